@@ -60,6 +60,8 @@ config_flags += -D__OSCONFIG_ENABLE_MULTIPROCESSORS # Use all cores
 
 #config_flags += -D__OSCONFIG_ENABLE_DEBUG_SHORTCUTS
 #config_flags += -D__OSCONFIG_TEST_KERNEL  # Enable kernel-mode testing suites of the operating system
+#config_flags += -D__OSCONFIG_MALLOC_THREAD_CACHE # Use the thread-caching allocator in libc instead of dlmalloc
+#config_flags += -D__OSCONFIG_BOOT_TIMELINE # Log when each service and driver was spawned, loaded and started
 
 # the init program that should be loaded [vioarr, cpptest, stest, wmsrv].app
 config_flags += -D__OSCONFIG_INIT_APP=\"vioarr.app\"
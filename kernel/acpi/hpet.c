@@ -477,7 +477,7 @@ HpInitialize(
                 ERROR("Failed to initialize periodic timer %" PRIiIN "", i);
             }
             else {
-                if (TimersRegisterSystemTimer(HpetController.Timers[i].Interrupt, 1000, HpGetTicks, HpResetTicks) != OsSuccess) {
+                if (TimersRegisterSystemTimer(HpetController.Timers[i].Interrupt, NSEC_PER_MSEC, HpGetTicks, HpResetTicks) != OsSuccess) {
                     ERROR("Failed register timer %" PRIiIN " as the system timer", i);
                 }
                 else {
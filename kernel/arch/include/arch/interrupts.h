@@ -47,6 +47,14 @@ InterruptConfigure(
     _In_ SystemInterrupt_t* Descriptor,
     _In_ int                Enable);
 
+/* InterruptSetAffinity
+ * Routes the interrupt to the given core, or back to the default routing of the interrupt
+ * controller if CoreId is UUID_INVALID. Returns OsNotSupported if the interrupt can't be routed. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptSetAffinity(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId);
+
 /* Interrupts
  * Used for manipulation of interrupt state. */
 KERNELAPI IntStatus_t KERNELABI InterruptDisable(void);
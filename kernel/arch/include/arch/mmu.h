@@ -176,10 +176,14 @@ ArchMmuSetVirtualPages(
 
 /**
  * ArchMmuClearVirtualPages
- * * Removes @PageCount number of virtual memory mappings.
+ * * Removes @PageCount number of virtual memory mappings. The physical pages that were
+ * * owned by the mappings are returned instead of released, as other cores may still have
+ * * them cached until the caller has invalidated the range.
  * @param MemorySpace    [In]
  * @param VirtualAddress [In]
  * @param PageCount      [In]
+ * @param FreedPages     [Out] Must have room for @PageCount entries.
+ * @param PagesFreed     [Out]
  * @param PagesCleared   [Out]
  * 
  * @return Status of the address mapping removal.
@@ -189,6 +193,8 @@ ArchMmuClearVirtualPages(
     _In_  SystemMemorySpace_t*,
     _In_  VirtualAddress_t,
     _In_  int,
+    _Out_ uintptr_t*,
+    _Out_ int*,
     _Out_ int*);
 
 /**
@@ -38,6 +38,13 @@ KERNELAPI OsStatus_t KERNELABI
 ArchGetSystemTime(
     _In_ SystemTime_t* SystemTime);
 
+/* ArchGetTimestampCounter
+ * Reads the cycle counter of the current core, which must also be readable from user space
+ * and tick at a constant rate. Returns OsNotSupported if there is no such counter. */
+KERNELAPI OsStatus_t KERNELABI
+ArchGetTimestampCounter(
+    _Out_ uint64_t* Value);
+
 /* ArchStallProcessorCore
  * Stalls the cpu for the given milliseconds, blocking call. */
 KERNELAPI void KERNELABI
@@ -137,6 +137,11 @@
 #define INTERRUPT_PHYSICAL_BASE 0x80
 #define INTERRUPT_PHYSICAL_END  0xE0
 
+// Message signaled interrupts are given unused vectors from the top of the hardware
+// range first, io-apic lines only reach this far on systems with more than 64 lines
+#define INTERRUPT_MSI_BASE      0xC0
+#define INTERRUPT_MSI_END       0xE0
+
 // High priority software interrupts
 #define INTERRUPT_SOFTWARE_BASE 0xE0
 #define INTERRUPT_SOFTWARE_END  0xF0
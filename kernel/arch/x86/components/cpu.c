@@ -24,6 +24,7 @@
 #define __MODULE "CCPU"
 
 #include <arch/interrupts.h>
+#include <arch/time.h>
 #include <arch/utils.h>
 #include <interrupts.h>
 #include <machine.h>
@@ -307,6 +308,33 @@ CpuInvalidateMemoryCache(
 
 extern void _rdtsc(uint64_t *Value);
 
+// 0 when not checked yet, 1 when the counter is invariant and -1 when it can't be used
+static int TscState = 0;
+
+OsStatus_t
+ArchGetTimestampCounter(
+    _Out_ uint64_t* Value)
+{
+    uint32_t CpuRegisters[4] = { 0 };
+
+    if (!TscState) {
+        TscState = -1;
+        if ((GetMachine()->Processor.Data[CPU_DATA_FEATURES_EDX] & CPUID_FEAT_EDX_TSC) &&
+            GetMachine()->Processor.Data[CPU_DATA_MAXEXTENDEDLEVEL] >= 0x80000007) {
+            __get_cpuid(0x80000007, CpuRegisters);
+            if (CpuRegisters[3] & CPUID_FEAT_EDX_INVARIANT_TSC) {
+                TscState = 1;
+            }
+        }
+    }
+
+    if (TscState < 0) {
+        return OsNotSupported;
+    }
+    _rdtsc(Value);
+    return OsSuccess;
+}
+
 void
 ArchStallProcessorCore(
     size_t MilliSeconds)
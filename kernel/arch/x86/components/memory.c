@@ -570,6 +570,8 @@ ArchMmuClearVirtualPages(
     _In_  SystemMemorySpace_t* MemorySpace,
     _In_  VirtualAddress_t     StartAddress,
     _In_  int                  PageCount,
+    _Out_ uintptr_t*           FreedPages,
+    _Out_ int*                 PagesFreed,
     _Out_ int*                 PagesCleared)
 {
     PAGE_MASTER_LEVEL* ParentDirectory;
@@ -580,6 +582,7 @@ ArchMmuClearVirtualPages(
     int                IsCurrent;
     int                Index;
     int                i      = 0;
+    int                Freed  = 0;
     OsStatus_t         Status = OsSuccess;
 
     Directory = MmVirtualGetMasterTable(MemorySpace, StartAddress, &ParentDirectory, &IsCurrent);
@@ -597,17 +600,15 @@ ArchMmuClearVirtualPages(
                 memory_invalidate_addr(StartAddress);
             }
             
-            // Release memory, but don't if it is a virtual mapping, that means we 
+            // Return the memory, but not if it is a virtual mapping, that means we 
             // should not free the physical page. We only do this if the memory
             // is marked as present, otherwise we don't
             if ((Mapping & PAGE_PRESENT) && !(Mapping & PAGE_PERSISTENT)) {
-                Mapping &= PAGE_MASK;
-                IrqSpinlockAcquire(&GetMachine()->PhysicalMemoryLock);
-                bounded_stack_push(&GetMachine()->PhysicalMemory, (void*)Mapping);
-                IrqSpinlockRelease(&GetMachine()->PhysicalMemoryLock);
+                FreedPages[Freed++] = Mapping & PAGE_MASK;
             }
         }
     }
+    *PagesFreed   = Freed;
     *PagesCleared = i;
     return Status;
 }
@@ -76,7 +76,7 @@ PitInitialize(void)
 	Interrupt.Pin                   = INTERRUPT_NONE;
 	Interrupt.Vectors[0]            = INTERRUPT_NONE;
 	Interrupt.FastInterrupt.Handler = PitInterrupt;
-	PitUnit.NsTick                  = 1000;
+	PitUnit.NsTick                  = NSEC_PER_MSEC;
 
 	PitUnit.Irq = InterruptRegister(&Interrupt, INTERRUPT_NOTSHARABLE | INTERRUPT_KERNEL);
 	if (PitUnit.Irq != UUID_INVALID) {
@@ -64,7 +64,7 @@ RtcInitialize(
 
     // Ms is .97, 1024 ints per sec
     // Frequency = 32768 >> (rate-1), 15 = 2, 14 = 4, 13 = 8/s (125 ms)
-    Chip->NsTick     = 976;
+    Chip->NsTick     = 976562;
     Chip->NsCounter  = 0;
     Chip->AlarmTicks = 0;
 
@@ -101,9 +101,11 @@ ThreadingYield(void)
 {
     // Never yield in interrupt handlers, could cause wierd stuff to happen
     // instead keep track of how nested we are, flag for yield and do it on the way
-    // out of last nesting to ensure we've run all interrupt handlers
+    // out of last nesting to ensure we've run all interrupt handlers. A core without an
+    // armed time-slice also needs the interrupt to let newly queued threads run
     if (InterruptGetActiveStatus()) {
-        if (ThreadingIsCurrentTaskIdle(ArchGetProcessorCoreId())) {
+        if (ThreadingIsCurrentTaskIdle(ArchGetProcessorCoreId()) ||
+            GetCurrentProcessorCore()->Scheduler.Tickless) {
             OsStatus_t Status = ApicSendInterrupt(InterruptSelf, UUID_INVALID, INTERRUPT_LAPIC);
             if (Status != OsSuccess) {
                 FATAL(FATAL_SCOPE_KERNEL, "Failed to deliver IPI signal");
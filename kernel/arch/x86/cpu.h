@@ -123,6 +123,9 @@ enum CpuFeatures {
 	CPUID_FEAT_EDX_PBE = 1 << 31
 };
 
+// Power management features contained in EDX of the extended leaf 0x80000007
+#define CPUID_FEAT_EDX_INVARIANT_TSC    (1 << 8)
+
 /* CpuInitializeFeatures
  * Initializes all onboard features on the running core. This can be extended features
  * as SSE, MMX, FPU, AVX etc */
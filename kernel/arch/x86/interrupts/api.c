@@ -141,6 +141,22 @@ AllocateSoftwareVector(
     else if (Interrupt->Line == INTERRUPT_NONE) {
         int Vectors[INTERRUPT_SOFTWARE_END - INTERRUPT_SOFTWARE_BASE];
         int i;
+
+        // Give MSI a vector of its own when one is free, so the handler of the
+        // vector never has to probe other devices
+        if (Flags & INTERRUPT_MSI) {
+            for (i = INTERRUPT_MSI_BASE; i < INTERRUPT_MSI_END; i++) {
+                if (InterruptGetPenalty(i) == 0) {
+                    return (UUId_t)i;
+                }
+            }
+            for (i = INTERRUPT_SOFTWARE_BASE; i < INTERRUPT_SOFTWARE_END; i++) {
+                if (InterruptGetPenalty(i) == 0) {
+                    return (UUId_t)i;
+                }
+            }
+        }
+
         for (i = 0; i < (INTERRUPT_SOFTWARE_END - INTERRUPT_SOFTWARE_BASE); i++) {
             Vectors[i] = (INTERRUPT_SOFTWARE_BASE + i);
         }
@@ -199,24 +215,27 @@ InterruptResolve(
 
     // In case of MSI interrupt, update msi format
     if (Flags & INTERRUPT_MSI) {
-        // Fill in MSI data
+        UUId_t DestinationId = GetMachine()->Processor.Cores->Id;
+
+        // Fill in MSI data, the message is delivered to the boot processor in physical
+        // destination mode, affinity is changed by reprogramming the device
         // MSI Message Address Register (0xFEE00000 LAPIC)
         // Bits 31-20: Must be 0xFEE
-        // Bits 19-11: Destination ID
+        // Bits 19-12: Destination APIC ID
         // Bits 11-04: Reserved
-        // Bit      3: 0 = Destination is ONE CPU, 1 = Destination is Group
+        // Bit      3: Redirection Hint (0 = Deliver to the destination only)
         // Bit      2: Destination Mode (1 Logical, 0 Physical)
         // Bits 00-01: X
-        Interrupt->MsiAddress = 0xFEE00000 | (0x0007F0000) | 0x8 | 0x4;
+        Interrupt->MsiAddress = 0xFEE00000 | ((DestinationId & 0xFF) << 12);
 
         // Message Data Register Format
         // Bits 31-16: Reserved
         // Bit     15: Trigger Mode (1 Level, 0 Edge)
         // Bit     14: If edge, this is not used, if level, 1 = Assert, 0 = Deassert
         // Bits 13-11: Reserved
-        // Bits 10-08: Delivery Mode, standard
+        // Bits 10-08: Delivery Mode, fixed
         // Bits 07-00: Vector
-        Interrupt->MsiValue = (0x100 | (*TableIndex & 0xFF));
+        Interrupt->MsiValue = (*TableIndex & 0xFF);
     }
     return OsSuccess;
 }
@@ -306,6 +325,53 @@ UpdateEntry:
     return OsSuccess;
 }
 
+OsStatus_t
+InterruptSetAffinity(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId)
+{
+    SystemInterruptController_t* Ic;
+    IntStatus_t                  InterruptStatus;
+    uint64_t                     ApicExisting;
+    uint64_t                     ApicFlags;
+    int                          Pin;
+
+    TRACE("InterruptSetAffinity(Id 0x%" PRIxIN ", CoreId %" PRIuIN ")", Descriptor->Id, CoreId);
+
+    // Only io-apic lines can be routed, MSI must be reprogrammed in the device
+    if ((Descriptor->Flags & (INTERRUPT_SOFT | INTERRUPT_MSI)) ||
+        GetApicInterruptMode() == InterruptModePic) {
+        return OsNotSupported;
+    }
+
+    Ic  = GetInterruptControllerByLine(Descriptor->Source);
+    Pin = GetPinOffsetByLine(Descriptor->Source);
+    if (Ic == NULL || Pin == APIC_NO_GSI) {
+        return OsError;
+    }
+
+    ApicFlags  = InterruptGetApicConfiguration(&Descriptor->Interrupt);
+    ApicFlags |= (Descriptor->Id & 0xFF);
+    if (CoreId != UUID_INVALID) {
+        // Fixed delivery in physical destination mode targets exactly one core
+        ApicFlags &= ~(APIC_FLAGS_DEFAULT | 0x100 | 0x800);
+        ApicFlags |= ((uint64_t)(CoreId & 0xFF) << 56);
+    }
+
+    // The destination and the mode are in different halves of the entry, so mask the line
+    // while it's rewritten. A level triggered line stays asserted while masked
+    InterruptStatus = InterruptDisable();
+    ApicExisting    = ApicReadIoEntry(Ic, Pin);
+    if (ApicExisting & APIC_MASKED) {
+        InterruptRestoreState(InterruptStatus);
+        return OsError;
+    }
+    ApicWriteIoEntry(Ic, Pin, ApicExisting | APIC_MASKED);
+    ApicWriteIoEntry(Ic, Pin, ApicFlags);
+    InterruptRestoreState(InterruptStatus);
+    return OsSuccess;
+}
+
 IntStatus_t
 InterruptDisable(void)
 {
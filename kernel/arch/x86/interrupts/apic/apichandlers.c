@@ -29,6 +29,26 @@
 
 extern size_t GlbTimerQuantum;
 
+// The timer quantum is the number of timer counts per millisecond
+static uint64_t
+ApicCountsToNanoseconds(
+    _In_ uint32_t Counts)
+{
+    return ((uint64_t)Counts * NSEC_PER_MSEC) / GlbTimerQuantum;
+}
+
+static uint32_t
+ApicNanosecondsToCounts(
+    _In_ uint64_t Nanoseconds)
+{
+    uint64_t MaxNanoseconds = ((uint64_t)UINT32_MAX * NSEC_PER_MSEC) / GlbTimerQuantum;
+    if (Nanoseconds >= MaxNanoseconds) {
+        // Deadlines beyond the range of the counter are reached in multiple steps
+        return UINT32_MAX;
+    }
+    return (uint32_t)MAX(1, ((Nanoseconds * GlbTimerQuantum) + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+}
+
 InterruptStatus_t
 ApicTimerHandler(
     _In_ FastInterruptResources_t* NotUsed,
@@ -37,15 +57,21 @@ ApicTimerHandler(
     _CRT_UNUSED(NotUsed);
     _CRT_UNUSED(Context);
     
+    uint32_t Initial      = ApicReadLocal(APIC_INITIAL_COUNT);
     uint32_t Count        = ApicReadLocal(APIC_CURRENT_COUNT);
-    uint32_t Passed       = ApicReadLocal(APIC_INITIAL_COUNT) - Count;
-    size_t   NextDeadline = 20;
-    if (Count != 0) {
-        ApicWriteLocal(APIC_INITIAL_COUNT, 0);
+    uint64_t NextDeadline = 20 * NSEC_PER_MSEC;
+
+    // Stop the timer, an expired one-shot keeps its initial count, and the next yield
+    // would be taken for another expiry if it was not cleared
+    ApicWriteLocal(APIC_INITIAL_COUNT, 0);
+
+    // The timer runs in one-shot mode, and is only armed when the scheduler has a
+    // deadline. Interrupts while the timer is disarmed are yields and never preemptive.
+    (void)ThreadingAdvance((Initial != 0 && Count == 0) ? 1 : 0,
+        ApicCountsToNanoseconds(Initial - Count), &NextDeadline);
+    if (NextDeadline != 0) {
+        ApicWriteLocal(APIC_INITIAL_COUNT, ApicNanosecondsToCounts(NextDeadline));
     }
-    
-    (void)ThreadingAdvance(Count == 0 ? 1 : 0, DIVUP(Passed, GlbTimerQuantum), &NextDeadline);
-    ApicWriteLocal(APIC_INITIAL_COUNT, GlbTimerQuantum * NextDeadline);
     return InterruptHandled;
 }
 
@@ -65,7 +65,7 @@
 typedef struct Pit {
 	UUId_t				Irq;
 	size_t				NsTick;
-	size_t				NsCounter;
+	uint64_t			NsCounter;
 	clock_t				Ticks;
 } Pit_t;
 
@@ -158,7 +158,7 @@ DebugPanic(
     vsprintf(&MessageBuffer[0], Message, Arguments);
     va_end(Arguments);
     LogSetRenderMode(1);
-    LogAppendMessage(LOG_ERROR, &MessageBuffer[0]);
+    LogAppendMessage(LOG_ERROR, "%s", &MessageBuffer[0]);
     
     // Log cpu and threads
     CurrentThread = GetCurrentThreadForCore(CoreId);
@@ -62,7 +62,7 @@ typedef struct HandleSetElement {
     // Event data
     UUId_t                   Handle;
     _Atomic(int)             ActiveEvents;
-    struct HandleSetElement* Link;
+    struct HandleSetElement* Link;     // Used to chain elements while the set is destroyed
     void*                    Context;
     Flags_t                  Configuration;
 } HandleSetElement_t;
@@ -77,19 +77,27 @@ static void
 DestroyHandleSet(
     _In_ void* Resource)
 {
-    HandleSet_t* Set = Resource;
-    rb_leaf_t*   Leaf;
+    HandleSet_t*        Set   = Resource;
+    HandleSetElement_t* Chain = NULL;
+    rb_leaf_t*          Leaf;
     WARNING("[handle_set] [destroy]");
     
-    do {
-        Leaf = rb_tree_minimum(&Set->Handles);
-        if (!Leaf) {
-            break;
-        }
-        
-        rb_tree_remove(&Set->Handles, Leaf->key);
-        DestroySetElement(Leaf->value);
-    } while (Leaf);
+    // The tree goes away with the set, so instead of removing the elements one by one
+    // and rebalancing for each, sweep it in order and chain the elements. They are only
+    // destroyed after the sweep, as the sweep still walks the leaves they contain.
+    Leaf = rb_tree_minimum(&Set->Handles);
+    while (Leaf) {
+        HandleSetElement_t* SetElement = Leaf->value;
+        SetElement->Link = Chain;
+        Chain            = SetElement;
+        Leaf             = rb_tree_next(&Set->Handles, Leaf);
+    }
+    
+    while (Chain) {
+        HandleSetElement_t* Next = Chain->Link;
+        DestroySetElement(Chain);
+        Chain = Next;
+    }
     kfree(Set);
 }
 
@@ -189,7 +197,7 @@ WaitForHandleSet(
     // Wait for response by 'polling' the value
     NumberOfEvents = atomic_exchange(&Set->Pending, 0);
     while (!NumberOfEvents) {
-        OsStatus_t Status = FutexWait(&Set->Pending, NumberOfEvents, 0, Timeout);
+        OsStatus_t Status = FutexWait(&Set->Pending, NumberOfEvents, FUTEX_WAIT_PRIVATE, Timeout);
         if (Status != OsSuccess) {
             return Status;
         }
@@ -232,7 +240,7 @@ MarkHandleCallback(
             
             Previous = atomic_fetch_add(&SetElement->Set->Pending, 1);
             if (!Previous) {
-                (void)FutexWake(&SetElement->Set->Pending, 1, 0);
+                (void)FutexWake(&SetElement->Set->Pending, 1, FUTEX_WAKE_PRIVATE);
             }
         }
     }
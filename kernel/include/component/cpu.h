@@ -35,6 +35,7 @@
 #include <os/osdefs.h>
 #include <ds/queue.h>
 #include <memoryspace.h>
+#include <memory_tlb.h>
 #include <threading.h>
 #include <scheduler.h>
 
@@ -77,6 +78,10 @@ typedef struct SystemCpuCore {
     Context_t*        InterruptRegisters;
     int               InterruptNesting;
     uint32_t          InterruptPriority;
+
+    // Lazy tlb state, the memory space family loaded by the core and the shootdown
+    // generation of that family at the time it was loaded
+    MemorySpaceTlb_t  Tlb;
     
     struct SystemCpuCore* Link;
 } SystemCpuCore_t;
@@ -92,7 +97,7 @@ typedef struct SystemCpu {
 } SystemCpu_t;
 
 #define SYSTEM_CORE_FN_STATE_INIT { QUEUE_INIT, QUEUE_INIT }
-#define SYSTEM_CPU_CORE_INIT      { UUID_INVALID, CpuStateUnavailable, 0, { 0 }, SCHEDULER_INIT, SYSTEM_CORE_FN_STATE_INIT, NULL, NULL, 0, 0, NULL }
+#define SYSTEM_CPU_CORE_INIT      { UUID_INVALID, CpuStateUnavailable, 0, { 0 }, SCHEDULER_INIT, SYSTEM_CORE_FN_STATE_INIT, NULL, NULL, 0, 0, { NULL, 0 }, NULL }
 #define SYSTEM_CPU_INIT           { { 0 }, { 0 }, { 0 }, 0, NULL, NULL }
 
 /**
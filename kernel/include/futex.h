@@ -71,4 +71,21 @@ FutexWakeOperation(
     _In_ int           Operation,
     _In_ int           Flags);
 
+/* FutexLockPi
+ * Locks a priority inheritance futex that is held by another thread. The owner runs at the
+ * priority of the waiter while it holds the futex, and the futex is handed directly to the
+ * waiter with the highest priority when it is unlocked. */
+KERNELAPI OsStatus_t KERNELABI
+FutexLockPi(
+    _In_ _Atomic(int)* Futex,
+    _In_ int           Flags,
+    _In_ size_t        Timeout);
+
+/* FutexUnlockPi
+ * Unlocks a priority inheritance futex that has waiters, must be called by the owner. */
+KERNELAPI OsStatus_t KERNELABI
+FutexUnlockPi(
+    _In_ _Atomic(int)* Futex,
+    _In_ int           Flags);
+
 #endif //!__FUTEX_H__
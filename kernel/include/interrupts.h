@@ -39,6 +39,7 @@ typedef struct SystemInterrupt {
     UUId_t                          Thread;
     Flags_t                         Flags;
     int                             Source;
+    unsigned int                    EventRingCapacity;
     struct SystemInterrupt*         Link;
 } SystemInterrupt_t;
 
@@ -131,6 +132,49 @@ InterruptGetLeastLoaded(
     _In_ int                Irqs[],
     _In_ int                Count);
 
+/* InterruptGetBalanceInfo
+ * Retrieves the source and the driver thread of the given table index. Returns OsDoesNotExist if
+ * the index has no interrupt, and OsNotSupported if the interrupt can't be balanced. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptGetBalanceInfo(
+    _In_  UUId_t  TableIndex,
+    _Out_ int*    Source,
+    _Out_ UUId_t* Thread);
+
+/* InterruptBalancerInitialize
+ * Starts the balancer thread that routes the interrupt lines to cores. */
+KERNELAPI void KERNELABI
+InterruptBalancerInitialize(void);
+
+/* InterruptBalancerReset
+ * Resets the statistics and the routing of a table index when it is (re)configured. */
+KERNELAPI void KERNELABI
+InterruptBalancerReset(
+    _In_ UUId_t TableIndex);
+
+/* InterruptBalancerUpdate
+ * Accounts a handled interrupt, and moves the line to its new core if the balancer has
+ * chosen one. This is invoked before the interrupt is acknowledged. */
+KERNELAPI void KERNELABI
+InterruptBalancerUpdate(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             TableIndex,
+    _In_ uint64_t           Cost);
+
+/* InterruptBalancerSetPolicy
+ * Changes the balancing policy, the new policy is applied in the next balancing period. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptBalancerSetPolicy(
+    _In_ int Policy);
+
+/* InterruptBalancerQuery
+ * Retrieves the balancing policy and the statistics of up to *Count table indices. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptBalancerQuery(
+    _Out_   int*                          Policy,
+    _Out_   InterruptBalanceStatistics_t* Statistics,
+    _InOut_ int*                          Count);
+
 /* AcpiGetPolarityMode
  * Returns whether or not the polarity is Active Low or Active High.
  * For Active Low = 1, Active High = 0 */
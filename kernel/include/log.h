@@ -34,6 +34,9 @@
 #define LOG_WARNING 3
 #define LOG_ERROR   4
 
+// The longest string argument a message can carry, the rest of the string is cut
+#define LOG_STRING_LENGTH 119
+
 /* LogInitialize
  * Initializes loggin data-structures and global variables
  * by setting everything to sane value */
@@ -41,7 +44,8 @@ KERNELAPI void KERNELABI
 LogInitialize(void);
 
 /* LogInitializeFull
- * Upgrades the log to a larger buffer, initializing pipes and installs the message thread. */
+ * Upgrades the log to a larger buffer, creates the per-core record rings and starts the log
+ * thread, which from then on formats and renders messages in the background. */
 KERNELAPI void KERNELABI
 LogInitializeFull(void);
 
@@ -53,12 +57,23 @@ LogSetRenderMode(
     _In_ int Enable);
 
 /* LogAppendMessage
- * Appends a new message of the given parameters to the global log object. If the buffer
- * reaches the end wrap-around will happen. */
+ * Appends a new message to the log of the calling core without formatting it. The format
+ * string must be static, as only the pointer is kept, while string arguments are copied and cut
+ * at LOG_STRING_LENGTH. If the ring is full the message is dropped. */
 KERNELAPI void KERNELABI
 LogAppendMessage(
     _In_ int         Type,
     _In_ const char* Message,
     ...);
 
+/* LogRead
+ * Reads formatted lines from the log history, starting at the line given by the cursor. The
+ * cursor is updated to the next unread line. Lines that have been overwritten are skipped. */
+KERNELAPI OsStatus_t KERNELABI
+LogRead(
+    _InOut_ size_t* Cursor,
+    _In_    char*   Buffer,
+    _In_    size_t  Length,
+    _Out_   size_t* BytesRead);
+
 #endif // !__LOGGING_INTERFACE__
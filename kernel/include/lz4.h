@@ -0,0 +1,38 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * LZ4 Implementation
+ *  - Decompression of raw LZ4 blocks, used for ramdisk modules
+ */
+
+#ifndef __VALI_LZ4_H__
+#define __VALI_LZ4_H__
+
+#include <os/osdefs.h>
+
+/* Lz4Decompress
+ * Decompresses a single raw LZ4 block into the destination buffer. The block is validated
+ * while decoding, and the decoded data must fill the destination buffer exactly. */
+KERNELAPI OsStatus_t KERNELABI
+Lz4Decompress(
+    _In_ const void* Source,
+    _In_ size_t      SourceLength,
+    _In_ void*       Destination,
+    _In_ size_t      DestinationLength);
+
+#endif //!__VALI_LZ4_H__
@@ -0,0 +1,111 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Memory Grant Interface
+ * - Read-only grants of memory from one memory space to another. Grants are kept
+ *   mapped between uses, so a buffer that is passed repeatedly between the same
+ *   pair of memory space contexts is only mapped once.
+ */
+
+#ifndef __MEMORY_GRANT_H__
+#define __MEMORY_GRANT_H__
+
+#include <os/osdefs.h>
+#include <memoryspace.h>
+
+// The number of unused grants that are kept mapped before the least recently
+// used ones are unmapped
+#define MEMORY_GRANT_MAX_CACHED 64
+
+typedef struct MemoryGrantStatistics {
+    size_t Acquires;
+    size_t Hits;
+    size_t Maps;
+    size_t Unmaps;
+    size_t Revokes;
+} MemoryGrantStatistics_t;
+
+/**
+ * MemoryGrantAcquire
+ * * Maps the pages of a buffer in the source memory space read-only into the target memory
+ * * space, or reuses an existing grant that covers the buffer. The grant must be released
+ * * again with MemoryGrantRelease.
+ * @param SourceSpace   [In]  The memory space that owns the buffer.
+ * @param TargetSpace   [In]  The memory space that should be given access.
+ * @param SourceAddress [In]  The address of the buffer in the source memory space.
+ * @param Length        [In]  The length of the buffer.
+ * @param TargetAddress [Out] The address of the buffer in the target memory space.
+ */
+KERNELAPI OsStatus_t KERNELABI
+MemoryGrantAcquire(
+    _In_  SystemMemorySpace_t* SourceSpace,
+    _In_  SystemMemorySpace_t* TargetSpace,
+    _In_  VirtualAddress_t     SourceAddress,
+    _In_  size_t               Length,
+    _Out_ VirtualAddress_t*    TargetAddress);
+
+/**
+ * MemoryGrantRelease
+ * * Releases a grant acquired by MemoryGrantAcquire. The mapping is kept for reuse until
+ * * it is evicted or revoked. Addresses that were not granted are simply unmapped.
+ * @param TargetSpace   [In] The memory space the grant was given to.
+ * @param TargetAddress [In] The address returned by MemoryGrantAcquire.
+ * @param Length        [In] The length of the buffer.
+ */
+KERNELAPI void KERNELABI
+MemoryGrantRelease(
+    _In_ SystemMemorySpace_t* TargetSpace,
+    _In_ VirtualAddress_t     TargetAddress,
+    _In_ size_t               Length);
+
+/**
+ * MemoryGrantRevokeRange
+ * * Revokes all grants of pages in the given range of the source memory space. Must be done
+ * * before the pages are released.
+ * @param SourceSpace [In]
+ * @param Address     [In]
+ * @param Length      [In]
+ */
+KERNELAPI void KERNELABI
+MemoryGrantRevokeRange(
+    _In_ SystemMemorySpace_t* SourceSpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ size_t               Length);
+
+/**
+ * MemoryGrantRevokeSpace
+ * * Revokes all grants that the memory space context is either the source or the target of,
+ * * when the memory space owns the context. Mappings in the target are removed before the
+ * * grants are freed.
+ * @param MemorySpace [In]
+ */
+KERNELAPI void KERNELABI
+MemoryGrantRevokeSpace(
+    _In_ SystemMemorySpace_t* MemorySpace);
+
+/**
+ * GetMemoryGrantStatistics
+ * * Retrieves the counters of the grant cache.
+ * @param Statistics [Out]
+ */
+KERNELAPI void KERNELABI
+GetMemoryGrantStatistics(
+    _Out_ MemoryGrantStatistics_t* Statistics);
+
+#endif //!__MEMORY_GRANT_H__
@@ -173,12 +173,12 @@ MemoryRegionWrite(
 
 /**
  * MemoryRegionGetSg
- * * Refreshes the current memory mapping to align with the memory region.
- * * This is neccessary for all users of an memory region that has been resized.
- * @param Handle        [In]
- * @param Memory        [In]
- * @param CurrentLength [In]
- * @param NewLength     [Out]
+ * * Retrieves the scatter-gather list of the committed pages of the memory region. The list
+ * * is cached by the region, so this is only a copy. If no list is provided the number of
+ * * entries is returned, otherwise the list is filled and the number of entries filled.
+ * @param Handle     [In]
+ * @param SgCountOut [In, Out] The size of the list provided, updated with the entry count.
+ * @param SgListOut  [Out]     The list to fill, or NULL to retrieve the count.
  */
 KERNELAPI OsStatus_t KERNELABI
 MemoryRegionGetSg(
@@ -0,0 +1,106 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Memory Space Tlb Interface
+ * - Tracks which memory space family every core has loaded into its tlb, and the
+ *   shootdown generation of the family at the time. Shootdowns use it to skip cores
+ *   that run another family or that have reloaded their tlb since the change.
+ */
+
+#ifndef __MEMORY_TLB_H__
+#define __MEMORY_TLB_H__
+
+#include <os/osdefs.h>
+#include <stdatomic.h>
+
+struct SystemMemorySpaceContext;
+
+#define MEMORY_TLB_FLUSH        0   // The core may cache the translations and must invalidate
+#define MEMORY_TLB_SKIP_LAZY    1   // The core does not have the family loaded
+#define MEMORY_TLB_SKIP_STALE   2   // The core reloaded its tlb after the generation was issued
+
+typedef struct MemorySpaceTlb {
+    _Atomic(struct SystemMemorySpaceContext*) Family;
+    _Atomic(unsigned int)                     Generation;
+} MemorySpaceTlb_t;
+
+/**
+ * MemoryTlbLoad
+ * * Publishes the family a core is about to load into its tlb. Must be called before the
+ * * tlb is reloaded, shootdowns issued before this are then covered by the reload, and
+ * * shootdowns issued after it will see the core as a target.
+ * @param Tlb              [In] The tlb state of the current core.
+ * @param Family           [In] The family that is loaded, NULL for kernel spaces.
+ * @param FamilyGeneration [In] The shootdown generation of the family.
+ */
+KERNELAPI void KERNELABI
+MemoryTlbLoad(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family,
+    _In_ _Atomic(unsigned int)*           FamilyGeneration);
+
+/**
+ * MemoryTlbIssue
+ * * Issues a new shootdown generation for a family. Must be called after the page tables
+ * * have been updated, and before the cores are checked with MemoryTlbIsTarget.
+ * @param FamilyGeneration [In] The shootdown generation of the family.
+ * @return The generation the shootdown should be sent with.
+ */
+KERNELAPI unsigned int KERNELABI
+MemoryTlbIssue(
+    _In_ _Atomic(unsigned int)* FamilyGeneration);
+
+/**
+ * MemoryTlbIsTarget
+ * * Whether a core must be interrupted for a shootdown of the family. Shootdowns without a
+ * * family concern all cores.
+ * @param Tlb    [In] The tlb state of the core.
+ * @param Family [In] The family of the shootdown, or NULL.
+ */
+KERNELAPI int KERNELABI
+MemoryTlbIsTarget(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family);
+
+/**
+ * MemoryTlbCheck
+ * * Called by a core that received a shootdown, to decide whether it has to invalidate.
+ * @param Tlb        [In] The tlb state of the current core.
+ * @param Family     [In] The family of the shootdown, or NULL.
+ * @param Generation [In] The generation the shootdown was issued with.
+ * @return One of the MEMORY_TLB_ values.
+ */
+KERNELAPI int KERNELABI
+MemoryTlbCheck(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family,
+    _In_ unsigned int                     Generation);
+
+/**
+ * MemoryTlbFlushed
+ * * Records that the current core flushed its entire tlb for a shootdown generation.
+ * @param Tlb        [In] The tlb state of the current core.
+ * @param Generation [In] The generation of the shootdown that was handled.
+ */
+KERNELAPI void KERNELABI
+MemoryTlbFlushed(
+    _In_ MemorySpaceTlb_t* Tlb,
+    _In_ unsigned int      Generation);
+
+#endif //!__MEMORY_TLB_H__
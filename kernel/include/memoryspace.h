@@ -53,6 +53,15 @@
 
 #define MAPPING_PHYSICAL_FIXED          0x00000001  // (Physical) Mappings are supplied
 
+/* SystemMemorySpace (Shootdown) Definitions
+ * Pending invalidations are kept as ranges, when there are too many ranges or pages
+ * in a batch the remote cores will flush their entire tlb instead. Physical pages and
+ * virtual ranges released by the batch are held until the invalidations are sent. */
+#define MEMORY_SHOOTDOWN_MAX_RANGES     8
+#define MEMORY_SHOOTDOWN_MAX_RELEASES   8
+#define MEMORY_SHOOTDOWN_MAX_FRAMES     32
+#define MEMORY_SHOOTDOWN_FLUSH_PAGES    32
+
 #define MAPPING_VIRTUAL_GLOBAL          0x00000002  // (Virtual) Mapping is done in global access memory
 #define MAPPING_VIRTUAL_PROCESS         0x00000004  // (Virtual) Mapping is process specific
 #define MAPPING_VIRTUAL_FIXED           0x00000008  // (Virtual) Mapping is supplied
@@ -66,9 +75,11 @@ typedef struct SystemMemoryMappingHandler {
 } SystemMemoryMappingHandler_t;
 
 typedef struct SystemMemorySpaceContext {
-    DynamicMemoryPool_t Heap;
-    list_t*             MemoryHandlers;
-    uintptr_t           SignalHandler;
+    DynamicMemoryPool_t   Heap;
+    list_t*               MemoryHandlers;
+    uintptr_t             SignalHandler;
+    uintptr_t             SystemPage;
+    _Atomic(unsigned int) TlbGeneration;
 } SystemMemorySpaceContext_t;
 
 typedef struct SystemMemorySpace {
@@ -78,6 +89,38 @@ typedef struct SystemMemorySpace {
     SystemMemorySpaceContext_t* Context;
 } SystemMemorySpace_t;
 
+typedef struct MemorySpaceShootdownRange {
+    uintptr_t Address;
+    size_t    Length;
+} MemorySpaceShootdownRange_t;
+
+typedef struct MemorySpaceShootdownRelease {
+    SystemMemorySpace_t* MemorySpace;
+    uintptr_t            Address;
+} MemorySpaceShootdownRelease_t;
+
+typedef struct MemorySpaceShootdown {
+    struct MemorySpaceShootdown*  Previous;
+    SystemMemorySpaceContext_t*   Family;      // NULL means every core must invalidate
+    int                           FullFlush;
+    size_t                        PageCount;
+    int                           RangeCount;
+    MemorySpaceShootdownRange_t   Ranges[MEMORY_SHOOTDOWN_MAX_RANGES];
+    int                           ReleaseCount;
+    MemorySpaceShootdownRelease_t Releases[MEMORY_SHOOTDOWN_MAX_RELEASES];
+    int                           FrameCount;
+    uintptr_t                     Frames[MEMORY_SHOOTDOWN_MAX_FRAMES];
+} MemorySpaceShootdown_t;
+
+typedef struct MemorySpaceShootdownStatistics {
+    size_t Requests;          // Changes that required remote invalidation
+    size_t Shootdowns;        // Batches sent to remote cores
+    size_t InterruptsSent;
+    size_t InterruptsSkipped; // Cores that were not running the memory space
+    size_t StaleSkipped;      // Cores that had already reloaded their tlb
+    size_t FullFlushes;
+} MemorySpaceShootdownStatistics_t;
+
 /* InitializeMemorySpace
  * Initializes the system memory space. This initializes a static version of the
  * system memory space which is the default space the cpu should use for kernel operation. */
@@ -292,6 +335,28 @@ IsMemorySpacePagePresent(
     _In_ SystemMemorySpace_t*   SystemMemorySpace,
     _In_ VirtualAddress_t       Address);
 
+/* MemorySpaceShootdownBegin
+ * Starts batching the tlb invalidations of the calling thread. Changes made until the
+ * batch is ended are sent to the other cores in as few interrupts as possible, and the
+ * physical pages and virtual ranges released by unmaps are not reused before the other
+ * cores have invalidated them.
+ * Batches can be nested, and the batch must stay valid until MemorySpaceShootdownEnd. */
+KERNELAPI void KERNELABI
+MemorySpaceShootdownBegin(
+    _In_ MemorySpaceShootdown_t* Batch);
+
+/* MemorySpaceShootdownEnd
+ * Sends all pending invalidations of the batch and ends it. */
+KERNELAPI void KERNELABI
+MemorySpaceShootdownEnd(
+    _In_ MemorySpaceShootdown_t* Batch);
+
+/* GetMemorySpaceShootdownStatistics
+ * Retrieves the counters of the tlb shootdown mechanism. */
+KERNELAPI void KERNELABI
+GetMemorySpaceShootdownStatistics(
+    _Out_ MemorySpaceShootdownStatistics_t* Statistics);
+
 /* GetMemorySpacePageSize
  * Retrieves the memory page-size used by the underlying architecture. */
 KERNELAPI size_t KERNELABI
@@ -65,6 +65,24 @@ RegisterModule(
     _In_ DevInfo_t          DeviceClass,
     _In_ DevInfo_t          DeviceSubclass);
 
+/* RegisterPackedModule
+ * Registers a new system module resource like RegisterModule, but the data is only validated
+ * against the given checksum and unpacked when the module is first loaded. Compression is one
+ * of the RAMDISK_COMPRESSION_* values. */
+KERNELAPI OsStatus_t KERNELABI
+RegisterPackedModule(
+    _In_ const char*        Path,
+    _In_ const void*        PackedData,
+    _In_ size_t             PackedLength,
+    _In_ size_t             Length,
+    _In_ int                Compression,
+    _In_ uint32_t           Crc32,
+    _In_ SystemModuleType_t Type,
+    _In_ DevInfo_t          VendorId,
+    _In_ DevInfo_t          DeviceId,
+    _In_ DevInfo_t          DeviceClass,
+    _In_ DevInfo_t          DeviceSubclass);
+
 /* SpawnServices
  * Loads all system services present in the initial ramdisk. */
 KERNELAPI void KERNELABI
@@ -72,7 +90,7 @@ SpawnServices(void);
 
 /* GetModuleDataByPath
  * Retrieve a pointer to the file-buffer and its length based on 
- * the given <rd:/> path */
+ * the given <rd:/> path. Packed modules are unpacked by the first call. */
 KERNELAPI OsStatus_t KERNELABI
 GetModuleDataByPath(
     _In_  MString_t* Path, 
@@ -26,6 +26,7 @@
 #include <os/osdefs.h>
 #include <os/types/process.h>
 #include <ds/list.h>
+#include <mutex.h>
 #include <time.h>
 
 typedef struct PeExecutable PeExecutable_t;
@@ -49,12 +50,27 @@ typedef struct SystemModule {
     const void* Data;
     size_t      Length;
 
+    // Modules from the ramdisk are validated and unpacked on first use, untill
+    // then Data is NULL and the packed data is described here
+    const void* PackedData;
+    size_t      PackedLength;
+    int         Compression;
+    uint32_t    Crc32;
+    Mutex_t     DataLock;
+
+    // Links for the lookup tables of the module manager
+    struct SystemModule* PathLink;
+    struct SystemModule* SpecificLink;
+    struct SystemModule* GenericLink;
+
     // Used by Module/Service type
     void*           InheritanceBlock;
     size_t          InheritanceBlockLength;
     void*           ArgumentBlock;
     size_t          ArgumentBlockLength;
+    clock_t         SpawnedAt;
     clock_t         StartedAt;
+    clock_t         LoadedAt;
     MString_t*      WorkingDirectory;
     MString_t*      BaseDirectory;
     UUId_t          PrimaryThreadId;
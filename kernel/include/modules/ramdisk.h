@@ -29,6 +29,7 @@
  * This is the magic signature, must be present in the ramdisk image file */
 #define RAMDISK_MAGIC               0x3144524D
 #define RAMDISK_VERSION_1           0x01
+#define RAMDISK_VERSION_2           0x02
 
 /* Supported architectures, must of course match
  * the architecture the kernel has been compiled with */
@@ -46,6 +47,11 @@
 #define RAMDISK_MODULE_SHARED       0x1
 #define RAMDISK_MODULE_SERVER       0x2
 
+/* Version 2 ramdisks can store module data compressed, the data is then
+ * unpacked the first time the module is loaded */
+#define RAMDISK_COMPRESSION_NONE    0x0
+#define RAMDISK_COMPRESSION_LZ4     0x1
+
 PACKED_TYPESTRUCT(SystemRamdiskHeader, {
     uint32_t Magic;
     uint32_t Version;
@@ -54,7 +60,8 @@ PACKED_TYPESTRUCT(SystemRamdiskHeader, {
 });
 
 // Entries are stored sequentially right after the header, they
-// point to an offset within
+// point to an offset within. In version 2 the entries are sorted by name, and
+// there are exactly FileCount entries before the data begins.
 PACKED_TYPESTRUCT(SystemRamdiskEntry, {
     uint8_t  Name[64];          // UTF-8 Encoded filename
     uint32_t Type;              // Check the ramdisk entry definitions
@@ -74,6 +81,22 @@ PACKED_TYPESTRUCT(SystemRamdiskModuleHeader, {
     uint32_t DeviceSubType;
 });
 
+// The version 2 module header extends the version 1 header with a description
+// of how the data is stored. Length and CRC describes the unpacked data.
+PACKED_TYPESTRUCT(SystemRamdiskModuleHeaderV2, {
+    uint32_t Flags;
+    uint32_t LengthOfData; // Excluding this header
+    uint32_t Crc32OfData;  // Excluding this header
+    
+    uint32_t VendorId;
+    uint32_t DeviceId;
+    uint32_t DeviceType;
+    uint32_t DeviceSubType;
+
+    uint32_t Compression;
+    uint32_t LengthOfStoredData;
+});
+
 /* ParseInitialRamdisk
  * Parses the supplied ramdisk by the bootloader. Without a ramdisk present only debug
  * functionality will be available. */
@@ -31,15 +31,21 @@
 #define MUTEX_PLAIN     0
 #define MUTEX_RECURSIVE 0x1
 #define MUTEX_TIMED     0x2
+#define MUTEX_INHERIT   0x4 // The owner runs at the priority of the waiters
+
+struct SystemThread;
+struct MutexSpinNode;
 
 typedef struct {
-    Flags_t      Flags;
-    UUId_t       Owner;
-    _Atomic(int) References;
-    _Atomic(int) Value;
+    Flags_t                        Flags;
+    UUId_t                         Owner;
+    _Atomic(int)                   References;
+    _Atomic(int)                   Value;
+    struct SystemThread*           OwnerThread;
+    _Atomic(struct MutexSpinNode*) SpinTail;
 } Mutex_t;
 
-#define OS_MUTEX_INIT(Flags) { Flags, UUID_INVALID, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0) }
+#define OS_MUTEX_INIT(Flags) { Flags, UUID_INVALID, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0), NULL, ATOMIC_VAR_INIT(NULL) }
 
 /**
  * * MutexConstruct
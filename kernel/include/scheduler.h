@@ -43,6 +43,12 @@ typedef struct list list_t;
 #define SCHEDULER_TIMESLICE_INITIAL     10
 #define SCHEDULER_BOOST                 10000
 
+// Sleeps are allowed to expire a little late, so wakeups that are close to each other
+// share a single timer interrupt. The slack is a fraction of the sleep, in nanoseconds
+#define SCHEDULER_SLACK_SHIFT           5
+#define SCHEDULER_SLACK_MIN             50000ULL
+#define SCHEDULER_SLACK_MAX             2000000ULL
+
 #define SCHEDULER_TIMEOUT_INFINITE      0
 #define SCHEDULER_SLEEP_OK              0
 #define SCHEDULER_SLEEP_INTERRUPTED     1
@@ -65,9 +71,11 @@ typedef struct SystemScheduler {
     _Atomic(int)           ObjectCount;
     _Atomic(unsigned long) Bandwidth;
     clock_t                LastBoost;
+    uint64_t               Clock;
+    int                    Tickless;
 } SystemScheduler_t;
 
-#define SCHEDULER_INIT { { 0 }, { 0 }, { { 0 } }, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0), 0 }
+#define SCHEDULER_INIT { { 0 }, { 0 }, { { 0 } }, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0), 0, 0, 0 }
 
 /* SchedulerCreateObject
  * Creates a new scheduling object and allocates a cpu core for the object.
@@ -98,23 +106,23 @@ SchedulerExpediteObject(
 
 /**
  * SchedulerSleep
- * * Blocks the currently running thread for @Milliseconds. Can return different
+ * * Blocks the currently running thread for @Nanoseconds. Can return different
  * * sleep-state results. SCHEDULER_SLEEP_OK or SCHEDULER_SLEEP_INTERRUPTED. 
  */
 KERNELAPI int KERNELABI
 SchedulerSleep(
-    _In_  size_t   Milliseconds,
+    _In_  uint64_t Nanoseconds,
     _Out_ clock_t* InterruptedAt);
 
 /**
  * SchedulerBlock
  * * Blocks the current scheduler object, and adds it to the given blocking queue.
- * 
+ * * The timeout is given in nanoseconds, SCHEDULER_TIMEOUT_INFINITE blocks until woken.
  */
 KERNELAPI void KERNELABI
 SchedulerBlock(
-    _In_ list_t* BlockQueue,
-    _In_ size_t  Timeout);
+    _In_ list_t*  BlockQueue,
+    _In_ uint64_t Timeout);
 
 /**
  * SchedulerGetTimeoutReason
@@ -124,18 +132,28 @@ SchedulerGetTimeoutReason(void);
 
 /* SchedulerAdvance 
  * This should be called by the underlying archteicture code
- * to get the next thread that is to be run. */
+ * to get the next thread that is to be run. The next deadline is given in nanoseconds
+ * from now, and is 0 if no timer interrupt is needed before the next event. */
 KERNELAPI void* KERNELABI
 SchedulerAdvance(
     _In_  SchedulerObject_t* Object,
     _In_  int                Preemptive,
-    _In_  size_t             MillisecondsPassed,
-    _Out_ size_t*            NextDeadlineOut);
+    _In_  uint64_t           NanosecondsPassed,
+    _Out_ uint64_t*          NextDeadlineOut);
 
 KERNELAPI int KERNELABI
 SchedulerObjectGetQueue(
     _In_ SchedulerObject_t*);
 
+/* SchedulerObjectInheritQueue
+ * Lets the object run at the given queue while that is a higher priority than its own
+ * queue, this is how priority inheritance boosts the owner of a lock. Passing
+ * SCHEDULER_LEVEL_COUNT removes the inherited queue. */
+KERNELAPI void KERNELABI
+SchedulerObjectInheritQueue(
+    _In_ SchedulerObject_t* Object,
+    _In_ int                Queue);
+
 KERNELAPI UUId_t KERNELABI
 SchedulerObjectGetAffinity(
     _In_ SchedulerObject_t*);
@@ -0,0 +1,58 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * System Page Interface
+ * - A single read-only page that is mapped into every application memory space and holds
+ *   the clocks and system values, so user space can read them without system calls.
+ */
+
+#ifndef __SYSTEM_PAGE_H__
+#define __SYSTEM_PAGE_H__
+
+#include <os/osdefs.h>
+#include <os/types/syspage.h>
+#include <memoryspace.h>
+
+/**
+ * SystemPageInitialize
+ * * Allocates the system page and fills in the values that never change.
+ */
+KERNELAPI OsStatus_t KERNELABI
+SystemPageInitialize(void);
+
+/**
+ * SystemPageUpdate
+ * * Publishes the current clocks and processor counts. This is called on every tick of the
+ * * system timer, and whenever the system time is synchronized.
+ */
+KERNELAPI void KERNELABI
+SystemPageUpdate(void);
+
+/**
+ * SystemPageMap
+ * * Maps the system page read-only into the given application memory space.
+ * @param MemorySpace [In]  The root memory space of the application.
+ * @param Address     [Out] The address of the system page in the memory space.
+ */
+KERNELAPI OsStatus_t KERNELABI
+SystemPageMap(
+    _In_  SystemMemorySpace_t* MemorySpace,
+    _Out_ VirtualAddress_t*    Address);
+
+#endif //!__SYSTEM_PAGE_H__
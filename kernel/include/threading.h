@@ -113,6 +113,9 @@ typedef struct SystemThread {
     uintptr_t               Data[THREADING_CONFIGDATA_COUNT];
     
     SignalSupport_t         Signaling;
+    
+    struct MemorySpaceShootdown* ShootdownBatch;
+    struct SyscallBatch*         SyscallBatch;
 } MCoreThread_t;
 
 /* ThreadingEnable
@@ -192,12 +195,13 @@ AreThreadsRelated(
 
 /* ThreadingAdvance
  * This is the thread-switch function and must be be called from the below architecture 
- * to get the next thread to run */
+ * to get the next thread to run. The next deadline is in nanoseconds, 0 means that no
+ * timer interrupt is needed until the core is woken by something else. */
 KERNELAPI OsStatus_t KERNELABI
 ThreadingAdvance(
-    _In_  int     Preemptive,
-    _In_  size_t  MillisecondsPassed,
-    _Out_ size_t* NextDeadlineOut);
+    _In_  int       Preemptive,
+    _In_  uint64_t  NanosecondsPassed,
+    _Out_ uint64_t* NextDeadlineOut);
 
 /* DisplayActiveThreads
  * Prints out debugging information about each thread in the system, only active threads */
@@ -27,12 +27,14 @@
 
 #include <arch.h>
 #include <arch/interrupts.h>
+#include <arch/time.h>
 #include <arch/utils.h>
 #include <assert.h>
 #include <component/cpu.h>
 #include <ddk/interrupt.h>
 #include <deviceio.h>
 #include <debug.h>
+#include <futex.h>
 #include <heap.h>
 #include <modules/manager.h>
 #include <memoryspace.h>
@@ -245,6 +247,88 @@ InterruptResolveMemoryResources(
     return Status;
 }
 
+/* InterruptCleanupEventRing
+ * Releases the kernel mapping of the interrupt event ring. */
+static OsStatus_t
+InterruptCleanupEventRing(
+    _In_ SystemInterrupt_t* Interrupt)
+{
+    InterruptEventRing_t* Ring = Interrupt->KernelResources.EventRing;
+    OsStatus_t            Status;
+
+    if (Ring == NULL) {
+        return OsSuccess;
+    }
+
+    Status = MemorySpaceUnmap(GetCurrentMemorySpace(), (uintptr_t)Ring,
+        INTERRUPT_EVENT_RING_SIZE(Interrupt->EventRingCapacity));
+    if (Status != OsSuccess) {
+        ERROR(" > failed to remove interrupt event ring mapping");
+        return Status;
+    }
+    Interrupt->KernelResources.EventRing = NULL;
+    return OsSuccess;
+}
+
+/* InterruptResolveEventRing
+ * Maps the event ring the driver shares with the fast-interrupt handler into kernel space. */
+static OsStatus_t
+InterruptResolveEventRing(
+    _In_ SystemInterrupt_t* Interrupt)
+{
+    InterruptEventRing_t* Ring = Interrupt->Interrupt.FastInterrupt.EventRing;
+    uintptr_t             UpdatedMapping;
+    unsigned int          Capacity;
+    OsStatus_t            Status;
+
+    if (Ring == NULL) {
+        return OsSuccess;
+    }
+
+    Capacity = Ring->Capacity;
+    if (((uintptr_t)Ring % GetMemorySpacePageSize()) != 0 ||
+        Capacity == 0 || (Capacity & (Capacity - 1)) != 0) {
+        ERROR(" > interrupt event ring was not page aligned or had an invalid capacity");
+        return OsInvalidParameters;
+    }
+
+    Status = CloneMemorySpaceMapping(GetCurrentMemorySpace(), GetCurrentMemorySpace(),
+        (VirtualAddress_t)Ring, &UpdatedMapping, INTERRUPT_EVENT_RING_SIZE(Capacity),
+        MAPPING_COMMIT | MAPPING_PERSISTENT, MAPPING_VIRTUAL_GLOBAL | MAPPING_PHYSICAL_FIXED);
+    if (Status != OsSuccess) {
+        ERROR(" > failed to clone interrupt event ring mapping");
+        return Status;
+    }
+    
+    // Keep our own copy of the capacity, the driver can still write to the ring
+    Interrupt->KernelResources.EventRing = (InterruptEventRing_t*)UpdatedMapping;
+    Interrupt->EventRingCapacity         = Capacity;
+    return OsSuccess;
+}
+
+/* InterruptNotifyEventRing
+ * Wakes the driver if it isn't already draining the ring, when the first event arrives in an
+ * empty ring or when enough events are pending. After the first event the driver waits up to
+ * its moderation delay for more events to arrive, and is woken early once MaxEvents are pending. */
+static void
+InterruptNotifyEventRing(
+    _In_ InterruptEventRing_t* Ring)
+{
+    unsigned int Pending;
+    int          Expected = INTERRUPT_EVENT_RING_WAITING;
+
+    atomic_fetch_add(&Ring->Statistics.Interrupts, 1);
+    Pending = atomic_load(&Ring->Head) - atomic_load(&Ring->Tail);
+    if (Pending != 1 && Pending < READ_VOLATILE(Ring->MaxEvents)) {
+        return;
+    }
+
+    if (atomic_compare_exchange_strong(&Ring->State, &Expected, INTERRUPT_EVENT_RING_DRAINING)) {
+        atomic_fetch_add(&Ring->Statistics.Wakeups, 1);
+        (void)FutexWake(&Ring->State, 1, 0);
+    }
+}
+
 /* InterruptResolveResources
  * Maps the neccessary fast-interrupt resources into kernel space
  * and allowing the interrupt handler to access the requested memory spaces. */
@@ -290,6 +374,12 @@ InterruptResolveResources(
         ERROR(" > failed to remap interrupt memory resources");
         return OsError;
     }
+
+    TRACE(" > remapping event-ring");
+    if (InterruptResolveEventRing(Interrupt) != OsSuccess) {
+        ERROR(" > failed to remap interrupt event ring");
+        return OsError;
+    }
     return OsSuccess;
 }
 
@@ -328,6 +418,11 @@ InterruptReleaseResources(
         ERROR(" > failed to cleanup interrupt memory resources");
         return OsError;
     }
+
+    if (InterruptCleanupEventRing(Interrupt) != OsSuccess) {
+        ERROR(" > failed to cleanup interrupt event ring");
+        return OsError;
+    }
     return OsSuccess;
 }
 
@@ -339,6 +434,7 @@ InterruptRegister(
     SystemInterrupt_t* Entry;
     UUId_t             TableIndex;
     UUId_t             Id;
+    int                FirstEntry = 0;
 
     TRACE("InterruptRegister(Line %i Pin %i, Vector %i, Flags 0x%" PRIxIN ")",
         Interrupt->Line, Interrupt->Pin, Interrupt->Vectors[0], Flags);
@@ -411,6 +507,7 @@ InterruptRegister(
         InterruptTable[TableIndex].Descriptor = Entry;
         InterruptTable[TableIndex].Penalty    = 1;
         InterruptTable[TableIndex].Sharable   = (Flags & INTERRUPT_NOTSHARABLE) ? 0 : 1;
+        FirstEntry = 1;
     }
     else {
         // Insert and increase penalty
@@ -426,6 +523,11 @@ InterruptRegister(
         ERROR("Failed to enable source %" PRIiIN "", Entry->Source);
     }
     IrqSpinlockRelease(&InterruptTableSyncObject);
+
+    // The line was configured with the default routing
+    if (FirstEntry) {
+        InterruptBalancerReset(TableIndex);
+    }
     TRACE("Interrupt Id 0x%" PRIxIN " (Handler 0x%" PRIxIN ", Context 0x%" PRIxIN ")",
         Entry->Id, Entry->Interrupt.FastInterrupt.Handler, Entry->Interrupt.Context);
     return Entry->Id;
@@ -516,6 +618,35 @@ InterruptGet(
     return NULL;
 }
 
+OsStatus_t
+InterruptGetBalanceInfo(
+    _In_  UUId_t  TableIndex,
+    _Out_ int*    Source,
+    _Out_ UUId_t* Thread)
+{
+    SystemInterrupt_t* Entry;
+    OsStatus_t         Status = OsDoesNotExist;
+
+    if (TableIndex >= MAX_SUPPORTED_INTERRUPTS) {
+        return OsInvalidParameters;
+    }
+
+    // Kernel interrupts stay with the interrupt controller, and only lines can be routed
+    IrqSpinlockAcquire(&InterruptTableSyncObject);
+    Entry = InterruptTable[TableIndex].Descriptor;
+    if (Entry != NULL) {
+        *Source = Entry->Source;
+        *Thread = Entry->Thread;
+        Status  = OsSuccess;
+        if (Entry->Source == INTERRUPT_NONE ||
+            (Entry->Flags & (INTERRUPT_KERNEL | INTERRUPT_SOFT | INTERRUPT_MSI))) {
+            Status = OsNotSupported;
+        }
+    }
+    IrqSpinlockRelease(&InterruptTableSyncObject);
+    return Status;
+}
+
 SystemInterrupt_t*
 InterruptGetIndex(
    _In_ UUId_t TableIndex)
@@ -551,6 +682,8 @@ InterruptHandle(
     uint32_t           Priority = InterruptsGetPriority();
     int                Source   = INTERRUPT_NONE;
     InterruptStatus_t  Result   = InterruptNotHandled;
+    uint64_t           Start    = 0;
+    uint64_t           End      = 0;
     SystemInterrupt_t* Entry;
     InterruptsSetPriority(TableIndex);
 
@@ -565,6 +698,7 @@ InterruptHandle(
 #endif
 
     // Update current status
+    (void)ArchGetTimestampCounter(&Start);
     Entry = InterruptTable[TableIndex].Descriptor;
     while (Entry != NULL) {
         if (Entry->Flags & INTERRUPT_KERNEL) {
@@ -580,8 +714,12 @@ InterruptHandle(
             Result = Entry->KernelResources.Handler(GetFastInterruptTable(), NULL);
             if (Result != InterruptNotHandled) {
                 // We have the InterruptHandledStop as a marker to identify
-                // when it's not neccessary to further send an interrupt notification
-                if ((Entry->Flags & INTERRUPT_USERSPACE) != 0 && Result != InterruptHandledStop) {
+                // when it's not neccessary to further send an interrupt notification. Drivers
+                // with an event ring are notified through the ring instead of SIGINT
+                if (Entry->KernelResources.EventRing != NULL) {
+                    InterruptNotifyEventRing(Entry->KernelResources.EventRing);
+                }
+                else if ((Entry->Flags & INTERRUPT_USERSPACE) != 0 && Result != InterruptHandledStop) {
                     (void)SignalSend(Entry->Thread, SIGINT, Entry->Interrupt.Context);
                 }
                 Source = Entry->Source;
@@ -590,6 +728,12 @@ InterruptHandle(
         }
         Entry = Entry->Link;
     }
+
+    // Account the handler cost, and move the line before it's acknowledged
+    if (Entry != NULL) {
+        (void)ArchGetTimestampCounter(&End);
+        InterruptBalancerUpdate(Entry, TableIndex, End - Start);
+    }
     
     InterruptsAcknowledge(Source, TableIndex);
     
@@ -0,0 +1,326 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Interrupt Balancer
+ * - Measures the rate and handler cost of every interrupt line, and periodically chooses
+ *   the core each line is routed to. The interrupt handler applies the choice the next time
+ *   the line fires, so a line is only rewritten right after it was serviced.
+ */
+
+#define __MODULE "IBAL"
+//#define __TRACE
+
+#include <arch.h>
+#include <arch/interrupts.h>
+#include <component/cpu.h>
+#include <debug.h>
+#include <handle.h>
+#include <interrupts.h>
+#include <irq_spinlock.h>
+#include <machine.h>
+#include <scheduler.h>
+#include <string.h>
+#include <threading.h>
+
+#define INTERRUPT_BALANCE_INTERVAL  1000    // Milliseconds between each balancing period
+#define INTERRUPT_BALANCE_MAX_CORES 64
+#define INTERRUPT_BALANCE_TOLERANCE 8       // Lines stay on a core within 1/8th of the average load
+
+typedef struct InterruptBalanceEntry {
+    _Atomic(unsigned int) Count;
+    _Atomic(UUId_t)       TargetCore;   // The core chosen by the balancer
+    _Atomic(UUId_t)       CoreId;       // The core the line is routed to
+    uint64_t              Cost;         // Only written by the core that handles the line
+    unsigned int          LastCount;
+    uint64_t              LastCost;
+    uint64_t              Load;
+    unsigned int          Rate;
+    unsigned int          Migrations;
+} InterruptBalanceEntry_t;
+
+static InterruptBalanceEntry_t BalanceTable[MAX_SUPPORTED_INTERRUPTS];
+static IrqSpinlock_t           BalanceSyncObject = OS_IRQ_SPINLOCK_INIT;
+static _Atomic(int)            BalancePolicy     = ATOMIC_VAR_INIT(INTERRUPT_BALANCE_SPREAD);
+
+static int
+GetRunningCores(
+    _In_ UUId_t Cores[])
+{
+    SystemCpuCore_t* Core  = GetMachine()->Processor.Cores;
+    int              Count = 0;
+
+    while (Core != NULL && Count < INTERRUPT_BALANCE_MAX_CORES) {
+        if (READ_VOLATILE(Core->State) & CpuStateRunning) {
+            Cores[Count++] = Core->Id;
+        }
+        Core = Core->Link;
+    }
+    return Count;
+}
+
+static int
+GetCoreIndex(
+    _In_ UUId_t Cores[],
+    _In_ int    CoreCount,
+    _In_ UUId_t CoreId)
+{
+    for (int i = 0; i < CoreCount; i++) {
+        if (Cores[i] == CoreId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* SampleStatistics
+ * Updates the rate and the load of each table index from the counters of the last period. The
+ * load is the handler cost, or the number of interrupts if there is no timestamp counter. */
+static void
+SampleStatistics(void)
+{
+    IrqSpinlockAcquire(&BalanceSyncObject);
+    for (int i = 0; i < MAX_SUPPORTED_INTERRUPTS; i++) {
+        InterruptBalanceEntry_t* Entry = &BalanceTable[i];
+        unsigned int             Count = atomic_load(&Entry->Count);
+        uint64_t                 Cost  = READ_VOLATILE(Entry->Cost);
+        unsigned int             CountDelta = Count - Entry->LastCount;
+        uint64_t                 CostDelta  = Cost - Entry->LastCost;
+
+        Entry->LastCount = Count;
+        Entry->LastCost  = Cost;
+        Entry->Rate      = (unsigned int)(((uint64_t)CountDelta * 1000) / INTERRUPT_BALANCE_INTERVAL);
+        Entry->Load      = (Entry->Load + (CostDelta ? CostDelta : CountDelta)) / 2;
+    }
+    IrqSpinlockRelease(&BalanceSyncObject);
+}
+
+/* GetDriverCore
+ * Retrieves the core the driver thread of an interrupt is running on. */
+static UUId_t
+GetDriverCore(
+    _In_ UUId_t ThreadHandle)
+{
+    MCoreThread_t* Thread = (MCoreThread_t*)LookupHandleOfType(ThreadHandle, HandleTypeThread);
+    if (Thread == NULL || Thread->SchedulerObject == NULL) {
+        return UUID_INVALID;
+    }
+    return SchedulerObjectGetAffinity(Thread->SchedulerObject);
+}
+
+/* BalanceLines
+ * Chooses a core for every line that can be balanced. Spreading is a greedy assignment of the
+ * heaviest lines to the least loaded core, but a line stays on its current core as long as that
+ * core is within the tolerance of the least loaded core, so lines don't bounce between cores. */
+static void
+BalanceLines(
+    _In_ int Policy)
+{
+    UUId_t   Cores[INTERRUPT_BALANCE_MAX_CORES];
+    uint64_t CoreLoads[INTERRUPT_BALANCE_MAX_CORES] = { 0 };
+    UUId_t   Lines[MAX_SUPPORTED_INTERRUPTS];
+    int      LineCount = 0;
+    int      CoreCount;
+    uint64_t TotalLoad = 0;
+    uint64_t Tolerance;
+    UUId_t   Thread;
+    int      Source;
+
+    // Routing to a single core gains nothing, leave it to the controller
+    CoreCount = GetRunningCores(&Cores[0]);
+    if (CoreCount < 2) {
+        Policy = INTERRUPT_BALANCE_NONE;
+    }
+
+    for (int i = 0; i < MAX_SUPPORTED_INTERRUPTS; i++) {
+        InterruptBalanceEntry_t* Entry = &BalanceTable[i];
+        UUId_t                   Target;
+        int                      j;
+
+        if (InterruptGetBalanceInfo((UUId_t)i, &Source, &Thread) != OsSuccess) {
+            continue;
+        }
+
+        if (Policy == INTERRUPT_BALANCE_NONE) {
+            atomic_store(&Entry->TargetCore, UUID_INVALID);
+        }
+        else if (Policy == INTERRUPT_BALANCE_COLOCATE) {
+            Target = GetDriverCore(Thread);
+            if (GetCoreIndex(&Cores[0], CoreCount, Target) != -1) {
+                atomic_store(&Entry->TargetCore, Target);
+            }
+        }
+        else if (Entry->Load != 0) {
+            // Keep the lines sorted by load, heaviest first
+            for (j = LineCount; j > 0 && BalanceTable[Lines[j - 1]].Load < Entry->Load; j--) {
+                Lines[j] = Lines[j - 1];
+            }
+            Lines[j] = (UUId_t)i;
+            TotalLoad += Entry->Load;
+            LineCount++;
+        }
+    }
+
+    if (!LineCount) {
+        return;
+    }
+
+    Tolerance = (TotalLoad / (uint64_t)CoreCount) / INTERRUPT_BALANCE_TOLERANCE;
+    for (int i = 0; i < LineCount; i++) {
+        InterruptBalanceEntry_t* Entry   = &BalanceTable[Lines[i]];
+        int                      Current = GetCoreIndex(&Cores[0], CoreCount, atomic_load(&Entry->CoreId));
+        int                      Best    = 0;
+
+        for (int j = 1; j < CoreCount; j++) {
+            if (CoreLoads[j] < CoreLoads[Best]) {
+                Best = j;
+            }
+        }
+
+        if (Current != -1 && CoreLoads[Current] <= CoreLoads[Best] + Tolerance) {
+            Best = Current;
+        }
+        CoreLoads[Best] += Entry->Load;
+        atomic_store(&Entry->TargetCore, Cores[Best]);
+        TRACE("[balancer] line %u => core %u (load %llu)", Lines[i], Cores[Best], Entry->Load);
+    }
+}
+
+static void
+InterruptBalancerThread(
+    _In_Opt_ void* Arguments)
+{
+    clock_t Interrupted;
+    _CRT_UNUSED(Arguments);
+
+    while (1) {
+        SchedulerSleep(INTERRUPT_BALANCE_INTERVAL * NSEC_PER_MSEC, &Interrupted);
+        SampleStatistics();
+        BalanceLines(atomic_load(&BalancePolicy));
+    }
+}
+
+void
+InterruptBalancerInitialize(void)
+{
+    UUId_t ThreadHandle;
+
+    for (int i = 0; i < MAX_SUPPORTED_INTERRUPTS; i++) {
+        InterruptBalancerReset((UUId_t)i);
+    }
+
+    if (CreateThread("irq-balancer", InterruptBalancerThread, NULL, 0, UUID_INVALID, &ThreadHandle) != OsSuccess) {
+        ERROR("[balancer] failed to create the balancer thread, interrupts are not balanced");
+    }
+}
+
+void
+InterruptBalancerReset(
+    _In_ UUId_t TableIndex)
+{
+    InterruptBalanceEntry_t* Entry;
+
+    if (TableIndex >= MAX_SUPPORTED_INTERRUPTS) {
+        return;
+    }
+
+    Entry = &BalanceTable[TableIndex];
+    IrqSpinlockAcquire(&BalanceSyncObject);
+    atomic_store(&Entry->Count, 0);
+    atomic_store(&Entry->TargetCore, UUID_INVALID);
+    atomic_store(&Entry->CoreId, UUID_INVALID);
+    Entry->Cost       = 0;
+    Entry->LastCount  = 0;
+    Entry->LastCost   = 0;
+    Entry->Load       = 0;
+    Entry->Rate       = 0;
+    Entry->Migrations = 0;
+    IrqSpinlockRelease(&BalanceSyncObject);
+}
+
+void
+InterruptBalancerUpdate(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             TableIndex,
+    _In_ uint64_t           Cost)
+{
+    InterruptBalanceEntry_t* Entry = &BalanceTable[TableIndex];
+    UUId_t                   Target;
+    UUId_t                   Current;
+
+    atomic_fetch_add(&Entry->Count, 1);
+    Entry->Cost += Cost;
+
+    // Only one core may move the line, and a line that can't be routed keeps its routing
+    Target  = atomic_load(&Entry->TargetCore);
+    Current = atomic_load(&Entry->CoreId);
+    if (Target != Current && atomic_compare_exchange_strong(&Entry->CoreId, &Current, Target)) {
+        if (InterruptSetAffinity(Descriptor, Target) == OsSuccess) {
+            Entry->Migrations++;
+        }
+        else {
+            atomic_store(&Entry->CoreId, Current);
+            atomic_store(&Entry->TargetCore, Current);
+        }
+    }
+}
+
+OsStatus_t
+InterruptBalancerSetPolicy(
+    _In_ int Policy)
+{
+    if (Policy < INTERRUPT_BALANCE_NONE || Policy > INTERRUPT_BALANCE_COLOCATE) {
+        return OsInvalidParameters;
+    }
+    atomic_store(&BalancePolicy, Policy);
+    return OsSuccess;
+}
+
+OsStatus_t
+InterruptBalancerQuery(
+    _Out_   int*                          Policy,
+    _Out_   InterruptBalanceStatistics_t* Statistics,
+    _InOut_ int*                          Count)
+{
+    InterruptBalanceStatistics_t Line;
+    UUId_t                       Thread;
+    int                          Source;
+    int                          Filled = 0;
+
+    *Policy = atomic_load(&BalancePolicy);
+    for (int i = 0; i < MAX_SUPPORTED_INTERRUPTS && Filled < *Count; i++) {
+        InterruptBalanceEntry_t* Entry = &BalanceTable[i];
+        if (InterruptGetBalanceInfo((UUId_t)i, &Source, &Thread) == OsDoesNotExist) {
+            continue;
+        }
+
+        // Take a copy, the statistics are written to user memory without the lock
+        IrqSpinlockAcquire(&BalanceSyncObject);
+        Line.TableIndex = (UUId_t)i;
+        Line.Source     = Source;
+        Line.CoreId     = atomic_load(&Entry->CoreId);
+        Line.Count      = atomic_load(&Entry->Count);
+        Line.Rate       = Entry->Rate;
+        Line.Cost       = Line.Count ? (Entry->Cost / Line.Count) : 0;
+        Line.Migrations = Entry->Migrations;
+        IrqSpinlockRelease(&BalanceSyncObject);
+        memcpy(&Statistics[Filled++], &Line, sizeof(InterruptBalanceStatistics_t));
+    }
+    *Count = Filled;
+    return OsSuccess;
+}
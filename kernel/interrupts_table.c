@@ -24,6 +24,7 @@
 #include <arch/io.h>
 #include <ddk/interrupt.h>
 #include <interrupts.h>
+#include <stddef.h>
 
 static FastInterruptResources_t FastInterruptTable = { 0 };
 
@@ -61,9 +62,42 @@ TableFunctionWriteIoSpace(
     return OsError;
 }
 
+// PostEvent
+static OsStatus_t
+TableFunctionPostEvent(
+    _In_ FastInterruptResources_t* Resources,
+    _In_ size_t                    Event)
+{
+    InterruptEventRing_t* Ring = Resources->ResourceTable->EventRing;
+    SystemInterrupt_t*    Interrupt;
+    unsigned int          Head;
+    
+    if (Ring == NULL) {
+        return OsNotSupported;
+    }
+    
+    // The resource table is the kernel copy inside the interrupt, which holds the capacity
+    // that was validated when the ring was mapped
+    Interrupt = (SystemInterrupt_t*)((uintptr_t)Resources->ResourceTable -
+        offsetof(SystemInterrupt_t, KernelResources));
+    
+    // Only the kernel moves the head, so the ring is full when the driver is behind
+    Head = atomic_load_explicit(&Ring->Head, memory_order_relaxed);
+    if ((Head - atomic_load_explicit(&Ring->Tail, memory_order_acquire)) >= Interrupt->EventRingCapacity) {
+        atomic_fetch_add(&Ring->Statistics.Dropped, 1);
+        return OsOutOfMemory;
+    }
+    
+    Ring->Events[Head & (Interrupt->EventRingCapacity - 1)] = Event;
+    atomic_store_explicit(&Ring->Head, Head + 1, memory_order_release);
+    atomic_fetch_add(&Ring->Statistics.Events, 1);
+    return OsSuccess;
+}
+
 void
 InitializeInterruptTable(void)
 {
     FastInterruptTable.ReadIoSpace  = TableFunctionReadIoSpace;
     FastInterruptTable.WriteIoSpace = TableFunctionWriteIoSpace;
+    FastInterruptTable.PostEvent    = TableFunctionPostEvent;
 }
@@ -40,6 +40,7 @@
 #include <interrupts.h>
 #include <scheduler.h>
 #include <stdio.h>
+#include <system_page.h>
 #include <threading.h>
 #include <timers.h>
 
@@ -156,6 +157,7 @@ InitializeMachine(
         ArchProcessorIdle();
     }
     LogInitializeFull();
+    InterruptBalancerInitialize();
     
     Status = InitializeHandleJanitor();
     if (Status != OsSuccess) {
@@ -174,6 +176,13 @@ InitializeMachine(
     }
 #endif
 
+    // The system page must exist before the first application memory space
+    Status = SystemPageInitialize();
+    if (Status != OsSuccess) {
+        ERROR("Failed to initialize the system page.");
+        ArchProcessorHalt();
+    }
+
     // Last step is to enable timers that kickstart all other threads
     Status = InitializeSystemTimers();
     if (Status != OsSuccess) {
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <ddk/io.h>
 #include <debug.h>
+#include <ds/bitmap.h>
 #include <ds/list.h>
 #include <heap.h>
 #include <mutex.h>
@@ -41,12 +42,15 @@
 #define MEMORY_SLAB_ELEMENT(Cache, Slab, Element)   (void*)((uintptr_t)Slab->Address + (Element * (Cache->ObjectSize + Cache->ObjectPadding)))
 
 // Slab size is equal to a page size, and memory layout of a slab is as below
-// FreeBitmap | Object | Object | Object |
+// MemorySlab_t | FreeBitmap Words | Object | Object | Object |
+// The free map is small enough to never get search summaries, so creating a slab
+// does not allocate anything besides the slab itself
 typedef struct MemorySlab {
     element_t  Header;
     int        NumberOfFreeObjects;
     uintptr_t* Address;  // Points to first object
-    uint8_t*   FreeBitmap;
+    Bitmap_t   FreeBitmap;
+    int        SearchIndex;
 } MemorySlab_t;
 
 // Memory Atomic Cache is followed directly by the buffer area for pointers
@@ -159,20 +163,15 @@ slab_allocate_index(
     _In_ MemoryCache_t* Cache,
     _In_ MemorySlab_t*  Slab)
 {
-    int i;
+    int Index;
     
     assert(Slab->NumberOfFreeObjects <= Cache->ObjectCount);
-    for (i = 0; i < (int)Cache->ObjectCount; i++) {
-        unsigned Block  = i / 8;
-        unsigned Offset = i % 8;
-        uint8_t  Bit    = (1u << Offset);
-        if (!(Slab->FreeBitmap[Block] & Bit)) {
-            Slab->FreeBitmap[Block] |= Bit;
-            Slab->NumberOfFreeObjects--;
-            return i;
-        }
+    Index = BitmapFindBits(&Slab->FreeBitmap, &Slab->SearchIndex, 1);
+    if (Index != -1) {
+        BitmapSetBits(&Slab->FreeBitmap, &Slab->SearchIndex, Index, 1);
+        Slab->NumberOfFreeObjects--;
     }
-    return -1;
+    return Index;
 }
 
 static void
@@ -181,12 +180,9 @@ slab_free_index(
     _In_ MemorySlab_t*  Slab,
     _In_ int            Index)
 {
-    unsigned Block  = Index / 8;
-    unsigned Offset = Index % 8;
-    uint8_t  Bit    = (1u << Offset);
     assert(Slab->NumberOfFreeObjects < Cache->ObjectCount);
     if (Index < (int)Cache->ObjectCount) {
-        Slab->FreeBitmap[Block] &= ~(Bit);
+        BitmapClearBits(&Slab->FreeBitmap, &Slab->SearchIndex, Index, 1);
         Slab->NumberOfFreeObjects++;
     }
 }
@@ -293,8 +289,15 @@ slab_create(
 
     ELEMENT_INIT(&Slab->Header, 0, Slab);
     Slab->NumberOfFreeObjects = Cache->ObjectCount;
-    Slab->FreeBitmap          = (uint8_t*)((uintptr_t)Slab + sizeof(MemorySlab_t));
     Slab->Address             = (uintptr_t*)ObjectAddress;
+
+    // Mark the bits after the last object in the last word as allocated
+    BitmapConstruct(&Slab->FreeBitmap, (size_t*)((uintptr_t)Slab + sizeof(MemorySlab_t)),
+        DIVUP(Cache->ObjectCount, __BITS) * sizeof(size_t));
+    if ((int)Slab->FreeBitmap.BitCount > Cache->ObjectCount) {
+        BitmapSetBits(&Slab->FreeBitmap, NULL, Cache->ObjectCount,
+            (int)Slab->FreeBitmap.BitCount - Cache->ObjectCount);
+    }
     slab_initalize_objects(Cache, Slab);
     return Slab;
 }
@@ -407,11 +410,8 @@ cache_calculate_slab_structure_size(
     _In_ size_t ObjectsPerSlab)
 {
     size_t SlabStructure = sizeof(MemorySlab_t);
-    // Calculate how many bytes the slab metadata will need
-    SlabStructure += (ObjectsPerSlab / 8);
-    if (ObjectsPerSlab % 8) {
-        SlabStructure++;
-    }
+    // Calculate how many bytes the slab metadata will need, the free map is kept in words
+    SlabStructure += DIVUP(ObjectsPerSlab, __BITS) * sizeof(size_t);
     return SlabStructure;
 }
 
@@ -536,6 +536,7 @@ cache_calculate_slab_size(
     if (ReservedSpace == 0) {
         ReservedSpace = cache_calculate_slab_structure_size(ObjectsPerSlab);
     }
+    assert(DIVUP(ObjectsPerSlab, __BITS) <= BITMAP_FLAT_WORDS);
 
     if (Cache != NULL) {
         Cache->ObjectCount       = (int)ObjectsPerSlab;
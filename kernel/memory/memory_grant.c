@@ -0,0 +1,346 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Memory Grant Interface
+ * - Read-only grants of memory from one memory space to another. Grants are kept
+ *   mapped between uses, so a buffer that is passed repeatedly between the same
+ *   pair of memory spaces is only mapped once. A grant is revoked when the source
+ *   unmaps the pages, so the target never keeps a mapping of released memory.
+ * - Grants are keyed by the memory space contexts, which are shared by all threads
+ *   of a process, not by the memory space of the thread that sent the buffer.
+ */
+
+#define __MODULE "GRNT"
+//#define __TRACE
+
+#include <assert.h>
+#include <debug.h>
+#include <handle.h>
+#include <heap.h>
+#include <memory_grant.h>
+#include <mutex.h>
+
+typedef struct MemoryGrant {
+    struct MemoryGrant*         Link;
+    SystemMemorySpaceContext_t* SourceContext; // NULL when revoked while in use
+    SystemMemorySpaceContext_t* TargetContext;
+    SystemMemorySpace_t*        TargetSpace;   // Owner of the target context
+    uintptr_t                   SourceAddress;
+    uintptr_t                   TargetAddress;
+    size_t                      Length;
+    int                         References;
+    unsigned int                LastUsed;
+} MemoryGrant_t;
+
+static Mutex_t        GrantLock   = OS_MUTEX_INIT(MUTEX_PLAIN);
+static MemoryGrant_t* Grants      = NULL;
+static int            UnusedCount = 0;
+static unsigned int   GrantClock  = 0;
+
+static _Atomic(size_t) GrantAcquires = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) GrantHits     = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) GrantMaps     = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) GrantUnmaps   = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) GrantRevokes  = ATOMIC_VAR_INIT(0);
+
+/* GetContextOwner
+ * Inherited memory spaces keep a reference on the memory space that created their context,
+ * so the mappings of a grant are always removed through the owner. */
+static SystemMemorySpace_t*
+GetContextOwner(
+    _In_ SystemMemorySpace_t* MemorySpace)
+{
+    if (MemorySpace->ParentHandle == UUID_INVALID) {
+        return MemorySpace;
+    }
+    return (SystemMemorySpace_t*)LookupHandleOfType(MemorySpace->ParentHandle, HandleTypeMemorySpace);
+}
+
+static void
+UnlinkGrant(
+    _In_ MemoryGrant_t* Grant)
+{
+    MemoryGrant_t** Iter = &Grants;
+    while (*Iter != Grant) {
+        Iter = &(*Iter)->Link;
+    }
+    *Iter = Grant->Link;
+}
+
+/* EvictGrant
+ * Unlinks the least recently used grant that is not in use, must be called with
+ * the lock held. The caller unmaps the returned grant once the lock is released. */
+static MemoryGrant_t*
+EvictGrant(void)
+{
+    MemoryGrant_t* Victim = NULL;
+    MemoryGrant_t* Grant;
+
+    for (Grant = Grants; Grant != NULL; Grant = Grant->Link) {
+        if (!Grant->References && (!Victim || (int)(Grant->LastUsed - Victim->LastUsed) < 0)) {
+            Victim = Grant;
+        }
+    }
+
+    if (Victim) {
+        UnlinkGrant(Victim);
+        UnusedCount--;
+    }
+    return Victim;
+}
+
+static void
+DestroyGrants(
+    _In_ MemoryGrant_t* Grant)
+{
+    while (Grant) {
+        MemoryGrant_t* Next = Grant->Link;
+        MemorySpaceUnmap(Grant->TargetSpace, Grant->TargetAddress, Grant->Length);
+        atomic_fetch_add(&GrantUnmaps, 1);
+        kfree(Grant);
+        Grant = Next;
+    }
+}
+
+OsStatus_t
+MemoryGrantAcquire(
+    _In_  SystemMemorySpace_t* SourceSpace,
+    _In_  SystemMemorySpace_t* TargetSpace,
+    _In_  VirtualAddress_t     SourceAddress,
+    _In_  size_t               Length,
+    _Out_ VirtualAddress_t*    TargetAddress)
+{
+    size_t           PageSize = GetMemorySpacePageSize();
+    size_t           Offset   = SourceAddress % PageSize;
+    uintptr_t        Base     = SourceAddress - Offset;
+    size_t           Size     = DIVUP((Length + Offset), PageSize) * PageSize;
+    VirtualAddress_t Mapping  = 0;
+    MemoryGrant_t*   Grant;
+    MemoryGrant_t*   Victim = NULL;
+    OsStatus_t       Status;
+
+    assert(SourceSpace != NULL);
+    assert(TargetSpace != NULL);
+    assert(TargetAddress != NULL);
+    atomic_fetch_add(&GrantAcquires, 1);
+
+    // Only grants between application memory spaces are cached, their unmaps are tracked
+    if (SourceSpace->Context != NULL && TargetSpace->Context != NULL) {
+        MutexLock(&GrantLock);
+        for (Grant = Grants; Grant != NULL; Grant = Grant->Link) {
+            if (Grant->SourceContext == SourceSpace->Context && Grant->TargetContext == TargetSpace->Context &&
+                Base >= Grant->SourceAddress && (Base + Size) <= (Grant->SourceAddress + Grant->Length)) {
+                if (!Grant->References++) {
+                    UnusedCount--;
+                }
+                Grant->LastUsed = ++GrantClock;
+                *TargetAddress  = Grant->TargetAddress + (Base - Grant->SourceAddress) + Offset;
+                MutexUnlock(&GrantLock);
+                atomic_fetch_add(&GrantHits, 1);
+                return OsSuccess;
+            }
+        }
+        MutexUnlock(&GrantLock);
+    }
+
+    Status = CloneMemorySpaceMapping(SourceSpace, TargetSpace, Base, &Mapping, Size,
+        MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_READONLY | MAPPING_PERSISTENT,
+        MAPPING_VIRTUAL_PROCESS);
+    if (Status != OsSuccess) {
+        ERROR("[memory] [grant] failed to clone mapping: %u", Status);
+        return Status;
+    }
+    atomic_fetch_add(&GrantMaps, 1);
+    *TargetAddress = Mapping + Offset;
+
+    // Without a grant the mapping is simply removed again on release
+    if (SourceSpace->Context == NULL || TargetSpace->Context == NULL) {
+        return OsSuccess;
+    }
+
+    Grant = (MemoryGrant_t*)kmalloc(sizeof(MemoryGrant_t));
+    if (!Grant) {
+        return OsSuccess;
+    }
+
+    Grant->SourceContext = SourceSpace->Context;
+    Grant->TargetContext = TargetSpace->Context;
+    Grant->TargetSpace   = GetContextOwner(TargetSpace);
+    Grant->SourceAddress = Base;
+    Grant->TargetAddress = Mapping;
+    Grant->Length        = Size;
+    Grant->References    = 1;
+
+    MutexLock(&GrantLock);
+    Grant->LastUsed = ++GrantClock;
+    Grant->Link     = Grants;
+    Grants          = Grant;
+    if (UnusedCount > MEMORY_GRANT_MAX_CACHED) {
+        Victim = EvictGrant();
+    }
+    MutexUnlock(&GrantLock);
+
+    if (Victim) {
+        Victim->Link = NULL;
+        DestroyGrants(Victim);
+    }
+    return OsSuccess;
+}
+
+void
+MemoryGrantRelease(
+    _In_ SystemMemorySpace_t* TargetSpace,
+    _In_ VirtualAddress_t     TargetAddress,
+    _In_ size_t               Length)
+{
+    size_t         PageSize = GetMemorySpacePageSize();
+    size_t         Offset   = TargetAddress % PageSize;
+    MemoryGrant_t* Victim   = NULL;
+    MemoryGrant_t* Grant;
+
+    assert(TargetSpace != NULL);
+
+    MutexLock(&GrantLock);
+    for (Grant = Grants; Grant != NULL; Grant = Grant->Link) {
+        if (Grant->References && Grant->TargetContext == TargetSpace->Context &&
+            TargetAddress >= Grant->TargetAddress && TargetAddress < (Grant->TargetAddress + Grant->Length)) {
+            break;
+        }
+    }
+
+    if (Grant != NULL) {
+        if (!--Grant->References) {
+            if (Grant->SourceContext == NULL) {
+                UnlinkGrant(Grant);
+                Victim = Grant;
+            }
+            else if (++UnusedCount > MEMORY_GRANT_MAX_CACHED) {
+                Victim = EvictGrant();
+            }
+        }
+        MutexUnlock(&GrantLock);
+
+        if (Victim) {
+            Victim->Link = NULL;
+            DestroyGrants(Victim);
+        }
+        return;
+    }
+    MutexUnlock(&GrantLock);
+
+    // Not a grant, so it is an uncached mapping
+    MemorySpaceUnmap(TargetSpace, TargetAddress - Offset, Length + Offset);
+    atomic_fetch_add(&GrantUnmaps, 1);
+}
+
+void
+MemoryGrantRevokeRange(
+    _In_ SystemMemorySpace_t* SourceSpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ size_t               Length)
+{
+    MemoryGrant_t* Victims = NULL;
+    MemoryGrant_t* Grant;
+    MemoryGrant_t* Next;
+
+    if (Grants == NULL || SourceSpace->Context == NULL) {
+        return;
+    }
+
+    MutexLock(&GrantLock);
+    for (Grant = Grants; Grant != NULL; Grant = Next) {
+        Next = Grant->Link;
+        if (Grant->SourceContext != SourceSpace->Context || Address >= (Grant->SourceAddress + Grant->Length) ||
+            (Address + Length) <= Grant->SourceAddress) {
+            continue;
+        }
+
+        // Grants in use are detached and unmapped on their last release
+        atomic_fetch_add(&GrantRevokes, 1);
+        if (Grant->References) {
+            Grant->SourceContext = NULL;
+        }
+        else {
+            UnlinkGrant(Grant);
+            UnusedCount--;
+            Grant->Link = Victims;
+            Victims     = Grant;
+        }
+    }
+    MutexUnlock(&GrantLock);
+    DestroyGrants(Victims);
+}
+
+void
+MemoryGrantRevokeSpace(
+    _In_ SystemMemorySpace_t* MemorySpace)
+{
+    SystemMemorySpaceContext_t* Context = MemorySpace->Context;
+    MemoryGrant_t*              Victims = NULL;
+    MemoryGrant_t*              Grant;
+    MemoryGrant_t*              Next;
+
+    // Inherited memory spaces share the context and its mappings with the owner, which
+    // outlives them, so only the destruction of the owner affects the grants
+    if (Grants == NULL || Context == NULL || MemorySpace->ParentHandle != UUID_INVALID) {
+        return;
+    }
+
+    MutexLock(&GrantLock);
+    for (Grant = Grants; Grant != NULL; Grant = Next) {
+        Next = Grant->Link;
+
+        // The mappings of a target that goes away are removed before its address space is
+        // torn down, whether or not they are still in use
+        if (Grant->TargetContext == Context) {
+            UnlinkGrant(Grant);
+            if (!Grant->References && Grant->SourceContext != NULL) {
+                UnusedCount--;
+            }
+            Grant->Link = Victims;
+            Victims     = Grant;
+        }
+        else if (Grant->SourceContext == Context) {
+            atomic_fetch_add(&GrantRevokes, 1);
+            if (Grant->References) {
+                Grant->SourceContext = NULL;
+            }
+            else {
+                UnlinkGrant(Grant);
+                UnusedCount--;
+                Grant->Link = Victims;
+                Victims     = Grant;
+            }
+        }
+    }
+    MutexUnlock(&GrantLock);
+    DestroyGrants(Victims);
+}
+
+void
+GetMemoryGrantStatistics(
+    _Out_ MemoryGrantStatistics_t* Statistics)
+{
+    assert(Statistics != NULL);
+    Statistics->Acquires = atomic_load(&GrantAcquires);
+    Statistics->Hits     = atomic_load(&GrantHits);
+    Statistics->Maps     = atomic_load(&GrantMaps);
+    Statistics->Unmaps   = atomic_load(&GrantUnmaps);
+    Statistics->Revokes  = atomic_load(&GrantRevokes);
+}
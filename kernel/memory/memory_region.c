@@ -39,16 +39,71 @@
 #include <string.h>
 #include <threading.h>
 
+// Regions are shared between servers and their clients, which run at different priorities,
+// so the owner of the lock is boosted to the priority of the threads waiting for it
 typedef struct MemoryRegion {
     Mutex_t   SyncObject;
     uintptr_t KernelMapping;
     size_t    Length;
     size_t    Capacity;
     Flags_t   Flags;
+    
+    // Cached scatter-gather list of the committed pages, it is extended as the
+    // region grows so it never has to be rebuilt
+    struct dma_sg* SgList;
+    int            SgCount;
+    int            SgCapacity;
+    int            SgPages;
+    
     int       PageCount;
     uintptr_t Pages[];
 } MemoryRegion_t;
 
+/* UpdateRegionSg
+ * Appends the pages committed since the last update to the cached scatter-gather
+ * list, merging them into the last entry when they are contiguous. Must be called
+ * with the region lock held. */
+static OsStatus_t
+UpdateRegionSg(
+    _In_ MemoryRegion_t* Region)
+{
+    size_t PageSize       = GetMemorySpacePageSize();
+    int    CommittedPages = MIN((int)DIVUP(Region->Length, PageSize), Region->PageCount);
+    
+    for (; Region->SgPages < CommittedPages; Region->SgPages++) {
+        uintptr_t      Page = Region->Pages[Region->SgPages];
+        struct dma_sg* Sg;
+        
+        if (Region->SgCount) {
+            Sg = &Region->SgList[Region->SgCount - 1];
+            if ((Sg->address + Sg->length) == Page) {
+                Sg->length += PageSize;
+                continue;
+            }
+        }
+        
+        if (Region->SgCount == Region->SgCapacity) {
+            int            Capacity = MIN(Region->PageCount, MAX(4, Region->SgCapacity * 2));
+            struct dma_sg* List     = (struct dma_sg*)kmalloc(sizeof(struct dma_sg) * Capacity);
+            if (!List) {
+                return OsOutOfMemory;
+            }
+            
+            if (Region->SgList) {
+                memcpy(List, Region->SgList, sizeof(struct dma_sg) * Region->SgCount);
+                kfree(Region->SgList);
+            }
+            Region->SgList     = List;
+            Region->SgCapacity = Capacity;
+        }
+        
+        Sg          = &Region->SgList[Region->SgCount++];
+        Sg->address = Page;
+        Sg->length  = PageSize;
+    }
+    return OsSuccess;
+}
+
 static OsStatus_t
 CreateUserMapping(
     _In_  MemoryRegion_t*      Region,
@@ -115,6 +170,9 @@ MemoryRegionDestroy(
     if (Region->KernelMapping) {
         MemorySpaceUnmap(GetCurrentMemorySpace(), Region->KernelMapping, Region->Capacity);
     }
+    if (Region->SgList) {
+        kfree(Region->SgList);
+    }
     kfree(Region);
 }
 
@@ -142,7 +200,7 @@ MemoryRegionCreate(
     }
     
     memset(Region, 0, sizeof(MemoryRegion_t) + (sizeof(uintptr_t) * PageCount));
-    MutexConstruct(&Region->SyncObject, MUTEX_PLAIN);
+    MutexConstruct(&Region->SyncObject, MUTEX_INHERIT);
     Region->Flags     = Flags;
     Region->Length    = Length;
     Region->Capacity  = Capacity;
@@ -160,6 +218,9 @@ MemoryRegionCreate(
         goto ErrorHandler;
     }
     
+    // Build the scatter-gather list up front, if this fails it is retried on request
+    (void)UpdateRegionSg(Region);
+    
     *KernelMapping = (void*)Region->KernelMapping;
     *Handle        = CreateHandle(HandleTypeMemoryRegion, MemoryRegionDestroy, Region);
     return Status;
@@ -194,7 +255,7 @@ MemoryRegionCreateExisting(
     }
     
     memset(Region, 0, sizeof(MemoryRegion_t) + (sizeof(uintptr_t) * PageCount));
-    MutexConstruct(&Region->SyncObject, MUTEX_PLAIN);
+    MutexConstruct(&Region->SyncObject, MUTEX_INHERIT);
     Region->Flags     = Flags;
     Region->Length    = CapacityWithOffset;
     Region->Capacity  = CapacityWithOffset;
@@ -206,6 +267,7 @@ MemoryRegionCreateExisting(
         goto ErrorHandler;
     }
     
+    (void)UpdateRegionSg(Region);
     *HandleOut = CreateHandle(HandleTypeMemoryRegion, MemoryRegionDestroy, Region);
     return Status;
     
@@ -351,6 +413,7 @@ MemoryRegionResize(
         MAPPING_PHYSICAL_FIXED);
     if (Status == OsSuccess) {
         Region->Length = NewLength;
+        (void)UpdateRegionSg(Region);
     }
     MutexUnlock(&Region->SyncObject);
     return Status;
@@ -479,6 +542,7 @@ MemoryRegionGetSg(
 {
     MemoryRegion_t* Region;
     size_t          PageSize = GetMemorySpacePageSize();
+    OsStatus_t      Status;
     
     if (!SgCountOut) {
         return OsInvalidParameters;
@@ -489,38 +553,31 @@ MemoryRegionGetSg(
         return OsDoesNotExist;
     }
     
-    // Requested count of the scatter-gather units, so count
-    // how many entries it would take to fill a list
-    // Assume that if both pointers are supplied we are trying to fill
-    // the list with the requested amount, and thus skip this step.
-    if (SgCountOut && !SgListOut) {
-        int SgCount = 0;
-        for (int i = 0; i < Region->PageCount; i++) {
-            if (i == 0 || (Region->Pages[i - 1] + PageSize) != Region->Pages[i]) {
-                SgCount++;
-            }
-        }
-        *SgCountOut = SgCount;
+    // The list is normally up to date, this only does work if building it
+    // failed previously
+    MutexLock(&Region->SyncObject);
+    Status = UpdateRegionSg(Region);
+    if (Status != OsSuccess) {
+        MutexUnlock(&Region->SyncObject);
+        return Status;
     }
     
-    // In order to get the list both counters must be filled
-    if (SgCountOut && SgListOut) {
-        int SgCount = *SgCountOut;
-        for (int i = 0, j = 0; (i < SgCount) && (j < Region->PageCount); i++) {
-            struct dma_sg* Sg = &SgListOut[i];
-            
-            Sg->address = Region->Pages[j++];
-            Sg->length  = PageSize;
+    // Requested count of the scatter-gather units. Assume that if both
+    // pointers are supplied we are trying to fill the list with the requested
+    // amount, and then report back how many were filled.
+    if (!SgListOut) {
+        *SgCountOut = Region->SgCount;
+    }
+    else {
+        int SgCount = MIN(*SgCountOut, Region->SgCount);
+        if (SgCount > 0) {
+            memcpy(SgListOut, Region->SgList, sizeof(struct dma_sg) * SgCount);
             
-            while ((j < Region->PageCount) &&
-                   (Region->Pages[j - 1] + PageSize) == Region->Pages[j]) {
-                Sg->length += PageSize;
-                j++;
-            }
+            // Adjust the initial sg entry for offset
+            SgListOut[0].length -= SgListOut[0].address % PageSize;
         }
-        
-        // Adjust the initial sg entry for offset
-        SgListOut[0].length -= SgListOut[0].address % PageSize;
+        *SgCountOut = MAX(SgCount, 0);
     }
+    MutexUnlock(&Region->SyncObject);
     return OsSuccess;
 }
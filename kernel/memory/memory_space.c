@@ -29,84 +29,127 @@
 #include <arch/utils.h>
 #include <assert.h>
 #include <component/cpu.h>
+#include <component/domain.h>
 #include <ddk/barrier.h>
+#include <ddk/io.h>
 #include <debug.h>
 #include <handle.h>
 #include <heap.h>
 #include <memoryspace.h>
+#include <memory_grant.h>
+#include <memory_tlb.h>
 #include <machine.h>
 #include <string.h>
+#include <system_page.h>
 #include <threading.h>
 
 typedef struct MemorySynchronizationObject {
-    _Atomic(int) CallsCompleted;
-    UUId_t       MemorySpaceHandle;
-    uintptr_t    Address;
-    size_t       Length;
+    _Atomic(int)            CallsCompleted;
+    MemorySpaceShootdown_t* Batch;
+    unsigned int            Generation;
 } MemorySynchronizationObject_t;
 
+static _Atomic(size_t) ShootdownRequests       = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) ShootdownsSent          = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) ShootdownInterruptsSent = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) ShootdownLazySkips      = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) ShootdownStaleSkips     = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) ShootdownFullFlushes    = ATOMIC_VAR_INIT(0);
+
 static void
 MemorySynchronizationHandler(
     _In_ void* Context)
 {
-    MemorySynchronizationObject_t* Object        = (MemorySynchronizationObject_t*)Context;
-    SystemMemorySpace_t*           Current       = GetCurrentMemorySpace();
-    UUId_t                         CurrentHandle = GetCurrentMemorySpaceHandle();
-
-    // Make sure the current address space is matching
-    // If NULL => everyone must update
-    // If it matches our parent, we must update
-    // If it matches us, we must update
-    smp_mb();
-    if (Object->MemorySpaceHandle  == UUID_INVALID ||
-        Current->ParentHandle      == Object->MemorySpaceHandle || 
-        CurrentHandle              == Object->MemorySpaceHandle) {
-        CpuInvalidateMemoryCache((void*)Object->Address, Object->Length);
+    MemorySynchronizationObject_t* Object = (MemorySynchronizationObject_t*)Context;
+    MemorySpaceShootdown_t*        Batch  = Object->Batch;
+    SystemCpuCore_t*               Core   = GetCurrentProcessorCore();
+    int                            i;
+
+    // Family batches only concern cores that still have the family loaded, and if the core
+    // has reloaded its tlb since the generation was issued there is nothing left to flush
+    switch (MemoryTlbCheck(&Core->Tlb, Batch->Family, Object->Generation)) {
+        case MEMORY_TLB_SKIP_LAZY:
+            atomic_fetch_add(&ShootdownLazySkips, 1);
+            atomic_fetch_add(&Object->CallsCompleted, 1);
+            return;
+        case MEMORY_TLB_SKIP_STALE:
+            atomic_fetch_add(&ShootdownStaleSkips, 1);
+            atomic_fetch_add(&Object->CallsCompleted, 1);
+            return;
+        default:
+            break;
+    }
+
+    if (Batch->FullFlush) {
+        CpuInvalidateMemoryCache(NULL, 0);
+        if (Batch->Family != NULL) {
+            MemoryTlbFlushed(&Core->Tlb, Object->Generation);
+        }
+    }
+    else {
+        for (i = 0; i < Batch->RangeCount; i++) {
+            CpuInvalidateMemoryCache((void*)Batch->Ranges[i].Address, Batch->Ranges[i].Length);
+        }
     }
     atomic_fetch_add(&Object->CallsCompleted, 1);
 }
 
+/* SendShootdown
+ * Interrupts the cores that could be caching translations covered by the batch. Cores not
+ * running the family at the time we check will load their tlb from the updated tables when
+ * they switch to it, so they are skipped without an interrupt. */
 static void
-SynchronizeMemoryRegion(
-    _In_ SystemMemorySpace_t* MemorySpace,
-    _In_ uintptr_t            Address,
-    _In_ size_t               Length)
+SendShootdown(
+    _In_ MemorySpaceShootdown_t* Batch)
 {
     // We can easily allocate this object on the stack as the stack is globally
     // visible to all kernel code. This spares us allocation on heap
-    MemorySynchronizationObject_t Object = { 
-        .Address        = Address,
-        .Length         = Length,
+    MemorySynchronizationObject_t Object = {
+        .Batch          = Batch,
         .CallsCompleted = 0
     };
     
-    int     NumberOfCores;
-    int     NumberOfActiveCores;
-    clock_t InterruptedAt;
-    size_t  Timeout = 1000;
+    SystemCpuCore_t* CurrentCore = GetCurrentProcessorCore();
+    SystemCpuCore_t* Iter;
+    int              NumberOfCores = 0;
+    clock_t          InterruptedAt;
+    size_t           Timeout = 1000;
 
     // Skip this entire step if there is no multiple cores active
-    NumberOfActiveCores = atomic_load(&GetMachine()->NumberOfActiveCores);
-    if (NumberOfActiveCores <= 1) {
+    if (atomic_load(&GetMachine()->NumberOfActiveCores) <= 1) {
         return;
     }
 
-    // Check for global address, in that case invalidate all cores
-    if (StaticMemoryPoolContains(&GetMachine()->GlobalAccessMemory, Address)) {
-        Object.MemorySpaceHandle = UUID_INVALID; // Everyone must update
+    // The tables have been updated at this point, publish a new generation before we
+    // look at which family the cores have loaded
+    if (Batch->Family != NULL) {
+        Object.Generation = MemoryTlbIssue(&Batch->Family->TlbGeneration);
     }
-    else {
-        if (MemorySpace->ParentHandle == UUID_INVALID) {
-            Object.MemorySpaceHandle = GetCurrentMemorySpaceHandle(); // Children of us must update
-        }
-        else {
-            Object.MemorySpaceHandle = MemorySpace->ParentHandle; // Parent and siblings!
+    if (Batch->FullFlush) {
+        atomic_fetch_add(&ShootdownFullFlushes, 1);
+    }
+
+    Iter = (GetCurrentDomain() != NULL) ? GetCurrentDomain()->CoreGroup.Cores : GetMachine()->Processor.Cores;
+    while (Iter) {
+        if (Iter != CurrentCore && (READ_VOLATILE(Iter->State) & CpuStateRunning)) {
+            if (!MemoryTlbIsTarget(&Iter->Tlb, Batch->Family)) {
+                atomic_fetch_add(&ShootdownLazySkips, 1);
+            }
+            else if (TxuMessageSend(Iter->Id, CpuFunctionCustom, MemorySynchronizationHandler, &Object, 1) == OsSuccess) {
+                NumberOfCores++;
+            }
         }
+        Iter = Iter->Link;
+    }
+
+    if (!NumberOfCores) {
+        return;
     }
     
-    NumberOfCores = ProcessorMessageSend(1, CpuFunctionCustom, MemorySynchronizationHandler, &Object, 1);
+    atomic_fetch_add(&ShootdownsSent, 1);
+    atomic_fetch_add(&ShootdownInterruptsSent, NumberOfCores);
     while (atomic_load(&Object.CallsCompleted) != NumberOfCores && Timeout > 0) {
-        SchedulerSleep(5, &InterruptedAt);
+        SchedulerSleep(5 * NSEC_PER_MSEC, &InterruptedAt);
         Timeout -= 5;
     }
     
@@ -116,6 +159,152 @@ SynchronizeMemoryRegion(
     }
 }
 
+static void
+ReleaseVirtualRange(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ uintptr_t            Address)
+{
+    // Free the range in either GAM or Process memory
+    if (MemorySpace->Context != NULL && DynamicMemoryPoolContains(&MemorySpace->Context->Heap, Address)) {
+        DynamicMemoryPoolFree(&MemorySpace->Context->Heap, Address);
+    }
+    else if (StaticMemoryPoolContains(&GetMachine()->GlobalAccessMemory, Address)) {
+        StaticMemoryPoolFree(&GetMachine()->GlobalAccessMemory, Address);
+    }
+    else {
+        // Ignore
+    }
+}
+
+static void
+FlushShootdown(
+    _In_ MemorySpaceShootdown_t* Batch)
+{
+    int i;
+
+    if (Batch->RangeCount || Batch->FullFlush) {
+        SendShootdown(Batch);
+    }
+
+    // Only now are the physical pages and virtual ranges unused on all cores
+    if (Batch->FrameCount) {
+        IrqSpinlockAcquire(&GetMachine()->PhysicalMemoryLock);
+        bounded_stack_push_multiple(&GetMachine()->PhysicalMemory,
+            (void**)&Batch->Frames[0], Batch->FrameCount);
+        IrqSpinlockRelease(&GetMachine()->PhysicalMemoryLock);
+    }
+    for (i = 0; i < Batch->ReleaseCount; i++) {
+        ReleaseVirtualRange(Batch->Releases[i].MemorySpace, Batch->Releases[i].Address);
+    }
+
+    Batch->Family       = NULL;
+    Batch->FullFlush    = 0;
+    Batch->PageCount    = 0;
+    Batch->RangeCount   = 0;
+    Batch->ReleaseCount = 0;
+    Batch->FrameCount   = 0;
+}
+
+static MemorySpaceShootdown_t*
+GetCurrentShootdown(void)
+{
+    MCoreThread_t* Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    return (Thread != NULL) ? Thread->ShootdownBatch : NULL;
+}
+
+static void
+SynchronizeMemoryRegion(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ uintptr_t            Address,
+    _In_ size_t               Length)
+{
+    MemorySpaceShootdown_t  LocalBatch = { 0 };
+    MemorySpaceShootdown_t* Batch      = GetCurrentShootdown();
+    SystemMemorySpaceContext_t* Family;
+    size_t                      PageCount;
+
+    atomic_fetch_add(&ShootdownRequests, 1);
+
+    // Global access memory and kernel spaces are mapped by every core, application spaces
+    // are only loaded by the cores running threads of the family
+    if (StaticMemoryPoolContains(&GetMachine()->GlobalAccessMemory, Address)) {
+        Family = NULL;
+    }
+    else {
+        Family = MemorySpace->Context;
+    }
+
+    if (Batch == NULL) {
+        Batch = &LocalBatch;
+    }
+    else if ((Batch->RangeCount || Batch->FullFlush) && Batch->Family != Family) {
+        FlushShootdown(Batch);
+    }
+    Batch->Family = Family;
+
+    // Global mappings survive a full flush, so those batches must be sent per range
+    PageCount = DIVUP((Length + (Address % GetMemorySpacePageSize())), GetMemorySpacePageSize());
+    if (Batch->RangeCount == MEMORY_SHOOTDOWN_MAX_RANGES && Family == NULL) {
+        FlushShootdown(Batch);
+        Batch->Family = Family;
+    }
+
+    Batch->PageCount += PageCount;
+    if (Batch->RangeCount == MEMORY_SHOOTDOWN_MAX_RANGES || 
+        (Family != NULL && Batch->PageCount > MEMORY_SHOOTDOWN_FLUSH_PAGES)) {
+        Batch->FullFlush = 1;
+    }
+    else {
+        Batch->Ranges[Batch->RangeCount].Address = Address;
+        Batch->Ranges[Batch->RangeCount].Length  = Length;
+        Batch->RangeCount++;
+    }
+
+    if (Batch == &LocalBatch) {
+        FlushShootdown(Batch);
+    }
+}
+
+void
+MemorySpaceShootdownBegin(
+    _In_ MemorySpaceShootdown_t* Batch)
+{
+    MCoreThread_t* Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    assert(Batch != NULL);
+
+    memset(Batch, 0, sizeof(MemorySpaceShootdown_t));
+    if (Thread != NULL) {
+        Batch->Previous        = Thread->ShootdownBatch;
+        Thread->ShootdownBatch = Batch;
+    }
+}
+
+void
+MemorySpaceShootdownEnd(
+    _In_ MemorySpaceShootdown_t* Batch)
+{
+    MCoreThread_t* Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    assert(Batch != NULL);
+
+    FlushShootdown(Batch);
+    if (Thread != NULL && Thread->ShootdownBatch == Batch) {
+        Thread->ShootdownBatch = Batch->Previous;
+    }
+}
+
+void
+GetMemorySpaceShootdownStatistics(
+    _Out_ MemorySpaceShootdownStatistics_t* Statistics)
+{
+    assert(Statistics != NULL);
+    Statistics->Requests          = atomic_load(&ShootdownRequests);
+    Statistics->Shootdowns        = atomic_load(&ShootdownsSent);
+    Statistics->InterruptsSent    = atomic_load(&ShootdownInterruptsSent);
+    Statistics->InterruptsSkipped = atomic_load(&ShootdownLazySkips);
+    Statistics->StaleSkipped      = atomic_load(&ShootdownStaleSkips);
+    Statistics->FullFlushes       = atomic_load(&ShootdownFullFlushes);
+}
+
 static OsStatus_t
 CreateMemorySpaceContext(
     _In_ SystemMemorySpace_t* MemorySpace)
@@ -129,6 +318,8 @@ CreateMemorySpaceContext(
         GetMachine()->MemoryMap.UserHeap.Start + GetMachine()->MemoryMap.UserHeap.Length, 
         GetMachine()->MemoryGranularity);
     Context->SignalHandler  = 0;
+    Context->SystemPage     = 0;
+    atomic_store(&Context->TlbGeneration, 0);
     Context->MemoryHandlers = kmalloc(sizeof(list_t));
     if (!Context->MemoryHandlers) {
         assert(0);
@@ -227,6 +418,13 @@ CreateMemorySpace(
             CreateMemorySpaceContext(MemorySpace);
         }
         CloneVirtualSpace(Parent, MemorySpace, (Flags & MEMORY_SPACE_INHERIT) ? 1 : 0);
+
+        // Inherited memory spaces share the user mappings, and with that the system page
+        if (MemorySpace->ParentHandle == UUID_INVALID) {
+            if (SystemPageMap(MemorySpace, &MemorySpace->Context->SystemPage) != OsSuccess) {
+                WARNING("[memory] [create] failed to map the system page");
+            }
+        }
         *Handle = CreateHandle(HandleTypeMemorySpace, DestroyMemorySpace, MemorySpace);
     }
     else {
@@ -242,6 +440,7 @@ DestroyMemorySpace(
     _In_ void* Resource)
 {
     SystemMemorySpace_t* MemorySpace = (SystemMemorySpace_t*)Resource;
+    MemoryGrantRevokeSpace(MemorySpace);
     if (MemorySpace->Flags & MEMORY_SPACE_APPLICATION) {
         DestroyVirtualSpace(MemorySpace);
     }
@@ -258,6 +457,14 @@ void
 SwitchMemorySpace(
     _In_ SystemMemorySpace_t* MemorySpace)
 {
+    SystemCpuCore_t* Core = GetCurrentProcessorCore();
+
+    // Publish the family before the tlb is reloaded, shootdowns issued before this point
+    // are covered by the reload, and shootdowns after it will see us as a target
+    if (Core != NULL) {
+        MemoryTlbLoad(&Core->Tlb, MemorySpace->Context,
+            (MemorySpace->Context != NULL) ? &MemorySpace->Context->TlbGeneration : NULL);
+    }
     ArchMmuSwitchMemorySpace(MemorySpace);
 }
 
@@ -580,15 +787,50 @@ MemorySpaceUnmap(
     _In_ VirtualAddress_t     Address, 
     _In_ size_t               Size)
 {
-    OsStatus_t Status;
-    int        PageCount    = DIVUP(Size, GetMemorySpacePageSize());
-    int        PagesCleared = 0;
+    MemorySpaceShootdown_t  LocalBatch;
+    MemorySpaceShootdown_t* Batch;
+    uintptr_t               Frames[MEMORY_SHOOTDOWN_MAX_FRAMES];
+    OsStatus_t              Status    = OsSuccess;
+    size_t                  PageSize  = GetMemorySpacePageSize();
+    uintptr_t               Current   = Address;
+    int                     PageCount = DIVUP(Size, PageSize);
+    int                     PagesCleared;
+    int                     PagesFreed;
+    int                     Chunk;
     assert(MemorySpace != NULL);
 
-    // Free the underlying resources first, before freeing the upper resources
-    Status = ArchMmuClearVirtualPages(MemorySpace, Address, PageCount, &PagesCleared);
-    if (PagesCleared) {
-        SynchronizeMemoryRegion(MemorySpace, Address, Size);
+    // Grants of the pages must be gone before the pages are released
+    if (MemorySpace->Context != NULL) {
+        MemoryGrantRevokeRange(MemorySpace, Address, Size);
+    }
+
+    // The physical pages and the virtual range are released when the batch is sent, so an
+    // unmap that isn't part of a batch gets one of its own
+    Batch = GetCurrentShootdown();
+    if (Batch == NULL) {
+        MemorySpaceShootdownBegin(&LocalBatch);
+        Batch = &LocalBatch;
+    }
+
+    // Free the underlying resources first, before freeing the upper resources. The pages
+    // are cleared in chunks, and a chunk is only handed to the batch once its range has
+    // been added, as a flush in between would release the pages before the invalidation
+    while (PageCount && Status == OsSuccess) {
+        Chunk  = MIN(PageCount, MEMORY_SHOOTDOWN_MAX_FRAMES);
+        Status = ArchMmuClearVirtualPages(MemorySpace, Current, Chunk,
+            &Frames[0], &PagesFreed, &PagesCleared);
+        if (PagesCleared) {
+            SynchronizeMemoryRegion(MemorySpace, Current, (size_t)PagesCleared * PageSize);
+        }
+
+        if (Batch->FrameCount + PagesFreed > MEMORY_SHOOTDOWN_MAX_FRAMES) {
+            FlushShootdown(Batch);
+        }
+        memcpy(&Batch->Frames[Batch->FrameCount], &Frames[0], PagesFreed * sizeof(uintptr_t));
+        Batch->FrameCount += PagesFreed;
+
+        Current   += (size_t)Chunk * PageSize;
+        PageCount -= Chunk;
     }
     
     if (Status != OsSuccess) {
@@ -596,15 +838,16 @@ MemorySpaceUnmap(
             Address, Size, Status);
     }
 
-    // Free the range in either GAM or Process memory
-    if (MemorySpace->Context != NULL && DynamicMemoryPoolContains(&MemorySpace->Context->Heap, Address)) {
-        DynamicMemoryPoolFree(&MemorySpace->Context->Heap, Address);
-    }
-    else if (StaticMemoryPoolContains(&GetMachine()->GlobalAccessMemory, Address)) {
-        StaticMemoryPoolFree(&GetMachine()->GlobalAccessMemory, Address);
+    // The virtual range can't be reused before the batch has been sent
+    if (Batch->ReleaseCount == MEMORY_SHOOTDOWN_MAX_RELEASES) {
+        FlushShootdown(Batch);
     }
-    else {
-        // Ignore
+    Batch->Releases[Batch->ReleaseCount].MemorySpace = MemorySpace;
+    Batch->Releases[Batch->ReleaseCount].Address     = Address;
+    Batch->ReleaseCount++;
+
+    if (Batch == &LocalBatch) {
+        MemorySpaceShootdownEnd(&LocalBatch);
     }
     return OsSuccess;
 }
@@ -0,0 +1,88 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Memory Space Tlb Interface
+ * - Tracks which memory space family every core has loaded into its tlb, and the
+ *   shootdown generation of the family at the time. Shootdowns use it to skip cores
+ *   that run another family or that have reloaded their tlb since the change.
+ * - The stores and loads are ordered so that a core switching to a family either sees
+ *   the updated tables when it reloads, or is seen as a target by the shootdown.
+ */
+
+#include <ddk/barrier.h>
+#include <memory_tlb.h>
+
+void
+MemoryTlbLoad(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family,
+    _In_ _Atomic(unsigned int)*           FamilyGeneration)
+{
+    if (Family != NULL) {
+        atomic_store(&Tlb->Generation, atomic_load(FamilyGeneration));
+    }
+    atomic_store(&Tlb->Family, Family);
+    smp_mb();
+}
+
+unsigned int
+MemoryTlbIssue(
+    _In_ _Atomic(unsigned int)* FamilyGeneration)
+{
+    unsigned int Generation = atomic_fetch_add(FamilyGeneration, 1) + 1;
+    smp_mb();
+    return Generation;
+}
+
+int
+MemoryTlbIsTarget(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family)
+{
+    return Family == NULL || atomic_load(&Tlb->Family) == Family;
+}
+
+int
+MemoryTlbCheck(
+    _In_ MemorySpaceTlb_t*                Tlb,
+    _In_ struct SystemMemorySpaceContext* Family,
+    _In_ unsigned int                     Generation)
+{
+    smp_mb();
+    if (Family == NULL) {
+        return MEMORY_TLB_FLUSH;
+    }
+    if (atomic_load(&Tlb->Family) != Family) {
+        return MEMORY_TLB_SKIP_LAZY;
+    }
+
+    // The generation wraps, so compare the distance
+    if ((int)(atomic_load(&Tlb->Generation) - Generation) >= 0) {
+        return MEMORY_TLB_SKIP_STALE;
+    }
+    return MEMORY_TLB_FLUSH;
+}
+
+void
+MemoryTlbFlushed(
+    _In_ MemorySpaceTlb_t* Tlb,
+    _In_ unsigned int      Generation)
+{
+    atomic_store(&Tlb->Generation, Generation);
+}
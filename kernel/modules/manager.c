@@ -26,21 +26,84 @@
 #include <arch/interrupts.h>
 #include <arch/utils.h>
 #include <assert.h>
+#include <crc32.h>
 #include <debug.h>
 #include <handle.h>
 #include <heap.h>
+#include <lz4.h>
 #include "../../librt/libds/pe/pe.h"
 #include <memoryspace.h>
+#include <modules/manager.h>
+#include <modules/ramdisk.h>
 #include <ds/mstring.h>
+#include <mutex.h>
 #include <threading.h>
+#include <timers.h>
 #include <string.h>
 
-static list_t Modules = LIST_INIT;
+// Modules are kept in hashed lookup tables for path and device lookups, each chain is kept
+// in registration order so the first registered module still wins a lookup
+#define MODULE_TABLE_SIZE 64
 
-OsStatus_t
-RegisterModule(
+static list_t          Modules                              = LIST_INIT;
+static SystemModule_t* ModulesByPath[MODULE_TABLE_SIZE]     = { 0 };
+static SystemModule_t* ModulesBySpecific[MODULE_TABLE_SIZE] = { 0 };
+static SystemModule_t* ModulesByGeneric[MODULE_TABLE_SIZE]  = { 0 };
+
+static size_t
+HashPath(
+    _In_ MString_t* Path)
+{
+    const char* Data = MStringRaw(Path);
+    uint32_t    Hash = 2166136261U;
+
+    // Paths are compared without case, so hash them the same way
+    while (*Data) {
+        char Character = *Data++;
+        if (Character >= 'A' && Character <= 'Z') {
+            Character += 'a' - 'A';
+        }
+        Hash = (Hash ^ (uint8_t)Character) * 16777619U;
+    }
+    return Hash % MODULE_TABLE_SIZE;
+}
+
+static size_t
+HashIdentifiers(
+    _In_ DevInfo_t First,
+    _In_ DevInfo_t Second)
+{
+    return ((((uint32_t)First * 2654435761U) ^ (uint32_t)Second) * 2654435761U) % MODULE_TABLE_SIZE;
+}
+
+static void
+AddModuleToTables(
+    _In_ SystemModule_t* Module)
+{
+    SystemModule_t** Link;
+
+    Link = &ModulesByPath[HashPath(Module->Path)];
+    while (*Link) {
+        Link = &(*Link)->PathLink;
+    }
+    *Link = Module;
+
+    Link = &ModulesBySpecific[HashIdentifiers(Module->VendorId, Module->DeviceId)];
+    while (*Link) {
+        Link = &(*Link)->SpecificLink;
+    }
+    *Link = Module;
+
+    Link = &ModulesByGeneric[HashIdentifiers(Module->DeviceClass, Module->DeviceSubclass)];
+    while (*Link) {
+        Link = &(*Link)->GenericLink;
+    }
+    *Link = Module;
+}
+
+static SystemModule_t*
+CreateModule(
     _In_ const char*        Path,
-    _In_ const void*        Data,
     _In_ size_t             Length,
     _In_ SystemModuleType_t Type,
     _In_ DevInfo_t          VendorId,
@@ -52,14 +115,14 @@ RegisterModule(
 
     Module = (SystemModule_t*)kmalloc(sizeof(SystemModule_t));
     if (!Module) {
-        return OsOutOfMemory;
+        return NULL;
     }
     
     memset(Module, 0, sizeof(SystemModule_t));
     ELEMENT_INIT(&Module->ListHeader, Type, Module);
+    MutexConstruct(&Module->DataLock, MUTEX_PLAIN);
 
     Module->Handle = CreateHandle(HandleTypeGeneric, NULL, Module);
-    Module->Data   = Data;
     Module->Length = Length;
     Module->Path   = MStringCreate("rd:/", StrUTF8);
     MStringAppendCharacters(Module->Path, Path, StrUTF8);
@@ -69,14 +132,121 @@ RegisterModule(
     Module->DeviceClass     = DeviceClass;
     Module->DeviceSubclass  = DeviceSubclass;
     Module->PrimaryThreadId = UUID_INVALID;
+    return Module;
+}
+
+OsStatus_t
+RegisterModule(
+    _In_ const char*        Path,
+    _In_ const void*        Data,
+    _In_ size_t             Length,
+    _In_ SystemModuleType_t Type,
+    _In_ DevInfo_t          VendorId,
+    _In_ DevInfo_t          DeviceId,
+    _In_ DevInfo_t          DeviceClass,
+    _In_ DevInfo_t          DeviceSubclass)
+{
+    SystemModule_t* Module = CreateModule(Path, Length, Type, 
+        VendorId, DeviceId, DeviceClass, DeviceSubclass);
+    if (!Module) {
+        return OsOutOfMemory;
+    }
+
+    Module->Data         = Data;
+    Module->PackedData   = Data;
+    Module->PackedLength = Length;
+    Module->Compression  = RAMDISK_COMPRESSION_NONE;
+    AddModuleToTables(Module);
+    list_append(&Modules, &Module->ListHeader);
+    return OsSuccess;
+}
+
+OsStatus_t
+RegisterPackedModule(
+    _In_ const char*        Path,
+    _In_ const void*        PackedData,
+    _In_ size_t             PackedLength,
+    _In_ size_t             Length,
+    _In_ int                Compression,
+    _In_ uint32_t           Crc32,
+    _In_ SystemModuleType_t Type,
+    _In_ DevInfo_t          VendorId,
+    _In_ DevInfo_t          DeviceId,
+    _In_ DevInfo_t          DeviceClass,
+    _In_ DevInfo_t          DeviceSubclass)
+{
+    SystemModule_t* Module = CreateModule(Path, Length, Type, 
+        VendorId, DeviceId, DeviceClass, DeviceSubclass);
+    if (!Module) {
+        return OsOutOfMemory;
+    }
+
+    Module->PackedData   = PackedData;
+    Module->PackedLength = PackedLength;
+    Module->Compression  = Compression;
+    Module->Crc32        = Crc32;
+    AddModuleToTables(Module);
     list_append(&Modules, &Module->ListHeader);
     return OsSuccess;
 }
 
+static OsStatus_t
+LoadModuleData(
+    _In_ SystemModule_t* Module)
+{
+    OsStatus_t Status = OsSuccess;
+    void*      Data   = NULL;
+    uint32_t   Crc;
+
+    if (Module->Data != NULL) {
+        return OsSuccess;
+    }
+
+    // Each module has its own lock, so services and drivers that start at the same
+    // time unpack their images in parallel
+    MutexLock(&Module->DataLock);
+    if (Module->Data == NULL) {
+        if (Module->Compression == RAMDISK_COMPRESSION_NONE) {
+            Data = (void*)Module->PackedData;
+        }
+        else if (Module->Compression == RAMDISK_COMPRESSION_LZ4) {
+            Data = kmalloc(Module->Length);
+            if (!Data) {
+                Status = OsOutOfMemory;
+            }
+            else {
+                Status = Lz4Decompress(Module->PackedData, Module->PackedLength, Data, Module->Length);
+            }
+        }
+        else {
+            Status = OsNotSupported;
+        }
+
+        if (Status == OsSuccess) {
+            Crc = Crc32Generate(-1, (uint8_t*)Data, Module->Length);
+            if (Crc != Module->Crc32) {
+                ERROR("CRC-Validation(%s): Failed (Calculated 0x%" PRIxIN " != Stored 0x%" PRIxIN ")",
+                    MStringRaw(Module->Path), Crc, Module->Crc32);
+                Status = OsError;
+            }
+        }
+
+        if (Status == OsSuccess) {
+            Module->Data = Data;
+        }
+        else if (Data != NULL && Data != Module->PackedData) {
+            kfree(Data);
+        }
+    }
+    MutexUnlock(&Module->DataLock);
+    return Status;
+}
+
 void
 SpawnServices(void)
 {
     IntStatus_t IrqState;
+    clock_t     Tick = 0;
 
     // Disable interrupts while doing this as
     // we are still the idle thread -> as soon as a new
@@ -95,6 +265,9 @@ SpawnServices(void)
         }
     }
     InterruptRestoreState(IrqState);
+    
+    TimersGetSystemTick(&Tick);
+    TRACE("SpawnServices services spawned at tick %" PRIuIN "", (size_t)Tick);
 }
 
 OsStatus_t
@@ -103,23 +276,30 @@ GetModuleDataByPath(
     _Out_ void**     Buffer, 
     _Out_ size_t*    Length)
 {
-    OsStatus_t Result = OsError;
+    SystemModule_t* Module;
+    OsStatus_t      Status;
     TRACE("GetModuleDataByPath(%s)", MStringRaw(Path));
 
-    foreach(i, &Modules) {
-        SystemModule_t* Module = (SystemModule_t*)i->value;
-        if (Module->Path != NULL) {
-            TRACE("Comparing(%s)To(%s)", MStringRaw(Path), MStringRaw(Module->Path));
-            if (MStringCompare(Path, Module->Path, 1) != MSTRING_NO_MATCH) {
-                assert(Module->Data != NULL && Module->Length != 0);
-                *Buffer = (void*)Module->Data;
-                *Length = Module->Length;
-                Result  = OsSuccess;
-                break;
-            }
+    Module = ModulesByPath[HashPath(Path)];
+    while (Module != NULL) {
+        TRACE("Comparing(%s)To(%s)", MStringRaw(Path), MStringRaw(Module->Path));
+        if (MStringCompare(Path, Module->Path, 1) != MSTRING_NO_MATCH) {
+            break;
         }
+        Module = Module->PathLink;
     }
-    return Result;
+
+    if (!Module) {
+        return OsError;
+    }
+
+    Status = LoadModuleData(Module);
+    if (Status == OsSuccess) {
+        assert(Module->Data != NULL && Module->Length != 0);
+        *Buffer = (void*)Module->Data;
+        *Length = Module->Length;
+    }
+    return Status;
 }
 
 SystemModule_t*
@@ -127,12 +307,13 @@ GetGenericDeviceModule(
     _In_ DevInfo_t DeviceClass, 
     _In_ DevInfo_t DeviceSubclass)
 {
-    foreach(i, &Modules) {
-        SystemModule_t* Module = (SystemModule_t*)i->value;
+    SystemModule_t* Module = ModulesByGeneric[HashIdentifiers(DeviceClass, DeviceSubclass)];
+    while (Module != NULL) {
         if (Module->DeviceClass       == DeviceClass
             && Module->DeviceSubclass == DeviceSubclass) {
             return Module;
         }
+        Module = Module->GenericLink;
     }
     return NULL;
 }
@@ -142,14 +323,17 @@ GetSpecificDeviceModule(
     _In_ DevInfo_t VendorId,
     _In_ DevInfo_t DeviceId)
 {
+    SystemModule_t* Module;
     if (VendorId == 0) {
         return NULL;
     }
-    foreach(i, &Modules) {
-        SystemModule_t* Module = (SystemModule_t*)i->value;
+
+    Module = ModulesBySpecific[HashIdentifiers(VendorId, DeviceId)];
+    while (Module != NULL) {
         if (Module->VendorId == VendorId && Module->DeviceId == DeviceId) {
             return Module;
         }
+        Module = Module->SpecificLink;
     }
     return NULL;
 }
@@ -161,24 +345,29 @@ GetModule(
     _In_  DevInfo_t DeviceClass,
     _In_  DevInfo_t DeviceSubclass)
 {
-    foreach(i, &Modules) {
-        SystemModule_t* Module = (SystemModule_t*)i->value;
-        if (Module->PrimaryThreadId != UUID_INVALID) {
-            // Should we check vendor-id && device-id?
-            if (VendorId != 0 && DeviceId != 0) {
-                if (Module->VendorId == VendorId && Module->DeviceId == DeviceId) {
-                    return Module;
-                }
-            }
+    SystemModule_t* Module;
 
-            // Skip all fixed-vendor ids
-            if (Module->VendorId != 0xFFEF) {
-                if (Module->DeviceClass == DeviceClass && Module->DeviceSubclass == DeviceSubclass) {
-                    return Module;
-                }
+    // Should we check vendor-id && device-id?
+    if (VendorId != 0 && DeviceId != 0) {
+        Module = ModulesBySpecific[HashIdentifiers(VendorId, DeviceId)];
+        while (Module != NULL) {
+            if (Module->PrimaryThreadId != UUID_INVALID &&
+                Module->VendorId == VendorId && Module->DeviceId == DeviceId) {
+                return Module;
             }
+            Module = Module->SpecificLink;
+        }
+    }
+
+    Module = ModulesByGeneric[HashIdentifiers(DeviceClass, DeviceSubclass)];
+    while (Module != NULL) {
+        // Skip all fixed-vendor ids
+        if (Module->PrimaryThreadId != UUID_INVALID && Module->VendorId != 0xFFEF &&
+            Module->DeviceClass == DeviceClass && Module->DeviceSubclass == DeviceSubclass) {
+            return Module;
         }
-    }   
+        Module = Module->GenericLink;
+    }
     return NULL;
 }
 
@@ -52,6 +52,12 @@ ModuleThreadEntry(
     if (Status == OsSuccess) {
         Thread->Function  = (ThreadEntry_t)Module->Executable->EntryAddress;
         Thread->Arguments = NULL;
+        TimersGetSystemTick(&Module->LoadedAt);
+#ifdef __OSCONFIG_BOOT_TIMELINE
+        WRITELINE("[timeline] %s spawned %" PRIuIN " started %" PRIuIN " loaded %" PRIuIN "",
+            MStringRaw(Module->Path), (size_t)Module->SpawnedAt, (size_t)Module->StartedAt,
+            (size_t)Module->LoadedAt);
+#endif
     }
     else {
         ERROR("Failed to bootstrap pe image: %" PRIuIN "", Status);
@@ -74,7 +80,7 @@ SpawnModule(
 
     assert(Module != NULL);
     assert(Module->Executable == NULL);
-    assert(Module->Data != NULL && Module->Length != 0);
+    assert(Module->PackedData != NULL && Module->Length != 0);
 
     // Split path, even if a / is not found
     // it won't fail, since -1 + 1 = 0, so we just copy the entire string
@@ -82,6 +88,7 @@ SpawnModule(
     Module->WorkingDirectory = MStringSubString(Module->Path, 0, Index);
     Module->BaseDirectory    = MStringSubString(Module->Path, 0, Index);
     ModuleName               = MStringSubString(Module->Path, Index + 1, -1);
+    TimersGetSystemTick(&Module->SpawnedAt);
     Status                   = CreateThread(MStringRaw(ModuleName), ModuleThreadEntry, Module, 
         THREADING_KERNELENTRY | THREADING_USERMODE, UUID_INVALID, &Module->PrimaryThreadId);
     MStringDestroy(ModuleName);
@@ -26,7 +26,57 @@
 #include <modules/ramdisk.h>
 #include <modules/manager.h>
 #include <debug.h>
-#include <crc32.h>
+#include <timers.h>
+
+static SystemModuleType_t
+GetEntryModuleType(
+    _In_ SystemRamdiskEntry_t* Entry,
+    _In_ uint32_t              Flags)
+{
+    if (Entry->Type == RAMDISK_FILE) {
+        return FileResource;
+    }
+    else if (Flags & RAMDISK_MODULE_SERVER) {
+        return ServiceResource;
+    }
+    return ModuleResource;
+}
+
+static OsStatus_t
+ParseRamdiskEntry(
+    _In_ uintptr_t             RamdiskAddress,
+    _In_ size_t                RamdiskSize,
+    _In_ uint32_t              Version,
+    _In_ SystemRamdiskEntry_t* Entry)
+{
+    SystemRamdiskModuleHeaderV2_t* Header =
+        (SystemRamdiskModuleHeaderV2_t*)(RamdiskAddress + (uintptr_t)Entry->DataHeaderOffset);
+    size_t      HeaderLength = sizeof(SystemRamdiskModuleHeader_t);
+    size_t      StoredLength = Header->LengthOfData;
+    int         Compression  = RAMDISK_COMPRESSION_NONE;
+    const void* ModuleData;
+
+    // Version 2 headers describe how the data is stored, version 1 is always
+    // stored as it is
+    if (Version == RAMDISK_VERSION_2) {
+        HeaderLength = sizeof(SystemRamdiskModuleHeaderV2_t);
+        StoredLength = Header->LengthOfStoredData;
+        Compression  = (int)Header->Compression;
+    }
+
+    if ((size_t)Entry->DataHeaderOffset + HeaderLength + StoredLength > RamdiskSize) {
+        ERROR("Ramdisk entry %s is out of bounds", &Entry->Name[0]);
+        return OsError;
+    }
+
+    // The data is only validated once the module is used, this avoids having
+    // to touch every byte of the ramdisk before boot can continue
+    ModuleData = (const void*)(RamdiskAddress + Entry->DataHeaderOffset + HeaderLength);
+    return RegisterPackedModule((const char*)&Entry->Name[0], ModuleData, StoredLength,
+        Header->LengthOfData, Compression, Header->Crc32OfData, 
+        GetEntryModuleType(Entry, Header->Flags), Header->VendorId, 
+        Header->DeviceId, Header->DeviceType, Header->DeviceSubType);
+}
 
 OsStatus_t
 ParseInitialRamdisk(
@@ -35,13 +85,15 @@ ParseInitialRamdisk(
     SystemRamdiskHeader_t* Ramdisk;
     SystemRamdiskEntry_t*  Entry;
     int                    Counter = 0;
-    SystemModuleType_t     Type;
+    clock_t                Start   = 0;
+    clock_t                End     = 0;
 
     TRACE("ParseInitialRamdisk(Address 0x%" PRIxIN ", Size 0x%" PRIxIN ")",
         BootInformation->RamdiskAddress, BootInformation->RamdiskSize);
     if (BootInformation->RamdiskAddress == 0 || BootInformation->RamdiskSize == 0) {
         return OsError;
     }
+    TimersGetSystemTick(&Start);
     
     // Initialize the pointer and read the signature value, must match
     Ramdisk = (SystemRamdiskHeader_t*)(uintptr_t)BootInformation->RamdiskAddress;
@@ -49,7 +101,7 @@ ParseInitialRamdisk(
         ERROR("Invalid magic in ramdisk - 0x%" PRIxIN "", Ramdisk->Magic);
         return OsError;
     }
-    if (Ramdisk->Version != RAMDISK_VERSION_1) {
+    if (Ramdisk->Version != RAMDISK_VERSION_1 && Ramdisk->Version != RAMDISK_VERSION_2) {
         ERROR("Invalid ramdisk version - 0x%" PRIxIN "", Ramdisk->Version);
         return OsError;
     }
@@ -61,40 +113,11 @@ ParseInitialRamdisk(
     TRACE("Parsing %" PRIiIN " number of files in the ramdisk", Counter);
     while (Counter != 0) {
         if (Entry->Type == RAMDISK_MODULE || Entry->Type == RAMDISK_FILE) {
-            SystemRamdiskModuleHeader_t* Header =
-                (SystemRamdiskModuleHeader_t*)(
-                    (uintptr_t)BootInformation->RamdiskAddress + (uintptr_t)Entry->DataHeaderOffset);
-            uint8_t* ModuleData;
-            uint32_t CrcOfData;
-
-            if (Entry->Type == RAMDISK_FILE) {
-                Type = FileResource;
-            }
-            else {
-                if (Header->Flags & RAMDISK_MODULE_SERVER) {
-                    Type = ServiceResource;
-                }
-                else {
-                    Type = ModuleResource;
-                }
-            }
-
-            // Perform CRC validation
-            ModuleData = (uint8_t*)(BootInformation->RamdiskAddress 
-                + Entry->DataHeaderOffset + sizeof(SystemRamdiskModuleHeader_t));
-            CrcOfData  = Crc32Generate(-1, ModuleData, Header->LengthOfData);
-            if (CrcOfData == Header->Crc32OfData) {
-                if (RegisterModule((const char*)&Entry->Name[0], (const void*)ModuleData, Header->LengthOfData, 
-                    Type, Header->VendorId, Header->DeviceId, Header->DeviceType, Header->DeviceSubType) != OsSuccess) {
-                    // @todo ?
-                    FATAL(FATAL_SCOPE_KERNEL, "failed to register module");
-                }
-            }
-            else
-            {
-                ERROR("CRC-Validation(%s): Failed (Calculated 0x%" PRIxIN " != Stored 0x%" PRIxIN ")",
-                    &Entry->Name[0], CrcOfData, Header->Crc32OfData);
-                break;
+            OsStatus_t Status = ParseRamdiskEntry((uintptr_t)BootInformation->RamdiskAddress,
+                (size_t)BootInformation->RamdiskSize, Ramdisk->Version, Entry);
+            if (Status != OsSuccess) {
+                // @todo ?
+                FATAL(FATAL_SCOPE_KERNEL, "failed to register module");
             }
         }
         else {
@@ -103,5 +126,9 @@ ParseInitialRamdisk(
         Counter--;
         Entry++;
     }
+    
+    TimersGetSystemTick(&End);
+    TRACE("Parsed ramdisk version %" PRIuIN " in %" PRIuIN " ticks", 
+        Ramdisk->Version, (size_t)(End - Start));
     return OsSuccess;
 }
@@ -18,20 +18,43 @@
  *
  * Logging Interface
  * - Contains the shared kernel log interface for logging-usage
+ *
+ * Messages are appended as compact binary records (format, arguments) to per-core
+ * rings without taking any locks. Formatting and rendering is done later by the
+ * log thread, which drains the rings into the text history under the log lock.
  */
 
 #include <arch/output.h>
 #include <arch/utils.h>
 #include <assert.h>
+#include <component/cpu.h>
 #include <handle.h>
 #include <heap.h>
 #include <irq_spinlock.h>
 #include <log.h>
 #include <machine.h>
+#include <scheduler.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <threading.h>
+#include <timers.h>
+
+#define LOG_RECORD_PAYLOAD     (LOG_STRING_LENGTH + 1)
+#define LOG_RING_CAPACITY      256
+#define LOG_MAX_RINGS          64
+#define LOG_MAX_CORES          256
+#define LOG_CONSUMER_INTERVAL  10
+
+// Argument classes in the record payload
+#define LOG_ARGUMENT_INT       0
+#define LOG_ARGUMENT_LONG      1
+#define LOG_ARGUMENT_LONGLONG  2
+#define LOG_ARGUMENT_POINTER   3
+#define LOG_ARGUMENT_STRING    4
+#define LOG_ARGUMENT_NONE      5
+
+#define LOG_RECORD_TRUNCATED   0x1
 
 typedef struct SystemLogLine {
     int    Type;
@@ -40,16 +63,42 @@ typedef struct SystemLogLine {
     char   Data[128]; // Message
 } SystemLogLine_t;
 
+typedef struct SystemLogRecord {
+    _Atomic(size_t) Sequence;
+    const char*     Format;
+    clock_t         Timestamp;
+    UUId_t          CoreId;
+    UUId_t          ThreadHandle;
+    uint8_t         Type;
+    uint8_t         Flags;
+    uint16_t        PayloadLength;
+    uint8_t         Payload[LOG_RECORD_PAYLOAD];
+} SystemLogRecord_t;
+
+typedef struct SystemLogRing {
+    _Atomic(size_t)    Head;
+    _Atomic(size_t)    Tail;
+    _Atomic(size_t)    Dropped;
+    size_t             DroppedReported;
+    size_t             Capacity;
+    SystemLogRecord_t* Records;
+} SystemLogRing_t;
+
 typedef struct SystemLog {
     uintptr_t*       StartOfData;
     size_t           DataSize;
     int              NumberOfLines;
     SystemLogLine_t* Lines;
     IrqSpinlock_t    SyncObject;
-    
-    int LineIndex;
-    int RenderIndex;
-    int AllowRender;
+
+    int    LineIndex;
+    int    RenderIndex;
+    size_t LineSequence;
+    int    AllowRender;
+    int    ConsumerActive;
+
+    SystemLogRing_t* Rings[LOG_MAX_RINGS];
+    _Atomic(int)     RingCount;
 } SystemLog_t;
 
 static char* TypeDescriptions[] = {
@@ -68,8 +117,11 @@ static uint32_t TypeColors[] = {
     0xFF392B
 };
 
-static SystemLog_t LogObject                 = { 0 };
-static char StaticLogSpace[LOG_INITIAL_SIZE] = { 0 };
+static SystemLog_t       LogObject                          = { 0 };
+static char              StaticLogSpace[LOG_INITIAL_SIZE]   = { 0 };
+static SystemLogRecord_t StaticRecords[LOG_RING_CAPACITY / 8];
+static SystemLogRing_t   BootRing                           = { 0 };
+static SystemLogRing_t*  CoreRings[LOG_MAX_CORES]           = { 0 };
 
 void
 LogInitialize(void)
@@ -77,27 +129,302 @@ LogInitialize(void)
     // Setup initial log space
     LogObject.StartOfData   = (uintptr_t*)&StaticLogSpace[0];
     LogObject.DataSize      = LOG_INITIAL_SIZE;
-    
+
     LogObject.Lines         = (SystemLogLine_t*)&StaticLogSpace[0];
     LogObject.NumberOfLines = LOG_INITIAL_SIZE / sizeof(SystemLogLine_t);
+
+    // The boot ring is shared by all cores that have no ring of their own
+    BootRing.Capacity = LOG_RING_CAPACITY / 8;
+    BootRing.Records  = &StaticRecords[0];
+    LogObject.Rings[0] = &BootRing;
+    atomic_store(&LogObject.RingCount, 1);
 }
 
-void
-LogInitializeFull(void)
+static SystemLogRing_t*
+CreateRing(
+    _In_ size_t Capacity)
 {
-    void* UpgradeBuffer;
+    SystemLogRing_t* Ring = (SystemLogRing_t*)kmalloc(sizeof(SystemLogRing_t) +
+        (Capacity * sizeof(SystemLogRecord_t)));
+    if (!Ring) {
+        return NULL;
+    }
 
-    // Upgrade the buffer
-    UpgradeBuffer = kmalloc(LOG_PREFFERED_SIZE);
-    memset(UpgradeBuffer, 0, LOG_PREFFERED_SIZE);
+    memset(Ring, 0, sizeof(SystemLogRing_t) + (Capacity * sizeof(SystemLogRecord_t)));
+    Ring->Capacity = Capacity;
+    Ring->Records  = (SystemLogRecord_t*)((uint8_t*)Ring + sizeof(SystemLogRing_t));
+    return Ring;
+}
 
-	IrqSpinlockAcquire(&LogObject.SyncObject);
-    memcpy(UpgradeBuffer, (const void*)LogObject.StartOfData, LogObject.DataSize);
-    LogObject.StartOfData   = (uintptr_t*)UpgradeBuffer;
-    LogObject.DataSize      = LOG_PREFFERED_SIZE;
-    LogObject.Lines         = (SystemLogLine_t*)UpgradeBuffer;
-    LogObject.NumberOfLines = LOG_PREFFERED_SIZE / sizeof(SystemLogLine_t);
-	IrqSpinlockRelease(&LogObject.SyncObject);
+static void
+RegisterCoreRing(
+    _In_ UUId_t CoreId)
+{
+    SystemLogRing_t* Ring;
+    int              Index;
+
+    if (CoreId >= LOG_MAX_CORES || CoreRings[CoreId] != NULL) {
+        return;
+    }
+
+    Index = atomic_load(&LogObject.RingCount);
+    if (Index == LOG_MAX_RINGS) {
+        return;
+    }
+
+    Ring = CreateRing(LOG_RING_CAPACITY);
+    if (!Ring) {
+        return;
+    }
+
+    // Publish the ring for the consumer before the producer starts using it
+    LogObject.Rings[Index] = Ring;
+    atomic_store(&LogObject.RingCount, Index + 1);
+    CoreRings[CoreId] = Ring;
+}
+
+/* ClassifyArgument
+ * Parses a single conversion specification starting after the '%', and returns the
+ * argument class together with the number of '*' width/precision arguments. */
+static const char*
+ClassifyArgument(
+    _In_  const char* Format,
+    _Out_ int*        Class,
+    _Out_ int*        Stars)
+{
+    int Longs = 0;
+
+    *Stars = 0;
+    while (*Format && strchr("-+ #0", *Format)) {
+        Format++;
+    }
+    while (*Format == '*' || (*Format >= '0' && *Format <= '9') || *Format == '.') {
+        if (*Format == '*') {
+            (*Stars)++;
+        }
+        Format++;
+    }
+    while (*Format && strchr("hlzjtLq", *Format)) {
+        if (*Format == 'l') {
+            Longs++;
+        }
+        else if (*Format == 'z' || *Format == 't') {
+            Longs = (sizeof(size_t) == sizeof(long long) && sizeof(long) != sizeof(long long)) ? 2 : 1;
+        }
+        else if (*Format == 'j' || *Format == 'L' || *Format == 'q') {
+            Longs = 2;
+        }
+        Format++;
+    }
+
+    switch (*Format) {
+        case 's': *Class = LOG_ARGUMENT_STRING; break;
+        case 'p': *Class = LOG_ARGUMENT_POINTER; break;
+        case 'd': case 'i': case 'u': case 'x':
+        case 'X': case 'o': case 'c': {
+            *Class = (Longs >= 2) ? LOG_ARGUMENT_LONGLONG :
+                (Longs == 1) ? LOG_ARGUMENT_LONG : LOG_ARGUMENT_INT;
+        } break;
+        default: {
+            *Class = LOG_ARGUMENT_NONE;
+        } break;
+    }
+    return *Format ? (Format + 1) : Format;
+}
+
+static int
+PushValue(
+    _In_ SystemLogRecord_t* Record,
+    _In_ uint64_t           Value)
+{
+    if ((Record->PayloadLength + sizeof(uint64_t)) > LOG_RECORD_PAYLOAD) {
+        return 0;
+    }
+    memcpy(&Record->Payload[Record->PayloadLength], &Value, sizeof(uint64_t));
+    Record->PayloadLength += sizeof(uint64_t);
+    return 1;
+}
+
+static int
+PushString(
+    _In_ SystemLogRecord_t* Record,
+    _In_ const char*        String)
+{
+    size_t Available = LOG_RECORD_PAYLOAD - Record->PayloadLength;
+    size_t Length;
+
+    if (Available < 2) {
+        return 0;
+    }
+    if (!String) {
+        String = "(null)";
+    }
+
+    // Strings are stored inline as a length byte followed by the characters, as
+    // the memory they live in is not guaranteed to be around when rendering
+    Length = MIN(strlen(String), MIN(Available - 1, 255));
+    Record->Payload[Record->PayloadLength++] = (uint8_t)Length;
+    memcpy(&Record->Payload[Record->PayloadLength], String, Length);
+    Record->PayloadLength += (uint16_t)Length;
+    return 1;
+}
+
+static void
+CaptureArguments(
+    _In_ SystemLogRecord_t* Record,
+    _In_ const char*        Format,
+    _In_ va_list            Arguments)
+{
+    int Class, Stars, Stored = 1;
+
+    while (*Format && Stored) {
+        if (*Format++ != '%') {
+            continue;
+        }
+        if (*Format == '%') {
+            Format++;
+            continue;
+        }
+
+        Format = ClassifyArgument(Format, &Class, &Stars);
+        while (Stars-- && Stored) {
+            Stored = PushValue(Record, (uint64_t)(int64_t)va_arg(Arguments, int));
+        }
+        if (!Stored) {
+            break;
+        }
+
+        switch (Class) {
+            case LOG_ARGUMENT_INT:      Stored = PushValue(Record, (uint64_t)va_arg(Arguments, unsigned int)); break;
+            case LOG_ARGUMENT_LONG:     Stored = PushValue(Record, (uint64_t)va_arg(Arguments, unsigned long)); break;
+            case LOG_ARGUMENT_LONGLONG: Stored = PushValue(Record, (uint64_t)va_arg(Arguments, unsigned long long)); break;
+            case LOG_ARGUMENT_POINTER:  Stored = PushValue(Record, (uint64_t)(uintptr_t)va_arg(Arguments, void*)); break;
+            case LOG_ARGUMENT_STRING:   Stored = PushString(Record, va_arg(Arguments, const char*)); break;
+            default:
+                break;
+        }
+    }
+
+    if (!Stored) {
+        Record->Flags |= LOG_RECORD_TRUNCATED;
+    }
+}
+
+static int
+PopValue(
+    _In_  SystemLogRecord_t* Record,
+    _In_  size_t*            Offset,
+    _Out_ uint64_t*          Value)
+{
+    if ((*Offset + sizeof(uint64_t)) > Record->PayloadLength) {
+        return 0;
+    }
+    memcpy(Value, &Record->Payload[*Offset], sizeof(uint64_t));
+    *Offset += sizeof(uint64_t);
+    return 1;
+}
+
+/* RenderRecord
+ * Formats a record into text. The format is walked again, and every conversion is formatted
+ * on its own with the captured argument, which avoids having to rebuild a va_list. */
+static void
+RenderRecord(
+    _In_ SystemLogRecord_t* Record,
+    _In_ char*              Buffer,
+    _In_ size_t             Length)
+{
+    const char* Format  = Record->Format;
+    size_t      Offset  = 0;
+    size_t      Written = 0;
+    char        Specification[24];
+
+    while (*Format && Written < (Length - 1)) {
+        const char* Start;
+        uint64_t    Stars[2] = { 0 };
+        uint64_t    Value    = 0;
+        int         Class, StarCount, i, Result = 0;
+        int         Valid = 1;
+        size_t      SpecLength;
+
+        if (*Format != '%' || Format[1] == '%') {
+            Buffer[Written++] = *Format;
+            Format += (*Format == '%') ? 2 : 1;
+            continue;
+        }
+
+        Start      = Format++;
+        Format     = ClassifyArgument(Format, &Class, &StarCount);
+        SpecLength = MIN((size_t)(Format - Start), sizeof(Specification) - 1);
+        memcpy(&Specification[0], Start, SpecLength);
+        Specification[SpecLength] = '\0';
+
+        for (i = 0; i < StarCount; i++) {
+            if (i < 2) {
+                Valid &= PopValue(Record, &Offset, &Stars[i]);
+            }
+        }
+
+        if (Class == LOG_ARGUMENT_STRING) {
+            char   String[LOG_RECORD_PAYLOAD];
+            size_t StringLength = 0;
+            if (Valid && Offset < Record->PayloadLength) {
+                StringLength = MIN(Record->Payload[Offset], Record->PayloadLength - Offset - 1);
+                memcpy(&String[0], &Record->Payload[Offset + 1], StringLength);
+                Offset += StringLength + 1;
+            }
+            else {
+                Valid = 0;
+            }
+            String[StringLength] = '\0';
+
+            if (Valid) {
+                if (StarCount == 0)      Result = snprintf(&Buffer[Written], Length - Written, Specification, &String[0]);
+                else if (StarCount == 1) Result = snprintf(&Buffer[Written], Length - Written, Specification, (int)Stars[0], &String[0]);
+                else                     Result = snprintf(&Buffer[Written], Length - Written, Specification, (int)Stars[0], (int)Stars[1], &String[0]);
+            }
+        }
+        else if (Class != LOG_ARGUMENT_NONE) {
+            Valid &= PopValue(Record, &Offset, &Value);
+            if (Valid && StarCount == 0) {
+                switch (Class) {
+                    case LOG_ARGUMENT_INT:      Result = snprintf(&Buffer[Written], Length - Written, Specification, (unsigned int)Value); break;
+                    case LOG_ARGUMENT_LONG:     Result = snprintf(&Buffer[Written], Length - Written, Specification, (unsigned long)Value); break;
+                    case LOG_ARGUMENT_LONGLONG: Result = snprintf(&Buffer[Written], Length - Written, Specification, (unsigned long long)Value); break;
+                    default:                    Result = snprintf(&Buffer[Written], Length - Written, Specification, (void*)(uintptr_t)Value); break;
+                }
+            }
+            else if (Valid) {
+                // Width or precision given as arguments, these are only used with plain ints
+                if (StarCount == 1) Result = snprintf(&Buffer[Written], Length - Written, Specification, (int)Stars[0], (unsigned int)Value);
+                else                Result = snprintf(&Buffer[Written], Length - Written, Specification, (int)Stars[0], (int)Stars[1], (unsigned int)Value);
+            }
+        }
+
+        if (!Valid) {
+            Result = snprintf(&Buffer[Written], Length - Written, "?");
+        }
+        if (Result > 0) {
+            Written = MIN(Written + (size_t)Result, Length - 1);
+        }
+    }
+    Buffer[Written] = '\0';
+}
+
+static SystemLogLine_t*
+AllocateLine(void)
+{
+    SystemLogLine_t* Line = &LogObject.Lines[LogObject.LineIndex++];
+    if (LogObject.LineIndex == LogObject.NumberOfLines) {
+        LogObject.LineIndex = 0;
+    }
+
+    // The oldest line is overwritten even if it was never rendered
+    if (LogObject.LineIndex == LogObject.RenderIndex) {
+        LogObject.RenderIndex = (LogObject.RenderIndex + 1) % LogObject.NumberOfLines;
+    }
+    LogObject.LineSequence++;
+    memset((void*)Line, 0, sizeof(SystemLogLine_t));
+    return Line;
 }
 
 void
@@ -105,7 +432,7 @@ LogRenderMessages(void)
 {
     SystemLogLine_t* Line;
     MCoreThread_t*   Thread;
-    
+
     if (!LogObject.AllowRender) {
         return;
     }
@@ -126,7 +453,7 @@ LogRenderMessages(void)
         }
         else {
             VideoGetTerminal()->FgColor = TypeColors[Line->Type];
-            printf("[%s-%u-%s] ", TypeDescriptions[Line->Type], Line->CoreId, 
+            printf("[%s-%u-%s] ", TypeDescriptions[Line->Type], Line->CoreId,
                 Thread ? Thread->Name : "boot");
             if (Line->Type != LOG_ERROR) {
                 VideoGetTerminal()->FgColor = 0;
@@ -136,6 +463,123 @@ LogRenderMessages(void)
     }
 }
 
+static SystemLogRecord_t*
+PeekRecord(
+    _In_ SystemLogRing_t* Ring)
+{
+    size_t             Tail   = atomic_load_explicit(&Ring->Tail, memory_order_relaxed);
+    SystemLogRecord_t* Record = &Ring->Records[Tail & (Ring->Capacity - 1)];
+    if (atomic_load_explicit(&Record->Sequence, memory_order_acquire) != (Tail + 1)) {
+        return NULL;
+    }
+    return Record;
+}
+
+/* LogDrainRecords
+ * Moves all committed records from the per-core rings into the text history, oldest first.
+ * Must be called with the log lock held, which makes the caller the only consumer. */
+static void
+LogDrainRecords(void)
+{
+    int RingCount = atomic_load(&LogObject.RingCount);
+    int i;
+
+    // Report drops before the records that follow them
+    for (i = 0; i < RingCount; i++) {
+        SystemLogRing_t* Ring    = LogObject.Rings[i];
+        size_t           Dropped = atomic_load_explicit(&Ring->Dropped, memory_order_relaxed);
+        if (Dropped != Ring->DroppedReported) {
+            SystemLogLine_t* Line = AllocateLine();
+            Line->Type         = LOG_WARNING;
+            Line->CoreId       = ArchGetProcessorCoreId();
+            Line->ThreadHandle = UUID_INVALID;
+            snprintf(&Line->Data[0], sizeof(Line->Data) - 1, "log: %" PRIuIN " messages dropped",
+                Dropped - Ring->DroppedReported);
+            Ring->DroppedReported = Dropped;
+        }
+    }
+
+    while (1) {
+        SystemLogRing_t*   SelectedRing   = NULL;
+        SystemLogRecord_t* SelectedRecord = NULL;
+        SystemLogLine_t*   Line;
+
+        for (i = 0; i < RingCount; i++) {
+            SystemLogRecord_t* Record = PeekRecord(LogObject.Rings[i]);
+            if (Record && (!SelectedRecord || Record->Timestamp < SelectedRecord->Timestamp)) {
+                SelectedRing   = LogObject.Rings[i];
+                SelectedRecord = Record;
+            }
+        }
+
+        if (!SelectedRecord) {
+            break;
+        }
+
+        Line               = AllocateLine();
+        Line->Type         = SelectedRecord->Type;
+        Line->CoreId       = SelectedRecord->CoreId;
+        Line->ThreadHandle = SelectedRecord->ThreadHandle;
+        RenderRecord(SelectedRecord, &Line->Data[0], sizeof(Line->Data) - 1);
+        atomic_store_explicit(&SelectedRing->Tail,
+            atomic_load_explicit(&SelectedRing->Tail, memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
+static void
+LogFlush(void)
+{
+    IrqSpinlockAcquire(&LogObject.SyncObject);
+    LogDrainRecords();
+    LogRenderMessages();
+    IrqSpinlockRelease(&LogObject.SyncObject);
+}
+
+static void
+LogConsumerThread(
+    _In_Opt_ void* Arguments)
+{
+    clock_t Interrupted;
+    _CRT_UNUSED(Arguments);
+
+    while (1) {
+        LogFlush();
+        SchedulerSleep(LOG_CONSUMER_INTERVAL * NSEC_PER_MSEC, &Interrupted);
+    }
+}
+
+void
+LogInitializeFull(void)
+{
+    SystemCpuCore_t* Core;
+    void*            UpgradeBuffer;
+    UUId_t           ThreadHandle;
+
+    // Upgrade the buffer
+    UpgradeBuffer = kmalloc(LOG_PREFFERED_SIZE);
+    memset(UpgradeBuffer, 0, LOG_PREFFERED_SIZE);
+
+	IrqSpinlockAcquire(&LogObject.SyncObject);
+    memcpy(UpgradeBuffer, (const void*)LogObject.StartOfData, LogObject.DataSize);
+    LogObject.StartOfData   = (uintptr_t*)UpgradeBuffer;
+    LogObject.DataSize      = LOG_PREFFERED_SIZE;
+    LogObject.Lines         = (SystemLogLine_t*)UpgradeBuffer;
+    LogObject.NumberOfLines = LOG_PREFFERED_SIZE / sizeof(SystemLogLine_t);
+	IrqSpinlockRelease(&LogObject.SyncObject);
+
+    // Give each of the known cores its own ring, so they never contend on the log
+    Core = GetMachine()->Processor.Cores;
+    while (Core) {
+        RegisterCoreRing(Core->Id);
+        Core = Core->Link;
+    }
+
+    // Hand over the formatting and rendering to the log thread
+    if (CreateThread("log", LogConsumerThread, NULL, 0, UUID_INVALID, &ThreadHandle) == OsSuccess) {
+        LogObject.ConsumerActive = 1;
+    }
+}
+
 void
 LogSetRenderMode(
     _In_ int Enable)
@@ -143,9 +587,7 @@ LogSetRenderMode(
     // Update status, flush log
     LogObject.AllowRender = Enable;
     if (Enable) {
-	    IrqSpinlockAcquire(&LogObject.SyncObject);
-        LogRenderMessages();
-	    IrqSpinlockRelease(&LogObject.SyncObject);
+        LogFlush();
     }
 }
 
@@ -155,31 +597,101 @@ LogAppendMessage(
     _In_ const char* Message,
     ...)
 {
-    SystemLogLine_t* Line;
-	va_list          Arguments;
-	UUId_t           CoreId = ArchGetProcessorCoreId();
+    SystemLogRing_t*   Ring;
+    SystemLogRecord_t* Record;
+	va_list            Arguments;
+	UUId_t             CoreId = ArchGetProcessorCoreId();
+    size_t             Head;
 
     assert(Message != NULL);
-    
-    // Get a new line object
-	IrqSpinlockAcquire(&LogObject.SyncObject);
-	if ((LogObject.LineIndex + 1) % LogObject.NumberOfLines == LogObject.RenderIndex) {
-	    LogRenderMessages();
-	}
-	
-    Line = &LogObject.Lines[LogObject.LineIndex++];
-    if (LogObject.LineIndex == LogObject.NumberOfLines) {
-        LogObject.LineIndex = 0;
+
+    Ring = (CoreId < LOG_MAX_CORES && CoreRings[CoreId]) ? CoreRings[CoreId] : &BootRing;
+
+    // Reserve a slot, interrupts on this core (and other cores for the boot ring) may
+    // reserve slots concurrently, so the reservation must be atomic
+    Head = atomic_load_explicit(&Ring->Head, memory_order_relaxed);
+    do {
+        if ((Head - atomic_load_explicit(&Ring->Tail, memory_order_acquire)) >= Ring->Capacity) {
+            atomic_fetch_add_explicit(&Ring->Dropped, 1, memory_order_relaxed);
+            Head = (size_t)-1;
+            break;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&Ring->Head, &Head, Head + 1,
+        memory_order_acq_rel, memory_order_relaxed));
+
+    if (Head != (size_t)-1) {
+        Record                = &Ring->Records[Head & (Ring->Capacity - 1)];
+        Record->Format        = Message;
+        Record->CoreId        = CoreId;
+        Record->ThreadHandle  = GetCurrentThreadId();
+        Record->Type          = (uint8_t)Type;
+        Record->Flags         = 0;
+        Record->PayloadLength = 0;
+        TimersGetSystemTick(&Record->Timestamp);
+
+	    va_start(Arguments, Message);
+        CaptureArguments(Record, Message, Arguments);
+        va_end(Arguments);
+        atomic_store_explicit(&Record->Sequence, Head + 1, memory_order_release);
     }
-    
-    memset((void*)Line, 0, sizeof(SystemLogLine_t));
-    Line->Type         = Type;
-    Line->CoreId       = CoreId;
-    Line->ThreadHandle = GetCurrentThreadId();
-    
-	va_start(Arguments, Message);
-    vsnprintf(&Line->Data[0], sizeof(Line->Data) - 1, Message, Arguments);
-    va_end(Arguments);
-	LogRenderMessages();
-	IrqSpinlockRelease(&LogObject.SyncObject);
+
+    // Until the log thread runs, and for errors that may precede a halt, the message is
+    // rendered immediately
+    if (!LogObject.ConsumerActive || Type == LOG_ERROR) {
+        LogFlush();
+    }
+}
+
+OsStatus_t
+LogRead(
+    _InOut_ size_t* Cursor,
+    _In_    char*   Buffer,
+    _In_    size_t  Length,
+    _Out_   size_t* BytesRead)
+{
+    SystemLogLine_t Line;
+    size_t          Written = 0;
+
+    if (!Cursor || !Buffer || !Length || !BytesRead) {
+        return OsInvalidParameters;
+    }
+
+    while (1) {
+        size_t Oldest, LineLength;
+        int    Index;
+
+        // Copy out a single line at the time, the user buffer must not be touched
+        // with the lock held
+        IrqSpinlockAcquire(&LogObject.SyncObject);
+        LogDrainRecords();
+        Oldest = (LogObject.LineSequence > (size_t)LogObject.NumberOfLines) ?
+            (LogObject.LineSequence - LogObject.NumberOfLines) : 0;
+        if (*Cursor < Oldest) {
+            *Cursor = Oldest;
+        }
+        if (*Cursor >= LogObject.LineSequence) {
+            IrqSpinlockRelease(&LogObject.SyncObject);
+            break;
+        }
+
+        Index = (int)((LogObject.LineIndex + LogObject.NumberOfLines -
+            (int)(LogObject.LineSequence - *Cursor)) % LogObject.NumberOfLines);
+        memcpy(&Line, &LogObject.Lines[Index], sizeof(SystemLogLine_t));
+        IrqSpinlockRelease(&LogObject.SyncObject);
+
+        LineLength = strnlen(&Line.Data[0], sizeof(Line.Data));
+        if ((Written + LineLength + 1) > Length) {
+            break;
+        }
+
+        memcpy(&Buffer[Written], &Line.Data[0], LineLength);
+        Written += LineLength;
+        if (Line.Type != LOG_RAW) {
+            Buffer[Written++] = '\n';
+        }
+        (*Cursor)++;
+    }
+
+    *BytesRead = Written;
+    return OsSuccess;
 }
@@ -22,6 +22,7 @@
 #define __MODULE "FUTX"
 //#define __TRACE
 
+#include <arch.h>
 #include <arch/interrupts.h>
 #include <arch/thread.h>
 #include <arch/utils.h>
@@ -29,29 +30,51 @@
 #include <ds/list.h>
 #include <debug.h>
 #include <futex.h>
+#include <handle.h>
 #include <heap.h>
-#include <os/spinlock.h>
+#include <irq_spinlock.h>
 #include <memoryspace.h>
 #include <scheduler.h>
 #include <string.h>
+#include <threading.h>
 
 #define FUTEX_HASHTABLE_CAPACITY 64
 
-// One per memory context
-typedef struct FutexItem {
-    element_t    Header;
-    list_t       BlockQueue;
-    spinlock_t   BlockQueueSyncObject;
-    _Atomic(int) Waiters;
-    
+#define FUTEX_KEY_PRIVATE 0 // Virtual address in a memory space context
+#define FUTEX_KEY_SHARED  1 // Physical frame and offset, the same in every memory space
+#define FUTEX_KEY_KERNEL  2 // Virtual address in kernel memory, mapped in every memory space
+
+typedef struct FutexKey {
+    int                         Type;
+    uintptr_t                   Address;    // The physical frame for shared keys
+    uintptr_t                   Offset;
     SystemMemorySpaceContext_t* Context;
-    uintptr_t                   FutexAddress;
-} FutexItem_t;
+} FutexKey_t;
 
 // One per futex key
+typedef struct FutexItem {
+    element_t      Header;
+    list_t         BlockQueue;
+    IrqSpinlock_t  BlockQueueSyncObject;
+    _Atomic(int)   Waiters;
+    list_t         PiWaiters;               // Protected by the BlockQueueSyncObject
+    UUId_t         PiOwner;                 // Protected by the BlockQueueSyncObject
+    MCoreThread_t* PiOwnerThread;
+    FutexKey_t     Key;
+} FutexItem_t;
+
+// Priority inheritance waiters block on a queue of their own, so the unlocking
+// thread can hand the futex to the waiter with the highest priority
+typedef struct FutexPiWaiter {
+    element_t      Header;
+    list_t         BlockQueue;
+    MCoreThread_t* Thread;
+} FutexPiWaiter_t;
+
+// One per hash value
 typedef struct FutexBucket {
-    spinlock_t   SyncObject;
-    list_t       Futexes;
+    IrqSpinlock_t SyncObject;
+    list_t        Futexes;
 } FutexBucket_t;
 
 static FutexBucket_t FutexBuckets[FUTEX_HASHTABLE_CAPACITY] = { 0 };
@@ -79,37 +102,88 @@ SchedulerGetCurrentObject(
         GetProcessorCore(CoreId)->CurrentThread->SchedulerObject : NULL;
 }
 
+/* FutexGetKey
+ * Private futexes are keyed by their virtual address, which only requires the memory space
+ * context. Kernel memory is mapped the same way in every memory space, so private futexes in
+ * kernel memory are keyed by their address alone. Shared futexes can be mapped at different
+ * addresses in each memory space, so they are keyed by the physical frame and the offset into
+ * it, which requires a page lookup. That includes shared futexes in kernel memory, which are
+ * also mapped into user-space, like the ipc streams and the interrupt event rings. */
+static OsStatus_t
+FutexGetKey(
+    _In_  _Atomic(int)* Futex,
+    _In_  int           Private,
+    _Out_ FutexKey_t*   Key)
+{
+    SystemMemorySpace_t* MemorySpace = GetCurrentMemorySpace();
+    uintptr_t            Address     = (uintptr_t)Futex;
+    uintptr_t            PhysicalAddress;
+    size_t               PageSize;
+
+    Key->Offset  = 0;
+    Key->Context = NULL;
+    if (Private && Address < MEMORY_LOCATION_KERNEL_END) {
+        Key->Type    = FUTEX_KEY_KERNEL;
+        Key->Address = Address;
+        return OsSuccess;
+    }
+
+    if (Private) {
+        Key->Type    = FUTEX_KEY_PRIVATE;
+        Key->Address = Address;
+        Key->Context = MemorySpace->Context;
+        return OsSuccess;
+    }
+
+    // Uncommitted pages have no frame, they would all share the key of frame 0
+    if (!(GetMemorySpaceAttributes(MemorySpace, Address) & MAPPING_COMMIT) ||
+        GetMemorySpaceMapping(MemorySpace, Address, 1, &PhysicalAddress) != OsSuccess) {
+        return OsDoesNotExist;
+    }
+
+    PageSize     = GetMemorySpacePageSize();
+    Key->Type    = FUTEX_KEY_SHARED;
+    Key->Address = PhysicalAddress & ~(PageSize - 1);
+    Key->Offset  = Address & (PageSize - 1);
+    return OsSuccess;
+}
+
+static inline int
+FutexKeyEquals(
+    _In_ FutexKey_t* Key1,
+    _In_ FutexKey_t* Key2)
+{
+    return Key1->Type == Key2->Type && Key1->Address == Key2->Address &&
+        Key1->Offset == Key2->Offset && Key1->Context == Key2->Context;
+}
+
 static FutexBucket_t*
 FutexGetBucket(
-    _In_ uintptr_t FutexAddress)
+    _In_ FutexKey_t* Key)
 {
-    size_t FutexHash = GetIntegerHash(FutexAddress);
+    size_t FutexHash = GetIntegerHash(Key->Address + Key->Offset);
     return &FutexBuckets[FutexHash & (FUTEX_HASHTABLE_CAPACITY - 1)];
 }
 
 // Must be called with the bucket lock held
 static FutexItem_t*
 FutexGetNode(
-    _In_ FutexBucket_t*              Bucket,
-    _In_ uintptr_t                   FutexAddress,
-    _In_ SystemMemorySpaceContext_t* Context)
+    _In_ FutexBucket_t* Bucket,
+    _In_ FutexKey_t*    Key)
 {
     foreach(i, &Bucket->Futexes) {
         FutexItem_t* Item = (FutexItem_t*)i->value;
-        if (Item->FutexAddress == FutexAddress &&
-            Item->Context      == Context) {
+        if (FutexKeyEquals(&Item->Key, Key)) {
             return Item;
         }
     }
     return NULL;
 }
 
-// Must be called with the bucket lock held
 static FutexItem_t*
 FutexCreateNode(
-    _In_ FutexBucket_t*              Bucket,
-    _In_ uintptr_t                   FutexAddress,
-    _In_ SystemMemorySpaceContext_t* Context)
+    _In_ FutexBucket_t* Bucket,
+    _In_ FutexKey_t*    Key)
 {
     FutexItem_t* Existing;
     FutexItem_t* Item = (FutexItem_t*)kmalloc(sizeof(FutexItem_t));
@@ -120,16 +194,17 @@ FutexCreateNode(
     memset(Item, 0, sizeof(FutexItem_t));
     ELEMENT_INIT(&Item->Header, 0, Item);
     list_construct(&Item->BlockQueue);
-    spinlock_init(&Item->BlockQueueSyncObject, spinlock_plain);
-    Item->FutexAddress = FutexAddress;
-    Item->Context      = Context;
+    list_construct(&Item->PiWaiters);
+    IrqSpinlockConstruct(&Item->BlockQueueSyncObject);
+    Item->PiOwner = UUID_INVALID;
+    memcpy(&Item->Key, Key, sizeof(FutexKey_t));
     
-    spinlock_acquire(&Bucket->SyncObject);
-    Existing = FutexGetNode(Bucket, FutexAddress, Context);
+    IrqSpinlockAcquire(&Bucket->SyncObject);
+    Existing = FutexGetNode(Bucket, Key);
     if (!Existing) {
         list_append(&Bucket->Futexes, &Item->Header);
     }
-    spinlock_release(&Bucket->SyncObject);
+    IrqSpinlockRelease(&Bucket->SyncObject);
     
     if (Existing) {
         kfree(Item);
@@ -138,6 +213,24 @@ FutexCreateNode(
     return Item;
 }
 
+static FutexItem_t*
+FutexGetItem(
+    _In_ FutexKey_t* Key,
+    _In_ int         Create)
+{
+    FutexBucket_t* Bucket = FutexGetBucket(Key);
+    FutexItem_t*   Item;
+
+    IrqSpinlockAcquire(&Bucket->SyncObject);
+    Item = FutexGetNode(Bucket, Key);
+    IrqSpinlockRelease(&Bucket->SyncObject);
+
+    if (!Item && Create) {
+        Item = FutexCreateNode(Bucket, Key);
+    }
+    return Item;
+}
+
 static void
 FutexPerformOperation(
     _In_ _Atomic(int)* Futex,
@@ -220,7 +313,7 @@ FutexInitialize(void)
 {
     int i;
     for (i = 0; i < FUTEX_HASHTABLE_CAPACITY; i++) {
-        spinlock_init(&FutexBuckets[i].SyncObject, spinlock_plain);
+        IrqSpinlockConstruct(&FutexBuckets[i].SyncObject);
         list_construct(&FutexBuckets[i].Futexes);
     }
     smp_wmb();
@@ -233,12 +326,11 @@ FutexWait(
     _In_ int           Flags,
     _In_ size_t        Timeout)
 {
-    SystemMemorySpaceContext_t* Context = NULL;
-    FutexBucket_t*              Bucket;
-    FutexItem_t*                FutexItem;
-    uintptr_t                   FutexAddress;
-    IntStatus_t                 CpuState;
-    int                         Result;
+    FutexItem_t* FutexItem;
+    FutexKey_t   Key;
+    IntStatus_t  CpuState;
+    OsStatus_t   Status;
+    int          Result;
     TRACE("%u: FutexWait(f 0x%llx, t %u)", GetCurrentThreadId(), Futex, Timeout);
     
     if (!SchedulerGetCurrentObject(ArchGetProcessorCoreId())) {
@@ -249,45 +341,29 @@ FutexWait(
         return OsNotSupported;
     }
     
-    // Get the futex context, if the context is private
-    // we can stick to the virtual address for sleeping
-    // otherwise we need to lookup the physical page
-    if (Flags & FUTEX_WAIT_PRIVATE) {
-        Context = GetCurrentMemorySpace()->Context;
-        FutexAddress = (uintptr_t)Futex;
-    }
-    else {
-        if (GetMemorySpaceMapping(GetCurrentMemorySpace(), (uintptr_t)Futex, 
-                1, &FutexAddress) != OsSuccess) {
-            return OsDoesNotExist;
-        }
+    Status = FutexGetKey(Futex, Flags & FUTEX_WAIT_PRIVATE, &Key);
+    if (Status != OsSuccess) {
+        return Status;
     }
 
-    Bucket = FutexGetBucket(FutexAddress);
+    FutexItem = FutexGetItem(&Key, 1);
+    if (!FutexItem) {
+        return OsOutOfMemory;
+    }
     
     // Disable interrupts here to gain safe passage, as we don't want to be
     // interrupted in this 'atomic' action. However when competing with other
     // cpus here, we must take care to flush any changes and reload any changes
     CpuState = InterruptDisable();
     
-    spinlock_acquire(&Bucket->SyncObject);
-    FutexItem = FutexGetNode(Bucket, FutexAddress, Context);
-    spinlock_release(&Bucket->SyncObject);
-    
-    if (!FutexItem) {
-        FutexItem = FutexCreateNode(Bucket, FutexAddress, Context);
-        if (!FutexItem) {
-            return OsOutOfMemory;
-        }
-    }
-    
     Result = atomic_fetch_add(&FutexItem->Waiters, 1);
     Result = atomic_load(Futex);
     if (Result != ExpectedValue) {
+        atomic_fetch_sub(&FutexItem->Waiters, 1);
         InterruptRestoreState(CpuState);
         return OsError;
     }
-    SchedulerBlock(&FutexItem->BlockQueue, Timeout);
+    SchedulerBlock(&FutexItem->BlockQueue, (uint64_t)Timeout * NSEC_PER_MSEC);
     InterruptRestoreState(CpuState);
     ThreadingYield();
 
@@ -306,12 +382,11 @@ FutexWaitOperation(
     _In_ int           Flags,
     _In_ size_t        Timeout)
 {
-    SystemMemorySpaceContext_t* Context = NULL;
-    FutexBucket_t*              Bucket;
-    FutexItem_t*                FutexItem;
-    uintptr_t                   FutexAddress;
-    IntStatus_t                 CpuState;
-    int                         Result;
+    FutexItem_t* FutexItem;
+    FutexKey_t   Key;
+    IntStatus_t  CpuState;
+    OsStatus_t   Status;
+    int          Result;
     TRACE("%u: FutexWaitOperation(f 0x%llx, t %u)", GetCurrentThreadId(), Futex, Timeout);
     
     if (!SchedulerGetCurrentObject(ArchGetProcessorCoreId())) {
@@ -322,47 +397,33 @@ FutexWaitOperation(
         return OsNotSupported;
     }
     
-    // Get the futex context, if the context is private
-    // we can stick to the virtual address for sleeping
-    // otherwise we need to lookup the physical page
-    if (Flags & FUTEX_WAIT_PRIVATE) {
-        Context = GetCurrentMemorySpace()->Context;
-        FutexAddress = (uintptr_t)Futex;
+    Status = FutexGetKey(Futex, Flags & FUTEX_WAIT_PRIVATE, &Key);
+    if (Status != OsSuccess) {
+        return Status;
     }
-    else {
-        if (GetMemorySpaceMapping(GetCurrentMemorySpace(), (uintptr_t)Futex, 
-                1, &FutexAddress) != OsSuccess) {
-            return OsDoesNotExist;
-        }
+
+    FutexItem = FutexGetItem(&Key, 1);
+    if (!FutexItem) {
+        return OsOutOfMemory;
     }
     
-    Bucket = FutexGetBucket(FutexAddress);
-    
     // Disable interrupts here to gain safe passage, as we don't want to be
     // interrupted in this 'atomic' action. However when competing with other
     // cpus here, we must take care to flush any changes and reload any changes
     CpuState = InterruptDisable();
     
-    spinlock_acquire(&Bucket->SyncObject);
-    FutexItem = FutexGetNode(Bucket, FutexAddress, Context);
-    spinlock_release(&Bucket->SyncObject);
-    
-    if (!FutexItem) {
-        FutexItem = FutexCreateNode(Bucket, FutexAddress, Context);
-        if (!FutexItem) {
-            return OsOutOfMemory;
-        }
-    }
-    
     Result = atomic_fetch_add(&FutexItem->Waiters, 1);
     Result = atomic_load(Futex);
     if (Result != ExpectedValue) {
+        atomic_fetch_sub(&FutexItem->Waiters, 1);
         InterruptRestoreState(CpuState);
         return OsError;
     }
-    SchedulerBlock(&FutexItem->BlockQueue, Timeout);
+    SchedulerBlock(&FutexItem->BlockQueue, (uint64_t)Timeout * NSEC_PER_MSEC);
     FutexPerformOperation(Futex2, Operation);
-    FutexWake(Futex2, Count2, Flags);
+
+    // The second futex must be keyed the same way as its waiters keyed it
+    FutexWake(Futex2, Count2, (Flags & FUTEX_WAIT_PRIVATE) ? FUTEX_WAKE_PRIVATE : 0);
     InterruptRestoreState(CpuState);
     ThreadingYield();
     
@@ -371,60 +432,95 @@ FutexWaitOperation(
     return SchedulerGetTimeoutReason();
 }
 
+typedef struct FutexTopContext {
+    int        Queue;
+    element_t* Element;
+} FutexTopContext_t;
+
+static int
+FutexFindTopQueue(
+    _In_ int        Index,
+    _In_ element_t* Element,
+    _In_ void*      Context)
+{
+    FutexTopContext_t* Top   = (FutexTopContext_t*)Context;
+    int                Queue = SchedulerObjectGetQueue((SchedulerObject_t*)Element->value);
+    _CRT_UNUSED(Index);
+
+    if (Queue < Top->Queue) {
+        Top->Queue = Queue;
+    }
+    return Top->Queue == 0 ? LIST_ENUMERATE_STOP : LIST_ENUMERATE_CONTINUE;
+}
+
+static int
+FutexRemoveTopQueue(
+    _In_ int        Index,
+    _In_ element_t* Element,
+    _In_ void*      Context)
+{
+    FutexTopContext_t* Top = (FutexTopContext_t*)Context;
+    _CRT_UNUSED(Index);
+
+    if (SchedulerObjectGetQueue((SchedulerObject_t*)Element->value) <= Top->Queue) {
+        Top->Element = Element;
+        return LIST_ENUMERATE_STOP | LIST_ENUMERATE_REMOVE;
+    }
+    return LIST_ENUMERATE_CONTINUE;
+}
+
+/* FutexGetTopBlocked
+ * Removes and returns the waiter to wake, waiters are woken by priority and waiters of the
+ * same priority in the order they blocked. Blocking and timeouts modify the queue under the
+ * list lock only, so the waiter is found and removed under that lock. The first pass only
+ * finds the top priority, the second removes the first waiter at or above it, which is still
+ * correct if the queue changed in between. Must be called with the futex lock held. */
+static element_t*
+FutexGetTopBlocked(
+    _In_ FutexItem_t* FutexItem)
+{
+    FutexTopContext_t Top = { SCHEDULER_LEVEL_COUNT, NULL };
+
+    while (!Top.Element && list_count(&FutexItem->BlockQueue)) {
+        Top.Queue = SCHEDULER_LEVEL_COUNT;
+        list_enumerate(&FutexItem->BlockQueue, FutexFindTopQueue, &Top);
+        list_enumerate(&FutexItem->BlockQueue, FutexRemoveTopQueue, &Top);
+    }
+    return Top.Element;
+}
+
 OsStatus_t
 FutexWake(
     _In_ _Atomic(int)* Futex,
     _In_ int           Count,
     _In_ int           Flags)
 {
-    SystemMemorySpaceContext_t* Context = NULL;
-    FutexBucket_t*     Bucket;
-    FutexItem_t*       FutexItem;
-    OsStatus_t         Status = OsDoesNotExist;
-    uintptr_t          FutexAddress;
-    int                WaiterCount;
-    int                i;
+    FutexItem_t* FutexItem;
+    FutexKey_t   Key;
+    OsStatus_t   Status;
+    int          WaiterCount;
+    int          i;
     
-    // Get the futex context, if the context is private
-    // we can stick to the virtual address for sleeping
-    // otherwise we need to lookup the physical page
-    if (Flags & FUTEX_WAKE_PRIVATE) {
-        Context = GetCurrentMemorySpace()->Context;
-        FutexAddress = (uintptr_t)Futex;
+    Status = FutexGetKey(Futex, Flags & FUTEX_WAKE_PRIVATE, &Key);
+    if (Status != OsSuccess) {
+        return Status;
     }
-    else {
-        if (GetMemorySpaceMapping(GetCurrentMemorySpace(), (uintptr_t)Futex, 
-                1, &FutexAddress) != OsSuccess) {
-            return OsDoesNotExist;
-        }
-    }
-    
-    Bucket = FutexGetBucket(FutexAddress);
     
-    spinlock_acquire(&Bucket->SyncObject);
-    FutexItem = FutexGetNode(Bucket, FutexAddress, Context);
-    spinlock_release(&Bucket->SyncObject);
+    FutexItem = FutexGetItem(&Key, 0);
     if (!FutexItem) {
         return OsDoesNotExist;
     }
     
+    Status      = OsDoesNotExist;
     WaiterCount = atomic_load(&FutexItem->Waiters);
     
 WakeWaiters:
     for (i = 0; i < Count; i++) {
         element_t* Front;
         
-        spinlock_acquire(&FutexItem->BlockQueueSyncObject);
-        Front = list_front(&FutexItem->BlockQueue);
-        if (Front) {
-            // This is only neccessary while the list itself is thread-safe
-            // otherwise we need a new list structure that can be shared including
-            // a lock.
-            if (list_remove(&FutexItem->BlockQueue, Front)) {
-                Front = NULL;
-            }
-        }
-        spinlock_release(&FutexItem->BlockQueueSyncObject);
+        IrqSpinlockAcquire(&FutexItem->BlockQueueSyncObject);
+        Front = FutexGetTopBlocked(FutexItem);
+        IrqSpinlockRelease(&FutexItem->BlockQueueSyncObject);
         
         if (Front) {
             Status = SchedulerQueueObject(Front->value);
@@ -442,6 +538,272 @@ WakeWaiters:
     return Status;
 }
 
+// Must be called with the futex lock held
+static FutexPiWaiter_t*
+FutexPiGetTopWaiter(
+    _In_  FutexItem_t* FutexItem,
+    _Out_ int*         QueueOut)
+{
+    FutexPiWaiter_t* TopWaiter = NULL;
+    int              TopQueue  = SCHEDULER_LEVEL_COUNT;
+
+    foreach(i, &FutexItem->PiWaiters) {
+        FutexPiWaiter_t* Waiter = (FutexPiWaiter_t*)i->value;
+        int              Queue  = SchedulerObjectGetQueue(Waiter->Thread->SchedulerObject);
+        if (Queue < TopQueue) {
+            TopWaiter = Waiter;
+            TopQueue  = Queue;
+        }
+    }
+
+    if (QueueOut) {
+        *QueueOut = TopQueue;
+    }
+    return TopWaiter;
+}
+
+/* FutexPiGetOwner
+ * The futex holds the id of the owner, the item keeps a handle reference to the thread
+ * so it can't be destroyed while it is boosted, and so the handle lookup is only done when
+ * the owner changes. An owner that has exited is not returned. The reference that was kept
+ * for the previous owner is returned in Stale and must be released once the lock is
+ * dropped. Must be called with the futex lock held. */
+static MCoreThread_t*
+FutexPiGetOwner(
+    _In_  FutexItem_t* FutexItem,
+    _In_  UUId_t       Owner,
+    _Out_ UUId_t*      Stale)
+{
+    MCoreThread_t* Thread = NULL;
+
+    if (FutexItem->PiOwner != Owner) {
+        if (FutexItem->PiOwner != UUID_INVALID) {
+            *Stale = FutexItem->PiOwner;
+        }
+
+        // The id comes from the futex, so it can be any handle
+        if (LookupHandleOfType(Owner, HandleTypeThread) != NULL) {
+            Thread = (MCoreThread_t*)AcquireHandle(Owner);
+        }
+        FutexItem->PiOwner       = (Thread != NULL) ? Owner : UUID_INVALID;
+        FutexItem->PiOwnerThread = Thread;
+    }
+
+    Thread = FutexItem->PiOwnerThread;
+    if (Thread == NULL || atomic_load(&Thread->Cleanup) || !Thread->SchedulerObject) {
+        return NULL;
+    }
+    return Thread;
+}
+
+/* FutexPiReleaseOwner
+ * Drops the reference to the owner when the futex changes hands in the kernel. Must be
+ * called with the futex lock held, and Stale released once the lock is dropped. */
+static void
+FutexPiReleaseOwner(
+    _In_  FutexItem_t* FutexItem,
+    _Out_ UUId_t*      Stale)
+{
+    *Stale                   = FutexItem->PiOwner;
+    FutexItem->PiOwner       = UUID_INVALID;
+    FutexItem->PiOwnerThread = NULL;
+}
+
+OsStatus_t
+FutexLockPi(
+    _In_ _Atomic(int)* Futex,
+    _In_ int           Flags,
+    _In_ size_t        Timeout)
+{
+    MCoreThread_t*  Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    MCoreThread_t*  Owner;
+    FutexItem_t*    FutexItem;
+    FutexPiWaiter_t Waiter;
+    FutexKey_t      Key;
+    IntStatus_t     CpuState;
+    OsStatus_t      Status;
+    UUId_t          Stale = UUID_INVALID;
+    int             ThreadId;
+    int             Value;
+    int             Queue;
+    TRACE("%u: FutexLockPi(f 0x%llx, t %u)", GetCurrentThreadId(), Futex, Timeout);
+
+    if (!Thread || !Thread->SchedulerObject) {
+        return OsNotSupported;
+    }
+    ThreadId = (int)(Thread->Handle & FUTEX_PI_OWNER_MASK);
+
+    Status = FutexGetKey(Futex, Flags & FUTEX_WAIT_PRIVATE, &Key);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    FutexItem = FutexGetItem(&Key, 1);
+    if (!FutexItem) {
+        return OsOutOfMemory;
+    }
+
+    ELEMENT_INIT(&Waiter.Header, 0, &Waiter);
+    list_construct(&Waiter.BlockQueue);
+    Waiter.Thread = Thread;
+
+    CpuState = InterruptDisable();
+    IrqSpinlockAcquire(&FutexItem->BlockQueueSyncObject);
+    while (1) {
+        Value = atomic_load(Futex);
+        if (!(Value & FUTEX_PI_OWNER_MASK)) {
+            // Keep the waiter bit, there can be waiters that timed out of the handoff
+            if (atomic_compare_exchange_strong(Futex, &Value, ThreadId | (Value & FUTEX_PI_WAITERS))) {
+                Status = OsSuccess;
+                break;
+            }
+            continue;
+        }
+
+        if ((Value & FUTEX_PI_OWNER_MASK) == ThreadId) {
+            Status = OsBusy;
+            break;
+        }
+
+        // The owner must enter the kernel when it unlocks
+        if (!(Value & FUTEX_PI_WAITERS) &&
+            !atomic_compare_exchange_strong(Futex, &Value, Value | FUTEX_PI_WAITERS)) {
+            continue;
+        }
+
+        // An owner that exited without unlocking leaves the futex to us
+        Owner = FutexPiGetOwner(FutexItem, (UUId_t)(Value & FUTEX_PI_OWNER_MASK), &Stale);
+        if (!Owner) {
+            Value |= FUTEX_PI_WAITERS;
+            if (atomic_compare_exchange_strong(Futex, &Value, ThreadId |
+                    (list_count(&FutexItem->PiWaiters) ? FUTEX_PI_WAITERS : 0))) {
+                Status = OsSuccess;
+                break;
+            }
+            continue;
+        }
+
+        // Lend our queue to the owner if it runs at a lower priority
+        Queue = SchedulerObjectGetQueue(Thread->SchedulerObject);
+        if (Queue < SchedulerObjectGetQueue(Owner->SchedulerObject)) {
+            SchedulerObjectInheritQueue(Owner->SchedulerObject, Queue);
+        }
+
+        list_append(&FutexItem->PiWaiters, &Waiter.Header);
+        SchedulerBlock(&Waiter.BlockQueue, (uint64_t)Timeout * NSEC_PER_MSEC);
+        IrqSpinlockRelease(&FutexItem->BlockQueueSyncObject);
+        InterruptRestoreState(CpuState);
+        if (Stale != UUID_INVALID) {
+            DestroyHandle(Stale);
+            Stale = UUID_INVALID;
+        }
+        ThreadingYield();
+
+        // The unlocking thread writes our id before waking us up, but we might have timed out
+        // right as the futex was handed over, so the futex decides whether we own it
+        CpuState = InterruptDisable();
+        IrqSpinlockAcquire(&FutexItem->BlockQueueSyncObject);
+        (void)list_remove(&FutexItem->PiWaiters, &Waiter.Header);
+        if ((atomic_load(Futex) & FUTEX_PI_OWNER_MASK) == ThreadId) {
+            Status = OsSuccess;
+            break;
+        }
+
+        Status = SchedulerGetTimeoutReason();
+        if (Status != OsSuccess) {
+            // The owner must not keep the queue of a waiter that left
+            Owner = FutexPiGetOwner(FutexItem, (UUId_t)(atomic_load(Futex) & FUTEX_PI_OWNER_MASK), &Stale);
+            if (Owner) {
+                (void)FutexPiGetTopWaiter(FutexItem, &Queue);
+                SchedulerObjectInheritQueue(Owner->SchedulerObject, Queue);
+            }
+            break;
+        }
+    }
+    IrqSpinlockRelease(&FutexItem->BlockQueueSyncObject);
+    InterruptRestoreState(CpuState);
+    if (Stale != UUID_INVALID) {
+        DestroyHandle(Stale);
+    }
+    TRACE("%u: FutexLockPi => %u", GetCurrentThreadId(), Status);
+    return Status;
+}
+
+OsStatus_t
+FutexUnlockPi(
+    _In_ _Atomic(int)* Futex,
+    _In_ int           Flags)
+{
+    MCoreThread_t*     Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    SchedulerObject_t* NewOwner = NULL;
+    FutexPiWaiter_t*   Waiter;
+    FutexItem_t*       FutexItem;
+    FutexKey_t         Key;
+    IntStatus_t        CpuState;
+    OsStatus_t         Status;
+    element_t*         Front;
+    UUId_t             Stale;
+    int                ThreadId;
+    int                Value;
+    int                Queue;
+    TRACE("%u: FutexUnlockPi(f 0x%llx)", GetCurrentThreadId(), Futex);
+
+    if (!Thread || !Thread->SchedulerObject) {
+        return OsNotSupported;
+    }
+    ThreadId = (int)(Thread->Handle & FUTEX_PI_OWNER_MASK);
+
+    Value = atomic_load(Futex);
+    if ((Value & FUTEX_PI_OWNER_MASK) != ThreadId) {
+        return OsInvalidPermissions;
+    }
+
+    Status = FutexGetKey(Futex, Flags & FUTEX_WAKE_PRIVATE, &Key);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    // Nobody has ever waited for the futex
+    FutexItem = FutexGetItem(&Key, 0);
+    if (!FutexItem) {
+        atomic_store(Futex, 0);
+        return OsSuccess;
+    }
+
+    CpuState = InterruptDisable();
+    IrqSpinlockAcquire(&FutexItem->BlockQueueSyncObject);
+    Waiter = FutexPiGetTopWaiter(FutexItem, NULL);
+    if (Waiter) {
+        (void)list_remove(&FutexItem->PiWaiters, &Waiter->Header);
+        (void)FutexPiGetTopWaiter(FutexItem, &Queue);
+        atomic_store(Futex, (int)(Waiter->Thread->Handle & FUTEX_PI_OWNER_MASK) |
+            (list_count(&FutexItem->PiWaiters) ? FUTEX_PI_WAITERS : 0));
+
+        // The new owner inherits from the waiters that are left
+        SchedulerObjectInheritQueue(Waiter->Thread->SchedulerObject, Queue);
+        Front = list_front(&Waiter->BlockQueue);
+        if (Front && !list_remove(&Waiter->BlockQueue, Front)) {
+            NewOwner = (SchedulerObject_t*)Front->value;
+        }
+    }
+    else {
+        atomic_store(Futex, 0);
+    }
+    SchedulerObjectInheritQueue(Thread->SchedulerObject, SCHEDULER_LEVEL_COUNT);
+    FutexPiReleaseOwner(FutexItem, &Stale);
+    IrqSpinlockRelease(&FutexItem->BlockQueueSyncObject);
+    InterruptRestoreState(CpuState);
+    if (Stale != UUID_INVALID) {
+        DestroyHandle(Stale);
+    }
+
+    // The waiter has left the block queue already if it timed out
+    if (NewOwner) {
+        (void)SchedulerQueueObject(NewOwner);
+    }
+    return OsSuccess;
+}
+
 OsStatus_t
 FutexWakeOperation(
     _In_ _Atomic(int)* Futex,
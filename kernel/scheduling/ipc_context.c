@@ -30,6 +30,7 @@
 #include <handle_set.h>
 #include <heap.h>
 #include <ipc_context.h>
+#include <memory_grant.h>
 #include <memoryspace.h>
 #include <memory_region.h>
 #include <string.h>
@@ -137,25 +138,25 @@ AllocateMessage(
     return OsSuccess;
 }
 
+/* MapUntypedParameter
+ * Grants the receiver read-only access to the buffer. Grants are cached between the sender
+ * and receiver, so buffers that are reused for every call (like io buffers) are only
+ * mapped the first time. */
 static OsStatus_t
 MapUntypedParameter(
     _In_ struct ipmsg_param*  Parameter,
     _In_ SystemMemorySpace_t* TargetMemorySpace)
 {
-    VirtualAddress_t CopyAddress;
-    size_t     OffsetInPage = Parameter->data.value % GetMemorySpacePageSize();
-    OsStatus_t Status       = CloneMemorySpaceMapping(
-        GetCurrentMemorySpace(), TargetMemorySpace,
-        (VirtualAddress_t)Parameter->data.buffer, &CopyAddress, Parameter->length + OffsetInPage,
-        MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_READONLY | MAPPING_PERSISTENT,
-        MAPPING_VIRTUAL_PROCESS);
+    VirtualAddress_t GrantAddress;
+    OsStatus_t       Status = MemoryGrantAcquire(GetCurrentMemorySpace(), TargetMemorySpace,
+        (VirtualAddress_t)Parameter->data.buffer, Parameter->length, &GrantAddress);
     if (Status != OsSuccess) {
-        ERROR("[ipc] [map_untyped] Failed to clone ipc mapping");
+        ERROR("[ipc] [map_untyped] Failed to grant ipc mapping");
         return Status;
     }
     
     // Update buffer pointer in untyped argument
-    Parameter->data.buffer = (void*)(CopyAddress + OffsetInPage);
+    Parameter->data.buffer = (void*)GrantAddress;
     smp_wmb();
     
     return OsSuccess;
@@ -224,15 +225,12 @@ CleanupMessage(
     int i;
     TRACE("CleanupMessage(0x%llx)", Message);
 
-    // Flush all the mappings granted in the argument phase
+    // Release all the mappings granted in the argument phase
     for (i = 0; i < Message->base.param_in; i++) {
         if (Message->base.params[i].type == IPMSG_PARAM_SHM) {
-            OsStatus_t Status = MemorySpaceUnmap(GetCurrentMemorySpace(),
+            MemoryGrantRelease(GetCurrentMemorySpace(),
                 (VirtualAddress_t)Message->base.params[i].data.buffer,
                 Message->base.params[i].length);
-            if (Status != OsSuccess) {
-                // LOG
-            }
         }
     }
 }
@@ -347,17 +345,22 @@ IpcContextRespondMultiple(
     _In_ struct ipmsg_base** messageDescriptors,
     _In_ int                 messageCount)
 {
-    int i;
+    MemorySpaceShootdown_t Shootdown;
+    int                    i;
     
     if (!messages || !messageDescriptors || !messageCount) {
         return OsInvalidParameters;
     }
     
+    // Tearing down the argument mappings of all the messages is sent to the
+    // other cores as a single shootdown
+    MemorySpaceShootdownBegin(&Shootdown);
     for (i = 0; i < messageCount; i++) {
         if (WriteFullResponse(messages[i], messageDescriptors[i]) != OsSuccess) {
             WARNING("[ipc] [respond] failed to write response");
         }
         CleanupMessage(messages[i]);
     }
+    MemorySpaceShootdownEnd(&Shootdown);
     return OsSuccess;
 }
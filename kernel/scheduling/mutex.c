@@ -23,7 +23,10 @@
  */
 #define __MODULE "MUTX"
 
+#include <arch/interrupts.h>
+#include <arch/utils.h>
 #include <assert.h>
+#include <component/cpu.h>
 #include <ddk/barrier.h>
 #include <debug.h>
 #include <futex.h>
@@ -31,9 +34,131 @@
 #include <machine.h>
 #include <mutex.h>
 #include <scheduler.h>
+#include <threading.h>
 
 #define MUTEX_SPINS 1000
 
+#define MUTEX_SPIN_WAITING 0
+#define MUTEX_SPIN_HEAD    1    // First in the queue, spins on the mutex
+#define MUTEX_SPIN_ABORT   2    // Spinning was given up, leave and pass it on
+
+typedef struct MutexSpinNode {
+    _Atomic(struct MutexSpinNode*) Next;
+    _Atomic(int)                   State;
+} MutexSpinNode_t;
+
+// Priority inheritance mutexes hold the id of the owner, so the kernel knows who to boost
+static inline int
+GetLockedValue(
+    _In_ Mutex_t* Mutex)
+{
+    if (Mutex->Flags & MUTEX_INHERIT) {
+        return (int)(GetCurrentThreadId() & FUTEX_PI_OWNER_MASK);
+    }
+    return 1;
+}
+
+static inline int
+HasWaiters(
+    _In_ Mutex_t* Mutex,
+    _In_ int      Value)
+{
+    if (Mutex->Flags & MUTEX_INHERIT) {
+        return (Value & FUTEX_PI_WAITERS) ? 1 : 0;
+    }
+    return Value == 2;
+}
+
+static inline void
+SetOwner(
+    _In_ Mutex_t* Mutex)
+{
+    Mutex->Owner       = GetCurrentThreadId();
+    Mutex->OwnerThread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    atomic_store(&Mutex->References, 1);
+}
+
+// A thread that is running is the current thread of a core. The owner is only compared,
+// never accessed, as it may exit while we look.
+static int
+IsThreadRunning(
+    _In_ MCoreThread_t* Thread)
+{
+    SystemCpuCore_t* Core = GetMachine()->Processor.Cores;
+
+    // The owner has taken the mutex but not stored itself yet
+    if (Thread == NULL) {
+        return 1;
+    }
+
+    while (Core != NULL) {
+        if (READ_VOLATILE(Core->CurrentThread) == Thread) {
+            return 1;
+        }
+        Core = Core->Link;
+    }
+    return 0;
+}
+
+/* MutexSpin
+ * Spins for the mutex while the owner is running on another core, as it is then likely to
+ * release the mutex soon. Spinners queue up, so only the first spins on the mutex while the
+ * others spin on their own node, which keeps the mutex from bouncing between the caches. A
+ * queued spinner that was preempted would stall the spinners behind it, so interrupts are
+ * disabled while queued, which also limits the queue to a spinner per core. */
+static OsStatus_t
+MutexSpin(
+    _In_ Mutex_t* Mutex)
+{
+    MutexSpinNode_t  Node;
+    MutexSpinNode_t* Self   = &Node;
+    MutexSpinNode_t* Previous;
+    MutexSpinNode_t* Next;
+    IntStatus_t      CpuState;
+    OsStatus_t       Status = OsBusy;
+    int              State  = MUTEX_SPIN_HEAD;
+    int              Value;
+    int              i;
+
+    atomic_store(&Node.Next, NULL);
+    atomic_store(&Node.State, MUTEX_SPIN_WAITING);
+
+    CpuState = InterruptDisable();
+    Previous = atomic_exchange(&Mutex->SpinTail, &Node);
+    if (Previous != NULL) {
+        atomic_store(&Previous->Next, &Node);
+        while ((State = atomic_load(&Node.State)) == MUTEX_SPIN_WAITING);
+    }
+
+    if (State == MUTEX_SPIN_HEAD) {
+        for (i = 0; i < MUTEX_SPINS; i++) {
+            Value = atomic_load(&Mutex->Value);
+            if (Value == 0) {
+                if (atomic_compare_exchange_strong(&Mutex->Value, &Value, GetLockedValue(Mutex))) {
+                    Status = OsSuccess;
+                    break;
+                }
+                continue;
+            }
+
+            // Don't take the mutex from sleeping waiters, and an owner that isn't running
+            // won't release it any time soon
+            if (HasWaiters(Mutex, Value) || !IsThreadRunning(READ_VOLATILE(Mutex->OwnerThread))) {
+                break;
+            }
+        }
+    }
+
+    // The next spinner spins for the next release if we got the mutex, otherwise
+    // the reason we gave up applies to it as well
+    if (!atomic_compare_exchange_strong(&Mutex->SpinTail, &Self, NULL)) {
+        while ((Next = atomic_load(&Node.Next)) == NULL);
+        atomic_store(&Next->State, (Status == OsSuccess) ? MUTEX_SPIN_HEAD : MUTEX_SPIN_ABORT);
+    }
+    InterruptRestoreState(CpuState);
+    return Status;
+}
+
 void
 MutexConstruct(
     _In_ Mutex_t* Mutex,
@@ -41,10 +166,12 @@ MutexConstruct(
 {
     assert(Mutex != NULL);
     
-    Mutex->Owner      = UUID_INVALID;
-    Mutex->Flags      = Configuration;
-    Mutex->References = ATOMIC_VAR_INIT(0);
-    Mutex->Value      = ATOMIC_VAR_INIT(0);
+    Mutex->Owner       = UUID_INVALID;
+    Mutex->Flags       = Configuration;
+    Mutex->References  = ATOMIC_VAR_INIT(0);
+    Mutex->Value       = ATOMIC_VAR_INIT(0);
+    Mutex->OwnerThread = NULL;
+    Mutex->SpinTail    = ATOMIC_VAR_INIT(NULL);
     smp_wmb();
 }
 
@@ -86,10 +213,9 @@ MutexTryLock(
         }
     }
     
-    Status = atomic_compare_exchange_strong(&Mutex->Value, &Zero, 1);
+    Status = atomic_compare_exchange_strong(&Mutex->Value, &Zero, GetLockedValue(Mutex));
     if (Status) {
-        Mutex->Owner = GetCurrentThreadId();
-        atomic_store(&Mutex->References, 1);
+        SetOwner(Mutex);
         return OsSuccess;
     }
     return OsError;
@@ -103,7 +229,6 @@ __MutexPerformLock(
     int Status;
     int Zero = 0;
     int Count;
-    int i;
     
     // If this thread already holds the mutex,
     // increase ref count, but only if we're recursive 
@@ -124,35 +249,38 @@ __MutexPerformLock(
     }
     
     // On multicore systems the lock might be released rather quickly
-    // so we perform a number of initial spins before going to sleep,
-    // and only in the case that there are no sleepers && locked
-    Status = atomic_compare_exchange_strong(&Mutex->Value, &Zero, 1);
+    // so we spin before going to sleep, as long as the owner is running
+    // and there are no sleepers
+    Status = atomic_compare_exchange_strong(&Mutex->Value, &Zero, GetLockedValue(Mutex));
     if (!Status) {
-        if (atomic_load(&GetMachine()->NumberOfActiveCores) > 1) {
-            for (i = 0; i < MUTEX_SPINS; i++) {
-                if (MutexTryLock(Mutex) == OsSuccess) {
-                    return OsSuccess;
-                }
+        if (atomic_load(&GetMachine()->NumberOfActiveCores) > 1 && !HasWaiters(Mutex, Zero) &&
+            MutexSpin(Mutex) == OsSuccess) {
+            SetOwner(Mutex);
+            return OsSuccess;
+        }
+        
+        // The kernel hands priority inheritance mutexes to the waiter
+        if (Mutex->Flags & MUTEX_INHERIT) {
+            Status = FutexLockPi(&Mutex->Value, FUTEX_WAIT_PRIVATE, Timeout);
+            if (Status != OsSuccess) {
+                return Status;
             }
+            SetOwner(Mutex);
+            return OsSuccess;
         }
         
         // Loop untill we get the lock
-        if (Zero != 0) {
-            if (Zero != 2) {
-                Zero = atomic_exchange(&Mutex->Value, 2);
-            }
-            while (Zero != 0) {
-                Status = FutexWait(&Mutex->Value, 2, FUTEX_WAIT_PRIVATE, Timeout);
-                if (Status != OsSuccess) {
-                    return Status;
-                }
-                Zero = atomic_exchange(&Mutex->Value, 2);
+        Zero = atomic_exchange(&Mutex->Value, 2);
+        while (Zero != 0) {
+            Status = FutexWait(&Mutex->Value, 2, FUTEX_WAIT_PRIVATE, Timeout);
+            if (Status != OsSuccess && Status != OsError) {
+                return Status;
             }
+            Zero = atomic_exchange(&Mutex->Value, 2);
         }
     }
     
-    Mutex->Owner = GetCurrentThreadId();
-    atomic_store(&Mutex->References, 1);
+    SetOwner(Mutex);
     return OsSuccess;
 }
 
@@ -194,7 +322,16 @@ MutexUnlock(
     
     Count = atomic_fetch_sub(&Mutex->References, 1);
     if ((Count - 1) == 0) {
-        Mutex->Owner = UUID_INVALID;
+        Mutex->Owner       = UUID_INVALID;
+        Mutex->OwnerThread = NULL;
+        
+        if (Mutex->Flags & MUTEX_INHERIT) {
+            Count = GetLockedValue(Mutex);
+            if (!atomic_compare_exchange_strong(&Mutex->Value, &Count, 0)) {
+                (void)FutexUnlockPi(&Mutex->Value, FUTEX_WAKE_PRIVATE);
+            }
+            return;
+        }
         
         Count = atomic_fetch_sub(&Mutex->Value, 1);
         if (Count != 1) {
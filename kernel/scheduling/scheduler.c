@@ -59,13 +59,16 @@ typedef struct SchedulerObject {
     Flags_t                 Flags;
     UUId_t                  CoreId;
     size_t                  TimeSlice;
-    size_t                  TimeSliceLeft;
+    uint64_t                TimeSliceLeft;
     int                     Queue;
+    _Atomic(int)            InheritedQueue; // Queue lent by priority inheritance
     struct SchedulerObject* Link;
     void*                   Object;
     
     list_t*                 WaitQueueHandle;
-    size_t                  TimeLeft;
+    uint64_t                TimeLeft;
+    uint64_t                Deadline;
+    uint64_t                Slack;
     OsStatus_t              TimeoutReason;
     clock_t                 InterruptedAt;
 } SchedulerObject_t;
@@ -220,6 +223,47 @@ RemoveFromQueue(
     return OsDoesNotExist;
 }
 
+// The sleep queue is sorted by deadline, objects with equal deadlines keep their order
+static void
+InsertIntoSleepQueue(
+    _In_ SystemScheduler_t* Scheduler,
+    _In_ SchedulerObject_t* Object)
+{
+    SchedulerObject_t* Current  = Scheduler->SleepQueue.Head;
+    SchedulerObject_t* Previous = NULL;
+
+    while (Current && Current->Deadline <= Object->Deadline) {
+        Previous = Current;
+        Current  = Current->Link;
+    }
+
+    Object->Link = Current;
+    if (Previous == NULL) Scheduler->SleepQueue.Head = Object;
+    else                  Previous->Link             = Object;
+    if (Current == NULL)  Scheduler->SleepQueue.Tail = Object;
+}
+
+static int
+HasQueuedObjects(
+    _In_ SystemScheduler_t* Scheduler)
+{
+    int i;
+    for (i = 0; i < SCHEDULER_LEVEL_COUNT; i++) {
+        if (Scheduler->Queues[i].Head != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The object runs at the inherited queue while it is a higher priority than its own
+static inline int
+GetObjectQueue(
+    _In_ SchedulerObject_t* Object)
+{
+    return MIN(Object->Queue, atomic_load(&Object->InheritedQueue));
+}
+
 static void
 QueueForScheduler(
     _In_ SystemScheduler_t* Scheduler,
@@ -240,7 +284,7 @@ QueueForScheduler(
     if (ResultState == STATE_INVALID) {
         FATAL(FATAL_SCOPE_KERNEL, "[scheduler] [queue] object was NOT in correct state for queueing");
     }
-    AppendToQueue(&Scheduler->Queues[Object->Queue], Object, Object);
+    AppendToQueue(&Scheduler->Queues[GetObjectQueue(Object)], Object, Object);
 }
 
 static void
@@ -250,7 +294,9 @@ QueueOnCoreFunction(
     SystemScheduler_t* Scheduler = &GetCurrentProcessorCore()->Scheduler;
     SchedulerObject_t* Object    = (SchedulerObject_t*)Context;
     QueueForScheduler(Scheduler, Object, 1);
-    if (ThreadingIsCurrentTaskIdle(Object->CoreId)) {
+    
+    // A core running a single object has no timer armed for its time-slice
+    if (ThreadingIsCurrentTaskIdle(Object->CoreId) || Scheduler->Tickless) {
         ThreadingYield();
     }
 }
@@ -267,7 +313,7 @@ QueueObjectImmediately(
         IrqSpinlockAcquire(&Core->Scheduler.SyncObject);
         QueueForScheduler(&Core->Scheduler, Object, 1);
         IrqSpinlockRelease(&Core->Scheduler.SyncObject);
-        if (ThreadingIsCurrentTaskIdle(Core->Id)) {
+        if (ThreadingIsCurrentTaskIdle(Core->Id) || Core->Scheduler.Tickless) {
             ThreadingYield();
         }
         return OsSuccess;
@@ -277,6 +323,34 @@ QueueObjectImmediately(
     }
 }
 
+// Moves a queued object to the queue it inherited, must run on the core of the object
+static void
+PromoteForScheduler(
+    _In_ SystemScheduler_t* Scheduler,
+    _In_ SchedulerObject_t* Object)
+{
+    int Queue = GetObjectQueue(Object);
+    int i;
+
+    if (atomic_load(&Object->State) != STATE_QUEUED) {
+        return;
+    }
+
+    for (i = Queue + 1; i < SCHEDULER_LEVEL_COUNT; i++) {
+        if (RemoveFromQueue(&Scheduler->Queues[i], Object) == OsSuccess) {
+            AppendToQueue(&Scheduler->Queues[Queue], Object, Object);
+            break;
+        }
+    }
+}
+
+static void
+PromoteOnCoreFunction(
+    _In_ void* Context)
+{
+    PromoteForScheduler(&GetCurrentProcessorCore()->Scheduler, (SchedulerObject_t*)Context);
+}
+
 static void
 AllocateScheduler(
     _In_ SchedulerObject_t* Object)
@@ -338,8 +412,9 @@ SchedulerCreateObject(
     
     memset(Object, 0, sizeof(SchedulerObject_t));
     ELEMENT_INIT(&Object->Header, 0, Object);
-    Object->State  = ATOMIC_VAR_INIT(STATE_INITIAL);
-    Object->Object = Payload;
+    Object->State          = ATOMIC_VAR_INIT(STATE_INITIAL);
+    Object->InheritedQueue = ATOMIC_VAR_INIT(SCHEDULER_LEVEL_COUNT);
+    Object->Object         = Payload;
 
     if (Flags & THREADING_IDLE) {
         Object->Queue      = SCHEDULER_LEVEL_LOW;
@@ -355,7 +430,7 @@ SchedulerCreateObject(
         smp_mb();
     }
     
-    Object->TimeSliceLeft = Object->TimeSlice;
+    Object->TimeSliceLeft = (uint64_t)Object->TimeSlice * NSEC_PER_MSEC;
     return Object;
 }
 
@@ -375,21 +450,21 @@ SchedulerDestroyObject(
 
 int
 SchedulerSleep(
-    _In_  size_t   Milliseconds,
+    _In_  uint64_t Nanoseconds,
     _Out_ clock_t* InterruptedAt)
 {
     SchedulerObject_t* Object;
     int                ResultState;
-    TRACE("[scheduler] [sleep] %" PRIuIN, Milliseconds);
+    TRACE("[scheduler] [sleep] %llu", Nanoseconds);
     
     Object = SchedulerGetCurrentObject(ArchGetProcessorCoreId());
     if (!Object) {
         // Called by the idle threads
-        ArchStallProcessorCore(Milliseconds);
+        ArchStallProcessorCore((size_t)DIVUP(Nanoseconds, NSEC_PER_MSEC));
         return SCHEDULER_SLEEP_OK;
     }
     
-    Object->TimeLeft        = Milliseconds;
+    Object->TimeLeft        = Nanoseconds;
     Object->TimeoutReason   = OsSuccess;
     Object->InterruptedAt   = 0;
     Object->WaitQueueHandle = NULL;
@@ -412,12 +487,12 @@ SchedulerSleep(
 
 void
 SchedulerBlock(
-    _In_ list_t* BlockQueue,
-    _In_ size_t  Timeout)
+    _In_ list_t*  BlockQueue,
+    _In_ uint64_t Timeout)
 {
     SchedulerObject_t* Object;
     int                ResultState;
-    TRACE("[scheduler] [block] %" PRIuIN, Timeout);
+    TRACE("[scheduler] [block] %llu", Timeout);
     
     Object = SchedulerGetCurrentObject(ArchGetProcessorCoreId());
     assert(Object != NULL);
@@ -496,7 +571,40 @@ SchedulerObjectGetQueue(
     assert(Object != NULL);
     
     smp_rmb();
-    return Object->Queue;
+    return GetObjectQueue(Object);
+}
+
+void
+SchedulerObjectInheritQueue(
+    _In_ SchedulerObject_t* Object,
+    _In_ int                Queue)
+{
+    SystemCpuCore_t* Core;
+
+    assert(Object != NULL);
+
+    if (Queue < 0 || Queue > SCHEDULER_LEVEL_COUNT) {
+        Queue = SCHEDULER_LEVEL_COUNT;
+    }
+    atomic_store(&Object->InheritedQueue, Queue);
+
+    // A running or blocked object picks up the queue the next time it is queued, but
+    // a queued object must be moved, otherwise it can wait behind the objects that
+    // keep the waiters from running
+    smp_rmb();
+    if (Queue >= Object->Queue || atomic_load(&Object->State) != STATE_QUEUED) {
+        return;
+    }
+
+    Core = GetCurrentProcessorCore();
+    if (Core->Id == Object->CoreId) {
+        IrqSpinlockAcquire(&Core->Scheduler.SyncObject);
+        PromoteForScheduler(&Core->Scheduler, Object);
+        IrqSpinlockRelease(&Core->Scheduler.SyncObject);
+    }
+    else {
+        (void)TxuMessageSend(Object->CoreId, CpuFunctionCustom, PromoteOnCoreFunction, Object, 1);
+    }
 }
 
 UUId_t
@@ -529,7 +637,7 @@ UpdatePressureForObject(
         
         Object->Queue         = NewPressureRank;
         Object->TimeSlice     = (NewPressureRank * 2) + SCHEDULER_TIMESLICE_INITIAL;
-        Object->TimeSliceLeft = Object->TimeSlice;
+        Object->TimeSliceLeft = (uint64_t)Object->TimeSlice * NSEC_PER_MSEC;
         atomic_fetch_add(&Scheduler->Bandwidth, Object->TimeSlice);
     }
 }
@@ -573,29 +681,30 @@ PerformObjectTimeout(
 // The sleep list is thread-safe due to the fact that the function that removes
 // from the sleep queue is only called on this core, while the function that adds
 // is also only called on this core, and the list here is only iterated on this core.
-static size_t
+// Returns the nanoseconds until the next wakeup, or UINT64_MAX if nothing is sleeping.
+static uint64_t
 SchedulerUpdateSleepQueue(
-    _In_ SystemScheduler_t* Scheduler,
-    _In_ SchedulerObject_t* IgnoreObject,
-    _In_ size_t             MillisecondsPassed)
+    _In_ SystemScheduler_t* Scheduler)
 {
-    size_t             NextUpdate = __MASK;
-    SchedulerObject_t* i          = Scheduler->SleepQueue.Head;
-    
-    while (i) {
-        if (i != IgnoreObject && i->TimeLeft) {
-            i->TimeLeft -= MIN(i->TimeLeft, MillisecondsPassed);
-            if (!i->TimeLeft) {
-                PerformObjectTimeout(Scheduler, i);
-            }
+    uint64_t           NextWakeup = UINT64_MAX;
+    SchedulerObject_t* i;
+    
+    // The queue is sorted, so everything that has expired is at the head
+    while ((i = Scheduler->SleepQueue.Head) != NULL && i->Deadline <= Scheduler->Clock) {
+        Scheduler->SleepQueue.Head = i->Link;
+        if (Scheduler->SleepQueue.Tail == i) {
+            Scheduler->SleepQueue.Tail = NULL;
         }
-        
-        if (i->TimeLeft) {
-            NextUpdate = MIN(i->TimeLeft, NextUpdate);
-        }
-        i = i->Link;
+        i->Link = NULL;
+        PerformObjectTimeout(Scheduler, i);
     }
-    return NextUpdate;
+    
+    // Wake up as late as the slack of the sleepers allow, this lets sleeps that
+    // expire close to each other share the same timer interrupt
+    for (i = Scheduler->SleepQueue.Head; i != NULL && i->Deadline < NextWakeup; i = i->Link) {
+        NextWakeup = MIN(i->Deadline + i->Slack, NextWakeup);
+    }
+    return (NextWakeup == UINT64_MAX) ? UINT64_MAX : NextWakeup - Scheduler->Clock;
 }
 
 static void
@@ -629,7 +738,10 @@ HandleObjectRequeue(
             Object->Link, Scheduler->SleepQueue.Head, Scheduler->SleepQueue.Tail);
         // OK, so the we are blocking this object which means we won't be
         // queuing the object up again, should we track the sleep?
-        AppendToQueue(&Scheduler->SleepQueue, Object, Object);
+        Object->Deadline = Scheduler->Clock + Object->TimeLeft;
+        Object->Slack    = MAX(SCHEDULER_SLACK_MIN, MIN(SCHEDULER_SLACK_MAX,
+            Object->TimeLeft >> SCHEDULER_SLACK_SHIFT));
+        InsertIntoSleepQueue(Scheduler, Object);
     }
 }
 
@@ -637,52 +749,83 @@ void*
 SchedulerAdvance(
     _In_  SchedulerObject_t* Object,
     _In_  int                Preemptive,
-    _In_  size_t             MillisecondsPassed,
-    _Out_ size_t*            NextDeadlineOut)
+    _In_  uint64_t           NanosecondsPassed,
+    _Out_ uint64_t*          NextDeadlineOut)
 {
     SystemScheduler_t* Scheduler  = &GetCurrentProcessorCore()->Scheduler;
     SchedulerObject_t* NextObject = NULL;
     clock_t            CurrentClock;
-    size_t             NextDeadline;
+    uint64_t           NextDeadline;
     int                i;
-    TRACE("[scheduler] [advance] current 0x%llx, forced %i, ms-passed %llu",
-        Object, Preemptive, MillisecondsPassed);
+    TRACE("[scheduler] [advance] current 0x%llx, forced %i, ns-passed %llu",
+        Object, Preemptive, NanosecondsPassed);
     
     // Allow Object to be NULL but not NextDeadlineOut
     assert(NextDeadlineOut != NULL);
+    Scheduler->Clock += NanosecondsPassed;
     
     // In one case we can skip the whole requeue etc etc. This happens when there
-    // was a sleep event before the objects time-slice is out. Adjust and continue
-    if (Object != NULL && Preemptive && MillisecondsPassed < Object->TimeSliceLeft) {
+    // was a sleep event before the objects time-slice is out, or while the object was
+    // running alone without a time-slice. Adjust and continue
+    if (Object != NULL && Preemptive &&
+        (Scheduler->Tickless || NanosecondsPassed < Object->TimeSliceLeft)) {
         // Steps to take here is, adjusting the current time-slice,
-        // updating the sleep queue and returning the current task again
-        Object->TimeSliceLeft -= MillisecondsPassed;
-        NextDeadline           = SchedulerUpdateSleepQueue(Scheduler, NULL, MillisecondsPassed);
-        *NextDeadlineOut       = MIN(Object->TimeSliceLeft, NextDeadline);
-        TRACE("[scheduler] [advance] redeploy next deadline %llu", *NextDeadlineOut);
-        return Object->Object;
+        // updating the sleep queue and returning the current task again. The time-slice
+        // is also counted down while it is not armed
+        Object->TimeSliceLeft -= MIN(Object->TimeSliceLeft, NanosecondsPassed);
+        NextDeadline = SchedulerUpdateSleepQueue(Scheduler);
+
+        // If the sleep queue woke anything, then the time-slice must be armed again, and
+        // if the object has used it up already it is switched out right away
+        if (Scheduler->Tickless && HasQueuedObjects(Scheduler)) {
+            Scheduler->Tickless = 0;
+        }
+        if (Scheduler->Tickless || Object->TimeSliceLeft != 0) {
+            if (!Scheduler->Tickless) {
+                NextDeadline = MIN(Object->TimeSliceLeft, NextDeadline);
+            }
+            *NextDeadlineOut = (NextDeadline == UINT64_MAX) ? 0 : NextDeadline;
+            TRACE("[scheduler] [advance] redeploy next deadline %llu", *NextDeadlineOut);
+            return Object->Object;
+        }
     }
 
     // Handle the scheduled object first. The only times it's up to this function
     // to requeue immediately is if the thread was running. Otherwise it's because
     // we've been interrupted or blocked.
+    Scheduler->Tickless = 0;
     if (Object != NULL) {
         HandleObjectRequeue(Scheduler, Object, Preemptive);
     }
-    NextDeadline = SchedulerUpdateSleepQueue(Scheduler, Object, MillisecondsPassed);
+    NextDeadline = SchedulerUpdateSleepQueue(Scheduler);
 
     // Get next object
     for (i = 0; i < SCHEDULER_LEVEL_COUNT; i++) {
         if (Scheduler->Queues[i].Head != NULL) {
             NextObject = Scheduler->Queues[i].Head;
             RemoveFromQueue(&Scheduler->Queues[i], NextObject);
-            UpdatePressureForObject(Scheduler, NextObject, i);
-            NextDeadline = MIN(NextObject->TimeSlice, NextDeadline);
+
+            // An inherited queue is lent, it must not become the queue of the object
+            if (i != atomic_load(&NextObject->InheritedQueue)) {
+                UpdatePressureForObject(Scheduler, NextObject, i);
+            }
+            NextObject->TimeSliceLeft = (uint64_t)NextObject->TimeSlice * NSEC_PER_MSEC;
             ExecuteEvent(NextObject, EVENT_EXECUTE);
             break;
         }
     }
     
+    // There is no reason to interrupt an object that has nothing to compete with, so
+    // only the sleep queue decides the next deadline until something is queued
+    if (NextObject != NULL) {
+        if (HasQueuedObjects(Scheduler)) {
+            NextDeadline = MIN(NextObject->TimeSliceLeft, NextDeadline);
+        }
+        else {
+            Scheduler->Tickless = 1;
+        }
+    }
+    
     // Handle the boost timer as long as there are active objects running
     // if we run out of objects then boosting makes no sense
     if (NextObject != NULL) {
@@ -699,13 +842,13 @@ SchedulerAdvance(
                 Scheduler->LastBoost = CurrentClock;
             }
         }
-        *NextDeadlineOut = NextDeadline;
-        TRACE("[scheduler] [advance] next 0x%llx, deadline in %llu", NextObject, NextDeadline);
+        *NextDeadlineOut = (NextDeadline == UINT64_MAX) ? 0 : NextDeadline;
+        TRACE("[scheduler] [advance] next 0x%llx, deadline in %llu", NextObject, *NextDeadlineOut);
     }
     else {
         // Reset boost
         Scheduler->LastBoost = 0;
-        *NextDeadlineOut = (NextDeadline == __MASK) ? 0 : NextDeadline;
+        *NextDeadlineOut = (NextDeadline == UINT64_MAX) ? 0 : NextDeadline;
         TRACE("[scheduler] [advance] no next object, deadline in %llu", *NextDeadlineOut);
     }
     
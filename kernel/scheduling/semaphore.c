@@ -59,7 +59,7 @@ SemaphoreDestruct(
     if (!Semaphore) {
         return OsInvalidParameters;
     }
-    return FutexWake(&Semaphore->Value, INT_MAX, 0);
+    return FutexWake(&Semaphore->Value, INT_MAX, FUTEX_WAKE_PRIVATE);
 }
 
 OsStatus_t
@@ -73,7 +73,7 @@ SemaphoreWait(
     while (1) {
         Value = atomic_load(&(Semaphore->Value));
         while (Value < 1) {
-            Status = FutexWait(&(Semaphore->Value), Value, 0, Timeout);
+            Status = FutexWait(&(Semaphore->Value), Value, FUTEX_WAIT_PRIVATE, Timeout);
             if (Status != OsSuccess) {
                 break;
             }
@@ -113,7 +113,7 @@ SemaphoreSignal(
                     break;
                 }
             }
-            FutexWake(&Semaphore->Value, 1, 0);
+            FutexWake(&Semaphore->Value, 1, FUTEX_WAKE_PRIVATE);
         }
         Status = OsSuccess;
     }
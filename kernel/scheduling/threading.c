@@ -91,7 +91,7 @@ DestroyThread(
         int Timeout = 200;
         SemaphoreSignal(&Thread->EventObject, References + 1);
         while (Timeout > 0) {
-            SchedulerSleep(10, &Unused);
+            SchedulerSleep(10 * NSEC_PER_MSEC, &Unused);
             Timeout -= 10;
             
             References = atomic_load(&Thread->References);
@@ -539,9 +539,9 @@ DisplayActiveThreads(void)
 
 OsStatus_t
 ThreadingAdvance(
-    _In_  int     Preemptive,
-    _In_  size_t  MillisecondsPassed,
-    _Out_ size_t* NextDeadlineOut)
+    _In_  int       Preemptive,
+    _In_  uint64_t  NanosecondsPassed,
+    _Out_ uint64_t* NextDeadlineOut)
 {
     SystemCpuCore_t* Core    = GetCurrentProcessorCore();
     MCoreThread_t*   Current = Core->CurrentThread;
@@ -585,7 +585,7 @@ GetNextThread:
     // Advance the scheduler
     NextThread = (MCoreThread_t*)SchedulerAdvance((Current != NULL) ? 
         Current->SchedulerObject : NULL, Preemptive, 
-        MillisecondsPassed, NextDeadlineOut);
+        NanosecondsPassed, NextDeadlineOut);
     
     // Sanitize if we need to active our idle thread, otherwise
     // do a final check that we haven't just gotten ahold of a thread
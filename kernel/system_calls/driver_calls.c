@@ -34,8 +34,11 @@
 #include <modules/manager.h>
 #include <interrupts.h>
 #include <machine.h>
+#include <mutex.h>
 #include <timers.h>
 
+static Mutex_t DriverLoadLock = OS_MUTEX_INIT(MUTEX_PLAIN);
+
 OsStatus_t
 ScAcpiQueryStatus(
    _In_ AcpiDescriptor_t*   AcpiDescriptor)
@@ -190,6 +193,10 @@ ScLoadDriver(
         return OsError;
     }
 
+    // Drivers are loaded in parallel by the device manager, so two devices with the same
+    // driver must not both see it as not spawned yet
+    MutexLock(&DriverLoadLock);
+
     // First of all, if a server has already been spawned
     // for the specific driver, then call it's RegisterInstance
     Module = GetModule(Device->VendorId, Device->DeviceId, Device->Class, Device->Subclass);
@@ -209,15 +216,18 @@ ScLoadDriver(
             }
 
             if (Module == NULL) {
+                MutexUnlock(&DriverLoadLock);
                 return OsError;
             }
         }
 
         Status = SpawnModule(Module);
         if (Status != OsSuccess) {
+            MutexUnlock(&DriverLoadLock);
             return Status;
         }
     }
+    MutexUnlock(&DriverLoadLock);
     return OsSuccess;
 }
 
@@ -245,6 +255,28 @@ ScUnregisterInterrupt(
     return InterruptUnregister(Source);
 }
 
+OsStatus_t
+ScInterruptSetBalancePolicy(
+    _In_ int Policy)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    return InterruptBalancerSetPolicy(Policy);
+}
+
+OsStatus_t
+ScInterruptQueryBalance(
+    _Out_   int*                          Policy,
+    _Out_   InterruptBalanceStatistics_t* Statistics,
+    _InOut_ int*                          Count)
+{
+    if (Policy == NULL || Count == NULL || (Statistics == NULL && *Count != 0)) {
+        return OsInvalidParameters;
+    }
+    return InterruptBalancerQuery(Policy, Statistics, Count);
+}
+
 OsStatus_t
 ScGetProcessBaseAddress(
     _Out_ uintptr_t* BaseAddress)
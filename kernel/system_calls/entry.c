@@ -27,7 +27,9 @@
 #include <ddk/device.h>
 #include <internal/_utils.h>
 #include <ipc_context.h>
+#include <memoryspace.h>
 #include <os/types/process.h>
+#include <os/types/syscall.h>
 #include <os/mollenos.h>
 #include <time.h>
 #include <threading.h>
@@ -79,6 +81,8 @@ extern OsStatus_t ScIoSpaceDestroy(DeviceIo_t* IoSpace);
 extern OsStatus_t ScLoadDriver(MCoreDevice_t* Device, size_t Length);
 extern UUId_t     ScRegisterInterrupt(DeviceInterrupt_t* Interrupt, Flags_t Flags);
 extern OsStatus_t ScUnregisterInterrupt(UUId_t Source);
+extern OsStatus_t ScInterruptSetBalancePolicy(int Policy);
+extern OsStatus_t ScInterruptQueryBalance(int* Policy, InterruptBalanceStatistics_t* Statistics, int* Count);
 extern OsStatus_t ScGetProcessBaseAddress(uintptr_t* BaseAddress);
 
 ///////////////////////////////////////////////
@@ -136,12 +140,20 @@ extern OsStatus_t ScDestroyMemoryHandler(UUId_t Handle);
 extern OsStatus_t ScFlushHardwareCache(int Cache, void* Start, size_t Length);
 extern OsStatus_t ScSystemQuery(SystemDescriptor_t* Descriptor);
 extern OsStatus_t ScSystemTime(SystemTime_t* SystemTime);
+extern OsStatus_t ScSystemLogRead(size_t* Cursor, char* Buffer, size_t Length, size_t* BytesRead);
+extern OsStatus_t ScSystemPage(VirtualAddress_t* Address);
 extern OsStatus_t ScSystemTick(int TickBase, LargeUInteger_t* Tick);
 extern OsStatus_t ScPerformanceFrequency(LargeInteger_t *Frequency);
 extern OsStatus_t ScPerformanceTick(LargeInteger_t *Value);
 extern OsStatus_t ScIsServiceAvailable(UUId_t ServiceId);
 
-#define SYSTEM_CALL_COUNT 74
+// System call batching
+static OsStatus_t ScSyscallBatchRegister(SyscallBatch_t* Batch);
+static OsStatus_t ScSyscallBatchExecute(void);
+
+#define SYSTEM_CALL_COUNT 80
+#define SYSTEM_CALL_BATCH_REGISTER 78
+#define SYSTEM_CALL_BATCH_EXECUTE  79
 
 typedef size_t(*SystemCallHandlerFn)(void*,void*,void*,void*,void*);
 
@@ -254,9 +266,163 @@ static struct SystemCallDescriptor {
     DefineSyscall(70, ScSystemTick),
     DefineSyscall(71, ScPerformanceFrequency),
     DefineSyscall(72, ScPerformanceTick),
-    DefineSyscall(73, ScSystemTime)
+    DefineSyscall(73, ScSystemTime),
+    DefineSyscall(74, ScSystemLogRead),
+    DefineSyscall(75, ScSystemPage),
+    
+    // Interrupt balancing system calls
+    DefineSyscall(76, ScInterruptSetBalancePolicy),
+    DefineSyscall(77, ScInterruptQueryBalance),
+
+    // System call batching
+    DefineSyscall(SYSTEM_CALL_BATCH_REGISTER, ScSyscallBatchRegister),
+    DefineSyscall(SYSTEM_CALL_BATCH_EXECUTE, ScSyscallBatchExecute)
 };
 
+/* ScSyscallBatchValidate
+ * The batch area must be committed and writable user memory of the calling thread. */
+static OsStatus_t
+ScSyscallBatchValidate(
+    _In_ SyscallBatch_t* Batch)
+{
+    size_t    PageSize = GetMemorySpacePageSize();
+    uintptr_t Address  = (uintptr_t)Batch & ~(PageSize - 1);
+    uintptr_t End      = (uintptr_t)Batch + sizeof(SyscallBatch_t);
+    Flags_t   Attributes;
+
+    if (((uintptr_t)Batch & (sizeof(size_t) - 1)) || End < (uintptr_t)Batch) {
+        return OsInvalidParameters;
+    }
+
+    for (; Address < End; Address += PageSize) {
+        Attributes = GetMemorySpaceAttributes(GetCurrentMemorySpace(), Address);
+        if ((Attributes & (MAPPING_USERSPACE | MAPPING_COMMIT | MAPPING_READONLY)) !=
+                (MAPPING_USERSPACE | MAPPING_COMMIT)) {
+            return OsInvalidPermissions;
+        }
+    }
+    return OsSuccess;
+}
+
+/* ScSyscallBatchPolicy
+ * Returns -1 for calls that can't be batched, and 1 for calls that can destroy memory
+ * regions or handles that the pending releases of the batch refer to, which must be sent
+ * first. The calls may block on the region locks while invalidations are held back, which
+ * is safe as the pages and ranges released by the batch are only reused once sent. */
+static int
+ScSyscallBatchPolicy(
+    _In_ size_t Index)
+{
+    switch (Index) {
+        case 50: // ScDmaAttach
+        case 51: // ScDmaAttachmentMap
+        case 54: // ScDmaAttachmentUnmap
+        case 57: // ScCreateHandle
+        case 61: // ScSetHandleActivity
+            return 0;
+        case 55: // ScDmaDetach
+        case 58: // ScDestroyHandle
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+/* ScSyscallBatchRegister
+ * Registers the batch area of the calling thread. Passing NULL removes the registration. */
+static OsStatus_t
+ScSyscallBatchRegister(
+    _In_ SyscallBatch_t* Batch)
+{
+    MCoreThread_t* Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    OsStatus_t     Status;
+
+    if (Batch == NULL) {
+        Thread->SyscallBatch = NULL;
+        return OsSuccess;
+    }
+
+    Status = ScSyscallBatchValidate(Batch);
+    if (Status == OsSuccess) {
+        Thread->SyscallBatch = Batch;
+    }
+    return Status;
+}
+
+/* ScSyscallBatchExecute
+ * Executes the system calls in the batch area of the calling thread in order. The calls
+ * can unmap the page that holds the area, so the entries are copied before the first call
+ * and the results are written back after the last, once the area has been validated again.
+ * The tlb invalidations of the calls are batched as well, so sequences of unmaps only
+ * interrupt the other cores once. */
+static OsStatus_t
+ScSyscallBatchExecute(void)
+{
+    MCoreThread_t*         Thread = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    SyscallBatch_t*        Batch  = Thread->SyscallBatch;
+    SyscallBatchEntry_t    Entries[SYSCALL_BATCH_MAX_ENTRIES];
+    MemorySpaceShootdown_t Shootdown;
+    OsStatus_t             Status = OsSuccess;
+    SyscallBatchEntry_t*   Entry;
+    int                    Policy;
+    int                    Count;
+    int                    i;
+
+    if (Batch == NULL) {
+        return OsNotSupported;
+    }
+
+    if (ScSyscallBatchValidate(Batch) != OsSuccess) {
+        Thread->SyscallBatch = NULL;
+        return OsInvalidPermissions;
+    }
+
+    Count = READ_VOLATILE(Batch->Count);
+    if (Count < 0 || Count > SYSCALL_BATCH_MAX_ENTRIES) {
+        Batch->Executed = 0;
+        return OsInvalidParameters;
+    }
+    memcpy(&Entries[0], &Batch->Entries[0], Count * sizeof(SyscallBatchEntry_t));
+
+    MemorySpaceShootdownBegin(&Shootdown);
+    for (i = 0; i < Count; i++) {
+        Entry  = &Entries[i];
+        Policy = ScSyscallBatchPolicy(Entry->Index);
+        if (Policy < 0) {
+            Entry->Result = (size_t)OsInvalidParameters;
+            Status        = OsIncomplete;
+            i++;
+            break;
+        }
+        else if (Policy > 0) {
+            MemorySpaceShootdownEnd(&Shootdown);
+            MemorySpaceShootdownBegin(&Shootdown);
+        }
+
+        Entry->Result = ((SystemCallHandlerFn)SystemCallsTable[Entry->Index].HandlerAddress)(
+            (void*)Entry->Arguments[0], (void*)Entry->Arguments[1], (void*)Entry->Arguments[2],
+            (void*)Entry->Arguments[3], (void*)Entry->Arguments[4]);
+        if ((Entry->Flags & SYSCALL_BATCH_STOP_ON_ERROR) && (OsStatus_t)Entry->Result != OsSuccess) {
+            Status = OsIncomplete;
+            i++;
+            break;
+        }
+    }
+    MemorySpaceShootdownEnd(&Shootdown);
+
+    // The calls have been executed, but if the area is gone their results are lost
+    if (ScSyscallBatchValidate(Batch) != OsSuccess) {
+        Thread->SyscallBatch = NULL;
+        return OsInvalidPermissions;
+    }
+
+    for (Count = 0; Count < i; Count++) {
+        Batch->Entries[Count].Result = Entries[Count].Result;
+    }
+    Batch->Executed = i;
+    return Status;
+}
+
 Context_t*
 SyscallHandle(
     _In_ Context_t* Context)
@@ -266,7 +432,7 @@ SyscallHandle(
     size_t                       Index = CONTEXT_SC_FUNC(Context);
     size_t                       ReturnValue;
     
-    if (Index > SYSTEM_CALL_COUNT) {
+    if (Index >= SYSTEM_CALL_COUNT) {
         CONTEXT_SC_RET0(Context) = (size_t)OsInvalidParameters;
         return Context;
     }
@@ -30,6 +30,10 @@ OsStatus_t
 ScFutexWait(
     _In_ FutexParameters_t* Parameters)
 {
+    if (Parameters->_flags & FUTEX_WAIT_PI) {
+        return FutexLockPi(Parameters->_futex0, Parameters->_flags, Parameters->_timeout);
+    }
+
     // Two version of wait
     if (Parameters->_flags & FUTEX_WAIT_OP) {
         return FutexWaitOperation(Parameters->_futex0, Parameters->_val0,
@@ -44,6 +48,10 @@ OsStatus_t
 ScFutexWake(
     _In_ FutexParameters_t* Parameters)
 {
+    if (Parameters->_flags & FUTEX_WAKE_PI) {
+        return FutexUnlockPi(Parameters->_futex0, Parameters->_flags);
+    }
+
     // Also two versions of wake
     if (Parameters->_flags & FUTEX_WAKE_OP) {
         return FutexWakeOperation(Parameters->_futex0, Parameters->_val0,
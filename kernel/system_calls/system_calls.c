@@ -39,20 +39,40 @@ ScSystemDebug(
     _In_ const char* Module,
     _In_ const char* Message)
 {
+    char   Part[LOG_STRING_LENGTH + 1];
+    size_t Length;
+    int    LogType;
+
     if (Module == NULL || Message == NULL) {
         return OsError;
     }
 
     // Switch based on type
     if (Type == 0) {
-        LogAppendMessage(LOG_TRACE, Message);
+        LogType = LOG_TRACE;
     }
     else if (Type == 1) {
-        LogAppendMessage(LOG_DEBUG, Message);
+        LogType = LOG_DEBUG;
     }
     else {
-        LogAppendMessage(LOG_ERROR, Message);
+        LogType = LOG_ERROR;
     }
+
+    // The log cuts strings at LOG_STRING_LENGTH, so longer messages are split across
+    // multiple lines. Splits are moved back to the start of an utf-8 sequence.
+    Length = strlen(Message);
+    do {
+        size_t PartLength = MIN(Length, LOG_STRING_LENGTH);
+        while (PartLength < Length && PartLength > 1 && (Message[PartLength] & 0xC0) == 0x80) {
+            PartLength--;
+        }
+
+        memcpy(&Part[0], Message, PartLength);
+        Part[PartLength] = '\0';
+        LogAppendMessage(LogType, "%s", &Part[0]);
+        Message += PartLength;
+        Length  -= PartLength;
+    } while (Length);
     return OsSuccess;
 }
 
@@ -108,6 +128,33 @@ ScSystemTime(
     return OsSuccess;
 }
 
+OsStatus_t
+ScSystemPage(
+    _Out_ VirtualAddress_t* Address)
+{
+    SystemMemorySpace_t* MemorySpace = GetCurrentMemorySpace();
+
+    if (Address == NULL) {
+        return OsInvalidParameters;
+    }
+
+    if (MemorySpace->Context == NULL || !MemorySpace->Context->SystemPage) {
+        return OsNotSupported;
+    }
+    *Address = MemorySpace->Context->SystemPage;
+    return OsSuccess;
+}
+
+OsStatus_t
+ScSystemLogRead(
+    _In_ size_t* Cursor,
+    _In_ char*   Buffer,
+    _In_ size_t  Length,
+    _In_ size_t* BytesRead)
+{
+    return LogRead(Cursor, Buffer, Length, BytesRead);
+}
+
 OsStatus_t
 ScSystemTick(
     _In_ int              TickBase,
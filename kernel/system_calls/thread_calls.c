@@ -114,7 +114,7 @@ ScThreadSleep(
     clock_t End     = 0;
 
     TimersGetSystemTick(&Start);
-    if (SchedulerSleep(Milliseconds, &End) != SCHEDULER_SLEEP_INTERRUPTED) {
+    if (SchedulerSleep((uint64_t)Milliseconds * NSEC_PER_MSEC, &End) != SCHEDULER_SLEEP_INTERRUPTED) {
         TimersGetSystemTick(&End);
     }
 
@@ -0,0 +1,168 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * System Page Interface
+ * - A single read-only page that is mapped into every application memory space and holds
+ *   the clocks and system values, so user space can read them without system calls.
+ */
+
+#define __MODULE "SPGE"
+//#define __TRACE
+
+#include <arch/time.h>
+#include <debug.h>
+#include <irq_spinlock.h>
+#include <machine.h>
+#include <string.h>
+#include <system_page.h>
+#include <timers.h>
+
+#define NSEC_PER_TICK (NSEC_PER_SEC / CLOCKS_PER_SEC)
+
+static IrqSpinlock_t SystemPageLock     = OS_IRQ_SPINLOCK_INIT;
+static SystemPage_t* SystemPage         = NULL;
+static uintptr_t     SystemPagePhysical = 0;
+
+// The timestamp counter is calibrated against the system timer
+static uint64_t CalibrationTsc = 0;
+static uint64_t CalibrationNs  = 0;
+static uint64_t TscScale       = 0;
+static uint64_t TscMaxDelta    = 0;
+
+static uint64_t
+GetEpochSeconds(
+    _In_ SystemTime_t* Time)
+{
+    int          Year  = Time->Year - (Time->Month <= 2);
+    int          Month = Time->Month;
+    unsigned int YearOfEra;
+    unsigned int DayOfYear;
+    unsigned int DayOfEra;
+    int          Era;
+
+    if (Time->Year < 1970 || Month < 1 || Month > 12) {
+        return 0;
+    }
+
+    // Count days from the civil date in 400 year eras that start in March
+    Era       = Year / 400;
+    YearOfEra = (unsigned int)(Year - (Era * 400));
+    DayOfYear = ((153 * (Month > 2 ? Month - 3 : Month + 9)) + 2) / 5 + (Time->DayOfMonth - 1);
+    DayOfEra  = (YearOfEra * 365) + (YearOfEra / 4) - (YearOfEra / 100) + DayOfYear;
+    return ((uint64_t)((Era * 146097) + (int)DayOfEra - 719468) * 86400) +
+        (Time->Hour * 3600) + (Time->Minute * 60) + Time->Second;
+}
+
+static void
+CalibrateTimestampCounter(
+    _In_ uint64_t Tsc,
+    _In_ uint64_t Ns)
+{
+    // Restart when the system tick was reset
+    if (!CalibrationTsc || Ns < CalibrationNs || Tsc < CalibrationTsc) {
+        CalibrationTsc = Tsc;
+        CalibrationNs  = Ns;
+        TscScale       = 0;
+        TscMaxDelta    = 0;
+        return;
+    }
+
+    // Calibrate once over the first second, the window must be less than two seconds
+    // for the shifted nanoseconds to fit in 64 bits
+    if (!TscScale && (Ns - CalibrationNs) >= NSEC_PER_SEC && Tsc > CalibrationTsc) {
+        TscScale    = ((Ns - CalibrationNs) << SYSTEM_PAGE_TSC_SHIFT) / (Tsc - CalibrationTsc);
+        TscMaxDelta = ((Tsc - CalibrationTsc) * NSEC_PER_TICK) / (Ns - CalibrationNs);
+        TRACE("[system_page] timestamp counter scale 0x%llx, %llu per tick", TscScale, TscMaxDelta);
+    }
+}
+
+OsStatus_t
+SystemPageInitialize(void)
+{
+    VirtualAddress_t Address;
+    OsStatus_t       Status;
+
+    Status = MemorySpaceMap(GetCurrentMemorySpace(), &Address, &SystemPagePhysical,
+        GetMemorySpacePageSize(), MAPPING_COMMIT, MAPPING_VIRTUAL_GLOBAL);
+    if (Status != OsSuccess) {
+        ERROR("[system_page] failed to allocate the system page");
+        return Status;
+    }
+
+    SystemPage = (SystemPage_t*)Address;
+    memset(SystemPage, 0, GetMemorySpacePageSize());
+    SystemPage->Version                    = SYSTEM_PAGE_VERSION;
+    SystemPage->PageSizeBytes              = GetMemorySpacePageSize();
+    SystemPage->AllocationGranularityBytes = GetMachine()->MemoryGranularity;
+    SystemPageUpdate();
+    return OsSuccess;
+}
+
+void
+SystemPageUpdate(void)
+{
+    SystemPageTime_t* PageTime;
+    unsigned int      Sequence;
+    clock_t           Tick;
+    uint64_t          Tsc = 0;
+    uint64_t          Ns;
+
+    if (SystemPage == NULL || TimersGetSystemTick(&Tick) != OsSuccess) {
+        return;
+    }
+
+    Ns = (uint64_t)Tick * NSEC_PER_TICK;
+    IrqSpinlockAcquire(&SystemPageLock);
+    if (ArchGetTimestampCounter(&Tsc) == OsSuccess) {
+        CalibrateTimestampCounter(Tsc, Ns);
+    }
+
+    // Readers retry while the sequence is odd
+    PageTime = &SystemPage->Time;
+    Sequence = atomic_load_explicit(&SystemPage->Sequence, memory_order_relaxed);
+    atomic_store_explicit(&SystemPage->Sequence, Sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    PageTime->Tick         = Tick;
+    PageTime->MonotonicNs  = Ns;
+    PageTime->Tsc          = Tsc;
+    PageTime->TscScale     = TscScale;
+    PageTime->TscMaxDelta  = TscMaxDelta;
+    PageTime->EpochSeconds = GetEpochSeconds(&GetMachine()->SystemTime);
+    memcpy(&PageTime->Time, &GetMachine()->SystemTime, sizeof(SystemTime_t));
+    SystemPage->NumberOfProcessors  = (size_t)atomic_load(&GetMachine()->NumberOfProcessors);
+    SystemPage->NumberOfActiveCores = (size_t)atomic_load(&GetMachine()->NumberOfActiveCores);
+
+    atomic_store_explicit(&SystemPage->Sequence, Sequence + 2, memory_order_release);
+    IrqSpinlockRelease(&SystemPageLock);
+}
+
+OsStatus_t
+SystemPageMap(
+    _In_  SystemMemorySpace_t* MemorySpace,
+    _Out_ VirtualAddress_t*    Address)
+{
+    if (SystemPage == NULL) {
+        return OsNotSupported;
+    }
+
+    return MemorySpaceMapContiguous(MemorySpace, Address, SystemPagePhysical,
+        GetMemorySpacePageSize(), MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_READONLY |
+        MAPPING_PERSISTENT, MAPPING_VIRTUAL_PROCESS);
+}
@@ -31,6 +31,7 @@
 #include <ds/list.h>
 #include <interrupts.h>
 #include <scheduler.h>
+#include <system_page.h>
 #include <threading.h>
 #include <machine.h>
 #include <timers.h>
@@ -54,6 +55,7 @@ TimersSynchronizeTime(void)
         ActiveSystemTimer->ResetTick();
     }
     GetMachine()->SystemTime.Nanoseconds.QuadPart = 0;
+    SystemPageUpdate();
     // InterruptEnable();
 }
 
@@ -160,7 +162,7 @@ UpdateSystemTime(size_t Nanoseconds)
 
     // Update the nanoseconds and handle rollover
     Time->Nanoseconds.QuadPart += Nanoseconds;
-    if (Time->Nanoseconds.QuadPart > NSEC_PER_SEC) {
+    if (Time->Nanoseconds.QuadPart >= NSEC_PER_SEC) {
         Time->Nanoseconds.QuadPart -= NSEC_PER_SEC;
         Time->Second++;
         if (Time->Second == SECSPERMIN) {
@@ -200,6 +202,7 @@ TimersInterrupt(
             else if (AccumulatedDrift <= -NSEC_PER_MSEC) { MilliTicks--; AccumulatedDrift += NSEC_PER_MSEC; }
             if (MilliTicks != 0)                         { /* */ }
             UpdateSystemTime(ActiveSystemTimer->TickInNs);
+            SystemPageUpdate();
             return OsSuccess;
         }
     }
@@ -0,0 +1,113 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * LZ4 Implementation
+ *  - Decompression of raw LZ4 blocks, used for ramdisk modules
+ */
+
+#include <lz4.h>
+#include <string.h>
+
+#define LZ4_MIN_MATCH 4
+
+static OsStatus_t
+ReadLength(
+    _InOut_ const uint8_t** Input,
+    _In_    const uint8_t*  InputEnd,
+    _InOut_ size_t*         Length)
+{
+    uint8_t Value;
+
+    // A nibble value of 15 means the length continues in the following bytes
+    if (*Length != 15) {
+        return OsSuccess;
+    }
+
+    do {
+        if (*Input >= InputEnd) {
+            return OsError;
+        }
+        Value    = *((*Input)++);
+        *Length += Value;
+    } while (Value == 255);
+    return OsSuccess;
+}
+
+OsStatus_t
+Lz4Decompress(
+    _In_ const void* Source,
+    _In_ size_t      SourceLength,
+    _In_ void*       Destination,
+    _In_ size_t      DestinationLength)
+{
+    const uint8_t* Input     = (const uint8_t*)Source;
+    const uint8_t* InputEnd  = Input + SourceLength;
+    uint8_t*       Output    = (uint8_t*)Destination;
+    uint8_t*       OutputEnd = Output + DestinationLength;
+
+    if (!Source || !Destination) {
+        return OsInvalidParameters;
+    }
+
+    while (Input < InputEnd) {
+        unsigned int   Token = *Input++;
+        size_t         Length = Token >> 4;
+        size_t         Offset;
+        const uint8_t* Match;
+
+        // Copy the literals of the sequence
+        if (ReadLength(&Input, InputEnd, &Length) != OsSuccess ||
+            Length > (size_t)(InputEnd - Input) ||
+            Length > (size_t)(OutputEnd - Output)) {
+            return OsError;
+        }
+        memcpy(Output, Input, Length);
+        Input  += Length;
+        Output += Length;
+
+        // The last sequence of a block only contains literals
+        if (Input == InputEnd) {
+            break;
+        }
+
+        if ((size_t)(InputEnd - Input) < 2) {
+            return OsError;
+        }
+        Offset = (size_t)Input[0] | ((size_t)Input[1] << 8);
+        Input += 2;
+        if (Offset == 0 || Offset > (size_t)(Output - (uint8_t*)Destination)) {
+            return OsError;
+        }
+
+        Length = Token & 0xF;
+        if (ReadLength(&Input, InputEnd, &Length) != OsSuccess) {
+            return OsError;
+        }
+        Length += LZ4_MIN_MATCH;
+        if (Length > (size_t)(OutputEnd - Output)) {
+            return OsError;
+        }
+
+        // Matches are allowed to overlap the output, so copy byte by byte
+        Match = Output - Offset;
+        while (Length--) {
+            *Output++ = *Match++;
+        }
+    }
+    return (Output == OutputEnd) ? OsSuccess : OsError;
+}
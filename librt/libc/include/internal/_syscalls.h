@@ -2,6 +2,7 @@
 #define __INTERNAL_CRT_SYSCALLS__
 
 #include <os/osdefs.h>
+#include <os/types/syscall.h>
 
 #if defined(i386) || defined(__i386__)
 #define SCTYPE int
@@ -16,6 +17,21 @@ CRTDECL(SCTYPE, syscall2(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1));
 CRTDECL(SCTYPE, syscall3(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2));
 CRTDECL(SCTYPE, syscall4(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE Arg3));
 CRTDECL(SCTYPE, syscall5(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE Arg3, SCTYPE Arg4));
+
+/* SyscallBatchBegin
+ * Retrieves the empty batch area of the calling thread, the area is registered with the
+ * kernel on first use. Returns NULL if batching is not available. */
+CRTDECL(SyscallBatch_t*, SyscallBatchBegin(void));
+
+/* SyscallBatchAdd
+ * Appends a system call to the batch, returns the index of the entry or -1 if the batch is full. */
+CRTDECL(int, SyscallBatchAdd(SyscallBatch_t* Batch, SCTYPE Function, size_t Flags,
+    SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE Arg3, SCTYPE Arg4));
+
+/* SyscallBatchExecute
+ * Executes the system calls of the batch with a single kernel entry. The results are stored
+ * in the entries, and OsIncomplete is returned if the batch stopped on an error. */
+CRTDECL(OsStatus_t, SyscallBatchExecute(SyscallBatch_t* Batch));
 _CODE_END
 
 ///////////////////////////////////////////////
@@ -109,5 +125,20 @@ _CODE_END
 #define Syscall_SystemPerformanceFrequency(Frequency)                      (OsStatus_t)syscall1(71, SCPARAM(Frequency))
 #define Syscall_SystemPerformanceTime(Value)                               (OsStatus_t)syscall1(72, SCPARAM(Value))
 #define Syscall_SystemTime(Time)                                           (OsStatus_t)syscall1(73, SCPARAM(Time))
+#define Syscall_SystemLogRead(Cursor, Buffer, Length, BytesRead)           (OsStatus_t)syscall4(74, SCPARAM(Cursor), SCPARAM(Buffer), SCPARAM(Length), SCPARAM(BytesRead))
+#define Syscall_SystemPage(Address)                                        (OsStatus_t)syscall1(75, SCPARAM(Address))
+
+// Interrupt balancing system calls
+#define Syscall_InterruptSetBalancePolicy(Policy)                          (OsStatus_t)syscall1(76, SCPARAM(Policy))
+#define Syscall_InterruptQueryBalance(Policy, Statistics, Count)           (OsStatus_t)syscall3(77, SCPARAM(Policy), SCPARAM(Statistics), SCPARAM(Count))
+
+// System call batching
+#define Syscall_SyscallBatchRegister(Batch)                                (OsStatus_t)syscall1(78, SCPARAM(Batch))
+#define Syscall_SyscallBatchExecute()                                      (OsStatus_t)syscall0(79)
+
+#define SyscallBatch_DmaAttach(Batch, Flags, Handle, Attachment)           SyscallBatchAdd(Batch, 50, Flags, SCPARAM(Handle), SCPARAM(Attachment), 0, 0, 0)
+#define SyscallBatch_DmaAttachmentMap(Batch, Flags, Attachment)            SyscallBatchAdd(Batch, 51, Flags, SCPARAM(Attachment), 0, 0, 0, 0)
+#define SyscallBatch_DmaAttachmentUnmap(Batch, Flags, Attachment)          SyscallBatchAdd(Batch, 54, Flags, SCPARAM(Attachment), 0, 0, 0, 0)
+#define SyscallBatch_DmaDetach(Batch, Flags, Attachment)                   SyscallBatchAdd(Batch, 55, Flags, SCPARAM(Attachment), 0, 0, 0, 0)
 
 #endif //!__INTERNAL_CRT_SYSCALLS__
@@ -122,6 +122,23 @@ CRTDECL(OsStatus_t, dma_attachment_unmap(struct dma_attachment* attachment));
  */
 CRTDECL(OsStatus_t, dma_detach(struct dma_attachment* attachment));
 
+/**
+ * dma_attach_and_map
+ * * Attach to a dma buffer handle and map it into current memory space with a single
+ * * system call. The attachment is detached again if the mapping fails.
+ * @param handle     [In] The dma buffer handle to attach to.
+ * @param attachment [In] The structure to fill with the attachment information.
+ */
+CRTDECL(OsStatus_t, dma_attach_and_map(UUId_t handle, struct dma_attachment* attachment));
+
+/**
+ * dma_unmap_and_detach
+ * * Remove the mapping of the attachment and detach from the dma buffer with a
+ * * single system call.
+ * @param attachment [In] The dma buffer attachment to unmap and detach from.
+ */
+CRTDECL(OsStatus_t, dma_unmap_and_detach(struct dma_attachment* attachment));
+
 /**
  * dma_get_metrics
  * * Call this once with the count parameter to get the number of
@@ -32,6 +32,13 @@
 #define FUTEX_WAIT_OP           0x2
 #define FUTEX_WAKE_PRIVATE      0x4
 #define FUTEX_WAKE_OP           0x8
+#define FUTEX_WAIT_PI           0x10    // Lock a priority inheritance futex
+#define FUTEX_WAKE_PI           0x20    // Unlock a priority inheritance futex
+
+// A priority inheritance futex holds the id of the owner thread, and the waiter bit
+// is set while threads are blocked on it, which forces the owner to unlock in the kernel
+#define FUTEX_PI_WAITERS        0x80000000
+#define FUTEX_PI_OWNER_MASK     0x3FFFFFFF
 
 //int futex(int *uaddr, int op, int val, const struct timespec *timeout,
 //          int *uaddr2, int val3);
@@ -28,6 +28,7 @@
 #include <os/types/file.h>
 #include <os/types/storage.h>
 #include <os/types/path.h>
+#include <os/types/syspage.h>
 #include <time.h>
 
 // Memory Allocation Definitions
@@ -51,16 +52,6 @@ PACKED_TYPESTRUCT(SystemDescriptor, {
     size_t AllocationGranularityBytes;
 });
 
-PACKED_TYPESTRUCT(SystemTime, {
-    LargeUInteger_t Nanoseconds;
-    int             Second;
-    int             Minute;
-    int             Hour;
-    int             DayOfMonth;
-    int             Month;
-    int             Year;
-});
-
 /* Cache Type Definitions
  * Flags that can be used when requesting a flush of one of the hardware caches */
 #define CACHE_INSTRUCTION   1
@@ -80,6 +71,9 @@ CRTDECL(OsStatus_t, MemoryProtect(void* Memory, size_t Length, Flags_t Flags, Fl
 CRTDECL(int,        OsStatusToErrno(OsStatus_t Status));
 CRTDECL(OsStatus_t, SystemQuery(SystemDescriptor_t* Descriptor));
 CRTDECL(OsStatus_t, GetSystemTime(SystemTime_t* Time));
+CRTDECL(OsStatus_t, GetSystemPageTime(SystemPageTime_t* Time));
+CRTDECL(const SystemPage_t*, GetSystemPage(void));
+CRTDECL(OsStatus_t, SystemLogRead(size_t* Cursor, char* Buffer, size_t Length, size_t* BytesRead));
 CRTDECL(OsStatus_t, GetSystemTick(int TickBase, LargeUInteger_t* Tick));
 CRTDECL(OsStatus_t, QueryPerformanceFrequency(LargeInteger_t* Frequency));
 CRTDECL(OsStatus_t, QueryPerformanceTimer(LargeInteger_t* Value));
@@ -221,7 +221,7 @@ NextPowerOfTwo(size_t Value)
 #endif
 
 #define FSEC_PER_NSEC                           1000000L
-#define NSEC_PER_MSEC                           1000L
+#define NSEC_PER_MSEC                           1000000L
 #define MSEC_PER_SEC                            1000L
 #define NSEC_PER_SEC                            1000000000L
 #define FSEC_PER_SEC                            1000000000000000LL
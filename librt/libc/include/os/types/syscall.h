@@ -0,0 +1,52 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * System Call Batch Type Definitions & Structures
+ * - A thread registers a batch area with the kernel once. It then fills in a number of
+ *   system calls and executes all of them with a single kernel entry. The kernel writes
+ *   the result of each call back into its entry, and the number of calls executed, once
+ *   all calls have completed. Results are lost if a call unmaps the batch area.
+ * - Only the dma attach/map/unmap/detach and handle calls can be batched.
+ */
+
+#ifndef __TYPES_SYSCALL_H__
+#define __TYPES_SYSCALL_H__
+
+#include <os/osdefs.h>
+
+#define SYSCALL_BATCH_SIZE          0x1000
+#define SYSCALL_BATCH_MAX_ENTRIES   32
+#define SYSCALL_BATCH_MAX_ARGUMENTS 5
+
+// The result of the call is an OsStatus_t, and the batch stops if it is not OsSuccess
+#define SYSCALL_BATCH_STOP_ON_ERROR 0x00000001
+
+typedef struct SyscallBatchEntry {
+    size_t Index;
+    size_t Flags;
+    size_t Arguments[SYSCALL_BATCH_MAX_ARGUMENTS];
+    size_t Result;
+} SyscallBatchEntry_t;
+
+typedef struct SyscallBatch {
+    int                 Count;      // Written by user space
+    int                 Executed;   // Written by the kernel
+    SyscallBatchEntry_t Entries[SYSCALL_BATCH_MAX_ENTRIES];
+} SyscallBatch_t;
+
+#endif //!__TYPES_SYSCALL_H__
@@ -0,0 +1,67 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * System Page Type Definitions & Structures
+ * - The system page is a read-only page the kernel maps into every process. It holds
+ *   the clocks and system values that are read often, so they can be read without a
+ *   system call. The kernel increments the sequence before and after an update, a reader
+ *   must retry if the sequence was odd or changed while the values were copied.
+ */
+
+#ifndef __TYPES_SYSPAGE_H__
+#define __TYPES_SYSPAGE_H__
+
+#include <os/osdefs.h>
+
+#define SYSTEM_PAGE_VERSION 1
+
+// The timestamp counter scale is a 32.32 fixed point value of nanoseconds per count
+#define SYSTEM_PAGE_TSC_SHIFT 32
+
+PACKED_TYPESTRUCT(SystemTime, {
+    LargeUInteger_t Nanoseconds;
+    int             Second;
+    int             Minute;
+    int             Hour;
+    int             DayOfMonth;
+    int             Month;
+    int             Year;
+});
+
+typedef struct SystemPageTime {
+    uint64_t     Tick;          // The system tick at the last update
+    uint64_t     MonotonicNs;   // Nanoseconds since boot at the last update
+    uint64_t     Tsc;           // The timestamp counter at the last update
+    uint64_t     TscScale;      // 0 if the timestamp counter can't be used
+    uint64_t     TscMaxDelta;   // The number of counts between two updates
+    uint64_t     EpochSeconds;  // Seconds since 1970-01-01 00:00:00 UTC
+    SystemTime_t Time;
+} SystemPageTime_t;
+
+typedef struct SystemPage {
+    _Atomic(unsigned int) Sequence;
+    unsigned int          Version;
+    SystemPageTime_t      Time;
+
+    size_t                NumberOfProcessors;
+    size_t                NumberOfActiveCores;
+    size_t                PageSizeBytes;
+    size_t                AllocationGranularityBytes;
+} SystemPage_t;
+
+#endif //!__TYPES_SYSPAGE_H__
@@ -52,6 +52,7 @@ typedef struct mtx {
     UUId_t       owner;
     _Atomic(int) references;
     _Atomic(int) value;
+    int          spins;     // Average number of spins it took to get the mutex
 } mtx_t;
 // _MTX_INITIALIZER_NP
 
@@ -70,9 +71,10 @@ enum {
 };
 
 enum {
-    mtx_plain       = 0,
-    mtx_recursive   = 1,
-    mtx_timed       = 2
+    mtx_plain        = 0,
+    mtx_recursive    = 1,
+    mtx_timed        = 2,
+    mtx_prio_inherit = 4    // Extension, the owner runs at the priority of the waiters
 };
 
 #define TSS_DTOR_ITERATIONS 4
@@ -80,11 +82,11 @@ enum {
 
 #if defined(__cplusplus)
 #define COND_INIT           { 0 }
-#define MUTEX_INIT(type)    { type, UUID_INVALID, 0, 0 }
+#define MUTEX_INIT(type)    { type, UUID_INVALID, 0, 0, 0 }
 #else
 // Use stdatomic C11
 #define COND_INIT           { ATOMIC_VAR_INIT(0) }
-#define MUTEX_INIT(type)    { type, UUID_INVALID, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0) }
+#define MUTEX_INIT(type)    { type, UUID_INVALID, ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0), 0 }
 #endif
 #define ONCE_FLAG_INIT      { MUTEX_INIT(mtx_plain), 0 }
 
@@ -111,6 +111,72 @@ dma_detach(
     return Syscall_DmaDetach(attachment);
 }
 
+OsStatus_t
+dma_attach_and_map(
+    _In_ UUId_t                 handle,
+    _In_ struct dma_attachment* attachment)
+{
+    SyscallBatch_t* batch;
+    OsStatus_t      status;
+
+    if (!attachment) {
+        return OsInvalidParameters;
+    }
+
+    batch = SyscallBatchBegin();
+    if (!batch) {
+        status = Syscall_DmaAttach(handle, attachment);
+        if (status != OsSuccess) {
+            return status;
+        }
+
+        status = Syscall_DmaAttachmentMap(attachment);
+        if (status != OsSuccess) {
+            Syscall_DmaDetach(attachment);
+        }
+        return status;
+    }
+
+    SyscallBatch_DmaAttach(batch, SYSCALL_BATCH_STOP_ON_ERROR, handle, attachment);
+    SyscallBatch_DmaAttachmentMap(batch, SYSCALL_BATCH_STOP_ON_ERROR, attachment);
+    if (SyscallBatchExecute(batch) == OsSuccess) {
+        return OsSuccess;
+    }
+
+    // The attachment is only valid if the first call went through
+    if (batch->Executed == 2) {
+        Syscall_DmaDetach(attachment);
+    }
+    return batch->Executed > 0 ? (OsStatus_t)batch->Entries[batch->Executed - 1].Result : OsError;
+}
+
+OsStatus_t
+dma_unmap_and_detach(
+    _In_ struct dma_attachment* attachment)
+{
+    SyscallBatch_t* batch;
+    OsStatus_t      status;
+
+    if (!attachment) {
+        return OsInvalidParameters;
+    }
+
+    batch = SyscallBatchBegin();
+    if (!batch) {
+        Syscall_DmaAttachmentUnmap(attachment);
+        return Syscall_DmaDetach(attachment);
+    }
+
+    // Detach even if the unmap fails, like the separate calls do
+    SyscallBatch_DmaAttachmentUnmap(batch, 0, attachment);
+    SyscallBatch_DmaDetach(batch, 0, attachment);
+    status = SyscallBatchExecute(batch);
+    if (status != OsSuccess || batch->Executed != 2) {
+        return status != OsSuccess ? status : OsError;
+    }
+    return (OsStatus_t)batch->Entries[1].Result;
+}
+
 OsStatus_t
 dma_get_sg_table(
     _In_ struct dma_attachment* attachment,
@@ -22,7 +22,9 @@
  */
 
 #include <internal/_syscalls.h>
+#include <os/mollenos.h>
 #include <os/osdefs.h>
+#include "../threads/tls.h"
 
 __EXTERN SCTYPE _syscall(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE Arg3, SCTYPE Arg4);
 
@@ -49,3 +51,68 @@ SCTYPE syscall4(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE A
 SCTYPE syscall5(SCTYPE Function, SCTYPE Arg0, SCTYPE Arg1, SCTYPE Arg2, SCTYPE Arg3, SCTYPE Arg4) {
 	return _syscall(Function, Arg0, Arg1, Arg2, Arg3, Arg4);
 }
+
+SyscallBatch_t*
+SyscallBatchBegin(void)
+{
+    thread_storage_t* Tls = tls_current();
+    SyscallBatch_t*   Batch;
+
+    if (Tls->syscall_batch == NULL) {
+        if (MemoryAllocate(NULL, SYSCALL_BATCH_SIZE, MEMORY_COMMIT | MEMORY_READ | MEMORY_WRITE,
+                &Tls->syscall_batch) != OsSuccess) {
+            Tls->syscall_batch = NULL;
+            return NULL;
+        }
+
+        if (Syscall_SyscallBatchRegister(Tls->syscall_batch) != OsSuccess) {
+            MemoryFree(Tls->syscall_batch, SYSCALL_BATCH_SIZE);
+            Tls->syscall_batch = NULL;
+            return NULL;
+        }
+    }
+
+    Batch           = (SyscallBatch_t*)Tls->syscall_batch;
+    Batch->Count    = 0;
+    Batch->Executed = 0;
+    return Batch;
+}
+
+int
+SyscallBatchAdd(
+    _In_ SyscallBatch_t* Batch,
+    _In_ SCTYPE          Function,
+    _In_ size_t          Flags,
+    _In_ SCTYPE          Arg0,
+    _In_ SCTYPE          Arg1,
+    _In_ SCTYPE          Arg2,
+    _In_ SCTYPE          Arg3,
+    _In_ SCTYPE          Arg4)
+{
+    SyscallBatchEntry_t* Entry;
+
+    if (!Batch || Batch->Count >= SYSCALL_BATCH_MAX_ENTRIES) {
+        return -1;
+    }
+
+    Entry               = &Batch->Entries[Batch->Count];
+    Entry->Index        = (size_t)Function;
+    Entry->Flags        = Flags;
+    Entry->Arguments[0] = (size_t)Arg0;
+    Entry->Arguments[1] = (size_t)Arg1;
+    Entry->Arguments[2] = (size_t)Arg2;
+    Entry->Arguments[3] = (size_t)Arg3;
+    Entry->Arguments[4] = (size_t)Arg4;
+    Entry->Result       = (size_t)OsIncomplete;
+    return Batch->Count++;
+}
+
+OsStatus_t
+SyscallBatchExecute(
+    _In_ SyscallBatch_t* Batch)
+{
+    if (!Batch) {
+        return OsInvalidParameters;
+    }
+    return Syscall_SyscallBatchExecute();
+}
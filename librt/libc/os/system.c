@@ -25,6 +25,19 @@
 #include <internal/_utils.h>
 #include <os/mollenos.h>
 #include <os/process.h>
+#include <string.h>
+
+static const SystemPage_t* SystemPage = NULL;
+
+static uint64_t
+ReadTimestampCounter(void)
+{
+#if defined(i386) || defined(__i386__) || defined(amd64) || defined(__amd64__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
 
 OsStatus_t
 SystemQuery(
@@ -37,13 +50,77 @@ SystemQuery(
 	return Syscall_SystemQuery(Descriptor);
 }
 
+const SystemPage_t*
+GetSystemPage(void)
+{
+    VirtualAddress_t Address = 0;
+    if (SystemPage == NULL && Syscall_SystemPage(&Address) == OsSuccess) {
+        SystemPage = (const SystemPage_t*)Address;
+    }
+    return SystemPage;
+}
+
+OsStatus_t
+GetSystemPageTime(
+    _In_ SystemPageTime_t* Time)
+{
+    const SystemPage_t* Page = GetSystemPage();
+    unsigned int        Sequence;
+    uint64_t            Delta;
+
+    if (Time == NULL) {
+        return OsInvalidParameters;
+    }
+    if (Page == NULL) {
+        return OsNotSupported;
+    }
+
+    do {
+        Sequence = atomic_load_explicit(&Page->Sequence, memory_order_acquire);
+        memcpy(Time, (const void*)&Page->Time, sizeof(SystemPageTime_t));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((Sequence & 1) || Sequence != atomic_load_explicit(&Page->Sequence, memory_order_relaxed));
+
+    // Advance the monotonic time from the last update with the timestamp counter. The delta
+    // is limited to one update period so the time never passes the next update.
+    if (Time->TscScale != 0) {
+        uint64_t Tsc = ReadTimestampCounter();
+        Delta = (Tsc > Time->Tsc) ? (Tsc - Time->Tsc) : 0;
+        if (Delta > Time->TscMaxDelta) {
+            Delta = Time->TscMaxDelta;
+        }
+        Time->MonotonicNs += (Delta * Time->TscScale) >> SYSTEM_PAGE_TSC_SHIFT;
+        Time->Tsc          = Tsc;
+    }
+    return OsSuccess;
+}
+
 OsStatus_t
 GetSystemTime(
 	_In_ SystemTime_t* Time)
 {
+    SystemPageTime_t PageTime;
+
+    if (Time != NULL && GetSystemPageTime(&PageTime) == OsSuccess) {
+        memcpy(Time, &PageTime.Time, sizeof(SystemTime_t));
+        return OsSuccess;
+    }
     return Syscall_SystemTime(Time);
 }
 
+OsStatus_t
+SystemLogRead(
+    _InOut_ size_t* Cursor,
+    _In_    char*   Buffer,
+    _In_    size_t  Length,
+    _Out_   size_t* BytesRead)
+{
+    if (Cursor == NULL || Buffer == NULL || Length == 0 || BytesRead == NULL) {
+        return OsInvalidParameters;
+    }
+    return Syscall_SystemLogRead(Cursor, Buffer, Length, BytesRead);
+}
+
 OsStatus_t
 GetSystemTick(
     _In_ int              TickBase,
@@ -58,6 +135,13 @@ GetSystemTick(
         gracht_vali_message_finish(&msg);
         return status;
     }
+    else if (TickBase == TIME_MONOTONIC && Tick != NULL) {
+        SystemPageTime_t PageTime;
+        if (GetSystemPageTime(&PageTime) == OsSuccess) {
+            Tick->QuadPart = PageTime.Tick;
+            return OsSuccess;
+        }
+    }
     return Syscall_SystemTick(TickBase, Tick);
 }
 
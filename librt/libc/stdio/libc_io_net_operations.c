@@ -71,13 +71,11 @@ OsStatus_t stdio_net_op_close(stdio_handle_t* handle, int options)
     }
     
     if (handle->object.data.socket.send_buffer.buffer) {
-        (void)dma_attachment_unmap(&handle->object.data.socket.send_buffer);
-        (void)dma_detach(&handle->object.data.socket.send_buffer);
+        (void)dma_unmap_and_detach(&handle->object.data.socket.send_buffer);
     }
     
     if (handle->object.data.socket.recv_buffer.buffer) {
-        (void)dma_attachment_unmap(&handle->object.data.socket.recv_buffer);
-        (void)dma_detach(&handle->object.data.socket.recv_buffer);
+        (void)dma_unmap_and_detach(&handle->object.data.socket.recv_buffer);
     }
     return status;
 }
@@ -90,22 +88,17 @@ OsStatus_t stdio_net_op_inherit(stdio_handle_t* handle)
     
     // When we inherit a socket from another application, we must reattach
     // the handle that is stored in dma_attachment.
-    status1 = dma_attach(send_buffer_handle, &handle->object.data.socket.send_buffer);
-    status2 = dma_attach(recv_buffer_handle, &handle->object.data.socket.recv_buffer);
-    if (status1 != OsSuccess || status2 != OsSuccess) {
-        return status1 != OsSuccess ? status1 : status2;
-    }
-    
-    status1 = dma_attachment_map(&handle->object.data.socket.send_buffer);
+    status1 = dma_attach_and_map(send_buffer_handle, &handle->object.data.socket.send_buffer);
     if (status1 != OsSuccess) {
         return status1;
     }
     
-    status1 = dma_attachment_map(&handle->object.data.socket.recv_buffer);
-    if (status1 != OsSuccess) {
-        return status1;
+    status2 = dma_attach_and_map(recv_buffer_handle, &handle->object.data.socket.recv_buffer);
+    if (status2 != OsSuccess) {
+        (void)dma_unmap_and_detach(&handle->object.data.socket.send_buffer);
+        return status2;
     }
-    return status1;
+    return OsSuccess;
 }
 
 void stdio_get_net_operations(stdio_ops_t* ops)
@@ -10,7 +10,7 @@
          Check before installing!
 */
 
-#ifdef LIBC_KERNEL
+#if defined(LIBC_KERNEL) || defined(__OSCONFIG_MALLOC_THREAD_CACHE)
 void __MallocLibCEmpty(void)
 {
 }
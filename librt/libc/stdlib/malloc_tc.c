@@ -0,0 +1,847 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Thread-Caching Memory Allocator
+ * - Replaces dlmalloc when the os is configured with __OSCONFIG_MALLOC_THREAD_CACHE.
+ *   Every thread owns a heap of spans, each span holds objects of a single size class
+ *   and is only ever allocated from by the thread that owns it. Frees from other
+ *   threads are pushed on a lock-free queue in the span, which the owner collects
+ *   once it runs out of free objects. Large allocations are mapped directly.
+ * - Spans are aligned to their size, so the span of any pointer is found by masking
+ *   the pointer. Large allocations carry the same header at the aligned base.
+ * - Spans that become empty are returned to the system, except the last one of each
+ *   size class of a heap. When a thread exits its spans are abandoned and adopted by
+ *   the next thread that needs a span of that class.
+ */
+
+#if defined(LIBC_KERNEL) || !defined(__OSCONFIG_MALLOC_THREAD_CACHE)
+void __MallocThreadCacheEmpty(void)
+{
+}
+#else
+#include <errno.h>
+#include <malloc.h>
+#include <os/mollenos.h>
+#include <os/spinlock.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../threads/tls.h"
+
+#define TC_SPAN_SIZE      ((size_t)0x10000)
+#define TC_SPAN_MASK      (TC_SPAN_SIZE - 1)
+#define TC_SPAN_MAGIC     0x7C5A11C0U
+#define TC_HEADER_SIZE    128
+#define TC_ALIGNMENT      16
+#define TC_PAGE_SIZE      0x1000
+#define TC_SMALL_MAX      8192
+#define TC_CLASS_COUNT    32
+#define TC_CLASS_LARGE    -1
+#define TC_HEAP_DETACHED  ((struct tc_heap*)(uintptr_t)1)
+#define TC_MEMORY_FLAGS   (MEMORY_READ | MEMORY_WRITE)
+
+// Pointers never sit at the very start of their span, the header is there
+#define TC_SPAN_OF(Pointer) ((struct tc_span*)(((uintptr_t)(Pointer) - 1) & ~(uintptr_t)TC_SPAN_MASK))
+#define TC_ALIGN_UP(Value, Alignment) (((Value) + ((Alignment) - 1)) & ~((uintptr_t)(Alignment) - 1))
+
+struct tc_heap;
+
+struct tc_span {
+    unsigned int             magic;
+    int                      class_index;
+    void*                    mapping;
+    size_t                   mapping_length;
+    size_t                   size;           // object size, or the usable size of large allocations
+    _Atomic(struct tc_heap*) owner;          // NULL while abandoned
+    struct tc_span*          next;
+    struct tc_span*          prev;
+    void*                    free_list;
+    uint8_t*                 bump;
+    uint8_t*                 end;
+    int                      used;
+    _Atomic(void*)           remote_free;
+};
+
+struct tc_heap {
+    struct tc_span* spans[TC_CLASS_COUNT];
+};
+
+static const size_t ClassSizes[TC_CLASS_COUNT] = {
+    16,   32,   48,   64,   80,   96,   112,  128,
+    160,  192,  224,  256,  320,  384,  448,  512,
+    640,  768,  896,  1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192
+};
+
+// The shared heap serves threads without thread storage, it is protected by a lock
+// and all frees to it are queued as remote frees
+static spinlock_t      SharedLock     = _SPN_INITIALIZER_NP(spinlock_plain);
+static struct tc_heap  SharedHeap     = { { 0 } };
+static spinlock_t      AbandonedLock  = _SPN_INITIALIZER_NP(spinlock_plain);
+static struct tc_span* AbandonedSpans[TC_CLASS_COUNT] = { 0 };
+
+static _Atomic(size_t) SpanBytes      = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) LargeBytes     = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t) MaxFootprint   = ATOMIC_VAR_INIT(0);
+
+static inline int
+tc_class(
+    _In_ size_t Size)
+{
+    unsigned int Shift;
+
+    if (Size <= 128) {
+        return Size ? (int)((Size - 1) >> 4) : 0;
+    }
+
+    // Four classes between each power of two, sizes never exceed 32 bits here
+    Shift = 31U - (unsigned int)__builtin_clz((unsigned int)(Size - 1));
+    return (int)(8 + ((Shift - 7) * 4) + ((Size - 1) >> (Shift - 2)) - 4);
+}
+
+static void
+tc_account(
+    _In_ _Atomic(size_t)* Counter,
+    _In_ size_t           Bytes,
+    _In_ int              Add)
+{
+    size_t Footprint;
+    size_t Max;
+
+    if (!Add) {
+        atomic_fetch_sub(Counter, Bytes);
+        return;
+    }
+
+    atomic_fetch_add(Counter, Bytes);
+    Footprint = atomic_load(&SpanBytes) + atomic_load(&LargeBytes);
+    Max       = atomic_load(&MaxFootprint);
+    while (Footprint > Max && !atomic_compare_exchange_weak(&MaxFootprint, &Max, Footprint));
+}
+
+/* tc_map_aligned
+ * Reserves memory that contains a range of the requested length at the requested
+ * alignment. The memory is only reserved, pages are committed when touched. */
+static uint8_t*
+tc_map_aligned(
+    _In_  size_t  Length,
+    _In_  size_t  Alignment,
+    _Out_ void**  MappingOut,
+    _Out_ size_t* MappingLengthOut)
+{
+    void* Mapping;
+
+    // Most of the time the memory is aligned already, so try without padding first
+    if (MemoryAllocate(NULL, Length, TC_MEMORY_FLAGS, &Mapping) != OsSuccess) {
+        return NULL;
+    }
+
+    if ((uintptr_t)Mapping & (Alignment - 1)) {
+        MemoryFree(Mapping, Length);
+        if (Length > (SIZE_MAX - Alignment) ||
+            MemoryAllocate(NULL, Length + Alignment, TC_MEMORY_FLAGS, &Mapping) != OsSuccess) {
+            return NULL;
+        }
+        Length += Alignment;
+    }
+
+    *MappingOut       = Mapping;
+    *MappingLengthOut = Length;
+    return (uint8_t*)TC_ALIGN_UP((uintptr_t)Mapping, Alignment);
+}
+
+static void
+tc_release_span(
+    _In_ struct tc_span* Span)
+{
+    size_t Length = Span->mapping_length;
+
+    tc_account((Span->class_index == TC_CLASS_LARGE) ? &LargeBytes : &SpanBytes, Length, 0);
+    MemoryFree(Span->mapping, Length);
+}
+
+static struct tc_span*
+tc_create_span(
+    _In_ struct tc_heap* Heap,
+    _In_ int             ClassIndex)
+{
+    struct tc_span* Span;
+    void*           Mapping;
+    size_t          MappingLength;
+    size_t          Size = ClassSizes[ClassIndex];
+
+    Span = (struct tc_span*)tc_map_aligned(TC_SPAN_SIZE, TC_SPAN_SIZE, &Mapping, &MappingLength);
+    if (!Span) {
+        return NULL;
+    }
+
+    memset(Span, 0, sizeof(struct tc_span));
+    Span->magic          = TC_SPAN_MAGIC;
+    Span->class_index    = ClassIndex;
+    Span->mapping        = Mapping;
+    Span->mapping_length = MappingLength;
+    Span->size           = Size;
+    Span->bump           = (uint8_t*)Span + TC_HEADER_SIZE;
+    Span->end            = Span->bump + (((TC_SPAN_SIZE - TC_HEADER_SIZE) / Size) * Size);
+    atomic_store(&Span->owner, Heap);
+    tc_account(&SpanBytes, MappingLength, 1);
+    return Span;
+}
+
+/* tc_span_collect
+ * Moves the objects freed by other threads to the local free list of the span. */
+static void
+tc_span_collect(
+    _In_ struct tc_span* Span)
+{
+    void* Objects;
+    void* Tail;
+    int   Count = 1;
+
+    if (!atomic_load_explicit(&Span->remote_free, memory_order_relaxed)) {
+        return;
+    }
+
+    Objects = atomic_exchange_explicit(&Span->remote_free, NULL, memory_order_acquire);
+    if (!Objects) {
+        return;
+    }
+
+    Tail = Objects;
+    while (*(void**)Tail) {
+        Tail = *(void**)Tail;
+        Count++;
+    }
+
+    *(void**)Tail   = Span->free_list;
+    Span->free_list = Objects;
+    Span->used     -= Count;
+}
+
+static inline void*
+tc_span_pop(
+    _In_ struct tc_span* Span)
+{
+    void* Object = Span->free_list;
+
+    if (Object) {
+        Span->free_list = *(void**)Object;
+        Span->used++;
+        return Object;
+    }
+
+    if (Span->bump < Span->end) {
+        Object      = Span->bump;
+        Span->bump += Span->size;
+        Span->used++;
+        return Object;
+    }
+    return NULL;
+}
+
+static void
+tc_link_span(
+    _In_ struct tc_heap* Heap,
+    _In_ struct tc_span* Span)
+{
+    int ClassIndex = Span->class_index;
+
+    Span->prev = NULL;
+    Span->next = Heap->spans[ClassIndex];
+    if (Span->next) {
+        Span->next->prev = Span;
+    }
+    Heap->spans[ClassIndex] = Span;
+}
+
+static void
+tc_unlink_span(
+    _In_ struct tc_heap* Heap,
+    _In_ struct tc_span* Span)
+{
+    if (Span->prev) {
+        Span->prev->next = Span->next;
+    }
+    else {
+        Heap->spans[Span->class_index] = Span->next;
+    }
+
+    if (Span->next) {
+        Span->next->prev = Span->prev;
+    }
+}
+
+static struct tc_span*
+tc_adopt_span(
+    _In_ struct tc_heap* Heap,
+    _In_ int             ClassIndex)
+{
+    struct tc_span* Span;
+
+    if (!AbandonedSpans[ClassIndex]) {
+        return NULL;
+    }
+
+    spinlock_acquire(&AbandonedLock);
+    Span = AbandonedSpans[ClassIndex];
+    if (Span) {
+        AbandonedSpans[ClassIndex] = Span->next;
+    }
+    spinlock_release(&AbandonedLock);
+
+    if (Span) {
+        atomic_store(&Span->owner, Heap);
+        tc_span_collect(Span);
+    }
+    return Span;
+}
+
+static void*
+tc_heap_allocate_slow(
+    _In_ struct tc_heap* Heap,
+    _In_ int             ClassIndex)
+{
+    struct tc_span* Span;
+    void*           Object;
+
+    // Look for a span that got objects back from other threads
+    for (Span = Heap->spans[ClassIndex]; Span != NULL; Span = Span->next) {
+        tc_span_collect(Span);
+        Object = tc_span_pop(Span);
+        if (Object) {
+            if (Span->prev) {
+                tc_unlink_span(Heap, Span);
+                tc_link_span(Heap, Span);
+            }
+            return Object;
+        }
+    }
+
+    // Abandoned spans can be full, those stay with the heap like any other full span
+    while ((Span = tc_adopt_span(Heap, ClassIndex)) != NULL) {
+        tc_link_span(Heap, Span);
+        Object = tc_span_pop(Span);
+        if (Object) {
+            return Object;
+        }
+    }
+
+    Span = tc_create_span(Heap, ClassIndex);
+    if (!Span) {
+        return NULL;
+    }
+
+    tc_link_span(Heap, Span);
+    return tc_span_pop(Span);
+}
+
+static inline void*
+tc_heap_allocate(
+    _In_ struct tc_heap* Heap,
+    _In_ int             ClassIndex)
+{
+    struct tc_span* Span = Heap->spans[ClassIndex];
+    void*           Object;
+
+    if (Span) {
+        Object = tc_span_pop(Span);
+        if (Object) {
+            return Object;
+        }
+    }
+    return tc_heap_allocate_slow(Heap, ClassIndex);
+}
+
+/* tc_heap_trim
+ * Collects all spans of the heap and returns the empty ones to the system, the
+ * first span of each class is kept unless Everything is set. */
+static int
+tc_heap_trim(
+    _In_ struct tc_heap* Heap,
+    _In_ int             Everything)
+{
+    int Released = 0;
+
+    for (int i = 0; i < TC_CLASS_COUNT; i++) {
+        struct tc_span* Span = Heap->spans[i];
+        while (Span) {
+            struct tc_span* Next = Span->next;
+            tc_span_collect(Span);
+            if (!Span->used && (Everything || Span != Heap->spans[i] || Next)) {
+                tc_unlink_span(Heap, Span);
+                tc_release_span(Span);
+                Released = 1;
+            }
+            Span = Next;
+        }
+    }
+    return Released;
+}
+
+static void*
+tc_shared_allocate(
+    _In_ int ClassIndex)
+{
+    void* Object;
+
+    spinlock_acquire(&SharedLock);
+    Object = tc_heap_allocate(&SharedHeap, ClassIndex);
+    spinlock_release(&SharedLock);
+    return Object;
+}
+
+/* tc_heap_current
+ * Retrieves the heap of the calling thread, creating it on first use. Returns NULL
+ * for threads that have no thread storage (yet), they use the shared heap. */
+static struct tc_heap*
+tc_heap_current(void)
+{
+    thread_storage_t* Tls = tls_current();
+    struct tc_heap*   Heap;
+
+    if (!Tls) {
+        return NULL;
+    }
+
+    Heap = (struct tc_heap*)Tls->malloc_cache;
+    if (Heap == TC_HEAP_DETACHED) {
+        return NULL;
+    }
+
+    if (!Heap) {
+        Heap = (struct tc_heap*)tc_shared_allocate(tc_class(sizeof(struct tc_heap)));
+        if (Heap) {
+            memset(Heap, 0, sizeof(struct tc_heap));
+            Tls->malloc_cache = Heap;
+        }
+    }
+    return Heap;
+}
+
+static void*
+tc_large_allocate(
+    _In_ size_t Size,
+    _In_ size_t Alignment)
+{
+    struct tc_span* Span;
+    uint8_t*        Pointer;
+    void*           Mapping;
+    size_t          MappingLength;
+    size_t          Offset = (Alignment < TC_SPAN_SIZE) ? MAX(TC_HEADER_SIZE, Alignment) : Alignment;
+
+    if (Size > (SIZE_MAX - Offset - TC_SPAN_SIZE)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // With alignments beyond the span size the header is placed a span below the pointer
+    Pointer = tc_map_aligned(Size + Offset, MAX(Alignment, TC_SPAN_SIZE), &Mapping, &MappingLength);
+    if (!Pointer) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    Pointer += Offset;
+    Span     = TC_SPAN_OF(Pointer);
+    memset(Span, 0, sizeof(struct tc_span));
+    Span->magic          = TC_SPAN_MAGIC;
+    Span->class_index    = TC_CLASS_LARGE;
+    Span->mapping        = Mapping;
+    Span->mapping_length = MappingLength;
+    Span->size           = ((uint8_t*)Mapping + MappingLength) - Pointer;
+    tc_account(&LargeBytes, MappingLength, 1);
+    return Pointer;
+}
+
+static void*
+tc_allocate_class(
+    _In_ int ClassIndex)
+{
+    struct tc_heap* Heap = tc_heap_current();
+    void*           Object;
+
+    Object = Heap ? tc_heap_allocate(Heap, ClassIndex) : tc_shared_allocate(ClassIndex);
+    if (!Object) {
+        errno = ENOMEM;
+    }
+    return Object;
+}
+
+void*
+malloc(
+    _In_ size_t Size)
+{
+    if (Size > TC_SMALL_MAX) {
+        return tc_large_allocate(Size, TC_ALIGNMENT);
+    }
+    return tc_allocate_class(tc_class(Size));
+}
+
+void
+free(
+    _In_ void* Memory)
+{
+    struct tc_span* Span;
+    struct tc_heap* Heap;
+    void*           Head;
+
+    if (!Memory) {
+        return;
+    }
+
+    Span = TC_SPAN_OF(Memory);
+    if (Span->magic != TC_SPAN_MAGIC) {
+        abort();
+    }
+
+    if (Span->class_index == TC_CLASS_LARGE) {
+        tc_release_span(Span);
+        return;
+    }
+
+    // Only the owner may touch the local free list, everyone else queues the object
+    Heap = tc_heap_current();
+    if (Heap && atomic_load_explicit(&Span->owner, memory_order_relaxed) == Heap) {
+        *(void**)Memory = Span->free_list;
+        Span->free_list = Memory;
+        if (!--Span->used && (Span->prev || Span->next)) {
+            tc_unlink_span(Heap, Span);
+            tc_release_span(Span);
+        }
+        return;
+    }
+
+    Head = atomic_load_explicit(&Span->remote_free, memory_order_relaxed);
+    do {
+        *(void**)Memory = Head;
+    } while (!atomic_compare_exchange_weak_explicit(&Span->remote_free, &Head, Memory,
+        memory_order_release, memory_order_relaxed));
+}
+
+void*
+calloc(
+    _In_ size_t Count,
+    _In_ size_t Size)
+{
+    void* Memory;
+
+    if (Size && Count > (SIZE_MAX / Size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    Memory = malloc(Count * Size);
+    if (Memory) {
+        memset(Memory, 0, Count * Size);
+    }
+    return Memory;
+}
+
+size_t
+malloc_usable_size(
+    _In_ void* Memory)
+{
+    return Memory ? TC_SPAN_OF(Memory)->size : 0;
+}
+
+void*
+realloc_in_place(
+    _In_ void*  Memory,
+    _In_ size_t Size)
+{
+    return (Memory && malloc_usable_size(Memory) >= Size) ? Memory : NULL;
+}
+
+void*
+realloc(
+    _In_ void*  Memory,
+    _In_ size_t Size)
+{
+    size_t Usable;
+    void*  Resized;
+
+    if (!Memory) {
+        return malloc(Size);
+    }
+
+    // Keep the allocation when it fits and is not more than twice the size
+    Usable = malloc_usable_size(Memory);
+    if (Size <= Usable && (Size > (Usable / 2) || Usable <= TC_ALIGNMENT)) {
+        return Memory;
+    }
+
+    Resized = malloc(Size);
+    if (Resized) {
+        memcpy(Resized, Memory, MIN(Size, Usable));
+        free(Memory);
+    }
+    return Resized;
+}
+
+void*
+memalign(
+    _In_ size_t Alignment,
+    _In_ size_t Size)
+{
+    size_t PowerOfTwo = TC_ALIGNMENT;
+
+    if (Alignment <= TC_ALIGNMENT) {
+        return malloc(Size);
+    }
+
+    while (PowerOfTwo < Alignment) {
+        PowerOfTwo <<= 1;
+    }
+
+    // Objects start at the header boundary, so classes that are a multiple of the
+    // alignment hold aligned objects
+    if (Size <= TC_SMALL_MAX && PowerOfTwo <= TC_HEADER_SIZE) {
+        for (int i = tc_class(Size); i < TC_CLASS_COUNT; i++) {
+            if (!(ClassSizes[i] & (PowerOfTwo - 1))) {
+                return tc_allocate_class(i);
+            }
+        }
+    }
+    return tc_large_allocate(Size, PowerOfTwo);
+}
+
+int
+posix_memalign(
+    _Out_ void** MemoryOut,
+    _In_  size_t Alignment,
+    _In_  size_t Size)
+{
+    void* Memory;
+
+    if (!Alignment || (Alignment % sizeof(void*)) || (Alignment & (Alignment - 1))) {
+        return EINVAL;
+    }
+
+    Memory = memalign(Alignment, Size);
+    if (!Memory) {
+        return ENOMEM;
+    }
+    *MemoryOut = Memory;
+    return 0;
+}
+
+void*
+valloc(
+    _In_ size_t Size)
+{
+    return memalign(TC_PAGE_SIZE, Size);
+}
+
+void*
+pvalloc(
+    _In_ size_t Size)
+{
+    return memalign(TC_PAGE_SIZE, TC_ALIGN_UP(Size, TC_PAGE_SIZE));
+}
+
+void**
+independent_calloc(
+    _In_ size_t Count,
+    _In_ size_t Size,
+    _In_ void** Chunks)
+{
+    void** Array = Chunks ? Chunks : (void**)malloc(Count * sizeof(void*));
+
+    if (!Array) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+        Array[i] = calloc(1, Size);
+        if (!Array[i]) {
+            bulk_free(Array, i);
+            if (!Chunks) {
+                free(Array);
+            }
+            return NULL;
+        }
+    }
+    return Array;
+}
+
+void**
+independent_comalloc(
+    _In_ size_t  Count,
+    _In_ size_t* Sizes,
+    _In_ void**  Chunks)
+{
+    void** Array = Chunks ? Chunks : (void**)malloc(Count * sizeof(void*));
+
+    if (!Array) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+        Array[i] = malloc(Sizes[i]);
+        if (!Array[i]) {
+            bulk_free(Array, i);
+            if (!Chunks) {
+                free(Array);
+            }
+            return NULL;
+        }
+    }
+    return Array;
+}
+
+size_t
+bulk_free(
+    _In_ void** Array,
+    _In_ size_t Count)
+{
+    for (size_t i = 0; i < Count; i++) {
+        free(Array[i]);
+        Array[i] = NULL;
+    }
+    return 0;
+}
+
+int
+malloc_trim(
+    _In_ size_t Pad)
+{
+    struct tc_heap* Heap = tc_heap_current();
+    int             Released = 0;
+    _CRT_UNUSED(Pad);
+
+    if (Heap) {
+        Released |= tc_heap_trim(Heap, 0);
+    }
+
+    spinlock_acquire(&SharedLock);
+    Released |= tc_heap_trim(&SharedHeap, 0);
+    spinlock_release(&SharedLock);
+
+    // Abandoned spans that were emptied by other threads can go as well
+    spinlock_acquire(&AbandonedLock);
+    for (int i = 0; i < TC_CLASS_COUNT; i++) {
+        struct tc_span** Iter = &AbandonedSpans[i];
+        while (*Iter) {
+            struct tc_span* Span = *Iter;
+            tc_span_collect(Span);
+            if (!Span->used) {
+                *Iter = Span->next;
+                tc_release_span(Span);
+                Released = 1;
+            }
+            else {
+                Iter = &Span->next;
+            }
+        }
+    }
+    spinlock_release(&AbandonedLock);
+    return Released;
+}
+
+/* malloc_thread_detach
+ * Releases the empty spans of the exiting thread and abandons the rest, they are
+ * adopted by other threads as needed. */
+void
+malloc_thread_detach(
+    _In_ thread_storage_t* Tls)
+{
+    struct tc_heap* Heap = (struct tc_heap*)Tls->malloc_cache;
+
+    Tls->malloc_cache = TC_HEAP_DETACHED;
+    if (!Heap || Heap == TC_HEAP_DETACHED) {
+        return;
+    }
+
+    tc_heap_trim(Heap, 1);
+    for (int i = 0; i < TC_CLASS_COUNT; i++) {
+        struct tc_span* Span = Heap->spans[i];
+        while (Span) {
+            struct tc_span* Next = Span->next;
+            atomic_store(&Span->owner, NULL);
+
+            spinlock_acquire(&AbandonedLock);
+            Span->prev        = NULL;
+            Span->next        = AbandonedSpans[i];
+            AbandonedSpans[i] = Span;
+            spinlock_release(&AbandonedLock);
+            Span = Next;
+        }
+    }
+    free(Heap);
+}
+
+int
+mallopt(
+    _In_ int Parameter,
+    _In_ int Value)
+{
+    _CRT_UNUSED(Parameter);
+    _CRT_UNUSED(Value);
+    return 0;
+}
+
+size_t
+malloc_footprint(void)
+{
+    return atomic_load(&SpanBytes) + atomic_load(&LargeBytes);
+}
+
+size_t
+malloc_max_footprint(void)
+{
+    return atomic_load(&MaxFootprint);
+}
+
+size_t
+malloc_footprint_limit(void)
+{
+    return SIZE_MAX;
+}
+
+size_t
+malloc_set_footprint_limit(
+    _In_ size_t Bytes)
+{
+    _CRT_UNUSED(Bytes);
+    return SIZE_MAX;
+}
+
+struct mallinfo
+mallinfo(void)
+{
+    struct mallinfo Info;
+
+    memset(&Info, 0, sizeof(struct mallinfo));
+    Info.arena   = atomic_load(&SpanBytes);
+    Info.hblkhd  = atomic_load(&LargeBytes);
+    Info.usmblks = atomic_load(&MaxFootprint);
+    return Info;
+}
+
+void
+malloc_stats(void)
+{
+    fprintf(stderr, "max system bytes = %10lu\n", (unsigned long)malloc_max_footprint());
+    fprintf(stderr, "system bytes     = %10lu\n", (unsigned long)malloc_footprint());
+    fprintf(stderr, "span bytes       = %10lu\n", (unsigned long)atomic_load(&SpanBytes));
+    fprintf(stderr, "large bytes      = %10lu\n", (unsigned long)atomic_load(&LargeBytes));
+}
+#endif
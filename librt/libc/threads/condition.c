@@ -28,6 +28,29 @@
 #include <errno.h>
 #include <time.h>
 
+/* __cnd_wait_pi
+ * Priority inheritance mutexes are handed over by the kernel, so the wait operation can't
+ * release them. The condition is read before the mutex is released, so a signal that comes
+ * in between makes the wait return immediately. */
+static OsStatus_t
+__cnd_wait_pi(
+    _In_ cnd_t* cond,
+    _In_ mtx_t* mutex,
+    _In_ size_t timeout)
+{
+    FutexParameters_t parameters;
+    OsStatus_t        status;
+
+    parameters._futex0  = &cond->syncobject;
+    parameters._val0    = atomic_load(&cond->syncobject);
+    parameters._flags   = FUTEX_WAIT_PRIVATE;
+    parameters._timeout = timeout;
+
+    mtx_unlock(mutex);
+    status = Syscall_FutexWait(&parameters);
+    return status == OsError ? OsSuccess : status;
+}
+
 int
 cnd_init(
     _In_ cnd_t* cond)
@@ -106,7 +129,12 @@ cnd_wait(
     parameters._flags   = FUTEX_WAIT_PRIVATE | FUTEX_WAIT_OP;
     parameters._timeout = 0;
     
-    status = Syscall_FutexWait(&parameters);
+    if (mutex->flags & mtx_prio_inherit) {
+        status = __cnd_wait_pi(cond, mutex, 0);
+    }
+    else {
+        status = Syscall_FutexWait(&parameters);
+    }
     mtx_lock(mutex);
     if (status != OsSuccess) {
         return thrd_error;
@@ -130,9 +158,13 @@ cnd_timedwait(
 		return thrd_error;
 	}
     
-    // Calculate time to sleep
+    // Calculate time to sleep, a timeout of 0 means forever to the kernel so a
+    // deadline that has already passed must not reach the wait
 	timespec_get(&now, TIME_UTC);
-    timespec_diff(time_point, &now, &result);
+    timespec_diff(&now, time_point, &result);
+    if (result.tv_sec < 0 || (result.tv_sec == 0 && result.tv_nsec == 0)) {
+        return thrd_timedout;
+    }
     msec = result.tv_sec * MSEC_PER_SEC;
     if (result.tv_nsec != 0) {
         msec += ((result.tv_nsec - 1) / NSEC_PER_MSEC) + 1;
@@ -144,9 +176,14 @@ cnd_timedwait(
     parameters._val1    = 1; // Wakeup one on the mutex
     parameters._val2    = FUTEX_OP(FUTEX_OP_SET, 0, 0, 0); // Reset mutex to 0
     parameters._flags   = FUTEX_WAIT_PRIVATE | FUTEX_WAIT_OP;
-    parameters._timeout = 0;
+    parameters._timeout = (size_t)msec;
     
-    status = Syscall_FutexWait(&parameters);
+    if (mutex->flags & mtx_prio_inherit) {
+        status = __cnd_wait_pi(cond, mutex, (size_t)msec);
+    }
+    else {
+        status = Syscall_FutexWait(&parameters);
+    }
     mtx_lock(mutex);
 	if (status  == OsTimeout) {
 		return thrd_timedout;
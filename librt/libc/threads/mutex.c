@@ -31,10 +31,36 @@
 #include <time.h>
 
 #define MUTEX_SPINS     1000
+#define MUTEX_MIN_SPINS 10
 #define MUTEX_DESTROYED 0x1000
 
 static SystemDescriptor_t SystemInfo = { 0 };
 
+static size_t
+GetActiveCoreCount(void)
+{
+    const SystemPage_t* Page = GetSystemPage();
+    if (Page != NULL) {
+        return Page->NumberOfActiveCores;
+    }
+
+    if (SystemInfo.NumberOfActiveCores == 0) {
+        SystemQuery(&SystemInfo);
+    }
+    return SystemInfo.NumberOfActiveCores;
+}
+
+// Priority inheritance mutexes hold the id of the owner, so the kernel knows who to boost
+static inline int
+GetLockedValue(
+    _In_ mtx_t* mutex)
+{
+    if (mutex->flags & mtx_prio_inherit) {
+        return (int)(thrd_current() & FUTEX_PI_OWNER_MASK);
+    }
+    return 1;
+}
+
 int
 mtx_init(
     _In_ mtx_t* mutex,
@@ -44,15 +70,11 @@ mtx_init(
         return thrd_error;
     }
 
-    // Get information about the system
-    if (SystemInfo.NumberOfActiveCores == 0) {
-        SystemQuery(&SystemInfo);
-    }
-    
     mutex->flags = type;
     mutex->owner = UUID_INVALID;
     mutex->value = ATOMIC_VAR_INIT(0);
     mutex->references = ATOMIC_VAR_INIT(0);
+    mutex->spins = 0;
     smp_wmb();
     
     return thrd_success;
@@ -105,7 +127,7 @@ mtx_trylock(
         }
     }
     
-    status = atomic_compare_exchange_strong(&mutex->value, &z, 1);
+    status = atomic_compare_exchange_strong(&mutex->value, &z, GetLockedValue(mutex));
     if (status) {
         mutex->owner = thrd_current();
         atomic_store(&mutex->references, 1);
@@ -114,6 +136,74 @@ mtx_trylock(
     return thrd_busy;
 }
 
+/* __perform_spin
+ * Spins for the mutex before going to sleep. User space can't see whether the owner is
+ * running, so the number of spins adapts to how long it took to get the mutex the last
+ * times, and spinning stops as soon as there are sleepers, as the owner then unlocks
+ * through the kernel. */
+static int
+__perform_spin(
+    _In_ mtx_t* mutex)
+{
+    int status = thrd_busy;
+    int spins;
+    int limit;
+    int value;
+    int i;
+    
+    limit = MIN(MUTEX_SPINS, (mutex->spins * 2) + MUTEX_MIN_SPINS);
+    for (i = 0; i < limit; i++) {
+        value = atomic_load(&mutex->value);
+        if (value == 2 || ((mutex->flags & mtx_prio_inherit) && (value & FUTEX_PI_WAITERS))) {
+            break;
+        }
+        
+        if (value == 0 && mtx_trylock(mutex) == thrd_success) {
+            status = thrd_success;
+            break;
+        }
+    }
+    
+    // Racy on purpose, it's only an estimate
+    spins = mutex->spins;
+    mutex->spins = spins + ((i - spins) / 8);
+    return status;
+}
+
+static int
+__perform_pi_lock(
+    _In_ mtx_t* mutex,
+    _In_ size_t timeout)
+{
+    FutexParameters_t parameters;
+    OsStatus_t        status;
+    int               z = 0;
+    
+    if (!atomic_compare_exchange_strong(&mutex->value, &z, GetLockedValue(mutex))) {
+        // Spinning only makes sense while nobody is waiting in the kernel
+        if (GetActiveCoreCount() > 1 && !(z & FUTEX_PI_WAITERS) &&
+            __perform_spin(mutex) == thrd_success) {
+            return thrd_success;
+        }
+        
+        // The kernel hands us the mutex, or fails
+        parameters._futex0  = &mutex->value;
+        parameters._timeout = timeout;
+        parameters._flags   = FUTEX_WAIT_PRIVATE | FUTEX_WAIT_PI;
+        status = Syscall_FutexWait(&parameters);
+        if (status == OsTimeout) {
+            return thrd_timedout;
+        }
+        if (status != OsSuccess || (mutex->flags & MUTEX_DESTROYED)) {
+            return thrd_error;
+        }
+    }
+
+    mutex->owner = thrd_current();
+    atomic_store(&mutex->references, 1);
+    return thrd_success;
+}
+
 static int
 __perform_lock(
     _In_ mtx_t* mutex,
@@ -123,7 +213,6 @@ __perform_lock(
     int initialcount;
     int status;
     int z = 0;
-    int i;
     
     // If this thread already holds the mutex,
     // increase ref count, but only if we're recursive 
@@ -143,6 +232,10 @@ __perform_lock(
         }
     }
     
+    if (mutex->flags & mtx_prio_inherit) {
+        return __perform_pi_lock(mutex, timeout);
+    }
+    
     parameters._futex0  = &mutex->value;
     parameters._val0    = 2; // we always sleep on expecting a two
     parameters._timeout = timeout;
@@ -153,12 +246,8 @@ __perform_lock(
     // and only in the case that there are no sleepers && locked
     status = atomic_compare_exchange_strong(&mutex->value, &z, 1);
     if (!status) {
-        if (SystemInfo.NumberOfActiveCores > 1 && z == 1) {
-            for (i = 0; i < MUTEX_SPINS; i++) {
-                if (mtx_trylock(mutex) == thrd_success) {
-                    return thrd_success;
-                }
-            }
+        if (GetActiveCoreCount() > 1 && z == 1 && __perform_spin(mutex) == thrd_success) {
+            return thrd_success;
         }
         
         // Loop untill we get the lock
@@ -205,9 +294,13 @@ mtx_timedlock(
         return thrd_error;
     }
     
-    // Calculate time to sleep
+    // Calculate time to sleep, a timeout of 0 means forever to the kernel so a
+    // deadline that has already passed only gets to try the mutex
 	timespec_get(&now, TIME_UTC);
-    timespec_diff(time_point, &now, &result);
+    timespec_diff(&now, time_point, &result);
+    if (result.tv_sec < 0 || (result.tv_sec == 0 && result.tv_nsec == 0)) {
+        return mtx_trylock(mutex) == thrd_success ? thrd_success : thrd_timedout;
+    }
     msec = result.tv_sec * MSEC_PER_SEC;
     if (result.tv_nsec != 0) {
         msec += ((result.tv_nsec - 1) / NSEC_PER_MSEC) + 1;
@@ -232,7 +325,18 @@ mtx_unlock(
     }
     
     initialcount = atomic_fetch_sub(&mutex->references, 1);
-    if ((initialcount - 1) == 0) {
+    if ((initialcount - 1) == 0 && (mutex->flags & mtx_prio_inherit)) {
+        parameters._futex0  = &mutex->value;
+        parameters._flags   = FUTEX_WAKE_PRIVATE | FUTEX_WAKE_PI;
+        
+        // The kernel must hand the mutex over if anyone is waiting
+        mutex->owner = UUID_INVALID;
+        initialcount = GetLockedValue(mutex);
+        if (!atomic_compare_exchange_strong(&mutex->value, &initialcount, 0)) {
+            Syscall_FutexWake(&parameters);
+        }
+    }
+    else if ((initialcount - 1) == 0) {
         parameters._futex0  = &mutex->value;
         parameters._val0    = 1;
         parameters._flags   = FUTEX_WAKE_PRIVATE;
@@ -35,6 +35,7 @@
 #include <os/spinlock.h>
 #include <ds/collection.h>
 #include <ddk/utils.h>
+#include <internal/_syscalls.h>
 #include <threads.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -133,7 +134,16 @@ tls_destroy(
     if (Tls->transfer_buffer.buffer != NULL) {
         dma_detach(&Tls->transfer_buffer);
         free(Tls->transfer_buffer.buffer);
+        Tls->transfer_buffer.buffer = NULL;
     }
+    if (Tls->syscall_batch != NULL) {
+        Syscall_SyscallBatchRegister(NULL);
+        MemoryFree(Tls->syscall_batch, SYSCALL_BATCH_SIZE);
+        Tls->syscall_batch = NULL;
+    }
+#ifdef __OSCONFIG_MALLOC_THREAD_CACHE
+    malloc_thread_detach(Tls);
+#endif
     return OsSuccess;
 }
 
@@ -43,6 +43,8 @@ PACKED_TYPESTRUCT(thread_storage, {
     struct tm             tm_buffer;
     char                  asc_buffer[26];
     struct dma_attachment transfer_buffer;
+    void*                 malloc_cache;
+    void*                 syscall_batch;
     uintptr_t             tls_array[TLS_NUMBER_ENTRIES];
 });
 
@@ -65,6 +67,13 @@ CRTDECL(OsStatus_t, tls_destroy(thread_storage_t *Tls));
  * by freeing resources and calling c11 destructors. */
 CRTDECL(void, tls_cleanup(thrd_t thr, void* DsoHandle, int ExitCode));
 CRTDECL(void, tls_cleanup_quick(thrd_t thr, void* DsoHandle, int ExitCode));
+
+#ifdef __OSCONFIG_MALLOC_THREAD_CACHE
+/* malloc_thread_detach
+ * Hands the allocator caches of the thread back to the process. Part of the
+ * thread cleanup, must be the last allocator call made by the thread storage. */
+CRTDECL(void, malloc_thread_detach(thread_storage_t *Tls));
+#endif
 _CODE_END
 
 #endif //!__STDC_TLS__
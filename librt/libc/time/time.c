@@ -28,9 +28,19 @@
 
 time_t time(time_t* Timer)
 {
-    SystemTime_t SystemTime = { { { 0 } } };
-	struct tm    Temporary  = { 0 };
-	time_t       Result     = 0;
+    SystemPageTime_t PageTime;
+    SystemTime_t     SystemTime = { { { 0 } } };
+	struct tm        Temporary  = { 0 };
+	time_t           Result     = 0;
+
+    // The system page already has the time in seconds since the epoch
+    if (GetSystemPageTime(&PageTime) == OsSuccess) {
+        Result = (time_t)PageTime.EpochSeconds;
+        if (Timer != NULL) {
+            *Timer = Result;
+        }
+        return Result;
+    }
 
     // Retrieve structure in our format, convert and mktime
 	if (GetSystemTime(&SystemTime) == OsSuccess) {
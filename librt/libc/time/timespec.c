@@ -30,9 +30,10 @@ timespec_get(
     _In_ struct timespec* ts,
     _In_ int              base)
 {
-    SystemTime_t    SystemTime = { { { 0 } } };
-	struct tm       Temporary  = { 0 };
-    LargeUInteger_t Tick       = { { 0 } };
+    SystemPageTime_t PageTime;
+    SystemTime_t     SystemTime = { { { 0 } } };
+	struct tm        Temporary  = { 0 };
+    LargeUInteger_t  Tick       = { { 0 } };
 
     if (ts == NULL) {
         return -1;
@@ -40,8 +41,14 @@ timespec_get(
 
     // Update based on type
     switch (base) {
-        case TIME_TAI:
         case TIME_UTC: {
+            if (GetSystemPageTime(&PageTime) == OsSuccess) {
+                ts->tv_sec  = (time_t)PageTime.EpochSeconds;
+                ts->tv_nsec = (long)PageTime.Time.Nanoseconds.QuadPart;
+                break;
+            }
+        } // Fall-through to the system call when there is no system page
+        case TIME_TAI: {
             if (GetSystemTime(&SystemTime) == OsSuccess) {
                 if (base == TIME_UTC) {
                     Temporary.tm_sec  = SystemTime.Second;
@@ -63,7 +70,13 @@ timespec_get(
                 return -1;
             }
         } break;
-        case TIME_MONOTONIC:
+        case TIME_MONOTONIC: {
+            if (GetSystemPageTime(&PageTime) == OsSuccess) {
+                ts->tv_sec  = (time_t)(PageTime.MonotonicNs / NSEC_PER_SEC);
+                ts->tv_nsec = (long)(PageTime.MonotonicNs % NSEC_PER_SEC);
+                break;
+            }
+        } // Fall-through to the system call when there is no system page
         case TIME_PROCESS:
         case TIME_THREAD: {
             GetSystemTick(base, &Tick);
@@ -0,0 +1,415 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Block Queue Support
+ * - Implementation of the per-device block request queue that sits between file
+ *   systems and storage drivers. Pending requests are kept sorted by sector, merged
+ *   with their neighbours and dispatched by a pool of threads.
+ */
+//#define __TRACE
+
+#include <ddk/blockqueue.h>
+#include <ddk/utils.h>
+#include <internal/_ipc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+typedef struct BlockWaiter {
+    cnd_t      Signal;
+    int        Outstanding;
+    OsStatus_t Status;
+} BlockWaiter_t;
+
+typedef struct BlockQueueEntry {
+    struct BlockQueueEntry* Link;
+    BlockRequest_t*         Request;
+    BlockWaiter_t*          Waiter;
+    clock_t                 Submitted;
+    clock_t                 Deadline;
+} BlockQueueEntry_t;
+
+typedef struct BlockQueue {
+    UUId_t                 Driver;
+    UUId_t                 Device;
+    size_t                 SectorSize;
+    size_t                 MaxSectors;
+    int                    Depth;
+
+    mtx_t                  Lock;
+    cnd_t                  HasWork;
+    int                    IsRunning;
+    BlockQueueEntry_t*     Pending;    // Sorted by sector
+    uint64_t               HeadPosition;
+    int                    InFlight;
+    thrd_t*                Dispatchers;
+    clock_t                Created;
+    BlockQueueStatistics_t Statistics;
+} BlockQueue_t;
+
+static int BlockQueueDispatcher(void* Context);
+
+OsStatus_t
+BlockQueueCreate(
+    _In_  UUId_t         Driver,
+    _In_  UUId_t         Device,
+    _In_  size_t         SectorSize,
+    _In_  int            Depth,
+    _In_  size_t         MaxSectors,
+    _Out_ BlockQueue_t** QueueOut)
+{
+    BlockQueue_t* Queue;
+    int           i;
+
+    if (!SectorSize || !QueueOut) {
+        return OsInvalidParameters;
+    }
+
+    Queue = (BlockQueue_t*)malloc(sizeof(BlockQueue_t));
+    if (!Queue) {
+        return OsOutOfMemory;
+    }
+    memset(Queue, 0, sizeof(BlockQueue_t));
+
+    Queue->Driver     = Driver;
+    Queue->Device     = Device;
+    Queue->SectorSize = SectorSize;
+    Queue->Depth      = Depth > 0 ? Depth : BLOCKQUEUE_DEFAULT_DEPTH;
+    Queue->MaxSectors = MaxSectors ? MaxSectors : BLOCKQUEUE_DEFAULT_MAXSECTORS;
+    Queue->IsRunning  = 1;
+    Queue->Created    = clock();
+    mtx_init(&Queue->Lock, mtx_plain);
+    cnd_init(&Queue->HasWork);
+
+    Queue->Dispatchers = (thrd_t*)malloc(sizeof(thrd_t) * Queue->Depth);
+    if (!Queue->Dispatchers) {
+        cnd_destroy(&Queue->HasWork);
+        mtx_destroy(&Queue->Lock);
+        free(Queue);
+        return OsOutOfMemory;
+    }
+
+    for (i = 0; i < Queue->Depth; i++) {
+        if (thrd_create(&Queue->Dispatchers[i], BlockQueueDispatcher, Queue) != thrd_success) {
+            ERROR("[blockqueue] failed to spawn dispatcher %i", i);
+            Queue->Depth = i;
+            break;
+        }
+    }
+
+    if (!Queue->Depth) {
+        BlockQueueDestroy(Queue);
+        return OsError;
+    }
+
+    *QueueOut = Queue;
+    return OsSuccess;
+}
+
+void
+BlockQueueDestroy(
+    _In_ BlockQueue_t* Queue)
+{
+    int Unused;
+    int i;
+
+    if (!Queue) {
+        return;
+    }
+
+    mtx_lock(&Queue->Lock);
+    Queue->IsRunning = 0;
+    cnd_broadcast(&Queue->HasWork);
+    mtx_unlock(&Queue->Lock);
+
+    // Dispatchers drain the pending list before exitting
+    for (i = 0; i < Queue->Depth; i++) {
+        thrd_join(Queue->Dispatchers[i], &Unused);
+    }
+
+    cnd_destroy(&Queue->HasWork);
+    mtx_destroy(&Queue->Lock);
+    free(Queue->Dispatchers);
+    free(Queue);
+}
+
+static void
+InsertSorted(
+    _In_ BlockQueue_t*      Queue,
+    _In_ BlockQueueEntry_t* Entry)
+{
+    BlockQueueEntry_t** Slot = &Queue->Pending;
+    while (*Slot && (*Slot)->Request->Sector <= Entry->Request->Sector) {
+        Slot = &(*Slot)->Link;
+    }
+    Entry->Link = *Slot;
+    *Slot       = Entry;
+}
+
+static int
+CanMerge(
+    _In_ BlockQueue_t*      Queue,
+    _In_ BlockQueueEntry_t* Tail,
+    _In_ BlockQueueEntry_t* Next,
+    _In_ size_t             SectorCount)
+{
+    BlockRequest_t* Current = Tail->Request;
+    BlockRequest_t* Request = Next->Request;
+
+    return Current->Direction    == Request->Direction &&
+           Current->BufferHandle == Request->BufferHandle &&
+           (Current->Sector + Current->SectorCount) == Request->Sector &&
+           (Current->BufferOffset + (Current->SectorCount * Queue->SectorSize)) == Request->BufferOffset &&
+           (SectorCount + Request->SectorCount) <= Queue->MaxSectors;
+}
+
+/* SelectNext
+ * Picks the next request to dispatch. Requests that have passed their deadline
+ * are served first, otherwise we sweep upwards from the last dispatched position (C-LOOK). */
+static BlockQueueEntry_t**
+SelectNext(
+    _In_ BlockQueue_t* Queue)
+{
+    BlockQueueEntry_t** Expired = NULL;
+    BlockQueueEntry_t** Forward = NULL;
+    BlockQueueEntry_t** Slot    = &Queue->Pending;
+    clock_t             Now     = clock();
+
+    while (*Slot) {
+        BlockQueueEntry_t* Entry = *Slot;
+        if (Entry->Deadline <= Now && (!Expired || Entry->Deadline < (*Expired)->Deadline)) {
+            Expired = Slot;
+        }
+        if (!Forward && Entry->Request->Sector >= Queue->HeadPosition) {
+            Forward = Slot;
+        }
+        Slot = &Entry->Link;
+    }
+
+    if (Expired) {
+        Queue->Statistics.DeadlineDispatches++;
+        return Expired;
+    }
+    return Forward ? Forward : &Queue->Pending;
+}
+
+static void
+CompleteEntries(
+    _In_ BlockQueue_t*      Queue,
+    _In_ BlockQueueEntry_t* Entries,
+    _In_ OsStatus_t         Status,
+    _In_ size_t             SectorsTransferred)
+{
+    clock_t Now = clock();
+
+    while (Entries) {
+        BlockQueueEntry_t* Next    = Entries->Link;
+        BlockRequest_t*    Request = Entries->Request;
+        size_t             Latency = (size_t)(Now - Entries->Submitted);
+
+        // Distribute the transferred sectors in order over the merged requests, any request
+        // that did not fully complete will report the error status
+        Request->SectorsTransferred = MIN(Request->SectorCount, SectorsTransferred);
+        SectorsTransferred         -= Request->SectorsTransferred;
+        Request->Status             = OsSuccess;
+        if (Request->SectorsTransferred != Request->SectorCount) {
+            Request->Status = (Status == OsSuccess) ? OsIncomplete : Status;
+        }
+
+        if (Request->Status != OsSuccess) {
+            Queue->Statistics.Errors++;
+            if (Entries->Waiter->Status == OsSuccess) {
+                Entries->Waiter->Status = Request->Status;
+            }
+        }
+
+        Queue->Statistics.RequestsCompleted++;
+        Queue->Statistics.TotalLatencyMs += Latency;
+        Queue->Statistics.MaxLatencyMs    = MAX(Queue->Statistics.MaxLatencyMs, Latency);
+
+        if (!(--Entries->Waiter->Outstanding)) {
+            cnd_broadcast(&Entries->Waiter->Signal);
+        }
+        Entries = Next;
+    }
+}
+
+static int
+BlockQueueDispatcher(
+    _In_ void* Context)
+{
+    BlockQueue_t* Queue = (BlockQueue_t*)Context;
+
+    mtx_lock(&Queue->Lock);
+    while (Queue->IsRunning || Queue->Pending) {
+        struct vali_link_message msg = VALI_MSG_INIT_HANDLE(Queue->Driver);
+        BlockQueueEntry_t**      Slot;
+        BlockQueueEntry_t*       First;
+        BlockQueueEntry_t*       Tail;
+        BlockRequest_t           Transfer;
+        OsStatus_t               Status;
+        size_t                   SectorsTransferred = 0;
+
+        if (!Queue->Pending) {
+            cnd_wait(&Queue->HasWork, &Queue->Lock);
+            continue;
+        }
+
+        // Build the transfer from the selected request and all that directly follow it
+        Slot  = SelectNext(Queue);
+        First = *Slot;
+        Tail  = First;
+        memcpy(&Transfer, First->Request, sizeof(BlockRequest_t));
+        while (Tail->Link && CanMerge(Queue, Tail, Tail->Link, Transfer.SectorCount)) {
+            Tail                  = Tail->Link;
+            Transfer.SectorCount += Tail->Request->SectorCount;
+            Queue->Statistics.RequestsMerged++;
+        }
+        *Slot      = Tail->Link;
+        Tail->Link = NULL;
+
+        Queue->HeadPosition = Transfer.Sector + Transfer.SectorCount;
+        Queue->InFlight++;
+        Queue->Statistics.Dispatches++;
+        Queue->Statistics.MaxInFlight = MAX(Queue->Statistics.MaxInFlight, Queue->InFlight);
+        mtx_unlock(&Queue->Lock);
+
+        TRACE("[blockqueue] dispatch %u, %u sectors", LODWORD(Transfer.Sector), Transfer.SectorCount);
+        ctt_storage_transfer(GetGrachtClient(), &msg, Queue->Device, Transfer.Direction,
+            LODWORD(Transfer.Sector), HIDWORD(Transfer.Sector), Transfer.BufferHandle,
+            Transfer.BufferOffset, Transfer.SectorCount, &Status, &SectorsTransferred);
+        gracht_vali_message_finish(&msg);
+
+        mtx_lock(&Queue->Lock);
+        Queue->InFlight--;
+        if (Transfer.Direction == __STORAGE_OPERATION_READ) {
+            Queue->Statistics.SectorsRead += SectorsTransferred;
+        }
+        else {
+            Queue->Statistics.SectorsWritten += SectorsTransferred;
+        }
+        CompleteEntries(Queue, First, Status, SectorsTransferred);
+    }
+    mtx_unlock(&Queue->Lock);
+    return 0;
+}
+
+OsStatus_t
+BlockQueueTransferBatch(
+    _In_ BlockQueue_t*   Queue,
+    _In_ BlockRequest_t* Requests,
+    _In_ int             Count)
+{
+    BlockQueueEntry_t* Entries;
+    BlockWaiter_t      Waiter;
+    clock_t            Now;
+    int                i;
+
+    if (!Queue || !Requests || Count <= 0) {
+        return OsInvalidParameters;
+    }
+
+    Entries = (BlockQueueEntry_t*)malloc(sizeof(BlockQueueEntry_t) * Count);
+    if (!Entries) {
+        return OsOutOfMemory;
+    }
+
+    cnd_init(&Waiter.Signal);
+    Waiter.Outstanding = Count;
+    Waiter.Status      = OsSuccess;
+    Now                = clock();
+
+    mtx_lock(&Queue->Lock);
+    if (!Queue->IsRunning) {
+        mtx_unlock(&Queue->Lock);
+        cnd_destroy(&Waiter.Signal);
+        free(Entries);
+        return OsError;
+    }
+
+    for (i = 0; i < Count; i++) {
+        Entries[i].Request   = &Requests[i];
+        Entries[i].Waiter    = &Waiter;
+        Entries[i].Submitted = Now;
+        Entries[i].Deadline  = Now + ((Requests[i].Direction == __STORAGE_OPERATION_READ) ?
+            BLOCKQUEUE_READ_DEADLINE : BLOCKQUEUE_WRITE_DEADLINE);
+        InsertSorted(Queue, &Entries[i]);
+    }
+    Queue->Statistics.RequestsSubmitted += Count;
+
+    if (Count == 1) {
+        cnd_signal(&Queue->HasWork);
+    }
+    else {
+        cnd_broadcast(&Queue->HasWork);
+    }
+
+    while (Waiter.Outstanding) {
+        cnd_wait(&Waiter.Signal, &Queue->Lock);
+    }
+    mtx_unlock(&Queue->Lock);
+
+    cnd_destroy(&Waiter.Signal);
+    free(Entries);
+    return Waiter.Status;
+}
+
+OsStatus_t
+BlockQueueTransfer(
+    _In_  BlockQueue_t* Queue,
+    _In_  int           Direction,
+    _In_  uint64_t      Sector,
+    _In_  UUId_t        BufferHandle,
+    _In_  size_t        BufferOffset,
+    _In_  size_t        SectorCount,
+    _Out_ size_t*       SectorsTransferred)
+{
+    BlockRequest_t Request;
+    OsStatus_t     Status;
+
+    Request.Direction          = Direction;
+    Request.Sector             = Sector;
+    Request.BufferHandle       = BufferHandle;
+    Request.BufferOffset       = BufferOffset;
+    Request.SectorCount        = SectorCount;
+    Request.Status             = OsSuccess;
+    Request.SectorsTransferred = 0;
+
+    Status = BlockQueueTransferBatch(Queue, &Request, 1);
+    if (SectorsTransferred) {
+        *SectorsTransferred = Request.SectorsTransferred;
+    }
+    return Status;
+}
+
+void
+BlockQueueGetStatistics(
+    _In_  BlockQueue_t*           Queue,
+    _Out_ BlockQueueStatistics_t* Statistics)
+{
+    if (!Queue || !Statistics) {
+        return;
+    }
+
+    mtx_lock(&Queue->Lock);
+    memcpy(Statistics, &Queue->Statistics, sizeof(BlockQueueStatistics_t));
+    mtx_unlock(&Queue->Lock);
+    Statistics->ElapsedMs = (size_t)(clock() - Queue->Created);
+}
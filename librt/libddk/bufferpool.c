@@ -19,6 +19,8 @@
  * BufferPool Support Definitions & Structures
  * - This header describes the base bufferpool-structures, prototypes
  *   and functionality, refer to the individual things for descriptions
+ * - Small allocations are served from slabs of fixed-size objects. Queues can
+ *   keep a cache of free objects to avoid taking the pool lock.
  */
 //#define __TRACE
 
@@ -27,11 +29,44 @@
 #include <ddk/utils.h>
 #include <os/dmabuf.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define DMA_POOL_CLASS_COUNT 5 // 32, 64, 128, 256, 512
+#define DMA_POOL_SLAB_ALIGN  32
+
+struct dma_slab {
+    struct dma_slab*       link;
+    void*                  allocation;
+    uint8_t*               base;
+    int                    class_index;
+    int                    object_count;
+    int                    free_count;
+    void*                  free_objects;
+};
+
+struct dma_slab_block {
+    uint8_t*         base;
+    struct dma_slab* slab;
+};
 
 struct dma_pool {
     struct bytepool*       pool;
     struct dma_attachment* attachment;
     struct dma_sg_table    table;
+    mtx_t                  lock;
+    struct dma_slab*       classes[DMA_POOL_CLASS_COUNT];
+    
+    // The slab that starts in each DMA_POOL_SLAB_SIZE block of the buffer, a slab
+    // spans at most two blocks. Entries only change while the slab is unused.
+    struct dma_slab_block* slab_map;
+    size_t                 slab_map_count;
+};
+
+struct dma_pool_cache {
+    struct dma_pool* pool;
+    int              counts[DMA_POOL_CLASS_COUNT];
+    void*            objects[DMA_POOL_CLASS_COUNT][DMA_POOL_CACHE_SIZE];
 };
 
 OsStatus_t
@@ -46,8 +81,20 @@ dma_pool_create(
         return OsInvalidParameters;
     }
     
-    pool             = (struct dma_pool*)malloc(sizeof(struct dma_pool));
-    pool->attachment = attachment;
+    pool = (struct dma_pool*)malloc(sizeof(struct dma_pool));
+    if (!pool) {
+        return OsOutOfMemory;
+    }
+    
+    memset(pool, 0, sizeof(struct dma_pool));
+    pool->attachment     = attachment;
+    pool->slab_map_count = DIVUP(attachment->length, DMA_POOL_SLAB_SIZE);
+    pool->slab_map       = (struct dma_slab_block*)calloc(pool->slab_map_count, sizeof(struct dma_slab_block));
+    if (!pool->slab_map) {
+        free(pool);
+        return OsOutOfMemory;
+    }
+    mtx_init(&pool->lock, mtx_plain);
     
     status = dma_get_sg_table(attachment, &pool->table, -1);
     status = bpool(attachment->buffer, attachment->length, &pool->pool);
@@ -60,22 +107,181 @@ OsStatus_t
 dma_pool_destroy(
     _In_ struct dma_pool* pool)
 {
+    for (int i = 0; i < DMA_POOL_CLASS_COUNT; i++) {
+        struct dma_slab* slab = pool->classes[i];
+        while (slab) {
+            struct dma_slab* next = slab->link;
+            free(slab);
+            slab = next;
+        }
+    }
+    
+    mtx_destroy(&pool->lock);
+    free(pool->slab_map);
     free(pool->table.entries);
     free(pool->pool);
     free(pool);
     return OsSuccess;
 }
 
-static uintptr_t
-dma_pool_get_dma(
+static int
+dma_pool_class(
+    _In_ size_t length)
+{
+    int class_index = 0;
+    
+    if (length > DMA_POOL_SLAB_MAX) {
+        return -1;
+    }
+    
+    while ((DMA_POOL_SLAB_MIN << class_index) < length) {
+        class_index++;
+    }
+    return class_index;
+}
+
+/* dma_pool_find_slab
+ * Finds the slab an allocated object belongs to. The map entry of a slab is only
+ * modified while none of its objects are allocated, and the entries of other slabs
+ * never cover the address, so this is safe without the lock. */
+static struct dma_slab*
+dma_pool_find_slab(
+    _In_ struct dma_pool* pool,
+    _In_ void*            address)
+{
+    size_t offset = (uintptr_t)address - (uintptr_t)pool->attachment->buffer;
+    size_t block  = offset / DMA_POOL_SLAB_SIZE;
+    
+    if ((uintptr_t)address < (uintptr_t)pool->attachment->buffer || block >= pool->slab_map_count) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < 2 && block >= (size_t)i; i++) {
+        struct dma_slab_block* entry = &pool->slab_map[block - i];
+        if (entry->base && (uint8_t*)address >= entry->base &&
+            (uint8_t*)address < (entry->base + DMA_POOL_SLAB_SIZE)) {
+            return entry->slab;
+        }
+    }
+    return NULL;
+}
+
+static struct dma_slab*
+dma_pool_create_slab(
+    _In_ struct dma_pool* pool,
+    _In_ int              class_index)
+{
+    size_t           object_size  = (size_t)DMA_POOL_SLAB_MIN << class_index;
+    int              object_count = DMA_POOL_SLAB_SIZE / object_size;
+    struct dma_slab* slab;
+    size_t           offset;
+    
+    slab = (struct dma_slab*)malloc(sizeof(struct dma_slab));
+    if (!slab) {
+        return NULL;
+    }
+    
+    slab->allocation = bget(pool->pool, DMA_POOL_SLAB_SIZE + DMA_POOL_SLAB_ALIGN);
+    if (!slab->allocation) {
+        free(slab);
+        return NULL;
+    }
+    
+    slab->base         = (uint8_t*)(((uintptr_t)slab->allocation + (DMA_POOL_SLAB_ALIGN - 1)) & ~(uintptr_t)(DMA_POOL_SLAB_ALIGN - 1));
+    slab->class_index  = class_index;
+    slab->object_count = object_count;
+    slab->free_count   = object_count;
+    slab->free_objects = NULL;
+    
+    // Chain all objects in the free list
+    offset = (uintptr_t)slab->base - (uintptr_t)pool->attachment->buffer;
+    for (int i = object_count - 1; i >= 0; i--) {
+        void* object = slab->base + (i * object_size);
+        *((void**)object)  = slab->free_objects;
+        slab->free_objects = object;
+    }
+    
+    pool->slab_map[offset / DMA_POOL_SLAB_SIZE].slab = slab;
+    pool->slab_map[offset / DMA_POOL_SLAB_SIZE].base = slab->base;
+    slab->link                 = pool->classes[class_index];
+    pool->classes[class_index] = slab;
+    return slab;
+}
+
+/* dma_pool_release_slab
+ * Returns an unused slab to the byte pool, the last slab of a class is kept
+ * to avoid creating and destroying it repeatedly. */
+static void
+dma_pool_release_slab(
+    _In_ struct dma_pool* pool,
+    _In_ struct dma_slab* slab)
+{
+    struct dma_slab** iter = &pool->classes[slab->class_index];
+    size_t            offset;
+    
+    if (*iter == slab && !slab->link) {
+        return;
+    }
+    
+    while (*iter != slab) {
+        iter = &(*iter)->link;
+    }
+    *iter = slab->link;
+    
+    offset = (uintptr_t)slab->base - (uintptr_t)pool->attachment->buffer;
+    pool->slab_map[offset / DMA_POOL_SLAB_SIZE].base = NULL;
+    pool->slab_map[offset / DMA_POOL_SLAB_SIZE].slab = NULL;
+    brel(pool->pool, slab->allocation);
+    free(slab);
+}
+
+/* dma_pool_take_objects
+ * Takes up to count free objects of a class, must be called with the lock held. */
+static int
+dma_pool_take_objects(
+    _In_ struct dma_pool* pool,
+    _In_ int              class_index,
+    _In_ void**           objects,
+    _In_ int              count)
+{
+    struct dma_slab* slab  = pool->classes[class_index];
+    int              taken = 0;
+    
+    while (taken < count) {
+        while (slab && !slab->free_count) {
+            slab = slab->link;
+        }
+        
+        if (!slab) {
+            slab = dma_pool_create_slab(pool, class_index);
+            if (!slab) {
+                break;
+            }
+        }
+        
+        while (taken < count && slab->free_count) {
+            void* object = slab->free_objects;
+            slab->free_objects = *((void**)object);
+            slab->free_count--;
+            objects[taken++] = object;
+        }
+    }
+    return taken;
+}
+
+/* dma_pool_return_object
+ * Returns an object to its slab, must be called with the lock held. */
+static void
+dma_pool_return_object(
     _In_ struct dma_pool* pool,
-    _In_ size_t           offset)
+    _In_ struct dma_slab* slab,
+    _In_ void*            object)
 {
-    int        entry_index;
-    size_t     sg_offset;
-    OsStatus_t status = dma_sg_table_offset(
-        &pool->table, offset, &entry_index, &sg_offset);
-    return status != OsSuccess ? 0 : pool->table.entries[entry_index].address + sg_offset;
+    *((void**)object)  = slab->free_objects;
+    slab->free_objects = object;
+    if (++slab->free_count == slab->object_count) {
+        dma_pool_release_slab(pool, slab);
+    }
 }
 
 OsStatus_t
@@ -84,18 +290,27 @@ dma_pool_allocate(
     _In_  size_t           length,
     _Out_ void**           address_out)
 {
-    void* allocation;
+    void* allocation  = NULL;
+    int   class_index = dma_pool_class(length);
 
     TRACE("dma_pool_allocate(Size %u)", length);
 
-    allocation = bget(pool->pool, length);
+    mtx_lock(&pool->lock);
+    if (class_index >= 0) {
+        (void)dma_pool_take_objects(pool, class_index, &allocation, 1);
+    }
+    else {
+        allocation = bget(pool->pool, length);
+    }
+    mtx_unlock(&pool->lock);
+    
     if (!allocation) {
         ERROR("Failed to allocate bufferpool memory (size %u)", length);
         return OsOutOfMemory;
     }
     
     *address_out = allocation;
-    TRACE(" > Virtual address 0x%x => Physical address 0x%x", allocation, *dma_address_out);
+    TRACE(" > Virtual address 0x%x", allocation);
     return OsSuccess;
 }
 
@@ -104,7 +319,16 @@ dma_pool_free(
     _In_ struct dma_pool* pool,
     _In_ void*            address)
 {
-    brel(pool->pool, address);
+    struct dma_slab* slab = dma_pool_find_slab(pool, address);
+    
+    mtx_lock(&pool->lock);
+    if (slab) {
+        dma_pool_return_object(pool, slab, address);
+    }
+    else {
+        brel(pool->pool, address);
+    }
+    mtx_unlock(&pool->lock);
     return OsSuccess;
 }
 
@@ -128,3 +352,113 @@ dma_pool_offset(
     }
     return (uintptr_t)address - (uintptr_t)pool->attachment->buffer;
 }
+
+OsStatus_t
+dma_pool_cache_create(
+    _In_  struct dma_pool*        pool,
+    _Out_ struct dma_pool_cache** cache_out)
+{
+    struct dma_pool_cache* cache;
+    
+    if (!pool || !cache_out) {
+        return OsInvalidParameters;
+    }
+    
+    cache = (struct dma_pool_cache*)malloc(sizeof(struct dma_pool_cache));
+    if (!cache) {
+        return OsOutOfMemory;
+    }
+    
+    memset(cache, 0, sizeof(struct dma_pool_cache));
+    cache->pool = pool;
+    *cache_out  = cache;
+    return OsSuccess;
+}
+
+void
+dma_pool_cache_destroy(
+    _In_ struct dma_pool_cache* cache)
+{
+    if (!cache) {
+        return;
+    }
+    
+    mtx_lock(&cache->pool->lock);
+    for (int i = 0; i < DMA_POOL_CLASS_COUNT; i++) {
+        for (int j = 0; j < cache->counts[i]; j++) {
+            dma_pool_return_object(cache->pool, dma_pool_find_slab(cache->pool, cache->objects[i][j]),
+                cache->objects[i][j]);
+        }
+    }
+    mtx_unlock(&cache->pool->lock);
+    free(cache);
+}
+
+OsStatus_t
+dma_pool_cache_allocate(
+    _In_  struct dma_pool_cache* cache,
+    _In_  size_t                 length,
+    _Out_ void**                 address_out)
+{
+    int class_index = dma_pool_class(length);
+    
+    if (!cache || !address_out) {
+        return OsInvalidParameters;
+    }
+    
+    if (class_index < 0) {
+        return dma_pool_allocate(cache->pool, length, address_out);
+    }
+    
+    // Refill half the cache at the time, so alternating allocations and frees
+    // do not go to the pool every time
+    if (!cache->counts[class_index]) {
+        mtx_lock(&cache->pool->lock);
+        cache->counts[class_index] = dma_pool_take_objects(cache->pool, class_index,
+            &cache->objects[class_index][0], DMA_POOL_CACHE_SIZE / 2);
+        mtx_unlock(&cache->pool->lock);
+        if (!cache->counts[class_index]) {
+            ERROR("Failed to allocate bufferpool memory (size %u)", length);
+            return OsOutOfMemory;
+        }
+    }
+    
+    *address_out = cache->objects[class_index][--cache->counts[class_index]];
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_pool_cache_free(
+    _In_ struct dma_pool_cache* cache,
+    _In_ void*                  address)
+{
+    struct dma_slab* slab;
+    int              class_index;
+    
+    if (!cache || !address) {
+        return OsInvalidParameters;
+    }
+    
+    slab = dma_pool_find_slab(cache->pool, address);
+    if (!slab) {
+        return dma_pool_free(cache->pool, address);
+    }
+    
+    // Flush the oldest half of the cache when it is full
+    class_index = slab->class_index;
+    if (cache->counts[class_index] == DMA_POOL_CACHE_SIZE) {
+        void** objects = &cache->objects[class_index][0];
+        
+        mtx_lock(&cache->pool->lock);
+        for (int i = 0; i < DMA_POOL_CACHE_SIZE / 2; i++) {
+            dma_pool_return_object(cache->pool, dma_pool_find_slab(cache->pool, objects[i]), objects[i]);
+        }
+        mtx_unlock(&cache->pool->lock);
+        
+        memmove(&objects[0], &objects[DMA_POOL_CACHE_SIZE / 2], sizeof(void*) * (DMA_POOL_CACHE_SIZE / 2));
+        cache->counts[class_index] = DMA_POOL_CACHE_SIZE / 2;
+    }
+    
+    cache->objects[class_index][cache->counts[class_index]++] = address;
+    return OsSuccess;
+}
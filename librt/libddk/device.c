@@ -25,6 +25,34 @@
 #include <ddk/device.h>
 #include <internal/_ipc.h>
 
+// Registers of the MSI and MSI-X capabilities, relative to the capability
+#define MSI_CONTROL                 0x02
+#define MSI_ADDRESS                 0x04
+#define MSI_DATA_32                 0x08
+#define MSI_DATA_64                 0x0C
+#define MSI_CONTROL_ENABLE          0x0001
+#define MSI_CONTROL_MME_MASK        0x0070
+#define MSIX_CONTROL_ENABLE         0x8000
+#define MSIX_CONTROL_FUNCTION_MASK  0x4000
+
+// Vector table entries of MSI-X
+#define MSIX_ENTRY_SIZE             16
+#define MSIX_ENTRY_ADDRESS_LO       0x00
+#define MSIX_ENTRY_ADDRESS_HI       0x04
+#define MSIX_ENTRY_DATA             0x08
+#define MSIX_ENTRY_CONTROL          0x0C
+#define MSIX_ENTRY_MASKED           0x1
+
+static OsStatus_t
+WriteDeviceConfig(
+    _In_ MCoreDevice_t* Device,
+    _In_ unsigned int   Register,
+    _In_ size_t         Value,
+    _In_ size_t         Width)
+{
+    return IoctlDeviceEx(Device->Id, __DEVICEMANAGER_IOCTL_EXT_WRITE, Register, &Value, Width);
+}
+
 UUId_t
 RegisterDevice(
     _In_ UUId_t         Parent,
@@ -77,3 +105,87 @@ IoctlDeviceEx(
         *Value, Width, &status, Value);
     return status;
 }
+
+OsStatus_t
+EnableDeviceMsi(
+    _In_ MCoreDevice_t*     Device,
+    _In_ int                Vector,
+    _In_ DeviceInterrupt_t* Interrupt)
+{
+    DeviceMsiCapability_t* Msi = &Device->Interrupt.Msi;
+    DeviceIo_t*            Table;
+    size_t                 Entry;
+    size_t                 Control = 0;
+    OsStatus_t             Status;
+
+    if (Vector < 0 || Vector >= Msi->Vectors || Interrupt->MsiAddress == 0) {
+        return OsInvalidParameters;
+    }
+
+    Status = IoctlDeviceEx(Device->Id, __DEVICEMANAGER_IOCTL_EXT_READ,
+        Msi->Offset + MSI_CONTROL, &Control, 2);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    if (Msi->Type == INTERRUPT_MSI_CAPABILITY_MSI) {
+        // The bus only hands out a single message, which is the one that follows
+        // the message data without any of the multiple message bits set
+        Status = WriteDeviceConfig(Device, Msi->Offset + MSI_ADDRESS, Interrupt->MsiAddress, 4);
+        if (Status == OsSuccess && Msi->Is64Bit) {
+            Status = WriteDeviceConfig(Device, Msi->Offset + MSI_ADDRESS + 4, 0, 4);
+        }
+        if (Status == OsSuccess) {
+            Status = WriteDeviceConfig(Device, Msi->Offset + (Msi->Is64Bit ? MSI_DATA_64 : MSI_DATA_32),
+                Interrupt->MsiValue & 0xFFFF, 2);
+        }
+        Control &= ~MSI_CONTROL_MME_MASK;
+        Control |= MSI_CONTROL_ENABLE;
+    }
+    else if (Msi->Type == INTERRUPT_MSI_CAPABILITY_MSIX) {
+        if (Msi->TableIoSpace < 0 || Msi->TableIoSpace >= __DEVICEMANAGER_MAX_IOSPACES) {
+            return OsInvalidParameters;
+        }
+
+        // Entries are masked until they are programmed
+        Table = &Device->IoSpaces[Msi->TableIoSpace];
+        Entry = Msi->TableOffset + ((size_t)Vector * MSIX_ENTRY_SIZE);
+        WriteDeviceIo(Table, Entry + MSIX_ENTRY_CONTROL, MSIX_ENTRY_MASKED, 4);
+        WriteDeviceIo(Table, Entry + MSIX_ENTRY_ADDRESS_LO, Interrupt->MsiAddress, 4);
+        WriteDeviceIo(Table, Entry + MSIX_ENTRY_ADDRESS_HI, 0, 4);
+        WriteDeviceIo(Table, Entry + MSIX_ENTRY_DATA, Interrupt->MsiValue, 4);
+        WriteDeviceIo(Table, Entry + MSIX_ENTRY_CONTROL, 0, 4);
+        Control &= ~MSIX_CONTROL_FUNCTION_MASK;
+        Control |= MSIX_CONTROL_ENABLE;
+    }
+    else {
+        return OsNotSupported;
+    }
+
+    if (Status != OsSuccess) {
+        return Status;
+    }
+    return WriteDeviceConfig(Device, Msi->Offset + MSI_CONTROL, Control, 2);
+}
+
+OsStatus_t
+DisableDeviceMsi(
+    _In_ MCoreDevice_t* Device)
+{
+    DeviceMsiCapability_t* Msi     = &Device->Interrupt.Msi;
+    size_t                 Control = 0;
+    OsStatus_t             Status;
+
+    if (Msi->Type == INTERRUPT_MSI_CAPABILITY_NONE) {
+        return OsNotSupported;
+    }
+
+    Status = IoctlDeviceEx(Device->Id, __DEVICEMANAGER_IOCTL_EXT_READ,
+        Msi->Offset + MSI_CONTROL, &Control, 2);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    Control &= (Msi->Type == INTERRUPT_MSI_CAPABILITY_MSI) ? ~MSI_CONTROL_ENABLE : ~MSIX_CONTROL_ENABLE;
+    return WriteDeviceConfig(Device, Msi->Offset + MSI_CONTROL, Control, 2);
+}
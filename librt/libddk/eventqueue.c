@@ -19,74 +19,279 @@
  * Event Queue Support Definitions & Structures
  * - This header describes the base event-structures, prototypes
  *   and functionality, refer to the individual things for descriptions
+ * - Events are kept in a min-heap ordered by their absolute deadline, and
+ *   in a hash table by their id for cancellation.
  */
 
 #include <ddk/eventqueue.h>
-#include <ds/collection.h>
 #include <os/mollenos.h>
 #include <threads.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 #define EVENT_QUEUED    0
-#define EVENT_EXECUTED  1
+#define EVENT_EXECUTING 1
 #define EVENT_CANCELLED 2
 
+#define EVENTQUEUE_INITIAL_SIZE 16
+
+// Deadlines are in nanoseconds, the timeouts and intervals are given in milliseconds
+#define EVENTQUEUE_NSEC_PER_MSEC (NSEC_PER_SEC / MSEC_PER_SEC)
+
 typedef struct EventQueueEvent {
-    CollectionItem_t   Header;
-    EventQueueFunction Function;
-    void*              Context;
-    size_t             Timeout;
-    size_t             Interval;
-    int                State;
+    struct EventQueueEvent* Link;
+    UUId_t                  Id;
+    EventQueueFunction      Function;
+    void*                   Context;
+    uint64_t                Deadline;  // Absolute, in nanoseconds
+    size_t                  Interval;  // In milliseconds
+    int                     HeapIndex;
+    int                     State;
 } EventQueueEvent_t;
 
 typedef struct EventQueue {
-    int           IsRunning;
-    UUId_t        NextEventId;
-    thrd_t        EventThread;
-    mtx_t         EventLock;
-    cnd_t         EventCondition;
-    Collection_t* Events;
+    int                 IsRunning;
+    UUId_t              NextEventId;
+    uint64_t            Slack;
+    int                 WorkerCount;
+    thrd_t*             Workers;
+    mtx_t               EventLock;
+    cnd_t               EventCondition;
+
+    // Min-heap of queued events
+    EventQueueEvent_t** Heap;
+    int                 HeapCount;
+    int                 HeapCapacity;
+
+    // Hash table of all events that are alive, by id
+    EventQueueEvent_t** Buckets;
+    size_t              BucketCount;
+    size_t              EventCount;
 } EventQueue_t;
 
 static UUId_t AddToEventQueue(EventQueue_t* EventQueue, EventQueueFunction Function, void* Context, size_t TimeoutMs, size_t IntervalMs);
 static int    EventQueueWorker(void* Context);
 
+// Deadlines are kept on the monotonic clock so steps of the wall clock neither
+// fire events early nor stall them
+static uint64_t GetTimestamp(void)
+{
+    struct timespec Now;
+    timespec_get(&Now, TIME_MONOTONIC);
+    return ((uint64_t)Now.tv_sec * NSEC_PER_SEC) + (uint64_t)Now.tv_nsec;
+}
+
+static int IsEventBefore(EventQueueEvent_t* Event1, EventQueueEvent_t* Event2)
+{
+    // Events with equal deadlines execute in the order they were queued
+    if (Event1->Deadline != Event2->Deadline) {
+        return Event1->Deadline < Event2->Deadline;
+    }
+    return Event1->Id < Event2->Id;
+}
+
+static void HeapSet(EventQueue_t* EventQueue, int Index, EventQueueEvent_t* Event)
+{
+    EventQueue->Heap[Index] = Event;
+    Event->HeapIndex        = Index;
+}
+
+static void HeapSiftUp(EventQueue_t* EventQueue, int Index)
+{
+    EventQueueEvent_t* Event = EventQueue->Heap[Index];
+    while (Index > 0) {
+        int Parent = (Index - 1) / 2;
+        if (!IsEventBefore(Event, EventQueue->Heap[Parent])) {
+            break;
+        }
+        HeapSet(EventQueue, Index, EventQueue->Heap[Parent]);
+        Index = Parent;
+    }
+    HeapSet(EventQueue, Index, Event);
+}
+
+static void HeapSiftDown(EventQueue_t* EventQueue, int Index)
+{
+    EventQueueEvent_t* Event = EventQueue->Heap[Index];
+    while (1) {
+        int Child = (Index * 2) + 1;
+        if (Child >= EventQueue->HeapCount) {
+            break;
+        }
+
+        if (Child + 1 < EventQueue->HeapCount &&
+            IsEventBefore(EventQueue->Heap[Child + 1], EventQueue->Heap[Child])) {
+            Child++;
+        }
+        if (!IsEventBefore(EventQueue->Heap[Child], Event)) {
+            break;
+        }
+        HeapSet(EventQueue, Index, EventQueue->Heap[Child]);
+        Index = Child;
+    }
+    HeapSet(EventQueue, Index, Event);
+}
+
+static void HeapInsert(EventQueue_t* EventQueue, EventQueueEvent_t* Event)
+{
+    if (EventQueue->HeapCount == EventQueue->HeapCapacity) {
+        EventQueue->HeapCapacity *= 2;
+        EventQueue->Heap = realloc(EventQueue->Heap, EventQueue->HeapCapacity * sizeof(EventQueueEvent_t*));
+        assert(EventQueue->Heap != NULL);
+    }
+    HeapSet(EventQueue, EventQueue->HeapCount++, Event);
+    HeapSiftUp(EventQueue, Event->HeapIndex);
+}
+
+static void HeapRemove(EventQueue_t* EventQueue, EventQueueEvent_t* Event)
+{
+    int Index = Event->HeapIndex;
+
+    EventQueue->HeapCount--;
+    if (Index != EventQueue->HeapCount) {
+        EventQueueEvent_t* Moved = EventQueue->Heap[EventQueue->HeapCount];
+        HeapSet(EventQueue, Index, Moved);
+        HeapSiftUp(EventQueue, Index);
+        HeapSiftDown(EventQueue, Moved->HeapIndex);
+    }
+    Event->HeapIndex = -1;
+}
+
+static void HashInsert(EventQueue_t* EventQueue, EventQueueEvent_t* Event)
+{
+    size_t i;
+
+    // Keep the load factor at most 1 by doubling the table
+    if (EventQueue->EventCount >= EventQueue->BucketCount) {
+        size_t              NewCount   = EventQueue->BucketCount * 2;
+        EventQueueEvent_t** NewBuckets = calloc(NewCount, sizeof(EventQueueEvent_t*));
+        assert(NewBuckets != NULL);
+
+        for (i = 0; i < EventQueue->BucketCount; i++) {
+            EventQueueEvent_t* Entry = EventQueue->Buckets[i];
+            while (Entry) {
+                EventQueueEvent_t* Next = Entry->Link;
+                Entry->Link = NewBuckets[Entry->Id & (NewCount - 1)];
+                NewBuckets[Entry->Id & (NewCount - 1)] = Entry;
+                Entry = Next;
+            }
+        }
+        free(EventQueue->Buckets);
+        EventQueue->Buckets     = NewBuckets;
+        EventQueue->BucketCount = NewCount;
+    }
+
+    i           = Event->Id & (EventQueue->BucketCount - 1);
+    Event->Link = EventQueue->Buckets[i];
+    EventQueue->Buckets[i] = Event;
+    EventQueue->EventCount++;
+}
+
+static EventQueueEvent_t* HashLookup(EventQueue_t* EventQueue, UUId_t Id)
+{
+    EventQueueEvent_t* Event = EventQueue->Buckets[Id & (EventQueue->BucketCount - 1)];
+    while (Event && Event->Id != Id) {
+        Event = Event->Link;
+    }
+    return Event;
+}
+
+static void HashRemove(EventQueue_t* EventQueue, EventQueueEvent_t* Event)
+{
+    EventQueueEvent_t** Link = &EventQueue->Buckets[Event->Id & (EventQueue->BucketCount - 1)];
+    while (*Link) {
+        if (*Link == Event) {
+            *Link = Event->Link;
+            EventQueue->EventCount--;
+            break;
+        }
+        Link = &(*Link)->Link;
+    }
+}
+
 void CreateEventQueue(EventQueue_t** EventQueueOut)
 {
-    EventQueue_t* EventQueue = malloc(sizeof(EventQueue_t));
-    assert(EventQueue != NULL);
-    
-    EventQueue->Events       = CollectionCreate(KeyId);
+    OsStatus_t Status = CreateEventQueueEx(EVENTQUEUE_DEFAULT_WORKERS,
+        EVENTQUEUE_DEFAULT_SLACK, EventQueueOut);
+    assert(Status == OsSuccess);
+}
+
+OsStatus_t CreateEventQueueEx(int Workers, size_t SlackMs, EventQueue_t** EventQueueOut)
+{
+    EventQueue_t* EventQueue;
+    int           i;
+
+    if (Workers <= 0 || EventQueueOut == NULL) {
+        return OsInvalidParameters;
+    }
+
+    EventQueue = malloc(sizeof(EventQueue_t));
+    if (!EventQueue) {
+        return OsOutOfMemory;
+    }
+    memset(EventQueue, 0, sizeof(EventQueue_t));
+
     EventQueue->IsRunning    = 1;
     EventQueue->NextEventId  = 1;
-    
-    if (thrd_create(&EventQueue->EventThread, EventQueueWorker, EventQueue) != thrd_success) {
-        EventQueue->EventThread = UUID_INVALID;
-        DestroyEventQueue(EventQueue);
-        return;
+    EventQueue->Slack        = (uint64_t)SlackMs * EVENTQUEUE_NSEC_PER_MSEC;
+    EventQueue->HeapCapacity = EVENTQUEUE_INITIAL_SIZE;
+    EventQueue->Heap         = malloc(EVENTQUEUE_INITIAL_SIZE * sizeof(EventQueueEvent_t*));
+    EventQueue->BucketCount  = EVENTQUEUE_INITIAL_SIZE;
+    EventQueue->Buckets      = calloc(EVENTQUEUE_INITIAL_SIZE, sizeof(EventQueueEvent_t*));
+    EventQueue->Workers      = calloc(Workers, sizeof(thrd_t));
+    if (!EventQueue->Heap || !EventQueue->Buckets || !EventQueue->Workers) {
+        free(EventQueue->Heap);
+        free(EventQueue->Buckets);
+        free(EventQueue->Workers);
+        free(EventQueue);
+        return OsOutOfMemory;
     }
-    
+
+    // The lock must be ready before the workers start
     mtx_init(&EventQueue->EventLock, mtx_plain);
     cnd_init(&EventQueue->EventCondition);
+    for (i = 0; i < Workers; i++) {
+        if (thrd_create(&EventQueue->Workers[i], EventQueueWorker, EventQueue) != thrd_success) {
+            DestroyEventQueue(EventQueue);
+            return OsError;
+        }
+        EventQueue->WorkerCount++;
+    }
+
     *EventQueueOut = EventQueue;
+    return OsSuccess;
 }
 
 void DestroyEventQueue(EventQueue_t* EventQueue)
 {
-    int Unused;
+    int    Unused;
+    int    i;
+    size_t j;
 
-    // Kill the thread, then cleanup resources
-    if (EventQueue->EventThread != UUID_INVALID) {
-        EventQueue->IsRunning = 0;
-        cnd_signal(&EventQueue->EventCondition);
-        thrd_join(EventQueue->EventThread, &Unused);
-        mtx_destroy(&EventQueue->EventLock);
-        cnd_destroy(&EventQueue->EventCondition);
+    // Kill the threads, then cleanup resources
+    mtx_lock(&EventQueue->EventLock);
+    EventQueue->IsRunning = 0;
+    cnd_broadcast(&EventQueue->EventCondition);
+    mtx_unlock(&EventQueue->EventLock);
+    for (i = 0; i < EventQueue->WorkerCount; i++) {
+        thrd_join(EventQueue->Workers[i], &Unused);
     }
-    CollectionDestroy(EventQueue->Events);
+
+    mtx_destroy(&EventQueue->EventLock);
+    cnd_destroy(&EventQueue->EventCondition);
+    for (j = 0; j < EventQueue->BucketCount; j++) {
+        EventQueueEvent_t* Event = EventQueue->Buckets[j];
+        while (Event) {
+            EventQueueEvent_t* Next = Event->Link;
+            free(Event);
+            Event = Next;
+        }
+    }
+    free(EventQueue->Buckets);
+    free(EventQueue->Heap);
+    free(EventQueue->Workers);
     free(EventQueue);
 }
 
@@ -110,15 +315,23 @@ UUId_t QueuePeriodicEvent(EventQueue_t* EventQueue, EventQueueFunction Callback,
 
 OsStatus_t CancelEvent(EventQueue_t* EventQueue, UUId_t EventHandle)
 {
-    DataKey_t          Key = { .Value.Id = EventHandle };
     EventQueueEvent_t* Event;
     OsStatus_t         Status = OsDoesNotExist;
-    
+
     mtx_lock(&EventQueue->EventLock);
-    Event = (EventQueueEvent_t*)CollectionGetNodeByKey(EventQueue->Events, Key, 0);
-    if (Event != NULL && Event->State != EVENT_EXECUTED) {
-        Event->State = EVENT_CANCELLED;
-        Status = OsSuccess;
+    Event = HashLookup(EventQueue, EventHandle);
+    if (Event != NULL) {
+        if (Event->State == EVENT_QUEUED) {
+            HeapRemove(EventQueue, Event);
+            HashRemove(EventQueue, Event);
+            free(Event);
+            Status = OsSuccess;
+        }
+        else if (Event->State == EVENT_EXECUTING && Event->Interval != 0) {
+            // Periodic events in progress are not queued again
+            Event->State = EVENT_CANCELLED;
+            Status       = OsSuccess;
+        }
     }
     mtx_unlock(&EventQueue->EventLock);
     return Status;
@@ -127,100 +340,91 @@ OsStatus_t CancelEvent(EventQueue_t* EventQueue, UUId_t EventHandle)
 static UUId_t AddToEventQueue(EventQueue_t* EventQueue, EventQueueFunction Function, void* Context, size_t TimeoutMs, size_t IntervalMs)
 {
     EventQueueEvent_t* Event = (EventQueueEvent_t*)malloc(sizeof(EventQueueEvent_t));
+    UUId_t             Id;
     assert(Event != NULL);
-    
+
     assert(EventQueue != NULL);
     assert(Function != NULL);
 
     memset(Event, 0, sizeof(EventQueueEvent_t));
-    Event->Header.Key.Value.Id = EventQueue->NextEventId++;
-
     Event->Function = Function;
     Event->Context  = Context;
-    Event->Timeout  = TimeoutMs;
+    Event->Deadline = GetTimestamp() + ((uint64_t)TimeoutMs * EVENTQUEUE_NSEC_PER_MSEC);
     Event->Interval = IntervalMs;
-    
+    Event->State    = EVENT_QUEUED;
+
     mtx_lock(&EventQueue->EventLock);
-    CollectionAppend(EventQueue->Events, &Event->Header);
-    mtx_unlock(&EventQueue->EventLock);
-    cnd_signal(&EventQueue->EventCondition);
-    return Event->Header.Key.Value.Id;
-}
+    Id        = EventQueue->NextEventId++;
+    Event->Id = Id;
+    HashInsert(EventQueue, Event);
+    HeapInsert(EventQueue, Event);
 
-static EventQueueEvent_t* GetNearestEventQueueDeadline(EventQueue_t* EventQueue)
-{
-    EventQueueEvent_t* Nearest = NULL;
-    foreach(Node, EventQueue->Events) {
-        EventQueueEvent_t* Event = (EventQueueEvent_t*)Node;
-        if (Nearest == NULL) {
-            Nearest = Event;
-        }
-        else {
-            if (Event->Timeout < Nearest->Timeout) {
-                Nearest = Event;
-            }
-        }
+    // Only wake up a worker if the nearest deadline changed
+    if (Event->HeapIndex == 0) {
+        cnd_signal(&EventQueue->EventCondition);
     }
-    return Nearest;
+    mtx_unlock(&EventQueue->EventLock);
+    return Id;
 }
 
 static int EventQueueWorker(void* Context)
 {
     EventQueueEvent_t* Event;
-    EventQueue_t*   EventQueue = (EventQueue_t*)Context;
-    struct timespec TimePoint;
-    struct timespec InterruptedAt;
-    struct timespec TimeSpent;
+    EventQueue_t*      EventQueue = (EventQueue_t*)Context;
+    struct timespec    TimePoint;
+    uint64_t           Now;
     SetCurrentThreadName("event-pump");
 
     mtx_lock(&EventQueue->EventLock);
     while (EventQueue->IsRunning) {
-        Event = GetNearestEventQueueDeadline(EventQueue);
-        if (Event != NULL) {
+        if (!EventQueue->HeapCount) {
+            // Wait for event to be added
+            cnd_wait(&EventQueue->EventCondition, &EventQueue->EventLock);
+            continue;
+        }
+
+        // Sleep untill the nearest deadline, any events that are due within the slack
+        // window are executed on this wakeup as well
+        Event = EventQueue->Heap[0];
+        Now   = GetTimestamp();
+        if (Event->Deadline > Now + EventQueue->Slack) {
+            // cnd_timedwait takes a wall clock time point, it only uses it to work out how
+            // long to sleep, so convert the time that is left on the monotonic clock
+            uint64_t Remaining = Event->Deadline - Now;
             timespec_get(&TimePoint, TIME_UTC);
-            TimePoint.tv_nsec += Event->Timeout * NSEC_PER_MSEC;
-            if (TimePoint.tv_nsec > NSEC_PER_SEC) {
-                TimePoint.tv_nsec -= NSEC_PER_SEC;
-                TimePoint.tv_sec++;
-            }
+            Remaining         += (uint64_t)TimePoint.tv_nsec;
+            TimePoint.tv_sec  += (time_t)(Remaining / NSEC_PER_SEC);
+            TimePoint.tv_nsec  = (long)(Remaining % NSEC_PER_SEC);
+            cnd_timedwait(&EventQueue->EventCondition, &EventQueue->EventLock, &TimePoint);
+            continue;
+        }
 
-            if (cnd_timedwait(&EventQueue->EventCondition, &EventQueue->EventLock, &TimePoint) == thrd_timedout) {
-                // We timedout, or in other words successfully waited
-                if (Event->State != EVENT_CANCELLED) {
-                    Event->State = EVENT_EXECUTED;
-                    
-                    mtx_unlock(&EventQueue->EventLock);
-                    Event->Function(Event->Context);
-                    mtx_lock(&EventQueue->EventLock);
-                    if (Event->Interval != 0) {
-                        Event->Timeout = Event->Interval;
-                    }
-                }
-                if (Event->State == EVENT_CANCELLED || !Event->Interval) {
-                    CollectionRemoveByNode(EventQueue->Events, &Event->Header);
-                    CollectionDestroyNode(EventQueue->Events, &Event->Header);
-                }
-            }
-            else {
-                if (Event->State != EVENT_CANCELLED) {
-                    // We were interrupted due to added events, calculate sleep time and subtract. Then
-                    // start over
-                    timespec_get(&InterruptedAt, TIME_UTC);
-                    timespec_diff(&InterruptedAt, &TimePoint, &TimeSpent);
-                    size_t Milliseconds = TimeSpent.tv_sec * MSEC_PER_SEC;
-                    Milliseconds       += TimeSpent.tv_nsec / NSEC_PER_MSEC;
-                    Event->Timeout     -= Milliseconds;
-                }
-                else {
-                    CollectionRemoveByNode(EventQueue->Events, &Event->Header);
-                    CollectionDestroyNode(EventQueue->Events, &Event->Header);
-                }
-                continue;
+        HeapRemove(EventQueue, Event);
+        Event->State = EVENT_EXECUTING;
+
+        // If more events are due, let another worker handle those while we execute
+        if (EventQueue->WorkerCount > 1 && EventQueue->HeapCount) {
+            cnd_signal(&EventQueue->EventCondition);
+        }
+
+        mtx_unlock(&EventQueue->EventLock);
+        Event->Function(Event->Context);
+        mtx_lock(&EventQueue->EventLock);
+
+        if (Event->Interval != 0 && Event->State != EVENT_CANCELLED && EventQueue->IsRunning) {
+            // Advance the deadline from the previous deadline so periodic events do not
+            // drift, but skip any periods we missed
+            Now              = GetTimestamp();
+            Event->Deadline += (uint64_t)Event->Interval * EVENTQUEUE_NSEC_PER_MSEC;
+            if (Event->Deadline < Now) {
+                Event->Deadline = Now + ((uint64_t)Event->Interval * EVENTQUEUE_NSEC_PER_MSEC);
             }
+            Event->State = EVENT_QUEUED;
+            HeapInsert(EventQueue, Event);
         }
         else {
-            // Wait for event to be added
-            cnd_wait(&EventQueue->EventCondition, &EventQueue->EventLock);
+            HashRemove(EventQueue, Event);
+            free(Event);
         }
     }
     mtx_unlock(&EventQueue->EventLock);
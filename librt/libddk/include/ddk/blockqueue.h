@@ -0,0 +1,119 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Block Queue Support Definitions & Structures
+ * - This header describes the per-device block request queue that sits between
+ *   file systems and storage drivers. Requests are sorted, merged and dispatched
+ *   concurrently up to the configured queue depth.
+ */
+
+#ifndef __DDK_BLOCKQUEUE_H__
+#define __DDK_BLOCKQUEUE_H__
+
+#include <ddk/ddkdefs.h>
+#include <ddk/storage.h>
+
+typedef struct BlockQueue BlockQueue_t;
+
+#define BLOCKQUEUE_DEFAULT_DEPTH      4
+#define BLOCKQUEUE_DEFAULT_MAXSECTORS 256
+
+// Deadlines in milliseconds after which a request is dispatched regardless of
+// its position relative to the elevator
+#define BLOCKQUEUE_READ_DEADLINE      50
+#define BLOCKQUEUE_WRITE_DEADLINE     500
+
+typedef struct BlockRequest {
+    int        Direction;    // __STORAGE_OPERATION_*
+    uint64_t   Sector;
+    UUId_t     BufferHandle;
+    size_t     BufferOffset;
+    size_t     SectorCount;
+
+    // Filled on completion
+    OsStatus_t Status;
+    size_t     SectorsTransferred;
+} BlockRequest_t;
+
+typedef struct BlockQueueStatistics {
+    uint64_t RequestsSubmitted;
+    uint64_t RequestsCompleted;
+    uint64_t RequestsMerged;
+    uint64_t Dispatches;
+    uint64_t DeadlineDispatches;
+    uint64_t SectorsRead;
+    uint64_t SectorsWritten;
+    uint64_t Errors;
+    uint64_t TotalLatencyMs;
+    size_t   MaxLatencyMs;
+    int      MaxInFlight;
+    size_t   ElapsedMs;
+} BlockQueueStatistics_t;
+
+_CODE_BEGIN
+/* BlockQueueCreate
+ * Creates a new request queue for the given storage device. Depth controls how many
+ * requests are outstanding towards the driver at once, and MaxSectors limits the size
+ * of merged requests. Pass 0 for either to use the defaults. */
+DDKDECL(OsStatus_t,
+BlockQueueCreate(
+    _In_  UUId_t         Driver,
+    _In_  UUId_t         Device,
+    _In_  size_t         SectorSize,
+    _In_  int            Depth,
+    _In_  size_t         MaxSectors,
+    _Out_ BlockQueue_t** QueueOut));
+
+/* BlockQueueDestroy
+ * Drains all pending requests and stops the dispatchers of the queue. */
+DDKDECL(void,
+BlockQueueDestroy(
+    _In_ BlockQueue_t* Queue));
+
+/* BlockQueueTransfer
+ * Queues a single transfer and waits for it to complete. Requests from other threads
+ * that touch adjacent sectors of the same buffer are merged with this one. */
+DDKDECL(OsStatus_t,
+BlockQueueTransfer(
+    _In_  BlockQueue_t* Queue,
+    _In_  int           Direction,
+    _In_  uint64_t      Sector,
+    _In_  UUId_t        BufferHandle,
+    _In_  size_t        BufferOffset,
+    _In_  size_t        SectorCount,
+    _Out_ size_t*       SectorsTransferred));
+
+/* BlockQueueTransferBatch
+ * Queues all the given requests at once and waits for every one of them to complete. The
+ * status of each request is stored in the request itself, the return value is the first error. */
+DDKDECL(OsStatus_t,
+BlockQueueTransferBatch(
+    _In_ BlockQueue_t*   Queue,
+    _In_ BlockRequest_t* Requests,
+    _In_ int             Count));
+
+/* BlockQueueGetStatistics
+ * Retrieves a snapshot of the latency and throughput counters of the queue. */
+DDKDECL(void,
+BlockQueueGetStatistics(
+    _In_  BlockQueue_t*           Queue,
+    _Out_ BlockQueueStatistics_t* Statistics));
+_CODE_END
+
+#endif //!__DDK_BLOCKQUEUE_H__
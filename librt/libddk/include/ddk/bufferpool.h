@@ -27,8 +27,16 @@
 
 #include <ddk/ddkdefs.h>
 
+// Allocations up to DMA_POOL_SLAB_MAX bytes are served from fixed-size slab classes
+// of power-of-two sizes, larger allocations fall back to the byte pool.
+#define DMA_POOL_SLAB_MIN   32
+#define DMA_POOL_SLAB_MAX   512
+#define DMA_POOL_SLAB_SIZE  0x400
+#define DMA_POOL_CACHE_SIZE 8
+
 struct dma_attachment;
 struct dma_pool;
+struct dma_pool_cache;
 
 _CODE_BEGIN
 /* BufferPoolCreate
@@ -72,6 +80,38 @@ DDKDECL(size_t,
 dma_pool_offset(
     _In_ struct dma_pool* pool,
     _In_ void*            address));
+
+/* dma_pool_cache_create
+ * Creates a cache of slab allocations for a single queue. The cache keeps a few free
+ * objects of each slab class, so allocations and frees on the queue only take the
+ * pool lock when the cache needs to be refilled or flushed. A cache must only be used
+ * by one thread at the time. */
+DDKDECL(OsStatus_t,
+dma_pool_cache_create(
+    _In_  struct dma_pool*        pool,
+    _Out_ struct dma_pool_cache** cache_out));
+
+/* dma_pool_cache_destroy
+ * Returns all cached objects to the pool and destroys the cache. */
+DDKDECL(void,
+dma_pool_cache_destroy(
+    _In_ struct dma_pool_cache* cache));
+
+/* dma_pool_cache_allocate
+ * Allocates from the queue cache, allocations too large for the slab classes are
+ * passed on to the pool. */
+DDKDECL(OsStatus_t,
+dma_pool_cache_allocate(
+    _In_  struct dma_pool_cache* cache,
+    _In_  size_t                 length,
+    _Out_ void**                 address_out));
+
+/* dma_pool_cache_free
+ * Frees an allocation made from either the queue cache or the pool. */
+DDKDECL(OsStatus_t,
+dma_pool_cache_free(
+    _In_ struct dma_pool_cache* cache,
+    _In_ void*                  address));
 _CODE_END
 
 #endif //!__DMA_POOL_H__
@@ -24,6 +24,7 @@
 #ifndef _CONTRACT_FILESYSTEM_INTERFACE_H_
 #define _CONTRACT_FILESYSTEM_INTERFACE_H_
 
+#include <ddk/blockqueue.h>
 #include <ddk/storage.h>
 #include <os/mollenos.h>
 
@@ -46,12 +47,14 @@ typedef struct MString MString_t;
 
 /* FileSystem Disk structure
  * Keeps information about the disk target and the
- * general information about the disk (geometry, string data) */
+ * general information about the disk (geometry, string data).
+ * All transfers to the disk should go through the block queue. */
 PACKED_TYPESTRUCT(FileSystemDisk, {
     UUId_t                      Driver;
     UUId_t                      Device;
     Flags_t                     Flags;
     StorageDescriptor_t         Descriptor;
+    BlockQueue_t*               Queue;
 });
 
 /* The filesystem descriptor structure 
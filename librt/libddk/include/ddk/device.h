@@ -121,6 +121,22 @@ IoctlDeviceEx(
     _InOut_ size_t* Value,
     _In_    size_t  Width));
 
+/* EnableDeviceMsi
+ * Programs the message of an interrupt registered with INTERRUPT_MSI into the given
+ * vector of the device, and switches the device to message signaled interrupts. For
+ * MSI-X the io-space that holds the vector table must be acquired through <Device>. */
+DDKDECL(OsStatus_t,
+EnableDeviceMsi(
+    _In_ MCoreDevice_t*     Device,
+    _In_ int                Vector,
+    _In_ DeviceInterrupt_t* Interrupt));
+
+/* DisableDeviceMsi
+ * Switches the device back to pin based interrupts. */
+DDKDECL(OsStatus_t,
+DisableDeviceMsi(
+    _In_ MCoreDevice_t* Device));
+
 /* InstallDriver 
  * Tries to find a suitable driver for the given device
  * by searching storage-medias for the vendorid/deviceid 
@@ -29,10 +29,20 @@
 typedef struct EventQueue EventQueue_t;
 typedef void(*EventQueueFunction)(void*);
 
+// Events that are due within the slack window of each other are executed on the
+// same wakeup of the event queue
+#define EVENTQUEUE_DEFAULT_SLACK   1
+#define EVENTQUEUE_DEFAULT_WORKERS 1
+
 /* CreateEventQueue
  * Creates a new event queue that can be used to queue up events based on intervals and timeouts. */
 CRTDECL(void, CreateEventQueue(EventQueue_t** EventQueueOut));
 
+/* CreateEventQueueEx
+ * Creates a new event queue with the given number of worker threads, so slow events do not delay
+ * other events, and the slack window in milliseconds used to coalesce events. */
+CRTDECL(OsStatus_t, CreateEventQueueEx(int Workers, size_t SlackMs, EventQueue_t** EventQueueOut));
+
 /* DestroyEventQueue
  * Stops the event queue handler, and cleans up resources. */
 CRTDECL(void, DestroyEventQueue(EventQueue_t* EventQueue));
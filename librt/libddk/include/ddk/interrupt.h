@@ -51,6 +51,36 @@ typedef struct FastInterruptMemoryResource {
     Flags_t   Flags;
 } FastInterruptMemoryResource_t;
 
+// Interrupt Event Ring
+// A ring of status words shared between the fast interrupt handler and the driver. The fast
+// handler posts events to the ring, and the kernel only wakes the driver through the ring futex
+// when the driver is not already draining the ring and enough events are pending. The ring must
+// be page aligned, and the capacity must be a power of two.
+#define INTERRUPT_EVENT_RING_WAITING        0
+#define INTERRUPT_EVENT_RING_DRAINING       1
+
+#define INTERRUPT_EVENT_RING_SIZE(Capacity) (sizeof(InterruptEventRing_t) + ((Capacity) * sizeof(size_t)))
+
+typedef struct InterruptEventRingStatistics {
+    _Atomic(unsigned int) Interrupts;   // Interrupts handled by the fast handler
+    _Atomic(unsigned int) Events;       // Events posted to the ring
+    _Atomic(unsigned int) Dropped;      // Events lost because the ring was full
+    _Atomic(unsigned int) Wakeups;      // Times the kernel woke the driver
+    _Atomic(unsigned int) Polls;        // Times the driver polled instead of sleeping
+} InterruptEventRingStatistics_t;
+
+typedef struct InterruptEventRing {
+    _Atomic(int)                   State;      // The futex the driver sleeps on
+    _Atomic(unsigned int)          Head;       // Written by the kernel
+    _Atomic(unsigned int)          Tail;       // Written by the driver
+    unsigned int                   Capacity;
+    unsigned int                   MaxEvents;  // Deliver without delay when this many events are pending
+    unsigned int                   MaxLatency; // Milliseconds fewer events may wait before delivery
+    unsigned int                   PollCount;  // Empty polls before the driver goes to sleep
+    InterruptEventRingStatistics_t Statistics;
+    size_t                         Events[];
+} InterruptEventRing_t;
+
 // Fast-Interrupt Resource Table
 // Table that descripes the executable region of the fast interrupt handler, and the
 // memory resources the fast interrupt handler needs access too. Validation and security
@@ -59,6 +89,7 @@ typedef struct FastInterruptResourceTable {
     InterruptHandler_t            Handler;
     DeviceIo_t*                   IoResources[INTERRUPT_MAX_IO_RESOURCES];
     FastInterruptMemoryResource_t MemoryResources[INTERRUPT_MAX_MEMORY_RESOURCES];
+    InterruptEventRing_t*         EventRing;
 } FastInterruptResourceTable_t;
 
 // Fast-Interrupt
@@ -72,10 +103,12 @@ typedef struct FastInterruptResources {
     // System Functions
     size_t                        (*ReadIoSpace)(DeviceIo_t*, size_t Offset, size_t Length);
     OsStatus_t                    (*WriteIoSpace)(DeviceIo_t*, size_t Offset, size_t Value, size_t Length);
+    OsStatus_t                    (*PostEvent)(FastInterruptResources_t*, size_t Event);
 } FastInterruptResources_t;
 
 #define INTERRUPT_IOSPACE(Resources, Index)     Resources->ResourceTable->IoResources[Index]
 #define INTERRUPT_RESOURCE(Resources, Index)    Resources->ResourceTable->MemoryResources[Index].Address
+#define INTERRUPT_POST_EVENT(Resources, Event)  Resources->PostEvent(Resources, Event)
 
 // Interrupt register options
 #define INTERRUPT_SOFT                  0x00000001  // Interrupt is not triggered by a hardware line
@@ -84,6 +117,43 @@ typedef struct FastInterruptResources {
 #define INTERRUPT_NOTSHARABLE           0x00000008  // Interrupt line can not be shared
 #define INTERRUPT_USERSPACE             0x00000010  // Send interrupt notification to process
 
+// Interrupt balancing policies
+// The kernel measures the rate and handler cost of every interrupt line, and periodically
+// routes the io-apic lines to a single core according to the active policy. Lines that use
+// MSI, and interrupts that are owned by the kernel, are left to the interrupt controller.
+#define INTERRUPT_BALANCE_NONE          0           // Lines are delivered to the lowest priority core
+#define INTERRUPT_BALANCE_SPREAD        1           // Spread the interrupt load evenly across cores
+#define INTERRUPT_BALANCE_COLOCATE      2           // Route lines to the core of the driver thread
+
+typedef struct InterruptBalanceStatistics {
+    UUId_t       TableIndex;
+    int          Source;
+    UUId_t       CoreId;        // UUID_INVALID if routed by the interrupt controller
+    unsigned int Count;         // Interrupts handled since the line was registered
+    unsigned int Rate;          // Interrupts per second over the last period
+    uint64_t     Cost;          // Average handler cost in timestamp counts
+    unsigned int Migrations;    // Times the line was moved to another core
+} InterruptBalanceStatistics_t;
+
+// Message signaled interrupts
+// The bus fills in the capability of devices that can deliver interrupts by MSI or MSI-X. Each
+// vector is registered on its own with INTERRUPT_MSI and gets a vector of its own, so it is never
+// shared with other devices. The vector is then programmed into the device with EnableDeviceMsi.
+#define INTERRUPT_MSI_CAPABILITY_NONE   0
+#define INTERRUPT_MSI_CAPABILITY_MSI    1
+#define INTERRUPT_MSI_CAPABILITY_MSIX   2
+
+#define INTERRUPT_MAX_MSI_VECTORS       32
+
+typedef struct DeviceMsiCapability {
+    int          Type;
+    unsigned int Offset;        // Offset of the capability in the configuration space
+    int          Vectors;       // Vectors the driver may register
+    int          Is64Bit;       // MSI   - The message address register is 64 bit
+    int          TableIoSpace;  // MSI-X - The index of the io-space that holds the vector table
+    size_t       TableOffset;   // MSI-X - The offset of the vector table in the io-space
+} DeviceMsiCapability_t;
+
 typedef struct DeviceInterrupt {
     // Interrupt-handler(s) and context
     // FastHandler is called to determine whether or not this source
@@ -104,6 +174,7 @@ typedef struct DeviceInterrupt {
     int                          Vectors[INTERRUPT_MAXVECTORS];
 
     // Read-Only
+    DeviceMsiCapability_t        Msi;            // Filled in by the bus
     uintptr_t                    MsiAddress;     // INTERRUPT_MSI - The address of MSI
     uintptr_t                    MsiValue;       // INTERRUPT_MSI - The value of MSI
 } DeviceInterrupt_t;
@@ -138,6 +209,56 @@ RegisterInterruptContext(
     _In_ DeviceInterrupt_t* Interrupt,
     _In_ void*              Context));
 
+/* RegisterInterruptEventRing
+ * Registers an initialized event ring with the fast-interrupt. Events the fast handler posts
+ * are delivered through the ring instead of SIGINT. */
+DDKDECL(void,
+RegisterInterruptEventRing(
+    _In_ DeviceInterrupt_t*    Interrupt,
+    _In_ InterruptEventRing_t* Ring));
+
+/* InterruptEventRingInitialize
+ * Initializes an event ring of INTERRUPT_EVENT_RING_SIZE(Capacity) bytes. The driver is woken by the
+ * first event in an empty ring, and then waits up to MaxLatency milliseconds for the batch to reach
+ * MaxEvents before the events are delivered. The driver polls the empty ring PollCount times before
+ * it sleeps, which avoids wakeups during bursts. */
+DDKDECL(OsStatus_t,
+InterruptEventRingInitialize(
+    _In_ InterruptEventRing_t* Ring,
+    _In_ unsigned int          Capacity,
+    _In_ unsigned int          MaxEvents,
+    _In_ unsigned int          MaxLatency,
+    _In_ unsigned int          PollCount));
+
+/* InterruptEventRingWait
+ * Waits until events should be delivered according to the moderation settings of the ring. */
+DDKDECL(OsStatus_t,
+InterruptEventRingWait(
+    _In_ InterruptEventRing_t* Ring));
+
+/* InterruptEventRingRead
+ * Reads up to Count pending events from the ring, returns the number of events read. */
+DDKDECL(int,
+InterruptEventRingRead(
+    _In_ InterruptEventRing_t* Ring,
+    _In_ size_t*               Events,
+    _In_ int                   Count));
+
+/* InterruptSetBalancePolicy
+ * Changes how the kernel routes interrupt lines to cores, see INTERRUPT_BALANCE_*. */
+DDKDECL(OsStatus_t,
+InterruptSetBalancePolicy(
+    _In_ int Policy));
+
+/* InterruptQueryBalance
+ * Retrieves the active balancing policy and the statistics of up to *Count interrupt lines. On
+ * return *Count holds the number of entries that were filled. */
+DDKDECL(OsStatus_t,
+InterruptQueryBalance(
+    _Out_    int*                          Policy,
+    _Out_    InterruptBalanceStatistics_t* Statistics,
+    _InOut_  int*                          Count));
+
 /* RegisterInterruptSource 
  * Allocates the given interrupt source for use by the requesting driver, an id for the interrupt source
  * is returned. After a succesful register, SIGINT can be invoked by the event-system */
@@ -30,6 +30,14 @@
 typedef struct ThreadPool ThreadPool_t;
 #define THREADPOOL_DEFAULT_WORKERS -1 // Call this to initialize with default number of workers
 
+typedef struct ThreadPoolStatistics {
+    uint64_t JobsExecuted;  // Jobs executed by the worker
+    uint64_t JobsStolen;    // Jobs the worker stole from other workers
+    uint64_t JobsInjected;  // Jobs the worker took from the external queue
+    uint64_t JobsPushed;    // Jobs submitted by the worker to its own queue
+    uint64_t Parks;         // Number of times the worker went to sleep
+} ThreadPoolStatistics_t;
+
 _CODE_BEGIN
 /* ThreadPoolInitialize 
  * Initializes a new thread-pool with the given number of threads */
@@ -48,6 +56,16 @@ ThreadPoolAddWork(
     _In_ thrd_start_t  Function,
     _In_ void*         Argument));
 
+/* ThreadPoolAddWorkBatch
+ * Adds a number of jobs that all execute the same function, one for each of the
+ * given arguments. The jobs are queued at once, and workers are woken once. */
+CRTDECL(OsStatus_t,
+ThreadPoolAddWorkBatch(
+    _In_ ThreadPool_t* ThreadPool,
+    _In_ thrd_start_t  Function,
+    _In_ void**        Arguments,
+    _In_ int           Count));
+
 /* ThreadPoolWait
  * Will wait for all jobs - both queued and currently running to finish.
  * Once the queue is empty and all work has completed, the calling thread
@@ -81,6 +99,20 @@ ThreadPoolDestroy(
 CRTDECL(size_t,
 ThreadPoolGetWorkingCount(
     _In_ ThreadPool_t* ThreadPool));
+
+/* ThreadPoolGetWorkerCount
+ * Returns the number of worker threads in the pool. */
+CRTDECL(int,
+ThreadPoolGetWorkerCount(
+    _In_ ThreadPool_t* ThreadPool));
+
+/* ThreadPoolGetStatistics
+ * Retrieves a snapshot of the counters of the given worker. */
+CRTDECL(OsStatus_t,
+ThreadPoolGetStatistics(
+    _In_  ThreadPool_t*           ThreadPool,
+    _In_  int                     Worker,
+    _Out_ ThreadPoolStatistics_t* Statistics));
 _CODE_END
 
 #endif //!_THREADINGPOOL_INTERFACE_H_
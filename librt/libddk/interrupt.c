@@ -23,7 +23,11 @@
  */
 
 #include <internal/_syscalls.h>
+#include <internal/_utils.h>
 #include <ddk/interrupt.h>
+#include <os/futex.h>
+#include <string.h>
+#include <threads.h>
 
 void
 RegisterFastInterruptHandler(
@@ -71,6 +75,105 @@ RegisterInterruptContext(
     Interrupt->Context = Context;
 }
 
+void
+RegisterInterruptEventRing(
+    _In_ DeviceInterrupt_t*    Interrupt,
+    _In_ InterruptEventRing_t* Ring)
+{
+    Interrupt->FastInterrupt.EventRing = Ring;
+}
+
+OsStatus_t
+InterruptEventRingInitialize(
+    _In_ InterruptEventRing_t* Ring,
+    _In_ unsigned int          Capacity,
+    _In_ unsigned int          MaxEvents,
+    _In_ unsigned int          MaxLatency,
+    _In_ unsigned int          PollCount)
+{
+    if (Ring == NULL || Capacity == 0 || (Capacity & (Capacity - 1)) != 0) {
+        return OsInvalidParameters;
+    }
+
+    memset(Ring, 0, INTERRUPT_EVENT_RING_SIZE(Capacity));
+    Ring->State      = ATOMIC_VAR_INIT(INTERRUPT_EVENT_RING_DRAINING);
+    Ring->Capacity   = Capacity;
+    Ring->MaxEvents  = MAX(1, MIN(MaxEvents, Capacity));
+    Ring->MaxLatency = MaxLatency;
+    Ring->PollCount  = PollCount;
+    return OsSuccess;
+}
+
+OsStatus_t
+InterruptEventRingWait(
+    _In_ InterruptEventRing_t* Ring)
+{
+    FutexParameters_t Parameters;
+    unsigned int      Polls   = 0;
+    int               Delayed = 0;
+    unsigned int      Pending;
+
+    if (Ring == NULL) {
+        return OsInvalidParameters;
+    }
+
+    while (1) {
+        Pending = atomic_load(&Ring->Head) - atomic_load(&Ring->Tail);
+        if (Pending >= Ring->MaxEvents || (Pending && (Delayed || !Ring->MaxLatency))) {
+            return OsSuccess;
+        }
+
+        // Keep polling while the ring is empty and events are arriving in bursts, the
+        // kernel does not wake us while we are draining
+        if (!Pending && Polls < Ring->PollCount) {
+            atomic_fetch_add(&Ring->Statistics.Polls, 1);
+            Polls++;
+            thrd_yield();
+            continue;
+        }
+
+        // Register as waiting before checking the ring one last time, the kernel will
+        // either see us waiting or we will see the event it posted. The kernel wakes us
+        // for the first event in an empty ring, the rest of the batch is then given up to
+        // MaxLatency to arrive, unless MaxEvents are pending before that
+        atomic_store(&Ring->State, INTERRUPT_EVENT_RING_WAITING);
+        Pending = atomic_load(&Ring->Head) - atomic_load(&Ring->Tail);
+        if (Pending < Ring->MaxEvents) {
+            Parameters._futex0  = &Ring->State;
+            Parameters._val0    = INTERRUPT_EVENT_RING_WAITING;
+            Parameters._flags   = 0;
+            Parameters._timeout = Pending ? Ring->MaxLatency : 0;
+            (void)Syscall_FutexWait(&Parameters);
+            Delayed = Pending != 0;
+        }
+        atomic_store(&Ring->State, INTERRUPT_EVENT_RING_DRAINING);
+    }
+}
+
+int
+InterruptEventRingRead(
+    _In_ InterruptEventRing_t* Ring,
+    _In_ size_t*               Events,
+    _In_ int                   Count)
+{
+    unsigned int Head;
+    unsigned int Tail;
+    int          i = 0;
+
+    if (Ring == NULL || Events == NULL) {
+        return 0;
+    }
+
+    Head = atomic_load_explicit(&Ring->Head, memory_order_acquire);
+    Tail = atomic_load_explicit(&Ring->Tail, memory_order_relaxed);
+    while (Tail != Head && i < Count) {
+        Events[i++] = Ring->Events[Tail & (Ring->Capacity - 1)];
+        Tail++;
+    }
+    atomic_store_explicit(&Ring->Tail, Tail, memory_order_release);
+    return i;
+}
+
 UUId_t
 RegisterInterruptSource(
     _In_ DeviceInterrupt_t* Interrupt,
@@ -93,3 +196,25 @@ UnregisterInterruptSource(
 	}
 	return Syscall_InterruptRemove(Source);
 }
+
+OsStatus_t
+InterruptSetBalancePolicy(
+    _In_ int Policy)
+{
+    if (Policy < INTERRUPT_BALANCE_NONE || Policy > INTERRUPT_BALANCE_COLOCATE) {
+        return OsInvalidParameters;
+    }
+    return Syscall_InterruptSetBalancePolicy(Policy);
+}
+
+OsStatus_t
+InterruptQueryBalance(
+    _Out_    int*                          Policy,
+    _Out_    InterruptBalanceStatistics_t* Statistics,
+    _InOut_  int*                          Count)
+{
+    if (Policy == NULL || Count == NULL || (Statistics == NULL && *Count != 0)) {
+        return OsInvalidParameters;
+    }
+    return Syscall_InterruptQueryBalance(Policy, Statistics, Count);
+}
@@ -19,9 +19,14 @@
  * Threading Pool Support Definitions & Structures
  * - This header describes the base threadingpool-structures, prototypes
  *   and functionality, refer to the individual things for descriptions
+ * - Each worker owns a Chase-Lev work-stealing deque, jobs submitted by workers
+ *   go to their own deque, while jobs from other threads go to a shared injection
+ *   queue. Idle workers steal from each other before they park on their own futex.
  */
 
-#include <os/binarysemaphore.h>
+#include <internal/_syscalls.h>
+#include <internal/_utils.h>
+#include <os/futex.h>
 #include <os/mollenos.h>
 #include <ddk/threadpool.h>
 #include <ddk/utils.h>
@@ -29,41 +34,60 @@
 #include <string.h>
 #include <signal.h>
 
+#define WORKDEQUE_SIZE       1024 // Must be a power of two
+#define WORKDEQUE_MASK       (WORKDEQUE_SIZE - 1)
+#define INJECTION_BATCH_SIZE 16
+
 /* ThreadPoolJob (Private)
  * Describes a linked list of jobs for threads to execute */
 typedef struct ThreadPoolJob {
-    struct ThreadPoolJob* Previous;
+    struct ThreadPoolJob* Next;
     thrd_start_t          Function;
     void*                 Argument;
 } ThreadPoolJob_t;
 
 /* ThreadPoolJobQueue (Private)
- * Contains a list of job entries (ThreadPoolJob), and keeps
- * the synchronization between retrieving and adding */
+ * The injection queue for jobs that are submitted from outside the pool, it is
+ * a simple locked list as workers only visit it when their own deque is empty */
 typedef struct ThreadPoolJobQueue {
-    mtx_t               Lock;
-    ThreadPoolJob_t*    Head;
-    ThreadPoolJob_t*    Tail;
-    BinarySemaphore_t*  HasJobs;
-    int                 Length;
+    mtx_t            Lock;
+    ThreadPoolJob_t* Head;
+    ThreadPoolJob_t* Tail;
+    _Atomic(int)     Length;
 } ThreadPoolJobQueue_t;
 
-/* ThreadPoolThread (Private) 
+/* ThreadPoolDeque (Private)
+ * Fixed size Chase-Lev deque, the owner pushes and pops at the bottom while
+ * other workers steal from the top. */
+typedef struct ThreadPoolDeque {
+    _Atomic(long)             Top;
+    _Atomic(long)             Bottom;
+    _Atomic(ThreadPoolJob_t*) Jobs[WORKDEQUE_SIZE];
+} ThreadPoolDeque_t;
+
+/* ThreadPoolThread (Private)
  * Contains the thread information and some extra information */
 typedef struct ThreadPoolThread {
-    int                 Id;
-    thrd_t              Thread;
-    ThreadPool_t*       Pool;
+    int                    Id;
+    thrd_t                 Thread;
+    ThreadPool_t*          Pool;
+    unsigned int           Seed;
+    _Atomic(int)           Parked;      // Cleared by whoever wakes the worker
+    ThreadPoolDeque_t      Deque;
+    ThreadPoolStatistics_t Statistics;
 } ThreadPoolThread_t;
 
-/* ThreadPool (Private) 
+/* ThreadPool (Private)
  * Contains all the neccessary information about the threadpool
  * and it's locks/threads/jobs */
 typedef struct ThreadPool {
-    volatile int            ThreadsAlive;
-    volatile int            ThreadsWorking;
-    volatile int            ThreadsKeepAlive;
+    _Atomic(int)            ThreadsAlive;
+    _Atomic(int)            ThreadsWorking;
+    _Atomic(int)            ThreadsSleeping;
+    _Atomic(int)            ThreadsKeepAlive;
     volatile sig_atomic_t   ThreadsOnHold;
+    _Atomic(int)            JobsPending;
+    int                     ThreadCount;
 
     // Resources
     mtx_t                   ThreadLock;
@@ -76,159 +100,282 @@ typedef struct ThreadPool {
  * Keeps volatile/static information related to state */
 static tss_t __GlbThreadPoolKey = TSS_KEY_INVALID;
 
+/* DequePush
+ * Pushes a job to the bottom of the deque, only called by the owner. Returns
+ * 0 if the deque is full. */
+static int
+DequePush(
+    _In_ ThreadPoolDeque_t* Deque,
+    _In_ ThreadPoolJob_t*   Job)
+{
+    long Bottom = atomic_load_explicit(&Deque->Bottom, memory_order_relaxed);
+    long Top    = atomic_load_explicit(&Deque->Top, memory_order_acquire);
+    if (Bottom - Top >= WORKDEQUE_SIZE) {
+        return 0;
+    }
+
+    atomic_store_explicit(&Deque->Jobs[Bottom & WORKDEQUE_MASK], Job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&Deque->Bottom, Bottom + 1, memory_order_relaxed);
+    return 1;
+}
+
+/* DequePop
+ * Pops a job from the bottom of the deque, only called by the owner. */
+static ThreadPoolJob_t*
+DequePop(
+    _In_ ThreadPoolDeque_t* Deque)
+{
+    ThreadPoolJob_t* Job = NULL;
+    long             Bottom;
+    long             Top;
+
+    Bottom = atomic_load_explicit(&Deque->Bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&Deque->Bottom, Bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    Top = atomic_load_explicit(&Deque->Top, memory_order_relaxed);
+
+    if (Top <= Bottom) {
+        Job = atomic_load_explicit(&Deque->Jobs[Bottom & WORKDEQUE_MASK], memory_order_relaxed);
+        if (Top == Bottom) {
+            // Last job, race against thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&Deque->Top, &Top, Top + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                Job = NULL;
+            }
+            atomic_store_explicit(&Deque->Bottom, Bottom + 1, memory_order_relaxed);
+        }
+    }
+    else {
+        atomic_store_explicit(&Deque->Bottom, Bottom + 1, memory_order_relaxed);
+    }
+    return Job;
+}
+
+/* DequeSteal
+ * Steals a job from the top of the deque, can be called by any thread. */
+static ThreadPoolJob_t*
+DequeSteal(
+    _In_ ThreadPoolDeque_t* Deque)
+{
+    ThreadPoolJob_t* Job;
+    long             Top;
+    long             Bottom;
+
+    Top = atomic_load_explicit(&Deque->Top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    Bottom = atomic_load_explicit(&Deque->Bottom, memory_order_acquire);
+    if (Top >= Bottom) {
+        return NULL;
+    }
+
+    Job = atomic_load_explicit(&Deque->Jobs[Top & WORKDEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&Deque->Top, &Top, Top + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return Job;
+}
+
 /* JobQueueInitialize
  * Allocates resources and initializes the job-queue */
-OsStatus_t
+static void
 JobQueueInitialize(
-    _In_ ThreadPoolJobQueue_t *JobQueue)
+    _In_ ThreadPoolJobQueue_t* JobQueue)
 {
-    // Sanitize
-    if (JobQueue == NULL) {
-        return OsError;
-    }
-
-    // Reset members
-    JobQueue->Length = 0;
     JobQueue->Head = NULL;
     JobQueue->Tail = NULL;
-
-    // Allocate a new lock
-    JobQueue->HasJobs = (BinarySemaphore_t*)malloc(sizeof(BinarySemaphore_t));
+    atomic_store(&JobQueue->Length, 0);
     mtx_init(&JobQueue->Lock, mtx_plain);
-    BinarySemaphoreConstruct(JobQueue->HasJobs, 0);
-    return OsSuccess;
 }
 
 /* JobQueuePush
- * Adds a new job to the end of the queue, the job will be executed
- * as fast as possible. */
-OsStatus_t
+ * Adds a chain of jobs to the end of the queue. */
+static void
 JobQueuePush(
-    _In_ ThreadPoolJobQueue_t*  JobQueue,
-    _In_ ThreadPoolJob_t*       Job)
+    _In_ ThreadPoolJobQueue_t* JobQueue,
+    _In_ ThreadPoolJob_t*      First,
+    _In_ ThreadPoolJob_t*      Last,
+    _In_ int                   Count)
 {
-    // Sanitize
-    if (JobQueue == NULL) {
-        return OsError;
-    }
-
-    // Acquire lock and reset previous
     mtx_lock(&JobQueue->Lock);
-    Job->Previous = NULL;
-
-    // Either add to start or end
-    if (JobQueue->Length == 0) {
-        JobQueue->Head = Job;
-        JobQueue->Tail = Job;
+    Last->Next = NULL;
+    if (JobQueue->Tail == NULL) {
+        JobQueue->Head = First;
     }
     else {
-        JobQueue->Tail->Previous = Job;
-        JobQueue->Tail = Job;
+        JobQueue->Tail->Next = First;
     }
-
-    // Increase length
-    JobQueue->Length++;
-
-    // Notify threads
-    BinarySemaphorePost(JobQueue->HasJobs);
-    return mtx_unlock(&JobQueue->Lock);
+    JobQueue->Tail = Last;
+    atomic_fetch_add(&JobQueue->Length, Count);
+    mtx_unlock(&JobQueue->Lock);
 }
 
 /* JobQueuePull
- * Get first job from queue and removes it from the job-queue
- * The caller must hold a mutex */
-ThreadPoolJob_t*
+ * Removes up to Count jobs from the front of the queue, and returns them as a chain. */
+static ThreadPoolJob_t*
 JobQueuePull(
-    _In_ ThreadPoolJobQueue_t *JobQueue)
+    _In_ ThreadPoolJobQueue_t* JobQueue,
+    _In_ int                   Count)
 {
-    // Variables
-    ThreadPoolJob_t *Job = NULL;
+    ThreadPoolJob_t* First;
+    ThreadPoolJob_t* Last;
+    int              Pulled = 1;
 
-    // Sanitize
-    if (JobQueue == NULL) {
+    // Avoid the lock if there is obviously nothing
+    if (!atomic_load(&JobQueue->Length)) {
         return NULL;
     }
 
-    // Acquire lock and reset previous
     mtx_lock(&JobQueue->Lock);
-    Job = JobQueue->Head;
+    First = JobQueue->Head;
+    if (First != NULL) {
+        Last = First;
+        while (Pulled < Count && Last->Next != NULL) {
+            Last = Last->Next;
+            Pulled++;
+        }
 
-    // On pull we have three different cases
-    // Either it's empty, return null
-    // If there is one job, clear head/tail
-    // If more, get head and notify
-    if (JobQueue->Length == 0) {
-        // Do nothing
-    }
-    else if (JobQueue->Length == 1) {
-        JobQueue->Head = NULL;
-        JobQueue->Tail = NULL;
-        JobQueue->Length--;
+        JobQueue->Head = Last->Next;
+        if (JobQueue->Head == NULL) {
+            JobQueue->Tail = NULL;
+        }
+        Last->Next = NULL;
+        atomic_fetch_sub(&JobQueue->Length, Pulled);
     }
-    else {
-        JobQueue->Head = Job->Previous;
-        JobQueue->Length--;
+    mtx_unlock(&JobQueue->Lock);
+    return First;
+}
 
-        // Update that we still have jobs
-        BinarySemaphorePost(JobQueue->HasJobs);
+/* JobQueueDestroy
+ * Free all queue resources back to the system and clears the queue */
+static void
+JobQueueDestroy(
+    _In_ ThreadPoolJobQueue_t* JobQueue)
+{
+    ThreadPoolJob_t* Job = JobQueue->Head;
+    while (Job) {
+        ThreadPoolJob_t* Next = Job->Next;
+        free(Job);
+        Job = Next;
     }
+    JobQueue->Head = NULL;
+    JobQueue->Tail = NULL;
+    atomic_store(&JobQueue->Length, 0);
+    mtx_destroy(&JobQueue->Lock);
+}
 
-    // Unlock and return the job
-    mtx_unlock(&JobQueue->Lock);
-    return Job;
+/* ThreadPoolSignalWork
+ * Wakes up to Count parked workers. A worker is claimed by clearing its park value, so
+ * a worker that was woken but has not run yet is never woken again, and the system call
+ * is only made for workers that are actually parked. */
+static void
+ThreadPoolSignalWork(
+    _In_ ThreadPool_t* Pool,
+    _In_ int           Count)
+{
+    FutexParameters_t Parameters;
+    int               i;
+
+    // The jobs must be visible before the sleepers are counted, the parking workers
+    // count themselves before they look for jobs the last time
+    atomic_thread_fence(memory_order_seq_cst);
+    for (i = 0; i < Pool->ThreadCount && Count > 0 && atomic_load(&Pool->ThreadsSleeping); i++) {
+        ThreadPoolThread_t* Worker = Pool->Threads[i];
+        if (!atomic_load(&Worker->Parked) || !atomic_exchange(&Worker->Parked, 0)) {
+            continue;
+        }
+
+        atomic_fetch_sub(&Pool->ThreadsSleeping, 1);
+        Parameters._futex0 = &Worker->Parked;
+        Parameters._val0   = 1;
+        Parameters._flags  = FUTEX_WAKE_PRIVATE;
+        (void)Syscall_FutexWake(&Parameters);
+        Count--;
+    }
 }
 
-/* JobQueueClear
- * Clears the job-queue and resets it's members. Also frees
- * any resources associated with the jobs */
-OsStatus_t
-JobQueueClear(
-    _In_ ThreadPoolJobQueue_t *JobQueue)
+/* ThreadPoolFindJob
+ * Locates the next job for the worker, first from its own deque, then from the
+ * injection queue and lastly by stealing from the other workers. */
+static ThreadPoolJob_t*
+ThreadPoolFindJob(
+    _In_ ThreadPoolThread_t* Worker)
 {
-    // Sanitize
-    if (JobQueue == NULL) {
-        return OsError;
+    ThreadPool_t*    Pool = Worker->Pool;
+    ThreadPoolJob_t* Job;
+    int              Start;
+    int              i;
+
+    Job = DequePop(&Worker->Deque);
+    if (Job) {
+        return Job;
     }
 
-    // Iterate and free jobs
-    while (JobQueue->Length) {
-        free(JobQueuePull(JobQueue));
+    // Take a batch of jobs from the injection queue, and make the rest available
+    // for stealing by moving them to our own deque
+    Job = JobQueuePull(&Pool->JobQueue, INJECTION_BATCH_SIZE);
+    if (Job) {
+        ThreadPoolJob_t* Next = Job->Next;
+        Worker->Statistics.JobsInjected++;
+        while (Next) {
+            ThreadPoolJob_t* Current = Next;
+            Next = Next->Next;
+            if (!DequePush(&Worker->Deque, Current)) {
+                JobQueuePush(&Pool->JobQueue, Current, Current, 1);
+            }
+            Worker->Statistics.JobsInjected++;
+        }
+        return Job;
     }
 
-    // Reset members
-    JobQueue->Head = NULL;
-    JobQueue->Tail = NULL;
-    BinarySemaphoreReset(JobQueue->HasJobs);
-    JobQueue->Length = 0;
-    return OsSuccess;
+    // Select a random victim to start from, to spread out the thieves
+    Worker->Seed ^= Worker->Seed << 13;
+    Worker->Seed ^= Worker->Seed >> 17;
+    Worker->Seed ^= Worker->Seed << 5;
+    Start = (int)(Worker->Seed % (unsigned int)Pool->ThreadCount);
+    for (i = 0; i < Pool->ThreadCount; i++) {
+        ThreadPoolThread_t* Victim = Pool->Threads[(Start + i) % Pool->ThreadCount];
+        if (Victim == Worker) {
+            continue;
+        }
+
+        Job = DequeSteal(&Victim->Deque);
+        if (Job) {
+            Worker->Statistics.JobsStolen++;
+            return Job;
+        }
+    }
+    return NULL;
 }
 
-/* JobQueueDestroy
- * Free all queue resources back to the system and clears the queue */
-void
-JobQueueDestroy(
-    _In_ ThreadPoolJobQueue_t *JobQueue)
+/* ThreadPoolJobDone
+ * Marks a job as done, and notifies waiters when there are no more pending jobs. */
+static void
+ThreadPoolJobDone(
+    _In_ ThreadPool_t* Pool)
 {
-    // Clear queue, then cleanup
-    JobQueueClear(JobQueue);
-    free(JobQueue->HasJobs);
+    if (atomic_fetch_sub(&Pool->JobsPending, 1) == 1) {
+        mtx_lock(&Pool->ThreadLock);
+        cnd_broadcast(&Pool->ThreadsIdle);
+        mtx_unlock(&Pool->ThreadLock);
+    }
 }
 
 /* ThreadPoolThreadHold
  * Signal-handler: Sets the calling thread on hold */
-void
+static void
 ThreadPoolThreadHold(
-    _In_ int                    SignalCode)
+    _In_ int SignalCode)
 {
-    // Variables 
-    ThreadPool_t *Tp = NULL;
+    ThreadPoolThread_t* Worker;
     _CRT_UNUSED(SignalCode);
 
-    // Extract pool from tls
-    Tp = (ThreadPool_t*)tss_get(__GlbThreadPoolKey);
-    if (Tp != NULL) {
-        Tp->ThreadsOnHold = 1;
-        while (Tp->ThreadsOnHold) {
+    // Extract worker from tls
+    Worker = (ThreadPoolThread_t*)tss_get(__GlbThreadPoolKey);
+    if (Worker != NULL) {
+        Worker->Pool->ThreadsOnHold = 1;
+        while (Worker->Pool->ThreadsOnHold) {
             thrd_sleepex(1);
         }
     }
@@ -236,105 +383,104 @@ ThreadPoolThreadHold(
 
 /* ThreadPoolThreadLoop
  * The primary loop of each thread */
-int
+static int
 ThreadPoolThreadLoop(
-    _In_ void*                  Argument)
+    _In_ void* Argument)
 {
-    ThreadPoolThread_t* Thread;
-    ThreadPoolJob_t *Job;
-    ThreadPool_t *Pool;
+    ThreadPoolThread_t* Worker = (ThreadPoolThread_t*)Argument;
+    ThreadPool_t*       Pool   = Worker->Pool;
+    FutexParameters_t   Parameters;
+    ThreadPoolJob_t*    Job;
 
-    // Instantiate the pointers
-    Thread  = (ThreadPoolThread_t*)Argument;
-    Pool    = Thread->Pool;
-
-    // Update tls and store the pool
-    tss_set(__GlbThreadPoolKey, Pool);
+    // Update tls and store the worker
+    tss_set(__GlbThreadPoolKey, Worker);
 
     // Update signal handler for this thread
     signal(SIGUSR1, ThreadPoolThreadHold);
 
     // Enter job-queue loop
-    Pool->ThreadsAlive++;
-    while (Pool->ThreadsKeepAlive) {
-        BinarySemaphoreWait(Pool->JobQueue.HasJobs);
-
-        // Make sure we check it again after wake-up
-        if (Pool->ThreadsKeepAlive) {
-            // Increase thread-working count
-            Pool->ThreadsWorking++;
-
-            // Get next job and execute
-            Job = JobQueuePull(&Pool->JobQueue);
-            if (Job != NULL) {
-                Job->Function(Job->Argument);
-                free(Job);
+    atomic_fetch_add(&Pool->ThreadsAlive, 1);
+    while (atomic_load(&Pool->ThreadsKeepAlive)) {
+        Job = ThreadPoolFindJob(Worker);
+        if (!Job) {
+            // Park before checking for work one last time, any submitter after this
+            // point will either see the job taken or see us parked and wake us
+            atomic_fetch_add(&Pool->ThreadsSleeping, 1);
+            atomic_store(&Worker->Parked, 1);
+            Job = ThreadPoolFindJob(Worker);
+            if (!Job && atomic_load(&Pool->ThreadsKeepAlive)) {
+                Parameters._futex0  = &Worker->Parked;
+                Parameters._val0    = 1;
+                Parameters._flags   = FUTEX_WAIT_PRIVATE;
+                Parameters._timeout = 0;
+                Worker->Statistics.Parks++;
+                (void)Syscall_FutexWait(&Parameters);
             }
 
-            // Decrease thread-working count
-            mtx_lock(&Pool->ThreadLock);
-            Pool->ThreadsWorking--;
-
-            // If none are working anymore, signal all idle
-            if (!Pool->ThreadsWorking) {
-                cnd_signal(&Pool->ThreadsIdle);
+            // Whoever clears the park value removes the worker from the sleepers
+            if (atomic_exchange(&Worker->Parked, 0)) {
+                atomic_fetch_sub(&Pool->ThreadsSleeping, 1);
+            }
+            if (!Job) {
+                continue;
             }
-            mtx_unlock(&Pool->ThreadLock);
         }
+
+        atomic_fetch_add(&Pool->ThreadsWorking, 1);
+        Job->Function(Job->Argument);
+        free(Job);
+        Worker->Statistics.JobsExecuted++;
+        atomic_fetch_sub(&Pool->ThreadsWorking, 1);
+        ThreadPoolJobDone(Pool);
     }
 
     // Decrease thread-live count
-    Pool->ThreadsAlive--;
+    atomic_fetch_sub(&Pool->ThreadsAlive, 1);
     return 0;
 }
 
-/* ThreadPoolInitializeThread
- * Initialize a thread in the thread pool */
-int 
-ThreadPoolInitializeThread(
-    _In_ ThreadPool_t*          ThreadPool,
-    _In_ ThreadPoolThread_t**   Thread,
-    _In_ int                    Id)
-{
-    // Allocate a new instance of a thread
-    *Thread = (ThreadPoolThread_t*)malloc(sizeof(ThreadPoolThread_t));
-    (*Thread)->Id   = Id;
-    (*Thread)->Pool = ThreadPool;
-    return thrd_create(&(*Thread)->Thread, ThreadPoolThreadLoop, *Thread);
-}
-
 /* ThreadPoolThreadDestroy
  * Frees any resources related to the given thread */
-void
+static void
 ThreadPoolThreadDestroy(
-    _In_ ThreadPoolThread_t*    Thread)
+    _In_ ThreadPoolThread_t* Thread)
 {
-    // Simply free it
+    ThreadPoolJob_t* Job;
+
+    // Free jobs that were never run
+    while ((Job = DequeSteal(&Thread->Deque)) != NULL) {
+        free(Job);
+    }
     free(Thread);
 }
 
-/* ThreadPoolInitialize 
+/* ThreadPoolInitialize
  * Initializes a new thread-pool with the given number of threads */
 OsStatus_t
 ThreadPoolInitialize(
-    _In_  int                   NumThreads,
-    _Out_ ThreadPool_t**        ThreadPool)
+    _In_  int            NumThreads,
+    _Out_ ThreadPool_t** ThreadPool)
 {
-    ThreadPool_t *Instance;
-    int i;
+    ThreadPool_t* Instance;
+    int           i;
 
-    // Trace
     TRACE("ThreadPoolInitialize(%i)", NumThreads);
-    
+
     // Handle thread count
     if (NumThreads == THREADPOOL_DEFAULT_WORKERS) {
-        SystemDescriptor_t Sys;
-        SystemQuery(&Sys);
-        NumThreads = Sys.NumberOfActiveCores;
+        const SystemPage_t* Page = GetSystemPage();
+        if (Page != NULL) {
+            NumThreads = (int)Page->NumberOfActiveCores;
+        }
+        else {
+            SystemDescriptor_t Sys;
+            SystemQuery(&Sys);
+            NumThreads = Sys.NumberOfActiveCores;
+        }
     }
 
     // Sanitize parameters
-    if (ThreadPool == NULL || NumThreads < 0) {
+    if (ThreadPool == NULL || NumThreads <= 0) {
         ERROR("Invalid parameters");
         return OsError;
     }
@@ -349,41 +495,115 @@ ThreadPoolInitialize(
     if (Instance == NULL) {
         return OsOutOfMemory;
     }
-    
+    memset((void*)Instance, 0, sizeof(ThreadPool_t));
+
     // Allocate the list of threads
     Instance->Threads = (ThreadPoolThread_t**)malloc(NumThreads * sizeof(ThreadPoolThread_t*));
     if (Instance->Threads == NULL) {
         free(Instance);
         return OsOutOfMemory;
     }
+    memset(Instance->Threads, 0, NumThreads * sizeof(ThreadPoolThread_t*));
 
-    memset((void*)Instance, 0, sizeof(ThreadPool_t));
-    Instance->ThreadsKeepAlive = 1;
-
-    // Initialize job queue
-    if (JobQueueInitialize(&Instance->JobQueue) != OsSuccess) {
-        free(Instance->Threads);
-        free(Instance);
-        return OsError;
-    }
+    atomic_store(&Instance->ThreadsKeepAlive, 1);
+    Instance->ThreadCount = NumThreads;
+    JobQueueInitialize(&Instance->JobQueue);
 
     // Initialize locks
     cnd_init(&Instance->ThreadsIdle);
     mtx_init(&Instance->ThreadLock, mtx_plain);
 
+    // Allocate all workers before starting them, as they steal from each other
+    for (i = 0; i < NumThreads; i++) {
+        Instance->Threads[i] = (ThreadPoolThread_t*)malloc(sizeof(ThreadPoolThread_t));
+        if (Instance->Threads[i] == NULL) {
+            while (i--) {
+                free(Instance->Threads[i]);
+            }
+            free(Instance->Threads);
+            free(Instance);
+            return OsOutOfMemory;
+        }
+        memset(Instance->Threads[i], 0, sizeof(ThreadPoolThread_t));
+        Instance->Threads[i]->Id   = i;
+        Instance->Threads[i]->Pool = Instance;
+        Instance->Threads[i]->Seed = (unsigned int)(i + 1) * 2654435761U;
+    }
+
     // Spawn threads
     for (i = 0; i < NumThreads; i++) {
-        ThreadPoolInitializeThread(Instance, &Instance->Threads[i], i);
+        if (thrd_create(&Instance->Threads[i]->Thread, ThreadPoolThreadLoop, Instance->Threads[i]) != thrd_success) {
+            ERROR("Failed to create worker %i of %i", i, NumThreads);
+            break;
+        }
     }
 
-    // Wait for all threads to spin-up
-    while (Instance->ThreadsAlive != NumThreads);
+    // Wait for the threads that were created to spin-up, and tear the pool down again if
+    // any of them could not be created
+    while (atomic_load(&Instance->ThreadsAlive) != i) {
+        thrd_yield();
+    }
+    if (i != NumThreads) {
+        ThreadPoolDestroy(Instance);
+        return OsError;
+    }
     *ThreadPool = Instance;
     return OsSuccess;
 }
 
+/* ThreadPoolCreateJob
+ * Allocates and initializes a new job */
+static ThreadPoolJob_t*
+ThreadPoolCreateJob(
+    _In_ thrd_start_t Function,
+    _In_ void*        Argument)
+{
+    ThreadPoolJob_t* Job = (ThreadPoolJob_t*)malloc(sizeof(ThreadPoolJob_t));
+    if (Job != NULL) {
+        Job->Next     = NULL;
+        Job->Function = Function;
+        Job->Argument = Argument;
+    }
+    return Job;
+}
+
+/* ThreadPoolSubmit
+ * Submits a chain of jobs, workers of the pool push to their own deque, while
+ * any other thread goes through the injection queue. */
+static void
+ThreadPoolSubmit(
+    _In_ ThreadPool_t*    ThreadPool,
+    _In_ ThreadPoolJob_t* First,
+    _In_ ThreadPoolJob_t* Last,
+    _In_ int              Count)
+{
+    ThreadPoolThread_t* Worker = (ThreadPoolThread_t*)tss_get(__GlbThreadPoolKey);
+
+    atomic_fetch_add(&ThreadPool->JobsPending, Count);
+    if (Worker != NULL && Worker->Pool == ThreadPool) {
+        ThreadPoolJob_t* Job       = First;
+        int              Remaining = Count;
+        while (Job) {
+            ThreadPoolJob_t* Next = Job->Next;
+
+            // Overflow goes to the injection queue when our deque is full
+            if (!DequePush(&Worker->Deque, Job)) {
+                JobQueuePush(&ThreadPool->JobQueue, Job, Last, Remaining);
+                break;
+            }
+            Worker->Statistics.JobsPushed++;
+            Remaining--;
+            Job = Next;
+        }
+    }
+    else {
+        JobQueuePush(&ThreadPool->JobQueue, First, Last, Count);
+    }
+    ThreadPoolSignalWork(ThreadPool, Count);
+}
+
 /* ThreadPoolAddWork
- * Takes an action and its argument and adds it to the threadpool's job queue. 
+ * Takes an action and its argument and adds it to the threadpool's job queue.
  * If you want to add to work a function with more than one arguments then
  * a way to implement this is by passing a pointer to a structure. */
 OsStatus_t
@@ -399,15 +619,53 @@ ThreadPoolAddWork(
         return OsError;
     }
 
-    // Allocate a new instance of the thread job
-    Job = (ThreadPoolJob_t*)malloc(sizeof(ThreadPoolJob_t));
+    Job = ThreadPoolCreateJob(Function, Argument);
     if (Job == NULL) {
         return OsOutOfMemory;
     }
-    
-    Job->Function = Function;
-    Job->Argument = Argument;
-    return JobQueuePush(&ThreadPool->JobQueue, Job);
+    ThreadPoolSubmit(ThreadPool, Job, Job, 1);
+    return OsSuccess;
+}
+
+/* ThreadPoolAddWorkBatch
+ * Adds a number of jobs that all execute the same function, one for each of the
+ * given arguments. The jobs are queued at once, and workers are woken once. */
+OsStatus_t
+ThreadPoolAddWorkBatch(
+    _In_ ThreadPool_t* ThreadPool,
+    _In_ thrd_start_t  Function,
+    _In_ void**        Arguments,
+    _In_ int           Count)
+{
+    ThreadPoolJob_t* First = NULL;
+    ThreadPoolJob_t* Last  = NULL;
+    int              i;
+
+    if (ThreadPool == NULL || Arguments == NULL || Count <= 0) {
+        return OsInvalidParameters;
+    }
+
+    for (i = 0; i < Count; i++) {
+        ThreadPoolJob_t* Job = ThreadPoolCreateJob(Function, Arguments[i]);
+        if (Job == NULL) {
+            while (First) {
+                Job = First->Next;
+                free(First);
+                First = Job;
+            }
+            return OsOutOfMemory;
+        }
+
+        if (Last == NULL) {
+            First = Job;
+        }
+        else {
+            Last->Next = Job;
+        }
+        Last = Job;
+    }
+    ThreadPoolSubmit(ThreadPool, First, Last, Count);
+    return OsSuccess;
 }
 
 /* ThreadPoolWait
@@ -416,21 +674,16 @@ ThreadPoolAddWork(
  * (probably the main program) will continue. */
 OsStatus_t
 ThreadPoolWait(
-    _In_ ThreadPool_t*          ThreadPool)
+    _In_ ThreadPool_t* ThreadPool)
 {
     if (ThreadPool == NULL) {
         return OsError;
     }
 
-    // Grab a hold of the mutex
     mtx_lock(&ThreadPool->ThreadLock);
-
-    // Now wait for all threads
-    while (ThreadPool->JobQueue.Length || ThreadPool->ThreadsWorking) {
+    while (atomic_load(&ThreadPool->JobsPending)) {
         cnd_wait(&ThreadPool->ThreadsIdle, &ThreadPool->ThreadLock);
     }
-
-    // Done, unlock again
     mtx_unlock(&ThreadPool->ThreadLock);
     return OsSuccess;
 }
@@ -441,7 +694,7 @@ ThreadPoolWait(
  * is called. */
 OsStatus_t
 ThreadPoolPause(
-    _In_ ThreadPool_t*          ThreadPool)
+    _In_ ThreadPool_t* ThreadPool)
 {
     int i;
 
@@ -451,7 +704,7 @@ ThreadPoolPause(
     }
 
     // Iterate and pause threads
-    for (i = 0; i < ThreadPool->ThreadsAlive; i++) {
+    for (i = 0; i < ThreadPool->ThreadCount; i++) {
         thrd_signal(ThreadPool->Threads[i]->Thread, SIGUSR1);
     }
     return OsSuccess;
@@ -462,7 +715,7 @@ ThreadPoolPause(
  * threadpool workers. */
 OsStatus_t
 ThreadPoolResume(
-    _In_ ThreadPool_t*          ThreadPool)
+    _In_ ThreadPool_t* ThreadPool)
 {
     if (ThreadPool == NULL) {
         return OsError;
@@ -476,13 +729,8 @@ ThreadPoolResume(
  * the whole threadpool to free up memory. */
 OsStatus_t
 ThreadPoolDestroy(
-    _In_ ThreadPool_t*          ThreadPool)
+    _In_ ThreadPool_t* ThreadPool)
 {
-    // Variables
-    volatile int ThreadsTotal;
-    double TimeOut      = 1.0;
-    double TimePassed   = 0.0;
-    time_t Start, End;
     int i;
 
     // Sanitize the parameters
@@ -490,31 +738,22 @@ ThreadPoolDestroy(
         return OsError;
     }
 
-    // Store information and end infinite loop
-    ThreadsTotal                    = ThreadPool->ThreadsAlive;
-    ThreadPool->ThreadsKeepAlive    = 0;
-
-    // Give it a second to shut-down threads
-    time(&Start);
-    while (TimePassed < TimeOut && ThreadPool->ThreadsAlive) {
-        BinarySemaphorePostAll(ThreadPool->JobQueue.HasJobs);
-        time(&End);
-        TimePassed = difftime(End, Start);
-    }
-
-    // Wait for remaining threads to shut-down
-    while (ThreadPool->ThreadsAlive) {
-        BinarySemaphorePostAll(ThreadPool->JobQueue.HasJobs);
+    // End the worker loops, and keep waking them up untill they are all gone
+    atomic_store(&ThreadPool->ThreadsKeepAlive, 0);
+    while (atomic_load(&ThreadPool->ThreadsAlive)) {
+        ThreadPoolSignalWork(ThreadPool, ThreadPool->ThreadCount);
         thrd_sleepex(1);
     }
 
     // Cleanup job-queue
     JobQueueDestroy(&ThreadPool->JobQueue);
-    for (i = 0; i < ThreadsTotal; i++) {
+    for (i = 0; i < ThreadPool->ThreadCount; i++) {
         ThreadPoolThreadDestroy(ThreadPool->Threads[i]);
     }
 
     // Cleanup
+    cnd_destroy(&ThreadPool->ThreadsIdle);
+    mtx_destroy(&ThreadPool->ThreadLock);
     free(ThreadPool->Threads);
     free(ThreadPool);
     return OsSuccess;
@@ -524,10 +763,38 @@ ThreadPoolDestroy(
  * Returns the number of working threads are the threads that are performing work (not idle). */
 size_t
 ThreadPoolGetWorkingCount(
-    _In_ ThreadPool_t*          ThreadPool)
+    _In_ ThreadPool_t* ThreadPool)
 {
     if (ThreadPool == NULL) {
         return 0;
     }
-    return ThreadPool->ThreadsWorking;
+    return (size_t)atomic_load(&ThreadPool->ThreadsWorking);
+}
+
+/* ThreadPoolGetWorkerCount
+ * Returns the number of worker threads in the pool. */
+int
+ThreadPoolGetWorkerCount(
+    _In_ ThreadPool_t* ThreadPool)
+{
+    if (ThreadPool == NULL) {
+        return 0;
+    }
+    return ThreadPool->ThreadCount;
+}
+
+/* ThreadPoolGetStatistics
+ * Retrieves a snapshot of the counters of the given worker. */
+OsStatus_t
+ThreadPoolGetStatistics(
+    _In_  ThreadPool_t*           ThreadPool,
+    _In_  int                     Worker,
+    _Out_ ThreadPoolStatistics_t* Statistics)
+{
+    if (ThreadPool == NULL || Statistics == NULL ||
+        Worker < 0 || Worker >= ThreadPool->ThreadCount) {
+        return OsInvalidParameters;
+    }
+    memcpy(Statistics, &ThreadPool->Threads[Worker]->Statistics, sizeof(ThreadPoolStatistics_t));
+    return OsSuccess;
 }
@@ -18,6 +18,9 @@
  *
  *
  * Generic Bitmap Implementation
+ *  - Free space is tracked by a hierarchy of summary bitmaps above the data and a cache of
+ *    the longest free run of each data word, so searches skip allocated regions in a few
+ *    word operations instead of testing every bit.
  */
 
 #include <os/osdefs.h>
@@ -25,8 +28,213 @@
 #include <ds/ds.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdatomic.h>
 #include <assert.h>
 
+#define BITMAP_RUN_UNKNOWN 0xFF
+#define BITMAP_WORDS(Bitmap) ((Bitmap)->SizeInBytes / sizeof(size_t))
+
+// The atomic functions modify words while others search them, so the search reads
+// every word that is shared with them through a relaxed load
+#define BITMAP_READ(Word)    atomic_load_explicit((_Atomic(size_t)*)&(Word), memory_order_relaxed)
+#define BITMAP_INVALIDATE_RUN(Bitmap, Word) \
+    atomic_store_explicit((_Atomic(uint8_t)*)&(Bitmap)->RunCache[Word], BITMAP_RUN_UNKNOWN, memory_order_relaxed)
+
+static inline int
+BitmapCtz(
+    _In_ size_t Value)
+{
+#if __BITS == 64
+    return __builtin_ctzll(Value);
+#else
+    return __builtin_ctz(Value);
+#endif
+}
+
+static inline int
+BitmapClz(
+    _In_ size_t Value)
+{
+#if __BITS == 64
+    return __builtin_clzll(Value);
+#else
+    return __builtin_clz(Value);
+#endif
+}
+
+static inline int
+BitmapPopcount(
+    _In_ size_t Value)
+{
+#if __BITS == 64
+    return __builtin_popcountll(Value);
+#else
+    return __builtin_popcount(Value);
+#endif
+}
+
+static inline size_t
+BitmapRangeMask(
+    _In_ int Offset,
+    _In_ int Count)
+{
+    return ((Count == __BITS) ? __MASK : (((size_t)1 << Count) - 1)) << Offset;
+}
+
+static int
+LongestFreeRun(
+    _In_ size_t Value)
+{
+    size_t Free   = ~Value;
+    int    Length = 0;
+
+    // Every iteration shortens each run of free bits by one
+    while (Free) {
+        Free &= Free >> 1;
+        Length++;
+    }
+    return Length;
+}
+
+/* FindRunInWord
+ * Returns the position of the first run of <Count> free bits in the word, or -1. After the
+ * loop a bit is only set if it starts a run of the requested length, the window doubles
+ * in size for every step. */
+static int
+FindRunInWord(
+    _In_ size_t Value,
+    _In_ int    Count)
+{
+    size_t Free   = ~Value;
+    int    Length = 1;
+
+    while (Free && Length < Count) {
+        int Shift = MIN(Length, Count - Length);
+        Free   &= Free >> Shift;
+        Length += Shift;
+    }
+    return Free ? BitmapCtz(Free) : -1;
+}
+
+static int
+GetLongestRun(
+    _In_ Bitmap_t* Bitmap,
+    _In_ size_t    Word)
+{
+    if (Bitmap->RunCache == NULL) {
+        return LongestFreeRun(Bitmap->Data[Word]);
+    }
+
+    if (Bitmap->RunCache[Word] == BITMAP_RUN_UNKNOWN) {
+        Bitmap->RunCache[Word] = (uint8_t)LongestFreeRun(Bitmap->Data[Word]);
+    }
+    return Bitmap->RunCache[Word];
+}
+
+static void
+FillSummary(
+    _In_ size_t* Summary,
+    _In_ size_t  BitCount)
+{
+    size_t i;
+
+    for (i = 0; i < (BitCount / __BITS); i++) {
+        Summary[i] = __MASK;
+    }
+    if (BitCount % __BITS) {
+        Summary[i] = ((size_t)1 << (BitCount % __BITS)) - 1;
+    }
+}
+
+/* UpdateSummaries
+ * Must be called after a data word has been modified. The change is propagated upwards
+ * for as long as the summary words change between zero and non-zero. */
+static void
+UpdateSummaries(
+    _In_ Bitmap_t* Bitmap,
+    _In_ size_t    Index)
+{
+    int HasFree = Bitmap->Data[Index] != __MASK;
+    int Level;
+
+    if (Bitmap->RunCache != NULL) {
+        Bitmap->RunCache[Index] = BITMAP_RUN_UNKNOWN;
+    }
+
+    for (Level = 0; Level < Bitmap->Levels; Level++) {
+        size_t* Word       = &Bitmap->Summaries[Level][Index / __BITS];
+        size_t  Bit        = (size_t)1 << (Index % __BITS);
+        int     WasNonZero = *Word != 0;
+
+        if (HasFree) {
+            *Word |= Bit;
+        }
+        else {
+            *Word &= ~Bit;
+        }
+
+        HasFree = *Word != 0;
+        if (HasFree == WasNonZero) {
+            break;
+        }
+        Index /= __BITS;
+    }
+}
+
+/* FindNextSummaryBit
+ * Locates the first set bit at or after <Index> in the given summary level, when a summary
+ * word is empty the level above is used to skip to the next non-empty word. The atomic
+ * functions only keep the summaries as hints, so an empty word is handled by searching on. */
+static int
+FindNextSummaryBit(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Level,
+    _In_ size_t    Index)
+{
+    size_t* Summary = Bitmap->Summaries[Level];
+    size_t  Word    = Index / __BITS;
+    size_t  Mask    = __MASK << (Index % __BITS);
+
+    while (Word < Bitmap->SummaryWords[Level]) {
+        size_t Value = BITMAP_READ(Summary[Word]) & Mask;
+        if (Value) {
+            return (int)((Word * __BITS) + BitmapCtz(Value));
+        }
+
+        if ((Level + 1) < Bitmap->Levels) {
+            int Next = FindNextSummaryBit(Bitmap, Level + 1, Word + 1);
+            if (Next < 0) {
+                break;
+            }
+            Word = (size_t)Next;
+        }
+        else {
+            Word++;
+        }
+        Mask = __MASK;
+    }
+    return -1;
+}
+
+static int
+FindNextFreeWord(
+    _In_ Bitmap_t* Bitmap,
+    _In_ size_t    Word)
+{
+    size_t Words = BITMAP_WORDS(Bitmap);
+
+    if (Bitmap->Levels != 0) {
+        return FindNextSummaryBit(Bitmap, 0, Word);
+    }
+
+    for (; Word < Words; Word++) {
+        if (BITMAP_READ(Bitmap->Data[Word]) != __MASK) {
+            return (int)Word;
+        }
+    }
+    return -1;
+}
+
 Bitmap_t*
 BitmapCreate(
     _In_ size_t Size)
@@ -57,17 +265,56 @@ BitmapConstruct(
     _In_ size_t*   Data,
     _In_ size_t    Size)
 {
+    size_t Words;
+    size_t TotalWords = 0;
+    size_t BitCount;
+    size_t* Storage;
+    int    i;
+    
     assert(Bitmap != NULL);
     assert(Data != NULL);
     assert(Size > 0);
 
     // Fill in data
     memset(Data, 0, Size);
-    Bitmap->Cleanup     = 0;
-    
+    memset(Bitmap, 0, sizeof(Bitmap_t));
     Bitmap->Data        = Data;
     Bitmap->SizeInBytes = Size;
     Bitmap->BitCount    = (Size * 8);
+
+    // Small bitmaps are cheaper to scan than to summarize
+    Words = BITMAP_WORDS(Bitmap);
+    if (Words <= BITMAP_FLAT_WORDS) {
+        return OsSuccess;
+    }
+
+    // Size the summary levels, each level has a bit per word in the level below, and we stop
+    // once a level fits in a single word
+    BitCount = Words;
+    while (BitCount > 1 && Bitmap->Levels < BITMAP_MAX_LEVELS) {
+        Bitmap->SummaryWords[Bitmap->Levels] = DIVUP(BitCount, __BITS);
+        BitCount    = Bitmap->SummaryWords[Bitmap->Levels++];
+        TotalWords += BitCount;
+    }
+
+    // The summaries and the run cache are optional, without them every word is visited
+    Storage = (size_t*)dsalloc((TotalWords * sizeof(size_t)) + Words);
+    if (!Storage) {
+        Bitmap->Levels = 0;
+        return OsSuccess;
+    }
+
+    BitCount = Words;
+    for (i = 0; i < Bitmap->Levels; i++) {
+        Bitmap->Summaries[i] = Storage;
+        memset(Storage, 0, Bitmap->SummaryWords[i] * sizeof(size_t));
+        FillSummary(Storage, BitCount);
+        BitCount = Bitmap->SummaryWords[i];
+        Storage += BitCount;
+    }
+
+    Bitmap->RunCache = (uint8_t*)Storage;
+    memset(Bitmap->RunCache, __BITS, Words);
     return OsSuccess;
 }
 
@@ -77,6 +324,12 @@ BitmapDestroy(
 {
     assert(Bitmap != NULL);
 
+    // The summaries are always ours
+    if (Bitmap->Levels != 0) {
+        dsfree((void*)Bitmap->Summaries[0]);
+        Bitmap->Levels = 0;
+    }
+
     // Should we cleanup bitmap?
     if (Bitmap->Cleanup != 0) {
         dsfree((void*)Bitmap->Data);
@@ -98,11 +351,11 @@ BitmapSetBits(
     int BitsLeft    = Count;
     int BitsSet     = 0;
     int NumberOfObjects;
-    int i, j;
+    int i;
     assert(Bitmap != NULL);
 
     // Get maximum number of iterations
-    NumberOfObjects = Bitmap->SizeInBytes / sizeof(size_t);
+    NumberOfObjects = BITMAP_WORDS(Bitmap);
     
     // Update the search index if the bits we are setting overlaps
     // on the search index
@@ -114,20 +367,14 @@ BitmapSetBits(
 
     // Iterate the block and flip bits
     for (i = BlockIndex; (i < NumberOfObjects) && (BitsLeft > 0); i++) {
-        if (Bitmap->Data[i] == 0 && BlockOffset == 0 && BitsLeft >= __BITS) {
-            Bitmap->Data[i] = __MASK;
-            BitsSet        += __BITS;
-            BitsLeft       -= __BITS;
-            continue;
-        }
+        int    Bits = MIN(__BITS - BlockOffset, BitsLeft);
+        size_t Mask = BitmapRangeMask(BlockOffset, Bits);
+
+        BitsSet         += BitmapPopcount(~Bitmap->Data[i] & Mask);
+        Bitmap->Data[i] |= Mask;
+        UpdateSummaries(Bitmap, i);
         
-        for (j = BlockOffset; (j < __BITS) && (BitsLeft > 0); j++, BitsLeft--) {
-            size_t Bit = (size_t)1 << j;
-            if (!(Bitmap->Data[i] & Bit)) {
-                Bitmap->Data[i] |= Bit;
-                BitsSet++;
-            }
-        }
+        BitsLeft   -= Bits;
         BlockOffset = 0;
     }
     return BitsSet;
@@ -146,11 +393,11 @@ BitmapClearBits(
     int BitsLeft    = Count;
     int BitsCleared = 0;
     int NumberOfObjects;
-    int i, j;
+    int i;
     assert(Bitmap != NULL);
 
     // Get maximum number of iterations
-    NumberOfObjects = Bitmap->SizeInBytes / sizeof(size_t);
+    NumberOfObjects = BITMAP_WORDS(Bitmap);
 
     // Update the search index if the range we are clearing comes before the search index
     if (SearchIndex != NULL && (*SearchIndex == -1 || Index < *SearchIndex)) {
@@ -159,20 +406,14 @@ BitmapClearBits(
     
     // Iterate the block and flip bits
     for (i = BlockIndex; (i < NumberOfObjects) && (BitsLeft > 0); i++) {
-        if (Bitmap->Data[i] == __MASK && BlockOffset == 0 && BitsLeft >= __BITS) {
-            Bitmap->Data[i] = 0;
-            BitsCleared    += __BITS;
-            BitsLeft       -= __BITS;
-            continue;
-        }
+        int    Bits = MIN(__BITS - BlockOffset, BitsLeft);
+        size_t Mask = BitmapRangeMask(BlockOffset, Bits);
+
+        BitsCleared     += BitmapPopcount(Bitmap->Data[i] & Mask);
+        Bitmap->Data[i] &= ~Mask;
+        UpdateSummaries(Bitmap, i);
         
-        for (j = BlockOffset; (j < __BITS) && (BitsLeft > 0); j++, BitsLeft--) {
-            size_t Bit = (size_t)1 << j;
-            if (Bitmap->Data[i] & Bit) {
-                Bitmap->Data[i] &= ~Bit;
-                BitsCleared++;
-            }
-        }
+        BitsLeft   -= Bits;
         BlockOffset = 0;
     }
     return BitsCleared;
@@ -189,25 +430,22 @@ BitmapAreBitsSet(
     int BlockOffset = Index % __BITS;
     int BitsLeft    = Count;
     int NumberOfObjects;
-    int i, j;
+    int i;
     assert(Bitmap != NULL);
     
     // Get maximum number of iterations
-    NumberOfObjects = Bitmap->SizeInBytes / sizeof(size_t);
+    NumberOfObjects = BITMAP_WORDS(Bitmap);
 
-    // Iterate the block and flip bits
+    // Iterate the blocks and test bits
     for (i = BlockIndex; (i < NumberOfObjects) && (BitsLeft > 0); i++) {
-        for (j = BlockOffset; j < __BITS && BitsLeft > 0; j++, BitsLeft--) {
-            size_t Bit = (size_t)1 << j;
-            if (!(Bitmap->Data[i] & Bit)) {
-                return 0;
-            }
+        int    Bits = MIN(__BITS - BlockOffset, BitsLeft);
+        size_t Mask = BitmapRangeMask(BlockOffset, Bits);
+        if ((Bitmap->Data[i] & Mask) != Mask) {
+            return 0;
         }
 
-        // Reset block offset
-        if (j == __BITS) {
-            BlockOffset = 0;
-        }
+        BitsLeft   -= Bits;
+        BlockOffset = 0;
     }
     return 1;
 }
@@ -223,95 +461,104 @@ BitmapAreBitsClear(
     int BlockOffset = Index % __BITS;
     int BitsLeft    = Count;
     int NumberOfObjects;
-    int i, j;
+    int i;
     assert(Bitmap != NULL);
 
     // Get maximum number of iterations
-    NumberOfObjects = Bitmap->SizeInBytes / sizeof(size_t);
+    NumberOfObjects = BITMAP_WORDS(Bitmap);
 
-    // Iterate the block and flip bits
+    // Iterate the blocks and test bits
     for (i = BlockIndex; (i < NumberOfObjects) && (BitsLeft > 0); i++) {
-        for (j = BlockOffset; j < __BITS && BitsLeft > 0; j++, BitsLeft--) {
-            size_t Bit = (size_t)1 << j;
-            if (Bitmap->Data[i] & Bit) {
-                return 0;
-            }
+        int    Bits = MIN(__BITS - BlockOffset, BitsLeft);
+        size_t Mask = BitmapRangeMask(BlockOffset, Bits);
+        if (Bitmap->Data[i] & Mask) {
+            return 0;
         }
 
-        // Reset block offset
-        if (j == __BITS) {
-            BlockOffset = 0;
-        }
+        BitsLeft   -= Bits;
+        BlockOffset = 0;
     }
     return 1;
 }
 
+/* BitmapFindBits
+ * Only words with free bits are visited, the summaries skip everything else. A run either
+ * fits inside a word, which the run cache tells us without looking at the bits, or it starts
+ * in the free tail of a word and continues through free words into the head of a later one. */
 int
 BitmapFindBits(
     _In_    Bitmap_t* Bitmap,
     _InOut_ int*      SearchIndex,
     _In_    int       Count)
 {
-    int NumberOfObjects;
-    int StartBit = -1;
-    int i = 0;
-    int j = 0;
-    int k;
+    size_t Words    = BITMAP_WORDS(Bitmap);
+    int    StartBit = -1;
+    int    Offset   = 0;
+    int    Word     = 0;
     assert(Bitmap != NULL);
-    
-    // Get maximum number of iterations
-    NumberOfObjects = Bitmap->SizeInBytes / sizeof(size_t);
+
+    if (Count <= 0) {
+        return -1;
+    }
     
     // Is the search index initialized?
     if (SearchIndex != NULL && *SearchIndex != -1) {
-        i = *SearchIndex / __BITS;
-        j = *SearchIndex % __BITS;
+        Word   = *SearchIndex / __BITS;
+        Offset = *SearchIndex % __BITS;
     }
 
-    // Iterate bits
-    for (; i < NumberOfObjects; i++) {
-        // Quick test, if all is allocated, damn
-        if (Bitmap->Data[i] == __MASK) {
-            continue;
-        }
+    while (1) {
+        int    Found = FindNextFreeWord(Bitmap, (size_t)Word);
+        size_t Value;
+        size_t Next;
+        int    Trailing;
+        int    Remaining;
 
-        // Test each bit in the value
-        for (; j < __BITS; j++) {
-            size_t CurrentBit = (size_t)1 << j;
-            if (Bitmap->Data[i] & CurrentBit) {
-                continue;
-            }
+        if (Found < 0) {
+            break;
+        }
 
-            // Ok, now we have to incremently make sure
-            // enough consecutive bits are free
-            for (k = 0; k < Count; k++) {
-                // Make sure we are still in same block
-                if ((j + k) >= __BITS) {
-                    int TempI   = i + ((j + k) / __BITS);
-                    int OffsetI = (j + k) % __BITS;
-                    if (Bitmap->Data[TempI] & ((size_t)1 << OffsetI)) {
-                        break;
-                    }
-                }
-                else {
-                    if (Bitmap->Data[i] & ((size_t)1 << (j + k))) {
-                        break;
-                    }
-                }
-            }
+        // Bits before the search index are treated as allocated
+        Value = Bitmap->Data[Found];
+        if (Found != Word) {
+            Offset = 0;
+        }
+        else if (Offset) {
+            Value |= ((size_t)1 << Offset) - 1;
+        }
+        Word = Found;
 
-            // If k == numblocks we've found free bits!
-            if (k == Count) {
-                StartBit = (int)(i * (sizeof(size_t) * 8) + j);
+        if (Count <= __BITS && (Offset || GetLongestRun(Bitmap, (size_t)Word) >= Count)) {
+            int Position = FindRunInWord(Value, Count);
+            if (Position >= 0) {
+                StartBit = (Word * __BITS) + Position;
                 break;
             }
         }
-        j = 0; // Reset j
+        Offset = 0;
+
+        // Otherwise the run has to start in the free tail of this word
+        Trailing = (Value == 0) ? __BITS : BitmapClz(Value);
+        if (!Trailing) {
+            Word++;
+            continue;
+        }
 
-        // Break out if we found start-bit
-        if (StartBit != -1) {
+        Remaining = Count - Trailing;
+        Next      = (size_t)Word + 1;
+        while (Remaining >= __BITS && Next < Words && Bitmap->Data[Next] == 0) {
+            Remaining -= __BITS;
+            Next++;
+        }
+
+        if (Remaining <= 0 || (Remaining < __BITS && Next < Words && 
+            (Bitmap->Data[Next] == 0 || BitmapCtz(Bitmap->Data[Next]) >= Remaining))) {
+            StartBit = ((Word + 1) * __BITS) - Trailing;
             break;
         }
+
+        // Runs starting in the free words we passed would also stop at <Next>
+        Word = (int)Next;
     }
     
     // Update search index
@@ -320,3 +567,114 @@ BitmapFindBits(
     }
     return StartBit;
 }
+
+static void
+SetSummaryHint(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Level,
+    _In_ size_t    Index)
+{
+    _Atomic(size_t)* Word = (_Atomic(size_t)*)&Bitmap->Summaries[Level][Index / __BITS];
+    size_t           Bit  = (size_t)1 << (Index % __BITS);
+
+    if (atomic_fetch_or(Word, Bit) == 0 && (Level + 1) < Bitmap->Levels) {
+        SetSummaryHint(Bitmap, Level + 1, Index / __BITS);
+    }
+}
+
+/* ClearSummaryHint
+ * Clearing races with a concurrent set of another bit in the same word. Whenever a word
+ * is cleared to zero the level above is cleared, and then the word is checked again, so
+ * the hint of a word with a set bit can only be missing for as long as the race lasts. */
+static void
+ClearSummaryHint(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Level,
+    _In_ size_t    Index)
+{
+    _Atomic(size_t)* Word = (_Atomic(size_t)*)&Bitmap->Summaries[Level][Index / __BITS];
+    size_t           Bit  = (size_t)1 << (Index % __BITS);
+
+    if ((atomic_fetch_and(Word, ~Bit) & ~Bit) == 0 && (Level + 1) < Bitmap->Levels) {
+        ClearSummaryHint(Bitmap, Level + 1, Index / __BITS);
+        if (atomic_load(Word) != 0) {
+            SetSummaryHint(Bitmap, Level + 1, Index / __BITS);
+        }
+    }
+}
+
+int
+BitmapAllocateBitAtomic(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       StartIndex)
+{
+    size_t Words   = BITMAP_WORDS(Bitmap);
+    size_t Start   = 0;
+    size_t Word;
+    int    Wrapped = 0;
+    int    Next;
+    assert(Bitmap != NULL);
+
+    if (StartIndex > 0 && (size_t)(StartIndex / __BITS) < Words) {
+        Start = (size_t)(StartIndex / __BITS);
+    }
+
+    Word = Start;
+    while (1) {
+        _Atomic(size_t)* Data;
+        size_t           Value;
+
+        Next = FindNextFreeWord(Bitmap, Word);
+        if (Next < 0 || (Wrapped && (size_t)Next >= Start)) {
+            if (Wrapped || Start == 0) {
+                break;
+            }
+            Wrapped = 1;
+            Word    = 0;
+            continue;
+        }
+
+        Data  = (_Atomic(size_t)*)&Bitmap->Data[Next];
+        Value = atomic_load(Data);
+        while (Value != __MASK) {
+            size_t Bit = ~Value & (Value + 1);
+            if (atomic_compare_exchange_weak(Data, &Value, Value | Bit)) {
+                if (Bitmap->RunCache != NULL) {
+                    BITMAP_INVALIDATE_RUN(Bitmap, Next);
+                }
+
+                // We filled the word, clear the hint and recheck in case of a racing free
+                if ((Value | Bit) == __MASK && Bitmap->Levels != 0) {
+                    ClearSummaryHint(Bitmap, 0, (size_t)Next);
+                    if (atomic_load(Data) != __MASK) {
+                        SetSummaryHint(Bitmap, 0, (size_t)Next);
+                    }
+                }
+                return (Next * __BITS) + BitmapCtz(Bit);
+            }
+        }
+        Word = (size_t)Next + 1;
+    }
+    return -1;
+}
+
+void
+BitmapFreeBitAtomic(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Index)
+{
+    size_t           Word = (size_t)Index / __BITS;
+    size_t           Bit  = (size_t)1 << (Index % __BITS);
+    _Atomic(size_t)* Data;
+    assert(Bitmap != NULL);
+    assert(Index >= 0 && Word < BITMAP_WORDS(Bitmap));
+
+    Data = (_Atomic(size_t)*)&Bitmap->Data[Word];
+    if (Bitmap->RunCache != NULL) {
+        BITMAP_INVALIDATE_RUN(Bitmap, Word);
+    }
+
+    if (atomic_fetch_and(Data, ~Bit) == __MASK && Bitmap->Levels != 0) {
+        SetSummaryHint(Bitmap, 0, Word);
+    }
+}
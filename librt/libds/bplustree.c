@@ -0,0 +1,690 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * B+ Tree Implementation
+ *  - Implements a B+ tree with wide nodes that keeps keys close together in memory, and
+ *    all values in linked leaves for cheap ordered scans. Useful for large keyed sets.
+ */
+
+#include <assert.h>
+#include <ds/ds.h>
+#include <ds/bplustree.h>
+#include <string.h>
+
+// A node is a few cache lines, the extra slot allows a node to overflow before it is split
+#define BP_MAX_KEYS  31
+#define BP_MIN_KEYS  (BP_MAX_KEYS / 2)
+#define BP_MAX_DEPTH 32
+
+#define TREE_LOCK   SYNC_LOCK(tree)
+#define TREE_UNLOCK SYNC_UNLOCK(tree)
+
+typedef struct bp_node {
+    int             leaf;
+    int             count;
+    struct bp_node* next; // leaves only, next leaf in order
+    void*           keys[BP_MAX_KEYS + 1];
+    union {
+        struct bp_node* children[BP_MAX_KEYS + 2];
+        void*           values[BP_MAX_KEYS + 1];
+    };
+} bp_node_t;
+
+void
+bp_tree_construct(
+    _In_ bp_tree_t* tree)
+{
+    bp_tree_construct_cmp(tree, rb_tree_cmp_default);
+}
+
+void
+bp_tree_construct_cmp(
+    _In_ bp_tree_t*     tree,
+    _In_ rb_tree_cmp_fn cmp_fn)
+{
+    assert(tree != NULL);
+    assert(cmp_fn != NULL);
+
+    tree->root  = NULL;
+    tree->cmp   = cmp_fn;
+    tree->count = 0;
+    SYNC_INIT_FN(tree);
+}
+
+static bp_node_t*
+create_node(
+    _In_ int leaf)
+{
+    bp_node_t* node = dsalloc(sizeof(bp_node_t));
+    if (node) {
+        memset(node, 0, sizeof(bp_node_t));
+        node->leaf = leaf;
+    }
+    return node;
+}
+
+static void
+destroy_node(
+    _In_ bp_node_t* node)
+{
+    int i;
+    if (!node->leaf) {
+        for (i = 0; i <= node->count; i++) {
+            destroy_node(node->children[i]);
+        }
+    }
+    dsfree(node);
+}
+
+void
+bp_tree_destroy(
+    _In_ bp_tree_t* tree)
+{
+    if (!tree) {
+        return;
+    }
+
+    TREE_LOCK;
+    if (tree->root) {
+        destroy_node(tree->root);
+    }
+    tree->root  = NULL;
+    tree->count = 0;
+    TREE_UNLOCK;
+}
+
+// Returns the index of the first key that is not below the key
+static int
+search_leaf(
+    _In_  bp_tree_t* tree,
+    _In_  bp_node_t* node,
+    _In_  void*      key,
+    _Out_ int*       found)
+{
+    int low  = 0;
+    int high = node->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (tree->cmp(node->keys[middle], key) < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    *found = (low < node->count && tree->cmp(node->keys[low], key) == 0);
+    return low;
+}
+
+// Returns the index of the child that covers the key. Separators are the lowest key
+// of the subtree to their right, so this is the index of the first key above the key
+static int
+search_child(
+    _In_ bp_tree_t* tree,
+    _In_ bp_node_t* node,
+    _In_ void*      key)
+{
+    int low  = 0;
+    int high = node->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (tree->cmp(node->keys[middle], key) <= 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static bp_node_t*
+find_leaf(
+    _In_      bp_tree_t*  tree,
+    _In_      void*       key,
+    _Out_Opt_ bp_node_t** path,
+    _Out_Opt_ int*        path_index,
+    _Out_Opt_ int*        depth_out)
+{
+    bp_node_t* node  = tree->root;
+    int        depth = 0;
+
+    while (!node->leaf) {
+        int index = search_child(tree, node, key);
+        if (path) {
+            path[depth]       = node;
+            path_index[depth] = index;
+        }
+        depth++;
+        node = node->children[index];
+    }
+
+    if (depth_out) {
+        *depth_out = depth;
+    }
+    return node;
+}
+
+OsStatus_t
+bp_tree_append(
+    _In_ bp_tree_t* tree,
+    _In_ void*      key,
+    _In_ void*      value)
+{
+    bp_node_t* path[BP_MAX_DEPTH];
+    int        path_index[BP_MAX_DEPTH];
+    bp_node_t* spare[BP_MAX_DEPTH + 1];
+    int        spare_count = 0;
+    bp_node_t* node;
+    int        depth, position, found, i;
+
+    if (!tree) {
+        return OsInvalidParameters;
+    }
+
+    TREE_LOCK;
+    if (!tree->root) {
+        tree->root = create_node(1);
+        if (!tree->root) {
+            TREE_UNLOCK;
+            return OsOutOfMemory;
+        }
+    }
+
+    node     = find_leaf(tree, key, &path[0], &path_index[0], &depth);
+    position = search_leaf(tree, node, key, &found);
+    if (found) {
+        TREE_UNLOCK;
+        return OsExists;
+    }
+
+    // Allocate the nodes needed for splitting up front, so the tree is never left
+    // half-split. Every full node on the path splits, and a full root adds a level.
+    if (node->count == BP_MAX_KEYS) {
+        int needed = 1;
+        for (i = depth - 1; i >= 0 && path[i]->count == BP_MAX_KEYS; i--) {
+            needed++;
+        }
+        if (i < 0) {
+            needed++;
+        }
+
+        for (i = 0; i < needed; i++) {
+            spare[spare_count] = create_node(0);
+            if (!spare[spare_count]) {
+                while (spare_count--) {
+                    dsfree(spare[spare_count]);
+                }
+                TREE_UNLOCK;
+                return OsOutOfMemory;
+            }
+            spare_count++;
+        }
+    }
+
+    memmove(&node->keys[position + 1], &node->keys[position], (node->count - position) * sizeof(void*));
+    memmove(&node->values[position + 1], &node->values[position], (node->count - position) * sizeof(void*));
+    node->keys[position]   = key;
+    node->values[position] = value;
+    node->count++;
+    tree->count++;
+
+    while (node->count > BP_MAX_KEYS) {
+        bp_node_t* right     = spare[--spare_count];
+        void*      separator;
+        bp_node_t* parent;
+        int        split;
+
+        right->leaf = node->leaf;
+        if (node->leaf) {
+            split        = node->count / 2;
+            right->count = node->count - split;
+            memcpy(&right->keys[0], &node->keys[split], right->count * sizeof(void*));
+            memcpy(&right->values[0], &node->values[split], right->count * sizeof(void*));
+            right->next  = node->next;
+            node->next   = right;
+            node->count  = split;
+            separator    = right->keys[0];
+        }
+        else {
+            // The middle key moves up and is not kept in either half
+            split        = node->count / 2;
+            separator    = node->keys[split];
+            right->count = node->count - split - 1;
+            memcpy(&right->keys[0], &node->keys[split + 1], right->count * sizeof(void*));
+            memcpy(&right->children[0], &node->children[split + 1], (right->count + 1) * sizeof(bp_node_t*));
+            node->count  = split;
+        }
+
+        if (depth == 0) {
+            parent              = spare[--spare_count];
+            parent->leaf        = 0;
+            parent->count       = 1;
+            parent->keys[0]     = separator;
+            parent->children[0] = node;
+            parent->children[1] = right;
+            tree->root          = parent;
+            break;
+        }
+
+        depth--;
+        parent   = path[depth];
+        position = path_index[depth];
+        memmove(&parent->keys[position + 1], &parent->keys[position], (parent->count - position) * sizeof(void*));
+        memmove(&parent->children[position + 2], &parent->children[position + 1],
+            (parent->count - position) * sizeof(bp_node_t*));
+        parent->keys[position]         = separator;
+        parent->children[position + 1] = right;
+        parent->count++;
+        node = parent;
+    }
+    TREE_UNLOCK;
+    return OsSuccess;
+}
+
+void*
+bp_tree_lookup_value(
+    _In_ bp_tree_t* tree,
+    _In_ void*      key)
+{
+    bp_node_t* node;
+    void*      value = NULL;
+    int        position, found;
+    assert(tree != NULL);
+
+    TREE_LOCK;
+    if (tree->root) {
+        node     = find_leaf(tree, key, NULL, NULL, NULL);
+        position = search_leaf(tree, node, key, &found);
+        if (found) {
+            value = node->values[position];
+        }
+    }
+    TREE_UNLOCK;
+    return value;
+}
+
+static void
+borrow_from_left(
+    _In_ bp_node_t* parent,
+    _In_ int        index,
+    _In_ bp_node_t* left,
+    _In_ bp_node_t* node)
+{
+    memmove(&node->keys[1], &node->keys[0], node->count * sizeof(void*));
+    if (node->leaf) {
+        memmove(&node->values[1], &node->values[0], node->count * sizeof(void*));
+        node->keys[0]        = left->keys[left->count - 1];
+        node->values[0]      = left->values[left->count - 1];
+        parent->keys[index - 1] = node->keys[0];
+    }
+    else {
+        // Rotate through the parent, the separator comes down and the last key of left goes up
+        memmove(&node->children[1], &node->children[0], (node->count + 1) * sizeof(bp_node_t*));
+        node->keys[0]           = parent->keys[index - 1];
+        node->children[0]       = left->children[left->count];
+        parent->keys[index - 1] = left->keys[left->count - 1];
+    }
+    left->count--;
+    node->count++;
+}
+
+static void
+borrow_from_right(
+    _In_ bp_node_t* parent,
+    _In_ int        index,
+    _In_ bp_node_t* node,
+    _In_ bp_node_t* right)
+{
+    if (node->leaf) {
+        node->keys[node->count]   = right->keys[0];
+        node->values[node->count] = right->values[0];
+        memmove(&right->keys[0], &right->keys[1], (right->count - 1) * sizeof(void*));
+        memmove(&right->values[0], &right->values[1], (right->count - 1) * sizeof(void*));
+        parent->keys[index] = right->keys[0];
+    }
+    else {
+        node->keys[node->count]         = parent->keys[index];
+        node->children[node->count + 1] = right->children[0];
+        parent->keys[index]             = right->keys[0];
+        memmove(&right->keys[0], &right->keys[1], (right->count - 1) * sizeof(void*));
+        memmove(&right->children[0], &right->children[1], right->count * sizeof(bp_node_t*));
+    }
+    node->count++;
+    right->count--;
+}
+
+// Merges right into left, they are children index and index + 1 of the parent
+static void
+merge_nodes(
+    _In_ bp_node_t* parent,
+    _In_ int        index,
+    _In_ bp_node_t* left,
+    _In_ bp_node_t* right)
+{
+    if (left->leaf) {
+        memcpy(&left->keys[left->count], &right->keys[0], right->count * sizeof(void*));
+        memcpy(&left->values[left->count], &right->values[0], right->count * sizeof(void*));
+        left->count += right->count;
+        left->next   = right->next;
+    }
+    else {
+        left->keys[left->count] = parent->keys[index];
+        memcpy(&left->keys[left->count + 1], &right->keys[0], right->count * sizeof(void*));
+        memcpy(&left->children[left->count + 1], &right->children[0], (right->count + 1) * sizeof(bp_node_t*));
+        left->count += right->count + 1;
+    }
+
+    memmove(&parent->keys[index], &parent->keys[index + 1], (parent->count - index - 1) * sizeof(void*));
+    memmove(&parent->children[index + 1], &parent->children[index + 2],
+        (parent->count - index - 1) * sizeof(bp_node_t*));
+    parent->count--;
+    dsfree(right);
+}
+
+OsStatus_t
+bp_tree_remove(
+    _In_  bp_tree_t* tree,
+    _In_  void*      key,
+    _Out_ void**     value_out)
+{
+    bp_node_t* path[BP_MAX_DEPTH];
+    int        path_index[BP_MAX_DEPTH];
+    bp_node_t* node;
+    int        depth, position, found;
+
+    if (!tree) {
+        return OsInvalidParameters;
+    }
+
+    TREE_LOCK;
+    if (!tree->root) {
+        TREE_UNLOCK;
+        return OsDoesNotExist;
+    }
+
+    node     = find_leaf(tree, key, &path[0], &path_index[0], &depth);
+    position = search_leaf(tree, node, key, &found);
+    if (!found) {
+        TREE_UNLOCK;
+        return OsDoesNotExist;
+    }
+
+    if (value_out) {
+        *value_out = node->values[position];
+    }
+    memmove(&node->keys[position], &node->keys[position + 1], (node->count - position - 1) * sizeof(void*));
+    memmove(&node->values[position], &node->values[position + 1], (node->count - position - 1) * sizeof(void*));
+    node->count--;
+    tree->count--;
+
+    // Separators may still name the removed key, which is fine as they only need to
+    // partition the keys. Rebalance upwards while nodes are below the minimum.
+    while (depth > 0 && node->count < BP_MIN_KEYS) {
+        bp_node_t* parent = path[depth - 1];
+        int        index  = path_index[depth - 1];
+        bp_node_t* left   = (index > 0) ? parent->children[index - 1] : NULL;
+        bp_node_t* right  = (index < parent->count) ? parent->children[index + 1] : NULL;
+
+        if (left && left->count > BP_MIN_KEYS) {
+            borrow_from_left(parent, index, left, node);
+            break;
+        }
+        if (right && right->count > BP_MIN_KEYS) {
+            borrow_from_right(parent, index, node, right);
+            break;
+        }
+
+        if (left) {
+            merge_nodes(parent, index - 1, left, node);
+        }
+        else {
+            merge_nodes(parent, index, node, right);
+        }
+        node = parent;
+        depth--;
+    }
+
+    // Shrink the tree when the root runs empty
+    if (!tree->root->leaf && tree->root->count == 0) {
+        bp_node_t* root = tree->root;
+        tree->root = root->children[0];
+        dsfree(root);
+    }
+    else if (tree->root->leaf && tree->root->count == 0) {
+        dsfree(tree->root);
+        tree->root = NULL;
+    }
+    TREE_UNLOCK;
+    return OsSuccess;
+}
+
+OsStatus_t
+bp_tree_build(
+    _In_ bp_tree_t* tree,
+    _In_ void**     keys,
+    _In_ void**     values,
+    _In_ size_t     count)
+{
+    bp_node_t** nodes;
+    void**      lowest;
+    size_t      node_count, allocated = 0, i, j, k;
+
+    if (!tree || (count && (!keys || !values))) {
+        return OsInvalidParameters;
+    }
+
+    for (i = 1; i < count; i++) {
+        if (tree->cmp(keys[i - 1], keys[i]) >= 0) {
+            return OsInvalidParameters;
+        }
+    }
+
+    TREE_LOCK;
+    if (tree->root) {
+        TREE_UNLOCK;
+        return OsExists;
+    }
+    if (!count) {
+        TREE_UNLOCK;
+        return OsSuccess;
+    }
+
+    // Keep every node created in one array, the levels above the leaves need less
+    // than half as many nodes as the level below. The lowest key of every node at the
+    // current level is kept on the side as they are the separators of the next level.
+    node_count = DIVUP(count, BP_MAX_KEYS);
+    nodes      = dsalloc((node_count * 2 + 1) * sizeof(bp_node_t*));
+    lowest     = dsalloc(node_count * sizeof(void*));
+    if (!nodes || !lowest) {
+        goto no_memory;
+    }
+
+    // Spread the keys evenly over the leaves, which keeps all of them above the minimum
+    for (i = 0, k = 0; i < node_count; i++) {
+        bp_node_t* leaf = create_node(1);
+        if (!leaf) {
+            goto no_memory;
+        }
+        nodes[allocated++] = leaf;
+        leaf->count = (int)((count / node_count) + ((i < (count % node_count)) ? 1 : 0));
+        memcpy(&leaf->keys[0], &keys[k], leaf->count * sizeof(void*));
+        memcpy(&leaf->values[0], &values[k], leaf->count * sizeof(void*));
+        lowest[i] = keys[k];
+        k += leaf->count;
+        if (i) {
+            nodes[allocated - 2]->next = leaf;
+        }
+    }
+
+    // Build internal levels until a single node remains
+    while (node_count > 1) {
+        bp_node_t** level        = &nodes[allocated - node_count];
+        size_t      parent_count = DIVUP(node_count, (BP_MAX_KEYS + 1));
+
+        for (i = 0, k = 0; i < parent_count; i++) {
+            size_t     children = (node_count / parent_count) + ((i < (node_count % parent_count)) ? 1 : 0);
+            bp_node_t* parent   = create_node(0);
+            if (!parent) {
+                goto no_memory;
+            }
+            nodes[allocated++] = parent;
+
+            parent->count = (int)(children - 1);
+            for (j = 0; j < children; j++) {
+                parent->children[j] = level[k + j];
+                if (j) {
+                    parent->keys[j - 1] = lowest[k + j];
+                }
+            }
+            lowest[i] = lowest[k];
+            k += children;
+        }
+        node_count = parent_count;
+    }
+
+    tree->root  = nodes[allocated - 1];
+    tree->count = count;
+    TREE_UNLOCK;
+    dsfree(lowest);
+    dsfree(nodes);
+    return OsSuccess;
+
+no_memory:
+    if (nodes) {
+        while (allocated--) {
+            dsfree(nodes[allocated]);
+        }
+        dsfree(nodes);
+    }
+    if (lowest) {
+        dsfree(lowest);
+    }
+    TREE_UNLOCK;
+    return OsOutOfMemory;
+}
+
+static OsStatus_t
+set_iterator(
+    _In_ bp_tree_iterator_t* iterator,
+    _In_ bp_node_t*          node,
+    _In_ int                 index)
+{
+    // Step to the next leaf if the position is past the end of this one
+    if (node && index >= node->count) {
+        node  = node->next;
+        index = 0;
+    }
+
+    iterator->node  = node;
+    iterator->index = index;
+    if (!node) {
+        iterator->key   = NULL;
+        iterator->value = NULL;
+        return OsDoesNotExist;
+    }
+
+    iterator->key   = node->keys[index];
+    iterator->value = node->values[index];
+    return OsSuccess;
+}
+
+OsStatus_t
+bp_tree_first(
+    _In_  bp_tree_t*          tree,
+    _Out_ bp_tree_iterator_t* iterator)
+{
+    bp_node_t* node;
+    OsStatus_t status;
+
+    if (!tree || !iterator) {
+        return OsInvalidParameters;
+    }
+
+    TREE_LOCK;
+    node = tree->root;
+    while (node && !node->leaf) {
+        node = node->children[0];
+    }
+    status = set_iterator(iterator, node, 0);
+    TREE_UNLOCK;
+    return status;
+}
+
+static OsStatus_t
+find_bound(
+    _In_  bp_tree_t*          tree,
+    _In_  void*               key,
+    _In_  int                 inclusive,
+    _Out_ bp_tree_iterator_t* iterator)
+{
+    bp_node_t* node;
+    OsStatus_t status;
+    int        position, found;
+
+    if (!tree || !iterator) {
+        return OsInvalidParameters;
+    }
+
+    TREE_LOCK;
+    if (!tree->root) {
+        status = set_iterator(iterator, NULL, 0);
+    }
+    else {
+        node     = find_leaf(tree, key, NULL, NULL, NULL);
+        position = search_leaf(tree, node, key, &found);
+        if (found && !inclusive) {
+            position++;
+        }
+        status = set_iterator(iterator, node, position);
+    }
+    TREE_UNLOCK;
+    return status;
+}
+
+OsStatus_t
+bp_tree_lower_bound(
+    _In_  bp_tree_t*          tree,
+    _In_  void*               key,
+    _Out_ bp_tree_iterator_t* iterator)
+{
+    return find_bound(tree, key, 1, iterator);
+}
+
+OsStatus_t
+bp_tree_upper_bound(
+    _In_  bp_tree_t*          tree,
+    _In_  void*               key,
+    _Out_ bp_tree_iterator_t* iterator)
+{
+    return find_bound(tree, key, 0, iterator);
+}
+
+OsStatus_t
+bp_tree_next(
+    _In_ bp_tree_iterator_t* iterator)
+{
+    if (!iterator || !iterator->node) {
+        return OsDoesNotExist;
+    }
+    return set_iterator(iterator, iterator->node, iterator->index + 1);
+}
@@ -24,11 +24,23 @@
 
 #include <ds/dsdefs.h>
 
+// The summaries are a hierarchy above the data, a set bit in level 0 means the data word
+// below it has at least one free bit, a set bit in level n means the level n-1 word below it
+// is non-zero. The search only has to visit words that actually have free bits.
+#define BITMAP_MAX_LEVELS 6
+
+// Bitmaps of up to this many words have no summaries, so constructing them never allocates
+#define BITMAP_FLAT_WORDS __BITS
+
 typedef struct {
-    int     Cleanup;
-    size_t  SizeInBytes;
-    size_t  BitCount;
-	size_t* Data;
+    int      Cleanup;
+    size_t   SizeInBytes;
+    size_t   BitCount;
+    size_t*  Data;
+    int      Levels;
+    size_t*  Summaries[BITMAP_MAX_LEVELS];
+    size_t   SummaryWords[BITMAP_MAX_LEVELS];
+    uint8_t* RunCache;
 } Bitmap_t;
 
 /* BitmapCreate
@@ -42,7 +54,9 @@ BitmapCreate(
 /* BitmapConstruct
  * Creates a bitmap of the given size in bytes, the actual available
  * member count will then be Size * sizeof(byte). This uses user-provided
- * resources, and won't be cleaned up. */
+ * resources, and won't be cleaned up. The search summaries of bitmaps larger than
+ * BITMAP_FLAT_WORDS words are allocated by the library, if that fails the bitmap still
+ * works but searches visit every word. */
 DSDECL(OsStatus_t,
 BitmapConstruct(
     _In_ Bitmap_t* Bitmap,
@@ -102,4 +116,20 @@ BitmapFindBits(
     _InOut_ int*      SearchIndex,
     _In_    int       Count));
 
+/* BitmapAllocateBitAtomic
+ * Lock-free allocation of a single bit, the search starts at StartIndex and wraps
+ * around. Returns the index of the bit claimed, or -1 if the bitmap is full. The atomic
+ * functions must not be mixed with the other modifiers without external locking. */
+DSDECL(int,
+BitmapAllocateBitAtomic(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       StartIndex));
+
+/* BitmapFreeBitAtomic
+ * Lock-free release of a single bit previously claimed by BitmapAllocateBitAtomic. */
+DSDECL(void,
+BitmapFreeBitAtomic(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Index));
+
 #endif //!__BITMAP_H__
@@ -0,0 +1,161 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * B+ Tree Implementation
+ *  - Implements a B+ tree with wide nodes that keeps keys close together in memory, and
+ *    all values in linked leaves for cheap ordered scans. Useful for large keyed sets.
+ */
+
+#ifndef __LIBDS_BPLUSTREE_H__
+#define __LIBDS_BPLUSTREE_H__
+
+#include <ds/dsdefs.h>
+#include <ds/shared.h>
+#include <ds/rbtree.h>
+
+struct bp_node;
+
+typedef struct bp_tree {
+    struct bp_node* root;
+    rb_tree_cmp_fn  cmp;
+    size_t          count;
+    syncobject_t    lock;
+} bp_tree_t;
+
+typedef struct bp_tree_iterator {
+    struct bp_node* node;
+    int             index;
+    void*           key;
+    void*           value;
+} bp_tree_iterator_t;
+
+#define BP_TREE_INIT { NULL, rb_tree_cmp_default, 0, SYNC_INIT }
+
+/** 
+ * bp_tree_construct
+ * * Constructs and initializes a new B+ tree. The comparators are shared with the
+ *   red-black tree, and so is the convention that keys are compared as (tree key, key).
+ * @param BPTree [In] The tree to initialize, must be allocated.
+ */
+DSDECL(void,
+bp_tree_construct(
+    _In_ bp_tree_t*));
+
+DSDECL(void,
+bp_tree_construct_cmp(
+    _In_ bp_tree_t*,
+    _In_ rb_tree_cmp_fn));
+
+/** 
+ * bp_tree_destroy
+ * * Frees all nodes of the tree. Keys and values are not touched.
+ * @param BPTree [In] The tree to destroy.
+ */
+DSDECL(void,
+bp_tree_destroy(
+    _In_ bp_tree_t*));
+
+/** 
+ * bp_tree_append
+ * * Adds a new key to the tree, the key must not exist already.
+ * @param BPTree [In] The tree to add the key to.
+ * @param Key    [In] The key to add.
+ * @param Value  [In] The value stored with the key.
+ */
+DSDECL(OsStatus_t,
+bp_tree_append(
+    _In_ bp_tree_t*,
+    _In_ void*,
+    _In_ void*));
+
+/** 
+ * bp_tree_lookup_value
+ * * Looks up the value of the provided key, returns NULL if it does not exist.
+ * @param BPTree [In] The tree to perform the lookup in.
+ * @param Key    [In] The key to lookup.
+ */
+DSDECL(void*,
+bp_tree_lookup_value(
+    _In_ bp_tree_t*,
+    _In_ void*));
+
+/** 
+ * bp_tree_remove
+ * * Removes the provided key from the tree.
+ * @param BPTree   [In]  The tree to remove the key from.
+ * @param Key      [In]  The key to remove.
+ * @param ValueOut [Out] Optional, receives the value that was stored with the key.
+ */
+DSDECL(OsStatus_t,
+bp_tree_remove(
+    _In_  bp_tree_t*,
+    _In_  void*,
+    _Out_ void**));
+
+/** 
+ * bp_tree_build
+ * * Builds the tree from keys in strictly increasing order in linear time. The tree must be empty.
+ * @param BPTree [In] The tree to build.
+ * @param Keys   [In] Array of keys, in sorted order.
+ * @param Values [In] Array of values, in the same order as the keys.
+ * @param Count  [In] Number of entries in the arrays.
+ */
+DSDECL(OsStatus_t,
+bp_tree_build(
+    _In_ bp_tree_t*,
+    _In_ void**,
+    _In_ void**,
+    _In_ size_t));
+
+/** 
+ * bp_tree_first/bp_tree_lower_bound/bp_tree_upper_bound
+ * * Positions an iterator at the first entry, the first entry with a key equal to or above
+ *   the provided key, or the first entry strictly above the provided key. Returns
+ *   OsDoesNotExist if there is no such entry. The tree must not be modified while iterating.
+ * @param BPTree   [In]  The tree to iterate.
+ * @param Key      [In]  The key to compare against.
+ * @param Iterator [Out] The iterator to position.
+ */
+DSDECL(OsStatus_t,
+bp_tree_first(
+    _In_  bp_tree_t*,
+    _Out_ bp_tree_iterator_t*));
+
+DSDECL(OsStatus_t,
+bp_tree_lower_bound(
+    _In_  bp_tree_t*,
+    _In_  void*,
+    _Out_ bp_tree_iterator_t*));
+
+DSDECL(OsStatus_t,
+bp_tree_upper_bound(
+    _In_  bp_tree_t*,
+    _In_  void*,
+    _Out_ bp_tree_iterator_t*));
+
+/** 
+ * bp_tree_next
+ * * Moves the iterator to the next entry in order. Returns OsDoesNotExist at the end.
+ * @param Iterator [In] The iterator to advance.
+ */
+DSDECL(OsStatus_t,
+bp_tree_next(
+    _In_ bp_tree_iterator_t*));
+
+#endif //!__LIBDS_BPLUSTREE_H__
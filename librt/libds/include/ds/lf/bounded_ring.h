@@ -0,0 +1,57 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Ring Implementation
+ *  - Implements a bounded multiple-producer, multiple-consumer ring. Every slot carries
+ *    a sequence number that tells producers and consumers whose turn it is.
+ */
+
+#ifndef __DS_LF_BOUNDED_RING_H__
+#define __DS_LF_BOUNDED_RING_H__
+
+#include <ds/dsdefs.h>
+#include <ds/shared.h>
+
+#define LF_RING_CACHELINE 64
+
+struct lf_bounded_ring_cell {
+    _Atomic(size_t) sequence;
+    void*           value;
+};
+
+typedef struct lf_bounded_ring {
+    struct lf_bounded_ring_cell* cells;
+    size_t                       mask;
+    uint8_t                      pad0[LF_RING_CACHELINE - sizeof(void*) - sizeof(size_t)];
+    _Atomic(size_t)              enqueue_position;
+    uint8_t                      pad1[LF_RING_CACHELINE - sizeof(size_t)];
+    _Atomic(size_t)              dequeue_position;
+    uint8_t                      pad2[LF_RING_CACHELINE - sizeof(size_t)];
+} lf_bounded_ring_t;
+
+_CODE_BEGIN
+
+DSDECL(int,   lf_bounded_ring_construct(lf_bounded_ring_t*, int));
+DSDECL(void,  lf_bounded_ring_destroy(lf_bounded_ring_t*));
+DSDECL(int,   lf_bounded_ring_push(lf_bounded_ring_t*, void*));
+DSDECL(void*, lf_bounded_ring_pop(lf_bounded_ring_t*));
+
+_CODE_END
+
+#endif //!__DS_LF_BOUNDED_RING_H__
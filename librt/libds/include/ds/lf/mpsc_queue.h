@@ -0,0 +1,50 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Queue Implementation
+ *  - Implements an intrusive multiple-producer, single-consumer queue. Producers
+ *    never wait on each other, pushing is a single atomic exchange.
+ */
+
+#ifndef __DS_LF_MPSC_QUEUE_H__
+#define __DS_LF_MPSC_QUEUE_H__
+
+#include <ds/dsdefs.h>
+#include <ds/shared.h>
+
+typedef struct lf_mpsc_node {
+    _Atomic(struct lf_mpsc_node*) next;
+} lf_mpsc_node_t;
+
+typedef struct lf_mpsc_queue {
+    _Atomic(lf_mpsc_node_t*) head; // producers push here
+    lf_mpsc_node_t*          tail; // only touched by the consumer
+    lf_mpsc_node_t           stub;
+} lf_mpsc_queue_t;
+
+_CODE_BEGIN
+
+DSDECL(void,            lf_mpsc_queue_construct(lf_mpsc_queue_t*));
+DSDECL(void,            lf_mpsc_queue_push(lf_mpsc_queue_t*, lf_mpsc_node_t*));
+DSDECL(lf_mpsc_node_t*, lf_mpsc_queue_pop(lf_mpsc_queue_t*));
+DSDECL(int,             lf_mpsc_queue_empty(lf_mpsc_queue_t*));
+
+_CODE_END
+
+#endif //!__DS_LF_MPSC_QUEUE_H__
@@ -0,0 +1,54 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Stack Implementation
+ *  - Implements an intrusive, unbounded lockfree stack. The head is a tagged pointer
+ *    that is updated with a double-width compare and swap to avoid ABA issues. Nodes
+ *    can be read after they have been popped, so their memory must remain valid.
+ */
+
+#ifndef __DS_LF_STACK_H__
+#define __DS_LF_STACK_H__
+
+#include <ds/dsdefs.h>
+#include <ds/shared.h>
+
+typedef struct lf_stack_node {
+    struct lf_stack_node* next;
+} lf_stack_node_t;
+
+struct lf_stack_head {
+    uintptr_t        aba;
+    lf_stack_node_t* node;
+};
+
+typedef struct lf_stack {
+    _Atomic(struct lf_stack_head) head;
+} lf_stack_t;
+
+_CODE_BEGIN
+
+DSDECL(void,             lf_stack_construct(lf_stack_t*));
+DSDECL(void,             lf_stack_push(lf_stack_t*, lf_stack_node_t*));
+DSDECL(lf_stack_node_t*, lf_stack_pop(lf_stack_t*));
+DSDECL(int,              lf_stack_empty(lf_stack_t*));
+
+_CODE_END
+
+#endif //!__DS_LF_STACK_H__
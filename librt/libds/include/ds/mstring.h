@@ -51,6 +51,12 @@ DSDECL(void,       MStringReset(MString_t* String, const char* NewString, MStrin
 DSDECL(void,       MStringCopy(MString_t* Destination, MString_t* Source, int DestinationIndex, int SourceIndex, int Length));
 DSDECL(void,       MStringDestroy(MString_t* String));
 
+/* MStringIntern
+ * Returns the shared instance for the given UTF-8 characters, creating it on first use. Interned
+ * strings live as long as the process, must not be modified and are ignored by MStringDestroy.
+ * Two interned strings with the same content are the same pointer. */
+DSDECL(MString_t*, MStringIntern(const char* Data, size_t Length));
+
 // Append Character to a given string the character is assumed to be either ASCII, UTF16 or UTF32
 DSDECL(void, MStringAppend(MString_t* Destination, MString_t* String));
 DSDECL(void, MStringAppendCharacter(MString_t* String, mchar_t Character));
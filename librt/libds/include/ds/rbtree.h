@@ -105,6 +105,63 @@ DSDECL(rb_leaf_t*,
 rb_tree_minimum(
 	_In_ rb_tree_t*));
 
+/** 
+ * rb_tree_maximum
+ * * Retrieves the item with the highest value.
+ * @param RBTree [In] The red-black tree to perform the lookup in.
+ */
+DSDECL(rb_leaf_t*,
+rb_tree_maximum(
+	_In_ rb_tree_t*));
+
+/** 
+ * rb_tree_next/rb_tree_prev
+ * * Retrieves the in-order successor or predecessor of an item in the tree. Returns NULL
+ *   at the end. The tree must not be modified while iterating.
+ * @param RBTree [In] The red-black tree the item belongs to.
+ * @param Leaf   [In] The item to step from.
+ */
+DSDECL(rb_leaf_t*,
+rb_tree_next(
+    _In_ rb_tree_t*,
+    _In_ rb_leaf_t*));
+
+DSDECL(rb_leaf_t*,
+rb_tree_prev(
+    _In_ rb_tree_t*,
+    _In_ rb_leaf_t*));
+
+/** 
+ * rb_tree_lower_bound/rb_tree_upper_bound
+ * * Retrieves the first item with a key equal to or above (lower_bound), or strictly
+ *   above (upper_bound) the provided key. Combine with rb_tree_next for range scans.
+ * @param RBTree [In] The red-black tree to perform the lookup in.
+ * @param Key    [In] The key to compare against.
+ */
+DSDECL(rb_leaf_t*,
+rb_tree_lower_bound(
+    _In_ rb_tree_t*,
+    _In_ void*));
+
+DSDECL(rb_leaf_t*,
+rb_tree_upper_bound(
+    _In_ rb_tree_t*,
+    _In_ void*));
+
+/** 
+ * rb_tree_build
+ * * Builds a balanced tree from items sorted by strictly increasing keys in linear time.
+ *   The tree must be empty.
+ * @param RBTree [In] The red-black tree to build.
+ * @param Leaves [In] Array of the items to insert, in sorted order.
+ * @param Count  [In] Number of items in the array.
+ */
+DSDECL(OsStatus_t,
+rb_tree_build(
+    _In_ rb_tree_t*,
+    _In_ rb_leaf_t**,
+    _In_ int));
+
 /** 
  * rb_tree_remove
  * * Removes and returns the item by the key provided.
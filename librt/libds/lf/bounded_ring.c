@@ -0,0 +1,155 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Ring Implementation
+ *  - Implements a bounded multiple-producer, multiple-consumer ring. Every slot carries
+ *    a sequence number that tells producers and consumers whose turn it is.
+ */
+
+#include <ds/lf/bounded_ring.h>
+#include <ds/ds.h>
+#include <errno.h>
+
+int
+lf_bounded_ring_construct(
+    _In_ lf_bounded_ring_t* ring,
+    _In_ int                capacity)
+{
+    size_t i;
+
+    // Positions are mapped to cells with a mask, so the capacity must be a power of two
+    if (!ring || capacity < 2 || (capacity & (capacity - 1))) {
+        _set_errno(EINVAL);
+        return -1;
+    }
+
+    ring->cells = dsalloc(capacity * sizeof(struct lf_bounded_ring_cell));
+    if (ring->cells == NULL) {
+        _set_errno(ENOMEM);
+        return -1;
+    }
+
+    for (i = 0; i < (size_t)capacity; i++) {
+        atomic_store_explicit(&ring->cells[i].sequence, i, memory_order_relaxed);
+        ring->cells[i].value = NULL;
+    }
+
+    ring->mask = (size_t)capacity - 1;
+    atomic_store_explicit(&ring->enqueue_position, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->dequeue_position, 0, memory_order_relaxed);
+    return 0;
+}
+
+void
+lf_bounded_ring_destroy(
+    _In_ lf_bounded_ring_t* ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    dsfree(ring->cells);
+}
+
+int
+lf_bounded_ring_push(
+    _In_ lf_bounded_ring_t* ring,
+    _In_ void*              value)
+{
+    struct lf_bounded_ring_cell* cell;
+    size_t                       position;
+
+    if (!ring) {
+        _set_errno(EINVAL);
+        return -1;
+    }
+
+    position = atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
+    while (1) {
+        size_t   sequence;
+        intptr_t difference;
+
+        cell       = &ring->cells[position & ring->mask];
+        sequence   = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        difference = (intptr_t)sequence - (intptr_t)position;
+
+        // The cell is free for this position, try to claim it
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_position, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            // The cell still holds the value from the previous lap, ring is full
+            _set_errno(ENOSPC);
+            return -1;
+        }
+        else {
+            position = atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    cell->value = value;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return 0;
+}
+
+void*
+lf_bounded_ring_pop(
+    _In_ lf_bounded_ring_t* ring)
+{
+    struct lf_bounded_ring_cell* cell;
+    size_t                       position;
+    void*                        value;
+
+    if (!ring) {
+        return NULL;
+    }
+
+    position = atomic_load_explicit(&ring->dequeue_position, memory_order_relaxed);
+    while (1) {
+        size_t   sequence;
+        intptr_t difference;
+
+        cell       = &ring->cells[position & ring->mask];
+        sequence   = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        // The cell has been filled for this position, try to claim it
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeue_position, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            // Not filled yet, ring is empty
+            return NULL;
+        }
+        else {
+            position = atomic_load_explicit(&ring->dequeue_position, memory_order_relaxed);
+        }
+    }
+
+    // Hand the cell over to the producer of the next lap
+    value = cell->value;
+    atomic_store_explicit(&cell->sequence, position + ring->mask + 1, memory_order_release);
+    return value;
+}
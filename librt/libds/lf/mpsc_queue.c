@@ -0,0 +1,98 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Queue Implementation
+ *  - Implements an intrusive multiple-producer, single-consumer queue. Producers
+ *    never wait on each other, pushing is a single atomic exchange.
+ */
+
+#include <ds/lf/mpsc_queue.h>
+#include <ds/ds.h>
+
+void
+lf_mpsc_queue_construct(
+    _In_ lf_mpsc_queue_t* queue)
+{
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+    queue->tail = &queue->stub;
+}
+
+void
+lf_mpsc_queue_push(
+    _In_ lf_mpsc_queue_t* queue,
+    _In_ lf_mpsc_node_t*  node)
+{
+    lf_mpsc_node_t* previous;
+
+    // Claim the head, and then link the previous head to us. Between those two
+    // steps the consumer will see the queue as temporarily empty after previous.
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    previous = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+}
+
+lf_mpsc_node_t*
+lf_mpsc_queue_pop(
+    _In_ lf_mpsc_queue_t* queue)
+{
+    lf_mpsc_node_t* tail = queue->tail;
+    lf_mpsc_node_t* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    lf_mpsc_node_t* head;
+
+    // Skip the stub node
+    if (tail == &queue->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail        = next;
+        next        = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    // If tail is not the last node a producer is in the middle of a push, so we
+    // can't make progress right now
+    head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail != head) {
+        return NULL;
+    }
+
+    // Tail is the last node, re-insert the stub so tail can be unlinked
+    lf_mpsc_queue_push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+int
+lf_mpsc_queue_empty(
+    _In_ lf_mpsc_queue_t* queue)
+{
+    lf_mpsc_node_t* tail = queue->tail;
+    return tail == atomic_load_explicit(&queue->head, memory_order_acquire) &&
+        atomic_load_explicit(&tail->next, memory_order_acquire) == NULL;
+}
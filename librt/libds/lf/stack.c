@@ -0,0 +1,86 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed Lockfree Stack Implementation
+ *  - Implements an intrusive, unbounded lockfree stack. The head is a tagged pointer
+ *    that is updated with a double-width compare and swap to avoid ABA issues.
+ */
+
+#include <ds/lf/stack.h>
+#include <ds/ds.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Watomic-alignment"
+#endif
+
+void
+lf_stack_construct(
+    _In_ lf_stack_t* stack)
+{
+    struct lf_stack_head head = { 0, NULL };
+    atomic_store(&stack->head, head);
+}
+
+void
+lf_stack_push(
+    _In_ lf_stack_t*      stack,
+    _In_ lf_stack_node_t* node)
+{
+    struct lf_stack_head next;
+    struct lf_stack_head orig = atomic_load(&stack->head);
+
+    do {
+        node->next = orig.node;
+        next.aba   = orig.aba + 1;
+        next.node  = node;
+    } while (!atomic_compare_exchange_weak(&stack->head, &orig, next));
+}
+
+lf_stack_node_t*
+lf_stack_pop(
+    _In_ lf_stack_t* stack)
+{
+    struct lf_stack_head next;
+    struct lf_stack_head orig = atomic_load(&stack->head);
+
+    // The node may be popped and pushed again by someone else while we read
+    // next, in that case the tag has changed and the exchange fails
+    do {
+        if (orig.node == NULL) {
+            return NULL;
+        }
+
+        next.aba  = orig.aba + 1;
+        next.node = orig.node->next;
+    } while (!atomic_compare_exchange_weak(&stack->head, &orig, next));
+    return orig.node;
+}
+
+int
+lf_stack_empty(
+    _In_ lf_stack_t* stack)
+{
+    struct lf_stack_head head = atomic_load(&stack->head);
+    return head.node == NULL;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,234 @@
+/* MollenOS
+ *
+ * Copyright 2011, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Generic String Library
+ *    - Managed string library for manipulating of strings in a managed format and to support
+ *      conversions from different formats to UTF-8
+ *    - Ascii fast paths. In utf-8 every byte below 0x80 is an ascii character, and no byte of
+ *      a multi-byte sequence is, so as long as no high bit is seen, bytes are characters.
+ */
+
+#include "mstringprivate.h"
+
+// The kernel is built without sse, so only use it in userspace
+#if defined(__SSE2__) && !defined(__LIBDS_KERNEL__)
+#include <emmintrin.h>
+#define MSTRING_USE_SSE2
+#endif
+
+#define WORD_ONES  ((size_t)-1 / 0xFF)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+#define HASH_PRIME ((size_t)0x9E3779B97F4A7C15ULL)
+
+static inline size_t
+LoadWord(
+    _In_ const uint8_t* Data)
+{
+    size_t Word;
+    memcpy(&Word, Data, sizeof(size_t));
+    return Word;
+}
+
+/* FoldWord
+ * Converts all upper-case ascii bytes in the word to lower-case. Bytes with the
+ * high bit set are left untouched, the same as tolower does. */
+static inline size_t
+FoldWord(
+    _In_ size_t Word)
+{
+    size_t Heptets  = Word & ~WORD_HIGHS;
+    size_t AboveZ   = Heptets + (WORD_ONES * (0x7F - 'Z'));
+    size_t AtLeastA = Heptets + (WORD_ONES * (0x80 - 'A'));
+    size_t Upper    = AtLeastA & ~AboveZ & ~Word & WORD_HIGHS;
+    return Word | (Upper >> 2);
+}
+
+static inline uint8_t
+FoldByte(
+    _In_ uint8_t Character)
+{
+    return (Character >= 'A' && Character <= 'Z') ? (Character | 0x20) : Character;
+}
+
+#ifdef MSTRING_USE_SSE2
+static inline __m128i
+FoldBlock(
+    _In_ __m128i Block)
+{
+    // Signed compares, bytes with the high bit set are negative and never upper-case
+    __m128i Upper = _mm_and_si128(_mm_cmpgt_epi8(Block, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(Block, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(Block, _mm_and_si128(Upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+int
+MStringAsciiIsAscii(
+    _In_ const uint8_t* Data,
+    _In_ size_t         Length)
+{
+    size_t i = 0;
+
+#ifdef MSTRING_USE_SSE2
+    for (; (i + 16) <= Length; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&Data[i]))) {
+            return 0;
+        }
+    }
+#endif
+    for (; (i + sizeof(size_t)) <= Length; i += sizeof(size_t)) {
+        if (LoadWord(&Data[i]) & WORD_HIGHS) {
+            return 0;
+        }
+    }
+    for (; i < Length; i++) {
+        if (Data[i] & 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+MStringAsciiCompare(
+    _In_ const uint8_t* Data1,
+    _In_ const uint8_t* Data2,
+    _In_ size_t         Length,
+    _In_ int            IgnoreCase)
+{
+    size_t i = 0;
+
+#ifdef MSTRING_USE_SSE2
+    for (; (i + 16) <= Length; i += 16) {
+        __m128i Block1 = _mm_loadu_si128((const __m128i*)&Data1[i]);
+        __m128i Block2 = _mm_loadu_si128((const __m128i*)&Data2[i]);
+        if (_mm_movemask_epi8(_mm_or_si128(Block1, Block2))) {
+            return MSTRING_ASCII_FALLBACK;
+        }
+        if (IgnoreCase) {
+            Block1 = FoldBlock(Block1);
+            Block2 = FoldBlock(Block2);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(Block1, Block2)) != 0xFFFF) {
+            return 1;
+        }
+    }
+#endif
+    for (; (i + sizeof(size_t)) <= Length; i += sizeof(size_t)) {
+        size_t Word1 = LoadWord(&Data1[i]);
+        size_t Word2 = LoadWord(&Data2[i]);
+        if ((Word1 | Word2) & WORD_HIGHS) {
+            return MSTRING_ASCII_FALLBACK;
+        }
+        if (IgnoreCase) {
+            Word1 = FoldWord(Word1);
+            Word2 = FoldWord(Word2);
+        }
+        if (Word1 != Word2) {
+            return 1;
+        }
+    }
+    for (; i < Length; i++) {
+        uint8_t Character1 = Data1[i];
+        uint8_t Character2 = Data2[i];
+        if ((Character1 | Character2) & 0x80) {
+            return MSTRING_ASCII_FALLBACK;
+        }
+        if (IgnoreCase) {
+            Character1 = FoldByte(Character1);
+            Character2 = FoldByte(Character2);
+        }
+        if (Character1 != Character2) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* MStringAsciiFind
+ * Returns the index of the first occurrence at or after StartIndex. The byte index is only
+ * the character index if everything before the match is ascii, otherwise we fall back. */
+int
+MStringAsciiFind(
+    _In_ const uint8_t* Data,
+    _In_ size_t         Length,
+    _In_ size_t         StartIndex,
+    _In_ uint8_t        Character)
+{
+    size_t i = 0;
+
+#ifdef MSTRING_USE_SSE2
+    __m128i Needle = _mm_set1_epi8((char)Character);
+    for (; (i + 16) <= Length; i += 16) {
+        __m128i  Block   = _mm_loadu_si128((const __m128i*)&Data[i]);
+        unsigned Matches = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(Block, Needle));
+        unsigned High    = (unsigned)_mm_movemask_epi8(Block);
+
+        if (StartIndex > i) {
+            Matches = ((StartIndex - i) >= 16) ? 0 : (Matches & (0xFFFFU << (StartIndex - i)));
+        }
+        if (Matches) {
+            unsigned First = (unsigned)__builtin_ctz(Matches);
+            if (High & ((1U << First) - 1)) {
+                return MSTRING_ASCII_FALLBACK;
+            }
+            return (int)(i + First);
+        }
+        if (High) {
+            return MSTRING_ASCII_FALLBACK;
+        }
+    }
+#endif
+    for (; i < Length; i++) {
+        if (Data[i] & 0x80) {
+            return MSTRING_ASCII_FALLBACK;
+        }
+        if (Data[i] == Character && i >= StartIndex) {
+            return (int)i;
+        }
+    }
+    return MSTRING_NOT_FOUND;
+}
+
+/* MStringAsciiHash
+ * Case-insensitive hash of the data, consumed a word at the time. Upper-case ascii is folded
+ * to lower-case before mixing, so strings that only differ in ascii case hash the same. */
+size_t
+MStringAsciiHash(
+    _In_ const uint8_t* Data,
+    _In_ size_t         Length)
+{
+    size_t Hash = 5381;
+    size_t Tail = 0;
+    size_t i    = 0;
+
+    for (; (i + sizeof(size_t)) <= Length; i += sizeof(size_t)) {
+        Hash  = (Hash ^ FoldWord(LoadWord(&Data[i]))) * HASH_PRIME;
+        Hash ^= Hash >> 15;
+    }
+
+    if (i < Length) {
+        memcpy(&Tail, &Data[i], Length - i);
+        Hash  = (Hash ^ FoldWord(Tail)) * HASH_PRIME;
+        Hash ^= Hash >> 15;
+    }
+
+    Hash  = (Hash ^ Length) * HASH_PRIME;
+    Hash ^= Hash >> 16;
+    return Hash;
+}
@@ -39,6 +39,7 @@ MStringCompare(
     char*   StringPtr2;
     int     i1 = 0;
     int     i2 = 0;
+    int     Result;
 
     if (String1 == NULL || String1->Data == NULL || String1->Length == 0 ||
         String2 == NULL || String2->Data == NULL || String2->Length == 0) {
@@ -47,6 +48,22 @@ MStringCompare(
     StringPtr1 = (char*)String1->Data;
     StringPtr2 = (char*)String2->Data;
 
+    // Interned strings and comparisons against self are resolved by the pointer
+    if (String1 == String2) {
+        return MSTRING_FULL_MATCH;
+    }
+
+    // Ascii strings can be compared bytewise, a difference in length is never a match as
+    // the terminator of the shorter string is compared against a character
+    Result = MStringAsciiCompare((const uint8_t*)StringPtr1, (const uint8_t*)StringPtr2,
+        MIN(String1->Length, String2->Length), IgnoreCase);
+    if (Result != MSTRING_ASCII_FALLBACK) {
+        if (Result == 0 && String1->Length == String2->Length) {
+            return MSTRING_FULL_MATCH;
+        }
+        return MSTRING_NO_MATCH;
+    }
+
     while ((i1 < String1->Length) && (i2 < String2->Length)) {
         mchar_t First   = Utf8GetNextCharacterInString(StringPtr1, &i1);
         mchar_t Second  = Utf8GetNextCharacterInString(StringPtr2, &i2);
@@ -31,7 +31,6 @@ MStringConvertASCIIToUtf8(
 {
     char *dPtr = NULL;
     char *cPtr = (char*)Source;
-    size_t DataLength = 0;
 
     // Get the length of the data
     Storage->Length = 0;
@@ -40,10 +39,7 @@ MStringConvertASCIIToUtf8(
         cPtr++;
     }
 
-    DataLength = DIVUP((Storage->Length + 1), MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
-    Storage->Data = (void*)dsalloc(DataLength);
-    Storage->MaxLength = DataLength;
-    memset(Storage->Data, 0, DataLength);
+    MStringAllocateStorage(Storage, Storage->Length + 1);
 
     dPtr = Storage->Data;
     cPtr = (char*)Source;
@@ -63,7 +59,6 @@ MStringConvertLatin1ToUtf8(
     _In_ MString_t*  Storage,
     _In_ const char* Source)
 {
-    size_t DataLength;
     size_t TempLength;
     char*  SourcePtr;
     char*  DestPtr;
@@ -71,11 +66,7 @@ MStringConvertLatin1ToUtf8(
 
     TempLength         = strlen(Source) * 2 + 1;
     SourcePtr          = (char*)Source;
-    DataLength         = DIVUP(TempLength, MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
-    Storage->MaxLength = DataLength;
-
-    Storage->Data = (void*)dsalloc(DataLength);
-    memset(Storage->Data, 0, DataLength);
+    MStringAllocateStorage(Storage, TempLength);
     
     DestPtr = (char*)Storage->Data;
     while (*SourcePtr) {
@@ -101,7 +92,6 @@ MStringConvertUtf16ToUtf8(
 {
     uint16_t *sPtr = (uint16_t*)Source;
     char *dPtr = NULL;
-    size_t DataLength = 0;
 
     // Get length of data
     Storage->Length = 0;
@@ -110,10 +100,7 @@ MStringConvertUtf16ToUtf8(
         sPtr++;
     }
 
-    DataLength = DIVUP((Storage->Length + 2), MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
-    Storage->Data = (void*)dsalloc(DataLength);
-    Storage->MaxLength = DataLength;
-    memset(Storage->Data, 0, DataLength);
+    MStringAllocateStorage(Storage, Storage->Length + 2);
 
     sPtr = (uint16_t*)Source;
     dPtr = (char*)Storage->Data;
@@ -137,7 +124,6 @@ MStringConvertUtf32ToUtf8(
 {
     uint32_t *sPtr = (uint32_t*)Source;
     char *dPtr = NULL;
-    size_t DataLength = 0;
     
     // Get length of data
     Storage->Length = 0;
@@ -146,10 +132,7 @@ MStringConvertUtf32ToUtf8(
         sPtr++;
     }
 
-    DataLength = DIVUP((Storage->Length + 4), MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
-    Storage->Data = (void*)dsalloc(DataLength);
-    Storage->MaxLength = DataLength;
-    memset(Storage->Data, 0, DataLength);
+    MStringAllocateStorage(Storage, Storage->Length + 4);
 
     sPtr = (uint32_t*)Source;
     dPtr = (char*)Storage->Data;
@@ -169,16 +152,10 @@ MStringCopyUtf8ToUtf8(
     _In_ MString_t*  Storage,
     _In_ const char* Source)
 {
-    size_t DataLength;
     assert(Source != NULL);
 
     Storage->Length = strlen(Source);
-    DataLength      = DIVUP((Storage->Length + 1), MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
-
-    Storage->Data       = (void*)dsalloc(DataLength);
-    Storage->MaxLength  = DataLength;
-
-    memset(Storage->Data, 0, DataLength);
+    MStringAllocateStorage(Storage, Storage->Length + 1);
     memcpy(Storage->Data, (const void*)Source, Storage->Length);
     return 0;
 }
@@ -188,8 +165,7 @@ MStringNull(
     _In_ MString_t* Storage)
 {
     if (Storage->Data == NULL) {
-        Storage->Data      = dsalloc(MSTRING_BLOCK_SIZE);
-        Storage->MaxLength = MSTRING_BLOCK_SIZE;
+        MStringAllocateStorage(Storage, 1);
     }
     memset(Storage->Data, 0, Storage->MaxLength);
     Storage->Length = 0;
@@ -203,11 +179,7 @@ MStringReset(
 {
     assert(String != NULL);
 
-    if (String->Data != NULL) {
-        dsfree(String->Data);
-        String->Data = NULL;
-    }
-    
+    MStringFreeStorage(String);
     if (NewString == NULL) {
         MStringNull(String);
         return;
@@ -30,12 +30,14 @@ void MStringDestroy(MString_t *String)
 		return;
 	}
 
-	/* Free buffer 
-	 * make sure it's not null */
-	if (String->Data != NULL) {
-		dsfree(String->Data);
+	/* Interned strings are owned by the intern table */
+	if (String->Flags & MSTRING_FLAG_INTERNED) {
+		return;
 	}
 
+	/* Free buffer, unless it's inline */
+	MStringFreeStorage(String);
+
 	/* Free structure */
 	dsfree(String);
 }
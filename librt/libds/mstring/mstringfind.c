@@ -34,6 +34,15 @@ int MStringFind(MString_t *String, mchar_t Character, int StartIndex)
 	}
 	StringPtr = (char*)String->Data;
 
+	// Ascii characters are found without decoding as long as the string is ascii up to the match
+	if (Character < 0x80) {
+		int Result = MStringAsciiFind((const uint8_t*)StringPtr, String->Length,
+			(size_t)MAX(StartIndex, 0), (uint8_t)Character);
+		if (Result != MSTRING_ASCII_FALLBACK) {
+			return Result;
+		}
+	}
+
 	while (i < String->Length) {
 		mchar_t NextCharacter = Utf8GetNextCharacterInString(StringPtr, &i);
 		if (NextCharacter == MSTRING_EOS) {
@@ -63,6 +72,17 @@ int MStringFindReverse(MString_t* String, mchar_t Character, int StartIndex)
         StartIndex = String->Length;
     }
 
+	// For ascii strings the character index is the byte index
+	if (Character < 0x80 && MStringAsciiIsAscii((const uint8_t*)StringPtr, String->Length)) {
+		i = MIN(StartIndex, (int)String->Length);
+		while (i-- > 0) {
+			if ((uint8_t)StringPtr[i] == (uint8_t)Character) {
+				return i;
+			}
+		}
+		return MSTRING_NOT_FOUND;
+	}
+
 	while (i < String->Length) {
 		mchar_t NextCharacter = Utf8GetNextCharacterInString(StringPtr, &i);
 		if (NextCharacter == MSTRING_EOS) {
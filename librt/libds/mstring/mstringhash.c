@@ -25,23 +25,11 @@
 
 size_t MStringHash(MString_t *String)
 {
-	/* Hash Seed */
-	size_t Hash = 5381;
-	uint8_t *StrPtr;
-	int Char;
-
 	/* Sanity */
 	if (String->Data == NULL
 		|| String->Length == 0)
 		return 0;
 
-	/* Get a pointer */
-	StrPtr = (uint8_t*)String->Data;
-
-	/* Hash */
-	while ((Char = tolower(*StrPtr++)) != 0)
-		Hash = ((Hash << 5) + Hash) + Char; /* hash * 33 + c */
-
-	/* Done */
-	return Hash;
+	/* Case-insensitive, consumed a word at the time */
+	return MStringAsciiHash((const uint8_t*)String->Data, String->Length);
 }
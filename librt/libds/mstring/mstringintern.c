@@ -0,0 +1,123 @@
+/* MollenOS
+ *
+ * Copyright 2011, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Generic String Library
+ *    - Managed string library for manipulating of strings in a managed format and to support
+ *      conversions from different formats to UTF-8
+ *    - Intern table, keeps a single shared instance of repeated strings like path components
+ */
+
+#include "mstringprivate.h"
+
+#define MSTRING_INTERN_INITIAL_BUCKETS 64
+
+typedef struct MStringInternEntry {
+    struct MStringInternEntry* Link;
+    size_t                     Hash;
+    MString_t                  String;
+} MStringInternEntry_t;
+
+static SafeMemoryLock_t       InternLock        = { 0 };
+static MStringInternEntry_t** InternBuckets     = NULL;
+static size_t                 InternBucketCount = 0;
+static size_t                 InternCount       = 0;
+
+static int
+GrowInternTable(void)
+{
+    MStringInternEntry_t** Buckets;
+    size_t                 BucketCount = InternBucketCount ? (InternBucketCount * 2) : MSTRING_INTERN_INITIAL_BUCKETS;
+    size_t                 i;
+
+    Buckets = (MStringInternEntry_t**)dsalloc(BucketCount * sizeof(MStringInternEntry_t*));
+    if (!Buckets) {
+        return -1;
+    }
+    memset(Buckets, 0, BucketCount * sizeof(MStringInternEntry_t*));
+
+    // Move all entries, the bucket count is always a power of two
+    for (i = 0; i < InternBucketCount; i++) {
+        MStringInternEntry_t* Entry = InternBuckets[i];
+        while (Entry) {
+            MStringInternEntry_t* Next = Entry->Link;
+            size_t                Index = Entry->Hash & (BucketCount - 1);
+            Entry->Link    = Buckets[Index];
+            Buckets[Index] = Entry;
+            Entry          = Next;
+        }
+    }
+
+    if (InternBuckets) {
+        dsfree(InternBuckets);
+    }
+    InternBuckets     = Buckets;
+    InternBucketCount = BucketCount;
+    return 0;
+}
+
+MString_t*
+MStringIntern(
+    _In_ const char* Data,
+    _In_ size_t      Length)
+{
+    MStringInternEntry_t* Entry;
+    size_t                Hash;
+
+    if (Data == NULL) {
+        return NULL;
+    }
+
+    Hash = MStringAsciiHash((const uint8_t*)Data, Length);
+    dslock(&InternLock);
+    if (InternBucketCount) {
+        Entry = InternBuckets[Hash & (InternBucketCount - 1)];
+        while (Entry) {
+            if (Entry->Hash == Hash && Entry->String.Length == Length &&
+                !memcmp(Entry->String.Data, Data, Length)) {
+                dsunlock(&InternLock);
+                return &Entry->String;
+            }
+            Entry = Entry->Link;
+        }
+    }
+
+    // Keep the load below 3/4 of the bucket count
+    if ((InternCount + 1) > ((InternBucketCount * 3) / 4) && GrowInternTable()) {
+        dsunlock(&InternLock);
+        return NULL;
+    }
+
+    Entry = (MStringInternEntry_t*)dsalloc(sizeof(MStringInternEntry_t));
+    if (!Entry) {
+        dsunlock(&InternLock);
+        return NULL;
+    }
+    memset(Entry, 0, sizeof(MStringInternEntry_t));
+
+    MStringAllocateStorage(&Entry->String, Length + 1);
+    memcpy(Entry->String.Data, Data, Length);
+    Entry->String.Length = Length;
+    Entry->String.Flags  = MSTRING_FLAG_INTERNED;
+    Entry->Hash          = Hash;
+
+    Entry->Link = InternBuckets[Hash & (InternBucketCount - 1)];
+    InternBuckets[Hash & (InternBucketCount - 1)] = Entry;
+    InternCount++;
+    dsunlock(&InternLock);
+    return &Entry->String;
+}
@@ -121,10 +121,22 @@
  * this can be tweaked by the user */
 #define MSTRING_BLOCK_SIZE 64
 
+/* Strings up to this size (including the terminator) are stored inside the
+ * string structure itself, which covers most names and path components */
+#define MSTRING_INLINE_SIZE 32
+
+/* Returned by the ascii helpers when the data contains non-ascii bytes and
+ * the caller must fall back to the utf-8 implementation */
+#define MSTRING_ASCII_FALLBACK -2
+
+#define MSTRING_FLAG_INTERNED 0x1
+
 typedef struct MString {
-    void*  Data;
-    size_t Length;
-    size_t MaxLength;
+    void*    Data;
+    size_t   Length;
+    size_t   MaxLength;
+    unsigned Flags;
+    char     Inline[MSTRING_INLINE_SIZE];
 } MString_t;
 
 /* Converts a single char (ASCII, UTF16, UTF32) to UTF8 
@@ -156,4 +168,18 @@ CRTDECL(size_t, Utf8ByteCountInString(const char *Str));
  * of a string to be able to fit a certain size */
 CRTDECL(void, MStringResize(MString_t *String, size_t Length));
 
+/* MStringAllocateStorage/MStringFreeStorage
+ * Sets up zeroed storage for at least Length bytes, either inline or on the heap,
+ * and releases it again. The previous storage is not released by the allocation. */
+CRTDECL(void, MStringAllocateStorage(MString_t* String, size_t Length));
+CRTDECL(void, MStringFreeStorage(MString_t* String));
+
+/* Ascii fast paths
+ * These work on whole words (or SSE2 registers where available) and return
+ * MSTRING_ASCII_FALLBACK when a non-ascii byte prevents a quick answer. */
+CRTDECL(int,    MStringAsciiCompare(const uint8_t* Data1, const uint8_t* Data2, size_t Length, int IgnoreCase));
+CRTDECL(int,    MStringAsciiFind(const uint8_t* Data, size_t Length, size_t StartIndex, uint8_t Character));
+CRTDECL(int,    MStringAsciiIsAscii(const uint8_t* Data, size_t Length));
+CRTDECL(size_t, MStringAsciiHash(const uint8_t* Data, size_t Length));
+
 #endif //!_MSTRING_PRIV_H_
@@ -23,23 +23,45 @@
 
 #include "mstringprivate.h"
 
+void MStringAllocateStorage(MString_t *String, size_t Length)
+{
+	/* Short strings are kept inside the structure */
+	if (Length <= MSTRING_INLINE_SIZE) {
+		String->Data = (void*)&String->Inline[0];
+		String->MaxLength = MSTRING_INLINE_SIZE;
+	}
+	else {
+		String->MaxLength = DIVUP(Length, MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
+		String->Data = dsalloc(String->MaxLength);
+	}
+	memset(String->Data, 0, String->MaxLength);
+}
+
+void MStringFreeStorage(MString_t *String)
+{
+	if (String->Data != NULL && String->Data != (void*)&String->Inline[0]) {
+		dsfree(String->Data);
+	}
+	String->Data = NULL;
+	String->MaxLength = 0;
+}
+
 void MStringResize(MString_t *String, size_t Length)
 {
-	/* Calculate the new byte-count we 
-	 * need to encompass with blocks */
-	size_t DataLength = DIVUP(Length, MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
+	void *Data = String->Data;
+	int Inline = (Data == (void*)&String->Inline[0]);
 
-	/* Expand and reset buffer */
-	void *Data = dsalloc(DataLength);
-	memset(Data, 0, DataLength);
+	/* The inline buffer can't be resized */
+	if (Inline && Length <= MSTRING_INLINE_SIZE) {
+		return;
+	}
 
-	/* Copy old data over */
-	memcpy(Data, String->Data, String->Length);
+	/* Expand and reset buffer, then copy old data over */
+	MStringAllocateStorage(String, Length);
+	memcpy(String->Data, Data, String->Length);
 
 	/* Free the old buffer */
-	dsfree(String->Data);
-
-	/* Update string to new buffer */
-	String->MaxLength = DataLength;
-	String->Data = Data;
+	if (!Inline) {
+		dsfree(Data);
+	}
 }
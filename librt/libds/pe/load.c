@@ -553,12 +553,19 @@ PeHandleImports(
 {
     PeImportDescriptor_t* ImportDescriptor = (PeImportDescriptor_t*)DirectoryContent;
     while (ImportDescriptor->ImportAddressTable != 0) {
-        SectionMapping_t* Section         = GetSectionFromRVA(Sections, SectionCount, ImportDescriptor->ImportAddressTable);
-        uintptr_t         HostNameAddress = OFFSET_IN_SECTION(Section, ImportDescriptor->ModuleName);
-        MString_t*        Name            = MStringCreate((const char*)HostNameAddress, StrUTF8);
-        OsStatus_t        Status          = PeResolveImportDescriptor(ParentImage, Image, Section, ImportDescriptor, Name);
-        MStringDestroy(Name);
+        SectionMapping_t* Section  = GetSectionFromRVA(Sections, SectionCount, ImportDescriptor->ImportAddressTable);
+        const char*       HostName = (const char*)OFFSET_IN_SECTION(Section, ImportDescriptor->ModuleName);
+        MString_t*        Name;
+        OsStatus_t        Status;
+
+        // The same few library names are imported by every image, so they are interned like the
+        // image names, which lets PeResolveLibrary match them by pointer
+        Name = MStringIntern(HostName, strlen(HostName));
+        if (!Name) {
+            return OsOutOfMemory;
+        }
 
+        Status = PeResolveImportDescriptor(ParentImage, Image, Section, ImportDescriptor, Name);
         if (Status != OsSuccess) {
             return OsError;
         }
@@ -714,7 +721,8 @@ PeLoadImage(
     PeExecutable_t*    Image;
     OsStatus_t         Status;
     uint8_t*           Buffer;
-    int                Index;
+    const char*        Name;
+    MString_t*         ImageName;
 
     dstrace("PeLoadImage(Path %s, Parent %s)",
         MStringRaw(Path), (Parent == NULL) ? "None" : MStringRaw(Parent->Name));
@@ -771,14 +779,21 @@ PeLoadImage(
         return OsError;
     }
 
+    // Image names are interned, they are compared for every import of every image
+    Name      = strrchr(MStringRaw(FullPath), '/');
+    Name      = (Name != NULL) ? (Name + 1) : MStringRaw(FullPath);
+    ImageName = MStringIntern(Name, strlen(Name));
+    if (!ImageName) {
+        return OsOutOfMemory;
+    }
+
     Image = (PeExecutable_t*)dsalloc(sizeof(PeExecutable_t));
     if (!Image) {
         return OsOutOfMemory;
     }
     
     memset(Image, 0, sizeof(PeExecutable_t));
-    Index                    = MStringFindReverse(FullPath, '/', 0);
-    Image->Name              = MStringSubString(FullPath, Index + 1, -1);
+    Image->Name              = ImageName;
     Image->Owner             = Owner;
     Image->FullPath          = FullPath;
     Image->Architecture      = OptHeader->Architecture;
@@ -798,7 +813,6 @@ PeLoadImage(
         Status = CreateImageSpace(&Image->MemorySpace);
         if (Status != OsSuccess) {
             dserror("Failed to create pe's memory space");
-            MStringDestroy(Image->Name);
             MStringDestroy(Image->FullPath);
             dsfree(Image->Libraries);
             dsfree(Image);
@@ -827,7 +841,6 @@ PeUnloadImage(
 {
     element_t* Element;
     if (Image != NULL) {
-        MStringDestroy(Image->Name);
         MStringDestroy(Image->FullPath);
         if (Image->ExportedFunctions != NULL) {
             dsfree(Image->ExportedFunctions);
@@ -53,7 +53,7 @@ typedef struct PeExportedFunction {
 
 typedef struct PeExecutable {
     UUId_t                Owner;
-    MString_t*            Name;
+    MString_t*            Name;     // Interned, never destroyed
     MString_t*            FullPath;
     atomic_int            References;
     MemorySpaceHandle_t   MemorySpace;
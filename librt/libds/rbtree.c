@@ -228,7 +228,7 @@ rb_tree_append(
         i = tree->root;
         while (1) {
             result = tree->cmp(i->key, leaf->key);
-            if (result == 1) {
+            if (result > 0) {
                 if (IS_ITEM_NIL(tree, i->left)) {
                     i->left = leaf;
                     leaf->parent = i;
@@ -238,7 +238,7 @@ rb_tree_append(
                     i = i->left;
                 }
             }
-            else if (result == -1) {
+            else if (result < 0) {
                 if (IS_ITEM_NIL(tree, i->right)) {
                     i->right = leaf;
                     leaf->parent = i;
@@ -260,25 +260,17 @@ rb_tree_append(
 }
 
 static rb_leaf_t*
-lookup_recursive(
+lookup_leaf(
     _In_ rb_tree_t* tree,
-    _In_ rb_leaf_t* leaf,
     _In_ void*      key)
 {
-    int result = tree->cmp(leaf->key, key);
-    if (!result) {
-        return leaf;
-    }
-    
-    if (result == 1) {
-        if (!IS_ITEM_NIL(tree, leaf->left)) {
-            return lookup_recursive(tree, leaf->left, key);
-        }
-    }
-    else {
-        if (!IS_ITEM_NIL(tree, leaf->right)) {
-            return lookup_recursive(tree, leaf->right, key);
+    rb_leaf_t* i = tree->root;
+    while (!IS_ITEM_NIL(tree, i)) {
+        int result = tree->cmp(i->key, key);
+        if (!result) {
+            return i;
         }
+        i = (result > 0) ? i->left : i->right;
     }
     return NULL;
 }
@@ -293,12 +285,7 @@ rb_tree_lookup(
     assert(key != NULL);
     
     TREE_LOCK;
-    if (IS_ITEM_NIL(tree, tree->root)) {
-        TREE_UNLOCK;
-        return NULL;
-    }
-    
-    leaf = lookup_recursive(tree, tree->root, key);
+    leaf = lookup_leaf(tree, key);
     TREE_UNLOCK;
     return leaf;
 }
@@ -342,6 +329,204 @@ rb_tree_minimum(
 	return leaf;
 }
 
+static rb_leaf_t*
+get_maximum_leaf(
+	_In_ rb_tree_t* tree,
+	_In_ rb_leaf_t* leaf)
+{
+	rb_leaf_t* i = leaf;
+	while (!IS_ITEM_NIL(tree, i->right)) {
+		i = i->right;
+	}
+	return i;
+}
+
+rb_leaf_t*
+rb_tree_maximum(
+	_In_ rb_tree_t* tree)
+{
+    rb_leaf_t* leaf;
+    assert(tree != NULL);
+    
+    TREE_LOCK;
+	if (IS_ITEM_NIL(tree, tree->root)) {
+	    TREE_UNLOCK;
+	    return NULL;
+	}
+	
+	leaf = get_maximum_leaf(tree, tree->root);
+	TREE_UNLOCK;
+	return leaf;
+}
+
+rb_leaf_t*
+rb_tree_next(
+    _In_ rb_tree_t* tree,
+    _In_ rb_leaf_t* leaf)
+{
+    rb_leaf_t* i;
+    assert(tree != NULL);
+    assert(leaf != NULL);
+    
+    TREE_LOCK;
+    if (!IS_ITEM_NIL(tree, leaf->right)) {
+        i = get_minimum_leaf(tree, leaf->right);
+    }
+    else {
+        // Walk up until we arrive from a left subtree
+        i = leaf->parent;
+        while (!IS_ITEM_NIL(tree, i) && leaf == i->right) {
+            leaf = i;
+            i    = i->parent;
+        }
+    }
+    TREE_UNLOCK;
+    return IS_ITEM_NIL(tree, i) ? NULL : i;
+}
+
+rb_leaf_t*
+rb_tree_prev(
+    _In_ rb_tree_t* tree,
+    _In_ rb_leaf_t* leaf)
+{
+    rb_leaf_t* i;
+    assert(tree != NULL);
+    assert(leaf != NULL);
+    
+    TREE_LOCK;
+    if (!IS_ITEM_NIL(tree, leaf->left)) {
+        i = get_maximum_leaf(tree, leaf->left);
+    }
+    else {
+        // Walk up until we arrive from a right subtree
+        i = leaf->parent;
+        while (!IS_ITEM_NIL(tree, i) && leaf == i->left) {
+            leaf = i;
+            i    = i->parent;
+        }
+    }
+    TREE_UNLOCK;
+    return IS_ITEM_NIL(tree, i) ? NULL : i;
+}
+
+static rb_leaf_t*
+find_bound(
+    _In_ rb_tree_t* tree,
+    _In_ void*      key,
+    _In_ int        inclusive)
+{
+    rb_leaf_t* i      = tree->root;
+    rb_leaf_t* result = NULL;
+    
+    // Track the last leaf that satisfied the bound while descending
+    while (!IS_ITEM_NIL(tree, i)) {
+        int cmp = tree->cmp(i->key, key);
+        if (cmp > 0 || (inclusive && cmp == 0)) {
+            result = i;
+            if (cmp == 0) {
+                break;
+            }
+            i = i->left;
+        }
+        else {
+            i = i->right;
+        }
+    }
+    return result;
+}
+
+rb_leaf_t*
+rb_tree_lower_bound(
+    _In_ rb_tree_t* tree,
+    _In_ void*      key)
+{
+    rb_leaf_t* leaf;
+    assert(tree != NULL);
+    
+    TREE_LOCK;
+    leaf = find_bound(tree, key, 1);
+    TREE_UNLOCK;
+    return leaf;
+}
+
+rb_leaf_t*
+rb_tree_upper_bound(
+    _In_ rb_tree_t* tree,
+    _In_ void*      key)
+{
+    rb_leaf_t* leaf;
+    assert(tree != NULL);
+    
+    TREE_LOCK;
+    leaf = find_bound(tree, key, 0);
+    TREE_UNLOCK;
+    return leaf;
+}
+
+static rb_leaf_t*
+build_subtree(
+    _In_ rb_tree_t*  tree,
+    _In_ rb_leaf_t** leaves,
+    _In_ int         start,
+    _In_ int         end,
+    _In_ int         depth,
+    _In_ int         red_depth,
+    _In_ rb_leaf_t*  parent)
+{
+    rb_leaf_t* leaf;
+    int        middle;
+    
+    if (start > end) {
+        return ITEM_NIL(tree);
+    }
+    
+    middle         = start + ((end - start) / 2);
+    leaf           = leaves[middle];
+    leaf->parent   = parent;
+    leaf->color    = (depth == red_depth) ? COLOR_RED : COLOR_BLACK;
+    leaf->left     = build_subtree(tree, leaves, start, middle - 1, depth + 1, red_depth, leaf);
+    leaf->right    = build_subtree(tree, leaves, middle + 1, end, depth + 1, red_depth, leaf);
+    return leaf;
+}
+
+OsStatus_t
+rb_tree_build(
+    _In_ rb_tree_t*  tree,
+    _In_ rb_leaf_t** leaves,
+    _In_ int         count)
+{
+    int red_depth = 0;
+    int i;
+    
+    if (!tree || (!leaves && count) || count < 0) {
+        return OsInvalidParameters;
+    }
+    
+    // The input must be strictly increasing
+    for (i = 1; i < count; i++) {
+        if (tree->cmp(leaves[i - 1]->key, leaves[i]->key) >= 0) {
+            return OsInvalidParameters;
+        }
+    }
+    
+    // A tree split at the middle has all leaves on the two deepest levels. Coloring
+    // the deepest level red gives every path the same number of black leaves.
+    while ((1 << (red_depth + 1)) <= count) {
+        red_depth++;
+    }
+    
+    TREE_LOCK;
+    if (!IS_ITEM_NIL(tree, tree->root)) {
+        TREE_UNLOCK;
+        return OsExists;
+    }
+    
+    tree->root = build_subtree(tree, leaves, 0, count - 1, 0, red_depth, ITEM_NIL(tree));
+    tree->root->color = COLOR_BLACK;
+    TREE_UNLOCK;
+    return OsSuccess;
+}
+
 static void
 transplant_nodes(
     _In_ rb_tree_t* tree,
@@ -435,16 +620,19 @@ rb_tree_remove(
     _In_ rb_tree_t* tree,
     _In_ void*      key)
 {
-    rb_leaf_t* leaf = rb_tree_lookup(tree, key);
+    rb_leaf_t* leaf;
     rb_leaf_t* temp;
     rb_leaf_t* i;
     int        temp_color;
+    assert(tree != NULL);
     
+    TREE_LOCK;
+    leaf = lookup_leaf(tree, key);
     if (!leaf) {
+        TREE_UNLOCK;
         return NULL;
     }
     
-    TREE_LOCK;
     temp = leaf;
     temp_color = temp->color;
     if (IS_ITEM_NIL(tree, leaf->left)) {
@@ -213,6 +213,11 @@ uintptr_t GetPageSize(void)
 #ifdef LIBC_KERNEL
     return GetMemorySpacePageSize();
 #else
+    const SystemPage_t* Page = GetSystemPage();
+    if (Page != NULL) {
+        return Page->PageSizeBytes;
+    }
+
     if (__SystemInformation.PageSizeBytes == 0) {
         SystemQuery(&__SystemInformation);
     }
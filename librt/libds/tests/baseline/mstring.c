@@ -0,0 +1,203 @@
+/* MollenOS
+ *
+ * Copyright 2011, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Generic String Library Baseline
+ * - The managed string before the ascii fast paths and the inline storage. Every operation
+ *   decodes UTF-8 a character at a time, and every string has a separate data block. Only
+ *   UTF-8 creation, compare, hash and find are kept, for the comparison in test_mstring.c.
+ *   The public functions and the structure are prefixed with Baseline, the UTF-8 decoder
+ *   is unchanged and shared with the current library.
+ */
+
+#include <ds/ds.h>
+#include <ds/mstring.h>
+#include <ctype.h>
+#include <string.h>
+
+#define MSTRING_BLOCK_SIZE 64
+
+typedef struct BaselineMString {
+    void*  Data;
+    size_t Length;
+    size_t MaxLength;
+} BaselineMString_t;
+
+extern mchar_t Utf8GetNextCharacterInString(const char *Str, int *Index);
+
+BaselineMString_t*
+BaselineMStringCreate(
+    _In_ const char* Data)
+{
+    BaselineMString_t* String = (BaselineMString_t*)dsalloc(sizeof(BaselineMString_t));
+    size_t             DataLength;
+
+    memset((void*)String, 0, sizeof(BaselineMString_t));
+    String->Length = strlen(Data);
+    DataLength     = DIVUP((String->Length + 1), MSTRING_BLOCK_SIZE) * MSTRING_BLOCK_SIZE;
+
+    String->Data       = (void*)dsalloc(DataLength);
+    String->MaxLength  = DataLength;
+
+    memset(String->Data, 0, DataLength);
+    memcpy(String->Data, (const void*)Data, String->Length);
+    return String;
+}
+
+void BaselineMStringDestroy(BaselineMString_t *String)
+{
+	/* Sanitize parameters */
+	if (String == NULL) {
+		return;
+	}
+
+	/* Free buffer 
+	 * make sure it's not null */
+	if (String->Data != NULL) {
+		dsfree(String->Data);
+	}
+
+	/* Free structure */
+	dsfree(String);
+}
+
+int
+BaselineMStringCompare(
+    _In_ BaselineMString_t* String1,
+    _In_ BaselineMString_t* String2,
+    _In_ int                IgnoreCase)
+{
+    char*   StringPtr1;
+    char*   StringPtr2;
+    int     i1 = 0;
+    int     i2 = 0;
+
+    if (String1 == NULL || String1->Data == NULL || String1->Length == 0 ||
+        String2 == NULL || String2->Data == NULL || String2->Length == 0) {
+        return MSTRING_NO_MATCH;
+    }
+    StringPtr1 = (char*)String1->Data;
+    StringPtr2 = (char*)String2->Data;
+
+    while ((i1 < String1->Length) && (i2 < String2->Length)) {
+        mchar_t First   = Utf8GetNextCharacterInString(StringPtr1, &i1);
+        mchar_t Second  = Utf8GetNextCharacterInString(StringPtr2, &i2);
+        if (First == MSTRING_EOS || Second == MSTRING_EOS) {
+            return MSTRING_PARTIAL_MATCH;
+        }
+
+        // We only support case-insensitivity on ascii characters
+        if (IgnoreCase) {
+            if (First < 0x80 && isalpha(First)) {
+                First = tolower((uint8_t)First);
+            }
+            if (Second < 0x80 && isalpha(Second)) {
+                Second = tolower((uint8_t)Second);
+            }
+        }
+
+        if (First != Second) {
+            return MSTRING_NO_MATCH;
+        }
+    }
+
+    if (StringPtr1[i1] != StringPtr2[i2]) {
+        return MSTRING_NO_MATCH;
+    }
+
+    if (String1->Length != String2->Length) {
+        return MSTRING_PARTIAL_MATCH;
+    }
+    return MSTRING_FULL_MATCH;
+}
+
+size_t BaselineMStringHash(BaselineMString_t *String)
+{
+	/* Hash Seed */
+	size_t Hash = 5381;
+	uint8_t *StrPtr;
+	int Char;
+
+	/* Sanity */
+	if (String->Data == NULL
+		|| String->Length == 0)
+		return 0;
+
+	/* Get a pointer */
+	StrPtr = (uint8_t*)String->Data;
+
+	/* Hash */
+	while ((Char = tolower(*StrPtr++)) != 0)
+		Hash = ((Hash << 5) + Hash) + Char; /* hash * 33 + c */
+
+	/* Done */
+	return Hash;
+}
+
+
+int BaselineMStringFind(BaselineMString_t *String, mchar_t Character, int StartIndex)
+{
+	char*   StringPtr;
+	int     Index   = 0;
+	int     i       = 0;
+
+	if (String == NULL || String->Data == NULL || String->Length == 0) {
+		return MSTRING_NOT_FOUND;
+	}
+	StringPtr = (char*)String->Data;
+
+	while (i < String->Length) {
+		mchar_t NextCharacter = Utf8GetNextCharacterInString(StringPtr, &i);
+		if (NextCharacter == MSTRING_EOS) {
+			return MSTRING_NOT_FOUND;
+		}
+		if (NextCharacter == Character && Index >= StartIndex) {
+			return Index;
+		}
+		Index++;
+	}
+	return MSTRING_NOT_FOUND;
+}
+
+int BaselineMStringFindReverse(BaselineMString_t* String, mchar_t Character, int StartIndex)
+{
+	char*   StringPtr;
+	int     LastOccurrence  = MSTRING_NOT_FOUND;
+	int     Index           = 0;
+	int     i               = 0;
+
+	if (String == NULL || String->Data == NULL || String->Length == 0) {
+		return LastOccurrence;
+	}
+	StringPtr = (char*)String->Data;
+
+    if (StartIndex == 0) {
+        StartIndex = String->Length;
+    }
+
+	while (i < String->Length) {
+		mchar_t NextCharacter = Utf8GetNextCharacterInString(StringPtr, &i);
+		if (NextCharacter == MSTRING_EOS) {
+			return MSTRING_NOT_FOUND;
+		}
+		if (NextCharacter == Character && Index < StartIndex) {
+			LastOccurrence = Index;
+		}
+		Index++;
+	}
+	return LastOccurrence;
+}
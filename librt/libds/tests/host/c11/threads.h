@@ -0,0 +1,37 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test C11 Threads
+ * - The host C11 threads with the few extensions of the libc threads.h, for code that
+ *   only needs the standard parts. The extensions are provided by the tests.
+ */
+
+#ifndef __HOST_C11_THREADS_H__
+#define __HOST_C11_THREADS_H__
+
+#include_next <threads.h>
+#include <limits.h>
+#include <stddef.h>
+
+#define TSS_KEY_INVALID UINT_MAX
+
+extern int thrd_sleepex(size_t msec);
+extern int thrd_signal(thrd_t thr, int sig);
+
+#endif //!__HOST_C11_THREADS_H__
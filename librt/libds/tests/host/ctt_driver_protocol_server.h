@@ -0,0 +1,27 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Driver Contract Server
+ * - Nothing of the driver contract is used by the host tests.
+ */
+
+#ifndef __CTT_DRIVER_PROTOCOL_SERVER_H__
+#define __CTT_DRIVER_PROTOCOL_SERVER_H__
+
+#endif //!__CTT_DRIVER_PROTOCOL_SERVER_H__
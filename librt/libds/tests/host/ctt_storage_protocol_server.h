@@ -0,0 +1,47 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Storage Contract Server
+ * - The requests and responses of the storage contract as seen by a storage driver.
+ */
+
+#ifndef __CTT_STORAGE_PROTOCOL_SERVER_H__
+#define __CTT_STORAGE_PROTOCOL_SERVER_H__
+
+#include <gracht/link/vali.h>
+#include <os/osdefs.h>
+
+struct ctt_storage_transfer_args {
+    UUId_t       device_id;
+    int          direction;
+    unsigned int sector_lo;
+    unsigned int sector_hi;
+    UUId_t       buffer_id;
+    unsigned int buffer_offset;
+    size_t       sector_count;
+};
+
+#define ctt_storage_transfer_async_args ctt_storage_transfer_args
+
+extern int ctt_storage_transfer_response(struct gracht_recv_message* message,
+    OsStatus_t status, size_t sectors_transferred);
+extern int ctt_storage_transfer_async_response(struct gracht_recv_message* message,
+    OsStatus_t status, size_t sectors_transferred);
+
+#endif //!__CTT_STORAGE_PROTOCOL_SERVER_H__
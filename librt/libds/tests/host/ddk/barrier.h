@@ -0,0 +1,39 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Barriers
+ * - The barriers libds uses, expressed with C11 fences for the host builds.
+ */
+
+#ifndef __DDK_BARRIERS_H__
+#define __DDK_BARRIERS_H__
+
+#include <stdatomic.h>
+
+#define sw_mb()   atomic_signal_fence(memory_order_seq_cst)
+#define smp_mb()  atomic_thread_fence(memory_order_seq_cst)
+#define smp_rmb() atomic_thread_fence(memory_order_acquire)
+#define smp_wmb() atomic_thread_fence(memory_order_release)
+
+// Device memory is host memory, so only the compiler must not reorder the accesses
+#define dma_mb()  sw_mb()
+#define dma_rmb() atomic_signal_fence(memory_order_acquire)
+#define dma_wmb() atomic_signal_fence(memory_order_release)
+
+#endif //!__DDK_BARRIERS_H__
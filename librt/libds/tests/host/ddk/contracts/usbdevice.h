@@ -0,0 +1,36 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Usb Device Contract
+ * - The usb device structures drivers embed in their devices, the host tests never
+ *   look into them.
+ */
+
+#ifndef __DDK_CONTRACT_USBDEVICE_H__
+#define __DDK_CONTRACT_USBDEVICE_H__
+
+#include <ddk/device.h>
+#include <ddk/usb.h>
+
+typedef struct MCoreUsbDevice {
+    MCoreDevice_t Base;
+    int           InterfaceId;
+} MCoreUsbDevice_t;
+
+#endif //!__DDK_CONTRACT_USBDEVICE_H__
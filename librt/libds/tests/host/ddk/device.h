@@ -0,0 +1,42 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Devices
+ * - The device structures drivers embed in their controllers, the host tests never
+ *   look into them.
+ */
+
+#ifndef __DDK_DEVICE_H__
+#define __DDK_DEVICE_H__
+
+#include <ddk/interrupt.h>
+#include <ddk/io.h>
+#include <os/osdefs.h>
+
+typedef struct DeviceIo {
+    int    Type;
+    size_t Length;
+} DeviceIo_t;
+
+typedef struct MCoreDevice {
+    UUId_t Id;
+    size_t Length;
+} MCoreDevice_t;
+
+#endif //!__DDK_DEVICE_H__
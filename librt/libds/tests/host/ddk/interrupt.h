@@ -0,0 +1,60 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Interrupts
+ * - The message signaled interrupt capability the bus fills in, and the balancing
+ *   statistics of the kernel, kept in sync with the definitions in libddk.
+ */
+
+#ifndef __DDK_INTERRUPT_H__
+#define __DDK_INTERRUPT_H__
+
+#include <ddk/io.h>
+#include <os/osdefs.h>
+
+#define INTERRUPT_MSI_CAPABILITY_NONE   0
+#define INTERRUPT_MSI_CAPABILITY_MSI    1
+#define INTERRUPT_MSI_CAPABILITY_MSIX   2
+
+#define INTERRUPT_MAX_MSI_VECTORS       32
+
+#define INTERRUPT_BALANCE_NONE          0           // Lines are delivered to the lowest priority core
+#define INTERRUPT_BALANCE_SPREAD        1           // Spread the interrupt load evenly across cores
+#define INTERRUPT_BALANCE_COLOCATE      2           // Route lines to the core of the driver thread
+
+typedef struct DeviceMsiCapability {
+    int          Type;
+    unsigned int Offset;        // Offset of the capability in the configuration space
+    int          Vectors;       // Vectors the driver may register
+    int          Is64Bit;       // MSI   - The message address register is 64 bit
+    int          TableIoSpace;  // MSI-X - The index of the io-space that holds the vector table
+    size_t       TableOffset;   // MSI-X - The offset of the vector table in the io-space
+} DeviceMsiCapability_t;
+
+typedef struct InterruptBalanceStatistics {
+    UUId_t       TableIndex;
+    int          Source;
+    UUId_t       CoreId;        // UUID_INVALID if routed by the interrupt controller
+    unsigned int Count;         // Interrupts handled since the line was registered
+    unsigned int Rate;          // Interrupts per second over the last period
+    uint64_t     Cost;          // Average handler cost in timestamp counts
+    unsigned int Migrations;    // Times the line was moved to another core
+} InterruptBalanceStatistics_t;
+
+#endif //!__DDK_INTERRUPT_H__
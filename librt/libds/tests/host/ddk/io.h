@@ -0,0 +1,38 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Volatile Access
+ * - The volatile accessors libds uses, for the host builds. Tests that model a device
+ *   define HOST_MMIO_TRAP to be told about every register write, like the device would.
+ */
+
+#ifndef __DDK_IO_H__
+#define __DDK_IO_H__
+
+#include <ddk/barrier.h>
+
+#define READ_VOLATILE(var)         (*(volatile __typeof__(var)*)&(var))
+#ifdef HOST_MMIO_TRAP
+extern void HostMmioWrite(volatile void* address);
+#define WRITE_VOLATILE(var, value) ({ *(volatile __typeof__(var)*)&(var) = (value); HostMmioWrite(&(var)); })
+#else
+#define WRITE_VOLATILE(var, value) (*(volatile __typeof__(var)*)&(var) = (value))
+#endif
+
+#endif //!__DDK_IO_H__
@@ -0,0 +1,76 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Usb Definitions
+ * - The speeds, endpoints and transfer codes of the usb stack, the host tests never
+ *   issue transfers.
+ */
+
+#ifndef __DDK_USB_H__
+#define __DDK_USB_H__
+
+#include <os/osdefs.h>
+
+typedef enum _UsbSpeed {
+    LowSpeed,
+    FullSpeed,
+    HighSpeed,
+    SuperSpeed
+} UsbSpeed_t;
+
+typedef struct UsbHcEndpointDescriptor {
+    int    Type;
+    int    Synchronization;
+    size_t Address;
+    int    Direction;
+    size_t MaxPacketSize;
+    size_t Bandwidth;
+    size_t Interval;
+} UsbHcEndpointDescriptor_t;
+
+#define USB_ENDPOINT_IN  0x0
+#define USB_ENDPOINT_OUT 0x1
+
+typedef enum _UsbTransferType {
+    ControlTransfer,
+    BulkTransfer,
+    InterruptTransfer,
+    IsochronousTransfer
+} UsbTransferType_t;
+
+typedef enum _UsbTransferStatus {
+    TransferNotProcessed,
+    TransferQueued,
+    TransferFinished,
+    TransferInvalid,
+    TransferNoBandwidth,
+    TransferStalled,
+    TransferNotResponding,
+    TransferInvalidToggles,
+    TransferBufferError,
+    TransferNAK,
+    TransferBabble
+} UsbTransferStatus_t;
+
+typedef struct UsbTransfer {
+    int    Type;
+    size_t Length;
+} UsbTransfer_t;
+
+#endif //!__DDK_USB_H__
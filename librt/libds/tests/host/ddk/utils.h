@@ -0,0 +1,48 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Driver Utilities
+ * - The logging macros and wait helpers of the ddk. The host tests check the outcome of
+ *   errors themselves, so nothing is printed.
+ */
+
+#ifndef __HOST_DDK_UTILS_H__
+#define __HOST_DDK_UTILS_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define WARNING(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#define ERROR(...)   do { if (0) printf(__VA_ARGS__); } while (0)
+#define TRACE(...)
+
+// Part of the libc threads.h, the host tests that poll registers provide it
+extern int thrd_sleepex(size_t msec);
+
+#define WaitForConditionWithFault(fault, condition, runs, wait)\
+    fault = 0; \
+    for (unsigned int timeout_ = 0; !(condition); timeout_++) {\
+        if (timeout_ >= runs) {\
+            fault = 1; \
+            break;\
+        }\
+        thrd_sleepex(wait);\
+    }
+
+#endif //!__HOST_DDK_UTILS_H__
@@ -0,0 +1,39 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Gracht Link
+ * - The deferred response a driver keeps for a request it completes later.
+ */
+
+#ifndef __GRACHT_LINK_VALI_H__
+#define __GRACHT_LINK_VALI_H__
+
+struct gracht_recv_message {
+    void* storage;
+    int   client;
+};
+
+struct vali_link_deferred_response {
+    struct gracht_recv_message recv_message;
+};
+
+extern void gracht_vali_message_defer_response(struct vali_link_deferred_response*,
+    struct gracht_recv_message*);
+
+#endif //!__GRACHT_LINK_VALI_H__
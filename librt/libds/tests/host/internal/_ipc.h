@@ -0,0 +1,47 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test IPC
+ * - The storage contract call the block queue makes towards the driver. There is no
+ *   gracht link on the host, the call is implemented by the test as a simulated device.
+ * - The process service call the libc makes for the tick of a process.
+ */
+
+#ifndef __INTERNAL_IPC_H__
+#define __INTERNAL_IPC_H__
+
+#include <os/osdefs.h>
+
+struct vali_link_message {
+    UUId_t Handle;
+};
+
+#define VALI_MSG_INIT_HANDLE(handle) { (handle) }
+#define GetGrachtClient()            NULL
+#define gracht_vali_message_finish(message)
+
+extern int ctt_storage_transfer(void* client, struct vali_link_message* message, UUId_t device_id,
+    int direction, unsigned int sector_lo, unsigned int sector_hi, UUId_t buffer_id,
+    unsigned int buffer_offset, size_t sector_count, OsStatus_t* status, size_t* sectors_transferred);
+
+extern UUId_t GetProcessService(void);
+extern int    svc_process_get_tick_base(void* client, struct vali_link_message* message, UUId_t handle,
+    OsStatus_t* status, unsigned int* tick_lo, unsigned int* tick_hi);
+
+#endif //!__INTERNAL_IPC_H__
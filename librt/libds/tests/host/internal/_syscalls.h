@@ -0,0 +1,43 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test System Calls
+ * - The futex system calls of the libc, implemented on the host futex in host/system.c.
+ * - The system calls of the libc system interface, the tests that use it provide them.
+ */
+
+#ifndef __INTERNAL_SYSCALLS__
+#define __INTERNAL_SYSCALLS__
+
+#include <internal/_utils.h>
+#include <os/mollenos.h>
+
+extern OsStatus_t Syscall_FutexWait(FutexParameters_t* Parameters);
+extern OsStatus_t Syscall_FutexWake(FutexParameters_t* Parameters);
+
+extern OsStatus_t Syscall_SystemQuery(SystemDescriptor_t* Descriptor);
+extern OsStatus_t Syscall_SystemTick(int TickBase, LargeUInteger_t* Tick);
+extern OsStatus_t Syscall_SystemPerformanceFrequency(LargeInteger_t* Frequency);
+extern OsStatus_t Syscall_SystemPerformanceTime(LargeInteger_t* Value);
+extern OsStatus_t Syscall_SystemTime(SystemTime_t* Time);
+extern OsStatus_t Syscall_SystemLogRead(size_t* Cursor, char* Buffer, size_t Length, size_t* BytesRead);
+extern OsStatus_t Syscall_SystemPage(VirtualAddress_t* Address);
+extern OsStatus_t Syscall_FlushHardwareCache(int Cache, void* Start, size_t Length);
+
+#endif //!__INTERNAL_SYSCALLS__
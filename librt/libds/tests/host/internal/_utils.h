@@ -0,0 +1,42 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Utilities
+ * - The futex parameters and the process module check of the libc, see internal/_utils.h
+ *   of the libc.
+ */
+
+#ifndef __INTERNAL_UTILS__
+#define __INTERNAL_UTILS__
+
+#include <os/osdefs.h>
+
+typedef struct FutexParameters {
+    _Atomic(int)* _futex0;
+    _Atomic(int)* _futex1;
+    int           _val0;
+    int           _val1;
+    int           _val2;
+    int           _flags;
+    size_t        _timeout;
+} FutexParameters_t;
+
+extern int IsProcessModule(void);
+
+#endif //!__INTERNAL_UTILS__
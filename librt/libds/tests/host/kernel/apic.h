@@ -0,0 +1,41 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Apic
+ * - The local apic registers the timer handler uses, the tests that model the timer
+ *   provide the register accesses.
+ */
+
+#ifndef __HOST_APIC_H__
+#define __HOST_APIC_H__
+
+#include <interrupts.h>
+
+#define APIC_INITIAL_COUNT		0x380
+#define APIC_CURRENT_COUNT		0x390
+
+__EXTERN uint32_t ApicReadLocal(size_t Register);
+__EXTERN void ApicWriteLocal(size_t Register, uint32_t Value);
+
+KERNELAPI InterruptStatus_t KERNELABI
+ApicTimerHandler(
+    _In_ FastInterruptResources_t* NotUsed,
+    _In_ void*                     Context);
+
+#endif //!__HOST_APIC_H__
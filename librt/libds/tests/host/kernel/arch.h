@@ -0,0 +1,31 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Architecture
+ * - The limits of the x86 architecture the kernel is built with.
+ */
+
+#ifndef __HOST_ARCH_H__
+#define __HOST_ARCH_H__
+
+#include <os/osdefs.h>
+
+#define MAX_SUPPORTED_INTERRUPTS        256
+
+#endif //!__HOST_ARCH_H__
@@ -0,0 +1,35 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Interrupt Control
+ * - The interrupt control of the architecture, the tests that model interrupt lines
+ *   provide the routing.
+ */
+
+#ifndef __HOST_ARCH_INTERRUPTS_H__
+#define __HOST_ARCH_INTERRUPTS_H__
+
+#include <interrupts.h>
+
+KERNELAPI OsStatus_t KERNELABI
+InterruptSetAffinity(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId);
+
+#endif //!__HOST_ARCH_INTERRUPTS_H__
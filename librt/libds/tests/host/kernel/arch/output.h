@@ -0,0 +1,38 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Output
+ * - The terminal the log renders to. The log tests keep rendering disabled and read
+ *   the history instead, so only the colors are kept.
+ */
+
+#ifndef __HOST_ARCH_OUTPUT_H__
+#define __HOST_ARCH_OUTPUT_H__
+
+#include <os/osdefs.h>
+
+typedef struct BootTerminal {
+    uint32_t FgColor;
+    uint32_t BgColor;
+} BootTerminal_t;
+
+KERNELAPI BootTerminal_t* KERNELABI
+VideoGetTerminal(void);
+
+#endif //!__HOST_ARCH_OUTPUT_H__
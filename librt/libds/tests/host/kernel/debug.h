@@ -0,0 +1,38 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Debug
+ * - The kernel log macros. Traces and warnings are not printed, the tests check the
+ *   outcome themselves, but a fatal error stops the test.
+ */
+
+#ifndef __HOST_DEBUG_H__
+#define __HOST_DEBUG_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FATAL_SCOPE_KERNEL 0x00000001
+
+#define TRACE(...)
+#define WARNING(...)      do { if (0) printf(__VA_ARGS__); } while (0)
+#define ERROR(...)        do { if (0) printf(__VA_ARGS__); } while (0)
+#define FATAL(Scope, ...) do { printf(__VA_ARGS__); printf("\n"); abort(); } while (0)
+
+#endif //!__HOST_DEBUG_H__
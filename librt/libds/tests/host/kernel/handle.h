@@ -0,0 +1,55 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Handles
+ * - The handle table, the tests that model threads or resources provide it.
+ */
+
+#ifndef __HOST_HANDLE_H__
+#define __HOST_HANDLE_H__
+
+#include <os/osdefs.h>
+
+typedef enum HandleType {
+    HandleTypeGeneric = 0,
+    HandleTypeSet,
+    HandleTypeMemorySpace,
+    HandleTypeMemoryRegion,
+    HandleTypeThread,
+    HandleTypeIpcContext
+} HandleType_t;
+
+typedef void (*HandleDestructorFn)(void*);
+
+KERNELAPI UUId_t KERNELABI
+CreateHandle(
+    _In_ HandleType_t       Type,
+    _In_ HandleDestructorFn Destructor,
+    _In_ void*              Resource);
+
+KERNELAPI void* KERNELABI
+AcquireHandle(
+    _In_ UUId_t Handle);
+
+KERNELAPI void* KERNELABI
+LookupHandleOfType(
+    _In_ UUId_t       Handle,
+    _In_ HandleType_t Type);
+
+#endif //!__HOST_HANDLE_H__
@@ -0,0 +1,63 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Interrupts
+ * - The interrupt handler types of the kernel, and the balancer the interrupt table
+ *   reports to. The tests that model interrupt lines provide the table.
+ */
+
+#ifndef __HOST_INTERRUPTS_H__
+#define __HOST_INTERRUPTS_H__
+
+#include <ddk/interrupt.h>
+#include <os/osdefs.h>
+
+typedef struct FastInterruptResources FastInterruptResources_t;
+typedef struct SystemInterrupt SystemInterrupt_t;
+
+KERNELAPI OsStatus_t KERNELABI
+InterruptGetBalanceInfo(
+    _In_  UUId_t  TableIndex,
+    _Out_ int*    Source,
+    _Out_ UUId_t* Thread);
+
+KERNELAPI void KERNELABI
+InterruptBalancerInitialize(void);
+
+KERNELAPI void KERNELABI
+InterruptBalancerReset(
+    _In_ UUId_t TableIndex);
+
+KERNELAPI void KERNELABI
+InterruptBalancerUpdate(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             TableIndex,
+    _In_ uint64_t           Cost);
+
+KERNELAPI OsStatus_t KERNELABI
+InterruptBalancerSetPolicy(
+    _In_ int Policy);
+
+KERNELAPI OsStatus_t KERNELABI
+InterruptBalancerQuery(
+    _Out_   int*                          Policy,
+    _Out_   InterruptBalanceStatistics_t* Statistics,
+    _InOut_ int*                          Count);
+
+#endif //!__HOST_INTERRUPTS_H__
@@ -0,0 +1,89 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Machine
+ * - A machine of one processor, with only the parts of the cores that the scheduler
+ *   uses. The tests that model a core provide the lookups.
+ * - The clock and system values the system page publishes.
+ */
+
+#ifndef __HOST_MACHINE_H__
+#define __HOST_MACHINE_H__
+
+#include <ddk/io.h>
+#include <os/types/syspage.h>
+#include <threading.h>
+#include <scheduler.h>
+
+typedef void(*TxuFunction_t)(void*);
+
+typedef enum SystemCpuState {
+    CpuStateUnavailable     = 0x0,
+    CpuStateShutdown        = 0x1,
+    CpuStateRunning         = 0x2
+} SystemCpuState_t;
+
+typedef enum SystemCpuFunctionType {
+    CpuFunctionHalt,
+    CpuFunctionCustom,
+
+    CpuFunctionCount
+} SystemCpuFunctionType_t;
+
+typedef struct SystemCpuCore {
+    UUId_t                Id;
+    SystemCpuState_t      State;
+    MCoreThread_t         IdleThread;
+    SystemScheduler_t     Scheduler;
+    MCoreThread_t*        CurrentThread;
+    struct SystemCpuCore* Link;
+} SystemCpuCore_t;
+
+typedef struct SystemCpu {
+    int              NumberOfCores;
+    SystemCpuCore_t* Cores;
+} SystemCpu_t;
+
+typedef struct SystemMachine {
+    SystemCpu_t  Processor;
+    SystemTime_t SystemTime;
+    _Atomic(int) NumberOfProcessors;
+    _Atomic(int) NumberOfActiveCores;
+    size_t       MemoryGranularity;
+} SystemMachine_t;
+
+KERNELAPI SystemMachine_t* KERNELABI
+GetMachine(void);
+
+KERNELAPI SystemCpuCore_t* KERNELABI
+GetProcessorCore(
+    _In_ UUId_t CoreId);
+
+KERNELAPI SystemCpuCore_t* KERNELABI
+GetCurrentProcessorCore(void);
+
+KERNELAPI OsStatus_t KERNELABI
+TxuMessageSend(
+    _In_ UUId_t                  CoreId,
+    _In_ SystemCpuFunctionType_t Type,
+    _In_ TxuFunction_t           Function,
+    _In_ void*                   Argument,
+    _In_ int                     Asynchronous);
+
+#endif //!__HOST_MACHINE_H__
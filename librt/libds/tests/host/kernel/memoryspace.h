@@ -0,0 +1,97 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Memory Spaces
+ * - The mapping functions of the memory spaces. The tests that model memory provide them,
+ *   and decide which physical pages a commit is backed by.
+ */
+
+#ifndef __HOST_MEMORYSPACE_H__
+#define __HOST_MEMORYSPACE_H__
+
+#include <os/osdefs.h>
+#include <mutex.h>
+
+#define MAPPING_USERSPACE               0x00000001
+#define MAPPING_NOCACHE                 0x00000002
+#define MAPPING_READONLY                0x00000004
+#define MAPPING_PERSISTENT              0x00000020
+#define MAPPING_COMMIT                  0x00000080
+
+#define MAPPING_PHYSICAL_FIXED          0x00000001
+
+#define MAPPING_VIRTUAL_GLOBAL          0x00000002
+#define MAPPING_VIRTUAL_PROCESS         0x00000004
+
+typedef struct SystemMemorySpace SystemMemorySpace_t;
+
+KERNELAPI SystemMemorySpace_t* KERNELABI
+GetCurrentMemorySpace(void);
+
+KERNELAPI OsStatus_t KERNELABI
+MemorySpaceMap(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _InOut_ uintptr_t*           PhysicalAddressValues,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags);
+
+KERNELAPI OsStatus_t KERNELABI
+MemorySpaceMapContiguous(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _In_    uintptr_t            PhysicalStartAddress,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags);
+
+KERNELAPI OsStatus_t KERNELABI
+MemorySpaceMapReserved(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags);
+
+KERNELAPI OsStatus_t KERNELABI
+MemorySpaceUnmap(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ size_t               Size);
+
+KERNELAPI OsStatus_t KERNELABI
+MemorySpaceCommit(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ uintptr_t*           PhysicalAddressValues,
+    _In_ size_t               Length,
+    _In_ Flags_t              Placement);
+
+KERNELAPI OsStatus_t KERNELABI
+GetMemorySpaceMapping(
+    _In_  SystemMemorySpace_t* MemorySpace,
+    _In_  VirtualAddress_t     Address,
+    _In_  int                  PageCount,
+    _Out_ uintptr_t*           DmaVectorOut);
+
+KERNELAPI size_t KERNELABI
+GetMemorySpacePageSize(void);
+
+#endif //!__HOST_MEMORYSPACE_H__
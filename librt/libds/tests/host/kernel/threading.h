@@ -0,0 +1,62 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Threading
+ * - The thread fields the scheduler reads. The tests that model a core provide the
+ *   thread switch, the thread creation and the current thread.
+ */
+
+#ifndef __HOST_THREADING_H__
+#define __HOST_THREADING_H__
+
+#include <scheduler.h>
+
+#define THREADING_IDLE 0x00000008
+
+typedef void(*ThreadEntry_t)(void*);
+
+typedef struct MCoreThread {
+    const char*        Name;
+    Flags_t            Flags;
+    SchedulerObject_t* SchedulerObject;
+} MCoreThread_t;
+
+KERNELAPI OsStatus_t KERNELABI
+CreateThread(
+    _In_  const char*    Name,
+    _In_  ThreadEntry_t  Function,
+    _In_  void*          Arguments,
+    _In_  Flags_t        Flags,
+    _In_  UUId_t         MemorySpaceHandle,
+    _Out_ UUId_t*        Handle);
+
+KERNELAPI UUId_t KERNELABI
+GetCurrentThreadId(void);
+
+KERNELAPI int KERNELABI
+ThreadingIsCurrentTaskIdle(
+    _In_ UUId_t CoreId);
+
+KERNELAPI OsStatus_t KERNELABI
+ThreadingAdvance(
+    _In_  int       Preemptive,
+    _In_  uint64_t  NanosecondsPassed,
+    _Out_ uint64_t* NextDeadlineOut);
+
+#endif //!__HOST_THREADING_H__
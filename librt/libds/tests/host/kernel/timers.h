@@ -0,0 +1,38 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Kernel Timers
+ * - The system tick, the tests that model a core provide it. The tick has the rate of
+ *   the kernel, which is a millisecond and not the rate of the host clock().
+ */
+
+#ifndef __HOST_TIMERS_H__
+#define __HOST_TIMERS_H__
+
+#include <os/osdefs.h>
+#include <time.h>
+
+#undef  CLOCKS_PER_SEC
+#define CLOCKS_PER_SEC 1000
+
+KERNELAPI OsStatus_t KERNELABI
+TimersGetSystemTick(
+    _Out_ clock_t* SystemTick);
+
+#endif //!__HOST_TIMERS_H__
@@ -0,0 +1,34 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Threads
+ * - The libc threading definitions, the host C library has its own threads.h which is
+ *   shadowed so the libc mutex can be built against its own definitions.
+ */
+
+#ifndef __HOST_THREADS_H__
+#define __HOST_THREADS_H__
+
+#include "../../../../libc/include/threads.h"
+
+// Part of the libc time.h, which the host time.h does not have
+extern void timespec_diff(const struct timespec* start, const struct timespec* stop,
+    struct timespec* result);
+
+#endif //!__HOST_THREADS_H__
@@ -0,0 +1,54 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Allocators
+ * - The libc malloc.h for the allocator test, which builds dlmalloc and the thread-caching
+ *   allocator into one program next to the host allocator. dlmalloc keeps its dl prefix,
+ *   and the entry points of the thread-caching allocator get a tc prefix where they would
+ *   replace the host ones.
+ */
+
+#ifndef __HOST_MALLOC_H__
+#define __HOST_MALLOC_H__
+
+// dlmalloc is built with the os configuration, its memory comes from MemoryAllocate
+#define MOLLENOS
+#define _CRTIMP extern
+
+#ifndef __OSCONFIG_MALLOC_THREAD_CACHE
+#define USE_DL_PREFIX
+#else
+#define malloc             tc_malloc
+#define free               tc_free
+#define calloc             tc_calloc
+#define realloc            tc_realloc
+#define memalign           tc_memalign
+#define posix_memalign     tc_posix_memalign
+#define valloc             tc_valloc
+#define pvalloc            tc_pvalloc
+#define malloc_trim        tc_malloc_trim
+#define malloc_usable_size tc_malloc_usable_size
+#define mallopt            tc_mallopt
+#define malloc_stats       tc_malloc_stats
+#define mallinfo(...)      tc_mallinfo(__VA_ARGS__)
+#endif
+
+#include "../../../../libc/include/malloc.h"
+
+#endif //!__HOST_MALLOC_H__
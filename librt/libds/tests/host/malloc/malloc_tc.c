@@ -0,0 +1,26 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Thread-Caching Allocator
+ * - The libc builds either dlmalloc or the thread-caching allocator, the allocator test
+ *   builds both, so this unit configures the thread cache for its allocator.
+ */
+
+#define __OSCONFIG_MALLOC_THREAD_CACHE
+#include "../../../../libc/stdlib/malloc_tc.c"
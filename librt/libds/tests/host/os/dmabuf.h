@@ -0,0 +1,30 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test DMA Buffers
+ * - The libc dma buffer definitions. The AHCI host test implements the calls on top of
+ *   host memory, where the physical address of a buffer is its virtual address.
+ */
+
+#ifndef __HOST_DMABUF_H__
+#define __HOST_DMABUF_H__
+
+#include "../../../../libc/include/os/dmabuf.h"
+
+#endif //!__HOST_DMABUF_H__
@@ -0,0 +1,57 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test System
+ * - The system information the libc mutex reads. The number of active cores can be
+ *   changed by the tests, so the spinning paths can be measured on any machine.
+ * - The memory calls the allocators map their memory with.
+ * - The clocks of the libc, which read the system page the kernel publishes.
+ */
+
+#ifndef __MOLLENOS_H__
+#define __MOLLENOS_H__
+
+#include <os/osdefs.h>
+#include <os/types/syspage.h>
+
+// The time bases of the libc time.h
+#define TIME_MONOTONIC       2
+#define TIME_PROCESS         3
+
+#define MEMORY_COMMIT        0x00000001
+#define MEMORY_CLEAN         0x00000004
+#define MEMORY_READ          0x00000010
+#define MEMORY_WRITE         0x00000020
+
+typedef struct SystemDescriptor {
+    size_t NumberOfProcessors;
+    size_t NumberOfActiveCores;
+} SystemDescriptor_t;
+
+// Must only be changed while no mutex is in use
+extern void                HostSetActiveCores(size_t Count);
+extern OsStatus_t          SystemQuery(SystemDescriptor_t* Descriptor);
+extern const SystemPage_t* GetSystemPage(void);
+extern OsStatus_t          GetSystemPageTime(SystemPageTime_t* Time);
+extern OsStatus_t          GetSystemTime(SystemTime_t* Time);
+extern OsStatus_t          GetSystemTick(int TickBase, LargeUInteger_t* Tick);
+extern OsStatus_t          MemoryAllocate(void* Hint, size_t Length, Flags_t Flags, void** MemoryOut);
+extern OsStatus_t          MemoryFree(void* Memory, size_t Length);
+
+#endif //!__MOLLENOS_H__
@@ -0,0 +1,156 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Definitions
+ * - The subset of the OS definitions that libds, the libc mutex, the block queue, the
+ *   AHCI driver, the PCI bus code and the kernel tlb tracking and scheduler use, mapped
+ *   onto the host C library so they can be built and tested on the build machine.
+ */
+
+#ifndef __OS_DEFINITIONS__
+#define __OS_DEFINITIONS__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// The native integer formats of the libc inttypes.h
+#define PRIiIN "li"
+#define PRIuIN "lu"
+#define PRIxIN "lx"
+
+#define _In_
+#define _In_Opt_
+#define _Out_
+#define _Out_Opt_
+#define _InOut_
+#define _CODE_BEGIN
+#define _CODE_END
+#define _CRT_UNUSED(x) (void)(x)
+#define CRTDECL(ReturnType, Function) extern ReturnType Function
+#define _set_errno(e) (errno = (e))
+#define __EXTERN extern
+#define KERNELAPI __EXTERN
+#define KERNELABI
+#define PACKED_STRUCT(name, body) struct __attribute__((packed)) name body
+#define PACKED_TYPESTRUCT(name, body) typedef struct __attribute__((packed)) name body name##_t
+#define PACKED_ATYPESTRUCT(opts, name, body) typedef opts struct __attribute__((packed)) name body name##_t
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define __BITS 64
+#define __MASK 0xFFFFFFFFFFFFFFFF
+#else
+#define __BITS 32
+#define __MASK 0xFFFFFFFF
+#endif
+
+typedef unsigned int IntStatus_t;
+typedef unsigned int UUId_t;
+typedef unsigned int Flags_t;
+typedef unsigned     DevInfo_t;
+typedef uint32_t reg32_t;
+typedef uintptr_t VirtualAddress_t;
+typedef int errno_t;
+
+typedef union LargeUInteger {
+    struct {
+        uint32_t LowPart;
+        uint32_t HighPart;
+    } u;
+    uint64_t QuadPart;
+} LargeUInteger_t;
+
+typedef union LargeInteger {
+    struct {
+        uint32_t LowPart;
+        int32_t  HighPart;
+    } s;
+    struct {
+        uint32_t LowPart;
+        uint32_t HighPart;
+    } u;
+    int64_t QuadPart;
+} LargeInteger_t;
+#define UUID_INVALID 0
+
+typedef enum {
+    OsSuccess = 0,
+    OsError,
+    OsExists,
+    OsDoesNotExist,
+    OsInvalidParameters,
+    OsInvalidPermissions,
+    OsTimeout,
+    OsInterrupted,
+    OsNotSupported,
+    OsOutOfMemory,
+    OsBusy,
+    OsIncomplete,
+    OsDeviceError
+} OsStatus_t;
+
+typedef enum {
+    InterruptNotHandled,
+    InterruptHandled,       // Handled, notify process
+    InterruptHandledStop,   // Handled, do not notify process
+} InterruptStatus_t;
+
+#define MIN(a,b)                (((a)<(b))?(a):(b))
+#define MAX(a,b)                (((a)>(b))?(a):(b))
+#define DIVUP(a, b)             ((a / b) + (((a % b) > 0) ? 1 : 0))
+#define SIZEOF_ARRAY(Array)     (sizeof(Array) / sizeof((Array)[0]))
+#define ISINRANGE(val, min, max)                (((val) >= (min)) && ((val) <= (max)))
+#define ALIGN(Val, Alignment, Roundup)          ((Val & (Alignment-1)) > 0 ? (Roundup == 1 ? ((Val + Alignment) & ~(Alignment-1)) : Val & ~(Alignment-1)) : Val)
+
+#define LOBYTE(l)               ((uint8_t)(uint16_t)(l))
+#define HIBYTE(l)               ((uint8_t)((((uint16_t)(l)) >> 8) & 0xFF))
+#define LOWORD(l)               ((uint16_t)(uint32_t)(l))
+#define LODWORD(l)              ((uint32_t)((uint64_t)(l) & 0xFFFFFFFF))
+#define HIDWORD(l)              ((uint32_t)(((uint64_t)(l) >> 32) & 0xFFFFFFFF))
+
+#ifdef __COMPILE_ASSERT
+#define STATIC_ASSERT(COND,MSG)                 typedef char static_assertion_##MSG[(!!(COND))*2-1]
+#define COMPILE_TIME_ASSERT3(X,L)               STATIC_ASSERT(X,static_assertion_at_line_##L)
+#define COMPILE_TIME_ASSERT2(X,L)               COMPILE_TIME_ASSERT3(X,L)
+#define COMPILE_TIME_ASSERT(X)                  COMPILE_TIME_ASSERT2(X,__LINE__)
+#endif
+
+static inline int
+LastSetBit(size_t Value)
+{
+    size_t _Val = Value;
+    int bIndex = 0;
+
+    while (_Val >>= 1) {
+        bIndex++;
+    }
+    return bIndex;
+}
+
+#define NSEC_PER_SEC            1000000000L
+#define NSEC_PER_MSEC           1000000L
+#define MSEC_PER_SEC            1000L
+
+#endif //!__OS_DEFINITIONS__
@@ -0,0 +1,54 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Spinlock
+ * - Maps the libc spinlock onto an atomic flag for the host builds of libds.
+ */
+
+#ifndef __OS_SPINLOCK_H__
+#define __OS_SPINLOCK_H__
+
+#include <os/osdefs.h>
+
+enum {
+    spinlock_plain = 0
+};
+
+typedef struct {
+    atomic_flag value;
+    int         type;
+} spinlock_t;
+
+#define _SPN_INITIALIZER_NP(Flags) { ATOMIC_FLAG_INIT, Flags }
+
+static inline void spinlock_init(spinlock_t* lock, int type) {
+    atomic_flag_clear(&lock->value);
+    lock->type = type;
+}
+
+static inline void spinlock_acquire(spinlock_t* lock) {
+    while (atomic_flag_test_and_set_explicit(&lock->value, memory_order_acquire));
+}
+
+static inline int spinlock_release(spinlock_t* lock) {
+    atomic_flag_clear_explicit(&lock->value, memory_order_release);
+    return 0;
+}
+
+#endif //!__OS_SPINLOCK_H__
@@ -0,0 +1,89 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Support
+ * - The libds support functions for host builds, see support/ds.c for the userspace ones.
+ */
+
+#include <ds/ds.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* dsalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void dsfree(void* pointer)
+{
+    free(pointer);
+}
+
+void dslock(SafeMemoryLock_t* lock)
+{
+    int expected = 0;
+    while (!atomic_compare_exchange_weak(&lock->SyncObject, &expected, 1)) {
+        expected = 0;
+    }
+}
+
+void dsunlock(SafeMemoryLock_t* lock)
+{
+    atomic_store(&lock->SyncObject, 0);
+}
+
+void dswarning(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void dserror(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+int dsmatchkey(KeyType_t type, DataKey_t key1, DataKey_t key2)
+{
+    switch (type) {
+        case KeyId: {
+            if (key1.Value.Id == key2.Value.Id) {
+                return 0;
+            }
+        } break;
+        case KeyInteger: {
+            if (key1.Value.Integer == key2.Value.Integer) {
+                return 0;
+            }
+        } break;
+        case KeyString: {
+            return strcmp(key1.Value.String.Pointer, key2.Value.String.Pointer);
+        } break;
+    }
+    return -1;
+}
@@ -0,0 +1,133 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test System Support
+ * - The futex system calls and the system information of the libc on the host. Only the
+ *   plain wait and wake operations are supported.
+ * - Memory is mapped with mmap, which is always committed on use and clean.
+ */
+
+#define _GNU_SOURCE
+#include <internal/_syscalls.h>
+#include <os/futex.h>
+#include <os/mollenos.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The host futex operations, the names are taken by the libc ones
+#define HOST_FUTEX_WAIT    0
+#define HOST_FUTEX_WAKE    1
+#define HOST_FUTEX_PRIVATE 128
+
+static SystemPage_t SystemPage = { .NumberOfProcessors = 1, .NumberOfActiveCores = 1 };
+
+void
+HostSetActiveCores(
+    _In_ size_t Count)
+{
+    SystemPage.NumberOfProcessors  = Count;
+    SystemPage.NumberOfActiveCores = Count;
+}
+
+OsStatus_t
+SystemQuery(
+    _In_ SystemDescriptor_t* Descriptor)
+{
+    Descriptor->NumberOfProcessors  = SystemPage.NumberOfProcessors;
+    Descriptor->NumberOfActiveCores = SystemPage.NumberOfActiveCores;
+    return OsSuccess;
+}
+
+const SystemPage_t*
+GetSystemPage(void)
+{
+    return &SystemPage;
+}
+
+OsStatus_t
+MemoryAllocate(
+    _In_  void*   Hint,
+    _In_  size_t  Length,
+    _In_  Flags_t Flags,
+    _Out_ void**  MemoryOut)
+{
+    void* Memory;
+    _CRT_UNUSED(Hint);
+    _CRT_UNUSED(Flags);
+
+    Memory = mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (Memory == MAP_FAILED) {
+        return OsOutOfMemory;
+    }
+    *MemoryOut = Memory;
+    return OsSuccess;
+}
+
+OsStatus_t
+MemoryFree(
+    _In_ void*  Memory,
+    _In_ size_t Length)
+{
+    return munmap(Memory, Length) ? OsInvalidParameters : OsSuccess;
+}
+
+// A timeout of 0 waits forever, and a changed value is reported as OsError like the kernel does
+OsStatus_t
+Syscall_FutexWait(
+    _In_ FutexParameters_t* Parameters)
+{
+    struct timespec  Timeout;
+    struct timespec* TimeoutPointer = NULL;
+    int              Operation      = HOST_FUTEX_WAIT;
+
+    if (Parameters->_flags & (FUTEX_WAIT_OP | FUTEX_WAIT_PI)) {
+        return OsNotSupported;
+    }
+    if (Parameters->_flags & FUTEX_WAIT_PRIVATE) {
+        Operation |= HOST_FUTEX_PRIVATE;
+    }
+    if (Parameters->_timeout) {
+        Timeout.tv_sec  = (time_t)(Parameters->_timeout / MSEC_PER_SEC);
+        Timeout.tv_nsec = (long)(Parameters->_timeout % MSEC_PER_SEC) * NSEC_PER_MSEC;
+        TimeoutPointer  = &Timeout;
+    }
+
+    if (syscall(SYS_futex, Parameters->_futex0, Operation, Parameters->_val0,
+            TimeoutPointer, NULL, 0) == 0) {
+        return OsSuccess;
+    }
+    return (errno == ETIMEDOUT) ? OsTimeout : OsError;
+}
+
+OsStatus_t
+Syscall_FutexWake(
+    _In_ FutexParameters_t* Parameters)
+{
+    int Operation = HOST_FUTEX_WAKE;
+
+    if (Parameters->_flags & (FUTEX_WAKE_OP | FUTEX_WAKE_PI)) {
+        return OsNotSupported;
+    }
+    if (Parameters->_flags & FUTEX_WAKE_PRIVATE) {
+        Operation |= HOST_FUTEX_PRIVATE;
+    }
+    return (syscall(SYS_futex, Parameters->_futex0, Operation, Parameters->_val0,
+        NULL, NULL, 0) > 0) ? OsSuccess : OsDoesNotExist;
+}
@@ -0,0 +1,54 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Threads Support
+ * - The parts of the libc threads the host build of the libc mutex needs, the system calls
+ *   are in host/system.c.
+ */
+
+#define _GNU_SOURCE
+#include <os/osdefs.h>
+#include <threads.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The libc keeps the thread id in the thread block, so it must not cost a system call here
+thrd_t
+thrd_current(void)
+{
+    static _Thread_local thrd_t ThreadId = 0;
+    if (!ThreadId) {
+        ThreadId = (thrd_t)syscall(SYS_gettid);
+    }
+    return ThreadId;
+}
+
+void
+timespec_diff(
+    _In_ const struct timespec* start,
+    _In_ const struct timespec* stop,
+    _In_ struct timespec*       result)
+{
+    result->tv_sec  = stop->tv_sec - start->tv_sec;
+    result->tv_nsec = stop->tv_nsec - start->tv_nsec;
+    if (result->tv_nsec < 0) {
+        result->tv_sec--;
+        result->tv_nsec += 1000000000;
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Host Test Helpers
+ * - Checks and timing shared by the libds host tests.
+ */
+
+#ifndef __LIBDS_TEST_H__
+#define __LIBDS_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int TestFailures = 0;
+
+#define TEST_CHECK(Condition, ...) do { \
+        if (!(Condition)) { \
+            printf("FAIL %s:%i: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            TestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT(Name) do { \
+        printf("%s: %s\n", Name, TestFailures ? "FAILED" : "passed"); \
+        return TestFailures ? EXIT_FAILURE : EXIT_SUCCESS; \
+    } while (0)
+
+static inline double
+TestNow(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (double)Now.tv_sec + ((double)Now.tv_nsec / 1e9);
+}
+
+// xorshift64, the tests must be reproducible so they never seed from the clock
+static unsigned long long TestRandomState = 88172645463325252ULL;
+
+static inline unsigned long long
+TestRandom(void)
+{
+    TestRandomState ^= TestRandomState << 13;
+    TestRandomState ^= TestRandomState >> 7;
+    TestRandomState ^= TestRandomState << 17;
+    return TestRandomState;
+}
+
+// Iteration counts can be scaled from the command line for longer stress runs
+static inline long
+TestScale(int argc, char** argv, long Default)
+{
+    return (argc > 1) ? Default * atol(argv[1]) : Default;
+}
+
+#endif //!__LIBDS_TEST_H__
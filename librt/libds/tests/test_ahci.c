@@ -0,0 +1,720 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * AHCI Tests
+ * - The port, transaction and dispatch code of the AHCI driver is built against a software
+ *   model of an HBA port with an NCQ capable disk behind it. Register writes are trapped
+ *   like on the hardware, PxCI and PxSACT are write-one-to-set and the model reads the
+ *   command list, command tables and PRDTs the driver built. Queued commands complete in
+ *   random order. The model checks the driver against the protocol: PxSACT must be set
+ *   before PxCI, the FIS tag must match the slot, a tag must not be reused while active,
+ *   and queued and non-queued commands must never be mixed. Errors abort the queue, and
+ *   the driver must read the NCQ error log, fail the tag it names and reissue the rest.
+ */
+
+#include <ahci.h>
+#include <manager.h>
+#include <dispatch.h>
+#include <ctt_storage_protocol_server.h>
+#include "test.h"
+
+#define SECTOR_SIZE  512
+#define DISK_SECTORS 8192
+#define PAGE_SIZE    4096
+#define MAX_HANDLES  256
+#define NO_SECTOR    UINT64_MAX
+
+// The model of the port and the disk
+static struct {
+    AHCIPortRegisters_t* Registers;
+    reg32_t              CommandIssue;
+    reg32_t              Active;
+    reg32_t              InterruptStatus;
+    reg32_t              Pending;        // Queued commands the disk has accepted
+    int                  Halted;         // The disk stopped the queue after an error
+    uint64_t             BadSector;
+    int                  FailLogRead;
+    int                  FailedTag;
+    reg32_t              AbortedTags;    // Outstanding when the queue was aborted
+    uint64_t             AbortedSectors[32];
+    int                  Violations;
+    int                  LogReads;
+    uint8_t              Disk[DISK_SECTORS * SECTOR_SIZE];
+} Hba;
+
+static AhciController_t Controller;
+static AhciPort_t*      Port;
+static AhciDevice_t     Device;
+
+#define VIOLATION(...) do { printf("HBA: "); printf(__VA_ARGS__); printf("\n"); Hba.Violations++; } while (0)
+
+/************************************************************************
+ * Host DMA buffers, the physical address of a page is its virtual address
+ ************************************************************************/
+static struct {
+    uint8_t* Data;
+    size_t   Length;
+    int      Owned;
+} Handles[MAX_HANDLES];
+
+static UUId_t
+RegisterBuffer(
+    _In_ void*  Data,
+    _In_ size_t Length,
+    _In_ int    Owned)
+{
+    for (UUId_t i = 1; i < MAX_HANDLES; i++) {
+        if (!Handles[i].Data) {
+            Handles[i].Data   = Data;
+            Handles[i].Length = Length;
+            Handles[i].Owned  = Owned;
+            return i;
+        }
+    }
+    return UUID_INVALID;
+}
+
+OsStatus_t
+dma_create(struct dma_buffer_info* info, struct dma_attachment* attachment)
+{
+    size_t Length = (info->capacity + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    void*  Data   = aligned_alloc(PAGE_SIZE, Length);
+    memset(Data, 0, Length);
+    attachment->handle = RegisterBuffer(Data, info->length, 1);
+    attachment->buffer = Data;
+    attachment->length = info->length;
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_attach(UUId_t handle, struct dma_attachment* attachment)
+{
+    if (handle >= MAX_HANDLES || !Handles[handle].Data) {
+        return OsDoesNotExist;
+    }
+    attachment->handle = handle;
+    attachment->buffer = Handles[handle].Data;
+    attachment->length = Handles[handle].Length;
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_detach(struct dma_attachment* attachment)
+{
+    if (Handles[attachment->handle].Owned) {
+        free(Handles[attachment->handle].Data);
+        Handles[attachment->handle].Data = NULL;
+    }
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_attachment_unmap(struct dma_attachment* attachment)
+{
+    return OsSuccess;
+}
+
+// Entries end at page boundaries like physical pages would
+OsStatus_t
+dma_get_sg_table(struct dma_attachment* attachment, struct dma_sg_table* sg_table, int max_count)
+{
+    uintptr_t Address = (uintptr_t)attachment->buffer;
+    uintptr_t End     = Address + attachment->length;
+    int       Count   = 0;
+
+    sg_table->entries = malloc(sizeof(struct dma_sg) * ((attachment->length / PAGE_SIZE) + 2));
+    while (Address < End && (max_count <= 0 || Count < max_count)) {
+        uintptr_t Next = MIN(End, (Address & ~(uintptr_t)(PAGE_SIZE - 1)) + PAGE_SIZE);
+        sg_table->entries[Count].address = Address;
+        sg_table->entries[Count].length  = Next - Address;
+        Address = Next;
+        Count++;
+    }
+    sg_table->count = Count;
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_sg_table_offset(struct dma_sg_table* sg_table, size_t offset, int* sg_index_out, size_t* sg_offset_out)
+{
+    for (int i = 0; i < sg_table->count; i++) {
+        if (offset < sg_table->entries[i].length) {
+            *sg_index_out  = i;
+            *sg_offset_out = offset;
+            return OsSuccess;
+        }
+        offset -= sg_table->entries[i].length;
+    }
+    return OsInvalidParameters;
+}
+
+/************************************************************************
+ * The driver environment
+ ************************************************************************/
+typedef struct Request {
+    uint64_t   Sector;
+    size_t     Count;
+    int        Write;
+    UUId_t     Buffer;
+    size_t     Offset;
+    int        Completions;
+    OsStatus_t Status;
+    size_t     Sectors;
+} Request_t;
+
+extern OsStatus_t AhciTransactionStorageCreate(AhciDevice_t*, struct gracht_recv_message*,
+    int, uint64_t, UUId_t, unsigned int, size_t);
+
+void
+gracht_vali_message_defer_response(struct vali_link_deferred_response* deferred, struct gracht_recv_message* message)
+{
+    deferred->recv_message = *message;
+}
+
+int
+ctt_storage_transfer_response(struct gracht_recv_message* message, OsStatus_t status, size_t sectors_transferred)
+{
+    Request_t* Request = message->storage;
+    Request->Completions++;
+    Request->Status  = status;
+    Request->Sectors = sectors_transferred;
+    return 0;
+}
+
+int
+ctt_storage_transfer_async_response(struct gracht_recv_message* message, OsStatus_t status, size_t sectors_transferred)
+{
+    return ctt_storage_transfer_response(message, status, sectors_transferred);
+}
+
+int           thrd_sleepex(size_t msec) { return 0; }
+size_t        AhciManagerGetFrameSize(void) { return PAGE_SIZE; }
+OsStatus_t    AhciManagerRegisterDevice(AhciController_t* c, AhciPort_t* p, uint32_t s) { return OsSuccess; }
+void          AhciManagerUnregisterDevice(AhciController_t* c, AhciPort_t* p) { }
+void          AhciManagerHandleControlResponse(AhciPort_t* p, AhciTransaction_t* t) { }
+AhciDevice_t* AhciManagerGetDevice(UUId_t DeviceId) { return NULL; }
+
+/************************************************************************
+ * The HBA port model
+ ************************************************************************/
+static void*
+PhysicalToVirtual(
+    _In_ reg32_t Low,
+    _In_ reg32_t High)
+{
+    return (void*)(uintptr_t)(((uint64_t)High << 32) | Low);
+}
+
+static AHCICommandTable_t*
+GetCommandTable(
+    _In_ int Slot)
+{
+    AHCICommandList_t* List = PhysicalToVirtual(Hba.Registers->CmdListBaseAddress,
+        Hba.Registers->CmdListBaseAddressUpper);
+    return PhysicalToVirtual(List->Headers[Slot].CmdTableBaseAddress,
+        List->Headers[Slot].CmdTableBaseAddressUpper);
+}
+
+static uint64_t
+GetFisSector(
+    _In_ FISRegisterH2D_t* Fis)
+{
+    return (uint64_t)Fis->SectorNo | ((uint64_t)Fis->CylinderLow << 8) |
+        ((uint64_t)Fis->CylinderHigh << 16) | ((uint64_t)Fis->SectorNoExtended << 24) |
+        ((uint64_t)Fis->CylinderLowExtended << 32) | ((uint64_t)Fis->CylinderHighExtended << 40);
+}
+
+/* MoveData
+ * Moves data between the disk and the memory described by the PRDT of the slot. */
+static void
+MoveData(
+    _In_ int      Slot,
+    _In_ uint8_t* Media,
+    _In_ size_t   Length,
+    _In_ int      ToMemory)
+{
+    AHCICommandList_t*  List  = PhysicalToVirtual(Hba.Registers->CmdListBaseAddress,
+        Hba.Registers->CmdListBaseAddressUpper);
+    AHCICommandTable_t* Table = GetCommandTable(Slot);
+    size_t              Moved = 0;
+
+    for (int i = 0; i < List->Headers[Slot].TableLength; i++) {
+        AHCIPrdtEntry_t* Prdt   = &Table->PrdtEntry[i];
+        uint8_t*         Memory = PhysicalToVirtual(Prdt->DataBaseAddress, Prdt->DataBaseAddressUpper);
+        size_t           Bytes  = (Prdt->Descriptor & 0x3FFFFF) + 1;
+
+        if (Moved + Bytes > Length) {
+            VIOLATION("slot %i: PRDT describes more than the %zu bytes of the command", Slot, Length);
+            return;
+        }
+        if (ToMemory) {
+            memcpy(Memory, Media + Moved, Bytes);
+        }
+        else {
+            memcpy(Media + Moved, Memory, Bytes);
+        }
+        Moved += Bytes;
+    }
+    if (Moved != Length) {
+        VIOLATION("slot %i: PRDT describes %zu of the %zu bytes of the command", Slot, Moved, Length);
+    }
+}
+
+static void
+RaiseInterrupt(
+    _In_ reg32_t Status)
+{
+    Hba.InterruptStatus |= Status;
+    Hba.Registers->InterruptStatus = Hba.InterruptStatus;
+}
+
+static void
+CompleteNonQueued(
+    _In_ int     Slot,
+    _In_ uint8_t TaskFile,
+    _In_ int     Count)
+{
+    AHCIFis_t* Fis = PhysicalToVirtual(Hba.Registers->FISBaseAddress, Hba.Registers->FISBaseAdressUpper);
+
+    Hba.Registers->TaskFileData = TaskFile;
+    Fis->RegisterD2H.Type   = FISRegisterD2H;
+    Fis->RegisterD2H.Status = TaskFile;
+    Fis->RegisterD2H.Count  = (uint16_t)Count;
+    Hba.CommandIssue &= ~(1U << Slot);
+    Hba.Registers->CommandIssue = Hba.CommandIssue;
+    RaiseInterrupt((TaskFile & AHCI_PORT_TFD_ERR) ? AHCI_PORT_IE_TFEE : AHCI_PORT_IE_DHRE);
+}
+
+static void
+ExecuteCommand(
+    _In_ int Slot)
+{
+    FISRegisterH2D_t* Fis = (FISRegisterH2D_t*)&GetCommandTable(Slot)->FISCommand[0];
+
+    if (!(Hba.Registers->CommandAndStatus & AHCI_PORT_CR)) {
+        VIOLATION("slot %i issued while the command engine is stopped", Slot);
+    }
+    if (Fis->Type != FISRegisterH2D) {
+        VIOLATION("slot %i: command FIS type 0x%x", Slot, Fis->Type);
+    }
+
+    if (Fis->Command == AtaFPDMAReadQueued || Fis->Command == AtaFPDMAWriteQueued) {
+        int Tag = (Fis->Count >> 3) & 0x1F;
+        if (Tag != Slot) {
+            VIOLATION("slot %i carries tag %i", Slot, Tag);
+        }
+        if (!(Hba.Active & (1U << Slot))) {
+            VIOLATION("slot %i issued as queued without its PxSACT bit", Slot);
+        }
+        if (Hba.Pending & (1U << Slot)) {
+            VIOLATION("tag %i reused while active", Slot);
+        }
+
+        // The disk accepts the command and completes it later through a Set Device Bits FIS
+        Hba.Pending      |= (1U << Slot);
+        Hba.CommandIssue &= ~(1U << Slot);
+        Hba.Registers->CommandIssue = Hba.CommandIssue;
+        return;
+    }
+
+    if (Hba.Active) {
+        VIOLATION("non-queued command 0x%x issued with queued commands active (0x%x)", Fis->Command, Hba.Active);
+    }
+
+    if (Fis->Command == AtaPIOReadLogExt && (GetFisSector(Fis) & 0xFF) == ATA_LOG_NCQ_COMMAND_ERROR) {
+        uint8_t           Page[SECTOR_SIZE] = { 0 };
+        ATANcqErrorLog_t* Log = (ATANcqErrorLog_t*)&Page[0];
+
+        Hba.LogReads++;
+        if (Hba.FailLogRead) {
+            CompleteNonQueued(Slot, AHCI_PORT_TFD_RDY | AHCI_PORT_TFD_ERR, 0);
+            return;
+        }
+
+        // Reading the log clears the error condition on the disk
+        Log->Tag    = (Hba.FailedTag == -1) ? ATA_NCQ_LOG_NQ : (uint8_t)Hba.FailedTag;
+        Log->Status = ATA_STS_DEV_ERROR;
+        Log->Error  = ATA_ERR_DEV_IDNF;
+        MoveData(Slot, Page, SECTOR_SIZE, 1);
+        Hba.FailedTag = -1;
+        CompleteNonQueued(Slot, AHCI_PORT_TFD_RDY, 1);
+        return;
+    }
+    VIOLATION("slot %i: unexpected command 0x%x", Slot, Fis->Command);
+}
+
+/* CompleteQueued
+ * The disk finishes a queued command, if it touches the bad sector the disk aborts
+ * the entire queue and reports a task file error. */
+static void
+CompleteQueued(
+    _In_ int Tag)
+{
+    FISRegisterH2D_t* Fis    = (FISRegisterH2D_t*)&GetCommandTable(Tag)->FISCommand[0];
+    uint64_t          Sector = GetFisSector(Fis);
+    size_t            Count  = Fis->FeaturesLow | ((size_t)Fis->FeaturesHigh << 8);
+
+    if (Count == 0 || Sector + Count > DISK_SECTORS) {
+        VIOLATION("tag %i: %zu sectors at %" PRIu64 " are out of range", Tag, Count, Sector);
+        return;
+    }
+
+    if (Hba.BadSector >= Sector && Hba.BadSector < Sector + Count) {
+        Hba.Halted      = 1;
+        Hba.FailedTag   = Tag;
+        Hba.AbortedTags = Hba.Pending;
+        for (int i = 0; i < 32; i++) {
+            if (Hba.Pending & (1U << i)) {
+                Hba.AbortedSectors[i] = GetFisSector((FISRegisterH2D_t*)&GetCommandTable(i)->FISCommand[0]);
+            }
+        }
+        Hba.BadSector = NO_SECTOR;
+        Hba.Registers->TaskFileData = AHCI_PORT_TFD_RDY | AHCI_PORT_TFD_ERR;
+        RaiseInterrupt(AHCI_PORT_IE_TFEE);
+        return;
+    }
+
+    MoveData(Tag, &Hba.Disk[Sector * SECTOR_SIZE], Count * SECTOR_SIZE, Fis->Command == AtaFPDMAReadQueued);
+    Hba.Pending &= ~(1U << Tag);
+    Hba.Active  &= ~(1U << Tag);
+    Hba.Registers->AtaActive = Hba.Active;
+    RaiseInterrupt(AHCI_PORT_IE_SDBE);
+}
+
+/* HostMmioWrite
+ * Called after every register write of the driver. */
+void
+HostMmioWrite(
+    _In_ volatile void* Address)
+{
+    AHCIPortRegisters_t* Registers = Hba.Registers;
+
+    if (!Registers) {
+        return;
+    }
+
+    if (Address == &Registers->CommandAndStatus) {
+        reg32_t Command = Registers->CommandAndStatus & ~(AHCI_PORT_CR | AHCI_PORT_FR);
+        if (Command & AHCI_PORT_FRE) {
+            Command |= AHCI_PORT_FR;
+        }
+        if (Command & AHCI_PORT_ST) {
+            if (!(Registers->CommandAndStatus & AHCI_PORT_CR)) {
+                Registers->TaskFileData = AHCI_PORT_TFD_RDY;
+                Hba.Halted = 0;
+            }
+            Command |= AHCI_PORT_CR;
+        }
+        else {
+            // Clearing ST resets PxCI and PxSACT, the disk forgets its queue
+            Hba.CommandIssue = 0;
+            Hba.Active       = 0;
+            Hba.Pending      = 0;
+            Registers->CommandIssue = 0;
+            Registers->AtaActive    = 0;
+        }
+        Registers->CommandAndStatus = Command;
+    }
+    else if (Address == &Registers->AtaActive) {
+        Hba.Active |= Registers->AtaActive;
+        Registers->AtaActive = Hba.Active;
+    }
+    else if (Address == &Registers->CommandIssue) {
+        reg32_t Issued = Registers->CommandIssue & ~Hba.CommandIssue;
+        Hba.CommandIssue |= Issued;
+        Registers->CommandIssue = Hba.CommandIssue;
+        for (int i = 0; i < 32; i++) {
+            if (Issued & (1U << i)) {
+                ExecuteCommand(i);
+            }
+        }
+    }
+    else if (Address == &Registers->InterruptStatus) {
+        Hba.InterruptStatus &= ~Registers->InterruptStatus;
+        Registers->InterruptStatus = Hba.InterruptStatus;
+    }
+    else if (Address == &Registers->AtaError) {
+        Registers->AtaError = 0;
+    }
+}
+
+/* HbaStep
+ * Completes a random number of the accepted queued commands in random order. */
+static void
+HbaStep(void)
+{
+    int Count = __builtin_popcount(Hba.Pending);
+    if (Hba.Halted || !Count) {
+        return;
+    }
+
+    Count = 1 + (int)(TestRandom() % Count);
+    while (Count-- && !Hba.Halted) {
+        int Tag;
+        do {
+            Tag = (int)(TestRandom() % 32);
+        } while (!(Hba.Pending & (1U << Tag)));
+        CompleteQueued(Tag);
+    }
+}
+
+/* DeliverInterrupt
+ * What the fast interrupt handler of the driver does, then runs the port handler. */
+static void
+DeliverInterrupt(void)
+{
+    Controller.InterruptResource.PortInterruptStatus[Port->Index] |= Hba.InterruptStatus;
+    Hba.InterruptStatus = 0;
+    Hba.Registers->InterruptStatus = 0;
+    AhciPortInterruptHandler(&Controller, Port);
+
+    TEST_CHECK(Port->QueuedSlots == Hba.Active, "driver queued slots 0x%x, PxSACT 0x%x",
+        Port->QueuedSlots, Hba.Active);
+    TEST_CHECK((reg32_t)atomic_load(&Port->Slots) == Port->IssuedSlots, "allocated slots 0x%x, issued 0x%x",
+        atomic_load(&Port->Slots), Port->IssuedSlots);
+    TEST_CHECK(__builtin_popcount(Port->QueuedSlots) <= Port->QueueDepth, "%i queued slots, depth %i",
+        __builtin_popcount(Port->QueuedSlots), Port->QueueDepth);
+}
+
+static void
+SetupPort(
+    _In_ int QueueDepth)
+{
+    static uint8_t Mmio[AHCI_REGISTER_PORTBASE(1)] __attribute__((aligned(128)));
+
+    memset(Mmio, 0, sizeof(Mmio));
+    Controller.Registers = (AHCIGenericRegisters_t*)&Mmio[0];
+    Controller.Registers->Capabilities = ((32 - 1) << 8) | AHCI_CAPABILITIES_SNCQ | AHCI_CAPABILITIES_S64A;
+
+    Port = AhciPortCreate(&Controller, 0, 0);
+    Controller.Ports[0] = Port;
+    Hba.Registers = Port->Registers;
+    Hba.Registers->AtaStatus    = AHCI_PORT_SSTS_DET_ENABLED;
+    Hba.Registers->TaskFileData = AHCI_PORT_TFD_RDY;
+    Hba.BadSector = NO_SECTOR;
+    Hba.FailedTag = -1;
+
+    TEST_CHECK(AhciPortRebase(&Controller, Port) == OsSuccess, "rebase failed");
+    TEST_CHECK(AhciPortStart(&Controller, Port) == OsSuccess, "start failed");
+    TEST_CHECK(PhysicalToVirtual(Hba.Registers->FISBaseAddress, Hba.Registers->FISBaseAdressUpper) ==
+        Port->RecievedFisDMA.buffer, "PxFB does not point to the received FIS area");
+    TEST_CHECK(PhysicalToVirtual(Hba.Registers->CmdListBaseAddress, Hba.Registers->CmdListBaseAddressUpper) ==
+        Port->CommandListDMA.buffer, "PxCLB does not point to the command list");
+    for (int i = 0; i < 32; i++) {
+        TEST_CHECK((void*)GetCommandTable(i) == AhciPortGetCommandTable(Port, i),
+            "command header %i does not point to its own table", i);
+    }
+
+    Port->QueueDepth = QueueDepth;
+    Device.Controller     = &Controller;
+    Device.Port           = Port;
+    Device.Type           = DeviceATA;
+    Device.HasDMAEngine   = 1;
+    Device.SectorSize     = SECTOR_SIZE;
+    Device.SectorCount    = DISK_SECTORS;
+    Device.AddressingMode = AHCI_DEVICE_MODE_LBA48;
+}
+
+/* SubmitBatch
+ * Queues the requests, each on its own part of the disk and with its own buffer at an
+ * unaligned offset, so the buffers cross page boundaries. */
+static void
+SubmitBatch(
+    _In_ Request_t* Requests,
+    _In_ int        Count)
+{
+    for (int i = 0; i < Count; i++) {
+        Request_t*                 Request = &Requests[i];
+        struct gracht_recv_message Message = { .storage = Request };
+        size_t                     Length;
+
+        Request->Count       = 1 + (TestRandom() % 64);
+        Request->Sector      = (i * 128) + (TestRandom() % (128 - Request->Count));
+        Request->Write       = (int)(TestRandom() & 1);
+        Request->Offset      = (TestRandom() % 8) * SECTOR_SIZE;
+        Request->Completions = 0;
+
+        Length = Request->Offset + (Request->Count * SECTOR_SIZE);
+        Request->Buffer = RegisterBuffer(malloc(Length), Length, 0);
+        for (size_t j = 0; j < Length; j++) {
+            Handles[Request->Buffer].Data[j] = (uint8_t)TestRandom();
+        }
+
+        TEST_CHECK(AhciTransactionStorageCreate(&Device, &Message,
+            Request->Write ? __STORAGE_OPERATION_WRITE : __STORAGE_OPERATION_READ, Request->Sector,
+            Request->Buffer, Request->Offset, Request->Count) == OsSuccess, "request %i was not queued", i);
+    }
+}
+
+static int
+RunUntilComplete(
+    _In_ Request_t* Requests,
+    _In_ int        Count)
+{
+    for (int Rounds = 0; Rounds < 10000; Rounds++) {
+        int Done = 0;
+        for (int i = 0; i < Count; i++) {
+            Done += Requests[i].Completions ? 1 : 0;
+        }
+        if (Done == Count) {
+            return 1;
+        }
+        HbaStep();
+        DeliverInterrupt();
+    }
+    return 0;
+}
+
+static void
+CheckRequest(
+    _In_ Request_t* Request,
+    _In_ int        Index,
+    _In_ uint8_t*   Shadow)
+{
+    uint8_t* Memory = Handles[Request->Buffer].Data + Request->Offset;
+    uint8_t* Media  = &Hba.Disk[Request->Sector * SECTOR_SIZE];
+    size_t   Length = Request->Count * SECTOR_SIZE;
+
+    TEST_CHECK(Request->Completions == 1, "request %i completed %i times", Index, Request->Completions);
+    TEST_CHECK(Request->Status == OsSuccess && Request->Sectors == Request->Count,
+        "request %i: status %i, %zu of %zu sectors", Index, Request->Status, Request->Sectors, Request->Count);
+    if (Request->Write) {
+        TEST_CHECK(!memcmp(Media, Memory, Length), "request %i wrote the wrong data", Index);
+        memcpy(&Shadow[Request->Sector * SECTOR_SIZE], Memory, Length);
+    }
+    else {
+        TEST_CHECK(!memcmp(&Shadow[Request->Sector * SECTOR_SIZE], Memory, Length),
+            "request %i read the wrong data", Index);
+    }
+}
+
+static void
+ReleaseBatch(
+    _In_ Request_t* Requests,
+    _In_ int        Count)
+{
+    for (int i = 0; i < Count; i++) {
+        free(Handles[Requests[i].Buffer].Data);
+        Handles[Requests[i].Buffer].Data = NULL;
+    }
+}
+
+static void
+CheckIdle(
+    _In_ const char* Name)
+{
+    TEST_CHECK(atomic_load(&Port->Slots) == 0 && Port->IssuedSlots == 0 && Port->QueuedSlots == 0,
+        "%s: slots 0x%x, issued 0x%x, queued 0x%x left", Name, atomic_load(&Port->Slots),
+        Port->IssuedSlots, Port->QueuedSlots);
+    TEST_CHECK(CollectionLength(Port->Transactions) == 0, "%s: %i transactions left", Name,
+        CollectionLength(Port->Transactions));
+    TEST_CHECK(Hba.Active == 0 && Hba.Pending == 0 && Hba.CommandIssue == 0,
+        "%s: PxSACT 0x%x, PxCI 0x%x, %x pending on the disk", Name, Hba.Active, Hba.CommandIssue, Hba.Pending);
+}
+
+/* TestRandomCompletion
+ * Batches larger than the queue depth, so transactions wait for slots, completed by the
+ * disk in random order. */
+static void
+TestRandomCompletion(
+    _In_ uint8_t* Shadow,
+    _In_ long     Batches)
+{
+    Request_t Requests[48];
+
+    for (long b = 0; b < Batches; b++) {
+        int Count = 1 + (int)(TestRandom() % 48);
+
+        SubmitBatch(Requests, Count);
+        TEST_CHECK(RunUntilComplete(Requests, Count), "batch %li did not complete", b);
+        for (int i = 0; i < Count; i++) {
+            CheckRequest(&Requests[i], i, Shadow);
+        }
+        ReleaseBatch(Requests, Count);
+        CheckIdle("random completion");
+    }
+}
+
+/* TestRecovery
+ * One request of the batch hits a bad sector. With a readable error log only that
+ * request must fail, without one every command that was outstanding fails. */
+static void
+TestRecovery(
+    _In_ uint8_t* Shadow,
+    _In_ int      FailLogRead)
+{
+    Request_t Requests[40];
+    int       Bad = (int)(TestRandom() % 40);
+    int       LogReads = Hba.LogReads;
+
+    SubmitBatch(Requests, 40);
+    Hba.BadSector   = Requests[Bad].Sector + (Requests[Bad].Count / 2);
+    Hba.FailLogRead = FailLogRead;
+    Hba.AbortedTags = 0;
+    TEST_CHECK(RunUntilComplete(Requests, 40), "batch with a bad sector did not complete");
+    TEST_CHECK(Hba.LogReads == LogReads + 1, "NCQ error log read %i times", Hba.LogReads - LogReads);
+    TEST_CHECK(Hba.AbortedTags != 0, "the bad sector was never reached");
+
+    for (int i = 0; i < 40; i++) {
+        int Aborted = 0;
+        for (int t = 0; t < 32; t++) {
+            if ((Hba.AbortedTags & (1U << t)) && Hba.AbortedSectors[t] == Requests[i].Sector) {
+                Aborted = 1;
+            }
+        }
+
+        if (i == Bad || (FailLogRead && Aborted)) {
+            TEST_CHECK(Requests[i].Completions == 1 && Requests[i].Status == OsDeviceError,
+                "failed request %i: %i completions, status %i", i, Requests[i].Completions, Requests[i].Status);
+        }
+        else {
+            CheckRequest(&Requests[i], i, Shadow);
+        }
+    }
+
+    // Failed writes leave the disk in an unknown state, resynchronize the shadow
+    memcpy(Shadow, Hba.Disk, sizeof(Hba.Disk));
+    ReleaseBatch(Requests, 40);
+    Hba.FailLogRead = 0;
+    CheckIdle(FailLogRead ? "recovery without log" : "recovery");
+}
+
+int main(int argc, char** argv)
+{
+    uint8_t* Shadow  = calloc(DISK_SECTORS, SECTOR_SIZE);
+    long     Batches = TestScale(argc, argv, 200);
+    int      Depths[] = { 32, 7 };
+
+    for (size_t d = 0; d < sizeof(Depths) / sizeof(Depths[0]); d++) {
+        memset(&Hba, 0, sizeof(Hba));
+        memset(&Controller, 0, sizeof(Controller));
+        memset(Shadow, 0, DISK_SECTORS * SECTOR_SIZE);
+        SetupPort(Depths[d]);
+
+        TestRandomCompletion(Shadow, Batches);
+        for (int i = 0; i < 10; i++) {
+            TestRecovery(Shadow, i & 1);
+            TestRandomCompletion(Shadow, 5);
+        }
+        TEST_CHECK(Hba.Violations == 0, "depth %i: %i protocol violations", Depths[d], Hba.Violations);
+        printf("depth %2i: %li batches, %i error log reads\n", Depths[d], Batches + 50, Hba.LogReads);
+    }
+    free(Shadow);
+    TEST_RESULT("ahci");
+}
@@ -0,0 +1,497 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Interrupt Balancer Tests
+ * - The kernel interrupt balancer runs unmodified against a deterministic model of a
+ *   machine with four cores and ten interrupt lines of very different rates and costs.
+ *   Every sleep of the balancer thread is one period of interrupts, which are delivered
+ *   to the core each line is routed to, or to the boot core while the interrupt
+ *   controller routes it. The load of every core is measured for each policy, and the
+ *   routing must follow the policy, stay put once the load is spread, and be the same
+ *   every time the model is run.
+ */
+
+#include <arch.h>
+#include <arch/interrupts.h>
+#include <handle.h>
+#include <machine.h>
+#include <setjmp.h>
+#include <string.h>
+#include "test.h"
+
+#define SIM_CORES       4
+#define SIM_LINES       10
+#define SIM_PERIODS     120
+#define SIM_FIRST_INDEX 32                  // The table index of the first line
+#define SIM_COUNTS      2000000000ULL       // Timestamp counts per second on every core
+#define SIM_BURST_START 40                  // One line bursts at four times its rate
+#define SIM_BURST_END   80
+#define SIM_DRIVER_MOVE 60                  // One driver thread moves to another core
+#define SIM_SWITCH      100                 // The policy may be changed while running
+
+struct SystemInterrupt {
+    int    Line;
+    UUId_t CoreId;                          // UUID_INVALID while routed by the controller
+};
+
+struct SchedulerObject {
+    UUId_t CoreId;
+};
+
+typedef struct SimLine {
+    unsigned int           Rate;            // Interrupts per second
+    uint64_t               Cost;            // Timestamp counts per interrupt
+    int                    Routable;        // MSI can't be routed by the balancer
+    int                    Masked;          // Every other routing attempt finds the line masked
+    SystemInterrupt_t      Descriptor;
+    MCoreThread_t          Driver;
+    struct SchedulerObject DriverObject;
+
+    long                   Delivered;
+    long                   OffDriverCore;
+    long                   RoutingCalls;
+    unsigned int           Migrations;
+    unsigned int           LastCount;       // Interrupts in the last period
+} SimLine_t;
+
+typedef struct Result {
+    double        PeakLoad;                 // The highest load of any core in any period
+    double        MaxOverBound;             // The highest load against the best possible load
+    double        SettledMaxOverBound;      // Only the periods after the balancer settled
+    uint64_t      OffBootCore;              // The load handled by other cores than the boot core
+    long          SettledMigrations;
+    long          OffDriverCore;
+    long          Delivered;
+    unsigned long long Routing;             // Hash of the routing of every period
+} Result_t;
+
+static SimLine_t Lines[SIM_LINES] = {
+    { 40000,  1500, 1, 0 },
+    { 20000,  3000, 1, 0 },                 // Bursts
+    {  8000,  4000, 1, 0 },
+    {  5000,  2000, 1, 1 },                 // Masked on every other routing attempt
+    {  2000, 12000, 1, 0 },
+    {  1000,  5000, 1, 0 },
+    {   500, 20000, 0, 0 },                 // MSI
+    {   100,  8000, 1, 0 },
+    {    50,  4000, 1, 0 },
+    {    10, 50000, 1, 0 }
+};
+
+static SystemMachine_t Machine;
+static SystemCpuCore_t Cores[SIM_CORES];
+static ThreadEntry_t   BalancerThread;
+static jmp_buf         BalancerExit;
+static int             Period;
+static int             SwitchPolicy;
+static Result_t        Current;
+static uint64_t        CoreLoads[SIM_CORES];
+static long            Migrations;
+
+SystemMachine_t*
+GetMachine(void)
+{
+    return &Machine;
+}
+
+SystemCpuCore_t*
+GetProcessorCore(
+    _In_ UUId_t CoreId)
+{
+    return &Cores[CoreId];
+}
+
+SystemCpuCore_t*
+GetCurrentProcessorCore(void)
+{
+    return &Cores[0];
+}
+
+void
+IrqSpinlockAcquire(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_acquire(&Spinlock->SyncObject);
+}
+
+void
+IrqSpinlockRelease(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_release(&Spinlock->SyncObject);
+}
+
+void*
+LookupHandleOfType(
+    _In_ UUId_t       Handle,
+    _In_ HandleType_t Type)
+{
+    if (Type != HandleTypeThread || Handle == UUID_INVALID || Handle > SIM_LINES) {
+        return NULL;
+    }
+    return &Lines[Handle - 1].Driver;
+}
+
+UUId_t
+SchedulerObjectGetAffinity(
+    _In_ SchedulerObject_t* Object)
+{
+    return Object->CoreId;
+}
+
+OsStatus_t
+CreateThread(
+    _In_  const char*    Name,
+    _In_  ThreadEntry_t  Function,
+    _In_  void*          Arguments,
+    _In_  Flags_t        Flags,
+    _In_  UUId_t         MemorySpaceHandle,
+    _Out_ UUId_t*        Handle)
+{
+    // The test runs the thread itself
+    BalancerThread = Function;
+    *Handle        = 1;
+    return OsSuccess;
+}
+
+OsStatus_t
+InterruptGetBalanceInfo(
+    _In_  UUId_t  TableIndex,
+    _Out_ int*    Source,
+    _Out_ UUId_t* Thread)
+{
+    SimLine_t* Line;
+
+    if (TableIndex >= MAX_SUPPORTED_INTERRUPTS) {
+        return OsInvalidParameters;
+    }
+    if (TableIndex < SIM_FIRST_INDEX || TableIndex >= SIM_FIRST_INDEX + SIM_LINES) {
+        return OsDoesNotExist;
+    }
+
+    Line    = &Lines[TableIndex - SIM_FIRST_INDEX];
+    *Source = Line->Descriptor.Line;
+    *Thread = (UUId_t)(TableIndex - SIM_FIRST_INDEX + 1);
+    return Line->Routable ? OsSuccess : OsNotSupported;
+}
+
+OsStatus_t
+InterruptSetAffinity(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId)
+{
+    SimLine_t* Line = &Lines[Descriptor->Line];
+
+    TEST_CHECK(Line->Routable, "line %i was routed", Descriptor->Line);
+    Line->RoutingCalls++;
+    if (Line->Masked && (Line->RoutingCalls & 1)) {
+        return OsError;
+    }
+    Descriptor->CoreId = CoreId;
+    Line->Migrations++;
+    Migrations++;
+    return OsSuccess;
+}
+
+// The rate of a line in a period, with up to 20% of noise
+static unsigned int
+LineRate(
+    _In_ int Index)
+{
+    unsigned int Rate = Lines[Index].Rate;
+
+    if (Index == 1 && Period >= SIM_BURST_START && Period < SIM_BURST_END) {
+        Rate *= 4;
+    }
+    return (unsigned int)(((uint64_t)Rate * (80 + (TestRandom() % 41))) / 100);
+}
+
+// The balancer needs a few periods to measure the lines after every change of the load
+static int
+IsSettled(void)
+{
+    return (Period >= 4 && Period < SIM_BURST_START) ||
+        (Period >= SIM_BURST_START + 4 && Period < SIM_BURST_END) ||
+        Period >= SIM_BURST_END + 4;
+}
+
+/* SimulatePeriod
+ * Delivers one period of interrupts. The lines fire interleaved, every line handles its
+ * interrupts on the core it is routed to at the time it fires. */
+static void
+SimulatePeriod(void)
+{
+    unsigned int Remaining[SIM_LINES];
+    uint64_t     LineLoads[SIM_LINES] = { 0 };
+    unsigned int Total    = 0;
+    uint64_t     MaxLoad  = 0;
+    uint64_t     AllLoads = 0;
+    uint64_t     Bound    = 0;
+    double       MaxOverBound;
+
+    memset(&CoreLoads[0], 0, sizeof(CoreLoads));
+    Migrations = 0;
+
+    if (Period == SIM_DRIVER_MOVE) {
+        Lines[0].DriverObject.CoreId = 3;
+    }
+    if (Period == SIM_SWITCH && SwitchPolicy != -1) {
+        (void)InterruptBalancerSetPolicy(SwitchPolicy);
+    }
+
+    for (int i = 0; i < SIM_LINES; i++) {
+        Remaining[i]       = LineRate(i);
+        Lines[i].LastCount = Remaining[i];
+        Total             += Remaining[i];
+    }
+
+    while (Total) {
+        for (int i = 0; i < SIM_LINES; i++) {
+            SimLine_t* Line = &Lines[i];
+            UUId_t     Core;
+
+            // Lines fire in proportion to their remaining interrupts in the period
+            if (!Remaining[i] || (TestRandom() % Total) >= Remaining[i] * SIM_LINES) {
+                continue;
+            }
+            Remaining[i]--;
+            Total--;
+
+            Core = (Line->Descriptor.CoreId == UUID_INVALID) ? 0 : Line->Descriptor.CoreId;
+            CoreLoads[Core] += Line->Cost;
+            LineLoads[i]    += Line->Cost;
+            Line->Delivered++;
+            Current.Delivered++;
+            if (Line->Routable && Core != Line->DriverObject.CoreId) {
+                Line->OffDriverCore++;
+                Current.OffDriverCore++;
+            }
+            InterruptBalancerUpdate(&Line->Descriptor, SIM_FIRST_INDEX + i, Line->Cost);
+        }
+    }
+
+    // No routing does better than the average load, or than the heaviest line on its own core
+    for (int i = 0; i < SIM_CORES; i++) {
+        MaxLoad   = MAX(MaxLoad, CoreLoads[i]);
+        AllLoads += CoreLoads[i];
+    }
+    for (int i = 0; i < SIM_LINES; i++) {
+        Bound = MAX(Bound, LineLoads[i]);
+    }
+    Bound        = MAX(Bound, AllLoads / SIM_CORES);
+    MaxOverBound = (double)MaxLoad / (double)Bound;
+
+    Current.OffBootCore += AllLoads - CoreLoads[0];
+    Current.PeakLoad     = MAX(Current.PeakLoad, (double)MaxLoad / (double)SIM_COUNTS);
+    Current.MaxOverBound = MAX(Current.MaxOverBound, MaxOverBound);
+    if (IsSettled()) {
+        Current.SettledMaxOverBound = MAX(Current.SettledMaxOverBound, MaxOverBound);
+        Current.SettledMigrations    += Migrations;
+    }
+
+    for (int i = 0; i < SIM_LINES; i++) {
+        Current.Routing = (Current.Routing * 31) + Lines[i].Descriptor.CoreId + 1;
+    }
+}
+
+/* SchedulerSleep
+ * The balancer thread sleeps between its periods, the interrupts of a period are delivered
+ * while it sleeps. */
+int
+SchedulerSleep(
+    _In_  uint64_t Nanoseconds,
+    _Out_ clock_t* InterruptedAt)
+{
+    TEST_CHECK(Nanoseconds == NSEC_PER_MSEC * MSEC_PER_SEC, "balancer slept %llu ns",
+        (unsigned long long)Nanoseconds);
+    if (Period == SIM_PERIODS) {
+        longjmp(BalancerExit, 1);
+    }
+    SimulatePeriod();
+    Period++;
+    return SCHEDULER_SLEEP_OK;
+}
+
+static void
+ResetMachine(
+    _In_ int CoreCount)
+{
+    memset(&Cores[0], 0, sizeof(Cores));
+    for (int i = 0; i < SIM_CORES; i++) {
+        Cores[i].Id    = (UUId_t)i;
+        Cores[i].State = (i < CoreCount) ? CpuStateRunning : CpuStateUnavailable;
+        Cores[i].Link  = (i + 1 < SIM_CORES) ? &Cores[i + 1] : NULL;
+    }
+    Machine.Processor.NumberOfCores = CoreCount;
+    Machine.Processor.Cores         = &Cores[0];
+
+    for (int i = 0; i < SIM_LINES; i++) {
+        SimLine_t* Line = &Lines[i];
+        Line->Descriptor.Line         = i;
+        Line->Descriptor.CoreId       = UUID_INVALID;
+        Line->Driver.SchedulerObject  = &Line->DriverObject;
+        Line->DriverObject.CoreId     = (UUId_t)(i % CoreCount);
+        Line->Delivered     = 0;
+        Line->OffDriverCore = 0;
+        Line->RoutingCalls  = 0;
+        Line->Migrations    = 0;
+    }
+}
+
+static Result_t
+RunPolicy(
+    _In_ int Policy,
+    _In_ int CoreCount,
+    _In_ int Switch)
+{
+    TestRandomState = 88172645463325252ULL;
+    memset(&Current, 0, sizeof(Result_t));
+    ResetMachine(CoreCount);
+    Period       = 0;
+    SwitchPolicy = Switch;
+
+    InterruptBalancerInitialize();
+    TEST_CHECK(InterruptBalancerSetPolicy(Policy) == OsSuccess, "policy %i was refused", Policy);
+    TEST_CHECK(BalancerThread != NULL, "no balancer thread was created");
+    if (!setjmp(BalancerExit)) {
+        BalancerThread(NULL);
+    }
+    return Current;
+}
+
+// The statistics must match what the model delivered and routed
+static void
+CheckStatistics(
+    _In_ const char* Name,
+    _In_ int         Policy)
+{
+    InterruptBalanceStatistics_t Statistics[MAX_SUPPORTED_INTERRUPTS];
+    int                          Count = MAX_SUPPORTED_INTERRUPTS;
+    int                          QueriedPolicy;
+
+    TEST_CHECK(InterruptBalancerQuery(&QueriedPolicy, &Statistics[0], &Count) == OsSuccess,
+        "%s: query failed", Name);
+    TEST_CHECK(QueriedPolicy == Policy, "%s: queried policy %i", Name, QueriedPolicy);
+    TEST_CHECK(Count == SIM_LINES, "%s: %i lines queried", Name, Count);
+    for (int i = 0; i < Count && i < SIM_LINES; i++) {
+        SimLine_t* Line = &Lines[i];
+        TEST_CHECK(Statistics[i].TableIndex == SIM_FIRST_INDEX + i, "%s: line %i is index %u",
+            Name, i, Statistics[i].TableIndex);
+        TEST_CHECK(Statistics[i].Count == Line->Delivered, "%s: line %i counted %u of %li",
+            Name, i, Statistics[i].Count, Line->Delivered);
+        TEST_CHECK(Statistics[i].Rate == Line->LastCount, "%s: line %i rate %u, fired %u times",
+            Name, i, Statistics[i].Rate, Line->LastCount);
+        TEST_CHECK(Statistics[i].CoreId == Line->Descriptor.CoreId, "%s: line %i on core %u, routed to %u",
+            Name, i, Statistics[i].CoreId, Line->Descriptor.CoreId);
+        TEST_CHECK(Statistics[i].Migrations == Line->Migrations, "%s: line %i moved %u times, counted %u",
+            Name, i, Line->Migrations, Statistics[i].Migrations);
+        TEST_CHECK(Statistics[i].Cost == Line->Cost, "%s: line %i cost %llu", Name, i,
+            (unsigned long long)Statistics[i].Cost);
+    }
+
+    Count = 3;
+    (void)InterruptBalancerQuery(&QueriedPolicy, &Statistics[0], &Count);
+    TEST_CHECK(Count == 3, "%s: %i lines queried into 3 entries", Name, Count);
+}
+
+static void
+PrintResult(
+    _In_ const char*     Name,
+    _In_ const Result_t* Result)
+{
+    printf("%-9s peak core irq load %5.1f%%, max/best %4.2f (settled %4.2f), %3li settled migrations, "
+        "%4.1f%% off the driver core\n", Name, Result->PeakLoad * 100.0, Result->MaxOverBound,
+        Result->SettledMaxOverBound, Result->SettledMigrations,
+        (100.0 * (double)Result->OffDriverCore) / (double)Result->Delivered);
+}
+
+int main(int argc, char** argv)
+{
+    Result_t None;
+    Result_t Spread;
+    Result_t Colocate;
+    Result_t Again;
+    Result_t Switched;
+    Result_t Single;
+
+    // The controller delivers everything to the boot core, and nothing is ever routed
+    None = RunPolicy(INTERRUPT_BALANCE_NONE, SIM_CORES, -1);
+    PrintResult("none", &None);
+    CheckStatistics("none", INTERRUPT_BALANCE_NONE);
+    TEST_CHECK(None.OffBootCore == 0, "none: %llu counts handled off the boot core",
+        (unsigned long long)None.OffBootCore);
+    for (int i = 0; i < SIM_LINES; i++) {
+        TEST_CHECK(Lines[i].RoutingCalls == 0, "none: line %i was routed", i);
+    }
+
+    // Spreading must come close to the best routing once the lines are measured, and then the
+    // lines must stay where they are, also the line that was masked
+    Spread = RunPolicy(INTERRUPT_BALANCE_SPREAD, SIM_CORES, -1);
+    PrintResult("spread", &Spread);
+    CheckStatistics("spread", INTERRUPT_BALANCE_SPREAD);
+    TEST_CHECK(Spread.PeakLoad < None.PeakLoad, "spread: peak load %f against %f",
+        Spread.PeakLoad, None.PeakLoad);
+    TEST_CHECK(Spread.SettledMaxOverBound <= 1.5, "spread: settled max/best %f",
+        Spread.SettledMaxOverBound);
+    TEST_CHECK(Spread.SettledMigrations == 0, "spread: %li migrations while settled",
+        Spread.SettledMigrations);
+    TEST_CHECK(Lines[3].Descriptor.CoreId != UUID_INVALID, "spread: the masked line was never routed");
+    TEST_CHECK(Lines[6].Descriptor.CoreId == UUID_INVALID, "spread: the MSI line was routed");
+
+    // The model is deterministic, so is the balancer
+    Again = RunPolicy(INTERRUPT_BALANCE_SPREAD, SIM_CORES, -1);
+    TEST_CHECK(Again.Routing == Spread.Routing && Again.Delivered == Spread.Delivered,
+        "spread: the second run routed differently");
+
+    // Every line follows its driver, also when the driver moves. Only the first period and
+    // the period the driver moved in are handled elsewhere
+    Colocate = RunPolicy(INTERRUPT_BALANCE_COLOCATE, SIM_CORES, -1);
+    PrintResult("colocate", &Colocate);
+    CheckStatistics("colocate", INTERRUPT_BALANCE_COLOCATE);
+    for (int i = 0; i < SIM_LINES; i++) {
+        if (Lines[i].Routable) {
+            TEST_CHECK(Lines[i].Descriptor.CoreId == Lines[i].DriverObject.CoreId,
+                "colocate: line %i on core %u, driver on %u", i, Lines[i].Descriptor.CoreId,
+                Lines[i].DriverObject.CoreId);
+            TEST_CHECK(Lines[i].OffDriverCore <= (long)Lines[i].Rate * 3,
+                "colocate: line %i had %li interrupts off the driver core", i, Lines[i].OffDriverCore);
+        }
+    }
+
+    // Turning the balancer off gives every line back to the controller
+    Switched = RunPolicy(INTERRUPT_BALANCE_SPREAD, SIM_CORES, INTERRUPT_BALANCE_NONE);
+    PrintResult("switched", &Switched);
+    CheckStatistics("switched", INTERRUPT_BALANCE_NONE);
+    for (int i = 0; i < SIM_LINES; i++) {
+        TEST_CHECK(Lines[i].Descriptor.CoreId == UUID_INVALID, "switched: line %i still on core %u",
+            i, Lines[i].Descriptor.CoreId);
+    }
+
+    // A single core leaves the routing to the controller
+    Single = RunPolicy(INTERRUPT_BALANCE_SPREAD, 1, -1);
+    PrintResult("one core", &Single);
+    for (int i = 0; i < SIM_LINES; i++) {
+        TEST_CHECK(Lines[i].RoutingCalls == 0, "one core: line %i was routed", i);
+    }
+
+    TEST_CHECK(InterruptBalancerSetPolicy(INTERRUPT_BALANCE_COLOCATE + 1) == OsInvalidParameters,
+        "an unknown policy was accepted");
+    TEST_CHECK(InterruptBalancerSetPolicy(-1) == OsInvalidParameters, "a negative policy was accepted");
+    TEST_RESULT("balancer");
+}
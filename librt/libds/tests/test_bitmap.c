@@ -0,0 +1,309 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Bitmap Tests
+ * - Random set/clear/find sequences are checked against a byte-per-bit reference, on a
+ *   bitmap small enough to be scanned flat and on one with search summaries. The atomic
+ *   functions are checked for bits claimed twice, and the benchmark times run searches
+ *   at several fill ratios against a plain word-by-word scan.
+ */
+
+#include <ds/bitmap.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "test.h"
+
+#define THREAD_COUNT 4
+#define ATOMIC_BITS  (BITMAP_FLAT_WORDS * __BITS * 4)
+#define ATOMIC_HOLD  64
+#define ATOMIC_FREE  ((THREAD_COUNT * ATOMIC_HOLD) + 8)
+
+/* ReferenceFind
+ * First fit over the reference, one byte per bit. */
+static int
+ReferenceFind(
+    _In_ const uint8_t* Reference,
+    _In_ int            BitCount,
+    _In_ int            Count)
+{
+    int Run = 0;
+    for (int i = 0; i < BitCount; i++) {
+        Run = Reference[i] ? 0 : Run + 1;
+        if (Run == Count) {
+            return i - Count + 1;
+        }
+    }
+    return -1;
+}
+
+/* TestAgainstReference
+ * Mostly short ranges so the map fragments, with the odd long range that crosses words. */
+static void
+TestAgainstReference(
+    _In_ const char* Name,
+    _In_ int         BitCount,
+    _In_ long        Iterations)
+{
+    Bitmap_t Bitmap;
+    size_t*  Data      = calloc((size_t)BitCount / 8, 1);
+    uint8_t* Reference = calloc((size_t)BitCount, 1);
+
+    BitmapConstruct(&Bitmap, Data, (size_t)BitCount / 8);
+    TEST_CHECK(Bitmap.BitCount == (size_t)BitCount, "%s: bit count %zu", Name, Bitmap.BitCount);
+
+    for (long i = 0; i < Iterations; i++) {
+        int Operation = (int)(TestRandom() % 4);
+        int Count     = (TestRandom() % 16) ? 1 + (int)(TestRandom() % 24) : 1 + (int)(TestRandom() % 300);
+        int Index     = (int)(TestRandom() % (unsigned long long)(BitCount - Count));
+        int Expected  = 0;
+
+        if (Operation == 0) {
+            for (int j = Index; j < Index + Count; j++) {
+                Expected += !Reference[j];
+                Reference[j] = 1;
+            }
+            TEST_CHECK(BitmapSetBits(&Bitmap, NULL, Index, Count) == Expected,
+                "%s: set %i+%i changed the wrong number of bits", Name, Index, Count);
+        }
+        else if (Operation == 1) {
+            for (int j = Index; j < Index + Count; j++) {
+                Expected += Reference[j];
+                Reference[j] = 0;
+            }
+            TEST_CHECK(BitmapClearBits(&Bitmap, NULL, Index, Count) == Expected,
+                "%s: clear %i+%i changed the wrong number of bits", Name, Index, Count);
+        }
+        else if (Operation == 2) {
+            int AllSet = 1, AllClear = 1;
+            for (int j = Index; j < Index + Count; j++) {
+                AllSet   &= Reference[j];
+                AllClear &= !Reference[j];
+            }
+            TEST_CHECK(BitmapAreBitsSet(&Bitmap, Index, Count) == AllSet, "%s: are set %i+%i", Name, Index, Count);
+            TEST_CHECK(BitmapAreBitsClear(&Bitmap, Index, Count) == AllClear, "%s: are clear %i+%i", Name, Index, Count);
+        }
+        else {
+            int Found = BitmapFindBits(&Bitmap, NULL, Count);
+            Expected  = ReferenceFind(Reference, BitCount, Count);
+            TEST_CHECK(Found == Expected, "%s: find %i returned %i, expected %i", Name, Count, Found, Expected);
+        }
+    }
+
+    // The search index must never skip a free run after a clear below it
+    {
+        int SearchIndex = 0;
+        int Found;
+
+        BitmapClearBits(&Bitmap, &SearchIndex, 0, BitCount);
+        BitmapSetBits(&Bitmap, &SearchIndex, 0, BitCount / 2);
+        TEST_CHECK(SearchIndex == BitCount / 2, "%s: search index %i after set", Name, SearchIndex);
+        BitmapClearBits(&Bitmap, &SearchIndex, 10, 3);
+        Found = BitmapFindBits(&Bitmap, &SearchIndex, 3);
+        TEST_CHECK(Found == 10, "%s: search index find returned %i", Name, Found);
+        TEST_CHECK(SearchIndex == 13, "%s: search index %i after find", Name, SearchIndex);
+    }
+
+    BitmapDestroy(&Bitmap);
+    free(Reference);
+    free(Data);
+}
+
+static Bitmap_t     AtomicBitmap;
+static size_t       AtomicData[ATOMIC_BITS / (8 * sizeof(size_t))];
+static _Atomic(int) AtomicOwners[ATOMIC_BITS];
+static _Atomic(int) AtomicConflicts;
+static long         AtomicIterations;
+
+// Every thread holds up to ATOMIC_HOLD bits, and the owner table catches a bit handed out twice
+static void*
+AtomicWorker(
+    _In_ void* Argument)
+{
+    int      Owner = (int)(intptr_t)Argument + 1;
+    int      Held[ATOMIC_HOLD];
+    int      Count = 0;
+    unsigned Seed  = (unsigned)Owner;
+
+    for (long i = 0; i < AtomicIterations; i++) {
+        // TestRandom is not thread-safe, so every worker has its own generator
+        Seed = (Seed * 1103515245u) + 12345u;
+        if (Count < ATOMIC_HOLD && (Count == 0 || ((Seed >> 16) & 1))) {
+            int Expected = 0;
+            int Index    = BitmapAllocateBitAtomic(&AtomicBitmap, (Owner - 1) * (ATOMIC_BITS / THREAD_COUNT));
+            if (Index < 0) {
+                continue;
+            }
+            if (!atomic_compare_exchange_strong(&AtomicOwners[Index], &Expected, Owner)) {
+                atomic_fetch_add(&AtomicConflicts, 1);
+            }
+            Held[Count++] = Index;
+        }
+        else {
+            int Index = Held[--Count];
+            atomic_store(&AtomicOwners[Index], 0);
+            BitmapFreeBitAtomic(&AtomicBitmap, Index);
+        }
+    }
+
+    while (Count) {
+        int Index = Held[--Count];
+        atomic_store(&AtomicOwners[Index], 0);
+        BitmapFreeBitAtomic(&AtomicBitmap, Index);
+    }
+    return NULL;
+}
+
+/* TestAtomic
+ * The map is sized so that all threads together nearly fill it, which keeps the summary
+ * hints changing between empty and non-empty words. */
+static void
+TestAtomic(
+    _In_ long Iterations)
+{
+    pthread_t Threads[THREAD_COUNT];
+    int       Index;
+    int       Claimed = 0;
+
+    BitmapConstruct(&AtomicBitmap, &AtomicData[0], sizeof(AtomicData));
+    BitmapSetBits(&AtomicBitmap, NULL, 0, ATOMIC_BITS - ATOMIC_FREE);
+    BitmapClearBits(&AtomicBitmap, NULL, ATOMIC_BITS / 2, 4);
+    AtomicIterations = Iterations;
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&Threads[i], NULL, AtomicWorker, (void*)(intptr_t)i);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    TEST_CHECK(atomic_load(&AtomicConflicts) == 0, "atomic: %i bits claimed twice", atomic_load(&AtomicConflicts));
+
+    // Everything was given back, so the free bits must all be claimable again, exactly once
+    while ((Index = BitmapAllocateBitAtomic(&AtomicBitmap, 0)) >= 0) {
+        TEST_CHECK(atomic_load(&AtomicOwners[Index]) == 0, "atomic: bit %i still owned", Index);
+        atomic_store(&AtomicOwners[Index], -1);
+        Claimed++;
+    }
+    TEST_CHECK(Claimed == ATOMIC_FREE + 4,
+        "atomic: %i bits were free at the end", Claimed);
+    BitmapDestroy(&AtomicBitmap);
+}
+
+/* LinearFind
+ * Word-by-word first fit without summaries or run cache, which is what the search cost
+ * before the summaries were added. */
+static int
+LinearFind(
+    _In_ Bitmap_t* Bitmap,
+    _In_ int       Count)
+{
+    size_t Words = Bitmap->SizeInBytes / sizeof(size_t);
+    int    Run   = 0;
+
+    for (size_t i = 0; i < Words; i++) {
+        size_t Value = Bitmap->Data[i];
+        if (Value == __MASK) {
+            Run = 0;
+            continue;
+        }
+        for (int j = 0; j < __BITS; j++) {
+            Run = (Value & ((size_t)1 << j)) ? 0 : Run + 1;
+            if (Run == Count) {
+                return (int)(i * __BITS) + j - Count + 1;
+            }
+        }
+    }
+    return -1;
+}
+
+/* BenchmarkFind
+ * Packed fill allocates the front of the map and leaves a few scattered holes that are too
+ * small for multi-bit runs, which is the long scan a page frame allocator sees. Random fill
+ * sets bits independently at the ratio. */
+static void
+BenchmarkFind(
+    _In_ int Shift,
+    _In_ int Percent,
+    _In_ int Packed)
+{
+    size_t   BitCount = (size_t)1 << Shift;
+    size_t*  Data     = malloc(BitCount / 8);
+    Bitmap_t Bitmap;
+    int      Counts[] = { 1, 16, 200 };
+
+    BitmapConstruct(&Bitmap, Data, BitCount / 8);
+    if (Packed) {
+        int Filled = (int)((BitCount / 100) * (size_t)Percent);
+        BitmapSetBits(&Bitmap, NULL, 0, Filled);
+        for (int i = 0; i < 64; i++) {
+            BitmapClearBits(&Bitmap, NULL, (int)(TestRandom() % (unsigned long long)Filled), 1);
+        }
+    }
+    else {
+        for (size_t i = 0; i < BitCount; i++) {
+            if ((int)(TestRandom() % 100) < Percent) {
+                BitmapSetBits(&Bitmap, NULL, (int)i, 1);
+            }
+        }
+    }
+
+    printf("2^%i bits, %2i%% %s:", Shift, Percent, Packed ? "packed" : "random");
+    for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); c++) {
+        int    Repeats = 20;
+        int    Found = 0, Expected = 0;
+        double Start, Summarized, Linear;
+
+        Start = TestNow();
+        for (int i = 0; i < Repeats; i++) {
+            Found = BitmapFindBits(&Bitmap, NULL, Counts[c]);
+        }
+        Summarized = (TestNow() - Start) / Repeats;
+
+        Start = TestNow();
+        for (int i = 0; i < Repeats; i++) {
+            Expected = LinearFind(&Bitmap, Counts[c]);
+        }
+        Linear = (TestNow() - Start) / Repeats;
+
+        TEST_CHECK(Found == Expected, "bench: find %i returned %i, expected %i", Counts[c], Found, Expected);
+        printf("  run %3i %8.2f us (linear %9.2f us)", Counts[c], Summarized * 1e6, Linear * 1e6);
+    }
+    printf("\n");
+
+    BitmapDestroy(&Bitmap);
+    free(Data);
+}
+
+int main(int argc, char** argv)
+{
+    long Iterations = TestScale(argc, argv, 200000);
+
+    TestAgainstReference("flat", BITMAP_FLAT_WORDS * __BITS, Iterations);
+    TestAgainstReference("summarized", 1 << 16, Iterations);
+    TestAtomic(Iterations);
+
+    for (int Shift = 20; Shift <= 28; Shift += 4) {
+        BenchmarkFind(Shift, 50, 1);
+        BenchmarkFind(Shift, 99, 1);
+    }
+    BenchmarkFind(20, 50, 0);
+    BenchmarkFind(20, 90, 0);
+    BenchmarkFind(24, 99, 0);
+    TEST_RESULT("bitmap");
+}
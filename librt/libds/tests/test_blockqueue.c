@@ -0,0 +1,410 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Block Queue Tests
+ * - The ddk block queue is built against a simulated block device that copies sectors
+ *   between a memory disk and registered buffers. The device can delay transfers to let
+ *   requests pile up in the queue, and can fail at a given sector. The tests check that
+ *   data survives the queue, that adjacent requests are merged up to the sector limit,
+ *   that a failing transfer only fails the merged requests it did not complete, and that
+ *   the number of transfers outstanding towards the device never exceeds the depth.
+ */
+
+#include <ddk/blockqueue.h>
+#include <internal/_ipc.h>
+#include <threads.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define SECTOR_SIZE    512
+#define DEVICE_SECTORS 4096
+#define MAX_BUFFERS    16
+#define NO_BAD_SECTOR  UINT64_MAX
+
+typedef struct HostBuffer {
+    uint8_t* Data;
+    size_t   Size;
+} HostBuffer_t;
+
+static uint8_t          Disk[DEVICE_SECTORS * SECTOR_SIZE];
+static HostBuffer_t     Buffers[MAX_BUFFERS];
+static _Atomic(uint64_t) BadSector = NO_BAD_SECTOR;
+static _Atomic(int)     DelayUs;
+static _Atomic(int)     InFlight;
+static _Atomic(int)     MaxInFlight;
+static _Atomic(size_t)  MaxTransfer;
+static _Atomic(int)     Transfers;
+static _Atomic(int)     Invalid;
+
+/* ctt_storage_transfer
+ * The simulated device, it moves sectors until the end of the transfer or until it
+ * reaches the bad sector, in which case it reports an error with the sectors it did move. */
+int
+ctt_storage_transfer(void* client, struct vali_link_message* message, UUId_t device_id,
+    int direction, unsigned int sector_lo, unsigned int sector_hi, UUId_t buffer_id,
+    unsigned int buffer_offset, size_t sector_count, OsStatus_t* status, size_t* sectors_transferred)
+{
+    uint64_t Sector = ((uint64_t)sector_hi << 32) | sector_lo;
+    uint64_t Bad    = atomic_load(&BadSector);
+    int      Active = atomic_fetch_add(&InFlight, 1) + 1;
+    int      Seen   = atomic_load(&MaxInFlight);
+    size_t   Largest = atomic_load(&MaxTransfer);
+    size_t   i;
+
+    while (Active > Seen && !atomic_compare_exchange_weak(&MaxInFlight, &Seen, Active));
+    while (sector_count > Largest && !atomic_compare_exchange_weak(&MaxTransfer, &Largest, sector_count));
+    atomic_fetch_add(&Transfers, 1);
+
+    *status              = OsSuccess;
+    *sectors_transferred = 0;
+    if (buffer_id >= MAX_BUFFERS || !Buffers[buffer_id].Data ||
+        (buffer_offset + (sector_count * SECTOR_SIZE)) > Buffers[buffer_id].Size ||
+        (Sector + sector_count) > DEVICE_SECTORS) {
+        atomic_fetch_add(&Invalid, 1);
+        *status = OsInvalidParameters;
+        atomic_fetch_sub(&InFlight, 1);
+        return 0;
+    }
+
+    if (atomic_load(&DelayUs)) {
+        usleep(atomic_load(&DelayUs));
+    }
+
+    for (i = 0; i < sector_count; i++) {
+        uint8_t* Memory = Buffers[buffer_id].Data + buffer_offset + (i * SECTOR_SIZE);
+        uint8_t* Media  = &Disk[(Sector + i) * SECTOR_SIZE];
+        if ((Sector + i) == Bad) {
+            *status = OsError;
+            break;
+        }
+
+        if (direction == __STORAGE_OPERATION_READ) {
+            memcpy(Memory, Media, SECTOR_SIZE);
+        }
+        else {
+            memcpy(Media, Memory, SECTOR_SIZE);
+        }
+    }
+    *sectors_transferred = i;
+    atomic_fetch_sub(&InFlight, 1);
+    return 0;
+}
+
+static UUId_t
+CreateBuffer(
+    _In_ size_t Sectors)
+{
+    for (UUId_t i = 1; i < MAX_BUFFERS; i++) {
+        if (!Buffers[i].Data) {
+            Buffers[i].Size = Sectors * SECTOR_SIZE;
+            Buffers[i].Data = calloc(1, Buffers[i].Size);
+            return i;
+        }
+    }
+    return UUID_INVALID;
+}
+
+static void
+DestroyBuffer(
+    _In_ UUId_t Handle)
+{
+    free(Buffers[Handle].Data);
+    Buffers[Handle].Data = NULL;
+}
+
+static void
+ResetDevice(void)
+{
+    atomic_store(&BadSector, NO_BAD_SECTOR);
+    atomic_store(&DelayUs, 0);
+    atomic_store(&MaxInFlight, 0);
+    atomic_store(&MaxTransfer, 0);
+    atomic_store(&Transfers, 0);
+}
+
+static void
+FillPattern(
+    _In_ uint8_t* Data,
+    _In_ size_t   Length,
+    _In_ uint64_t Seed)
+{
+    for (size_t i = 0; i < Length; i++) {
+        Data[i] = (uint8_t)((Seed * 31) + (i * 7) + (i >> 9));
+    }
+}
+
+static void
+TestRoundtrip(void)
+{
+    BlockQueue_t* Queue;
+    UUId_t        Buffer = CreateBuffer(64);
+    size_t        Sizes[] = { 1, 3, 8, 64 };
+    size_t        Transferred;
+    uint8_t*      Expected = malloc(64 * SECTOR_SIZE);
+
+    ResetDevice();
+    TEST_CHECK(BlockQueueCreate(1, 1, SECTOR_SIZE, 0, 0, &Queue) == OsSuccess, "create failed");
+    for (size_t i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++) {
+        uint64_t Sector = 100 * (i + 1);
+        size_t   Length = Sizes[i] * SECTOR_SIZE;
+
+        FillPattern(Buffers[Buffer].Data, Length, Sector);
+        memcpy(Expected, Buffers[Buffer].Data, Length);
+        TEST_CHECK(BlockQueueTransfer(Queue, __STORAGE_OPERATION_WRITE, Sector, Buffer, 0,
+            Sizes[i], &Transferred) == OsSuccess, "write of %zu sectors failed", Sizes[i]);
+        TEST_CHECK(Transferred == Sizes[i], "wrote %zu of %zu sectors", Transferred, Sizes[i]);
+
+        memset(Buffers[Buffer].Data, 0, Length);
+        TEST_CHECK(BlockQueueTransfer(Queue, __STORAGE_OPERATION_READ, Sector, Buffer, 0,
+            Sizes[i], &Transferred) == OsSuccess, "read of %zu sectors failed", Sizes[i]);
+        TEST_CHECK(Transferred == Sizes[i], "read %zu of %zu sectors", Transferred, Sizes[i]);
+        TEST_CHECK(!memcmp(Expected, Buffers[Buffer].Data, Length), "data of %zu sectors differs", Sizes[i]);
+    }
+
+    // Out of range transfers are passed through and fail at the device
+    TEST_CHECK(BlockQueueTransfer(Queue, __STORAGE_OPERATION_READ, DEVICE_SECTORS - 1, Buffer, 0,
+        2, &Transferred) == OsInvalidParameters, "out of range read succeeded");
+    TEST_CHECK(Transferred == 0, "out of range read moved %zu sectors", Transferred);
+    atomic_store(&Invalid, 0);
+
+    BlockQueueDestroy(Queue);
+    DestroyBuffer(Buffer);
+    free(Expected);
+}
+
+/* TestMerging
+ * A single dispatcher with a slow device, so the batch is queued up before the first
+ * transfer completes. Adjacent requests in the same buffer must merge up to the sector
+ * limit, the requests that target another buffer or leave a gap must not. */
+static void
+TestMerging(void)
+{
+    BlockQueue_t*          Queue;
+    BlockQueueStatistics_t Statistics;
+    BlockRequest_t         Requests[32];
+    UUId_t                 Buffer = CreateBuffer(64);
+    UUId_t                 Other  = CreateBuffer(64);
+    uint8_t*               Expected = malloc(64 * SECTOR_SIZE);
+
+    ResetDevice();
+    atomic_store(&DelayUs, 500);
+    FillPattern(Disk, 128 * SECTOR_SIZE, 5);
+    TEST_CHECK(BlockQueueCreate(1, 1, SECTOR_SIZE, 1, 16, &Queue) == OsSuccess, "create failed");
+
+    // 32 requests of 2 sectors, submitted in reverse order to exercise the sorting
+    for (int i = 0; i < 32; i++) {
+        BlockRequest_t* Request = &Requests[31 - i];
+        Request->Direction    = __STORAGE_OPERATION_READ;
+        Request->Sector       = i * 2;
+        Request->BufferHandle = Buffer;
+        Request->BufferOffset = i * 2 * SECTOR_SIZE;
+        Request->SectorCount  = 2;
+    }
+    TEST_CHECK(BlockQueueTransferBatch(Queue, Requests, 32) == OsSuccess, "batch failed");
+    for (int i = 0; i < 32; i++) {
+        TEST_CHECK(Requests[i].Status == OsSuccess && Requests[i].SectorsTransferred == 2,
+            "request %i: status %i, %zu sectors", i, Requests[i].Status, Requests[i].SectorsTransferred);
+    }
+    TEST_CHECK(!memcmp(Buffers[Buffer].Data, Disk, 64 * SECTOR_SIZE), "merged read data differs");
+    TEST_CHECK(atomic_load(&MaxTransfer) <= 16, "transfer of %zu sectors exceeds the limit",
+        atomic_load(&MaxTransfer));
+
+    // The first request is dispatched alone before the rest arrive at the earliest, all
+    // others merge into transfers of 16 sectors
+    BlockQueueGetStatistics(Queue, &Statistics);
+    TEST_CHECK(Statistics.Dispatches <= 5, "%" PRIu64 " dispatches for 64 sectors", Statistics.Dispatches);
+    TEST_CHECK(Statistics.RequestsMerged == 32 - Statistics.Dispatches,
+        "%" PRIu64 " merges for %" PRIu64 " dispatches", Statistics.RequestsMerged, Statistics.Dispatches);
+
+    // Alternating buffers and a gap in the sectors, nothing here may be merged across
+    atomic_store(&MaxTransfer, 0);
+    memset(Buffers[Buffer].Data, 0, 64 * SECTOR_SIZE);
+    for (int i = 0; i < 8; i++) {
+        Requests[i].Direction    = __STORAGE_OPERATION_READ;
+        Requests[i].Sector       = (i < 4) ? i : i + 1;
+        Requests[i].BufferHandle = (i & 1) ? Other : Buffer;
+        Requests[i].BufferOffset = i * SECTOR_SIZE;
+        Requests[i].SectorCount  = 1;
+    }
+    TEST_CHECK(BlockQueueTransferBatch(Queue, Requests, 8) == OsSuccess, "unmergeable batch failed");
+    TEST_CHECK(atomic_load(&MaxTransfer) == 1, "unmergeable requests were merged");
+    for (int i = 0; i < 8; i++) {
+        uint8_t* Memory = Buffers[Requests[i].BufferHandle].Data + (i * SECTOR_SIZE);
+        TEST_CHECK(!memcmp(Memory, &Disk[Requests[i].Sector * SECTOR_SIZE], SECTOR_SIZE),
+            "unmergeable request %i read the wrong sector", i);
+    }
+
+    BlockQueueDestroy(Queue);
+    DestroyBuffer(Buffer);
+    DestroyBuffer(Other);
+    free(Expected);
+}
+
+/* TestPartial
+ * A merged transfer that fails halfway must complete the requests before the bad
+ * sector, and fail the one containing it and all after it. */
+static void
+TestPartial(void)
+{
+    BlockQueue_t*  Queue;
+    BlockRequest_t Requests[8];
+    UUId_t         Buffer = CreateBuffer(32);
+    OsStatus_t     Status;
+
+    ResetDevice();
+    atomic_store(&DelayUs, 500);
+    atomic_store(&BadSector, 1000 + 9);
+    TEST_CHECK(BlockQueueCreate(1, 1, SECTOR_SIZE, 1, 0, &Queue) == OsSuccess, "create failed");
+
+    // Keep the dispatcher busy so the batch is merged into a single transfer
+    for (int i = 0; i < 8; i++) {
+        Requests[i].Direction    = __STORAGE_OPERATION_WRITE;
+        Requests[i].Sector       = 1000 + (i * 4);
+        Requests[i].BufferHandle = Buffer;
+        Requests[i].BufferOffset = i * 4 * SECTOR_SIZE;
+        Requests[i].SectorCount  = 4;
+    }
+    Status = BlockQueueTransferBatch(Queue, Requests, 8);
+    TEST_CHECK(Status == OsError, "batch over a bad sector returned %i", Status);
+    for (int i = 0; i < 8; i++) {
+        if (i < 2) {
+            TEST_CHECK(Requests[i].Status == OsSuccess && Requests[i].SectorsTransferred == 4,
+                "request %i before the bad sector: status %i, %zu sectors", i,
+                Requests[i].Status, Requests[i].SectorsTransferred);
+        }
+        else if (i == 2) {
+            TEST_CHECK(Requests[i].Status == OsError && Requests[i].SectorsTransferred == 1,
+                "request %i with the bad sector: status %i, %zu sectors", i,
+                Requests[i].Status, Requests[i].SectorsTransferred);
+        }
+        else {
+            TEST_CHECK(Requests[i].Status != OsSuccess,
+                "request %i after the bad sector succeeded", i);
+        }
+    }
+
+    BlockQueueDestroy(Queue);
+    DestroyBuffer(Buffer);
+}
+
+#define WORKERS        6
+#define WORKER_SECTORS 256
+
+typedef struct Worker {
+    BlockQueue_t* Queue;
+    int           Index;
+    long          Iterations;
+    int           Errors;
+} Worker_t;
+
+/* Worker
+ * Each worker owns a region of the disk and a shadow copy of it, it does random reads
+ * and writes and checks every read against the shadow. */
+static int
+Worker(
+    _In_ void* Argument)
+{
+    Worker_t*          Context = Argument;
+    UUId_t             Buffer  = Context->Index + 1;
+    uint64_t           Base    = Context->Index * WORKER_SECTORS;
+    uint8_t*           Shadow  = calloc(WORKER_SECTORS, SECTOR_SIZE);
+    unsigned long long Random  = 0x9E3779B97F4A7C15ULL * (Context->Index + 1);
+
+    for (long i = 0; i < Context->Iterations; i++) {
+        size_t   Count, Transferred;
+        uint64_t Sector;
+        int      Write;
+
+        Random ^= Random << 13;
+        Random ^= Random >> 7;
+        Random ^= Random << 17;
+        Count   = 1 + (Random % 16);
+        Sector  = (Random >> 8) % (WORKER_SECTORS - Count);
+        Write   = (Random >> 40) & 1;
+
+        if (Write) {
+            FillPattern(Buffers[Buffer].Data, Count * SECTOR_SIZE, Random);
+            memcpy(&Shadow[Sector * SECTOR_SIZE], Buffers[Buffer].Data, Count * SECTOR_SIZE);
+        }
+        if (BlockQueueTransfer(Context->Queue, Write ? __STORAGE_OPERATION_WRITE : __STORAGE_OPERATION_READ,
+            Base + Sector, Buffer, 0, Count, &Transferred) != OsSuccess || Transferred != Count) {
+            Context->Errors++;
+            continue;
+        }
+        if (!Write && memcmp(&Shadow[Sector * SECTOR_SIZE], Buffers[Buffer].Data, Count * SECTOR_SIZE)) {
+            Context->Errors++;
+        }
+    }
+    free(Shadow);
+    return 0;
+}
+
+static void
+TestConcurrent(
+    _In_ long Iterations)
+{
+    BlockQueue_t*          Queue;
+    BlockQueueStatistics_t Statistics;
+    Worker_t               Workers[WORKERS];
+    thrd_t                 Threads[WORKERS];
+    int                    Depth = 3;
+    int                    Unused;
+
+    ResetDevice();
+    atomic_store(&DelayUs, 20);
+    memset(Disk, 0, WORKERS * WORKER_SECTORS * SECTOR_SIZE);
+    TEST_CHECK(BlockQueueCreate(1, 1, SECTOR_SIZE, Depth, 0, &Queue) == OsSuccess, "create failed");
+
+    for (int i = 0; i < WORKERS; i++) {
+        TEST_CHECK(CreateBuffer(16) == (UUId_t)(i + 1), "buffer %i has the wrong handle", i);
+        Workers[i].Queue      = Queue;
+        Workers[i].Index      = i;
+        Workers[i].Iterations = Iterations;
+        Workers[i].Errors     = 0;
+        thrd_create(&Threads[i], Worker, &Workers[i]);
+    }
+    for (int i = 0; i < WORKERS; i++) {
+        thrd_join(Threads[i], &Unused);
+        TEST_CHECK(Workers[i].Errors == 0, "worker %i saw %i errors", i, Workers[i].Errors);
+        DestroyBuffer(i + 1);
+    }
+
+    BlockQueueGetStatistics(Queue, &Statistics);
+    TEST_CHECK(Statistics.RequestsSubmitted == (uint64_t)(WORKERS * Iterations) &&
+        Statistics.RequestsCompleted == Statistics.RequestsSubmitted,
+        "%" PRIu64 " submitted, %" PRIu64 " completed", Statistics.RequestsSubmitted,
+        Statistics.RequestsCompleted);
+    TEST_CHECK(Statistics.MaxInFlight <= Depth && atomic_load(&MaxInFlight) <= Depth,
+        "%i transfers in flight at the device, depth is %i", atomic_load(&MaxInFlight), Depth);
+    TEST_CHECK(Statistics.Errors == 0, "%" PRIu64 " errors", Statistics.Errors);
+    printf("%i workers, %li requests each: %" PRIu64 " dispatches, %" PRIu64 " merged, %i in flight\n",
+        WORKERS, Iterations, Statistics.Dispatches, Statistics.RequestsMerged, Statistics.MaxInFlight);
+    BlockQueueDestroy(Queue);
+}
+
+int main(int argc, char** argv)
+{
+    TestRoundtrip();
+    TestMerging();
+    TestPartial();
+    TestConcurrent(TestScale(argc, argv, 2000));
+    TEST_CHECK(atomic_load(&Invalid) == 0, "%i transfers had invalid parameters", atomic_load(&Invalid));
+    TEST_RESULT("blockqueue");
+}
@@ -0,0 +1,330 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Device Manager Bring-up Tests
+ * - The bring-up queue of the device manager is driven by a discrete event simulation of
+ *   its workers, on synthetic device trees that are enumerated over time. Every decision
+ *   is checked against a reference: a driver must be taken when one is runnable, in
+ *   queue order, and never while the driver of its parent is queued or installing. The
+ *   simulation reports the boot time against a serial bring-up and the critical path.
+ */
+
+#include "bringup.h"
+#include <string.h>
+#include "test.h"
+
+#define MAX_DEVICES 512
+
+// Device ids are handed out from UUID_INVALID + 1 like DmRegisterDevice does
+#define DEVICE_ID(Index)    ((UUId_t)(Index) + UUID_INVALID + 1)
+#define DEVICE_INDEX(Id)    ((int)((Id) - UUID_INVALID - 1))
+
+typedef struct SimDevice {
+    MCoreDevice_t     Device;
+    int               Parent;     // Index of the parent, -1 for roots
+    int               HasDriver;
+    long              Arrival;    // Microseconds into the enumeration
+    long              Cost;       // Microseconds the driver takes to install
+    long              Start;
+    long              End;
+    int               Installs;
+    DmPendingDriver_t Pending;
+} SimDevice_t;
+
+typedef struct SimTree {
+    const char* Name;
+    int         Count;
+    SimDevice_t Devices[MAX_DEVICES];
+} SimTree_t;
+
+static SimTree_t Tree;
+static long      Finish[MAX_DEVICES];
+
+static int
+AddDevice(
+    _In_ int Parent,
+    _In_ int HasDriver)
+{
+    SimDevice_t* Device = &Tree.Devices[Tree.Count];
+
+    memset(Device, 0, sizeof(SimDevice_t));
+    Device->Device.Id     = DEVICE_ID(Tree.Count);
+    Device->Device.Length = sizeof(MCoreDevice_t);
+    Device->Parent        = Parent;
+    Device->HasDriver     = HasDriver;
+    Device->Cost          = 2000 + (long)(TestRandom() % 60000);
+    Device->Start         = -1;
+    Device->End           = -1;
+    return Tree.Count++;
+}
+
+/* BuildPc
+ * A root bridge with a few bridges below it, the usual controllers and a couple of
+ * devices without drivers. */
+static void
+BuildPc(void)
+{
+    int Root = AddDevice(-1, 1);
+    for (int i = 0; i < 4; i++) {
+        int Bridge = AddDevice(Root, 1);
+        for (int j = 0; j < 6; j++) {
+            int Controller = AddDevice(Bridge, (j % 3) != 2);
+            if (j == 0) {
+                for (int k = 0; k < 4; k++) {
+                    AddDevice(Controller, 1);
+                }
+            }
+        }
+    }
+    AddDevice(-1, 1);
+    AddDevice(-1, 0);
+    AddDevice(-1, 1);
+}
+
+static void
+BuildChain(void)
+{
+    int Parent = -1;
+    for (int i = 0; i < 32; i++) {
+        Parent = AddDevice(Parent, (i % 5) != 3);
+    }
+}
+
+static void
+BuildWide(void)
+{
+    int Root = AddDevice(-1, 1);
+    for (int i = 0; i < 120; i++) {
+        AddDevice(Root, 1);
+    }
+}
+
+static void
+BuildRandom(void)
+{
+    for (int i = 0; i < 300; i++) {
+        int Parent = (i == 0 || (TestRandom() % 8) == 0) ? -1 : (int)(TestRandom() % i);
+        AddDevice(Parent, (TestRandom() % 5) != 0);
+    }
+}
+
+/* ReferenceRunnable
+ * A driver may be installed when the driver of its parent is neither queued nor
+ * installing, parents without drivers do not hold back their children. */
+static int
+ReferenceRunnable(
+    _In_ SimDevice_t* Device,
+    _In_ long         Now)
+{
+    SimDevice_t* Parent;
+
+    if (Device->Parent < 0) {
+        return 1;
+    }
+
+    Parent = &Tree.Devices[Device->Parent];
+    if (!Parent->HasDriver || Parent->Arrival > Now) {
+        return 1;
+    }
+    return Parent->End >= 0 && Parent->End <= Now;
+}
+
+static void
+CheckQueue(
+    _In_ DmBringupQueue_t* Queue,
+    _In_ long              Now)
+{
+    for (DmPendingDriver_t* i = Queue->Pending; i != NULL; i = i->Link) {
+        SimDevice_t* Device = &Tree.Devices[DEVICE_INDEX(i->Device->Id)];
+        TEST_CHECK(DmIsRunnable(Queue, i) == ReferenceRunnable(Device, Now),
+            "%s: device %i runnable %i at %li us, expected %i", Tree.Name, DEVICE_INDEX(i->Device->Id),
+            DmIsRunnable(Queue, i), Now, ReferenceRunnable(Device, Now));
+    }
+}
+
+/* Simulate
+ * Devices are registered at their arrival times, and idle workers take the next
+ * runnable driver whenever something changes. */
+static void
+Simulate(
+    _In_ int Workers)
+{
+    DmBringupQueue_t Queue;
+    long             WorkerEnd[DM_BRINGUP_WORKERS] = { 0 };
+    long             Now = 0;
+    long             Serial = 0, Critical = 0, Makespan = 0;
+    int              Arrived = 0;
+    int              Active;
+
+    DmBringupInitialize(&Queue);
+    TEST_CHECK(DmIsBringupIdle(&Queue), "%s: new queue is not idle", Tree.Name);
+
+    while (1) {
+        long Next = -1;
+
+        // Register every device that has arrived, in enumeration order
+        while (Arrived < Tree.Count && Tree.Devices[Arrived].Arrival <= Now) {
+            SimDevice_t* Device = &Tree.Devices[Arrived++];
+            if (Device->HasDriver) {
+                Device->Pending.Device = &Device->Device;
+                Device->Pending.Parent = (Device->Parent < 0) ? UUID_INVALID : DEVICE_ID(Device->Parent);
+                DmBringupAppend(&Queue, &Device->Pending);
+            }
+        }
+
+        // Retire the installs that are done
+        for (int i = 0; i < Workers; i++) {
+            if (Queue.Active[i] != UUID_INVALID && WorkerEnd[i] <= Now) {
+                Tree.Devices[DEVICE_INDEX(Queue.Active[i])].End = WorkerEnd[i];
+                Queue.Active[i] = UUID_INVALID;
+            }
+        }
+        CheckQueue(&Queue, Now);
+
+        // Idle workers take drivers until nothing is runnable, the first runnable
+        // driver in queue order must be the one that is taken
+        for (int i = 0; i < Workers; i++) {
+            DmPendingDriver_t* Expected = NULL;
+            DmPendingDriver_t* Pending;
+
+            if (Queue.Active[i] != UUID_INVALID) {
+                continue;
+            }
+
+            for (DmPendingDriver_t* j = Queue.Pending; j != NULL && Expected == NULL; j = j->Link) {
+                if (ReferenceRunnable(&Tree.Devices[DEVICE_INDEX(j->Device->Id)], Now)) {
+                    Expected = j;
+                }
+            }
+
+            Pending = DmTakeRunnable(&Queue);
+            TEST_CHECK(Pending == Expected, "%s: took device %i at %li us, expected %i", Tree.Name,
+                Pending ? DEVICE_INDEX(Pending->Device->Id) : -1, Now, Expected ? DEVICE_INDEX(Expected->Device->Id) : -1);
+            if (Pending == NULL) {
+                break;
+            }
+
+            SimDevice_t* Device = &Tree.Devices[DEVICE_INDEX(Pending->Device->Id)];
+            Device->Start   = Now;
+            Device->Installs++;
+            Queue.Active[i] = Pending->Device->Id;
+            WorkerEnd[i]    = Now + Device->Cost;
+        }
+
+        // Advance to the next arrival or install that ends
+        if (Arrived < Tree.Count) {
+            Next = Tree.Devices[Arrived].Arrival;
+        }
+        Active = 0;
+        for (int i = 0; i < Workers; i++) {
+            if (Queue.Active[i] != UUID_INVALID) {
+                Active++;
+                if (Next < 0 || WorkerEnd[i] < Next) {
+                    Next = WorkerEnd[i];
+                }
+            }
+        }
+        TEST_CHECK(DmIsBringupIdle(&Queue) == (Queue.Pending == NULL && Active == 0),
+            "%s: queue idle %i at %li us with %i installing", Tree.Name, DmIsBringupIdle(&Queue), Now, Active);
+        if (Next < 0) {
+            break;
+        }
+        Now = Next;
+    }
+
+    TEST_CHECK(DmIsBringupIdle(&Queue), "%s: drivers left in the queue at %li us", Tree.Name, Now);
+    for (int i = 0; i < Tree.Count; i++) {
+        SimDevice_t* Device = &Tree.Devices[i];
+        int          Parent = Device->Parent;
+
+        if (!Device->HasDriver) {
+            TEST_CHECK(Device->Installs == 0, "%s: device %i without driver installed", Tree.Name, i);
+            continue;
+        }
+        TEST_CHECK(Device->Installs == 1, "%s: device %i installed %i times", Tree.Name, i, Device->Installs);
+        if (Parent >= 0 && Tree.Devices[Parent].HasDriver) {
+            TEST_CHECK(Device->Start >= Tree.Devices[Parent].End,
+                "%s: device %i started at %li us before parent %i ended at %li us",
+                Tree.Name, i, Device->Start, Parent, Tree.Devices[Parent].End);
+        }
+        Serial += Device->Cost;
+        if (Device->End > Makespan) {
+            Makespan = Device->End;
+        }
+    }
+
+    // The critical path is the boot time with unlimited workers, parents are always
+    // added before their children
+    for (int i = 0; i < Tree.Count; i++) {
+        SimDevice_t* Device = &Tree.Devices[i];
+        long         Ready  = Device->Arrival;
+
+        if (Device->Parent >= 0 && Tree.Devices[Device->Parent].HasDriver &&
+            Finish[Device->Parent] > Ready) {
+            Ready = Finish[Device->Parent];
+        }
+        Finish[i] = Device->HasDriver ? Ready + Device->Cost : Ready;
+        if (Finish[i] > Critical) {
+            Critical = Finish[i];
+        }
+    }
+
+    TEST_CHECK(Makespan >= Critical, "%s: finished at %li us, before the critical path %li us",
+        Tree.Name, Makespan, Critical);
+    printf("%-6s %3i devices, %i workers: %5li ms (serial %5li ms, critical path %5li ms)\n",
+        Tree.Name, Tree.Count, Workers, Makespan / 1000, Serial / 1000, Critical / 1000);
+}
+
+static void
+RunTree(
+    _In_ const char* Name,
+    _In_ void      (*Build)(void))
+{
+    unsigned long long State = TestRandomState;
+    long               Arrival;
+
+    // The same tree is built for every worker count
+    for (int Workers = 1; Workers <= DM_BRINGUP_WORKERS; Workers *= 2) {
+        TestRandomState = State;
+        Tree.Name  = Name;
+        Tree.Count = 0;
+        Build();
+
+        // Enumeration registers a device every few hundred microseconds
+        Arrival = 0;
+        for (int i = 0; i < Tree.Count; i++) {
+            Arrival += 50 + (long)(TestRandom() % 400);
+            Tree.Devices[i].Arrival = Arrival;
+        }
+        Simulate(Workers);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long Rounds = TestScale(argc, argv, 1);
+
+    for (long i = 0; i < Rounds; i++) {
+        RunTree("pc", BuildPc);
+        RunTree("chain", BuildChain);
+        RunTree("wide", BuildWide);
+        RunTree("random", BuildRandom);
+    }
+    TEST_RESULT("bringup");
+}
@@ -0,0 +1,277 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Dma Pool Tests
+ * - The dma pool runs on a buffer in host memory. Random allocations and frees go
+ *   through the pool and through two queue caches, and every byte of the buffer is owned
+ *   by at most one live allocation. The contents of an allocation must survive until it
+ *   is freed. Once everything is freed the pool must have given its slabs back, and the
+ *   cost of an allocation is measured for the pool, a cache and the byte pool alone,
+ *   which is what the pool allocated from before the slab classes.
+ */
+
+#include <ddk/bufferpool.h>
+#include <ddk/bytepool.h>
+#include <os/dmabuf.h>
+#include <string.h>
+#include <threads.h>
+#include "test.h"
+
+#define BUFFER_SIZE    0x40000
+#define SLOT_COUNT     512
+#define OPERATIONS     400000
+#define PROBE_SIZE     0x1000
+
+typedef struct Slot {
+    uint8_t* Address;
+    size_t   Length;
+    uint8_t  Pattern;
+} Slot_t;
+
+static Slot_t  Slots[SLOT_COUNT];
+static uint8_t Owners[BUFFER_SIZE];
+
+OsStatus_t
+dma_get_sg_table(struct dma_attachment* attachment, struct dma_sg_table* sg_table, int max_count)
+{
+    _CRT_UNUSED(max_count);
+    sg_table->entries = malloc(sizeof(struct dma_sg));
+    sg_table->count   = 1;
+    sg_table->entries[0].address = 0x100000;
+    sg_table->entries[0].length  = attachment->length;
+    return OsSuccess;
+}
+
+static void
+CreateAttachment(
+    _In_ struct dma_attachment* Attachment)
+{
+    Attachment->handle = 1;
+    Attachment->buffer = aligned_alloc(0x1000, BUFFER_SIZE);
+    Attachment->length = BUFFER_SIZE;
+}
+
+/* ClaimRange
+ * Marks the bytes of an allocation as owned, every byte must have been free. */
+static void
+ClaimRange(
+    _In_ struct dma_attachment* Attachment,
+    _In_ Slot_t*                Slot)
+{
+    size_t Offset = (size_t)(Slot->Address - (uint8_t*)Attachment->buffer);
+
+    TEST_CHECK(Slot->Address >= (uint8_t*)Attachment->buffer && (Offset + Slot->Length) <= BUFFER_SIZE,
+        "allocation of %zu bytes at offset 0x%zx is outside the buffer", Slot->Length, Offset);
+    if (Slot->Address < (uint8_t*)Attachment->buffer || (Offset + Slot->Length) > BUFFER_SIZE) {
+        return;
+    }
+
+    for (size_t i = 0; i < Slot->Length; i++) {
+        if (Owners[Offset + i]) {
+            TEST_CHECK(0, "allocation of %zu bytes at offset 0x%zx overlaps a live one at 0x%zx",
+                Slot->Length, Offset, Offset + i);
+            break;
+        }
+    }
+    memset(&Owners[Offset], 1, Slot->Length);
+    memset(Slot->Address, Slot->Pattern, Slot->Length);
+}
+
+static void
+ReleaseRange(
+    _In_ struct dma_attachment* Attachment,
+    _In_ Slot_t*                Slot)
+{
+    size_t Offset = (size_t)(Slot->Address - (uint8_t*)Attachment->buffer);
+
+    for (size_t i = 0; i < Slot->Length; i++) {
+        if (Slot->Address[i] != Slot->Pattern) {
+            TEST_CHECK(0, "allocation of %zu bytes at offset 0x%zx was overwritten at +%zu",
+                Slot->Length, Offset, i);
+            break;
+        }
+    }
+    memset(&Owners[Offset], 0, Slot->Length);
+}
+
+/* CountProbes
+ * Allocates blocks too large for the slabs until the pool is full, and frees them again.
+ * Returns the number of blocks that fit. */
+static int
+CountProbes(
+    _In_ struct dma_pool* Pool)
+{
+    static void* Probes[BUFFER_SIZE / PROBE_SIZE];
+    int          Count = 0;
+
+    while (Count < (int)SIZEOF_ARRAY(Probes) && dma_pool_allocate(Pool, PROBE_SIZE, &Probes[Count]) == OsSuccess) {
+        Count++;
+    }
+    for (int i = 0; i < Count; i++) {
+        dma_pool_free(Pool, Probes[i]);
+    }
+    return Count;
+}
+
+/* TestRandomOperations
+ * Random allocations of slab and byte pool sizes, each taken from and given back to the
+ * pool or one of the caches at random. The buffer is small enough that the pool runs
+ * full, which must fail the allocation without handing out memory. */
+static void
+TestRandomOperations(
+    _In_ long Operations)
+{
+    struct dma_attachment  Attachment;
+    struct dma_pool*       Pool;
+    struct dma_pool_cache* Caches[2];
+    int                    FreshProbes, Probes;
+    long                   Failed = 0;
+
+    CreateAttachment(&Attachment);
+    TEST_CHECK(dma_pool_create(&Attachment, &Pool) == OsSuccess, "the pool could not be created");
+    TEST_CHECK(dma_pool_handle(Pool) == Attachment.handle, "the pool has the wrong buffer handle");
+    FreshProbes = CountProbes(Pool);
+
+    dma_pool_cache_create(Pool, &Caches[0]);
+    dma_pool_cache_create(Pool, &Caches[1]);
+    memset(&Slots[0], 0, sizeof(Slots));
+    memset(&Owners[0], 0, sizeof(Owners));
+
+    for (long i = 0; i < Operations; i++) {
+        Slot_t* Slot = &Slots[TestRandom() % SLOT_COUNT];
+        int     Path = (int)(TestRandom() % 3);
+
+        if (Slot->Address) {
+            ReleaseRange(&Attachment, Slot);
+            if (Path == 0) dma_pool_free(Pool, Slot->Address);
+            else           dma_pool_cache_free(Caches[Path - 1], Slot->Address);
+            Slot->Address = NULL;
+        }
+        else {
+            size_t     Length = (TestRandom() % 4) ? (1 + (TestRandom() % DMA_POOL_SLAB_MAX)) :
+                (DMA_POOL_SLAB_MAX + 1 + (TestRandom() % 0xE00));
+            void*      Address = NULL;
+            OsStatus_t Status;
+
+            if (Path == 0) Status = dma_pool_allocate(Pool, Length, &Address);
+            else           Status = dma_pool_cache_allocate(Caches[Path - 1], Length, &Address);
+            if (Status != OsSuccess) {
+                Failed++;
+                continue;
+            }
+
+            if (Length <= DMA_POOL_SLAB_MAX) {
+                TEST_CHECK(((uintptr_t)Address % DMA_POOL_SLAB_MIN) == 0, "object of %zu bytes at %p is not aligned",
+                    Length, Address);
+            }
+            TEST_CHECK(dma_pool_offset(Pool, Address) == (size_t)((uint8_t*)Address - (uint8_t*)Attachment.buffer),
+                "offset of %p is wrong", Address);
+            Slot->Address = Address;
+            Slot->Length  = Length;
+            Slot->Pattern = (uint8_t)(1 + (TestRandom() % 255));
+            ClaimRange(&Attachment, Slot);
+        }
+    }
+
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (Slots[i].Address) {
+            ReleaseRange(&Attachment, &Slots[i]);
+            dma_pool_cache_free(Caches[i & 1], Slots[i].Address);
+        }
+    }
+    dma_pool_cache_destroy(Caches[0]);
+    dma_pool_cache_destroy(Caches[1]);
+
+    // One slab of each class may be kept, and each of them can split at most one probe
+    Probes = CountProbes(Pool);
+    TEST_CHECK(Probes >= (FreshProbes - 5), "%i of %i probes fit once everything was freed",
+        Probes, FreshProbes);
+    printf("%li operations, %li failed on a full pool, %i of %i probes fit after\n",
+        Operations, Failed, Probes, FreshProbes);
+
+    dma_pool_destroy(Pool);
+    free(Attachment.buffer);
+}
+
+/* Benchmark
+ * Times an allocation and a free of a command sized object, each with a handful of
+ * objects live, the way a queue uses its transfer descriptors. The byte pool is built
+ * with FreeWipe, so a release wipes the free block it merges into, which on a mostly
+ * free buffer is most of the buffer. */
+static void
+Benchmark(
+    _In_ long Rounds)
+{
+    struct dma_attachment  Attachment;
+    struct dma_pool*       Pool;
+    struct dma_pool_cache* Cache;
+    bytepool_t*            BytePool = NULL;
+    void*                  Buffer = aligned_alloc(0x1000, BUFFER_SIZE);
+    void*                  Live[4];
+    mtx_t                  Lock;
+    double                 Start, Time[3];
+
+    CreateAttachment(&Attachment);
+    dma_pool_create(&Attachment, &Pool);
+    dma_pool_cache_create(Pool, &Cache);
+    bpool(Buffer, BUFFER_SIZE, &BytePool);
+    mtx_init(&Lock, mtx_plain);
+
+    Start = TestNow();
+    for (int i = 0; i < Rounds; i++) {
+        dma_pool_allocate(Pool, 64, &Live[i & 3]);
+        dma_pool_free(Pool, Live[i & 3]);
+    }
+    Time[0] = TestNow() - Start;
+
+    Start = TestNow();
+    for (int i = 0; i < Rounds; i++) {
+        dma_pool_cache_allocate(Cache, 64, &Live[i & 3]);
+        dma_pool_cache_free(Cache, Live[i & 3]);
+    }
+    Time[1] = TestNow() - Start;
+
+    Start = TestNow();
+    for (int i = 0; i < Rounds; i++) {
+        mtx_lock(&Lock);
+        Live[i & 3] = bget(BytePool, 64);
+        mtx_unlock(&Lock);
+        mtx_lock(&Lock);
+        brel(BytePool, Live[i & 3]);
+        mtx_unlock(&Lock);
+    }
+    Time[2] = TestNow() - Start;
+
+    printf("allocate and free: pool %5.1f ns, cache %5.1f ns, byte pool %5.1f ns\n",
+        Time[0] / Rounds * 1e9, Time[1] / Rounds * 1e9, Time[2] / Rounds * 1e9);
+
+    mtx_destroy(&Lock);
+    dma_pool_cache_destroy(Cache);
+    dma_pool_destroy(Pool);
+    free(BytePool);
+    free(Buffer);
+    free(Attachment.buffer);
+}
+
+int main(int argc, char** argv)
+{
+    TestRandomOperations(TestScale(argc, argv, OPERATIONS));
+    Benchmark(TestScale(argc, argv, OPERATIONS) / 2);
+    TEST_RESULT("dmapool");
+}
@@ -0,0 +1,437 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Hid Report Tests
+ * - The report descriptors of a boot mouse, a wheel mouse with report ids, a gaming
+ *   mouse with packed 12 bit axes, a flight stick with physical units and a boot
+ *   keyboard are parsed by the driver. The descriptors are transcribed from the layouts
+ *   those devices use. The compiled fields must match the layout written out for each
+ *   of them, and a recorded stream of reports is replayed through the driver and
+ *   compared against a reference decoder that reads the layout one bit at a time.
+ */
+
+#include <hid.h>
+#include <string.h>
+#include "test.h"
+
+#define REPORT_COUNT 20000
+#define REPORT_MAX   16
+
+#define BUTTON(n)    (HID_SLOT_BUTTON | ((n) << 8))
+
+typedef struct RefField {
+    uint8_t  ReportId;
+    uint16_t BitOffset;                     // Relative to the first byte after the id
+    uint8_t  Bits;
+    int      Signed;
+    int      Relative;
+    int      Slot;                          // HID_SLOT_* or BUTTON(n)
+    int32_t  Scale;                         // 16.16 logical to physical, 0 for none
+} RefField_t;
+
+typedef struct RefReport {
+    uint8_t  ReportId;
+    size_t   Length;                        // Without the id byte
+} RefReport_t;
+
+typedef struct RefDevice {
+    const char*        Name;
+    const uint8_t*     Descriptor;
+    size_t             DescriptorLength;
+    DeviceInputType_t  InputType;
+    int                Applications;            // Top level collections
+    int                ReportIdsUsed;
+    const RefReport_t* Reports;
+    size_t             ReportCount;
+    const RefField_t*  Fields;
+    size_t             FieldCount;
+} RefDevice_t;
+
+// HID 1.11 appendix B.2, the boot protocol mouse
+static const uint8_t BootMouse[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01,
+    0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+    0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81,
+    0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06, 0xC0, 0xC0
+};
+static const RefReport_t BootMouseReports[] = { { 0, 3 } };
+static const RefField_t  BootMouseFields[] = {
+    { 0,  0, 1, 0, 0, BUTTON(0), 0 },
+    { 0,  1, 1, 0, 0, BUTTON(1), 0 },
+    { 0,  2, 1, 0, 0, BUTTON(2), 0 },
+    { 0,  8, 8, 1, 1, HID_SLOT_X, 0 },
+    { 0, 16, 8, 1, 1, HID_SLOT_Y, 0 }
+};
+
+// A five button wheel mouse with 16 bit axes, and a consumer control collection
+// on report id 2 like wireless receivers have
+static const uint8_t WheelMouse[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x01, 0x09, 0x01,
+    0xA1, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00,
+    0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01,
+    0x75, 0x03, 0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31,
+    0x16, 0x01, 0x80, 0x26, 0xFF, 0x7F, 0x75, 0x10, 0x95, 0x02,
+    0x81, 0x06, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08,
+    0x95, 0x01, 0x81, 0x06, 0xC0, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02, 0x19, 0x00,
+    0x2A, 0x3C, 0x02, 0x15, 0x00, 0x26, 0x3C, 0x02, 0x95, 0x01,
+    0x75, 0x10, 0x81, 0x00, 0xC0
+};
+static const RefReport_t WheelMouseReports[] = { { 1, 6 }, { 2, 2 } };
+static const RefField_t  WheelMouseFields[] = {
+    { 1,  0,  1, 0, 0, BUTTON(0), 0 },
+    { 1,  1,  1, 0, 0, BUTTON(1), 0 },
+    { 1,  2,  1, 0, 0, BUTTON(2), 0 },
+    { 1,  3,  1, 0, 0, BUTTON(3), 0 },
+    { 1,  4,  1, 0, 0, BUTTON(4), 0 },
+    { 1,  8, 16, 1, 1, HID_SLOT_X, 0 },
+    { 1, 24, 16, 1, 1, HID_SLOT_Y, 0 },
+    { 1, 40,  8, 1, 1, HID_SLOT_Z, 0 }
+};
+
+// A sixteen button gaming mouse, the axes are packed into 12 bits each and the
+// horizontal wheel (AC Pan) has no slot
+static const uint8_t GamingMouse[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01,
+    0xA1, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x10, 0x15, 0x00,
+    0x25, 0x01, 0x95, 0x10, 0x75, 0x01, 0x81, 0x02, 0x05, 0x01,
+    0x16, 0x01, 0xF8, 0x26, 0xFF, 0x07, 0x75, 0x0C, 0x95, 0x02,
+    0x09, 0x30, 0x09, 0x31, 0x81, 0x06, 0x15, 0x81, 0x25, 0x7F,
+    0x75, 0x08, 0x95, 0x01, 0x09, 0x38, 0x81, 0x06, 0x05, 0x0C,
+    0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06, 0xC0, 0xC0
+};
+static const RefReport_t GamingMouseReports[] = { { 2, 7 } };
+static const RefField_t  GamingMouseFields[] = {
+    { 2,  0,  1, 0, 0, BUTTON(0), 0 },  { 2,  1,  1, 0, 0, BUTTON(1), 0 },
+    { 2,  2,  1, 0, 0, BUTTON(2), 0 },  { 2,  3,  1, 0, 0, BUTTON(3), 0 },
+    { 2,  4,  1, 0, 0, BUTTON(4), 0 },  { 2,  5,  1, 0, 0, BUTTON(5), 0 },
+    { 2,  6,  1, 0, 0, BUTTON(6), 0 },  { 2,  7,  1, 0, 0, BUTTON(7), 0 },
+    { 2,  8,  1, 0, 0, BUTTON(8), 0 },  { 2,  9,  1, 0, 0, BUTTON(9), 0 },
+    { 2, 10,  1, 0, 0, BUTTON(10), 0 }, { 2, 11,  1, 0, 0, BUTTON(11), 0 },
+    { 2, 12,  1, 0, 0, BUTTON(12), 0 }, { 2, 13,  1, 0, 0, BUTTON(13), 0 },
+    { 2, 14,  1, 0, 0, BUTTON(14), 0 }, { 2, 15,  1, 0, 0, BUTTON(15), 0 },
+    { 2, 16, 12, 1, 1, HID_SLOT_X, 0 },
+    { 2, 28, 12, 1, 1, HID_SLOT_Y, 0 },
+    { 2, 40,  8, 1, 1, HID_SLOT_Z, 0 }
+};
+
+// A flight stick laid out like HID 1.11 appendix E.10, the stick reports -1000 to
+// 1000 physical units over -127 to 127 and the throttle 0 to 1023 over 0 to 255
+static const uint8_t FlightStick[] = {
+    0x05, 0x01, 0x09, 0x04, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+    0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x36, 0x18,
+    0xFC, 0x46, 0xE8, 0x03, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0xC0, 0x09, 0x32, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x35, 0x00,
+    0x46, 0xFF, 0x03, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02, 0x05,
+    0x09, 0x19, 0x01, 0x29, 0x04, 0x15, 0x00, 0x25, 0x01, 0x35,
+    0x00, 0x45, 0x01, 0x75, 0x01, 0x95, 0x04, 0x81, 0x02, 0x95,
+    0x01, 0x75, 0x04, 0x81, 0x01, 0xC0
+};
+static const RefReport_t FlightStickReports[] = { { 0, 4 } };
+static const RefField_t  FlightStickFields[] = {
+    { 0,  0, 8, 1, 0, HID_SLOT_X, (2000 << 16) / 254 },
+    { 0,  8, 8, 1, 0, HID_SLOT_Y, (2000 << 16) / 254 },
+    { 0, 16, 8, 0, 0, HID_SLOT_Z, (1023 << 16) / 255 },
+    { 0, 24, 1, 0, 0, BUTTON(0), 0 },
+    { 0, 25, 1, 0, 0, BUTTON(1), 0 },
+    { 0, 26, 1, 0, 0, BUTTON(2), 0 },
+    { 0, 27, 1, 0, 0, BUTTON(3), 0 }
+};
+
+// HID 1.11 appendix B.1, the boot protocol keyboard. Keys are not reported by the
+// driver yet, so the reports must be sized correctly and never produce input.
+static const uint8_t BootKeyboard[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0,
+    0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08,
+    0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x05,
+    0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x95, 0x06, 0x75, 0x08,
+    0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65,
+    0x81, 0x00, 0xC0
+};
+static const RefReport_t BootKeyboardReports[] = { { 0, 8 } };
+
+#define REF_DEVICE(Name, Descriptor, Type, Applications, Ids, Reports, Fields) \
+    { Name, Descriptor, sizeof(Descriptor), Type, Applications, Ids, Reports, \
+      sizeof(Reports) / sizeof(RefReport_t), Fields, sizeof(Fields) / sizeof(RefField_t) }
+
+static const RefDevice_t Devices[] = {
+    REF_DEVICE("boot mouse", BootMouse, DeviceInputPointer, 1, 0, BootMouseReports, BootMouseFields),
+    REF_DEVICE("wheel mouse", WheelMouse, DeviceInputPointer, 2, 1, WheelMouseReports, WheelMouseFields),
+    REF_DEVICE("gaming mouse", GamingMouse, DeviceInputPointer, 1, 1, GamingMouseReports, GamingMouseFields),
+    REF_DEVICE("flight stick", FlightStick, DeviceInputJoystick, 1, 0, FlightStickReports, FlightStickFields),
+    { "boot keyboard", BootKeyboard, sizeof(BootKeyboard), DeviceInputKeyboard, 1, 0,
+      BootKeyboardReports, 1, NULL, 0 }
+};
+
+// The reference decoder state of a single report id
+typedef struct RefState {
+    uint8_t  Previous[REPORT_MAX];
+    uint32_t Buttons;
+} RefState_t;
+
+static int32_t
+RefRead(
+    _In_ const uint8_t*    Data,
+    _In_ const RefField_t* Field)
+{
+    uint32_t Value = 0;
+    for (int i = 0; i < Field->Bits; i++) {
+        unsigned int Bit = Field->BitOffset + i;
+        Value |= (uint32_t)((Data[Bit / 8] >> (Bit % 8)) & 1) << i;
+    }
+    if (Field->Signed && (Value & (1U << (Field->Bits - 1)))) {
+        Value |= ~((1U << Field->Bits) - 1);
+    }
+    return (int32_t)Value;
+}
+
+static int
+RefDecode(
+    _In_  const RefDevice_t* Device,
+    _In_  RefState_t*        State,
+    _In_  uint8_t            ReportId,
+    _In_  const uint8_t*     Data,
+    _In_  size_t             Length,
+    _Out_ SystemInput_t*     Input)
+{
+    int Changes = 0;
+
+    memset(Input, 0, sizeof(SystemInput_t));
+    Input->Type    = (uint8_t)Device->InputType;
+    Input->Buttons = State->Buttons;
+    for (size_t i = 0; i < Device->FieldCount; i++) {
+        const RefField_t* Field    = &Device->Fields[i];
+        int32_t           Value    = 0;
+        int32_t           Previous = 0;
+        int32_t           Delta;
+
+        if (Field->ReportId != ReportId) {
+            continue;
+        }
+
+        Value    = RefRead(Data, Field);
+        Previous = RefRead(State->Previous, Field);
+        if (Field->Relative) {
+            Delta = Value;
+            if (Delta == 0) {
+                continue;
+            }
+        }
+        else {
+            if (Value == Previous) {
+                continue;
+            }
+            Delta = Value - Previous;
+        }
+
+        if ((Field->Slot & 0xFF) == HID_SLOT_BUTTON) {
+            if (Value) {
+                Input->Buttons |= 1U << (Field->Slot >> 8);
+            }
+            else {
+                Input->Buttons &= ~(1U << (Field->Slot >> 8));
+            }
+        }
+        else {
+            if (Field->Scale) {
+                Delta = (int32_t)(((int64_t)Delta * Field->Scale) / 65536);
+            }
+            switch (Field->Slot) {
+                case HID_SLOT_X: Input->RelativeX += (int16_t)Delta; break;
+                case HID_SLOT_Y: Input->RelativeY += (int16_t)Delta; break;
+                default:         Input->RelativeZ += (int16_t)Delta; break;
+            }
+        }
+        Changes++;
+    }
+
+    memcpy(State->Previous, Data, Length);
+    if (Changes) {
+        State->Buttons = Input->Buttons;
+    }
+    return Changes;
+}
+
+static void
+CheckProgram(
+    _In_ HidDevice_t*       Device,
+    _In_ const RefDevice_t* Reference)
+{
+    UsbHidReportProgram_t* Program = Device->Programs;
+    size_t                 Field   = 0;
+
+    for (size_t i = 0; i < Reference->ReportCount; i++, Program = Program->Link) {
+        const RefReport_t* Report = &Reference->Reports[i];
+        UUId_t             Id     = Reference->ReportIdsUsed ? Report->ReportId : UUID_INVALID;
+
+        TEST_CHECK(Program != NULL, "%s: report %u was not compiled", Reference->Name, Report->ReportId);
+        if (Program == NULL) {
+            return;
+        }
+        TEST_CHECK(Program->ReportId == Id, "%s: report id %u, expected %u",
+            Reference->Name, Program->ReportId, Id);
+        TEST_CHECK(Program->ByteLength == Report->Length, "%s: report %u is %zu bytes, expected %zu",
+            Reference->Name, Report->ReportId, Program->ByteLength, Report->Length);
+
+        for (size_t j = 0; j < Program->FieldCount; j++, Field++) {
+            const UsbHidReportField_t* Compiled = &Program->Fields[j];
+            const RefField_t*          Expected = &Reference->Fields[Field];
+            int                        Slot     = Compiled->Slot;
+
+            if (Field >= Reference->FieldCount) {
+                TEST_CHECK(0, "%s: field %zu of report %u is not in the layout",
+                    Reference->Name, j, Report->ReportId);
+                return;
+            }
+            if (Slot == HID_SLOT_BUTTON) {
+                Slot = BUTTON(Compiled->SlotIndex);
+            }
+            TEST_CHECK(Expected->ReportId == Report->ReportId && Compiled->BitOffset == Expected->BitOffset
+                    && Compiled->BitLength == Expected->Bits && Slot == Expected->Slot,
+                "%s: field %zu at bit %u (%u bits, slot 0x%x), expected bit %u (%u bits, slot 0x%x)",
+                Reference->Name, Field, Compiled->BitOffset, Compiled->BitLength, Slot,
+                Expected->BitOffset, Expected->Bits, Expected->Slot);
+            TEST_CHECK(!!(Compiled->Flags & HID_FIELD_SIGNED) == Expected->Signed
+                    && !!(Compiled->Flags & HID_FIELD_RELATIVE) == Expected->Relative,
+                "%s: field %zu has flags 0x%x", Reference->Name, Field, Compiled->Flags);
+            TEST_CHECK(Compiled->Scale == Expected->Scale, "%s: field %zu has scale %i, expected %i",
+                Reference->Name, Field, Compiled->Scale, Expected->Scale);
+        }
+    }
+    TEST_CHECK(Program == NULL, "%s: more reports were compiled than described", Reference->Name);
+    TEST_CHECK(Field == Reference->FieldCount, "%s: %zu fields compiled, expected %zu",
+        Reference->Name, Field, Reference->FieldCount);
+}
+
+// The recording is generated from a fixed seed. Reports repeat, move only some of
+// their bytes, or change the padding only, like the reports of a device in use do.
+static void
+RecordReport(
+    _In_ const RefReport_t* Report,
+    _In_ const uint8_t*     Previous,
+    _In_ uint8_t*           Data)
+{
+    unsigned long long Kind = TestRandom() % 8;
+    memcpy(Data, Previous, Report->Length);
+    if (Kind == 0) {
+        return;
+    }
+    for (size_t i = 0; i < Report->Length; i++) {
+        if (Kind == 1 || (TestRandom() % 3) == 0) {
+            Data[i] = (uint8_t)TestRandom();
+        }
+    }
+}
+
+static void
+ReplayDevice(
+    _In_ const RefDevice_t* Reference,
+    _In_ long               Reports)
+{
+    HidDevice_t               Device;
+    UsbHidReportCollection_t* Collection;
+    int                       Applications = 0;
+    RefState_t                States[4];
+    uint8_t                   Buffer[REPORT_MAX + 1];
+    size_t                    ReportLength;
+    size_t                    Longest = 0;
+    long                      Emitted = 0;
+    double                    Start, Elapsed;
+
+    memset(&Device, 0, sizeof(HidDevice_t));
+    memset(&States[0], 0, sizeof(States));
+    Device.Buffer = (uintptr_t*)&Buffer[0];
+
+    for (size_t i = 0; i < Reference->ReportCount; i++) {
+        Longest = MAX(Longest, Reference->Reports[i].Length + (Reference->ReportIdsUsed ? 1 : 0));
+    }
+
+    ReportLength = HidParseReportDescriptor(&Device, (uint8_t*)Reference->Descriptor,
+        Reference->DescriptorLength);
+    TEST_CHECK(ReportLength == Longest, "%s: maximum report length %zu, expected %zu",
+        Reference->Name, ReportLength, Longest);
+    TEST_CHECK(Device.ReportIdsUsed == Reference->ReportIdsUsed, "%s: report ids used %i",
+        Reference->Name, Device.ReportIdsUsed);
+    for (Collection = Device.Collection; Collection != NULL; Collection = Collection->Link) {
+        Applications++;
+    }
+    TEST_CHECK(Applications == Reference->Applications, "%s: %i application collections, expected %i",
+        Reference->Name, Applications, Reference->Applications);
+    CheckProgram(&Device, Reference);
+    if (Device.Programs != NULL) {
+        TEST_CHECK(Device.Programs->InputType == Reference->InputType, "%s: input type %i, expected %i",
+            Reference->Name, Device.Programs->InputType, Reference->InputType);
+    }
+
+    for (long i = 0; i < Reports; i++) {
+        size_t             Index  = TestRandom() % Reference->ReportCount;
+        const RefReport_t* Report = &Reference->Reports[Index];
+        uint8_t*           Data   = &Buffer[Reference->ReportIdsUsed ? 1 : 0];
+        SystemInput_t      Input, Expected;
+        int                Changes, ExpectedChanges;
+
+        Buffer[0] = Report->ReportId;
+        RecordReport(Report, States[Index].Previous, Data);
+        ExpectedChanges = RefDecode(Reference, &States[Index], Report->ReportId, Data, Report->Length, &Expected);
+        Changes         = HidParseReport(&Device, 0, &Input);
+
+        TEST_CHECK(Changes == ExpectedChanges, "%s: report %li changed %i fields, expected %i",
+            Reference->Name, i, Changes, ExpectedChanges);
+        if (Changes && Changes == ExpectedChanges) {
+            TEST_CHECK(!memcmp(&Input, &Expected, sizeof(SystemInput_t)),
+                "%s: report %li gave type %u (%i, %i, %i) buttons 0x%x, expected type %u (%i, %i, %i) buttons 0x%x",
+                Reference->Name, i, Input.Type, Input.RelativeX, Input.RelativeY, Input.RelativeZ, Input.Buttons,
+                Expected.Type, Expected.RelativeX, Expected.RelativeY, Expected.RelativeZ, Expected.Buttons);
+        }
+        if (TestFailures > 20) {
+            break;
+        }
+        Emitted += Changes ? 1 : 0;
+    }
+
+    // Time the driver alone on a stream of reports that all differ
+    Start = TestNow();
+    for (long i = 0; i < Reports; i++) {
+        SystemInput_t Input;
+        for (size_t j = 1; j <= Reference->Reports[0].Length; j++) {
+            Buffer[j] = (uint8_t)(i * j);
+        }
+        Buffer[0] = Reference->ReportIdsUsed ? Reference->Reports[0].ReportId : (uint8_t)i;
+        (void)HidParseReport(&Device, 0, &Input);
+    }
+    Elapsed = TestNow() - Start;
+
+    printf("  %-14s %2zu reports, %2zu bytes, %5.1f%% emitted, %6.1f ns/report\n", Reference->Name,
+        Reference->ReportCount, ReportLength, (100.0 * (double)Emitted) / (double)Reports,
+        (Elapsed * 1e9) / (double)Reports);
+    HidCollectionCleanup(&Device);
+}
+
+int
+main(int argc, char** argv)
+{
+    long Reports = TestScale(argc, argv, REPORT_COUNT);
+
+    for (size_t i = 0; i < sizeof(Devices) / sizeof(RefDevice_t); i++) {
+        ReplayDevice(&Devices[i], Reports);
+    }
+    TEST_RESULT("hid");
+}
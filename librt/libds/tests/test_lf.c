@@ -0,0 +1,413 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Lockfree Structure Tests
+ * - Stress tests for the lockfree queue, ring and stack. Producers tag every value with
+ *   their id and a sequence number, so the consumers can check that nothing was lost,
+ *   duplicated or reordered. The throughput is compared to the locked queue.
+ */
+
+#include <ds/lf/bounded_ring.h>
+#include <ds/lf/mpsc_queue.h>
+#include <ds/lf/stack.h>
+#include <ds/queue.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "test.h"
+
+#define THREAD_COUNT 4
+#define STACK_NODES  1024
+#define RING_SIZE    1024
+
+typedef struct TestItem {
+    union {
+        lf_mpsc_node_t MpscNode;
+        element_t      Element;
+    };
+    int Producer;
+    int Sequence;
+} TestItem_t;
+
+static long         ItemCount;
+static TestItem_t*  Items[THREAD_COUNT];
+
+static lf_mpsc_queue_t MpscQueue;
+static queue_t         LockedQueue;
+
+static void*
+MpscProducer(
+    _In_ void* Argument)
+{
+    int Producer = (int)(intptr_t)Argument;
+    for (long i = 0; i < ItemCount; i++) {
+        lf_mpsc_queue_push(&MpscQueue, &Items[Producer][i].MpscNode);
+    }
+    return NULL;
+}
+
+static void*
+LockedProducer(
+    _In_ void* Argument)
+{
+    int Producer = (int)(intptr_t)Argument;
+    for (long i = 0; i < ItemCount; i++) {
+        queue_push(&LockedQueue, &Items[Producer][i].Element);
+    }
+    return NULL;
+}
+
+static void
+ResetItems(void)
+{
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        for (long i = 0; i < ItemCount; i++) {
+            memset(&Items[p][i], 0, sizeof(TestItem_t));
+            Items[p][i].Producer = p;
+            Items[p][i].Sequence = (int)i;
+        }
+    }
+}
+
+/* TestMpscQueue
+ * Every producer pushes its items in order, the single consumer must see each producer's
+ * items in that same order, and must see all of them exactly once. */
+static void
+TestMpscQueue(void)
+{
+    pthread_t Threads[THREAD_COUNT];
+    int       Last[THREAD_COUNT];
+    long      Received = 0;
+    long      Reordered = 0;
+    double    Start, LockFreeTime, LockedTime;
+
+    ResetItems();
+    lf_mpsc_queue_construct(&MpscQueue);
+    TEST_CHECK(lf_mpsc_queue_empty(&MpscQueue), "new queue is not empty");
+    TEST_CHECK(lf_mpsc_queue_pop(&MpscQueue) == NULL, "pop from an empty queue returned a node");
+
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        Last[p] = -1;
+    }
+
+    Start = TestNow();
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        pthread_create(&Threads[p], NULL, MpscProducer, (void*)(intptr_t)p);
+    }
+
+    while (Received < ItemCount * THREAD_COUNT) {
+        TestItem_t* Item = (TestItem_t*)lf_mpsc_queue_pop(&MpscQueue);
+        if (!Item) {
+            continue;
+        }
+
+        if (Item->Sequence != Last[Item->Producer] + 1) {
+            Reordered++;
+        }
+        Last[Item->Producer] = Item->Sequence;
+        Received++;
+    }
+    LockFreeTime = TestNow() - Start;
+
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        pthread_join(Threads[p], NULL);
+    }
+
+    TEST_CHECK(Reordered == 0, "mpsc: %li items out of producer order", Reordered);
+    TEST_CHECK(lf_mpsc_queue_empty(&MpscQueue), "mpsc: queue not empty after draining");
+    TEST_CHECK(lf_mpsc_queue_pop(&MpscQueue) == NULL, "mpsc: pop after draining returned a node");
+
+    // The same workload through the locked queue
+    ResetItems();
+    queue_construct(&LockedQueue);
+    Received = 0;
+    Start    = TestNow();
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        pthread_create(&Threads[p], NULL, LockedProducer, (void*)(intptr_t)p);
+    }
+
+    while (Received < ItemCount * THREAD_COUNT) {
+        if (queue_pop(&LockedQueue)) {
+            Received++;
+        }
+    }
+    LockedTime = TestNow() - Start;
+
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        pthread_join(Threads[p], NULL);
+    }
+
+    printf("mpsc queue:   %6.1f Mops/s, locked queue %6.1f Mops/s\n",
+        (double)Received / LockFreeTime / 1e6, (double)Received / LockedTime / 1e6);
+}
+
+static lf_bounded_ring_t  Ring;
+static _Atomic(long)      RingConsumed;
+static _Atomic(uint8_t)*  RingSeen;
+static _Atomic(long)      RingViolations;
+static _Atomic(long)      RingFull;
+
+// Values are encoded as producer << 24 | (sequence + 1), so a value is never NULL
+static void*
+RingProducer(
+    _In_ void* Argument)
+{
+    intptr_t Producer = (intptr_t)Argument;
+    for (intptr_t i = 0; i < ItemCount; i++) {
+        void* Value = (void*)((Producer << 24) | (i + 1));
+        while (lf_bounded_ring_push(&Ring, Value)) {
+            atomic_fetch_add(&RingFull, 1);
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void*
+RingConsumer(
+    _In_ void* Argument)
+{
+    long Last[THREAD_COUNT] = { 0 };
+    _CRT_UNUSED(Argument);
+
+    while (atomic_load(&RingConsumed) < ItemCount * THREAD_COUNT) {
+        intptr_t Value = (intptr_t)lf_bounded_ring_pop(&Ring);
+        int      Producer;
+        long     Sequence;
+        if (!Value) {
+            sched_yield();
+            continue;
+        }
+
+        atomic_fetch_add(&RingConsumed, 1);
+        Producer = (int)(Value >> 24);
+        Sequence = (long)(Value & 0xFFFFFF);
+
+        // A single consumer must see the values of each producer in increasing order
+        if (Sequence <= Last[Producer] || atomic_exchange(&RingSeen[(Producer * ItemCount) + Sequence - 1], 1)) {
+            atomic_fetch_add(&RingViolations, 1);
+        }
+        Last[Producer] = Sequence;
+    }
+    return NULL;
+}
+
+static queue_t LockedRing;
+
+static void*
+LockedRingProducer(
+    _In_ void* Argument)
+{
+    int Producer = (int)(intptr_t)Argument;
+    for (long i = 0; i < ItemCount; i++) {
+        queue_push(&LockedRing, &Items[Producer][i].Element);
+    }
+    return NULL;
+}
+
+static void*
+LockedRingConsumer(
+    _In_ void* Argument)
+{
+    _CRT_UNUSED(Argument);
+    while (atomic_load(&RingConsumed) < ItemCount * THREAD_COUNT) {
+        if (queue_pop(&LockedRing)) {
+            atomic_fetch_add(&RingConsumed, 1);
+        }
+        else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* TestBoundedRing
+ * Producers and consumers run at the same time, every value must be consumed exactly once
+ * and in producer order. The ring is small so it runs full and empty repeatedly. */
+static void
+TestBoundedRing(void)
+{
+    pthread_t Threads[THREAD_COUNT * 2];
+    long      Missing = 0;
+    double    Start, LockFreeTime, LockedTime;
+    int       i;
+
+    TEST_CHECK(lf_bounded_ring_construct(&Ring, 1000) == -1, "ring: accepted a capacity that is not a power of two");
+    TEST_CHECK(lf_bounded_ring_construct(&Ring, 4) == 0, "ring: construct failed");
+    for (i = 0; i < 4; i++) {
+        TEST_CHECK(lf_bounded_ring_push(&Ring, (void*)(intptr_t)(i + 1)) == 0, "ring: push %i failed", i);
+    }
+    TEST_CHECK(lf_bounded_ring_push(&Ring, (void*)1) == -1 && errno == ENOSPC, "ring: push to a full ring succeeded");
+    for (i = 0; i < 4; i++) {
+        TEST_CHECK(lf_bounded_ring_pop(&Ring) == (void*)(intptr_t)(i + 1), "ring: pop %i out of order", i);
+    }
+    TEST_CHECK(lf_bounded_ring_pop(&Ring) == NULL, "ring: pop from an empty ring returned a value");
+    lf_bounded_ring_destroy(&Ring);
+
+    RingSeen = calloc((size_t)ItemCount * THREAD_COUNT, 1);
+    lf_bounded_ring_construct(&Ring, RING_SIZE);
+    Start = TestNow();
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&Threads[i], NULL, RingProducer, (void*)(intptr_t)i);
+        pthread_create(&Threads[THREAD_COUNT + i], NULL, RingConsumer, NULL);
+    }
+    for (i = 0; i < THREAD_COUNT * 2; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    LockFreeTime = TestNow() - Start;
+
+    for (long j = 0; j < ItemCount * THREAD_COUNT; j++) {
+        if (!RingSeen[j]) {
+            Missing++;
+        }
+    }
+    TEST_CHECK(atomic_load(&RingViolations) == 0, "ring: %li values duplicated or out of order", atomic_load(&RingViolations));
+    TEST_CHECK(Missing == 0, "ring: %li values never consumed", Missing);
+    TEST_CHECK(lf_bounded_ring_pop(&Ring) == NULL, "ring: values left after draining");
+    lf_bounded_ring_destroy(&Ring);
+    free((void*)RingSeen);
+
+    ResetItems();
+    queue_construct(&LockedRing);
+    atomic_store(&RingConsumed, 0);
+    Start = TestNow();
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&Threads[i], NULL, LockedRingProducer, (void*)(intptr_t)i);
+        pthread_create(&Threads[THREAD_COUNT + i], NULL, LockedRingConsumer, NULL);
+    }
+    for (i = 0; i < THREAD_COUNT * 2; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    LockedTime = TestNow() - Start;
+
+    printf("mpmc ring:    %6.1f Mops/s, locked queue %6.1f Mops/s (ring full %li times)\n",
+        (double)(ItemCount * THREAD_COUNT) / LockFreeTime / 1e6,
+        (double)(ItemCount * THREAD_COUNT) / LockedTime / 1e6, atomic_load(&RingFull));
+}
+
+static lf_stack_t      Stack;
+static lf_stack_node_t StackNodes[STACK_NODES];
+static queue_t         LockedStack;
+static element_t       LockedStackNodes[STACK_NODES];
+
+// Pop and push back as fast as possible, which is the pattern that exposes ABA
+static void*
+StackWorker(
+    _In_ void* Argument)
+{
+    _CRT_UNUSED(Argument);
+    for (long i = 0; i < ItemCount; i++) {
+        lf_stack_node_t* Node = lf_stack_pop(&Stack);
+        if (Node) {
+            lf_stack_push(&Stack, Node);
+        }
+    }
+    return NULL;
+}
+
+static void*
+LockedStackWorker(
+    _In_ void* Argument)
+{
+    _CRT_UNUSED(Argument);
+    for (long i = 0; i < ItemCount; i++) {
+        element_t* Element = queue_pop(&LockedStack);
+        if (Element) {
+            queue_push(&LockedStack, Element);
+        }
+    }
+    return NULL;
+}
+
+/* TestStack
+ * Checks the ordering on a single thread, then hammers pop/push from all threads and
+ * checks that every node is still on the stack exactly once. */
+static void
+TestStack(void)
+{
+    pthread_t Threads[THREAD_COUNT];
+    uint8_t   Seen[STACK_NODES] = { 0 };
+    int       Count = 0, Duplicates = 0;
+    double    Start, LockFreeTime, LockedTime;
+    int       i;
+
+    lf_stack_construct(&Stack);
+    TEST_CHECK(lf_stack_empty(&Stack), "stack: new stack is not empty");
+    for (i = 0; i < 3; i++) {
+        lf_stack_push(&Stack, &StackNodes[i]);
+    }
+    for (i = 2; i >= 0; i--) {
+        TEST_CHECK(lf_stack_pop(&Stack) == &StackNodes[i], "stack: pop is not last in, first out");
+    }
+    TEST_CHECK(lf_stack_pop(&Stack) == NULL, "stack: pop from an empty stack returned a node");
+
+    for (i = 0; i < STACK_NODES; i++) {
+        lf_stack_push(&Stack, &StackNodes[i]);
+    }
+
+    Start = TestNow();
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&Threads[i], NULL, StackWorker, NULL);
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    LockFreeTime = TestNow() - Start;
+
+    while (!lf_stack_empty(&Stack)) {
+        lf_stack_node_t* Node = lf_stack_pop(&Stack);
+        if (Seen[Node - &StackNodes[0]]++) {
+            Duplicates++;
+        }
+        Count++;
+    }
+    TEST_CHECK(Count == STACK_NODES, "stack: %i of %i nodes left", Count, STACK_NODES);
+    TEST_CHECK(Duplicates == 0, "stack: %i nodes on the stack twice", Duplicates);
+
+    queue_construct(&LockedStack);
+    for (i = 0; i < STACK_NODES; i++) {
+        queue_push(&LockedStack, &LockedStackNodes[i]);
+    }
+
+    Start = TestNow();
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&Threads[i], NULL, LockedStackWorker, NULL);
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    LockedTime = TestNow() - Start;
+
+    printf("stack:        %6.1f Mops/s, locked queue %6.1f Mops/s\n",
+        (double)(ItemCount * THREAD_COUNT * 2) / LockFreeTime / 1e6,
+        (double)(ItemCount * THREAD_COUNT * 2) / LockedTime / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    ItemCount = TestScale(argc, argv, 200000);
+    for (int p = 0; p < THREAD_COUNT; p++) {
+        Items[p] = calloc((size_t)ItemCount, sizeof(TestItem_t));
+    }
+
+    TestMpscQueue();
+    TestBoundedRing();
+    TestStack();
+    TEST_RESULT("lf");
+}
@@ -0,0 +1,530 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Kernel Log Tests
+ * - The kernel log runs on host threads, each of them is a core with its own ring. Every
+ *   message that is captured to a record must read back from the history as the text
+ *   vsnprintf produces, strings cut at LOG_STRING_LENGTH and arguments that did not fit
+ *   the record shown as '?'. The cores then log concurrently with the log thread draining
+ *   the rings, and the cost of a log call is measured against the log it replaced, which
+ *   is kept in baseline/log.c.
+ */
+
+#include <os/osdefs.h>
+#include <arch/output.h>
+#include <handle.h>
+#include <irq_spinlock.h>
+#include <log.h>
+#include <machine.h>
+#include <threading.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define CORES          8
+#define ORDERED_COUNT  50
+#define PRODUCER_BURST 24
+#define PRODUCER_PAUSE 500
+#define BENCH_BATCH    200
+#define LINE_LENGTH    127
+
+#define LONG_TEXT "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz" \
+    "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz"
+
+extern void BaselineLogInitialize(void);
+extern void BaselineLogInitializeFull(void);
+extern void BaselineLogAppendMessage(int Type, const char* Message, ...);
+
+typedef void(*LogFunction_t)(int, const char*, ...);
+
+static __thread UUId_t   CurrentCore = 0;
+static SystemMachine_t   Machine;
+static SystemCpuCore_t   Cores[CORES];
+static BootTerminal_t    Terminal;
+static _Atomic(clock_t)  Tick;
+static pthread_t         ConsumerThread;
+static int               ConsumerStarted;
+static _Atomic(int)      ConsumerStop;
+static _Atomic(int)      ProducersDone;
+
+static char   History[LOG_PREFFERED_SIZE];
+static size_t Cursor = 0;
+
+UUId_t ArchGetProcessorCoreId(void) { return CurrentCore; }
+UUId_t GetCurrentThreadId(void) { return CurrentCore + 1; }
+SystemMachine_t* GetMachine(void) { return &Machine; }
+BootTerminal_t* VideoGetTerminal(void) { return &Terminal; }
+
+void*
+LookupHandleOfType(
+    _In_ UUId_t       Handle,
+    _In_ HandleType_t Type)
+{
+    return NULL;
+}
+
+void
+IrqSpinlockAcquire(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_acquire(&Spinlock->SyncObject);
+}
+
+void
+IrqSpinlockRelease(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_release(&Spinlock->SyncObject);
+}
+
+// The tick only has to order the records, every record gets its own
+OsStatus_t
+TimersGetSystemTick(
+    _Out_ clock_t* SystemTick)
+{
+    *SystemTick = atomic_fetch_add(&Tick, 1);
+    return OsSuccess;
+}
+
+typedef struct ThreadStart {
+    ThreadEntry_t Function;
+    void*         Arguments;
+} ThreadStart_t;
+
+static void*
+ThreadTrampoline(
+    _In_ void* Context)
+{
+    ThreadStart_t Start = *(ThreadStart_t*)Context;
+    free(Context);
+    Start.Function(Start.Arguments);
+    return NULL;
+}
+
+OsStatus_t
+CreateThread(
+    _In_  const char*    Name,
+    _In_  ThreadEntry_t  Function,
+    _In_  void*          Arguments,
+    _In_  Flags_t        Flags,
+    _In_  UUId_t         MemorySpaceHandle,
+    _Out_ UUId_t*        Handle)
+{
+    ThreadStart_t* Start = malloc(sizeof(ThreadStart_t));
+    Start->Function  = Function;
+    Start->Arguments = Arguments;
+    if (pthread_create(&ConsumerThread, NULL, ThreadTrampoline, Start)) {
+        free(Start);
+        return OsError;
+    }
+    ConsumerStarted = 1;
+    *Handle         = CORES + 1;
+    return OsSuccess;
+}
+
+// The log thread is stopped from its sleep, before the overhead is measured
+int
+SchedulerSleep(
+    _In_  uint64_t Nanoseconds,
+    _Out_ clock_t* InterruptedAt)
+{
+    if (atomic_load(&ConsumerStop)) {
+        pthread_exit(NULL);
+    }
+    usleep(Nanoseconds / 1000);
+    return SCHEDULER_SLEEP_OK;
+}
+
+/* ReadHistory
+ * Reads the lines added to the history since the last read, and returns the number of lines.
+ * The lines are separated by newlines in History. */
+static int
+ReadHistory(void)
+{
+    size_t Length = 0;
+    int    Count  = 0;
+    size_t i;
+
+    while (1) {
+        size_t BytesRead;
+        if (LogRead(&Cursor, &History[Length], sizeof(History) - Length, &BytesRead) != OsSuccess ||
+            BytesRead == 0) {
+            break;
+        }
+        Length += BytesRead;
+    }
+
+    for (i = 0; i < Length; i++) {
+        if (History[i] == '\n') {
+            Count++;
+        }
+    }
+    History[Length] = '\0';
+    return Count;
+}
+
+static void
+CheckLine(
+    _In_ int         SourceLine,
+    _In_ const char* Expected)
+{
+    int Count = ReadHistory();
+    TEST_CHECK(Count == 1, "line %i: %i lines logged", SourceLine, Count);
+    if (Count == 1) {
+        History[strlen(&History[0]) - 1] = '\0';
+        TEST_CHECK(!strcmp(&History[0], Expected), "line %i: logged '%s', expected '%s'",
+            SourceLine, &History[0], Expected);
+    }
+}
+
+#define CHECK_FORMAT(Format, ...) do { \
+        char Expected[LINE_LENGTH]; \
+        snprintf(&Expected[0], sizeof(Expected), Format, __VA_ARGS__); \
+        LogAppendMessage(LOG_DEBUG, Format, __VA_ARGS__); \
+        CheckLine(__LINE__, &Expected[0]); \
+    } while (0)
+
+#define CHECK_CUT(Expected, Format, ...) do { \
+        LogAppendMessage(LOG_DEBUG, Format, __VA_ARGS__); \
+        CheckLine(__LINE__, Expected); \
+    } while (0)
+
+static void
+CheckFormats(void)
+{
+    char   Long[256];
+    char   Expected[LINE_LENGTH];
+    long   Iterations = 10000;
+    long   i;
+
+    memset(&Long[0], 'a', sizeof(Long) - 1);
+    Long[sizeof(Long) - 1] = '\0';
+
+    CHECK_FORMAT("plain text without arguments%s", "");
+    CHECK_FORMAT("%d %i %d %u", 0, -1, INT32_MIN, UINT32_MAX);
+    CHECK_FORMAT("%x %X %08x %#x %o", 0xDEADu, 0xBEEFu, 0x1234u, 255u, 8u);
+    CHECK_FORMAT("%5d|%-5d|%+d|% d|%05d", 42, 42, 42, 42, -42);
+    CHECK_FORMAT("%hhd %hd %hu", -128, -32768, 65535);
+    CHECK_FORMAT("%ld %lu %lx", -1L, ULONG_MAX, 0xCAFEBABEUL);
+    CHECK_FORMAT("%lld %llu %llx", (long long)INT64_MIN, (unsigned long long)UINT64_MAX, 0x123456789ABCDEFULL);
+    CHECK_FORMAT("%zu %zx %jd", (size_t)-1, (size_t)4096, (intmax_t)-7);
+    CHECK_FORMAT("%p %p", (void*)0x1000, (void*)&Long[0]);
+    CHECK_FORMAT("%c%c%c", 'l', 'o', 'g');
+    CHECK_FORMAT("100%% %s %% done", "is");
+    CHECK_FORMAT("%s|%10s|%-10s|%.3s", "str", "right", "left", "precision");
+    CHECK_FORMAT("%*d|%-*d|%.*s|%*.*s", 6, 1, 6, 2, 3, "precision", 8, 2, "width");
+    CHECK_FORMAT("%s %d %s %llu", "mixed", -5, "arguments", 1ULL << 40);
+    CHECK_CUT("(null)", "%s", (char*)NULL);
+
+    // Strings are cut to what is left of the record payload
+    snprintf(&Expected[0], sizeof(Expected), "%.*s", LOG_STRING_LENGTH, &Long[0]);
+    CHECK_CUT(&Expected[0], "%s", &Long[0]);
+    snprintf(&Expected[0], sizeof(Expected), "%d %.*s", 7, LOG_STRING_LENGTH - 8, &Long[0]);
+    CHECK_CUT(&Expected[0], "%d %s", 7, &Long[0]);
+
+    // Arguments that no longer fit the record are rendered as '?'
+    CHECK_CUT("0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 ? ?",
+        "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+
+    // Lines are cut at the length of a history line, as before
+    snprintf(&Expected[0], sizeof(Expected), "%.*s", LINE_LENGTH - 1, LONG_TEXT " 5");
+    CHECK_CUT(&Expected[0], LONG_TEXT " %d", 5);
+
+    for (i = 0; i < Iterations; i++) {
+        unsigned long long Value = TestRandom();
+        CHECK_FORMAT("%d %u %x %08X %-5i|%lu %lld %llx %zu %p %c", (int)Value, (unsigned int)(Value >> 7),
+            (unsigned int)(Value >> 13), (unsigned int)(Value >> 21), (int)(Value % 1000) - 500,
+            (unsigned long)(Value >> 3), (long long)Value, Value >> 11, (size_t)(Value >> 17),
+            (void*)(uintptr_t)(Value >> 5), (int)('a' + (Value % 26)));
+    }
+}
+
+/* CheckDrops
+ * Fills the ring of a core past its capacity while the log thread is stopped. The overflow must be
+ * reported once as dropped, before the messages that did fit. */
+static void
+CheckDrops(void)
+{
+    char  Expected[64];
+    char* Line;
+    char* Saved;
+    int   Count, i;
+
+    for (i = 0; i < 300; i++) {
+        LogAppendMessage(LOG_DEBUG, "message %i", i);
+    }
+
+    Count = ReadHistory();
+    TEST_CHECK(Count == 257, "%i lines after overflowing the ring", Count);
+    Line = strtok_r(&History[0], "\n", &Saved);
+    TEST_CHECK(Line && !strcmp(Line, "log: 44 messages dropped"), "drops reported as '%s'",
+        Line ? Line : "");
+    for (i = 0; i < 256 && Line; i++) {
+        Line = strtok_r(NULL, "\n", &Saved);
+        snprintf(&Expected[0], sizeof(Expected), "message %i", i);
+        TEST_CHECK(Line && !strcmp(Line, &Expected[0]), "logged '%s', expected '%s'",
+            Line ? Line : "", &Expected[0]);
+    }
+}
+
+typedef struct Producer {
+    pthread_t          Thread;
+    UUId_t             Core;
+    long               Count;
+    LogFunction_t      Log;
+    pthread_barrier_t* Barrier;
+    long               Rounds;
+} Producer_t;
+
+static const char* Names[] = { "ahci", "usb", "vfs", "net" };
+
+static void*
+ProducerMain(
+    _In_ void* Context)
+{
+    Producer_t* Producer = Context;
+    long        i;
+
+    CurrentCore = Producer->Core;
+    for (i = 0; i < Producer->Count; i++) {
+        LogAppendMessage(LOG_TRACE, "core %u message %li %s", (unsigned int)Producer->Core, i,
+            Names[i % SIZEOF_ARRAY(Names)]);
+
+        // Messages come in bursts, so the history is not overwritten before it is read
+        if ((i % PRODUCER_BURST) == (PRODUCER_BURST - 1)) {
+            usleep(PRODUCER_PAUSE);
+        }
+    }
+    atomic_fetch_add(&ProducersDone, 1);
+    return NULL;
+}
+
+/* ParseLine
+ * Checks a line from the producers and that the messages of each core arrive in order,
+ * returns the number of messages dropped if it was a drop line. */
+static long
+ParseLine(
+    _In_ const char* Line,
+    _In_ long*       Next,
+    _In_ int         Exact)
+{
+    char         Name[16];
+    unsigned int Core;
+    long         Message;
+
+    if (sscanf(Line, "log: %li messages dropped", &Message) == 1) {
+        TEST_CHECK(!Exact, "%li messages dropped", Message);
+        return Message;
+    }
+
+    if (sscanf(Line, "core %u message %li %15s", &Core, &Message, &Name[0]) != 3 || Core >= CORES) {
+        TEST_CHECK(0, "malformed line '%s'", Line);
+        return 0;
+    }
+    TEST_CHECK(!strcmp(&Name[0], Names[Message % SIZEOF_ARRAY(Names)]), "core %u message %li logged %s",
+        Core, Message, &Name[0]);
+    if (Exact) {
+        TEST_CHECK(Message == Next[Core], "core %u logged message %li, expected %li", Core, Message, Next[Core]);
+    }
+    else {
+        TEST_CHECK(Message >= Next[Core], "core %u logged message %li after %li", Core, Message, Next[Core] - 1);
+    }
+    Next[Core] = Message + 1;
+    return 0;
+}
+
+/* RunProducers
+ * Lets all cores log concurrently while the log thread drains them. The history is read
+ * until the producers are done, and all their messages must read back in order. When the
+ * messages fit the rings none may be dropped, otherwise the drops are counted. */
+static void
+RunProducers(
+    _In_ long Count,
+    _In_ int  Exact)
+{
+    Producer_t Producers[CORES];
+    long       Next[CORES] = { 0 };
+    long       Received    = 0;
+    long       Dropped     = 0;
+    int        i, Done     = 0;
+
+    atomic_store(&ProducersDone, 0);
+    for (i = 0; i < CORES; i++) {
+        Producers[i].Core  = i;
+        Producers[i].Count = Count;
+        pthread_create(&Producers[i].Thread, NULL, ProducerMain, &Producers[i]);
+    }
+
+    while (1) {
+        char* Saved;
+        char* Line;
+        int   Lines = ReadHistory();
+
+        Line = strtok_r(&History[0], "\n", &Saved);
+        while (Lines && Line) {
+            long Drops = ParseLine(Line, &Next[0], Exact);
+            Dropped  += Drops;
+            Received += Drops ? 0 : 1;
+            Line      = strtok_r(NULL, "\n", &Saved);
+        }
+
+        if (Done) {
+            break;
+        }
+        // The history is read once more after the producers are done, reading it
+        // drains the rings
+        Done = Exact ? (Received == (Count * CORES)) : (atomic_load(&ProducersDone) == CORES);
+        usleep(1000);
+    }
+
+    for (i = 0; i < CORES; i++) {
+        pthread_join(Producers[i].Thread, NULL);
+    }
+
+    if (Exact) {
+        for (i = 0; i < CORES; i++) {
+            TEST_CHECK(Next[i] == Count, "core %i logged %li of %li messages", i, Next[i], Count);
+        }
+    }
+    else {
+        TEST_CHECK(Received > 0 && (Received + Dropped) <= (Count * CORES),
+            "%li messages read and %li dropped of %li", Received, Dropped, Count * CORES);
+        printf("%i cores logging %li messages, %li read back in order, %li dropped, %li overwritten\n",
+            CORES, Count * CORES, Received, Dropped, (Count * CORES) - Received - Dropped);
+    }
+}
+
+static void*
+BenchMain(
+    _In_ void* Context)
+{
+    Producer_t* Producer = Context;
+    long        Round, i;
+
+    CurrentCore = Producer->Core;
+    for (Round = 0; Round < Producer->Rounds; Round++) {
+        pthread_barrier_wait(Producer->Barrier);
+        for (i = 0; i < BENCH_BATCH; i++) {
+            Producer->Log(LOG_TRACE, "ahci: port %i, status 0x%x, sector %llu, %s", (int)Producer->Core,
+                (unsigned int)i, (unsigned long long)(Round * BENCH_BATCH + i), Names[i & 3]);
+        }
+        pthread_barrier_wait(Producer->Barrier);
+    }
+    return NULL;
+}
+
+/* MeasureLog
+ * Times batches of log calls from a number of cores. The rings are drained between the
+ * batches, as the log thread would, so no message is dropped and the drain is not timed.
+ * Returns the nanoseconds per call seen by each core. */
+static double
+MeasureLog(
+    _In_ LogFunction_t Log,
+    _In_ int           CoreCount,
+    _In_ long          Rounds,
+    _Out_ double*      RenderNs)
+{
+    pthread_barrier_t Barrier;
+    Producer_t        Producers[CORES];
+    double            Logging   = 0.0;
+    double            Rendering = 0.0;
+    long              Round;
+    int               i;
+
+    pthread_barrier_init(&Barrier, NULL, CoreCount + 1);
+    for (i = 0; i < CoreCount; i++) {
+        Producers[i].Core    = i;
+        Producers[i].Log     = Log;
+        Producers[i].Barrier = &Barrier;
+        Producers[i].Rounds  = Rounds;
+        pthread_create(&Producers[i].Thread, NULL, BenchMain, &Producers[i]);
+    }
+
+    for (Round = 0; Round < Rounds; Round++) {
+        double Start;
+
+        pthread_barrier_wait(&Barrier);
+        Start = TestNow();
+        pthread_barrier_wait(&Barrier);
+        Logging += TestNow() - Start;
+
+        Start = TestNow();
+        ReadHistory();
+        Rendering += TestNow() - Start;
+    }
+
+    for (i = 0; i < CoreCount; i++) {
+        pthread_join(Producers[i].Thread, NULL);
+    }
+    pthread_barrier_destroy(&Barrier);
+
+    if (RenderNs) {
+        *RenderNs = (Rendering * 1e9) / (double)(Rounds * BENCH_BATCH * CoreCount);
+    }
+    return (Logging * 1e9) / (double)(Rounds * BENCH_BATCH);
+}
+
+int main(int argc, char** argv)
+{
+    long   Rounds = TestScale(argc, argv, 200);
+    double NewNs[2], BaselineNs[2], RenderNs;
+    int    i;
+
+    // A lost record would keep the ordered run waiting for it forever
+    alarm(120);
+
+    // The boot log renders synchronously from the boot ring
+    LogInitialize();
+    CheckFormats();
+
+    Machine.Processor.NumberOfCores = CORES;
+    Machine.Processor.Cores         = &Cores[0];
+    for (i = 0; i < CORES; i++) {
+        Cores[i].Id   = i;
+        Cores[i].Link = (i + 1 < CORES) ? &Cores[i + 1] : NULL;
+    }
+
+    // From here on the log thread drains the per-core rings
+    LogInitializeFull();
+    TEST_CHECK(ConsumerStarted, "the log thread was not started");
+    ReadHistory();
+    RunProducers(ORDERED_COUNT, 1);
+    RunProducers(TestScale(argc, argv, 20000), 0);
+
+    atomic_store(&ConsumerStop, 1);
+    pthread_join(ConsumerThread, NULL);
+    ReadHistory();
+    CheckDrops();
+
+    BaselineLogInitialize();
+    BaselineLogInitializeFull();
+    NewNs[0]      = MeasureLog(LogAppendMessage, 1, Rounds, &RenderNs);
+    BaselineNs[0] = MeasureLog(BaselineLogAppendMessage, 1, Rounds, NULL);
+    NewNs[1]      = MeasureLog(LogAppendMessage, CORES, Rounds, NULL);
+    BaselineNs[1] = MeasureLog(BaselineLogAppendMessage, CORES, Rounds, NULL);
+    printf("log call  1 core  %7.1f ns, baseline %7.1f ns (%.1fx), rendered later in %.1f ns\n",
+        NewNs[0], BaselineNs[0], BaselineNs[0] / NewNs[0], RenderNs);
+    printf("log call  %i cores %7.1f ns, baseline %7.1f ns (%.1fx)\n", CORES,
+        NewNs[1], BaselineNs[1], BaselineNs[1] / NewNs[1]);
+    TEST_RESULT("log");
+}
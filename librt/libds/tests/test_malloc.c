@@ -0,0 +1,464 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Allocator Tests
+ * - dlmalloc and the thread-caching allocator are built into the test with prefixed entry
+ *   points, host threads act as the threads of a process. The thread-caching allocator is
+ *   checked for the sizes and alignments it hands out, the contents realloc keeps, and
+ *   the spans it gives back once threads have freed each others objects and exited.
+ * - Both allocators are measured on larson, where threads hand their objects to the next
+ *   thread every round, and on xmalloc, where producers allocate and consumers free.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../libc/threads/tls.h"
+#include "test.h"
+
+#define TC_SPAN_SIZE   0x10000
+#define TC_SMALL_MAX   8192
+#define LARSON_SLOTS   1024
+#define LARSON_ROUNDS  4
+#define LARSON_OPS     2000000
+#define XMALLOC_RING   4096
+#define XMALLOC_OPS    1000000
+#define REMOTE_OBJECTS 20000
+
+extern void*  tc_malloc(size_t Size);
+extern void   tc_free(void* Memory);
+extern void*  tc_calloc(size_t Count, size_t Size);
+extern void*  tc_realloc(void* Memory, size_t Size);
+extern void*  tc_memalign(size_t Alignment, size_t Size);
+extern int    tc_posix_memalign(void** MemoryOut, size_t Alignment, size_t Size);
+extern int    tc_malloc_trim(size_t Pad);
+extern size_t tc_malloc_usable_size(void* Memory);
+extern size_t malloc_footprint(void);
+extern void   malloc_thread_detach(thread_storage_t* Tls);
+
+extern void*  dlmalloc(size_t Size);
+extern void   dlfree(void* Memory);
+
+typedef struct Allocator {
+    const char* Name;
+    void*       (*Allocate)(size_t);
+    void        (*Free)(void*);
+    int         Detach;
+} Allocator_t;
+
+static const Allocator_t Allocators[] = {
+    { "dlmalloc", dlmalloc,  dlfree,  0 },
+    { "tcache",   tc_malloc, tc_free, 1 }
+};
+
+static __thread thread_storage_t ThreadStorage;
+
+thread_storage_t*
+tls_current(void)
+{
+    return &ThreadStorage;
+}
+
+// The libc detaches the allocator when the thread storage is cleaned up
+static void
+ThreadExit(
+    _In_ const Allocator_t* Allocator)
+{
+    if (Allocator->Detach) {
+        malloc_thread_detach(&ThreadStorage);
+    }
+}
+
+// Every thread has its own generator, the shared one in test.h is not thread safe
+static inline unsigned int
+NextRandom(
+    _In_ unsigned int* State)
+{
+    *State = (*State * 1103515245U) + 12345U;
+    return *State >> 8;
+}
+
+/* CheckSizes
+ * Every small size is served from a class at most a quarter larger, and every
+ * allocation is aligned and writable up to its usable size. */
+static void
+CheckSizes(void)
+{
+    static const size_t Large[] = { TC_SMALL_MAX + 1, 0x10000, 0x10001, 0x100000 };
+
+    for (size_t Size = 1; Size <= TC_SMALL_MAX; Size++) {
+        uint8_t* Memory = tc_malloc(Size);
+        size_t   Usable = tc_malloc_usable_size(Memory);
+
+        TEST_CHECK(Memory && ((uintptr_t)Memory % 16) == 0, "%zu bytes at %p are not aligned", Size, Memory);
+        TEST_CHECK(Usable >= Size && (Usable - Size) <= MAX(15, Size / 4),
+            "%zu bytes are served from a class of %zu", Size, Usable);
+        memset(Memory, 0xA5, Usable);
+        tc_free(Memory);
+    }
+
+    for (size_t i = 0; i < SIZEOF_ARRAY(Large); i++) {
+        uint8_t* Memory = tc_malloc(Large[i]);
+
+        TEST_CHECK(Memory && ((uintptr_t)Memory % 16) == 0, "%zu bytes at %p are not aligned", Large[i], Memory);
+        TEST_CHECK(tc_malloc_usable_size(Memory) >= Large[i], "%zu bytes have %zu usable", Large[i],
+            tc_malloc_usable_size(Memory));
+        memset(Memory, 0xA5, Large[i]);
+        tc_free(Memory);
+    }
+}
+
+static void
+CheckAlignment(void)
+{
+    static const size_t Sizes[] = { 1, 100, 5000, 70000 };
+    void*               Memory = NULL;
+
+    for (size_t Alignment = 32; Alignment <= 0x40000; Alignment <<= 1) {
+        for (size_t i = 0; i < SIZEOF_ARRAY(Sizes); i++) {
+            Memory = tc_memalign(Alignment, Sizes[i]);
+            TEST_CHECK(Memory && ((uintptr_t)Memory % Alignment) == 0, "%zu bytes aligned to 0x%zx are at %p",
+                Sizes[i], Alignment, Memory);
+            memset(Memory, 0x5A, Sizes[i]);
+            tc_free(Memory);
+        }
+    }
+
+    TEST_CHECK(tc_posix_memalign(&Memory, 24, 64) == EINVAL, "an alignment of 24 was accepted");
+    TEST_CHECK(tc_posix_memalign(&Memory, 64, 64) == 0 && ((uintptr_t)Memory % 64) == 0, "posix_memalign failed");
+    tc_free(Memory);
+}
+
+static void
+CheckRealloc(void)
+{
+    uint8_t* Memory = tc_malloc(1);
+    size_t   Size   = 1;
+
+    Memory[0] = 0;
+    while (Size < 0x40000) {
+        size_t Next = (Size * 3 / 2) + 1;
+
+        Memory = tc_realloc(Memory, Next);
+        for (size_t i = 0; i < Size; i++) {
+            if (Memory[i] != (uint8_t)i) {
+                TEST_CHECK(0, "growing from %zu to %zu bytes lost byte %zu", Size, Next, i);
+                break;
+            }
+        }
+        for (size_t i = Size; i < Next; i++) {
+            Memory[i] = (uint8_t)i;
+        }
+        Size = Next;
+    }
+
+    Memory = tc_realloc(Memory, 100);
+    for (size_t i = 0; i < 100; i++) {
+        if (Memory[i] != (uint8_t)i) {
+            TEST_CHECK(0, "shrinking to 100 bytes lost byte %zu", i);
+            break;
+        }
+    }
+    tc_free(Memory);
+}
+
+static void
+CheckCalloc(void)
+{
+    uint8_t* Memory = tc_malloc(200);
+    int      Dirty  = 0;
+
+    memset(Memory, 0xFF, 200);
+    tc_free(Memory);
+
+    // The object that was just freed is handed out again
+    Memory = tc_calloc(10, 20);
+    for (int i = 0; i < 200; i++) {
+        Dirty |= Memory[i];
+    }
+    TEST_CHECK(!Dirty, "calloc returned dirty memory");
+    tc_free(Memory);
+
+    TEST_CHECK(tc_calloc(SIZE_MAX / 2, 4) == NULL, "an overflowing calloc succeeded");
+}
+
+typedef struct RemotePair {
+    pthread_t        Thread;
+    void**           Objects;
+    _Atomic(int)     Produced;
+    unsigned int     Seed;
+} RemotePair_t;
+
+static void*
+RemoteProducer(
+    _In_ void* Context)
+{
+    RemotePair_t* Pair = Context;
+
+    for (int i = 0; i < REMOTE_OBJECTS; i++) {
+        size_t Size = 1 + (NextRandom(&Pair->Seed) % ((i % 64) ? 512 : (TC_SMALL_MAX * 2)));
+
+        Pair->Objects[i] = tc_malloc(Size);
+        memset(Pair->Objects[i], 0x3C, Size);
+    }
+    atomic_store(&Pair->Produced, 1);
+    ThreadExit(&Allocators[1]);
+    return NULL;
+}
+
+static void*
+RemoteConsumer(
+    _In_ void* Context)
+{
+    RemotePair_t* Pair = Context;
+
+    // Half of the objects are freed while the producer is still alive, the rest once
+    // its spans have been abandoned
+    while (!atomic_load(&Pair->Produced)) {
+        sched_yield();
+    }
+    for (int i = 0; i < REMOTE_OBJECTS; i += 2) {
+        tc_free(Pair->Objects[i]);
+    }
+    pthread_join(Pair->Thread, NULL);
+    for (int i = 1; i < REMOTE_OBJECTS; i += 2) {
+        tc_free(Pair->Objects[i]);
+    }
+    ThreadExit(&Allocators[1]);
+    return NULL;
+}
+
+/* CheckRemoteFrees
+ * Producers exit while their objects are freed by other threads. Once all threads are
+ * gone and the process trims, the footprint must be back where it started. */
+static void
+CheckRemoteFrees(void)
+{
+    RemotePair_t Pairs[4];
+    pthread_t    Consumers[4];
+    size_t       Before;
+
+    tc_malloc_trim(0);
+    Before = malloc_footprint();
+
+    for (int i = 0; i < 4; i++) {
+        Pairs[i].Objects = calloc(REMOTE_OBJECTS, sizeof(void*));
+        Pairs[i].Seed    = (unsigned int)(i + 1);
+        atomic_store(&Pairs[i].Produced, 0);
+        pthread_create(&Pairs[i].Thread, NULL, RemoteProducer, &Pairs[i]);
+        pthread_create(&Consumers[i], NULL, RemoteConsumer, &Pairs[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(Consumers[i], NULL);
+        free(Pairs[i].Objects);
+    }
+
+    tc_malloc_trim(0);
+    TEST_CHECK(malloc_footprint() <= Before + TC_SPAN_SIZE, "the footprint grew from %zu to %zu bytes",
+        Before, malloc_footprint());
+}
+
+typedef struct BenchThread {
+    pthread_t          Thread;
+    int                Index;
+    int                Count;
+    long               Operations;
+    const Allocator_t* Allocator;
+    pthread_barrier_t* Start;
+    pthread_barrier_t* Round;
+    void***            Slots;
+    _Atomic(void*)*    Ring;
+} BenchThread_t;
+
+/* LarsonMain
+ * Each round the thread replaces random objects of a slot set, and then moves on to the
+ * set of the next thread, so most frees are of objects allocated by another thread. */
+static void*
+LarsonMain(
+    _In_ void* Context)
+{
+    BenchThread_t*     Bench     = Context;
+    const Allocator_t* Allocator = Bench->Allocator;
+    unsigned int       Seed      = (unsigned int)(Bench->Index * 77 + 1);
+
+    for (int i = 0; i < LARSON_SLOTS; i++) {
+        Bench->Slots[Bench->Index][i] = Allocator->Allocate(16 + (NextRandom(&Seed) % 240));
+    }
+    pthread_barrier_wait(Bench->Start);
+
+    for (int Round = 0; Round < LARSON_ROUNDS; Round++) {
+        void** Slots = Bench->Slots[(Bench->Index + Round) % Bench->Count];
+
+        for (long i = 0; i < Bench->Operations / LARSON_ROUNDS; i++) {
+            unsigned int Slot = NextRandom(&Seed) % LARSON_SLOTS;
+            size_t       Size = 16 + (NextRandom(&Seed) % ((NextRandom(&Seed) % 16) ? 240 : 2000));
+
+            Allocator->Free(Slots[Slot]);
+            Slots[Slot] = Allocator->Allocate(Size);
+            *(char*)Slots[Slot] = 1;
+        }
+        pthread_barrier_wait(Bench->Round);
+    }
+    pthread_barrier_wait(Bench->Start);
+
+    for (int i = 0; i < LARSON_SLOTS; i++) {
+        Allocator->Free(Bench->Slots[Bench->Index][i]);
+    }
+    ThreadExit(Allocator);
+    return NULL;
+}
+
+static void*
+XmallocProducer(
+    _In_ void* Context)
+{
+    BenchThread_t* Bench = Context;
+    unsigned int   Seed  = (unsigned int)(Bench->Index + 5);
+
+    pthread_barrier_wait(Bench->Start);
+    for (long i = 0; i < Bench->Operations; i++) {
+        void* Memory = Bench->Allocator->Allocate(16 + (NextRandom(&Seed) % 256));
+
+        *(char*)Memory = 1;
+        while (atomic_load_explicit(&Bench->Ring[i % XMALLOC_RING], memory_order_acquire)) {
+            sched_yield();
+        }
+        atomic_store_explicit(&Bench->Ring[i % XMALLOC_RING], Memory, memory_order_release);
+    }
+    pthread_barrier_wait(Bench->Start);
+    ThreadExit(Bench->Allocator);
+    return NULL;
+}
+
+static void*
+XmallocConsumer(
+    _In_ void* Context)
+{
+    BenchThread_t* Bench = Context;
+
+    pthread_barrier_wait(Bench->Start);
+    for (long i = 0; i < Bench->Operations; i++) {
+        void* Memory;
+
+        while (!(Memory = atomic_load_explicit(&Bench->Ring[i % XMALLOC_RING], memory_order_acquire))) {
+            sched_yield();
+        }
+        atomic_store_explicit(&Bench->Ring[i % XMALLOC_RING], NULL, memory_order_relaxed);
+        Bench->Allocator->Free(Memory);
+    }
+    pthread_barrier_wait(Bench->Start);
+    ThreadExit(Bench->Allocator);
+    return NULL;
+}
+
+/* RunBenchmark
+ * Runs larson or xmalloc with the given number of threads and returns the million
+ * operations per second, timed between the barriers the threads start and end on. */
+static double
+RunBenchmark(
+    _In_ const Allocator_t* Allocator,
+    _In_ int                Xmalloc,
+    _In_ int                ThreadCount,
+    _In_ long               Operations)
+{
+    BenchThread_t*    Threads = calloc(ThreadCount, sizeof(BenchThread_t));
+    void***           Slots   = calloc(ThreadCount, sizeof(void**));
+    _Atomic(void*)*   Rings   = NULL;
+    pthread_barrier_t Start, Round;
+    double            Began, Time;
+
+    pthread_barrier_init(&Start, NULL, ThreadCount + 1);
+    pthread_barrier_init(&Round, NULL, ThreadCount);
+    if (Xmalloc) {
+        Rings = calloc((ThreadCount / 2) * XMALLOC_RING, sizeof(void*));
+    }
+
+    for (int i = 0; i < ThreadCount; i++) {
+        Threads[i].Index      = i;
+        Threads[i].Count      = ThreadCount;
+        Threads[i].Allocator  = Allocator;
+        Threads[i].Start      = &Start;
+        Threads[i].Round      = &Round;
+        Threads[i].Slots      = Slots;
+        if (Xmalloc) {
+            Threads[i].Operations = Operations / ThreadCount * 2;
+            Threads[i].Ring       = &Rings[(i / 2) * XMALLOC_RING];
+            pthread_create(&Threads[i].Thread, NULL, (i & 1) ? XmallocConsumer : XmallocProducer, &Threads[i]);
+        }
+        else {
+            Threads[i].Operations = Operations / ThreadCount;
+            Slots[i]              = calloc(LARSON_SLOTS, sizeof(void*));
+            pthread_create(&Threads[i].Thread, NULL, LarsonMain, &Threads[i]);
+        }
+    }
+
+    pthread_barrier_wait(&Start);
+    Began = TestNow();
+    pthread_barrier_wait(&Start);
+    Time = TestNow() - Began;
+
+    for (int i = 0; i < ThreadCount; i++) {
+        pthread_join(Threads[i].Thread, NULL);
+        free(Slots[i]);
+    }
+    pthread_barrier_destroy(&Start);
+    pthread_barrier_destroy(&Round);
+    free(Rings);
+    free(Slots);
+    free(Threads);
+    return (double)Operations / Time / 1e6;
+}
+
+static void
+Benchmark(
+    _In_ long Scale)
+{
+    static const int LarsonThreads[]  = { 1, 4, 16, 64 };
+    static const int XmallocThreads[] = { 2, 4, 16, 64 };
+
+    printf("larson Mops/s   threads  dlmalloc  tcache\n");
+    for (size_t i = 0; i < SIZEOF_ARRAY(LarsonThreads); i++) {
+        printf("                %7i  %8.1f  %6.1f\n", LarsonThreads[i],
+            RunBenchmark(&Allocators[0], 0, LarsonThreads[i], LARSON_OPS * Scale),
+            RunBenchmark(&Allocators[1], 0, LarsonThreads[i], LARSON_OPS * Scale));
+    }
+
+    printf("xmalloc Mops/s  threads  dlmalloc  tcache\n");
+    for (size_t i = 0; i < SIZEOF_ARRAY(XmallocThreads); i++) {
+        printf("                %7i  %8.1f  %6.1f\n", XmallocThreads[i],
+            RunBenchmark(&Allocators[0], 1, XmallocThreads[i], XMALLOC_OPS * Scale),
+            RunBenchmark(&Allocators[1], 1, XmallocThreads[i], XMALLOC_OPS * Scale));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    alarm(300);
+
+    CheckSizes();
+    CheckAlignment();
+    CheckRealloc();
+    CheckCalloc();
+    CheckRemoteFrees();
+    Benchmark(TestScale(argc, argv, 1));
+    TEST_RESULT("malloc");
+}
@@ -0,0 +1,311 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Managed String Tests
+ * - A corpus of generated paths, shaped like the ones the file manager and the loader see,
+ *   is checked against the C library for compare, hash and find, and against the managed
+ *   string before the ascii fast paths, which is kept in baseline/mstring.c. The intern
+ *   table is checked for pointer identity across growth, and the benchmark times the same
+ *   operations on the corpus for the current string, the baseline and the C library.
+ */
+
+#include <ds/mstring.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "test.h"
+
+#define PATH_COUNT      20000
+#define PATH_LENGTH     256
+#define INTERN_COUNT    10000
+#define BENCH_REPEATS   5
+
+// Times the loop a number of times and keeps the fastest, so every loop is timed with warm caches
+#define TEST_BEST(Best, ...) do { \
+        Best = 1e9; \
+        for (int Repeat = 0; Repeat < BENCH_REPEATS; Repeat++) { \
+            double Start = TestNow(); \
+            __VA_ARGS__ \
+            Best = MIN(Best, TestNow() - Start); \
+        } \
+    } while (0)
+
+static const char* Prefixes[] = {
+    "st0:/", "rd:/", "$sys/", "$bin/", "st1:/shared/"
+};
+
+static const char* Components[] = {
+    "system", "bin", "shared", "libraries", "users", "documents", "appdata", "temp", "cache",
+    "themes", "default", "icons", "fonts", "includes", "readme.txt", "libc.dll", "libos.dll",
+    "libds.dll", "vioarr.app", "config.json", "image.png", "Pr\xC3\xA6sentation.odp",
+    "Bilder", "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", "build-2020-06-14.log"
+};
+
+#define ARRAY_COUNT(Array) (sizeof(Array) / sizeof((Array)[0]))
+
+typedef struct BaselineMString BaselineMString_t;
+
+extern BaselineMString_t* BaselineMStringCreate(const char* Data);
+extern void BaselineMStringDestroy(BaselineMString_t* String);
+extern int BaselineMStringCompare(BaselineMString_t* String1, BaselineMString_t* String2, int IgnoreCase);
+extern size_t BaselineMStringHash(BaselineMString_t* String);
+extern int BaselineMStringFind(BaselineMString_t* String, mchar_t Character, int StartIndex);
+extern int BaselineMStringFindReverse(BaselineMString_t* String, mchar_t Character, int StartIndex);
+
+static char       Paths[PATH_COUNT][PATH_LENGTH];
+static char       Flipped[PATH_COUNT][PATH_LENGTH];
+static MString_t* Strings[PATH_COUNT];
+static MString_t* FlippedStrings[PATH_COUNT];
+
+static BaselineMString_t* BaselineStrings[PATH_COUNT];
+static BaselineMString_t* BaselineFlipped[PATH_COUNT];
+
+static void
+BuildCorpus(void)
+{
+    for (int i = 0; i < PATH_COUNT; i++) {
+        int Depth = 1 + (int)(TestRandom() % 6);
+
+        strcpy(Paths[i], Prefixes[TestRandom() % ARRAY_COUNT(Prefixes)]);
+        for (int j = 0; j < Depth; j++) {
+            strcat(Paths[i], Components[TestRandom() % ARRAY_COUNT(Components)]);
+            if (j + 1 < Depth) {
+                strcat(Paths[i], "/");
+            }
+        }
+
+        // The twin only differs in the case of ascii letters
+        strcpy(Flipped[i], Paths[i]);
+        for (char* c = &Flipped[i][0]; *c; c++) {
+            if ((unsigned char)*c < 0x80 && (TestRandom() & 1)) {
+                *c = (char)(isupper((unsigned char)*c) ? tolower((unsigned char)*c) : toupper((unsigned char)*c));
+            }
+        }
+
+        Strings[i]        = MStringCreate(Paths[i], StrUTF8);
+        FlippedStrings[i] = MStringCreate(Flipped[i], StrUTF8);
+        BaselineStrings[i] = BaselineMStringCreate(Paths[i]);
+        BaselineFlipped[i] = BaselineMStringCreate(Flipped[i]);
+    }
+}
+
+// Only ascii letters are folded, which is what MStringCompare promises for UTF-8 input
+static int
+ReferenceEqual(
+    _In_ const char* First,
+    _In_ const char* Second,
+    _In_ int         IgnoreCase)
+{
+    while (*First && *Second) {
+        unsigned char a = (unsigned char)*First++;
+        unsigned char b = (unsigned char)*Second++;
+        if (IgnoreCase && a < 0x80 && b < 0x80) {
+            a = (unsigned char)tolower(a);
+            b = (unsigned char)tolower(b);
+        }
+        if (a != b) {
+            return 0;
+        }
+    }
+    return *First == *Second;
+}
+
+static int
+IsAscii(
+    _In_ const char* String)
+{
+    for (; *String; String++) {
+        if ((unsigned char)*String >= 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+TestAgainstLibc(void)
+{
+    for (int i = 0; i < PATH_COUNT; i++) {
+        int Other = (int)(TestRandom() % PATH_COUNT);
+
+        TEST_CHECK(MStringCompare(Strings[i], FlippedStrings[i], 1) == MSTRING_FULL_MATCH,
+            "compare: %s and %s differ ignoring case", Paths[i], Flipped[i]);
+        TEST_CHECK((MStringCompare(Strings[i], FlippedStrings[i], 0) == MSTRING_FULL_MATCH) ==
+            ReferenceEqual(Paths[i], Flipped[i], 0), "compare: %s and %s", Paths[i], Flipped[i]);
+        TEST_CHECK((MStringCompare(Strings[i], Strings[Other], 1) == MSTRING_FULL_MATCH) ==
+            ReferenceEqual(Paths[i], Paths[Other], 1), "compare: %s and %s", Paths[i], Paths[Other]);
+
+        TEST_CHECK(MStringHash(Strings[i]) == MStringHash(FlippedStrings[i]),
+            "hash: %s and %s differ", Paths[i], Flipped[i]);
+
+        // The UTF-8 decoder counts a lead byte as a character of its own, so the indices of
+        // non-ascii strings are only checked against the decoder itself
+        if (IsAscii(Paths[i])) {
+            TEST_CHECK(MStringFind(Strings[i], '/', 0) == (int)(strchr(Paths[i], '/') - Paths[i]),
+                "find: / in %s", Paths[i]);
+            TEST_CHECK(MStringFindReverse(Strings[i], '/', 0) == (int)(strrchr(Paths[i], '/') - Paths[i]),
+                "find reverse: / in %s", Paths[i]);
+        }
+        else {
+            TEST_CHECK(MStringGetCharAt(Strings[i], MStringFind(Strings[i], '/', 0)) == '/',
+                "find: / in %s", Paths[i]);
+            TEST_CHECK(MStringGetCharAt(Strings[i], MStringFindReverse(Strings[i], '/', 0)) == '/',
+                "find reverse: / in %s", Paths[i]);
+        }
+
+        // Apart from the hash values, the fast paths must give the results of the old string
+        TEST_CHECK(MStringCompare(Strings[i], FlippedStrings[i], 0) ==
+            BaselineMStringCompare(BaselineStrings[i], BaselineFlipped[i], 0), "baseline compare: %s and %s",
+            Paths[i], Flipped[i]);
+        TEST_CHECK(MStringCompare(Strings[i], Strings[Other], 1) ==
+            BaselineMStringCompare(BaselineStrings[i], BaselineStrings[Other], 1), "baseline compare: %s and %s",
+            Paths[i], Paths[Other]);
+        TEST_CHECK(MStringFind(Strings[i], '/', 1) == BaselineMStringFind(BaselineStrings[i], '/', 1),
+            "baseline find: / in %s", Paths[i]);
+        TEST_CHECK(MStringFindReverse(Strings[i], '/', 0) == BaselineMStringFindReverse(BaselineStrings[i], '/', 0),
+            "baseline find reverse: / in %s", Paths[i]);
+        TEST_CHECK(MStringSize(Strings[i]) == strlen(Paths[i]), "size: %s", Paths[i]);
+        TEST_CHECK(!strcmp(MStringRaw(Strings[i]), Paths[i]), "raw: %s", Paths[i]);
+    }
+}
+
+static void
+TestIntern(void)
+{
+    static MString_t* Interned[INTERN_COUNT];
+    char              Name[32];
+    MString_t*        First  = MStringIntern("libc.dll", 8);
+    MString_t*        Second = MStringIntern("libc.dll", 8);
+    MString_t*        Upper  = MStringIntern("LIBC.DLL", 8);
+
+    TEST_CHECK(First != NULL && First == Second, "intern: same content gave two instances");
+    TEST_CHECK(Upper != First, "intern: case is part of the identity");
+    TEST_CHECK(MStringCompare(First, Upper, 1) == MSTRING_FULL_MATCH, "intern: compare ignoring case");
+
+    // Interned strings are shared, so destroying one must leave it intact
+    MStringDestroy(First);
+    TEST_CHECK(!strcmp(MStringRaw(Second), "libc.dll"), "intern: destroy released a shared string");
+
+    // Enough entries to grow the table several times, every pointer must survive the rehash
+    for (int i = 0; i < INTERN_COUNT; i++) {
+        int Length  = snprintf(Name, sizeof(Name), "component%i", i);
+        Interned[i] = MStringIntern(Name, (size_t)Length);
+    }
+    for (int i = 0; i < INTERN_COUNT; i++) {
+        int Length = snprintf(Name, sizeof(Name), "component%i", i);
+        TEST_CHECK(MStringIntern(Name, (size_t)Length) == Interned[i], "intern: %s moved", Name);
+        TEST_CHECK(!strcmp(MStringRaw(Interned[i]), Name), "intern: %s has the wrong content", Name);
+    }
+    TEST_CHECK(MStringIntern("libc.dll", 8) == Second, "intern: libc.dll moved");
+}
+
+static void
+Benchmark(void)
+{
+    volatile size_t Sink = 0;
+    double          Time[3];
+
+    TEST_BEST(Time[0],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)MStringCompare(Strings[i], FlippedStrings[i], 1);
+            Sink += (size_t)MStringCompare(Strings[i], Strings[(i + 1) % PATH_COUNT], 1);
+        });
+    TEST_BEST(Time[1],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)BaselineMStringCompare(BaselineStrings[i], BaselineFlipped[i], 1);
+            Sink += (size_t)BaselineMStringCompare(BaselineStrings[i], BaselineStrings[(i + 1) % PATH_COUNT], 1);
+        });
+    TEST_BEST(Time[2],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)strcasecmp(Paths[i], Flipped[i]);
+            Sink += (size_t)strcasecmp(Paths[i], Paths[(i + 1) % PATH_COUNT]);
+        });
+    printf("compare ignoring case: %6.1f ns, baseline %6.1f ns (%.1fx), strcasecmp %6.1f ns\n",
+        Time[0] / (PATH_COUNT * 2) * 1e9, Time[1] / (PATH_COUNT * 2) * 1e9, Time[1] / Time[0],
+        Time[2] / (PATH_COUNT * 2) * 1e9);
+
+    TEST_BEST(Time[0],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += MStringHash(Strings[i]);
+        });
+    TEST_BEST(Time[1],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += BaselineMStringHash(BaselineStrings[i]);
+        });
+    printf("hash:                  %6.1f ns, baseline %6.1f ns (%.1fx)\n",
+        Time[0] / PATH_COUNT * 1e9, Time[1] / PATH_COUNT * 1e9, Time[1] / Time[0]);
+
+    TEST_BEST(Time[0],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)MStringFindReverse(Strings[i], '/', 0);
+        });
+    TEST_BEST(Time[1],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)BaselineMStringFindReverse(BaselineStrings[i], '/', 0);
+        });
+    TEST_BEST(Time[2],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            Sink += (size_t)strrchr(Paths[i], '/');
+        });
+    printf("find reverse:          %6.1f ns, baseline %6.1f ns (%.1fx), strrchr    %6.1f ns\n",
+        Time[0] / PATH_COUNT * 1e9, Time[1] / PATH_COUNT * 1e9, Time[1] / Time[0],
+        Time[2] / PATH_COUNT * 1e9);
+
+    // Path components are what the loader and the file systems create over and over
+    TEST_BEST(Time[0],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            MString_t* Component = MStringCreate(Components[i % ARRAY_COUNT(Components)], StrUTF8);
+            Sink += MStringSize(Component);
+            MStringDestroy(Component);
+        });
+    TEST_BEST(Time[1],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            BaselineMString_t* Component = BaselineMStringCreate(Components[i % ARRAY_COUNT(Components)]);
+            Sink += (size_t)Component;
+            BaselineMStringDestroy(Component);
+        });
+    TEST_BEST(Time[2],
+        for (int i = 0; i < PATH_COUNT; i++) {
+            const char* Name = Components[i % ARRAY_COUNT(Components)];
+            Sink += MStringSize(MStringIntern(Name, strlen(Name)));
+        });
+    printf("component create:      %6.1f ns, baseline %6.1f ns (%.1fx), intern     %6.1f ns\n",
+        Time[0] / PATH_COUNT * 1e9, Time[1] / PATH_COUNT * 1e9, Time[1] / Time[0],
+        Time[2] / PATH_COUNT * 1e9);
+}
+
+int main(int argc, char** argv)
+{
+    long Rounds = TestScale(argc, argv, 1);
+
+    BuildCorpus();
+    for (long i = 0; i < Rounds; i++) {
+        TestAgainstLibc();
+    }
+    TestIntern();
+    Benchmark();
+
+    for (int i = 0; i < PATH_COUNT; i++) {
+        MStringDestroy(Strings[i]);
+        MStringDestroy(FlippedStrings[i]);
+        BaselineMStringDestroy(BaselineStrings[i]);
+        BaselineMStringDestroy(BaselineFlipped[i]);
+    }
+    TEST_RESULT("mstring");
+}
@@ -0,0 +1,196 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Mutex Tests
+ * - The libc mutex is built on the host futex. Threads count their acquisitions and the
+ *   shared counter inside the lock must match the sum. The benchmark measures throughput
+ *   and fairness (Jain's index over the per-thread counts) under contention, with the
+ *   spinning enabled by reporting several active cores, with it disabled by reporting a
+ *   single core, and for the host pthread mutex. Spinning only pays off when the threads
+ *   really run in parallel, on a single cpu machine the numbers of the spinning runs are
+ *   expected to be no better than the blocking ones.
+ */
+
+#include <os/mollenos.h>
+#include <threads.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define MAX_THREADS 8
+#define RUN_SECONDS 0.2
+
+typedef enum {
+    LOCK_SPIN,
+    LOCK_BLOCK,
+    LOCK_PTHREAD
+} LockType_t;
+
+static const char* LockNames[] = { "spinning", "blocking", "pthread" };
+
+static mtx_t           Mutex;
+static pthread_mutex_t HostMutex = PTHREAD_MUTEX_INITIALIZER;
+static LockType_t      Type;
+static int             CriticalWork;
+static _Atomic(int)    Stop;
+static long            Counter;
+static long            Counts[MAX_THREADS];
+
+static inline void
+Work(
+    _In_ int Amount)
+{
+    for (volatile int i = 0; i < Amount; i++);
+}
+
+static void*
+Worker(
+    _In_ void* Argument)
+{
+    int  Index = (int)(intptr_t)Argument;
+    long Count = 0;
+
+    while (!atomic_load(&Stop)) {
+        if (Type == LOCK_PTHREAD) {
+            pthread_mutex_lock(&HostMutex);
+            Counter++;
+            Work(CriticalWork);
+            pthread_mutex_unlock(&HostMutex);
+        }
+        else {
+            mtx_lock(&Mutex);
+            Counter++;
+            Work(CriticalWork);
+            mtx_unlock(&Mutex);
+        }
+        Count++;
+        Work(CriticalWork / 2);
+    }
+    Counts[Index] = Count;
+    return NULL;
+}
+
+/* BenchmarkContention
+ * Returns the acquisitions per second, the fairness is 1.0 when every thread got the lock
+ * equally often and 1/threads when a single thread got it every time. */
+static double
+BenchmarkContention(
+    _In_  LockType_t LockType,
+    _In_  int        Threads,
+    _In_  int        Work,
+    _In_  double     Seconds,
+    _Out_ double*    Fairness)
+{
+    pthread_t Handles[MAX_THREADS];
+    double    Start, Elapsed;
+    double    Sum = 0.0, SumSquares = 0.0;
+
+    HostSetActiveCores((LockType == LOCK_SPIN) ? MAX_THREADS : 1);
+    mtx_init(&Mutex, mtx_plain);
+    Type         = LockType;
+    CriticalWork = Work;
+    atomic_store(&Stop, 0);
+    Counter      = 0;
+    memset(Counts, 0, sizeof(Counts));
+
+    Start = TestNow();
+    for (int i = 0; i < Threads; i++) {
+        pthread_create(&Handles[i], NULL, Worker, (void*)(intptr_t)i);
+    }
+    while (TestNow() - Start < Seconds) {
+        struct timespec Sleep = { 0, 10000000 };
+        nanosleep(&Sleep, NULL);
+    }
+    atomic_store(&Stop, 1);
+    for (int i = 0; i < Threads; i++) {
+        pthread_join(Handles[i], NULL);
+    }
+    Elapsed = TestNow() - Start;
+
+    for (int i = 0; i < Threads; i++) {
+        Sum        += (double)Counts[i];
+        SumSquares += (double)Counts[i] * (double)Counts[i];
+    }
+    TEST_CHECK((double)Counter == Sum, "%s: %li acquisitions counted inside the lock, %.0f outside",
+        LockNames[LockType], Counter, Sum);
+    mtx_destroy(&Mutex);
+
+    *Fairness = (SumSquares > 0.0) ? (Sum * Sum) / (Threads * SumSquares) : 0.0;
+    return Sum / Elapsed;
+}
+
+static void
+TestSemantics(void)
+{
+    mtx_t           Recursive, Timed;
+    struct timespec Deadline;
+
+    mtx_init(&Recursive, mtx_recursive);
+    TEST_CHECK(mtx_lock(&Recursive) == thrd_success, "recursive: lock");
+    TEST_CHECK(mtx_lock(&Recursive) == thrd_success, "recursive: second lock");
+    TEST_CHECK(mtx_unlock(&Recursive) == thrd_success, "recursive: unlock");
+    TEST_CHECK(atomic_load(&Recursive.value) != 0, "recursive: released after the first unlock");
+    TEST_CHECK(mtx_unlock(&Recursive) == thrd_success, "recursive: second unlock");
+    TEST_CHECK(atomic_load(&Recursive.value) == 0, "recursive: still held");
+    TEST_CHECK(mtx_unlock(&Recursive) == thrd_error, "recursive: unlocked a free mutex");
+    mtx_destroy(&Recursive);
+
+    // The deadline must be honored both when it has passed and when it lies ahead
+    mtx_init(&Timed, mtx_timed);
+    TEST_CHECK(mtx_trylock(&Timed) == thrd_success, "timed: trylock");
+    atomic_store(&Timed.value, 2);
+    Timed.owner = UUID_INVALID;
+
+    timespec_get(&Deadline, TIME_UTC);
+    Deadline.tv_sec--;
+    TEST_CHECK(mtx_timedlock(&Timed, &Deadline) == thrd_timedout, "timed: passed deadline");
+    timespec_get(&Deadline, TIME_UTC);
+    Deadline.tv_nsec += 50000000;
+    if (Deadline.tv_nsec >= 1000000000) {
+        Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000;
+    }
+    TEST_CHECK(mtx_timedlock(&Timed, &Deadline) == thrd_timedout, "timed: deadline ahead");
+    mtx_destroy(&Timed);
+}
+
+int main(int argc, char** argv)
+{
+    double Seconds = RUN_SECONDS * (double)TestScale(argc, argv, 1);
+    int    Threads[] = { 2, MAX_THREADS };
+    int    Works[]   = { 10, 200 };
+
+    TestSemantics();
+
+    printf("%li cpus online, the spinning runs report %i cores\n",
+        sysconf(_SC_NPROCESSORS_ONLN), MAX_THREADS);
+    for (size_t w = 0; w < sizeof(Works) / sizeof(Works[0]); w++) {
+        for (size_t t = 0; t < sizeof(Threads) / sizeof(Threads[0]); t++) {
+            printf("cs %3i, %i threads:", Works[w], Threads[t]);
+            for (int l = LOCK_SPIN; l <= LOCK_PTHREAD; l++) {
+                double Fairness;
+                double Rate = BenchmarkContention((LockType_t)l, Threads[t], Works[w], Seconds, &Fairness);
+                printf("  %s %6.2f Mops/s (fairness %.3f)", LockNames[l], Rate / 1e6, Fairness);
+            }
+            printf("\n");
+        }
+    }
+    TEST_RESULT("mutex");
+}
@@ -0,0 +1,325 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * PCI MSI Tests
+ * - The capability walk and the MSI/MSI-X parser of the bus driver are run against
+ *   configuration space dumps in the layout lspci -xxx prints them, rows that are left
+ *   out are zero. The devices follow the qemu ich9-ahci, qemu-xhci, nvme, e1000e,
+ *   pci-bridge and piix3-ide functions, the rest are broken lists and tables a device
+ *   must not be trusted with. Random configuration spaces check that the walk always
+ *   terminates and never reads past the 256 bytes.
+ */
+
+#include "bus.h"
+#include <string.h>
+#include "test.h"
+
+typedef struct PciDump {
+    const char* Name;
+    const char* Dump;
+    OsStatus_t  Status;
+    int         Type;
+    unsigned    Offset;
+    int         Vectors;
+    int         Is64Bit;
+    int         TableIoSpace;
+    size_t      TableOffset;
+} PciDump_t;
+
+static const PciDump_t Dumps[] = {
+    { "ich9-ahci",
+      "00: 86 80 22 29 07 05 10 00 02 01 06 01 00 00 00 00\n"
+      "20: 81 c0 00 00 00 10 bf fe 00 00 00 00 f4 1a 00 11\n"
+      "30: 00 00 00 00 80 00 00 00 00 00 00 00 0a 01 00 00\n"
+      "80: 05 a8 80 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "a0: 00 00 00 00 00 00 00 00 12 00 10 00 48 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0x80, 1, 1, -1, 0 },
+
+    // The vector table is in bar 0, which is 64 bit and therefore io-space 1
+    { "qemu-xhci",
+      "00: 36 1b 0d 00 07 05 10 00 01 30 03 0c 00 00 00 00\n"
+      "10: 04 00 bf fe 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "20: 00 00 00 00 00 00 00 00 00 00 00 00 f4 1a 00 11\n"
+      "30: 00 00 00 00 90 00 00 00 00 00 00 00 0a 01 00 00\n"
+      "60: 30 20 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "70: 05 00 88 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "90: 11 70 0f 00 00 30 00 00 00 38 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSIX, 0x90, 16, 0, 1, 0x3000 },
+
+    // 65 table entries, more than a driver may register
+    { "nvme",
+      "00: 36 1b 10 00 07 05 10 00 02 02 08 01 00 00 00 00\n"
+      "10: 04 00 bf fe 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "20: 00 20 bf fe 00 00 00 00 00 00 00 00 f4 1a 00 11\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 11 80 40 00 04 00 00 00 04 08 00 00 00 00 00 00\n"
+      "60: 01 00 03 00 08 00 00 00 00 00 00 00 00 00 00 00\n"
+      "80: 10 60 02 00 00 80 00 10 00 00 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSIX, 0x40, INTERRUPT_MAX_MSI_VECTORS, 0, 4, 0 },
+
+    // MSI comes first in the list, but MSI-X is preferred
+    { "e1000e",
+      "00: 86 80 d3 10 07 05 10 00 00 00 00 02 00 00 00 00\n"
+      "10: 00 00 bc fe 00 00 be fe 81 c0 00 00 00 00 bf fe\n"
+      "20: 00 00 00 00 00 00 00 00 00 00 00 00 f4 1a 00 11\n"
+      "30: 00 00 00 00 c8 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "a0: 11 00 04 00 03 00 00 00 03 20 00 00 00 00 00 00\n"
+      "c0: 00 00 00 00 00 00 00 00 01 d0 22 c8 00 20 00 00\n"
+      "d0: 05 e0 80 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "e0: 10 a0 02 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSIX, 0xa0, 5, 0, 3, 0 },
+
+    { "pci-bridge",
+      "00: 36 1b 01 00 07 05 10 00 00 00 04 06 00 00 01 00\n"
+      "10: 04 10 bf fe 00 00 00 00 00 01 01 00 f0 00 00 00\n"
+      "30: 00 00 00 00 4c 00 00 00 00 00 00 00 0a 01 03 00\n"
+      "40: 0c 00 00 00 00 00 00 00 04 40 00 00 05 48 80 01\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0x4c, 1, 1, -1, 0 },
+
+    // The pointer register holds timing registers when the status bit is clear
+    { "piix3-ide",
+      "00: 86 80 10 70 07 00 80 02 00 80 01 01 00 00 00 00\n"
+      "20: 01 c0 00 00 00 00 00 00 00 00 00 00 f4 1a 00 11\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 00 00 00 00\n"
+      "40: 05 00 80 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    { "cardbus",
+      "00: 80 11 76 04 07 00 10 02 00 00 07 06 00 00 02 00\n"
+      "10: 00 00 00 f0 dc 00 00 02 00 01 01 00 00 00 00 00\n"
+      "d0: 00 00 00 00 00 00 00 00 00 00 00 00 05 00 80 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    { "pointer into the header",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "30: 00 00 00 00 10 00 00 00 00 00 00 00 0b 01 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    { "list loops",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 01 50 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "50: 09 40 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    // The low two bits of the pointers are reserved
+    { "reserved pointer bits",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "30: 00 00 00 00 43 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 01 52 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "50: 05 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0x50, 1, 0, -1, 0 },
+
+    { "vector table in io",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "10: 01 c0 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 11 50 07 00 00 00 00 00 00 08 00 00 00 00 00 00\n"
+      "50: 05 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0x50, 1, 0, -1, 0 },
+
+    { "vector table in a truncated 64 bit bar",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "20: 00 00 00 00 04 00 bf fe 00 00 00 00 00 00 00 00\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 11 50 07 00 05 00 00 00 05 08 00 00 00 00 00 00\n"
+      "50: 05 00 80 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0x50, 1, 1, -1, 0 },
+
+    { "reserved table bar",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "40: 11 00 07 00 07 00 00 00 07 08 00 00 00 00 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    // Capabilities must fit in the configuration space, the msi-x one here would overrun it
+    { "msi-x past the end",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "10: 00 00 bf fe 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "30: 00 00 00 00 f8 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "e0: 05 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n"
+      "f0: 00 00 00 00 00 00 00 00 11 e0 07 00 00 20 00 00\n",
+      OsSuccess, INTERRUPT_MSI_CAPABILITY_MSI, 0xe0, 1, 0, -1, 0 },
+
+    { "64 bit msi past the end",
+      "00: 86 80 00 10 07 00 10 00 00 00 00 02 00 00 00 00\n"
+      "30: 00 00 00 00 f4 00 00 00 00 00 00 00 0b 01 00 00\n"
+      "f0: 00 00 00 00 05 00 80 00 00 00 00 00 00 00 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 },
+
+    // A bridge only has two bars
+    { "bridge table past its bars",
+      "00: 36 1b 01 00 07 05 10 00 00 00 04 06 00 00 01 00\n"
+      "10: 00 00 00 00 00 00 00 00 00 01 01 00 f0 00 00 00\n"
+      "30: 00 00 00 00 40 00 00 00 00 00 00 00 0a 01 03 00\n"
+      "40: 11 00 07 00 02 00 00 00 02 08 00 00 00 00 00 00\n",
+      OsDoesNotExist, INTERRUPT_MSI_CAPABILITY_NONE, 0, 0, 0, -1, 0 }
+};
+
+static uint8_t CurrentSpace[PCI_CONFIG_SPACE_LENGTH];
+
+uint32_t
+PciRead32(
+    _In_ PciBus_t* Io,
+    _In_ DevInfo_t Bus,
+    _In_ DevInfo_t Slot,
+    _In_ DevInfo_t Function,
+    _In_ size_t    Register)
+{
+    uint32_t Value;
+    memcpy(&Value, &CurrentSpace[Register], sizeof(uint32_t));
+    return Value;
+}
+
+/* ParseDump
+ * Rows are "<offset>: <16 hex bytes>", anything not covered stays zero. */
+static void
+ParseDump(
+    _In_  const char* Dump,
+    _Out_ uint8_t*    ConfigSpace)
+{
+    const char* Line = Dump;
+    unsigned    Row, Byte;
+    int         Read;
+
+    memset(ConfigSpace, 0, PCI_CONFIG_SPACE_LENGTH);
+    while (*Line) {
+        if (sscanf(Line, "%x:%n", &Row, &Read) != 1 || Row > PCI_CONFIG_SPACE_LENGTH - 16) {
+            TEST_CHECK(0, "malformed dump row: %.16s", Line);
+            return;
+        }
+        Line += Read;
+        for (int i = 0; i < 16; i++) {
+            if (sscanf(Line, " %2x%n", &Byte, &Read) != 1) {
+                TEST_CHECK(0, "short dump row %02x", Row);
+                return;
+            }
+            ConfigSpace[Row + i] = (uint8_t)Byte;
+            Line += Read;
+        }
+        while (*Line && *Line++ != '\n');
+    }
+}
+
+static void
+CheckCapability(
+    _In_ const PciDump_t*             Dump,
+    _In_ const char*                  Path,
+    _In_ OsStatus_t                   Status,
+    _In_ const DeviceMsiCapability_t* Msi)
+{
+    TEST_CHECK(Status == Dump->Status, "%s (%s): status %i, expected %i", Dump->Name, Path, Status, Dump->Status);
+    TEST_CHECK(Msi->Type == Dump->Type && Msi->Offset == Dump->Offset,
+        "%s (%s): type %i at 0x%x, expected type %i at 0x%x",
+        Dump->Name, Path, Msi->Type, Msi->Offset, Dump->Type, Dump->Offset);
+    TEST_CHECK(Msi->Vectors == Dump->Vectors && Msi->Is64Bit == Dump->Is64Bit,
+        "%s (%s): %i vectors, 64 bit %i, expected %i vectors, 64 bit %i",
+        Dump->Name, Path, Msi->Vectors, Msi->Is64Bit, Dump->Vectors, Dump->Is64Bit);
+    TEST_CHECK(Msi->TableIoSpace == Dump->TableIoSpace && Msi->TableOffset == Dump->TableOffset,
+        "%s (%s): table in io-space %i at 0x%zx, expected io-space %i at 0x%zx",
+        Dump->Name, Path, Msi->TableIoSpace, Msi->TableOffset, Dump->TableIoSpace, Dump->TableOffset);
+}
+
+/* TestDumps
+ * Every dump is parsed from the copy and read through the bus accessors. */
+static void
+TestDumps(void)
+{
+    DeviceMsiCapability_t Msi;
+    OsStatus_t            Status;
+
+    for (size_t i = 0; i < sizeof(Dumps) / sizeof(Dumps[0]); i++) {
+        ParseDump(Dumps[i].Dump, &CurrentSpace[0]);
+
+        memset(&Msi, 0xA5, sizeof(Msi));
+        Status = PciParseMsiCapability(&CurrentSpace[0], &Msi);
+        CheckCapability(&Dumps[i], "copy", Status, &Msi);
+
+        memset(&Msi, 0xA5, sizeof(Msi));
+        Status = PciReadMsiCapability(NULL, 0, 0, 0, &Msi);
+        CheckCapability(&Dumps[i], "bus", Status, &Msi);
+    }
+}
+
+/* TestFindCapability
+ * Capabilities behind others in the list, and ids that are not present. */
+static void
+TestFindCapability(void)
+{
+    ParseDump(Dumps[3].Dump, &CurrentSpace[0]);
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], 0x01) == 0xc8, "e1000e: power management not found first");
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], PCI_CAPABILITY_MSI) == 0xd0, "e1000e: msi not found");
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], 0x10) == 0xe0, "e1000e: pci express not found");
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], PCI_CAPABILITY_MSIX) == 0xa0, "e1000e: msi-x not found last");
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], 0x12) == 0, "e1000e: sata capability found");
+
+    ParseDump(Dumps[0].Dump, &CurrentSpace[0]);
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], 0x12) == 0xa8, "ich9-ahci: sata capability not found");
+    TEST_CHECK(PciFindCapability(&CurrentSpace[0], PCI_CAPABILITY_MSIX) == 0, "ich9-ahci: msi-x found");
+}
+
+/* TestCorruptSpaces
+ * Random configuration spaces with the capability bit set must terminate and only ever
+ * report capabilities the list actually links to. */
+static void
+TestCorruptSpaces(
+    _In_ long Iterations)
+{
+    DeviceMsiCapability_t Msi;
+
+    for (long i = 0; i < Iterations; i++) {
+        for (int j = 0; j < PCI_CONFIG_SPACE_LENGTH; j += 8) {
+            unsigned long long Value = TestRandom();
+            memcpy(&CurrentSpace[j], &Value, sizeof(Value));
+        }
+        CurrentSpace[0x06] |= PCI_STATUS_CAPABILITIES;
+        CurrentSpace[0x0E] &= 0x81;
+
+        if (PciParseMsiCapability(&CurrentSpace[0], &Msi) != OsSuccess) {
+            TEST_CHECK(Msi.Type == INTERRUPT_MSI_CAPABILITY_NONE, "corrupt space %li: type %i without success", i, Msi.Type);
+            continue;
+        }
+
+        TEST_CHECK(Msi.Offset >= 0x40 && Msi.Offset + 0x0A <= PCI_CONFIG_SPACE_LENGTH && !(Msi.Offset & 3),
+            "corrupt space %li: capability at 0x%x", i, Msi.Offset);
+        TEST_CHECK(Msi.Vectors >= 1 && Msi.Vectors <= INTERRUPT_MAX_MSI_VECTORS,
+            "corrupt space %li: %i vectors", i, Msi.Vectors);
+        if (Msi.Type == INTERRUPT_MSI_CAPABILITY_MSIX) {
+            TEST_CHECK(CurrentSpace[Msi.Offset] == PCI_CAPABILITY_MSIX && Msi.Offset + 0x0C <= PCI_CONFIG_SPACE_LENGTH,
+                "corrupt space %li: msi-x at 0x%x", i, Msi.Offset);
+            TEST_CHECK(Msi.TableIoSpace >= 0 && Msi.TableIoSpace < 6, "corrupt space %li: io-space %i", i, Msi.TableIoSpace);
+        }
+        else {
+            TEST_CHECK(CurrentSpace[Msi.Offset] == PCI_CAPABILITY_MSI &&
+                Msi.Offset + (Msi.Is64Bit ? 0x0E : 0x0A) <= PCI_CONFIG_SPACE_LENGTH,
+                "corrupt space %li: msi at 0x%x", i, Msi.Offset);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long Iterations = TestScale(argc, argv, 100000);
+
+    TestDumps();
+    TestFindCapability();
+    TestCorruptSpaces(Iterations);
+    printf("%zu dumps, %li corrupt spaces\n", sizeof(Dumps) / sizeof(Dumps[0]), Iterations);
+    TEST_RESULT("pcimsi");
+}
@@ -0,0 +1,319 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Ordered Tree Tests
+ * - Random insert/remove sequences are replayed on the red-black tree and the B+ tree and
+ *   checked against a presence table, including the red-black invariants, ordered walks
+ *   and bounds. The benchmark compares lookups and full scans of both trees.
+ */
+
+#include <ds/bplustree.h>
+#include <ds/rbtree.h>
+#include "test.h"
+
+#define KEY_SPACE   4096
+#define BUILD_LIMIT 3000
+
+#define KEY(Value) ((void*)(intptr_t)(Value))
+
+// The colors are private to rbtree.c
+#define TEST_COLOR_RED 1
+
+/* CheckRbSubtree
+ * Validates parent links, that no red node has a red child and that every path has the
+ * same number of black nodes. Returns the black height, or -1 if the subtree is broken. */
+static int
+CheckRbSubtree(
+    _In_ rb_tree_t* Tree,
+    _In_ rb_leaf_t* Leaf)
+{
+    int Left, Right;
+    if (Leaf == &Tree->nil) {
+        return 1;
+    }
+
+    if (Leaf->color == TEST_COLOR_RED &&
+        (Leaf->left->color == TEST_COLOR_RED || Leaf->right->color == TEST_COLOR_RED)) {
+        return -1;
+    }
+    if ((Leaf->left != &Tree->nil && Leaf->left->parent != Leaf) ||
+        (Leaf->right != &Tree->nil && Leaf->right->parent != Leaf)) {
+        return -1;
+    }
+
+    Left  = CheckRbSubtree(Tree, Leaf->left);
+    Right = CheckRbSubtree(Tree, Leaf->right);
+    if (Left < 0 || Left != Right) {
+        return -1;
+    }
+    return Left + (Leaf->color != TEST_COLOR_RED);
+}
+
+static int
+CheckRbTree(
+    _In_ rb_tree_t* Tree)
+{
+    return Tree->root == NULL || CheckRbSubtree(Tree, Tree->root) > 0;
+}
+
+/* CheckOrder
+ * Walks both trees forwards and the red-black tree backwards, and compares the bounds of
+ * a random key against the presence table. */
+static void
+CheckOrder(
+    _In_ rb_tree_t*     RbTree,
+    _In_ bp_tree_t*     BpTree,
+    _In_ const uint8_t* Present)
+{
+    bp_tree_iterator_t Iterator;
+    rb_leaf_t*         Leaf;
+    OsStatus_t         Status;
+    int                Query = 1 + (int)(TestRandom() % (KEY_SPACE - 1));
+    int                LowerBound = -1, UpperBound = -1;
+    size_t             Count = 0;
+
+    for (int Key = Query; Key < KEY_SPACE; Key++) {
+        if (Present[Key]) {
+            if (LowerBound < 0) {
+                LowerBound = Key;
+            }
+            if (Key > Query && UpperBound < 0) {
+                UpperBound = Key;
+            }
+        }
+    }
+
+    Leaf = rb_tree_lower_bound(RbTree, KEY(Query));
+    TEST_CHECK((Leaf ? (int)(intptr_t)Leaf->key : -1) == LowerBound, "rb: lower bound of %i", Query);
+    Leaf = rb_tree_upper_bound(RbTree, KEY(Query));
+    TEST_CHECK((Leaf ? (int)(intptr_t)Leaf->key : -1) == UpperBound, "rb: upper bound of %i", Query);
+
+    Status = bp_tree_lower_bound(BpTree, KEY(Query), &Iterator);
+    TEST_CHECK((Status == OsSuccess ? (int)(intptr_t)Iterator.key : -1) == LowerBound,
+        "bp: lower bound of %i", Query);
+    Status = bp_tree_upper_bound(BpTree, KEY(Query), &Iterator);
+    TEST_CHECK((Status == OsSuccess ? (int)(intptr_t)Iterator.key : -1) == UpperBound,
+        "bp: upper bound of %i", Query);
+
+    Leaf   = rb_tree_minimum(RbTree);
+    Status = bp_tree_first(BpTree, &Iterator);
+    for (int Key = 1; Key < KEY_SPACE; Key++) {
+        if (!Present[Key]) {
+            continue;
+        }
+        TEST_CHECK(Leaf && (int)(intptr_t)Leaf->key == Key, "rb: forward walk missed %i", Key);
+        TEST_CHECK(Status == OsSuccess && (int)(intptr_t)Iterator.key == Key &&
+            (intptr_t)Iterator.value == (intptr_t)Key * 2, "bp: forward walk missed %i", Key);
+        Leaf   = Leaf ? rb_tree_next(RbTree, Leaf) : NULL;
+        Status = bp_tree_next(&Iterator);
+        Count++;
+    }
+    TEST_CHECK(Leaf == NULL, "rb: forward walk did not end");
+    TEST_CHECK(Status != OsSuccess, "bp: forward walk did not end");
+    TEST_CHECK(BpTree->count == Count, "bp: count %zu, expected %zu", BpTree->count, Count);
+
+    Leaf = rb_tree_maximum(RbTree);
+    for (int Key = KEY_SPACE - 1; Key > 0; Key--) {
+        if (Present[Key]) {
+            TEST_CHECK(Leaf && (int)(intptr_t)Leaf->key == Key, "rb: backward walk missed %i", Key);
+            Leaf = Leaf ? rb_tree_prev(RbTree, Leaf) : NULL;
+        }
+    }
+    TEST_CHECK(Leaf == NULL, "rb: backward walk did not end");
+}
+
+/* TestRandomOperations
+ * Inserts, reinserts and removes random keys in both trees. */
+static void
+TestRandomOperations(
+    _In_ long Iterations)
+{
+    static rb_leaf_t Leaves[KEY_SPACE];
+    static uint8_t   Present[KEY_SPACE];
+    rb_tree_t        RbTree;
+    bp_tree_t        BpTree;
+
+    rb_tree_construct(&RbTree);
+    bp_tree_construct(&BpTree);
+
+    for (long i = 0; i < Iterations; i++) {
+        int Key       = 1 + (int)(TestRandom() % (KEY_SPACE - 1));
+        int Operation = (int)(TestRandom() % 3);
+
+        if (Operation < 2 && !Present[Key]) {
+            RB_LEAF_INIT(&Leaves[Key], Key, NULL);
+            TEST_CHECK(rb_tree_append(&RbTree, &Leaves[Key]) == OsSuccess, "rb: append %i", Key);
+            TEST_CHECK(bp_tree_append(&BpTree, KEY(Key), KEY(Key * 2)) == OsSuccess, "bp: append %i", Key);
+            Present[Key] = 1;
+        }
+        else if (Operation < 2) {
+            rb_leaf_t Duplicate;
+            RB_LEAF_INIT(&Duplicate, Key, NULL);
+            TEST_CHECK(rb_tree_append(&RbTree, &Duplicate) == OsExists, "rb: duplicate %i accepted", Key);
+            TEST_CHECK(bp_tree_append(&BpTree, KEY(Key), NULL) == OsExists, "bp: duplicate %i accepted", Key);
+        }
+        else {
+            void*      Value  = NULL;
+            rb_leaf_t* Leaf   = rb_tree_remove(&RbTree, KEY(Key));
+            OsStatus_t Status = bp_tree_remove(&BpTree, KEY(Key), &Value);
+            if (Present[Key]) {
+                TEST_CHECK(Leaf == &Leaves[Key], "rb: remove %i", Key);
+                TEST_CHECK(Status == OsSuccess && (intptr_t)Value == (intptr_t)Key * 2, "bp: remove %i", Key);
+                Present[Key] = 0;
+            }
+            else {
+                TEST_CHECK(Leaf == NULL, "rb: removed missing key %i", Key);
+                TEST_CHECK(Status == OsDoesNotExist, "bp: removed missing key %i", Key);
+            }
+        }
+
+        if ((i % 5000) == 0) {
+            TEST_CHECK(CheckRbTree(&RbTree), "rb: invariants broken after %li operations", i);
+            CheckOrder(&RbTree, &BpTree, &Present[0]);
+        }
+    }
+    bp_tree_destroy(&BpTree);
+}
+
+/* TestBuild
+ * Builds both trees from sorted input of every small size and a spread of larger ones, which
+ * covers the partial last level of the red-black build and the leaf split of the B+ tree build. */
+static void
+TestBuild(void)
+{
+    static rb_leaf_t  Leaves[BUILD_LIMIT];
+    static rb_leaf_t* LeafPointers[BUILD_LIMIT];
+    static void*      Keys[BUILD_LIMIT];
+
+    for (int Count = 0; Count < BUILD_LIMIT; Count += (Count < 70) ? 1 : 97) {
+        rb_tree_t RbTree;
+        bp_tree_t BpTree;
+
+        rb_tree_construct(&RbTree);
+        bp_tree_construct(&BpTree);
+        for (int i = 0; i < Count; i++) {
+            RB_LEAF_INIT(&Leaves[i], i + 1, NULL);
+            LeafPointers[i] = &Leaves[i];
+            Keys[i]         = KEY(i + 1);
+        }
+
+        TEST_CHECK(rb_tree_build(&RbTree, &LeafPointers[0], Count) == OsSuccess, "rb: build %i", Count);
+        TEST_CHECK(CheckRbTree(&RbTree), "rb: invariants broken after building %i", Count);
+        TEST_CHECK(bp_tree_build(&BpTree, &Keys[0], &Keys[0], (size_t)Count) == OsSuccess,
+            "bp: build %i", Count);
+
+        for (int i = 1; i <= Count; i++) {
+            TEST_CHECK(rb_tree_lookup(&RbTree, KEY(i)) == &Leaves[i - 1], "rb: built tree lacks %i", i);
+            TEST_CHECK(bp_tree_lookup_value(&BpTree, KEY(i)) == KEY(i), "bp: built tree lacks %i", i);
+        }
+
+        // Removing every other key exercises the merges of the packed nodes
+        for (int i = 1; i <= Count; i += 2) {
+            TEST_CHECK(bp_tree_remove(&BpTree, KEY(i), NULL) == OsSuccess, "bp: remove %i from build", i);
+        }
+        for (int i = 1; i <= Count; i++) {
+            TEST_CHECK((bp_tree_lookup_value(&BpTree, KEY(i)) != NULL) == ((i % 2) == 0),
+                "bp: built tree has wrong presence of %i", i);
+        }
+        bp_tree_destroy(&BpTree);
+    }
+}
+
+/* BenchmarkTrees
+ * Inserts shuffled keys, then times random lookups and a full in-order scan. The lookup
+ * count is fixed so the small sizes measure the cached case. */
+static void
+BenchmarkTrees(
+    _In_ long Count)
+{
+    rb_leaf_t*         Leaves = malloc((size_t)Count * sizeof(rb_leaf_t));
+    long*              Keys   = malloc((size_t)Count * sizeof(long));
+    long               Lookups = (Count < 1000000) ? 1000000 : Count;
+    volatile long      Sum = 0;
+    rb_tree_t          RbTree;
+    bp_tree_t          BpTree;
+    bp_tree_iterator_t Iterator;
+    rb_leaf_t*         Leaf;
+    OsStatus_t         Status;
+    double             Times[7];
+
+    for (long i = 0; i < Count; i++) {
+        Keys[i] = i + 1;
+    }
+    for (long i = Count - 1; i > 0; i--) {
+        long j = (long)(TestRandom() % (unsigned long long)(i + 1));
+        long Temporary = Keys[i];
+        Keys[i] = Keys[j];
+        Keys[j] = Temporary;
+    }
+
+    rb_tree_construct(&RbTree);
+    bp_tree_construct(&BpTree);
+
+    Times[0] = TestNow();
+    for (long i = 0; i < Count; i++) {
+        RB_LEAF_INIT(&Leaves[i], Keys[i], NULL);
+        rb_tree_append(&RbTree, &Leaves[i]);
+    }
+    Times[1] = TestNow();
+    for (long i = 0; i < Count; i++) {
+        bp_tree_append(&BpTree, KEY(Keys[i]), KEY(Keys[i]));
+    }
+    Times[2] = TestNow();
+    for (long i = 0; i < Lookups; i++) {
+        Sum += (long)(intptr_t)rb_tree_lookup(&RbTree, KEY(1 + (TestRandom() % (unsigned long long)Count)));
+    }
+    Times[3] = TestNow();
+    for (long i = 0; i < Lookups; i++) {
+        Sum += (long)(intptr_t)bp_tree_lookup_value(&BpTree, KEY(1 + (TestRandom() % (unsigned long long)Count)));
+    }
+    Times[4] = TestNow();
+    Leaf = rb_tree_minimum(&RbTree);
+    while (Leaf) {
+        Sum += (long)(intptr_t)Leaf->key;
+        Leaf = rb_tree_next(&RbTree, Leaf);
+    }
+    Times[5] = TestNow();
+    Status = bp_tree_first(&BpTree, &Iterator);
+    while (Status == OsSuccess) {
+        Sum += (long)(intptr_t)Iterator.key;
+        Status = bp_tree_next(&Iterator);
+    }
+    Times[6] = TestNow();
+
+    printf("%8li keys: insert rb %5.0f bp %5.0f ns, lookup rb %5.0f bp %5.0f ns, scan rb %5.1f bp %5.1f ns/key\n",
+        Count,
+        (Times[1] - Times[0]) / (double)Count * 1e9, (Times[2] - Times[1]) / (double)Count * 1e9,
+        (Times[3] - Times[2]) / (double)Lookups * 1e9, (Times[4] - Times[3]) / (double)Lookups * 1e9,
+        (Times[5] - Times[4]) / (double)Count * 1e9, (Times[6] - Times[5]) / (double)Count * 1e9);
+
+    bp_tree_destroy(&BpTree);
+    free(Leaves);
+    free(Keys);
+}
+
+int main(int argc, char** argv)
+{
+    TestRandomOperations(TestScale(argc, argv, 400000));
+    TestBuild();
+    for (long Count = 1000; Count <= 1000000; Count *= 10) {
+        BenchmarkTrees(Count);
+    }
+    TEST_RESULT("rbtree");
+}
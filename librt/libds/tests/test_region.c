@@ -0,0 +1,386 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Memory Region Tests
+ * - Regions are created and grown on a memory model that backs every commit with
+ *   physical pages laid out contiguous, fragmented or scattered. After each step the
+ *   cached scatter-gather list must match the walk of the committed pages that
+ *   MemoryRegionGetSg did before the list was cached, and the cost of count and fill is
+ *   measured against that walk.
+ */
+
+#include <os/osdefs.h>
+#include <os/dmabuf.h>
+#include <handle.h>
+#include <memory_region.h>
+#include <memoryspace.h>
+#include <mutex.h>
+#include <string.h>
+#include "test.h"
+
+#define PAGE_SIZE      0x1000
+#define MAX_PAGES      1024
+#define MAX_HANDLES    64
+#define GROW_ROUNDS    200
+#define BENCH_ROUNDS   2000
+
+typedef enum Layout {
+    LayoutContiguous,
+    LayoutFragmented,
+    LayoutScattered
+} Layout_t;
+
+static const char* LayoutNames[] = { "contiguous", "fragmented", "scattered" };
+static const int   BenchSizes[]  = { 1, 16, 64, 256, 1024 };
+
+typedef struct Handle {
+    HandleDestructorFn Destructor;
+    void*              Resource;
+} Handle_t;
+
+static Handle_t  Handles[MAX_HANDLES];
+static Layout_t  CurrentLayout;
+static uintptr_t NextPage = 0x100000;
+
+// Every page handed to a commit that was not given its pages, in order
+static uintptr_t Committed[MAX_PAGES];
+static int       CommittedCount;
+
+/* NextPhysicalPage
+ * Fragmented memory continues the previous run three times out of four, scattered
+ * memory never does. Runs never meet, so a gap in the addresses is always a new entry. */
+static uintptr_t
+NextPhysicalPage(void)
+{
+    int Continue = (CurrentLayout == LayoutContiguous) ||
+        (CurrentLayout == LayoutFragmented && (TestRandom() & 3) != 0);
+    uintptr_t Page;
+
+    if (!Continue) {
+        NextPage += PAGE_SIZE * (1 + (TestRandom() % 16));
+    }
+    Page      = NextPage;
+    NextPage += PAGE_SIZE;
+    return Page;
+}
+
+size_t GetMemorySpacePageSize(void) { return PAGE_SIZE; }
+SystemMemorySpace_t* GetCurrentMemorySpace(void) { return NULL; }
+
+void
+MutexConstruct(
+    _In_ Mutex_t* Mutex,
+    _In_ Flags_t  Configuration)
+{
+    memset(Mutex, 0, sizeof(Mutex_t));
+    Mutex->Flags = Configuration;
+}
+
+void
+MutexLock(
+    _In_ Mutex_t* Mutex)
+{
+    int Expected = 0;
+    TEST_CHECK(atomic_compare_exchange_strong(&Mutex->Value, &Expected, 1), "region lock taken twice");
+}
+
+void
+MutexUnlock(
+    _In_ Mutex_t* Mutex)
+{
+    atomic_store(&Mutex->Value, 0);
+}
+
+UUId_t
+CreateHandle(
+    _In_ HandleType_t       Type,
+    _In_ HandleDestructorFn Destructor,
+    _In_ void*              Resource)
+{
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (!Handles[i].Resource) {
+            Handles[i].Destructor = Destructor;
+            Handles[i].Resource   = Resource;
+            return (UUId_t)(i + 1);
+        }
+    }
+    return UUID_INVALID;
+}
+
+void*
+AcquireHandle(
+    _In_ UUId_t Handle)
+{
+    return (Handle && Handle <= MAX_HANDLES) ? Handles[Handle - 1].Resource : NULL;
+}
+
+void*
+LookupHandleOfType(
+    _In_ UUId_t       Handle,
+    _In_ HandleType_t Type)
+{
+    return (Type == HandleTypeMemoryRegion) ? AcquireHandle(Handle) : NULL;
+}
+
+static void
+DestroyHandle(
+    _In_ UUId_t Handle)
+{
+    Handles[Handle - 1].Destructor(Handles[Handle - 1].Resource);
+    Handles[Handle - 1].Resource = NULL;
+}
+
+// The kernel mapping is host memory, so reads and writes of the region work, the user
+// mapping is only an address
+OsStatus_t
+MemorySpaceMapReserved(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags)
+{
+    if (PlacementFlags & MAPPING_VIRTUAL_GLOBAL) {
+        *Address = (VirtualAddress_t)aligned_alloc(PAGE_SIZE, Length);
+        return *Address ? OsSuccess : OsOutOfMemory;
+    }
+    *Address = 0x40000000;
+    return OsSuccess;
+}
+
+OsStatus_t
+MemorySpaceMap(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _InOut_ uintptr_t*           PhysicalAddressValues,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags)
+{
+    return MemorySpaceMapReserved(MemorySpace, Address, Length, MemoryFlags, PlacementFlags);
+}
+
+OsStatus_t
+MemorySpaceUnmap(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ size_t               Size)
+{
+    free((void*)Address);
+    return OsSuccess;
+}
+
+OsStatus_t
+MemorySpaceCommit(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ uintptr_t*           PhysicalAddressValues,
+    _In_ size_t               Length,
+    _In_ Flags_t              Placement)
+{
+    int PageCount = (int)DIVUP(Length, PAGE_SIZE);
+
+    if (!(Placement & MAPPING_PHYSICAL_FIXED)) {
+        for (int i = 0; i < PageCount; i++) {
+            PhysicalAddressValues[i]    = NextPhysicalPage();
+            Committed[CommittedCount++] = PhysicalAddressValues[i];
+        }
+    }
+    return OsSuccess;
+}
+
+OsStatus_t
+GetMemorySpaceMapping(
+    _In_  SystemMemorySpace_t* MemorySpace,
+    _In_  VirtualAddress_t     Address,
+    _In_  int                  PageCount,
+    _Out_ uintptr_t*           DmaVectorOut)
+{
+    for (int i = 0; i < PageCount; i++) {
+        DmaVectorOut[i]             = NextPhysicalPage();
+        Committed[CommittedCount++] = DmaVectorOut[i];
+    }
+    return OsSuccess;
+}
+
+/* WalkPages
+ * The walk MemoryRegionGetSg did for every request before the list was cached, a count
+ * pass followed by a fill pass over the pages. */
+static int
+WalkPages(
+    _In_ uintptr_t*     Pages,
+    _In_ int            PageCount,
+    _In_ struct dma_sg* SgList,
+    _In_ int            SgMax)
+{
+    int SgCount = 0;
+
+    for (int i = 0; i < PageCount; i++) {
+        if (i == 0 || (Pages[i - 1] + PAGE_SIZE) != Pages[i]) {
+            SgCount++;
+        }
+    }
+
+    SgCount = MIN(SgCount, SgMax);
+    for (int i = 0, j = 0; (i < SgCount) && (j < PageCount); i++) {
+        struct dma_sg* Sg = &SgList[i];
+
+        Sg->address = Pages[j++];
+        Sg->length  = PAGE_SIZE;
+        while ((j < PageCount) && (Pages[j - 1] + PAGE_SIZE) == Pages[j]) {
+            Sg->length += PAGE_SIZE;
+            j++;
+        }
+    }
+    return SgCount;
+}
+
+static void
+CheckSg(
+    _In_ UUId_t      Handle,
+    _In_ const char* Step)
+{
+    static struct dma_sg Expected[MAX_PAGES];
+    static struct dma_sg Actual[MAX_PAGES];
+    int                  ExpectedCount = WalkPages(&Committed[0], CommittedCount, &Expected[0], MAX_PAGES);
+    int                  Count;
+    size_t               Length = 0;
+
+    TEST_CHECK(MemoryRegionGetSg(Handle, &Count, NULL) == OsSuccess, "%s: count failed", Step);
+    TEST_CHECK(Count == ExpectedCount, "%s: %i entries, the walk found %i", Step, Count, ExpectedCount);
+
+    Count = MAX_PAGES;
+    TEST_CHECK(MemoryRegionGetSg(Handle, &Count, &Actual[0]) == OsSuccess, "%s: fill failed", Step);
+    TEST_CHECK(Count == ExpectedCount, "%s: filled %i entries, the walk found %i", Step, Count, ExpectedCount);
+    for (int i = 0; i < MIN(Count, ExpectedCount); i++) {
+        TEST_CHECK(Actual[i].address == Expected[i].address && Actual[i].length == Expected[i].length,
+            "%s: entry %i is 0x%lx+0x%zx, the walk gave 0x%lx+0x%zx", Step, i, (unsigned long)Actual[i].address,
+            Actual[i].length, (unsigned long)Expected[i].address, Expected[i].length);
+        Length += Actual[i].length;
+    }
+    TEST_CHECK(Length == (size_t)CommittedCount * PAGE_SIZE, "%s: the list covers 0x%zx of 0x%zx bytes",
+        Step, Length, (size_t)CommittedCount * PAGE_SIZE);
+
+    // A shorter list only gets the first entries
+    if (ExpectedCount > 1) {
+        Count = ExpectedCount / 2;
+        TEST_CHECK(MemoryRegionGetSg(Handle, &Count, &Actual[0]) == OsSuccess && Count == (ExpectedCount / 2) &&
+            Actual[0].address == Expected[0].address, "%s: partial fill gave %i entries", Step, Count);
+    }
+}
+
+/* TestGrowth
+ * Creates regions with part of their capacity committed, and grows them a random number
+ * of pages at the time until they are full. */
+static void
+TestGrowth(
+    _In_ Layout_t Layout)
+{
+    char Step[64];
+
+    CurrentLayout = Layout;
+    for (int Round = 0; Round < GROW_ROUNDS; Round++) {
+        int    Capacity = 1 + (int)(TestRandom() % MAX_PAGES);
+        int    Pages    = 1 + (int)(TestRandom() % Capacity);
+        void*  KernelMapping;
+        void*  UserMapping;
+        UUId_t Handle;
+
+        CommittedCount = 0;
+        if (MemoryRegionCreate((size_t)Pages * PAGE_SIZE, (size_t)Capacity * PAGE_SIZE, 0,
+                &KernelMapping, &UserMapping, &Handle) != OsSuccess) {
+            TEST_CHECK(0, "%s: creating a region of %i pages failed", LayoutNames[Layout], Capacity);
+            continue;
+        }
+        snprintf(Step, sizeof(Step), "%s %i of %i pages", LayoutNames[Layout], Pages, Capacity);
+        CheckSg(Handle, Step);
+
+        while (Pages < Capacity) {
+            Pages += 1 + (int)(TestRandom() % (Capacity - Pages));
+            TEST_CHECK(MemoryRegionResize(Handle, UserMapping, (size_t)Pages * PAGE_SIZE) == OsSuccess,
+                "%s: growing to %i pages failed", LayoutNames[Layout], Pages);
+            snprintf(Step, sizeof(Step), "%s grown to %i of %i pages", LayoutNames[Layout], Pages, Capacity);
+            CheckSg(Handle, Step);
+        }
+        DestroyHandle(Handle);
+    }
+}
+
+/* Benchmark
+ * Times a count followed by a fill of a full region, which is what the dma attach of a
+ * driver does, against the two passes of the walk. */
+static void
+Benchmark(
+    _In_ Layout_t Layout)
+{
+    static struct dma_sg SgList[MAX_PAGES];
+    volatile int         Sink = 0;
+
+    CurrentLayout = Layout;
+    printf("%-10s", LayoutNames[Layout]);
+    for (int i = 0; i < (int)SIZEOF_ARRAY(BenchSizes); i++) {
+        void*  KernelMapping;
+        void*  UserMapping;
+        UUId_t Handle;
+        double Start, Cached, Walk;
+
+        CommittedCount = 0;
+        MemoryRegionCreate((size_t)BenchSizes[i] * PAGE_SIZE, (size_t)BenchSizes[i] * PAGE_SIZE, 0,
+            &KernelMapping, &UserMapping, &Handle);
+
+        Start = TestNow();
+        for (int Round = 0; Round < BENCH_ROUNDS; Round++) {
+            int Count;
+            MemoryRegionGetSg(Handle, &Count, NULL);
+            MemoryRegionGetSg(Handle, &Count, &SgList[0]);
+            Sink += Count;
+        }
+        Cached = TestNow() - Start;
+
+        Start = TestNow();
+        for (int Round = 0; Round < BENCH_ROUNDS; Round++) {
+            Sink += WalkPages(&Committed[0], CommittedCount, &SgList[0], MAX_PAGES);
+        }
+        Walk = TestNow() - Start;
+        printf(" %6.0f/%-4.0f", Walk / BENCH_ROUNDS * 1e9, Cached / BENCH_ROUNDS * 1e9);
+        DestroyHandle(Handle);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    long Rounds = TestScale(argc, argv, 1);
+
+    for (long i = 0; i < Rounds; i++) {
+        TestGrowth(LayoutContiguous);
+        TestGrowth(LayoutFragmented);
+        TestGrowth(LayoutScattered);
+    }
+
+    printf("count and fill ns, walk/cached\n%-10s", "");
+    for (int i = 0; i < (int)SIZEOF_ARRAY(BenchSizes); i++) {
+        printf(" %9iKB ", BenchSizes[i] * 4);
+    }
+    printf("\n");
+    Benchmark(LayoutContiguous);
+    Benchmark(LayoutFragmented);
+    Benchmark(LayoutScattered);
+    TEST_RESULT("region");
+}
@@ -0,0 +1,525 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Scheduler Timer Tests
+ * - One core is simulated in nanoseconds, with a local apic timer that counts down in
+ *   one-shot mode. The kernel scheduler and the apic timer handler run unmodified on top
+ *   of it while threads sleep, block and spin, and while other cores and devices send it
+ *   interrupts. Sleeps must never end early, blocked threads must run once they are
+ *   signalled, and a core that has nothing to time must not take timer interrupts. The
+ *   timer interrupts per second and the wakeup accuracy are printed for each workload.
+ */
+
+#include <machine.h>
+#include <apic.h>
+#include <component/domain.h>
+#include <ds/list.h>
+#include <string.h>
+#include "test.h"
+
+#define SIM_SECONDS     60
+#define SIM_QUANTUM     6250    // Apic timer counts per millisecond
+#define SIM_SLEEP_RUN   20000   // Nanoseconds a sleeper runs between two sleeps
+#define SIM_EVENT_RUN   50000   // Nanoseconds a blocked thread runs once it is signalled
+#define SIM_MAX_THREADS 32
+#define SIM_NEVER       UINT64_MAX
+
+// The longest a woken thread waits behind a thread that spins, its time-slice at the
+// lowest level
+#define SIM_MAX_SLICE   ((uint64_t)(SCHEDULER_TIMESLICE_INITIAL + (SCHEDULER_LEVEL_LOW * 2)) * NSEC_PER_MSEC)
+
+enum {
+    SIM_SLEEPER,
+    SIM_BUSY,
+    SIM_EVENT
+};
+
+typedef struct SimThread {
+    MCoreThread_t Thread;
+    int           Kind;
+    uint64_t      RunLeft;
+    int           Waiting;
+    uint64_t      WaitEnd;   // The deadline of the sleep, or when the thread was signalled
+    long          Wakeups;
+    list_t        BlockQueue;
+} SimThread_t;
+
+typedef struct Workload {
+    const char* Name;
+    int         Sleepers;
+    int         Busy;
+    int         Events;
+    int         KicksPerSecond;   // Interrupts on the timer vector sent by other cores
+    int         SignalsPerSecond; // Device interrupts that signal a blocked thread
+} Workload_t;
+
+typedef struct Stats {
+    long     TimerInterrupts;
+    long     Interrupts;
+    long     Sleeps;
+    long     Early;
+    uint64_t LateTotal;
+    uint64_t LateMax;
+    long     Signals;
+    long     Spurious;
+    uint64_t LatencyTotal;
+    uint64_t LatencyMax;
+} Stats_t;
+
+static const Workload_t Workloads[] = {
+    { "idle",          0, 0, 0,   0,   0 },
+    { "kicks",         0, 0, 0, 500,   0 },
+    { "busy",          0, 1, 0,   0,   0 },
+    { "sleep1",        1, 0, 0,   0,   0 },
+    { "sleep16",      16, 0, 0,   0,   0 },
+    { "sleep16+kick", 16, 0, 0, 500,   0 },
+    { "sleep1+busy",   1, 1, 0,   0,   0 },
+    { "sleep16+busy", 16, 1, 0,   0,   0 },
+    { "events+busy",   0, 1, 4,   0, 200 },
+    { "mixed",         8, 1, 4, 500, 200 }
+};
+
+size_t GlbTimerQuantum = SIM_QUANTUM;
+
+static SystemMachine_t Machine;
+static SystemCpuCore_t Core;
+static SimThread_t     Threads[SIM_MAX_THREADS];
+static int             ThreadCount;
+static Stats_t         Stats;
+
+static uint64_t        Now;
+static int             InInterrupt;
+static int             YieldPending;
+static uint32_t        ApicInitial;
+static uint64_t        ApicArmedAt;
+static uint64_t        ApicExpiry = SIM_NEVER;
+
+SystemMachine_t*
+GetMachine(void)
+{
+    return &Machine;
+}
+
+SystemCpuCore_t*
+GetProcessorCore(
+    _In_ UUId_t CoreId)
+{
+    return &Core;
+}
+
+SystemCpuCore_t*
+GetCurrentProcessorCore(void)
+{
+    return &Core;
+}
+
+SystemDomain_t*
+GetCurrentDomain(void)
+{
+    return NULL;
+}
+
+UUId_t
+ArchGetProcessorCoreId(void)
+{
+    return Core.Id;
+}
+
+void
+ArchStallProcessorCore(
+    _In_ size_t Milliseconds)
+{
+    // Only the idle thread stalls, and it never sleeps here
+    TEST_CHECK(0, "the idle thread stalled for %zu ms", Milliseconds);
+}
+
+OsStatus_t
+TxuMessageSend(
+    _In_ UUId_t                  CoreId,
+    _In_ SystemCpuFunctionType_t Type,
+    _In_ TxuFunction_t           Function,
+    _In_ void*                   Argument,
+    _In_ int                     Asynchronous)
+{
+    // Every object is on the only core, so nothing is ever sent
+    TEST_CHECK(0, "a message was sent to core %u", CoreId);
+    return OsError;
+}
+
+OsStatus_t
+TimersGetSystemTick(
+    _Out_ clock_t* SystemTick)
+{
+    *SystemTick = (clock_t)(Now / NSEC_PER_MSEC);
+    return OsSuccess;
+}
+
+void
+IrqSpinlockAcquire(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_acquire(&Spinlock->SyncObject);
+}
+
+void
+IrqSpinlockRelease(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_release(&Spinlock->SyncObject);
+}
+
+int
+ThreadingIsCurrentTaskIdle(
+    _In_ UUId_t CoreId)
+{
+    return (Core.CurrentThread->Flags & THREADING_IDLE) ? 1 : 0;
+}
+
+/* ThreadingAdvance
+ * The part of the kernel thread switch that involves the scheduler, the idle thread is
+ * not known by the scheduler and runs when it has nothing else. */
+OsStatus_t
+ThreadingAdvance(
+    _In_  int       Preemptive,
+    _In_  uint64_t  NanosecondsPassed,
+    _Out_ uint64_t* NextDeadlineOut)
+{
+    MCoreThread_t* Current = Core.CurrentThread;
+    MCoreThread_t* NextThread;
+
+    NextThread = (MCoreThread_t*)SchedulerAdvance((Current->Flags & THREADING_IDLE) ?
+        NULL : Current->SchedulerObject, Preemptive, NanosecondsPassed, NextDeadlineOut);
+    Core.CurrentThread = (NextThread != NULL) ? NextThread : &Core.IdleThread;
+    return OsSuccess;
+}
+
+/* ApicReadLocal
+ * The timer counts down from the initial count and stops at 0, the initial count is
+ * kept until it is written again. */
+uint32_t
+ApicReadLocal(
+    _In_ size_t Register)
+{
+    uint64_t Counts;
+
+    if (Register == APIC_INITIAL_COUNT) {
+        return ApicInitial;
+    }
+
+    if (ApicInitial == 0) {
+        return 0;
+    }
+    Counts = ((Now - ApicArmedAt) * SIM_QUANTUM) / NSEC_PER_MSEC;
+    return (Counts >= ApicInitial) ? 0 : ApicInitial - (uint32_t)Counts;
+}
+
+void
+ApicWriteLocal(
+    _In_ size_t   Register,
+    _In_ uint32_t Value)
+{
+    uint64_t Nanoseconds = (uint64_t)Value * NSEC_PER_MSEC;
+
+    // Writing the initial count restarts the timer, 0 stops it
+    TEST_CHECK(Register == APIC_INITIAL_COUNT, "write to apic register 0x%zx", Register);
+    ApicInitial = Value;
+    ApicArmedAt = Now;
+    ApicExpiry  = (Value != 0) ? Now + (Nanoseconds + SIM_QUANTUM - 1) / SIM_QUANTUM : SIM_NEVER;
+}
+
+// A thread returns from its sleep or block when the core runs it again
+static void
+ThreadResumed(void)
+{
+    SimThread_t* Thread = (SimThread_t*)Core.CurrentThread;
+
+    if ((Core.CurrentThread->Flags & THREADING_IDLE) || !Thread->Waiting) {
+        return;
+    }
+
+    Thread->Waiting = 0;
+    Thread->Wakeups++;
+    if (Thread->Kind == SIM_SLEEPER) {
+        Thread->RunLeft = SIM_SLEEP_RUN;
+        Stats.Sleeps++;
+        if (Now < Thread->WaitEnd) {
+            Stats.Early++;
+        }
+        else {
+            Stats.LateTotal += Now - Thread->WaitEnd;
+            Stats.LateMax    = MAX(Stats.LateMax, Now - Thread->WaitEnd);
+        }
+    }
+    else {
+        Thread->RunLeft = SIM_EVENT_RUN;
+        if (Thread->WaitEnd == SIM_NEVER) {
+            Stats.Spurious++;
+        }
+        else {
+            Stats.LatencyTotal += Now - Thread->WaitEnd;
+            Stats.LatencyMax    = MAX(Stats.LatencyMax, Now - Thread->WaitEnd);
+        }
+    }
+}
+
+// The timer vector, and the yields that were flagged by the handlers that ran before
+static void
+TimerVector(void)
+{
+    do {
+        YieldPending = 0;
+        InInterrupt  = 1;
+        Stats.Interrupts++;
+        ApicTimerHandler(NULL, NULL);
+        InInterrupt  = 0;
+    } while (YieldPending);
+    ThreadResumed();
+}
+
+/* ThreadingYield
+ * Outside interrupts the yield is a software interrupt on the timer vector, inside them
+ * a core that has no time-slice armed sends the vector to itself. */
+void
+ThreadingYield(void)
+{
+    if (InInterrupt) {
+        if (ThreadingIsCurrentTaskIdle(Core.Id) || Core.Scheduler.Tickless) {
+            YieldPending = 1;
+        }
+    }
+    else {
+        TimerVector();
+    }
+}
+
+static void
+DeviceInterrupt(
+    _In_ SimThread_t* Thread)
+{
+    element_t* Element;
+
+    InInterrupt = 1;
+    Element     = list_front(&Thread->BlockQueue);
+    if (Element != NULL) {
+        list_remove(&Thread->BlockQueue, Element);
+        Thread->WaitEnd = Now;
+        Stats.Signals++;
+        SchedulerQueueObject(Element->value);
+    }
+    InInterrupt = 0;
+
+    if (YieldPending) {
+        TimerVector();
+    }
+}
+
+// The running thread is done with its work, and sleeps or blocks until it is signalled
+static void
+ThreadWait(
+    _In_ SimThread_t* Thread)
+{
+    clock_t InterruptedAt;
+
+    Thread->Waiting = 1;
+    if (Thread->Kind == SIM_SLEEPER) {
+        uint64_t Duration = (1 + (TestRandom() % 100)) * NSEC_PER_MSEC;
+        Thread->WaitEnd = Now + Duration;
+        (void)SchedulerSleep(Duration, &InterruptedAt);
+    }
+    else {
+        Thread->WaitEnd = SIM_NEVER;
+        SchedulerBlock(&Thread->BlockQueue, SCHEDULER_TIMEOUT_INFINITE);
+        ThreadingYield();
+    }
+}
+
+static void
+CreateSimThread(
+    _In_ int Kind)
+{
+    SimThread_t* Thread = &Threads[ThreadCount++];
+
+    memset(Thread, 0, sizeof(SimThread_t));
+    list_construct(&Thread->BlockQueue);
+    Thread->Kind                   = Kind;
+    Thread->RunLeft                = (Kind == SIM_SLEEPER) ? SIM_SLEEP_RUN : SIM_EVENT_RUN;
+    Thread->Thread.Name            = "sim";
+    Thread->Thread.SchedulerObject = SchedulerCreateObject(&Thread->Thread, 0);
+    TEST_CHECK(Thread->Thread.SchedulerObject != NULL, "no scheduler object");
+    SchedulerQueueObject(Thread->Thread.SchedulerObject);
+}
+
+static void
+ResetCore(void)
+{
+    for (int i = 0; i < ThreadCount; i++) {
+        SchedulerDestroyObject(Threads[i].Thread.SchedulerObject);
+    }
+    ThreadCount = 0;
+
+    memset(&Core, 0, sizeof(SystemCpuCore_t));
+    memset(&Stats, 0, sizeof(Stats_t));
+    Core.State            = CpuStateRunning;
+    Core.IdleThread.Name  = "idle";
+    Core.IdleThread.Flags = THREADING_IDLE;
+    Core.CurrentThread    = &Core.IdleThread;
+    Machine.Processor.NumberOfCores = 1;
+    Machine.Processor.Cores         = &Core;
+
+    Now          = 0;
+    InInterrupt  = 0;
+    YieldPending = 0;
+    ApicInitial  = 0;
+    ApicExpiry   = SIM_NEVER;
+}
+
+// Interrupts from outside arrive at random, at the given rate on average
+static uint64_t
+NextArrival(
+    _In_ int PerSecond)
+{
+    uint64_t Mean = ((uint64_t)MSEC_PER_SEC * NSEC_PER_MSEC) / PerSecond;
+    return (PerSecond != 0) ? Now + 1 + (TestRandom() % (2 * Mean)) : SIM_NEVER;
+}
+
+static void
+RunWorkload(
+    _In_ const Workload_t* Workload)
+{
+    uint64_t End        = (uint64_t)SIM_SECONDS * MSEC_PER_SEC * NSEC_PER_MSEC;
+    uint64_t NextKick   = SIM_NEVER;
+    uint64_t NextSignal = SIM_NEVER;
+    uint64_t LateBound;
+    int      FirstEvent;
+
+    ResetCore();
+    for (int i = 0; i < Workload->Busy; i++) {
+        CreateSimThread(SIM_BUSY);
+    }
+    for (int i = 0; i < Workload->Sleepers; i++) {
+        CreateSimThread(SIM_SLEEPER);
+    }
+    FirstEvent = ThreadCount;
+    for (int i = 0; i < Workload->Events; i++) {
+        CreateSimThread(SIM_EVENT);
+    }
+
+    if (Workload->KicksPerSecond) {
+        NextKick = NextArrival(Workload->KicksPerSecond);
+    }
+    if (Workload->SignalsPerSecond) {
+        NextSignal = NextArrival(Workload->SignalsPerSecond);
+    }
+
+    while (1) {
+        SimThread_t* Running = (SimThread_t*)Core.CurrentThread;
+        uint64_t     Next    = ApicExpiry;
+        int          Event   = 0;
+
+        if (Core.CurrentThread->Flags & THREADING_IDLE) {
+            Running = NULL;
+        }
+
+        // The timer wins ties, it fires before anything else can happen at that time
+        if (NextKick < Next)   { Next = NextKick;   Event = 1; }
+        if (NextSignal < Next) { Next = NextSignal; Event = 2; }
+        if (Running != NULL && Running->Kind != SIM_BUSY && Now + Running->RunLeft < Next) {
+            Next  = Now + Running->RunLeft;
+            Event = 3;
+        }
+        if (Next >= End) {
+            break;
+        }
+
+        if (Running != NULL && Running->Kind != SIM_BUSY) {
+            Running->RunLeft -= Next - Now;
+        }
+        Now = Next;
+
+        if (Event == 0) {
+            ApicExpiry = SIM_NEVER;
+            Stats.TimerInterrupts++;
+            TimerVector();
+        }
+        else if (Event == 1) {
+            NextKick = NextArrival(Workload->KicksPerSecond);
+            TimerVector();
+        }
+        else if (Event == 2) {
+            NextSignal = NextArrival(Workload->SignalsPerSecond);
+            DeviceInterrupt(&Threads[FirstEvent + (TestRandom() % Workload->Events)]);
+        }
+        else {
+            ThreadWait(Running);
+        }
+    }
+
+    printf("%-13s %7.1f timer irq/s %7.1f irq/s", Workload->Name,
+        (double)Stats.TimerInterrupts / SIM_SECONDS, (double)Stats.Interrupts / SIM_SECONDS);
+    if (Stats.Sleeps) {
+        printf(", %6li sleeps late %4.0f us mean %5.0f us max", Stats.Sleeps,
+            (double)Stats.LateTotal / Stats.Sleeps / 1000.0, (double)Stats.LateMax / 1000.0);
+    }
+    if (Stats.Signals) {
+        printf(", %5li signals run after %4.0f us mean %6.0f us max", Stats.Signals,
+            (double)Stats.LatencyTotal / Stats.Signals / 1000.0, (double)Stats.LatencyMax / 1000.0);
+    }
+    printf("\n");
+
+    // A core with nothing to time never takes a timer interrupt, not even while a
+    // thread spins on it alone
+    if (Workload->Sleepers == 0 && Workload->Events == 0) {
+        TEST_CHECK(Stats.TimerInterrupts == 0, "%s: %li timer interrupts",
+            Workload->Name, Stats.TimerInterrupts);
+    }
+
+    // Sleeps end within their slack, after the sleepers that woke at the same time ran.
+    // Behind a spinning thread they also wait for its time-slice
+    LateBound = SCHEDULER_SLACK_MAX + ((uint64_t)Workload->Sleepers * SIM_SLEEP_RUN) +
+        (Workload->Events * SIM_EVENT_RUN) + (Workload->Busy ? SIM_MAX_SLICE : 0) + 1000;
+    TEST_CHECK(Stats.Early == 0, "%s: %li of %li sleeps ended early",
+        Workload->Name, Stats.Early, Stats.Sleeps);
+    TEST_CHECK(Stats.LateMax <= LateBound, "%s: a sleep ended %llu ns late",
+        Workload->Name, (unsigned long long)Stats.LateMax);
+    TEST_CHECK(Stats.Spurious == 0, "%s: %li blocked threads ran without a signal",
+        Workload->Name, Stats.Spurious);
+    TEST_CHECK(Stats.LatencyMax <= LateBound, "%s: a signalled thread ran %llu ns late",
+        Workload->Name, (unsigned long long)Stats.LatencyMax);
+
+    // The clock of the scheduler only advances by the time the timer counted
+    TEST_CHECK(Core.Scheduler.Clock <= Now, "%s: scheduler clock %llu ahead of %llu",
+        Workload->Name, (unsigned long long)Core.Scheduler.Clock, (unsigned long long)Now);
+
+    // Every sleeper keeps sleeping, at most 100 ms and the bound at a time
+    for (int i = 0; i < ThreadCount; i++) {
+        if (Threads[i].Kind == SIM_SLEEPER) {
+            long Minimum = (long)(End / ((100 * NSEC_PER_MSEC) + LateBound));
+            TEST_CHECK(Threads[i].Wakeups >= Minimum, "%s: sleeper %i woke %li times",
+                Workload->Name, i, Threads[i].Wakeups);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 0; i < SIZEOF_ARRAY(Workloads); i++) {
+        RunWorkload(&Workloads[i]);
+    }
+    TEST_RESULT("scheduler");
+}
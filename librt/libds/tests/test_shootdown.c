@@ -0,0 +1,366 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * TLB Shootdown Tests
+ * - The kernel tlb tracking is run by simulated cores that switch between memory space
+ *   families and cache translations of their pages, while other threads change the
+ *   pages and send shootdowns the way SendShootdown does. The cores handle them the way
+ *   MemorySynchronizationHandler does. A core must never use a translation that is older
+ *   than a shootdown that has completed, also when the shootdown skipped it because it
+ *   switched family at the same time.
+ */
+
+#include <memory_tlb.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <string.h>
+#include "test.h"
+
+#define CORE_COUNT     4
+#define SENDER_COUNT   2
+#define FAMILY_COUNT   3
+#define PAGE_COUNT     16
+#define FLUSH_PAGES    4
+
+struct SystemMemorySpaceContext {
+    _Atomic(unsigned int) TlbGeneration;
+    _Atomic(unsigned int) Tables[PAGE_COUNT];    // The version of every page mapping
+    _Atomic(unsigned int) Completed[PAGE_COUNT]; // The newest version a shootdown has completed for
+};
+
+typedef struct Shootdown {
+    struct SystemMemorySpaceContext* Family;
+    int                              FullFlush;
+    unsigned int                     Pages;
+    unsigned int                     Generation;
+    _Atomic(int)                     CallsCompleted;
+} Shootdown_t;
+
+typedef struct Core {
+    MemorySpaceTlb_t                 Tlb;
+    struct SystemMemorySpaceContext* Loaded;
+    int                              Valid[PAGE_COUNT];
+    unsigned int                     Cached[PAGE_COUNT];
+    _Atomic(Shootdown_t*)            Inbox[SENDER_COUNT];
+    unsigned long long               Random;
+
+    long Accesses;
+    long Switches;
+    long Flushes;
+    long LazySkips;
+    long StaleSkips;
+    long Violations;
+} Core_t;
+
+typedef struct Sender {
+    int                Index;
+    long               Shootdowns;
+    unsigned long long Random;
+
+    long Interrupts;
+    long LazySkips;
+    long RacingSkips;
+} Sender_t;
+
+static struct SystemMemorySpaceContext Families[FAMILY_COUNT];
+static Core_t                          Cores[CORE_COUNT];
+static _Atomic(int)                    Stop;
+
+static unsigned long long
+NextRandom(
+    _In_ unsigned long long* State)
+{
+    *State ^= *State << 13;
+    *State ^= *State >> 7;
+    *State ^= *State << 17;
+    return *State;
+}
+
+/* HandleShootdown
+ * The handler side, mirrors MemorySynchronizationHandler. */
+static void
+HandleShootdown(
+    _In_ Core_t*      Core,
+    _In_ Shootdown_t* Shootdown)
+{
+    switch (MemoryTlbCheck(&Core->Tlb, Shootdown->Family, Shootdown->Generation)) {
+        case MEMORY_TLB_SKIP_LAZY:
+            Core->LazySkips++;
+            break;
+        case MEMORY_TLB_SKIP_STALE:
+            Core->StaleSkips++;
+            break;
+        default:
+            Core->Flushes++;
+            for (int i = 0; i < PAGE_COUNT; i++) {
+                if (Shootdown->FullFlush || (Shootdown->Pages & (1U << i))) {
+                    Core->Valid[i] = 0;
+                }
+            }
+            if (Shootdown->FullFlush && Shootdown->Family != NULL) {
+                MemoryTlbFlushed(&Core->Tlb, Shootdown->Generation);
+            }
+            break;
+    }
+    atomic_fetch_add(&Shootdown->CallsCompleted, 1);
+}
+
+/* SwitchFamily
+ * Mirrors SwitchMemorySpace, the family is published before the tlb is reloaded. */
+static void
+SwitchFamily(
+    _In_ Core_t*                          Core,
+    _In_ struct SystemMemorySpaceContext* Family)
+{
+    MemoryTlbLoad(&Core->Tlb, Family, (Family != NULL) ? &Family->TlbGeneration : NULL);
+    memset(&Core->Valid[0], 0, sizeof(Core->Valid));
+    Core->Loaded = Family;
+    Core->Switches++;
+}
+
+/* AccessPage
+ * Translations are filled from the tables on a miss, and a translation that is still
+ * cached must not be older than the newest completed shootdown of the page. */
+static void
+AccessPage(
+    _In_ Core_t* Core,
+    _In_ int     Page)
+{
+    struct SystemMemorySpaceContext* Family = Core->Loaded;
+    unsigned int                     Completed;
+
+    if (!Core->Valid[Page]) {
+        Core->Cached[Page] = atomic_load(&Family->Tables[Page]);
+        Core->Valid[Page]  = 1;
+    }
+
+    Completed = atomic_load(&Family->Completed[Page]);
+    if ((int)(Core->Cached[Page] - Completed) < 0) {
+        Core->Violations++;
+    }
+    Core->Accesses++;
+}
+
+static void*
+CoreMain(
+    _In_ void* Argument)
+{
+    Core_t* Core = (Core_t*)Argument;
+
+    while (!atomic_load(&Stop)) {
+        unsigned long long Value = NextRandom(&Core->Random);
+
+        // Interrupts are taken between instructions, but not always right away, so the
+        // core can switch family before it sees the shootdown
+        if ((Value % 4) != 0) {
+            for (int i = 0; i < SENDER_COUNT; i++) {
+                Shootdown_t* Shootdown = atomic_exchange(&Core->Inbox[i], NULL);
+                if (Shootdown != NULL) {
+                    HandleShootdown(Core, Shootdown);
+                }
+            }
+        }
+
+        if ((Value % 16) == 0) {
+            int Family = (int)((Value >> 8) % (FAMILY_COUNT + 1));
+            SwitchFamily(Core, (Family == FAMILY_COUNT) ? NULL : &Families[Family]);
+        }
+        else if (Core->Loaded != NULL) {
+            AccessPage(Core, (int)((Value >> 8) % PAGE_COUNT));
+        }
+        if ((Value % 64) == 1) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* SenderMain
+ * Mirrors SynchronizeMemoryRegion and SendShootdown, the tables are updated before the
+ * generation is issued and the cores are checked. */
+static void*
+SenderMain(
+    _In_ void* Argument)
+{
+    Sender_t*    Sender = (Sender_t*)Argument;
+    Shootdown_t  Shootdown;
+    unsigned int Versions[PAGE_COUNT];
+    unsigned int Skipped;
+    int          Targets;
+
+    for (long i = 0; i < Sender->Shootdowns; i++) {
+        unsigned long long Value = NextRandom(&Sender->Random);
+        int                Count = 1 + (int)((Value >> 8) % (FLUSH_PAGES * 2));
+
+        memset(&Shootdown, 0, sizeof(Shootdown));
+        Shootdown.Family    = &Families[Value % FAMILY_COUNT];
+        Shootdown.FullFlush = Count > FLUSH_PAGES;
+        for (int j = 0; j < Count; j++) {
+            int Page = (int)(NextRandom(&Sender->Random) % PAGE_COUNT);
+            if (!(Shootdown.Pages & (1U << Page))) {
+                Shootdown.Pages |= (1U << Page);
+                Versions[Page] = atomic_fetch_add(&Shootdown.Family->Tables[Page], 1) + 1;
+            }
+        }
+
+        Shootdown.Generation = MemoryTlbIssue(&Shootdown.Family->TlbGeneration);
+        Targets = 0;
+        Skipped = 0;
+        for (int j = 0; j < CORE_COUNT; j++) {
+            if (!MemoryTlbIsTarget(&Cores[j].Tlb, Shootdown.Family)) {
+                Sender->LazySkips++;
+                Skipped |= (1U << j);
+                continue;
+            }
+            atomic_store(&Cores[j].Inbox[Sender->Index], &Shootdown);
+            Targets++;
+        }
+        Sender->Interrupts += Targets;
+
+        while (atomic_load(&Shootdown.CallsCompleted) != Targets) {
+            sched_yield();
+        }
+
+        // Count the cores that were skipped but have the family loaded by now, they
+        // switched while the shootdown was sent and rely on the reload
+        for (int j = 0; j < CORE_COUNT; j++) {
+            if ((Skipped & (1U << j)) && atomic_load(&Cores[j].Tlb.Family) == Shootdown.Family) {
+                Sender->RacingSkips++;
+            }
+        }
+
+        for (int Page = 0; Page < PAGE_COUNT; Page++) {
+            if (Shootdown.Pages & (1U << Page)) {
+                unsigned int Completed = atomic_load(&Shootdown.Family->Completed[Page]);
+                while ((int)(Versions[Page] - Completed) > 0 &&
+                    !atomic_compare_exchange_weak(&Shootdown.Family->Completed[Page], &Completed, Versions[Page]));
+            }
+        }
+
+        // Give the cores time to run between the shootdowns
+        for (int j = 0; j < (int)(Value % 4); j++) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* TestDecisions
+ * The single core decisions, including a generation that wraps. */
+static void
+TestDecisions(void)
+{
+    struct SystemMemorySpaceContext Family = { 0 };
+    struct SystemMemorySpaceContext Other  = { 0 };
+    MemorySpaceTlb_t                Tlb    = { 0 };
+    unsigned int                    Generation;
+
+    atomic_store(&Family.TlbGeneration, UINT_MAX - 1);
+    MemoryTlbLoad(&Tlb, &Family, &Family.TlbGeneration);
+    TEST_CHECK(MemoryTlbIsTarget(&Tlb, &Family), "loaded family is not a target");
+    TEST_CHECK(!MemoryTlbIsTarget(&Tlb, &Other), "other family is a target");
+    TEST_CHECK(MemoryTlbIsTarget(&Tlb, NULL), "global shootdown is not a target");
+
+    Generation = MemoryTlbIssue(&Family.TlbGeneration);
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, Generation) == MEMORY_TLB_FLUSH, "new generation skipped");
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Other, Generation) == MEMORY_TLB_SKIP_LAZY, "other family flushed");
+    TEST_CHECK(MemoryTlbCheck(&Tlb, NULL, 0) == MEMORY_TLB_FLUSH, "global shootdown skipped");
+
+    // Issue past the wrap, a reload in between covers the older generations
+    Generation = MemoryTlbIssue(&Family.TlbGeneration);
+    TEST_CHECK(Generation == 0, "generation did not wrap (%u)", Generation);
+    MemoryTlbLoad(&Tlb, &Family, &Family.TlbGeneration);
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, UINT_MAX) == MEMORY_TLB_SKIP_STALE, "generation before the wrap flushed");
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, 0) == MEMORY_TLB_SKIP_STALE, "reloaded generation flushed");
+
+    Generation = MemoryTlbIssue(&Family.TlbGeneration);
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, Generation) == MEMORY_TLB_FLUSH, "generation after the wrap skipped");
+    MemoryTlbFlushed(&Tlb, Generation);
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, Generation) == MEMORY_TLB_SKIP_STALE, "flushed generation flushed again");
+
+    // Kernel spaces have no family and keep the generation of the last family
+    MemoryTlbLoad(&Tlb, NULL, NULL);
+    TEST_CHECK(!MemoryTlbIsTarget(&Tlb, &Family), "kernel space is a family target");
+    TEST_CHECK(MemoryTlbCheck(&Tlb, &Family, Generation + 1) == MEMORY_TLB_SKIP_LAZY, "kernel space flushed a family");
+}
+
+/* TestRacingCores
+ * Cores switch and access pages while the senders shoot down. */
+static void
+TestRacingCores(
+    _In_ long Shootdowns)
+{
+    pthread_t CoreThreads[CORE_COUNT];
+    pthread_t SenderThreads[SENDER_COUNT];
+    Sender_t  Senders[SENDER_COUNT];
+    long      Accesses = 0, Switches = 0, Flushes = 0, Violations = 0;
+    long      HandlerLazy = 0, HandlerStale = 0;
+    long      Interrupts = 0, LazySkips = 0, RacingSkips = 0;
+
+    memset(&Families[0], 0, sizeof(Families));
+    memset(&Cores[0], 0, sizeof(Cores));
+    atomic_store(&Stop, 0);
+
+    for (int i = 0; i < CORE_COUNT; i++) {
+        Cores[i].Random = TestRandom();
+        pthread_create(&CoreThreads[i], NULL, CoreMain, &Cores[i]);
+    }
+    for (int i = 0; i < SENDER_COUNT; i++) {
+        memset(&Senders[i], 0, sizeof(Sender_t));
+        Senders[i].Index      = i;
+        Senders[i].Shootdowns = Shootdowns;
+        Senders[i].Random     = TestRandom();
+        pthread_create(&SenderThreads[i], NULL, SenderMain, &Senders[i]);
+    }
+
+    for (int i = 0; i < SENDER_COUNT; i++) {
+        pthread_join(SenderThreads[i], NULL);
+        Interrupts  += Senders[i].Interrupts;
+        LazySkips   += Senders[i].LazySkips;
+        RacingSkips += Senders[i].RacingSkips;
+    }
+    atomic_store(&Stop, 1);
+    for (int i = 0; i < CORE_COUNT; i++) {
+        pthread_join(CoreThreads[i], NULL);
+        Accesses     += Cores[i].Accesses;
+        Switches     += Cores[i].Switches;
+        Flushes      += Cores[i].Flushes;
+        HandlerLazy  += Cores[i].LazySkips;
+        HandlerStale += Cores[i].StaleSkips;
+        Violations   += Cores[i].Violations;
+    }
+
+    TEST_CHECK(Violations == 0, "%li accesses used a translation older than a completed shootdown", Violations);
+    TEST_CHECK(Interrupts == Flushes + HandlerLazy + HandlerStale, "%li interrupts, %li handled",
+        Interrupts, Flushes + HandlerLazy + HandlerStale);
+    printf("%li shootdowns: %li interrupts (%li flushed, %li lazy and %li stale in the handler), %li cores skipped\n",
+        Shootdowns * SENDER_COUNT, Interrupts, Flushes, HandlerLazy, HandlerStale, LazySkips);
+    printf("%li switches, %li accesses, %li skipped cores switched to the family during the shootdown\n",
+        Switches, Accesses, RacingSkips);
+}
+
+int main(int argc, char** argv)
+{
+    long Shootdowns = TestScale(argc, argv, 20000);
+
+    TestDecisions();
+    TestRacingCores(Shootdowns);
+    TEST_RESULT("shootdown");
+}
@@ -0,0 +1,474 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * System Page Tests
+ * - The kernel side of the system page runs on a host thread that updates it every tick,
+ *   the page is shared with the libc side through a read-only alias, like the mapping
+ *   the kernel makes into every application. Readers must never see the monotonic time
+ *   step back or a snapshot from two updates, the epoch seconds must match timegm, and
+ *   the cost of a clock read is measured against the system calls the page replaced.
+ *   The system calls are modelled as one Linux system call, which costs less than the
+ *   system call entry of the kernel.
+ */
+
+#define _GNU_SOURCE
+#include <os/osdefs.h>
+#include <os/mollenos.h>
+#include <internal/_ipc.h>
+#include <internal/_syscalls.h>
+#include <internal/_utils.h>
+#include <arch/time.h>
+#include <irq_spinlock.h>
+#include <machine.h>
+#include <memoryspace.h>
+#include <system_page.h>
+#include <timers.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "test.h"
+
+#define PAGE_SIZE      0x1000
+#define READERS        2
+#define EPOCH_ROUNDS   20000
+#define READ_SECONDS   2
+#define TSC_SLACK_NS   50000
+
+static SystemMachine_t Machine;
+static _Atomic(int)    WriterStop;
+static uint64_t        StartNs;
+static void*           KernelPage;
+static void*           UserPage;
+
+typedef struct Reader {
+    pthread_t Thread;
+    uint64_t  Reads;
+    uint64_t  Backwards;
+    uint64_t  Torn;
+    uint64_t  Ahead;
+    uint64_t  SubTick;
+} Reader_t;
+
+static uint64_t
+HostNs(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return ((uint64_t)Now.tv_sec * NSEC_PER_SEC) + (uint64_t)Now.tv_nsec;
+}
+
+SystemMachine_t* GetMachine(void) { return &Machine; }
+SystemMemorySpace_t* GetCurrentMemorySpace(void) { return NULL; }
+size_t GetMemorySpacePageSize(void) { return PAGE_SIZE; }
+
+void
+IrqSpinlockAcquire(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_acquire(&Spinlock->SyncObject);
+}
+
+void
+IrqSpinlockRelease(
+    _In_ IrqSpinlock_t* Spinlock)
+{
+    spinlock_release(&Spinlock->SyncObject);
+}
+
+// The system tick is a millisecond since the test started, like the kernel counts it
+OsStatus_t
+TimersGetSystemTick(
+    _Out_ clock_t* SystemTick)
+{
+    *SystemTick = (clock_t)((HostNs() - StartNs) / (NSEC_PER_SEC / CLOCKS_PER_SEC));
+    return OsSuccess;
+}
+
+OsStatus_t
+ArchGetTimestampCounter(
+    _Out_ uint64_t* Value)
+{
+#if defined(i386) || defined(__i386__) || defined(amd64) || defined(__amd64__)
+    *Value = __builtin_ia32_rdtsc();
+    return OsSuccess;
+#else
+    return OsNotSupported;
+#endif
+}
+
+// The page is one shared memory page, the kernel writes through one mapping and the
+// application reads through a read-only one, so a write from the libc would fault
+OsStatus_t
+MemorySpaceMap(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _InOut_ uintptr_t*           PhysicalAddressValues,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags)
+{
+    int Fd = memfd_create("syspage", 0);
+    if (Fd < 0 || ftruncate(Fd, (off_t)Length)) {
+        return OsOutOfMemory;
+    }
+
+    KernelPage = mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+    UserPage   = mmap(NULL, Length, PROT_READ, MAP_SHARED, Fd, 0);
+    close(Fd);
+    if (KernelPage == MAP_FAILED || UserPage == MAP_FAILED) {
+        return OsOutOfMemory;
+    }
+    *Address               = (VirtualAddress_t)KernelPage;
+    *PhysicalAddressValues = (uintptr_t)KernelPage;
+    return OsSuccess;
+}
+
+OsStatus_t
+MemorySpaceMapContiguous(
+    _In_    SystemMemorySpace_t* MemorySpace,
+    _InOut_ VirtualAddress_t*    Address,
+    _In_    uintptr_t            PhysicalStartAddress,
+    _In_    size_t               Length,
+    _In_    Flags_t              MemoryFlags,
+    _In_    Flags_t              PlacementFlags)
+{
+    TEST_CHECK(PhysicalStartAddress == (uintptr_t)KernelPage, "the page was mapped from 0x%lx",
+        (unsigned long)PhysicalStartAddress);
+    TEST_CHECK((MemoryFlags & MAPPING_READONLY) && (MemoryFlags & MAPPING_USERSPACE),
+        "the page was mapped with flags 0x%x", (unsigned int)MemoryFlags);
+    *Address = (VirtualAddress_t)UserPage;
+    return OsSuccess;
+}
+
+// The libc system interface, only the page and the clocks it replaced are modelled
+OsStatus_t
+Syscall_SystemPage(
+    _In_ VirtualAddress_t* Address)
+{
+    return SystemPageMap(GetCurrentMemorySpace(), Address);
+}
+
+OsStatus_t
+Syscall_SystemTick(
+    _In_ int              TickBase,
+    _In_ LargeUInteger_t* Tick)
+{
+    struct timespec Now;
+    syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &Now);
+    Tick->QuadPart = ((((uint64_t)Now.tv_sec * NSEC_PER_SEC) + (uint64_t)Now.tv_nsec) - StartNs) /
+        (NSEC_PER_SEC / CLOCKS_PER_SEC);
+    return OsSuccess;
+}
+
+OsStatus_t
+Syscall_SystemTime(
+    _In_ SystemTime_t* Time)
+{
+    struct timespec Now;
+    syscall(SYS_clock_gettime, CLOCK_REALTIME, &Now);
+    memcpy(Time, &Machine.SystemTime, sizeof(SystemTime_t));
+    return OsSuccess;
+}
+
+OsStatus_t Syscall_SystemQuery(SystemDescriptor_t* Descriptor) { return OsNotSupported; }
+OsStatus_t Syscall_SystemPerformanceFrequency(LargeInteger_t* Frequency) { return OsNotSupported; }
+OsStatus_t Syscall_SystemPerformanceTime(LargeInteger_t* Value) { return OsNotSupported; }
+OsStatus_t Syscall_FlushHardwareCache(int Cache, void* Start, size_t Length) { return OsNotSupported; }
+
+OsStatus_t
+Syscall_SystemLogRead(
+    _In_ size_t* Cursor,
+    _In_ char*   Buffer,
+    _In_ size_t  Length,
+    _In_ size_t* BytesRead)
+{
+    return OsNotSupported;
+}
+
+int IsProcessModule(void) { return 1; }
+UUId_t GetProcessService(void) { return UUID_INVALID; }
+UUId_t ProcessGetCurrentId(void) { return 1; }
+
+int
+svc_process_get_tick_base(
+    _In_  void*                     Client,
+    _In_  struct vali_link_message* Message,
+    _In_  UUId_t                    Handle,
+    _Out_ OsStatus_t*               Status,
+    _Out_ unsigned int*             TickLow,
+    _Out_ unsigned int*             TickHigh)
+{
+    *Status = OsNotSupported;
+    return 0;
+}
+
+static void
+SetSystemTime(
+    _In_ time_t Seconds)
+{
+    struct tm Time;
+    gmtime_r(&Seconds, &Time);
+    Machine.SystemTime.Second     = Time.tm_sec;
+    Machine.SystemTime.Minute     = Time.tm_min;
+    Machine.SystemTime.Hour       = Time.tm_hour;
+    Machine.SystemTime.DayOfMonth = Time.tm_mday;
+    Machine.SystemTime.Month      = Time.tm_mon + 1;
+    Machine.SystemTime.Year       = Time.tm_year + 1900;
+}
+
+static time_t
+GetTimegm(
+    _In_ SystemTime_t* Time)
+{
+    struct tm Value = { 0 };
+    Value.tm_sec  = Time->Second;
+    Value.tm_min  = Time->Minute;
+    Value.tm_hour = Time->Hour;
+    Value.tm_mday = Time->DayOfMonth;
+    Value.tm_mon  = Time->Month - 1;
+    Value.tm_year = Time->Year - 1900;
+    return timegm(&Value);
+}
+
+// Runs before the writer starts, so every update is read back as it was made
+static void
+CheckEpoch(void)
+{
+    const SystemPage_t* Page = GetSystemPage();
+    SystemPageTime_t    PageTime;
+    SystemTime_t        Time;
+    int                 i;
+
+    TEST_CHECK(Page != NULL, "the system page was not mapped");
+    if (Page == NULL) {
+        return;
+    }
+    TEST_CHECK(Page->Version == SYSTEM_PAGE_VERSION, "version %u", Page->Version);
+    TEST_CHECK(Page->PageSizeBytes == PAGE_SIZE, "page size %lu", (unsigned long)Page->PageSizeBytes);
+    TEST_CHECK(Page->AllocationGranularityBytes == Machine.MemoryGranularity,
+        "granularity %lu", (unsigned long)Page->AllocationGranularityBytes);
+    TEST_CHECK(Page->NumberOfProcessors == 1 && Page->NumberOfActiveCores == 2,
+        "%lu processors, %lu active cores", (unsigned long)Page->NumberOfProcessors,
+        (unsigned long)Page->NumberOfActiveCores);
+
+    // Every day from 1970 to 2200, at a random time of the day
+    for (i = 0; i < EPOCH_ROUNDS; i++) {
+        time_t Seconds = (time_t)(TestRandom() % (230ULL * 365 * 86400));
+        SetSystemTime(Seconds);
+        SystemPageUpdate();
+        TEST_CHECK(GetSystemPageTime(&PageTime) == OsSuccess, "the page time could not be read");
+        TEST_CHECK(PageTime.EpochSeconds == (uint64_t)Seconds, "%04i-%02i-%02i %02i:%02i:%02i is %llu, not %lld",
+            Machine.SystemTime.Year, Machine.SystemTime.Month, Machine.SystemTime.DayOfMonth,
+            Machine.SystemTime.Hour, Machine.SystemTime.Minute, Machine.SystemTime.Second,
+            (unsigned long long)PageTime.EpochSeconds, (long long)Seconds);
+        TEST_CHECK(GetSystemTime(&Time) == OsSuccess &&
+            !memcmp(&Time, &Machine.SystemTime, sizeof(SystemTime_t)), "the system time was not copied");
+    }
+
+    // Times the kernel can't convert are published as 0
+    Machine.SystemTime.Year = 1969;
+    SystemPageUpdate();
+    GetSystemPageTime(&PageTime);
+    TEST_CHECK(PageTime.EpochSeconds == 0, "1969 is %llu", (unsigned long long)PageTime.EpochSeconds);
+}
+
+// The kernel updates the page on every tick, and the wall clock moves with it
+static void*
+Writer(
+    _In_ void* Context)
+{
+    struct timespec Period = { 0, NSEC_PER_SEC / CLOCKS_PER_SEC };
+    time_t          Seconds = (time_t)(50ULL * 365 * 86400);
+
+    while (!atomic_load(&WriterStop)) {
+        SetSystemTime(Seconds++);
+        SystemPageUpdate();
+        nanosleep(&Period, NULL);
+    }
+    return NULL;
+}
+
+static void*
+ReaderMain(
+    _In_ void* Context)
+{
+    Reader_t*        Reader = Context;
+    SystemPageTime_t PageTime;
+    uint64_t         Last = 0;
+    uint64_t         End  = HostNs() + ((uint64_t)READ_SECONDS * NSEC_PER_SEC);
+    uint64_t         Ns;
+
+    while ((Ns = HostNs()) < End) {
+        GetSystemPageTime(&PageTime);
+
+        // A snapshot holds one update, the time was advanced by at most one tick and the
+        // epoch seconds belong to the copied time
+        if (PageTime.MonotonicNs < PageTime.Tick * (NSEC_PER_SEC / CLOCKS_PER_SEC) ||
+            PageTime.MonotonicNs > (PageTime.Tick + 1) * (NSEC_PER_SEC / CLOCKS_PER_SEC) ||
+            PageTime.EpochSeconds != (uint64_t)GetTimegm(&PageTime.Time)) {
+            Reader->Torn++;
+        }
+        if (PageTime.MonotonicNs < Last) {
+            Reader->Backwards++;
+        }
+        if (PageTime.MonotonicNs > (HostNs() - StartNs) + TSC_SLACK_NS) {
+            Reader->Ahead++;
+        }
+        if (PageTime.MonotonicNs % (NSEC_PER_SEC / CLOCKS_PER_SEC)) {
+            Reader->SubTick++;
+        }
+        Last = PageTime.MonotonicNs;
+        Reader->Reads++;
+    }
+    return NULL;
+}
+
+static void
+CheckReaders(void)
+{
+    Reader_t Readers[READERS] = { { 0 } };
+    uint64_t Reads = 0, SubTick = 0;
+    int      i;
+
+    for (i = 0; i < READERS; i++) {
+        pthread_create(&Readers[i].Thread, NULL, ReaderMain, &Readers[i]);
+    }
+    for (i = 0; i < READERS; i++) {
+        pthread_join(Readers[i].Thread, NULL);
+        TEST_CHECK(Readers[i].Backwards == 0, "reader %i stepped back %llu times", i,
+            (unsigned long long)Readers[i].Backwards);
+        TEST_CHECK(Readers[i].Torn == 0, "reader %i read %llu torn snapshots", i,
+            (unsigned long long)Readers[i].Torn);
+        TEST_CHECK(Readers[i].Ahead == 0, "reader %i was ahead of the host clock %llu times", i,
+            (unsigned long long)Readers[i].Ahead);
+        Reads   += Readers[i].Reads;
+        SubTick += Readers[i].SubTick;
+    }
+
+    // Without a calibrated counter every read is on a tick
+    if (((const SystemPage_t*)UserPage)->Time.TscScale != 0) {
+        TEST_CHECK(SubTick > Reads / 2, "only %llu of %llu reads were between ticks",
+            (unsigned long long)SubTick, (unsigned long long)Reads);
+    }
+    printf("%llu reads over %i s, %llu between ticks\n", (unsigned long long)Reads, READ_SECONDS,
+        (unsigned long long)SubTick);
+}
+
+typedef uint64_t(*ClockRead_t)(void);
+
+static uint64_t
+ReadTickPage(void)
+{
+    LargeUInteger_t Tick;
+    GetSystemTick(TIME_MONOTONIC, &Tick);
+    return Tick.QuadPart;
+}
+
+static uint64_t
+ReadTickSyscall(void)
+{
+    LargeUInteger_t Tick;
+    Syscall_SystemTick(TIME_MONOTONIC, &Tick);
+    return Tick.QuadPart;
+}
+
+static uint64_t
+ReadUtcPage(void)
+{
+    SystemPageTime_t PageTime;
+    GetSystemPageTime(&PageTime);
+    return PageTime.EpochSeconds;
+}
+
+// This is what time() and timespec_get(TIME_UTC) did before the page
+static uint64_t
+ReadUtcSyscall(void)
+{
+    SystemTime_t Time;
+    struct tm    Value = { 0 };
+
+    Syscall_SystemTime(&Time);
+    Value.tm_sec  = Time.Second;
+    Value.tm_min  = Time.Minute;
+    Value.tm_hour = Time.Hour;
+    Value.tm_mday = Time.DayOfMonth;
+    Value.tm_mon  = Time.Month - 1;
+    Value.tm_year = Time.Year - 1900;
+    return (uint64_t)mktime(&Value);
+}
+
+static double
+Measure(
+    _In_ ClockRead_t Read,
+    _In_ long        Rounds)
+{
+    volatile uint64_t Sink = 0;
+    double            Start;
+    long              i;
+
+    Start = TestNow();
+    for (i = 0; i < Rounds; i++) {
+        Sink += Read();
+    }
+    return ((TestNow() - Start) * 1e9) / (double)Rounds;
+}
+
+int main(int argc, char** argv)
+{
+    long      Rounds = TestScale(argc, argv, 1000000);
+    pthread_t WriterThread;
+    double    PageNs, SyscallNs;
+    int       i;
+
+    // A reader that never gets a consistent snapshot would retry forever
+    alarm(120);
+
+    // mktime reads the zone, the kernel treats the clock as UTC
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    StartNs                   = HostNs();
+    Machine.MemoryGranularity = 0x10000;
+    atomic_store(&Machine.NumberOfProcessors, 1);
+    atomic_store(&Machine.NumberOfActiveCores, 2);
+    TEST_CHECK(SystemPageInitialize() == OsSuccess, "the system page could not be initialized");
+    CheckEpoch();
+
+    // The counter is calibrated over the first second of updates
+    pthread_create(&WriterThread, NULL, Writer, NULL);
+    for (i = 0; i < 30 && ((const SystemPage_t*)UserPage)->Time.TscScale == 0; i++) {
+        usleep(100000);
+    }
+    TEST_CHECK(((const SystemPage_t*)UserPage)->Time.TscScale != 0,
+        "the timestamp counter was not calibrated");
+    CheckReaders();
+
+    PageNs    = Measure(ReadTickPage, Rounds);
+    SyscallNs = Measure(ReadTickSyscall, Rounds);
+    printf("monotonic %7.1f ns, system call %7.1f ns (%.1fx)\n", PageNs, SyscallNs, SyscallNs / PageNs);
+    PageNs    = Measure(ReadUtcPage, Rounds);
+    SyscallNs = Measure(ReadUtcSyscall, Rounds);
+    printf("utc       %7.1f ns, system call %7.1f ns (%.1fx)\n", PageNs, SyscallNs, SyscallNs / PageNs);
+
+    atomic_store(&WriterStop, 1);
+    pthread_join(WriterThread, NULL);
+    TEST_RESULT("syspage");
+}
@@ -0,0 +1,353 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Thread Pool Tests
+ * - The ddk thread pool runs on the host threads, and its jobs/s is measured against the
+ *   pool it replaced, which is kept in baseline/threadpool.c. Parallel-for submits small
+ *   jobs from the outside, fib spawns its jobs from the workers. Thread creation can be
+ *   made to fail, and the pool must then fail to initialize and stop the workers it did
+ *   create, instead of waiting for the ones it did not.
+ */
+
+#include <ddk/threadpool.h>
+#include <pthread.h>
+#include <signal.h>
+#include <threads.h>
+#include <unistd.h>
+#include "test.h"
+
+#define WORKERS      4
+#define FIB_CUTOFF   2      // Fib values below this are computed in the job
+#define JOB_WORK     64     // Rounds of work in each parallel-for job
+#define BATCH_SIZE   256
+
+typedef struct PoolInterface {
+    const char* Name;
+    OsStatus_t (*Initialize)(int, ThreadPool_t**);
+    OsStatus_t (*AddWork)(ThreadPool_t*, thrd_start_t, void*);
+    OsStatus_t (*Wait)(ThreadPool_t*);
+    OsStatus_t (*Destroy)(ThreadPool_t*);
+} PoolInterface_t;
+
+typedef struct WorkerStart {
+    thrd_start_t Function;
+    void*        Argument;
+} WorkerStart_t;
+
+extern OsStatus_t BaselineThreadPoolInitialize(int NumThreads, ThreadPool_t** ThreadPool);
+extern OsStatus_t BaselineThreadPoolAddWork(ThreadPool_t* ThreadPool, thrd_start_t Function, void* Argument);
+extern OsStatus_t BaselineThreadPoolWait(ThreadPool_t* ThreadPool);
+extern OsStatus_t BaselineThreadPoolDestroy(ThreadPool_t* ThreadPool);
+
+static const PoolInterface_t Pools[] = {
+    { "stealing", ThreadPoolInitialize, ThreadPoolAddWork, ThreadPoolWait, ThreadPoolDestroy },
+    { "baseline", BaselineThreadPoolInitialize, BaselineThreadPoolAddWork, BaselineThreadPoolWait,
+        BaselineThreadPoolDestroy }
+};
+
+static const PoolInterface_t* Pool;
+static ThreadPool_t*          Instance;
+static _Atomic(long)          FibSum;
+static _Atomic(long)          FibJobs;
+static unsigned long long*    Results;
+static _Atomic(int)           CreatesLeft = -1;   // Thread creation fails once it reaches 0
+static _Atomic(int)           WorkersRunning;
+
+int
+thrd_sleepex(
+    _In_ size_t msec)
+{
+    return usleep(msec * 1000);
+}
+
+int
+thrd_signal(
+    _In_ thrd_t thr,
+    _In_ int    sig)
+{
+    return pthread_kill(thr, sig);
+}
+
+// The pools never join their workers, so they are detached like they are in the libc
+static void*
+WorkerTrampoline(
+    _In_ void* Argument)
+{
+    WorkerStart_t Start = *(WorkerStart_t*)Argument;
+
+    free(Argument);
+    pthread_detach(pthread_self());
+    atomic_fetch_add(&WorkersRunning, 1);
+    (void)Start.Function(Start.Argument);
+    atomic_fetch_sub(&WorkersRunning, 1);
+    return NULL;
+}
+
+// The host thrd_t is a pthread_t, and the threads are created as such so the sanitizers
+// know about them
+int
+__wrap_thrd_create(
+    _In_ thrd_t*      thr,
+    _In_ thrd_start_t func,
+    _In_ void*        arg)
+{
+    WorkerStart_t* Start;
+    int            Left = atomic_load(&CreatesLeft);
+
+    if (Left == 0) {
+        return thrd_nomem;
+    }
+    if (Left > 0) {
+        atomic_fetch_sub(&CreatesLeft, 1);
+    }
+
+    Start = malloc(sizeof(WorkerStart_t));
+    Start->Function = func;
+    Start->Argument = arg;
+    if (pthread_create(thr, NULL, WorkerTrampoline, Start) != 0) {
+        free(Start);
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+static int
+ParallelForJob(
+    _In_ void* Argument)
+{
+    unsigned long long Index = (unsigned long long)(uintptr_t)Argument;
+    unsigned long long Value = Index + 1;
+
+    for (int i = 0; i < JOB_WORK; i++) {
+        Value ^= Value << 13;
+        Value ^= Value >> 7;
+        Value ^= Value << 17;
+    }
+    Results[Index] = Value;
+    return 0;
+}
+
+static int
+FibJob(
+    _In_ void* Argument)
+{
+    long N = (long)(intptr_t)Argument;
+    long A = 0;
+    long B = 1;
+
+    atomic_fetch_add(&FibJobs, 1);
+    if (N < FIB_CUTOFF) {
+        for (long i = 0; i < N; i++) {
+            long Next = A + B;
+            A = B;
+            B = Next;
+        }
+        atomic_fetch_add(&FibSum, A);
+        return 0;
+    }
+    TEST_CHECK(Pool->AddWork(Instance, FibJob, (void*)(intptr_t)(N - 1)) == OsSuccess, "fib submit failed");
+    TEST_CHECK(Pool->AddWork(Instance, FibJob, (void*)(intptr_t)(N - 2)) == OsSuccess, "fib submit failed");
+    return 0;
+}
+
+static long
+Fibonacci(
+    _In_ long N)
+{
+    long A = 0;
+    long B = 1;
+    for (long i = 0; i < N; i++) {
+        long Next = A + B;
+        A = B;
+        B = Next;
+    }
+    return A;
+}
+
+static unsigned long long
+ExpectedResult(
+    _In_ unsigned long long Index)
+{
+    unsigned long long Value = Index + 1;
+    for (int i = 0; i < JOB_WORK; i++) {
+        Value ^= Value << 13;
+        Value ^= Value >> 7;
+        Value ^= Value << 17;
+    }
+    return Value;
+}
+
+// Every job must have run exactly once, the results are cleared between the runs
+static void
+CheckParallelFor(
+    _In_ const char* Name,
+    _In_ long        Jobs)
+{
+    long Wrong = 0;
+    for (long i = 0; i < Jobs; i++) {
+        if (Results[i] != ExpectedResult((unsigned long long)i)) {
+            Wrong++;
+        }
+    }
+    TEST_CHECK(Wrong == 0, "%s: %li of %li parallel-for jobs did not run", Name, Wrong, Jobs);
+    memset(Results, 0, (size_t)Jobs * sizeof(unsigned long long));
+}
+
+static double
+RunParallelFor(
+    _In_ long Jobs)
+{
+    double Start = TestNow();
+    for (long i = 0; i < Jobs; i++) {
+        TEST_CHECK(Pool->AddWork(Instance, ParallelForJob, (void*)(uintptr_t)i) == OsSuccess,
+            "%s: submit failed", Pool->Name);
+    }
+    Pool->Wait(Instance);
+    return (double)Jobs / (TestNow() - Start);
+}
+
+static double
+RunBatches(
+    _In_ long Jobs)
+{
+    void*  Arguments[BATCH_SIZE];
+    double Start = TestNow();
+
+    for (long i = 0; i < Jobs; i += BATCH_SIZE) {
+        int Count = (int)MIN((long)BATCH_SIZE, Jobs - i);
+        for (int j = 0; j < Count; j++) {
+            Arguments[j] = (void*)(uintptr_t)(i + j);
+        }
+        TEST_CHECK(ThreadPoolAddWorkBatch(Instance, ParallelForJob, &Arguments[0], Count) == OsSuccess,
+            "batch submit failed");
+    }
+    ThreadPoolWait(Instance);
+    return (double)Jobs / (TestNow() - Start);
+}
+
+static double
+RunFib(
+    _In_ long N,
+    _In_ long Rounds)
+{
+    double Start;
+
+    atomic_store(&FibJobs, 0);
+    Start = TestNow();
+    for (long i = 0; i < Rounds; i++) {
+        atomic_store(&FibSum, 0);
+        TEST_CHECK(Pool->AddWork(Instance, FibJob, (void*)(intptr_t)N) == OsSuccess, "fib submit failed");
+        Pool->Wait(Instance);
+        TEST_CHECK(atomic_load(&FibSum) == Fibonacci(N), "%s: fib(%li) was %li", Pool->Name, N,
+            atomic_load(&FibSum));
+    }
+    return (double)atomic_load(&FibJobs) / (TestNow() - Start);
+}
+
+// The counters of the workers must add up to the jobs that were run
+static void
+CheckStatistics(
+    _In_ long Executed)
+{
+    ThreadPoolStatistics_t Statistics;
+    uint64_t               Total  = 0;
+    uint64_t               Stolen = 0;
+
+    TEST_CHECK(ThreadPoolGetWorkerCount(Instance) == WORKERS, "%i workers",
+        ThreadPoolGetWorkerCount(Instance));
+    for (int i = 0; i < WORKERS; i++) {
+        TEST_CHECK(ThreadPoolGetStatistics(Instance, i, &Statistics) == OsSuccess, "no statistics");
+        Total  += Statistics.JobsExecuted;
+        Stolen += Statistics.JobsStolen;
+    }
+    TEST_CHECK(Total == (uint64_t)Executed, "the workers executed %llu of %li jobs",
+        (unsigned long long)Total, Executed);
+    TEST_CHECK(ThreadPoolGetStatistics(Instance, WORKERS, &Statistics) == OsInvalidParameters,
+        "statistics of a worker that does not exist");
+    printf("%-9s %llu of %li jobs stolen\n", "", (unsigned long long)Stolen, Executed);
+}
+
+// Workers that were created must be gone once the failed initialization returns
+static void
+TestFailedCreate(
+    _In_ int Created)
+{
+    ThreadPool_t* Failed = NULL;
+    int           Waited;
+
+    atomic_store(&CreatesLeft, Created);
+    TEST_CHECK(ThreadPoolInitialize(WORKERS, &Failed) != OsSuccess,
+        "initialized with %i of %i workers", Created, WORKERS);
+    TEST_CHECK(Failed == NULL, "a failed pool was returned");
+    atomic_store(&CreatesLeft, -1);
+
+    for (Waited = 0; Waited < 1000 && atomic_load(&WorkersRunning); Waited++) {
+        thrd_sleepex(1);
+    }
+    TEST_CHECK(atomic_load(&WorkersRunning) == 0, "%i workers still running after %i of %i were created",
+        atomic_load(&WorkersRunning), Created, WORKERS);
+}
+
+int main(int argc, char** argv)
+{
+    long   Jobs   = TestScale(argc, argv, 200000);
+    long   FibN   = 20;
+    long   Rounds = TestScale(argc, argv, 4);
+    double ForRate[2];
+    double FibRate[2];
+    double BatchRate;
+    long   FibTotal;
+
+    // A pool that waits for workers that never start hangs, and the test with it
+    alarm(120);
+
+    Results = calloc((size_t)Jobs, sizeof(unsigned long long));
+    for (int p = 0; p < 2; p++) {
+        Pool = &Pools[p];
+        TEST_CHECK(Pool->Initialize(WORKERS, &Instance) == OsSuccess, "%s: no pool", Pool->Name);
+        ForRate[p] = RunParallelFor(Jobs);
+        CheckParallelFor(Pool->Name, Jobs);
+        FibRate[p] = RunFib(FibN, Rounds);
+        FibTotal   = atomic_load(&FibJobs);
+
+        if (p == 0) {
+            BatchRate = RunBatches(Jobs);
+            CheckParallelFor("batch", Jobs);
+            CheckStatistics((Jobs * 2) + FibTotal);
+        }
+        TEST_CHECK(Pool->Destroy(Instance) == OsSuccess, "%s: destroy failed", Pool->Name);
+        for (int Waited = 0; Waited < 1000 && atomic_load(&WorkersRunning); Waited++) {
+            thrd_sleepex(1);
+        }
+        TEST_CHECK(atomic_load(&WorkersRunning) == 0, "%s: workers left after destroy", Pool->Name);
+    }
+    free(Results);
+
+    printf("%li cpus online, %i workers\n", sysconf(_SC_NPROCESSORS_ONLN), WORKERS);
+    printf("parallel-for %7.2f Mjobs/s, baseline %7.2f Mjobs/s (%.1fx), batched %7.2f Mjobs/s\n",
+        ForRate[0] / 1e6, ForRate[1] / 1e6, ForRate[0] / ForRate[1], BatchRate / 1e6);
+    printf("fib(%li)      %7.2f Mjobs/s, baseline %7.2f Mjobs/s (%.1fx)\n", FibN,
+        FibRate[0] / 1e6, FibRate[1] / 1e6, FibRate[0] / FibRate[1]);
+
+    TEST_CHECK(ThreadPoolInitialize(0, &Instance) != OsSuccess, "a pool without workers");
+    TestFailedCreate(0);
+    TestFailedCreate(WORKERS / 2);
+    TestFailedCreate(WORKERS - 1);
+    TEST_RESULT("threadpool");
+}
@@ -0,0 +1,563 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Usb Scheduler Tests
+ * - The shared usb scheduler runs unmodified in the shapes the EHCI, OHCI and UHCI
+ *   drivers create it in. A recorded sequence of periodic endpoint attaches and
+ *   detaches is replayed, and after every step the element free lists, the bandwidth
+ *   table and the periodic frame lists are checked against a model kept by the test.
+ *   Every placement must be one of the least loaded, and rejections must only happen
+ *   when no placement fits. The admitted endpoints and the worst frame load are reported.
+ */
+
+#define __COMPILE_ASSERT
+
+#include <ddk/usb.h>
+#include <os/dmabuf.h>
+#include <scheduler.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define REPLAY_STEPS       20000
+#define CHECK_INTERVAL     64                   // Steps between full checks of the lists
+#define MAX_ELEMENTS       64
+#define PHYSICAL_BASE      0x100000
+
+typedef struct SimElement {
+    reg32_t              Link;
+    reg32_t              Depth;
+    UsbSchedulerObject_t Object;
+} SimElement_t;
+
+typedef struct SimShape {
+    const char* Name;
+    size_t      FrameCount;
+    size_t      SubframeCount;
+    size_t      MaxBandwidth;
+    Flags_t     Flags;
+    size_t      ElementCount;                   // The queue head pools of the drivers
+    size_t      ElementCountReserved;
+    int         HighSpeed;
+} SimShape_t;
+
+static const SimShape_t Shapes[] = {
+    { "ehci", 1024, 8, 800, USB_SCHEDULER_DEFERRED_CLEAN | USB_SCHEDULER_FRAMELIST | USB_SCHEDULER_LINK_BIT_EOL, 50, 2, 1 },
+    { "ohci",   32, 1, 900, USB_SCHEDULER_NULL_ELEMENT, 50, 1, 0 },
+    { "uhci", 1024, 1, 900, USB_SCHEDULER_FRAMELIST | USB_SCHEDULER_LINK_BIT_EOL, 50, 13, 0 }
+};
+
+typedef struct SimEndpoint {
+    uint8_t*                  Element;
+    UsbHcEndpointDescriptor_t Descriptor;
+    size_t                    Bytes;
+    UsbTransferType_t         Type;
+    UsbSpeed_t                Speed;
+} SimEndpoint_t;
+
+typedef struct SimStats {
+    long   Attaches;
+    long   Admitted;
+    long   NoBandwidth;
+    long   NoElement;
+    long   Detaches;
+    size_t PeakAttached;
+    size_t WorstLoad;
+    double AttachTime;
+    double DetachTime;
+} SimStats_t;
+
+static UsbScheduler_t*   Scheduler;
+static const SimShape_t* Shape;
+static SimEndpoint_t     Endpoints[MAX_ELEMENTS];
+static size_t            EndpointCount;
+static size_t*           Load;                  // The bandwidth table the test expects
+static reg32_t           FrameList[1024];       // Owned by the controller when not allocated
+static uintptr_t         NextPhysical = PHYSICAL_BASE;
+
+// The element pools are given device addresses below 4GB like the controllers need,
+// a buffer is contiguous from its address
+OsStatus_t
+dma_create(struct dma_buffer_info* info, struct dma_attachment* attachment)
+{
+    size_t Length = (info->capacity + 0xFFF) & ~(size_t)0xFFF;
+    attachment->buffer = aligned_alloc(0x1000, Length);
+    attachment->length = info->length;
+    attachment->handle = (UUId_t)NextPhysical;
+    memset(attachment->buffer, 0, Length);
+    NextPhysical += Length;
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_get_sg_table(struct dma_attachment* attachment, struct dma_sg_table* sg_table, int max_count)
+{
+    _CRT_UNUSED(max_count);
+    sg_table->entries            = malloc(sizeof(struct dma_sg));
+    sg_table->entries[0].address = (uintptr_t)attachment->handle;
+    sg_table->entries[0].length  = attachment->length;
+    sg_table->count              = 1;
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_attachment_unmap(struct dma_attachment* attachment)
+{
+    _CRT_UNUSED(attachment);
+    return OsSuccess;
+}
+
+OsStatus_t
+dma_detach(struct dma_attachment* attachment)
+{
+    free(attachment->buffer);
+    return OsSuccess;
+}
+
+static UsbSchedulerPool_t*
+GetPool(void)
+{
+    return &Scheduler->Settings.Pools[0];
+}
+
+static UsbSchedulerObject_t*
+GetObject(
+    _In_ uint8_t* Element)
+{
+    return USB_ELEMENT_OBJECT(GetPool(), Element);
+}
+
+static size_t
+GetCapacity(void)
+{
+    return Shape->MaxBandwidth / Shape->SubframeCount;
+}
+
+static void
+CreateScheduler(
+    _In_ const SimShape_t* NewShape)
+{
+    UsbSchedulerSettings_t Settings;
+
+    Shape = NewShape;
+    UsbSchedulerSettingsCreate(&Settings, Shape->FrameCount, Shape->SubframeCount,
+        Shape->MaxBandwidth, Shape->Flags);
+    if (!(Shape->Flags & USB_SCHEDULER_FRAMELIST)) {
+        UsbSchedulerSettingsConfigureFrameList(&Settings, &FrameList[0], PHYSICAL_BASE / 2);
+    }
+    UsbSchedulerSettingsAddPool(&Settings, sizeof(SimElement_t), 32, Shape->ElementCount,
+        Shape->ElementCountReserved, offsetof(SimElement_t, Link), offsetof(SimElement_t, Depth),
+        offsetof(SimElement_t, Object));
+    TEST_CHECK(UsbSchedulerInitialize(&Settings, &Scheduler) == OsSuccess, "%s: scheduler was not created",
+        Shape->Name);
+
+    Load = calloc(Shape->FrameCount * Shape->SubframeCount, sizeof(size_t));
+    EndpointCount = 0;
+}
+
+static void
+DestroyScheduler(void)
+{
+    UsbSchedulerDestroy(Scheduler);
+    free(Load);
+}
+
+// The worst load of the least loaded placement of a periodic element, or -1 if nothing fits
+static long
+BestPlacement(
+    _In_ size_t Bandwidth,
+    _In_ size_t Interval,
+    _In_ size_t WindowLength)
+{
+    size_t Subframes = Shape->SubframeCount;
+    long   Best      = -1;
+
+    for (size_t Phase = 0; Phase < Interval; Phase++) {
+        size_t Worst[USB_SUBFRAME_MAXCOUNT] = { 0 };
+        for (size_t Frame = Phase; Frame < Shape->FrameCount; Frame += Interval) {
+            for (size_t i = 0; i < Subframes; i++) {
+                Worst[i] = MAX(Worst[i], Load[Frame * Subframes + i]);
+            }
+        }
+        for (size_t Start = 0; Start + WindowLength <= Subframes; Start++) {
+            size_t WindowLoad = 0;
+            for (size_t i = Start; i < Start + WindowLength; i++) {
+                WindowLoad = MAX(WindowLoad, Worst[i]);
+            }
+            if (WindowLoad + Bandwidth <= GetCapacity() && (Best < 0 || (long)WindowLoad < Best)) {
+                Best = (long)WindowLoad;
+            }
+        }
+    }
+    return Best;
+}
+
+// The worst load of the placement the scheduler picked, before the element was added
+static size_t
+PlacementLoad(
+    _In_ UsbSchedulerObject_t* Object)
+{
+    size_t Worst = 0;
+    for (size_t Frame = Object->StartFrame; Frame < Shape->FrameCount; Frame += Object->FrameInterval) {
+        for (size_t i = 0; i < Shape->SubframeCount; i++) {
+            if (Object->FrameMask & (1 << i)) {
+                Worst = MAX(Worst, Load[Frame * Shape->SubframeCount + i]);
+            }
+        }
+    }
+    return Worst;
+}
+
+static void
+ApplyLoad(
+    _In_ UsbSchedulerObject_t* Object,
+    _In_ int                   Sign)
+{
+    for (size_t Frame = Object->StartFrame; Frame < Shape->FrameCount; Frame += Object->FrameInterval) {
+        for (size_t i = 0; i < Shape->SubframeCount; i++) {
+            if (Object->FrameMask & (1 << i)) {
+                Load[Frame * Shape->SubframeCount + i] += (size_t)(Sign * (long)Object->Bandwidth);
+            }
+        }
+    }
+}
+
+// The same window the scheduler derives from the transfer size
+static size_t
+WindowLength(
+    _In_ SimEndpoint_t* Endpoint)
+{
+    if (Shape->SubframeCount == 1) {
+        return 1;
+    }
+    return MAX(1, MIN(DIVUP(Endpoint->Bytes, Endpoint->Descriptor.MaxPacketSize), Shape->SubframeCount));
+}
+
+static void
+RecordEndpoint(
+    _In_ SimEndpoint_t* Endpoint)
+{
+    static const size_t HsInterrupt[] = { 8, 16, 64, 512, 1024 };
+    static const size_t HsIsochronous[] = { 188, 376, 512, 1024 };
+    static const size_t FsInterrupt[] = { 8, 16, 32, 64 };
+    static const size_t FsIsochronous[] = { 192, 384, 512, 1023 };
+
+    memset(Endpoint, 0, sizeof(SimEndpoint_t));
+    Endpoint->Type                 = (TestRandom() % 5) < 3 ? InterruptTransfer : IsochronousTransfer;
+    Endpoint->Descriptor.Direction = (TestRandom() & 1) ? USB_ENDPOINT_IN : USB_ENDPOINT_OUT;
+    if (Shape->HighSpeed) {
+        Endpoint->Speed = HighSpeed;
+        Endpoint->Descriptor.MaxPacketSize = (Endpoint->Type == InterruptTransfer)
+            ? HsInterrupt[TestRandom() % SIZEOF_ARRAY(HsInterrupt)]
+            : HsIsochronous[TestRandom() % SIZEOF_ARRAY(HsIsochronous)];
+        Endpoint->Descriptor.Interval = 1 + (TestRandom() % 9);
+        Endpoint->Bytes = Endpoint->Descriptor.MaxPacketSize * (1 + (TestRandom() % 3));
+    }
+    else {
+        Endpoint->Speed = (Endpoint->Type == InterruptTransfer && (TestRandom() % 4) == 0) ? LowSpeed : FullSpeed;
+        if (Endpoint->Speed == LowSpeed) {
+            Endpoint->Descriptor.MaxPacketSize = 8;
+        }
+        else {
+            Endpoint->Descriptor.MaxPacketSize = (Endpoint->Type == InterruptTransfer)
+                ? FsInterrupt[TestRandom() % SIZEOF_ARRAY(FsInterrupt)]
+                : FsIsochronous[TestRandom() % SIZEOF_ARRAY(FsIsochronous)];
+        }
+        Endpoint->Descriptor.Interval = (Endpoint->Type == InterruptTransfer) ? 1 + (TestRandom() % 32) : 1;
+        Endpoint->Bytes = Endpoint->Descriptor.MaxPacketSize;
+    }
+}
+
+static void
+Attach(
+    _In_ SimStats_t* Stats)
+{
+    SimEndpoint_t*        Endpoint = &Endpoints[EndpointCount];
+    UsbSchedulerObject_t* Object;
+    OsStatus_t            Status;
+    double                Start;
+    long                  Best;
+
+    RecordEndpoint(Endpoint);
+    Stats->Attaches++;
+
+    Start = TestNow();
+    if (UsbSchedulerAllocateElement(Scheduler, 0, &Endpoint->Element) != OsSuccess) {
+        Stats->AttachTime += TestNow() - Start;
+        TEST_CHECK(GetPool()->FreeCount == 0, "%s: allocation failed with %zu free elements",
+            Shape->Name, GetPool()->FreeCount);
+        Stats->NoElement++;
+        return;
+    }
+    Status = UsbSchedulerAllocateBandwidth(Scheduler, &Endpoint->Descriptor, Endpoint->Bytes,
+        Endpoint->Type, Endpoint->Speed, Endpoint->Element);
+    if (Status == OsSuccess) {
+        UsbSchedulerLinkPeriodicElement(Scheduler, 0, Endpoint->Element);
+    }
+    Stats->AttachTime += TestNow() - Start;
+
+    // The element keeps the bandwidth and interval the scheduler derived, the placement must
+    // be one of the least loaded ones, and nothing may fit when the element is rejected
+    Object = GetObject(Endpoint->Element);
+    Best   = BestPlacement(Object->Bandwidth, Object->FrameInterval, WindowLength(Endpoint));
+    if (Status != OsSuccess) {
+        TEST_CHECK(Best < 0, "%s: %u us every %u frames was rejected, but fits at load %li",
+            Shape->Name, Object->Bandwidth, Object->FrameInterval, Best);
+        UsbSchedulerFreeElement(Scheduler, Endpoint->Element);
+        Stats->NoBandwidth++;
+        return;
+    }
+
+    TEST_CHECK(Object->StartFrame < Object->FrameInterval && Object->FrameMask != 0
+            && (size_t)__builtin_popcount(Object->FrameMask) == WindowLength(Endpoint),
+        "%s: placed at phase %u of %u with mask 0x%x", Shape->Name, Object->StartFrame,
+        Object->FrameInterval, Object->FrameMask);
+    TEST_CHECK((long)PlacementLoad(Object) == Best, "%s: placed at load %zu, the least loaded is %li",
+        Shape->Name, PlacementLoad(Object), Best);
+    ApplyLoad(Object, 1);
+    EndpointCount++;
+    Stats->Admitted++;
+    Stats->PeakAttached = MAX(Stats->PeakAttached, EndpointCount);
+}
+
+static void
+Detach(
+    _In_ SimStats_t* Stats,
+    _In_ size_t      Index)
+{
+    SimEndpoint_t* Endpoint = &Endpoints[Index];
+    double         Start;
+
+    ApplyLoad(GetObject(Endpoint->Element), -1);
+
+    Start = TestNow();
+    UsbSchedulerUnlinkPeriodicElement(Scheduler, 0, Endpoint->Element);
+    UsbSchedulerFreeElement(Scheduler, Endpoint->Element);
+    Stats->DetachTime += TestNow() - Start;
+    Stats->Detaches++;
+
+    Endpoints[Index] = Endpoints[--EndpointCount];
+}
+
+static int
+FindEndpoint(
+    _In_ uint8_t* Element)
+{
+    for (size_t i = 0; i < EndpointCount; i++) {
+        if (Endpoints[i].Element == Element) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void
+CheckFreeList(void)
+{
+    UsbSchedulerPool_t* Pool = GetPool();
+    uint8_t             Used[MAX_ELEMENTS] = { 0 };
+
+    TEST_CHECK(Pool->FreeCount + EndpointCount == Shape->ElementCount - Shape->ElementCountReserved,
+        "%s: %zu free and %zu attached of %zu elements", Shape->Name, Pool->FreeCount, EndpointCount,
+        Shape->ElementCount - Shape->ElementCountReserved);
+    for (size_t i = 0; i < Pool->FreeCount; i++) {
+        uint16_t Index = Pool->FreeIndices[i];
+        TEST_CHECK(Index >= Shape->ElementCountReserved && Index < Shape->ElementCount && !Used[Index],
+            "%s: element %u is on the free list twice or is reserved", Shape->Name, Index);
+        if (Index < MAX_ELEMENTS) {
+            Used[Index] = 1;
+        }
+    }
+    for (size_t i = 0; i < EndpointCount; i++) {
+        size_t Index = (size_t)(Endpoints[i].Element - Pool->ElementPool) / Pool->ElementAlignedSize;
+        TEST_CHECK(!Used[Index], "%s: attached element %zu is on the free list", Shape->Name, Index);
+    }
+}
+
+// Every frame is walked like the controller would, elements must be linked into exactly the
+// frames of their phase, the longest periods first, and the hardware links must match
+static void
+CheckFrameLists(void)
+{
+    UsbSchedulerPool_t* Pool     = GetPool();
+    reg32_t             NoLink   = (Shape->Flags & USB_SCHEDULER_LINK_BIT_EOL) ? USB_ELEMENT_LINK_END : 0;
+    size_t              Linked[MAX_ELEMENTS] = { 0 };
+    size_t              Total    = Shape->FrameCount * Shape->SubframeCount;
+
+    for (size_t i = 0; i < Total; i++) {
+        TEST_CHECK(Scheduler->Bandwidth[i] == Load[i] && Load[i] <= GetCapacity(),
+            "%s: frame %zu.%zu has %zu us allocated, expected %zu of %zu", Shape->Name,
+            i / Shape->SubframeCount, i % Shape->SubframeCount, Scheduler->Bandwidth[i], Load[i], GetCapacity());
+        if (TestFailures > 20) {
+            return;
+        }
+    }
+
+    for (size_t Frame = 0; Frame < Shape->FrameCount; Frame++) {
+        uint8_t* Element  = (uint8_t*)Scheduler->VirtualFrameList[Frame];
+        reg32_t  Link     = Scheduler->Settings.FrameList[Frame];
+        size_t   Interval = (size_t)-1;
+        size_t   Steps    = 0;
+
+        if (Element == NULL) {
+            TEST_CHECK(Link == NoLink, "%s: empty frame %zu links to 0x%x", Shape->Name, Frame, Link);
+        }
+        while (Element != NULL && Steps++ <= EndpointCount) {
+            UsbSchedulerObject_t* Object = GetObject(Element);
+            int                   Index  = FindEndpoint(Element);
+
+            TEST_CHECK(Index >= 0, "%s: frame %zu links to a detached element", Shape->Name, Frame);
+            TEST_CHECK(Link == (LODWORD(UsbSchedulerGetDma(Pool, Element)) | USB_ELEMENT_LINKFLAGS(Object->Flags)),
+                "%s: frame %zu has a hardware link that does not match", Shape->Name, Frame);
+            TEST_CHECK((Frame % Object->FrameInterval) == Object->StartFrame,
+                "%s: element with phase %u of %u is linked into frame %zu", Shape->Name,
+                Object->StartFrame, Object->FrameInterval, Frame);
+            TEST_CHECK(Object->FrameInterval <= Interval, "%s: frame %zu is not ordered by period",
+                Shape->Name, Frame);
+            if (Index < 0 || TestFailures > 20) {
+                return;
+            }
+
+            Linked[Index]++;
+            Interval = Object->FrameInterval;
+            Link     = USB_ELEMENT_LINK(Pool, Element, USB_CHAIN_BREATH);
+            Element  = NULL;
+            if (Object->BreathIndex != USB_ELEMENT_NO_INDEX) {
+                UsbSchedulerPool_t* NextPool = USB_ELEMENT_GET_POOL(Scheduler, Object->BreathIndex);
+                Element = USB_ELEMENT_INDEX(NextPool, Object->BreathIndex);
+            }
+        }
+        TEST_CHECK(Element == NULL, "%s: frame %zu has a loop", Shape->Name, Frame);
+    }
+
+    for (size_t i = 0; i < EndpointCount; i++) {
+        size_t Interval = GetObject(Endpoints[i].Element)->FrameInterval;
+        TEST_CHECK(Linked[i] == Shape->FrameCount / Interval, "%s: element linked into %zu frames, expected %zu",
+            Shape->Name, Linked[i], Shape->FrameCount / Interval);
+    }
+}
+
+static void
+Replay(
+    _In_ const SimShape_t* NewShape,
+    _In_ long              Steps)
+{
+    SimStats_t Stats = { 0 };
+
+    CreateScheduler(NewShape);
+    for (long Step = 0; Step < Steps && TestFailures <= 20; Step++) {
+        if (EndpointCount < MAX_ELEMENTS && (EndpointCount == 0 || (TestRandom() % 8) < 5)) {
+            Attach(&Stats);
+        }
+        else {
+            Detach(&Stats, TestRandom() % EndpointCount);
+        }
+
+        Stats.WorstLoad = MAX(Stats.WorstLoad, UsbSchedulerGetWorstLoad(Scheduler));
+        if ((Step % CHECK_INTERVAL) == 0) {
+            CheckFreeList();
+            CheckFrameLists();
+        }
+    }
+
+    // Everything must be returned once all endpoints are gone
+    while (EndpointCount) {
+        Detach(&Stats, EndpointCount - 1);
+    }
+    CheckFreeList();
+    CheckFrameLists();
+    TEST_CHECK(UsbSchedulerGetWorstLoad(Scheduler) == 0 && Scheduler->TotalBandwidth == 0,
+        "%s: %zu us still allocated after detaching everything", Shape->Name, Scheduler->TotalBandwidth);
+
+    printf("%s  admitted %5li of %5li endpoints, %5li without bandwidth, %5li without elements, peak %2zu attached\n",
+        Shape->Name, Stats.Admitted, Stats.Attaches, Stats.NoBandwidth, Stats.NoElement, Stats.PeakAttached);
+    printf("      worst frame load %3zu of %3zu us, %6.0f ns/attach, %6.0f ns/detach\n", Stats.WorstLoad, GetCapacity(),
+        (Stats.AttachTime * 1e9) / (double)Stats.Attaches, (Stats.DetachTime * 1e9) / (double)Stats.Detaches);
+    DestroyScheduler();
+}
+
+// Interrupt endpoints polled every frame must be spread over the microframes, so the
+// worst load only grows once every microframe has one
+static void
+SpreadInterrupts(void)
+{
+    SimStats_t Stats = { 0 };
+    uint8_t*   Element;
+    size_t     Bandwidth;
+    long       Expected;
+
+    CreateScheduler(&Shapes[0]);
+    for (int i = 0; i < 40; i++) {
+        SimEndpoint_t* Endpoint = &Endpoints[EndpointCount];
+        size_t         Before   = EndpointCount;
+
+        memset(Endpoint, 0, sizeof(SimEndpoint_t));
+        Endpoint->Type                     = InterruptTransfer;
+        Endpoint->Speed                    = HighSpeed;
+        Endpoint->Descriptor.Direction     = USB_ENDPOINT_IN;
+        Endpoint->Descriptor.MaxPacketSize = 1024;
+        Endpoint->Descriptor.Interval      = 4;
+        Endpoint->Bytes                    = 1024;
+        if (UsbSchedulerAllocateElement(Scheduler, 0, &Endpoint->Element) != OsSuccess) {
+            continue;
+        }
+        if (UsbSchedulerAllocateBandwidth(Scheduler, &Endpoint->Descriptor, Endpoint->Bytes,
+                Endpoint->Type, Endpoint->Speed, Endpoint->Element) != OsSuccess) {
+            UsbSchedulerFreeElement(Scheduler, Endpoint->Element);
+            continue;
+        }
+        UsbSchedulerLinkPeriodicElement(Scheduler, 0, Endpoint->Element);
+        ApplyLoad(GetObject(Endpoint->Element), 1);
+        EndpointCount++;
+
+        Bandwidth = GetObject(Endpoint->Element)->Bandwidth;
+        TEST_CHECK(UsbSchedulerGetWorstLoad(Scheduler) == ((Before / 8) + 1) * Bandwidth,
+            "spread: %zu endpoints give a worst load of %zu us", EndpointCount, UsbSchedulerGetWorstLoad(Scheduler));
+    }
+
+    Expected = 8 * (long)(GetCapacity() / GetObject(Endpoints[0].Element)->Bandwidth);
+    TEST_CHECK((long)EndpointCount == Expected, "spread: %zu endpoints admitted, expected %li",
+        EndpointCount, Expected);
+    CheckFrameLists();
+
+    // A double free must not put the element on the free list twice
+    Element = Endpoints[0].Element;
+    Detach(&Stats, 0);
+    UsbSchedulerFreeElement(Scheduler, Element);
+    CheckFreeList();
+    while (EndpointCount) {
+        Detach(&Stats, EndpointCount - 1);
+    }
+    CheckFreeList();
+    DestroyScheduler();
+}
+
+int
+main(int argc, char** argv)
+{
+    long Steps = TestScale(argc, argv, REPLAY_STEPS);
+
+    // A loop in the periodic lists makes the scheduler walk them forever
+    alarm(120);
+    SpreadInterrupts();
+    for (size_t i = 0; i < SIZEOF_ARRAY(Shapes); i++) {
+        Replay(&Shapes[i], Steps);
+    }
+    TEST_RESULT("usbscheduler");
+}
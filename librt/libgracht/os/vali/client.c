@@ -140,8 +140,7 @@ static void vali_link_destroy(struct vali_link_manager* linkManager)
         return;
     }
     
-    dma_attachment_unmap(&linkManager->dma);
-    dma_detach(&linkManager->dma);
+    dma_unmap_and_detach(&linkManager->dma);
     free(linkManager->pool);
     free(linkManager);
 }
@@ -174,8 +173,7 @@ int gracht_link_vali_client_create(struct client_link_ops** linkOut)
     
     status = bpool(linkManager->dma.buffer, 0x1000, &linkManager->pool);
     if (status != OsSuccess) {
-        dma_attachment_unmap(&linkManager->dma);
-        dma_detach(&linkManager->dma);
+        dma_unmap_and_detach(&linkManager->dma);
         free(linkManager);
         return -1;
     }
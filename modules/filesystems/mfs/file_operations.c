@@ -28,6 +28,38 @@
 #include <string.h>
 #include "mfs.h"
 
+// Direct reads into the user buffer are queued up and submitted together, this lets
+// the block queue merge the reads of buckets that are laid out next to each other
+#define MFS_READ_BATCH_SIZE 16
+
+/* FlushReadBatch
+ * Submits the queued reads and adds the bytes read to <UnitsRead>. Only the reads up to
+ * the first one that came up short count, as the bytes after it are not contiguous. */
+static OsStatus_t
+FlushReadBatch(
+    _In_    FileSystemDescriptor_t* FileSystem,
+    _In_    BlockRequest_t*         Requests,
+    _InOut_ int*                    Count,
+    _InOut_ size_t*                 UnitsRead)
+{
+    OsStatus_t Status;
+    int        i;
+
+    if (!*Count) {
+        return OsSuccess;
+    }
+
+    Status = BlockQueueTransferBatch(FileSystem->Disk.Queue, Requests, *Count);
+    for (i = 0; i < *Count; i++) {
+        *UnitsRead += Requests[i].SectorsTransferred * FileSystem->Disk.Descriptor.SectorSize;
+        if (Requests[i].SectorsTransferred != Requests[i].SectorCount) {
+            break;
+        }
+    }
+    *Count = 0;
+    return Status;
+}
+
 OsStatus_t
 FsReadFromFile(
     _In_  FileSystemDescriptor_t*   FileSystem,
@@ -44,6 +76,9 @@ FsReadFromFile(
     uint64_t         Position        = Handle->Base.Position;
     size_t           BucketSizeBytes = Mfs->SectorsPerBucket * FileSystem->Disk.Descriptor.SectorSize;
     size_t           BytesToRead     = UnitCount;
+    BlockRequest_t   Batch[MFS_READ_BATCH_SIZE];
+    int              BatchCount      = 0;
+    OsStatus_t       BatchStatus     = OsSuccess;
 
     TRACE("[mfs] [read_file] id 0x%x, position %u, length %u",
         Handle->Base.Id, LODWORD(Handle->Base.Position), LODWORD(UnitCount));
@@ -78,6 +113,7 @@ FsReadFromFile(
         size_t   SectorCount;
         size_t   SectorsRead;
         size_t   ByteCount;
+        int      IsDirect     = 0;
         
         // The buffer handle + offset that was selected for reading 
         UUId_t SelectedHandle = Mfs->TransferBuffer.handle;
@@ -96,6 +132,7 @@ FsReadFromFile(
             SectorCount    = BytesToRead / FileSystem->Disk.Descriptor.SectorSize;
             SelectedHandle = BufferHandle;
             SelectedOffset = BufferOffset;
+            IsDirect       = 1;
         }
         
         // CASE 2: SINGLE READ INTO INTERMEDIATE BUFFER
@@ -137,26 +174,49 @@ FsReadFromFile(
             TRACE(" > sector %u (b-start %u, b-index %u), num-sectors %u, sector-byte-offset %u, bytecount %u",
                 LODWORD(Sector), LODWORD(Sector) - SectorIndex, SectorIndex, SectorCount, LODWORD(SectorOffset), ByteCount);
     
-            if (MfsReadSectors(FileSystem, SelectedHandle, SelectedOffset, 
-                    Sector, SectorCount, &SectorsRead) != OsSuccess) {
-                ERROR("Failed to read sector");
-                Result = OsDeviceError;
-                break;
-            }
-            
-            // Adjust for how many sectors we actually read
-            if (SectorCount != SectorsRead) {
-                ByteCount = (FileSystem->Disk.Descriptor.SectorSize * SectorsRead) - SectorOffset;
+            // Direct reads are counted in <UnitsRead> once the batch completes, any read that
+            // comes up short ends the read there
+            if (IsDirect) {
+                BlockRequest_t* Request = &Batch[BatchCount++];
+                Request->Direction          = __STORAGE_OPERATION_READ;
+                Request->Sector             = FileSystem->SectorStart + Sector;
+                Request->BufferHandle       = SelectedHandle;
+                Request->BufferOffset       = SelectedOffset;
+                Request->SectorCount        = SectorCount;
+                Request->Status             = OsSuccess;
+                Request->SectorsTransferred = 0;
+                if (BatchCount == MFS_READ_BATCH_SIZE) {
+                    BatchStatus = FlushReadBatch(FileSystem, &Batch[0], &BatchCount, UnitsRead);
+                    if (BatchStatus != OsSuccess) {
+                        break;
+                    }
+                }
             }
-            
-            // If we used the intermediate buffer for the transfer we now have to copy
-            // <ByteCount> amount of bytes from <TransferBuffer> + <SectorOffset> to <Buffer> + <BufferOffset>
-            if (SelectedHandle == Mfs->TransferBuffer.handle) {
+            else {
+                BatchStatus = FlushReadBatch(FileSystem, &Batch[0], &BatchCount, UnitsRead);
+                if (BatchStatus != OsSuccess) {
+                    break;
+                }
+
+                if (MfsReadSectors(FileSystem, SelectedHandle, SelectedOffset, 
+                        Sector, SectorCount, &SectorsRead) != OsSuccess) {
+                    ERROR("Failed to read sector");
+                    Result = OsDeviceError;
+                    break;
+                }
+                
+                // Adjust for how many sectors we actually read
+                if (SectorCount != SectorsRead) {
+                    ByteCount = (FileSystem->Disk.Descriptor.SectorSize * SectorsRead) - SectorOffset;
+                }
+                
+                // We used the intermediate buffer for the transfer so we now have to copy
+                // <ByteCount> amount of bytes from <TransferBuffer> + <SectorOffset> to <Buffer> + <BufferOffset>
                 memcpy(((uint8_t*)Buffer + BufferOffset), ((uint8_t*)Mfs->TransferBuffer.buffer + SectorOffset), ByteCount);
+                *UnitsRead += ByteCount;
             }
             
             // Increament all read-state variables
-            *UnitsRead   += ByteCount;
             BufferOffset += ByteCount;
             Position     += ByteCount;
             BytesToRead  -= ByteCount;            
@@ -175,6 +235,25 @@ FsReadFromFile(
         }
     }
 
+    if (BatchStatus == OsSuccess) {
+        BatchStatus = FlushReadBatch(FileSystem, &Batch[0], &BatchCount, UnitsRead);
+    }
+
+    // A batch that came up short leaves the bucket state ahead of the data that was read,
+    // so look the bucket up again. A short read ends the read, anything else is an error.
+    if (BatchStatus != OsSuccess) {
+        uint64_t HandlePosition = Handle->Base.Position;
+        ERROR("Failed to read sectors: %u", BatchStatus);
+        if (BatchStatus != OsIncomplete) {
+            *UnitsRead = 0;
+            Result     = OsDeviceError;
+        }
+        if (FsSeekInFile(FileSystem, Handle, HandlePosition + *UnitsRead) != OsSuccess) {
+            Result = OsDeviceError;
+        }
+        Handle->Base.Position = HandlePosition;
+    }
+
     // if (update_when_accessed) @todo
     // entry->accessed = now
     // entry->action_on_close = update
@@ -377,4 +377,13 @@ MfsFileRecordToVfsFile(
     _In_ FileRecord_t*              NativeEntry,
     _In_ MfsEntry_t*                VfsEntry);
 
+/* FsSeekInFile
+ * Moves the position of the file handle to the given absolute position, and switches
+ * the active bucket of the handle to the one containing the new position. */
+__EXTERN OsStatus_t
+FsSeekInFile(
+    _In_ FileSystemDescriptor_t*    FileSystem,
+    _In_ MfsEntryHandle_t*          Handle,
+    _In_ uint64_t                   AbsolutePosition);
+
 #endif //!_MFS_H_
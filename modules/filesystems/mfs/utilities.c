@@ -24,29 +24,10 @@
 //#define __TRACE
 
 #include <ddk/utils.h>
-#include <internal/_ipc.h>
 #include "mfs.h"
 #include <stdlib.h>
 #include <string.h>
 
-static OsStatus_t
-ReadStorage(
-	_In_  FileSystemDisk_t* storage,
-	_In_  UUId_t            bufferHandle,
-	_In_  uint64_t          sector,
-	_In_  size_t            sectorCount,
-	_Out_ size_t*           sectorsRead)
-{
-	struct vali_link_message msg  = VALI_MSG_INIT_HANDLE(storage->Driver);
-	OsStatus_t               status;
-	
-	ctt_storage_transfer(GetGrachtClient(), &msg, storage->Device,
-			__STORAGE_OPERATION_READ, LODWORD(sector), HIDWORD(sector), 
-			bufferHandle, 0, sectorCount, &status, sectorsRead);
-	gracht_vali_message_finish(&msg);
-	return status;
-}
-
 OsStatus_t
 MfsReadSectors(
     _In_ FileSystemDescriptor_t* FileSystem, 
@@ -56,15 +37,9 @@ MfsReadSectors(
     _In_ size_t                  Count,
     _In_ size_t*                 SectorsRead)
 {
-	struct vali_link_message msg            = VALI_MSG_INIT_HANDLE(FileSystem->Disk.Driver);
-    uint64_t                 absoluteSector = FileSystem->SectorStart + Sector;
-	OsStatus_t               status;
-	
-	ctt_storage_transfer(GetGrachtClient(), &msg, FileSystem->Disk.Device,
-			__STORAGE_OPERATION_READ, LODWORD(absoluteSector), HIDWORD(absoluteSector), 
-			BufferHandle, BufferOffset, Count, &status, SectorsRead);
-	gracht_vali_message_finish(&msg);
-	return status;
+    uint64_t absoluteSector = FileSystem->SectorStart + Sector;
+	return BlockQueueTransfer(FileSystem->Disk.Queue, __STORAGE_OPERATION_READ,
+			absoluteSector, BufferHandle, BufferOffset, Count, SectorsRead);
 }
 
 OsStatus_t
@@ -76,15 +51,9 @@ MfsWriteSectors(
     _In_ size_t                  Count,
     _In_ size_t*                 SectorsWritten)
 {
-	struct vali_link_message msg            = VALI_MSG_INIT_HANDLE(FileSystem->Disk.Driver);
-    uint64_t                 absoluteSector = FileSystem->SectorStart + Sector;
-	OsStatus_t               status;
-	
-	ctt_storage_transfer(GetGrachtClient(), &msg, FileSystem->Disk.Device,
-			__STORAGE_OPERATION_WRITE, LODWORD(absoluteSector), HIDWORD(absoluteSector), 
-			BufferHandle, BufferOffset, Count, &status, SectorsWritten);
-	gracht_vali_message_finish(&msg);
-	return status;
+    uint64_t absoluteSector = FileSystem->SectorStart + Sector;
+	return BlockQueueTransfer(FileSystem->Disk.Queue, __STORAGE_OPERATION_WRITE,
+			absoluteSector, BufferHandle, BufferOffset, Count, SectorsWritten);
 }
 
 OsStatus_t
@@ -24,32 +24,7 @@
 #include <ddk/usb.h>
 #include <ddk/utils.h>
 #include <stdlib.h>
-
-/* HidExtractValue
- * Retrieves a value from a buffer by the given bit-offset and the for a certain
- * number of bits, the extracted value will be treated unsigned */
-uint64_t
-HidExtractValue(
-    _In_ uint8_t *Buffer, 
-    _In_ uint32_t BitOffset, 
-    _In_ uint32_t NumBits)
-{
-    // Variables
-    uint64_t value = 0;
-    uint32_t i = 0;
-    uint32_t offset = BitOffset;
-
-    // Do it by loop
-    while (i < NumBits) {
-        uint8_t bits = ((offset % 8) + NumBits - i) < 8 ? NumBits % 8 : 8 - (offset % 8);
-        value |= ((Buffer[offset / 8] >> (offset % 8)) & ((1 << bits) - 1)) << i;
-        i += bits;
-        offset += bits;
-    }
-
-    // Return calculated value
-    return value;
-}
+#include <string.h>
 
 /* HidCollectionCreate
  * Allocates a new collection and fills it from the current states. */
@@ -110,6 +85,21 @@ HidCollectionCreateChild(
     }
 }
 
+/* HidSignExtend
+ * Item data is stored in the fewest bytes that can hold it, so signed values
+ * must be extended from the size of the item. */
+static int32_t
+HidSignExtend(
+    _In_ uint32_t Value,
+    _In_ uint8_t Size)
+{
+    switch (Size) {
+        case 1: return (int8_t)Value;
+        case 2: return (int16_t)Value;
+        default: return (int32_t)Value;
+    }
+}
+
 /* HidParseGlobalState
  * Parses an Global collection item and extracts all the stored settings
  * in the given GlobalStats structure. */
@@ -117,6 +107,7 @@ void
 HidParseGlobalState(
     _InOut_ UsbHidReportGlobalStats_t *Stats,
     _In_ uint8_t Tag,
+    _In_ uint8_t Size,
     _In_ uint32_t Value)
 {
     switch (Tag) {
@@ -134,20 +125,9 @@ HidParseGlobalState(
                 Stats->HasLogicalMax = 0;
             }
 
-            // Store the value and mark its presence
-            Stats->LogicalMin = (int32_t)Value;
+            // Store the value and mark its presence, the minimum is always signed
+            Stats->LogicalMin = HidSignExtend(Value, Size);
             Stats->HasLogicalMin = 1;
-
-            // If we have it's counter-part we have to sanitize
-            // it's value, because if low-part is higher/equal to
-            // higher part, then we have to negate the value by
-            // signing it. (It means the low-part is negative)
-            if (Stats->HasLogicalMax != 0) {
-                if ((int)(Stats->LogicalMin) >= (int)(Stats->LogicalMax)) {
-                    Stats->LogicalMin = ~(Stats->LogicalMin);
-                    Stats->LogicalMin++;
-                }
-            }
         } break;
 
         // The logical maximum setting, describes the
@@ -158,20 +138,15 @@ HidParseGlobalState(
                 Stats->HasLogicalMin = 0;
             }
 
-            // Store the value and mark its presence
-            Stats->LogicalMax = (int32_t)Value;
-            Stats->HasLogicalMax = 1;
-
-            // If we have it's counter-part we have to sanitize
-            // it's value, because if low-part is higher/equal to
-            // higher part, then we have to negate the value by
-            // signing it. (It means the low-part is negative)
-            if (Stats->HasLogicalMin != 0) {
-                if ((int)(Stats->LogicalMin) >= (int)(Stats->LogicalMax)) {
-                    Stats->LogicalMin = ~(Stats->LogicalMin);
-                    Stats->LogicalMin++;
-                }
+            // Store the value and mark its presence. The maximum is only signed when
+            // the range has a negative minimum, otherwise 0 to 255 would be 0 to -1.
+            if (Stats->HasLogicalMin != 0 && Stats->LogicalMin < 0) {
+                Stats->LogicalMax = HidSignExtend(Value, Size);
+            }
+            else {
+                Stats->LogicalMax = (int32_t)Value;
             }
+            Stats->HasLogicalMax = 1;
         } break;
 
         // The physical minimum setting, describes the
@@ -182,20 +157,9 @@ HidParseGlobalState(
                 Stats->HasPhysicalMax = 0;
             }
 
-            // Store the value and mark its presence
-            Stats->PhysicalMin = (int32_t)Value;
+            // Store the value and mark its presence, the minimum is always signed
+            Stats->PhysicalMin = HidSignExtend(Value, Size);
             Stats->HasPhysicalMin = 1;
-
-            // If we have it's counter-part we have to sanitize
-            // it's value, because if low-part is higher/equal to
-            // higher part, then we have to negate the value by
-            // signing it. (It means the low-part is negative)
-            if (Stats->HasPhysicalMax != 0) {
-                if ((int)(Stats->PhysicalMin) >= (int)(Stats->PhysicalMax)) {
-                    Stats->PhysicalMin = ~(Stats->PhysicalMin);
-                    Stats->PhysicalMin++;
-                }
-            }
         } break;
 
         // The physical maximum setting, describes the
@@ -206,20 +170,15 @@ HidParseGlobalState(
                 Stats->HasPhysicalMin = 0;
             }
 
-            // Store the value and mark its presence
-            Stats->PhysicalMax = (int32_t)Value;
-            Stats->HasPhysicalMax = 1;
-
-            // If we have it's counter-part we have to sanitize
-            // it's value, because if low-part is higher/equal to
-            // higher part, then we have to negate the value by
-            // signing it. (It means the low-part is negative)
-            if (Stats->HasPhysicalMin != 0) {
-                if ((int)(Stats->PhysicalMin) >= (int)(Stats->PhysicalMax)) {
-                    Stats->PhysicalMin = ~(Stats->PhysicalMin);
-                    Stats->PhysicalMin++;
-                }
+            // Store the value and mark its presence. The maximum is only signed when
+            // the range has a negative minimum, otherwise 0 to 255 would be 0 to -1.
+            if (Stats->HasPhysicalMin != 0 && Stats->PhysicalMin < 0) {
+                Stats->PhysicalMax = HidSignExtend(Value, Size);
+            }
+            else {
+                Stats->PhysicalMax = (int32_t)Value;
             }
+            Stats->HasPhysicalMax = 1;
         } break;
 
         // The Unit & Unit Exponent describes the type of data-unit
@@ -265,7 +224,6 @@ HidParseReportDescriptor(
     // Variables
     DeviceInputType_t CurrentType = DeviceInputPointer;
     size_t i = 0, j = 0, Depth = 0;
-    size_t LongestReport = 0;
     size_t BitOffset = 0;
     int ReportIdsUsed = 0;
 
@@ -337,6 +295,14 @@ HidParseReportDescriptor(
                         // Set it if current is not set
                         // then we don't need to insert it to list
                         if (CurrentCollection == NULL) {
+                            // Further application collections are linked from the first
+                            if (RootCollection != NULL) {
+                                UsbHidReportCollection_t *Last = RootCollection;
+                                while (Last->Link) {
+                                    Last = Last->Link;
+                                }
+                                Last->Link = Collection;
+                            }
                             CurrentCollection = Collection;
                         }
                         else {
@@ -361,8 +327,8 @@ HidParseReportDescriptor(
                     // closed and we should switch to parent collection context
                     case HID_MAIN_ENDCOLLECTION: {
                         if (CurrentCollection != NULL) {
-                            // If we finish with root collection, no more!
-                            if (CurrentCollection->Parent == NULL) {
+                            // If we finish with the first root collection, keep it
+                            if (CurrentCollection->Parent == NULL && RootCollection == NULL) {
                                 RootCollection = CurrentCollection;
                             }
                             CurrentCollection = CurrentCollection->Parent;
@@ -418,13 +384,13 @@ HidParseReportDescriptor(
                             CurrentCollection, &GlobalStats, CurrentType,
                             HID_TYPE_INPUT, InputItem);
 
-                        // Adjust BitOffset now to past this item
-                        // and also sanitize current length, make sure we store
-                        // the longest report
-                        BitOffset += GlobalStats.ReportCount * GlobalStats.ReportSize;
-                        if ((GlobalStats.ReportCount * GlobalStats.ReportSize) > LongestReport) {
-                            LongestReport = GlobalStats.ReportCount * GlobalStats.ReportSize;
+                        // Compile the item into the field table of its report, so
+                        // reports don't have to walk the collection tree
+                        if (HidReportCompileInput(Device, &GlobalStats, &ItemStats,
+                                CurrentType, InputItem->Flags) != OsSuccess) {
+                            ERROR("Failed to compile input item of report %i", (int)GlobalStats.ReportId);
                         }
+                        BitOffset += GlobalStats.ReportCount * GlobalStats.ReportSize;
                     } break;
 
                     // Output examples could be @todo
@@ -453,7 +419,7 @@ HidParseReportDescriptor(
             // They can also carry a report-id which means they only apply to a given
             // report
             case HID_REPORT_TYPE_GLOBAL: {
-                HidParseGlobalState(&GlobalStats, Tag, Packet);
+                HidParseGlobalState(&GlobalStats, Tag, Size, Packet);
                 if (GlobalStats.ReportId != UUID_INVALID) {
                     ReportIdsUsed = 1;
                 }
@@ -467,22 +433,25 @@ HidParseReportDescriptor(
                     // The usage tag describes which kind of device we are dealing
                     // with and are usefull for determing how to handle it.
                     case HID_LOCAL_USAGE: {
-                        // Determine the kind of input device
-                        if (Packet == HID_REPORT_USAGE_POINTER
-                            || Packet == HID_REPORT_USAGE_MOUSE) {
-                            CurrentType = DeviceInputPointer;
-                        }
-                        else if (Packet == HID_REPORT_USAGE_KEYBOARD) {
-                            CurrentType = DeviceInputKeyboard;
-                        }
-                        else if (Packet == HID_REPORT_USAGE_KEYPAD) {
-                            CurrentType = DeviceInputKeypad;
-                        }
-                        else if (Packet == HID_REPORT_USAGE_JOYSTICK) {
-                            CurrentType = DeviceInputJoystick;
-                        }
-                        else if (Packet == HID_REPORT_USAGE_GAMEPAD) {
-                            CurrentType = DeviceInputGamePad;
+                        // Determine the kind of input device from the usage of the application
+                        // collection, joysticks group their axes in a pointer collection
+                        if (Depth == 0 && GlobalStats.UsagePage == HID_USAGE_PAGE_GENERIC_PC) {
+                            if (Packet == HID_REPORT_USAGE_POINTER
+                                || Packet == HID_REPORT_USAGE_MOUSE) {
+                                CurrentType = DeviceInputPointer;
+                            }
+                            else if (Packet == HID_REPORT_USAGE_KEYBOARD) {
+                                CurrentType = DeviceInputKeyboard;
+                            }
+                            else if (Packet == HID_REPORT_USAGE_KEYPAD) {
+                                CurrentType = DeviceInputKeypad;
+                            }
+                            else if (Packet == HID_REPORT_USAGE_JOYSTICK) {
+                                CurrentType = DeviceInputJoystick;
+                            }
+                            else if (Packet == HID_REPORT_USAGE_GAMEPAD) {
+                                CurrentType = DeviceInputGamePad;
+                            }
                         }
 
                         // There can be multiple usages for an descriptor
@@ -516,13 +485,9 @@ HidParseReportDescriptor(
 
     // Store the collection in the device
     // and return the calculated number of maximum bytes reports can use
-    Device->Collection = (RootCollection == NULL) ? CurrentCollection : RootCollection;
-    if (ReportIdsUsed) {
-        return DIVUP(LongestReport, 8) + 1;
-    }
-    else {
-        return DIVUP(BitOffset, 8);
-    }
+    Device->Collection    = (RootCollection == NULL) ? CurrentCollection : RootCollection;
+    Device->ReportIdsUsed = ReportIdsUsed;
+    return HidReportGetMaximumLength(Device);
 }
 
 /* HidCollectionDestroy
@@ -574,246 +539,12 @@ HidCollectionCleanup(
         return OsError;
     }
 
-    // Recursively cleanup
-    return HidCollectionDestroy(Device->Collection);
-}
-
-/* HidParseReportInput
- * Handles report data from a collection-item of the type input.
- * This means we have actual input data from the device */
-void
-HidParseReportInput(
-    _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollectionItem_t *CollectionItem,
-    _In_ size_t DataIndex)
-{
-    // Variables
-    uint8_t *DataPointer = NULL, *PreviousDataPointer = NULL;
-    UsbHidReportInputItem_t *InputItem = NULL;
-    uint64_t Value = 0, OldValue = 0;
-    size_t i, Offset, Length, Usage;
-
-    // Static buffers
-    SystemInput_t InputData = { 0 };
-
-    // Cast the input-item from the ItemPointer
-    InputItem = (UsbHidReportInputItem_t*)CollectionItem->ItemPointer;
-
-    // Initiate pointers to new and previous data
-    DataPointer = &((uint8_t*)Device->Buffer)[DataIndex];
-    PreviousDataPointer = &((uint8_t*)Device->Buffer)[Device->PreviousDataIndex];
-
-    // Sanitize the type of input, if we are constant, it's padding
-    if (InputItem->Flags == REPORT_INPUT_TYPE_CONSTANT) {
-        return;
+    // Recursively cleanup, including the linked application collections
+    HidReportCleanup(Device);
+    while (Device->Collection != NULL) {
+        UsbHidReportCollection_t *Next = Device->Collection->Link;
+        HidCollectionDestroy(Device->Collection);
+        Device->Collection = Next;
     }
-
-    // If report-ids are active, we must make sure this data-packet
-    // is actually for this report
-    // The first byte of the data-report is the id
-    if (CollectionItem->Stats.ReportId != UUID_INVALID) {
-        uint8_t ReportId = DataPointer[0];
-        if (ReportId != (uint8_t)CollectionItem->Stats.ReportId) {
-            return;
-        }
-    }
-
-    // Initiate the mInputEvent data
-    InputData.Type = CollectionItem->InputType;
-
-    // Extract some of the state variables for parsing
-    Offset = InputItem->LocalState.BitOffset;
-    Length = CollectionItem->Stats.ReportSize;
-
-    // Iterate the data
-    for (i = 0; i < CollectionItem->Stats.ReportCount; i++, Offset += Length) {
-        Value = HidExtractValue(DataPointer, Offset, Length);
-        OldValue = HidExtractValue(PreviousDataPointer, Offset, Length);
-        
-        // We cant expect this to be correct though, it might be 0
-        Usage = InputItem->LocalState.Usages[i];
-
-        // Take action based on the type of input
-        // currently we only handle generic pc input devices
-        switch (CollectionItem->Stats.UsagePage) {
-            case HID_USAGE_PAGE_GENERIC_PC: {
-                switch (Usage) {
-                    // Calculating Device Bounds 
-                    // Resolution = (Logical Maximum � Logical Minimum) / 
-                    // ((Physical Maximum � Physical Minimum) * (10 Unit Exponent))
-
-                    // If physical min/max is not defined or are 0, 
-                    // we set them to be logical min/max
-
-                    // Grid updates like x, y or z coordinates have
-                    // changed. 
-                    case HID_REPORT_USAGE_X_AXIS:
-                    case HID_REPORT_USAGE_Y_AXIS:
-                    case HID_REPORT_USAGE_Z_AXIS: {
-                        // Variables
-                        int64_t Relative = (int64_t)Value;
-
-                        // Sanitize against no changes
-                        if (Value == 0) {
-                            break;
-                        }
-
-                        // If the value is absolute, we want to
-                        // make sure we calculate the relative
-                        if (InputItem->Flags == REPORT_INPUT_TYPE_ABSOLUTE) {
-                            Relative = (int64_t)(Value - OldValue);
-                        }
-
-                        // Handle sign-cases where we have to turn them negative
-                        if (Relative > CollectionItem->Stats.LogicalMax
-                            && CollectionItem->Stats.LogicalMin < 0) {
-                            if (Relative & (int64_t)(1 << (Length - 1))) {
-                                Relative -= (int64_t)(1 << Length);
-                            }
-                        }
-
-                        // Guard against relative = 0
-                        if (Relative != 0) {
-                            char *DebugAxis = NULL;
-                            if (Usage == HID_REPORT_USAGE_X_AXIS) {
-                                DebugAxis = "X";
-                                InputData.RelativeX = (int16_t)(Relative & 0xFFFF);
-                            }
-                            else if (Usage == HID_REPORT_USAGE_Y_AXIS) {
-                                DebugAxis = "Y";
-                                InputData.RelativeY = (int16_t)(Relative & 0xFFFF);
-                            }
-                            else { // HID_REPORT_USAGE_Z_AXIS
-                                DebugAxis = "Z";
-                                InputData.RelativeZ = (int16_t)(Relative & 0xFFFF);
-                            }
-                            
-                            // Debug
-                            TRACE("%s-Change: %i (Original 0x%x, Old 0x%x, LogMax %i)",
-                                DebugAxis, (int32_t)Relative, (uint32_t)Value, (uint32_t)OldValue, 
-                                CollectionItem->Stats.LogicalMax);
-                        }
-
-                    } break;
-                }
-            } break;
-
-            // Describes keyboard or keypad events
-            case HID_REPORT_USAGE_PAGE_KEYBOARD: {
-
-            } break;
-
-            // Generic Button events
-            case HID_REPORT_USAGE_PAGE_BUTTON: {
-                uint8_t KeystateChanged = 0;
-
-                // Check against old values if any changes are neccessary
-                if (Value != OldValue) {
-                    KeystateChanged = 1;
-                }
-                else {
-                    break;
-                }
-
-                // Ok, so if we have multiple buttons (an array) 
-                // we will use the logical min & max to find out which
-                // button id this is
-                TRACE("Button %u: %u", i, (uint32_t)Value);
-
-                // Possible types are: Keyboard, keypad, mouse, gamepad or joystick
-                switch (CollectionItem->InputType) {
-                    // Mouse button event
-                    case DeviceInputPointer: {
-
-                    } break;
-
-                    // Gamepad button event
-                    case DeviceInputGamePad: {
-
-                    } break;
-
-                    // Joystick button event
-                    case DeviceInputJoystick: {
-
-                    } break;
-
-                    // Ignore the rest of the input-types
-                    default:
-                        break;
-                }
-            } break;
-
-            // Consumer, this is device-specific
-            case HID_REPORT_USAGE_PAGE_CONSUMER: {
-                // Virtual box sends me 0x238 which means AC Pan 
-                // which actually is a kind of scrolling 
-                // From the HID Usage Table Specs:
-                // Sel - Set the horizontal offset of the display in the document. 
-            } break;
-
-            // We don't handle rest of usage-pages, but should be ok
-            default: {
-                TRACE("Usage Page 0x%x (Input Type 0x%x), Usage 0x%x, Value 0x%x",
-                    CollectionItem->Stats.UsagePage, CollectionItem->InputType, Usage, (uint32_t)Value);
-            } break;
-        }
-    }
-    
-    // Create a new input report
-    // @todo
-
-    // Buttons @todo
-}
-
-/* HidParseReport
- * Recursive report-parser that applies the given report-data
- * to the parsed report collection. */
-OsStatus_t
-HidParseReport(
-    _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollection_t *Collection,
-    _In_ size_t DataIndex)
-{
-    // Variables
-    UsbHidReportCollectionItem_t *Itr = NULL;
-    int Calls = 0;
-
-    // Get the collection pointer
-    Itr = Collection->Childs;
-    
-    // Iterate over all the children elements of root
-    while (Itr != NULL) {
-        switch (Itr->CollectionType) {
-
-            // Collections inside collections must be parsed
-            // recursively, so handle them
-            case HID_TYPE_COLLECTION: {
-                // Sanitize data attached
-                if (Itr->ItemPointer == NULL) {
-                    break;
-                }
-                
-                // Recursive parser for sub-collections
-                Calls += HidParseReport(Device, 
-                    (UsbHidReportCollection_t*)Itr->ItemPointer, DataIndex);
-            } break;
-            
-            // Input reports are interesting, that means we have an input event
-            case HID_TYPE_INPUT: {
-                HidParseReportInput(Device, Itr, DataIndex);
-                Calls++;
-            } break;
-
-            // For now we don't handle feature-reports
-            // output reports are not handled here, but never should
-            default:
-                break;
-        }
-        
-        // Go to next collection item in the collection
-        Itr = Itr->Link;
-    }
-
-    // Return the number of actual parses we made
-    return Calls;
+    return OsSuccess;
 }
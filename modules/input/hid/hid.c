@@ -137,17 +137,20 @@ HidInterrupt(
     _In_ UsbTransferStatus_t Status,
     _In_ size_t DataIndex)
 {
+    SystemInput_t Input;
+
     // Sanitize
     if (Device->Collection == NULL || Status == TransferNAK) {
         return InterruptHandled;
     }
 
-    // Perform the report parse
-    if (!HidParseReport(Device, Device->Collection, DataIndex)) {
-        return InterruptHandled;
-    }
+    // Perform the report parse, the changed fields are delivered as one event
+    if (HidParseReport(Device, DataIndex, &Input)) {
+        TRACE("Input type %u: X %i, Y %i, Z %i, Buttons 0x%x", Input.Type,
+            Input.RelativeX, Input.RelativeY, Input.RelativeZ, Input.Buttons);
 
-    // Store previous index
-    Device->PreviousDataIndex = DataIndex;
+        // Create a new input report
+        // @todo
+    }
     return InterruptHandled;
 }
@@ -154,7 +154,9 @@ PACKED_TYPESTRUCT(SystemInput, {
 #define HID_REPORT_USAGE_R_X                0x33
 #define HID_REPORT_USAGE_R_Y                0x34
 #define HID_REPORT_USAGE_R_Z                0x35
-#define HID_REPORT_USAGE_WHEEL              0x36
+#define HID_REPORT_USAGE_SLIDER             0x36
+#define HID_REPORT_USAGE_DIAL               0x37
+#define HID_REPORT_USAGE_WHEEL              0x38
 
 /* UsbHidDescriptor
  * A descriptor containing the setup of the HID device
@@ -238,15 +240,66 @@ typedef struct _UsbHidReportCollectionItem {
 
 /* UsbHidReportCollection
  * Represents a collection of hid-items that each describe
- * some form of input. */
+ * some form of input. Devices with multiple application collections
+ * have them linked from the first one. */
 typedef struct _UsbHidReportCollection {
     size_t                           UsagePage;
     size_t                           Usage;
     
     struct _UsbHidReportCollection  *Parent;
     UsbHidReportCollectionItem_t    *Childs;
+    struct _UsbHidReportCollection  *Link;
 } UsbHidReportCollection_t;
 
+/* UsbHidReportField
+ * A single compiled data field of a report. Fields are resolved when the report
+ * descriptor is parsed, so extraction at interrupt time only needs the location,
+ * the sign/scaling information and the slot the value should be written to. */
+typedef struct _UsbHidReportField {
+    uint16_t                        BitOffset;
+    uint8_t                         BitLength;
+    uint8_t                         Flags;
+    uint8_t                         Slot;
+    uint8_t                         SlotIndex;
+    uint32_t                        Mask;
+    int32_t                         Scale;
+} UsbHidReportField_t;
+
+/* UsbHidReportField::Flags
+ * Contains definitions and bitfield definitions for UsbHidReportField::Flags */
+#define HID_FIELD_SIGNED                    0x1
+#define HID_FIELD_RELATIVE                  0x2
+#define HID_FIELD_SCALED                    0x4
+#define HID_FIELD_BYTE_ALIGNED              0x8
+#define HID_FIELD_SINGLE_BIT                0x10
+
+/* UsbHidReportField::Slot
+ * Contains definitions and bitfield definitions for UsbHidReportField::Slot */
+#define HID_SLOT_X                          0x0
+#define HID_SLOT_Y                          0x1
+#define HID_SLOT_Z                          0x2
+#define HID_SLOT_BUTTON                     0x3
+
+/* UsbHidReportProgram
+ * The compiled form of a single input report (per report-id). The previous report is
+ * kept per program, as reports with different ids are interleaved on the same pipe. */
+typedef struct _UsbHidReportProgram {
+    UUId_t                          ReportId;
+    DeviceInputType_t               InputType;
+    size_t                          BitLength;
+    size_t                          ByteLength;
+    int                             HasRelative;
+    uint32_t                        Buttons;
+
+    UsbHidReportField_t            *Fields;
+    size_t                          FieldCount;
+    size_t                          FieldCapacity;
+
+    uint8_t                        *Previous;
+    uint8_t                        *Difference;
+    struct _UsbHidReportProgram    *Link;
+} UsbHidReportProgram_t;
+
 /* HidDevice
  * Represents a human input device. */
 typedef struct _HidDevice {
@@ -256,8 +309,9 @@ typedef struct _HidDevice {
 
     // Buffers
     UsbHidReportCollection_t    *Collection;
+    UsbHidReportProgram_t       *Programs;
+    int                          ReportIdsUsed;
     uintptr_t                   *Buffer;
-    size_t                       PreviousDataIndex;
     size_t                       ReportLength;
     
     // Endpoint Information
@@ -318,15 +372,43 @@ HidParseReportDescriptor(
     _In_ uint8_t *Descriptor,
     _In_ size_t DescriptorLength);
 
-/* HidParseReport
- * Recursive report-parser that applies the given report-data
- * to the parsed report collection. */
+/* HidReportCompileInput
+ * Compiles an input item into the field table of the report it belongs to. Constant
+ * items only take up space in the report, and fields without an output slot are skipped. */
 __EXTERN
 OsStatus_t
-HidParseReport(
+HidReportCompileInput(
     _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollection_t *Collection,
-    _In_ size_t DataIndex);
+    _In_ UsbHidReportGlobalStats_t *GlobalStats,
+    _In_ UsbHidReportItemStats_t *ItemStats,
+    _In_ DeviceInputType_t InputType,
+    _In_ Flags_t InputFlags);
+
+/* HidReportGetMaximumLength
+ * Returns the number of bytes the largest compiled report takes up, including
+ * the report-id byte if the device uses report ids. */
+__EXTERN
+size_t
+HidReportGetMaximumLength(
+    _In_ HidDevice_t *Device);
+
+/* HidParseReport
+ * Runs the compiled program for the report at the given data index. Only fields that
+ * changed since the previous report with the same id are applied, and they are batched
+ * into the given input event. Returns the number of fields that changed. */
+__EXTERN
+int
+HidParseReport(
+    _In_  HidDevice_t *Device,
+    _In_  size_t DataIndex,
+    _Out_ SystemInput_t *Input);
+
+/* HidReportCleanup
+ * Cleans up the compiled report programs of the device. */
+__EXTERN
+void
+HidReportCleanup(
+    _In_ HidDevice_t *Device);
 
 /* HidCollectionCleanup
  * Cleans up any resources allocated by the collection parser. */
@@ -0,0 +1,450 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - Human Input Device Driver (Generic)
+ *  - Compiled report programs. Each report id is compiled into a flat field table
+ *    when the report descriptor is parsed, which is then executed for each report.
+ */
+//#define __TRACE
+
+#include "hid.h"
+#include <ddk/utils.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HID_FIELD_INITIAL_CAPACITY 8
+
+static UsbHidReportProgram_t*
+GetProgram(
+    _In_ HidDevice_t *Device,
+    _In_ UUId_t ReportId)
+{
+    UsbHidReportProgram_t *Program = Device->Programs;
+    while (Program != NULL) {
+        if (Program->ReportId == ReportId) {
+            return Program;
+        }
+        Program = Program->Link;
+    }
+    return NULL;
+}
+
+static UsbHidReportProgram_t*
+GetOrCreateProgram(
+    _In_ HidDevice_t *Device,
+    _In_ UUId_t ReportId,
+    _In_ DeviceInputType_t InputType)
+{
+    UsbHidReportProgram_t *Program = GetProgram(Device, ReportId);
+    if (Program != NULL) {
+        return Program;
+    }
+
+    Program = (UsbHidReportProgram_t*)malloc(sizeof(UsbHidReportProgram_t));
+    if (Program == NULL) {
+        return NULL;
+    }
+    memset(Program, 0, sizeof(UsbHidReportProgram_t));
+    Program->ReportId  = ReportId;
+    Program->InputType = InputType;
+
+    // Keep the programs in the order the reports are described
+    if (Device->Programs == NULL) {
+        Device->Programs = Program;
+    }
+    else {
+        UsbHidReportProgram_t *Last = Device->Programs;
+        while (Last->Link) {
+            Last = Last->Link;
+        }
+        Last->Link = Program;
+    }
+    return Program;
+}
+
+static OsStatus_t
+AppendField(
+    _In_ UsbHidReportProgram_t *Program,
+    _In_ UsbHidReportField_t *Field)
+{
+    if (Program->FieldCount == Program->FieldCapacity) {
+        size_t Capacity = Program->FieldCapacity ? (Program->FieldCapacity * 2) : HID_FIELD_INITIAL_CAPACITY;
+        UsbHidReportField_t *Fields = (UsbHidReportField_t*)realloc(Program->Fields,
+            Capacity * sizeof(UsbHidReportField_t));
+        if (Fields == NULL) {
+            return OsOutOfMemory;
+        }
+        Program->Fields        = Fields;
+        Program->FieldCapacity = Capacity;
+    }
+    memcpy(&Program->Fields[Program->FieldCount++], Field, sizeof(UsbHidReportField_t));
+    return OsSuccess;
+}
+
+/* ResolveUsage
+ * Resolves the usage of the n'th data field of an item. Explicit usages are used first,
+ * then the usage range, and otherwise the last usage given applies to the rest. */
+static uint32_t
+ResolveUsage(
+    _In_ UsbHidReportItemStats_t *ItemStats,
+    _In_ size_t Index)
+{
+    uint32_t Usage = 0;
+    size_t   i;
+
+    if (Index < 16 && ItemStats->Usages[Index] != 0) {
+        return (uint32_t)ItemStats->Usages[Index];
+    }
+
+    if (ItemStats->UsageMax != 0 && (ItemStats->UsageMin + Index) <= ItemStats->UsageMax) {
+        return ItemStats->UsageMin + (uint32_t)Index;
+    }
+
+    for (i = 0; i < 16 && ItemStats->Usages[i] != 0; i++) {
+        Usage = (uint32_t)ItemStats->Usages[i];
+    }
+    return Usage;
+}
+
+/* ResolveSlot
+ * Maps a usage to the slot of the input event it is reported in. Returns OsDoesNotExist
+ * for usages that we do not report. */
+static OsStatus_t
+ResolveSlot(
+    _In_  uint32_t UsagePage,
+    _In_  uint32_t Usage,
+    _Out_ uint8_t *Slot,
+    _Out_ uint8_t *SlotIndex)
+{
+    // Extended usages carry their own usage page in the upper half
+    if (Usage >> 16) {
+        UsagePage = Usage >> 16;
+        Usage    &= 0xFFFF;
+    }
+
+    *SlotIndex = 0;
+    switch (UsagePage) {
+        case HID_USAGE_PAGE_GENERIC_PC: {
+            switch (Usage) {
+                case HID_REPORT_USAGE_X_AXIS: *Slot = HID_SLOT_X; return OsSuccess;
+                case HID_REPORT_USAGE_Y_AXIS: *Slot = HID_SLOT_Y; return OsSuccess;
+                case HID_REPORT_USAGE_Z_AXIS:
+                case HID_REPORT_USAGE_WHEEL:  *Slot = HID_SLOT_Z; return OsSuccess;
+                default:
+                    break;
+            }
+        } break;
+
+        // Buttons are numbered from 1, and are reported as a bitmask
+        case HID_REPORT_USAGE_PAGE_BUTTON: {
+            if (Usage >= 1 && Usage <= 32) {
+                *Slot      = HID_SLOT_BUTTON;
+                *SlotIndex = (uint8_t)(Usage - 1);
+                return OsSuccess;
+            }
+        } break;
+
+        default:
+            break;
+    }
+    return OsDoesNotExist;
+}
+
+/* CalculateScale
+ * Calculates the logical to physical scale as a 16.16 fixed point factor. Returns 0 if the
+ * values should be reported as their logical values. */
+static int32_t
+CalculateScale(
+    _In_ UsbHidReportGlobalStats_t *GlobalStats)
+{
+    int64_t LogicalRange, PhysicalRange;
+
+    if (!GlobalStats->HasPhysicalMin || !GlobalStats->HasPhysicalMax) {
+        return 0;
+    }
+
+    LogicalRange  = (int64_t)GlobalStats->LogicalMax - (int64_t)GlobalStats->LogicalMin;
+    PhysicalRange = (int64_t)GlobalStats->PhysicalMax - (int64_t)GlobalStats->PhysicalMin;
+    if (LogicalRange <= 0 || PhysicalRange <= 0 || LogicalRange == PhysicalRange) {
+        return 0;
+    }
+    return (int32_t)((PhysicalRange << 16) / LogicalRange);
+}
+
+OsStatus_t
+HidReportCompileInput(
+    _In_ HidDevice_t *Device,
+    _In_ UsbHidReportGlobalStats_t *GlobalStats,
+    _In_ UsbHidReportItemStats_t *ItemStats,
+    _In_ DeviceInputType_t InputType,
+    _In_ Flags_t InputFlags)
+{
+    UsbHidReportProgram_t *Program;
+    UsbHidReportField_t    Field;
+    size_t                 BitOffset;
+    size_t                 i;
+
+    Program = GetOrCreateProgram(Device, GlobalStats->ReportId, InputType);
+    if (Program == NULL) {
+        return OsOutOfMemory;
+    }
+
+    // Reserve the space of the item in the report, regardless of whether we use it
+    BitOffset           = Program->BitLength;
+    Program->BitLength += GlobalStats->ReportCount * GlobalStats->ReportSize;
+    Program->ByteLength = DIVUP(Program->BitLength, 8);
+
+    // Constant items are padding, and array items report usage indices which we
+    // do not map to any slots yet
+    if (InputFlags == REPORT_INPUT_TYPE_CONSTANT || InputFlags == REPORT_INPUT_TYPE_ARRAY) {
+        return OsSuccess;
+    }
+
+    if (GlobalStats->ReportSize == 0 || GlobalStats->ReportSize > 32) {
+        TRACE("Skipping input item with field size %u", GlobalStats->ReportSize);
+        return OsSuccess;
+    }
+
+    memset(&Field, 0, sizeof(UsbHidReportField_t));
+    Field.BitLength = (uint8_t)GlobalStats->ReportSize;
+    Field.Mask      = (Field.BitLength == 32) ? 0xFFFFFFFF : ((1U << Field.BitLength) - 1);
+    Field.Scale     = CalculateScale(GlobalStats);
+    if (GlobalStats->LogicalMin < 0) {
+        Field.Flags |= HID_FIELD_SIGNED;
+    }
+    if (InputFlags == REPORT_INPUT_TYPE_RELATIVE) {
+        Field.Flags |= HID_FIELD_RELATIVE;
+    }
+    if (Field.Scale != 0) {
+        Field.Flags |= HID_FIELD_SCALED;
+    }
+
+    for (i = 0; i < GlobalStats->ReportCount; i++, BitOffset += GlobalStats->ReportSize) {
+        uint32_t Usage = ResolveUsage(ItemStats, i);
+        if (ResolveSlot(GlobalStats->UsagePage, Usage, &Field.Slot, &Field.SlotIndex) != OsSuccess) {
+            TRACE("Usage Page 0x%x, Usage 0x%x has no input slot", GlobalStats->UsagePage, Usage);
+            continue;
+        }
+
+        Field.BitOffset = (uint16_t)BitOffset;
+        Field.Flags    &= ~(HID_FIELD_BYTE_ALIGNED | HID_FIELD_SINGLE_BIT);
+        if (Field.BitLength == 1) {
+            Field.Flags |= HID_FIELD_SINGLE_BIT;
+        }
+        else if (!(BitOffset & 7) && (Field.BitLength == 8 || Field.BitLength == 16 || Field.BitLength == 32)) {
+            Field.Flags |= HID_FIELD_BYTE_ALIGNED;
+        }
+
+        if (AppendField(Program, &Field) != OsSuccess) {
+            return OsOutOfMemory;
+        }
+        if (Field.Flags & HID_FIELD_RELATIVE) {
+            Program->HasRelative = 1;
+        }
+    }
+    return OsSuccess;
+}
+
+size_t
+HidReportGetMaximumLength(
+    _In_ HidDevice_t *Device)
+{
+    UsbHidReportProgram_t *Program = Device->Programs;
+    size_t                 Length  = 0;
+
+    while (Program != NULL) {
+        // Allocate the previous report and the difference buffer now that the
+        // length of the report is known
+        if (Program->Previous == NULL && Program->ByteLength != 0) {
+            Program->Previous = (uint8_t*)malloc(Program->ByteLength * 2);
+            if (Program->Previous != NULL) {
+                Program->Difference = Program->Previous + Program->ByteLength;
+                memset(Program->Previous, 0, Program->ByteLength * 2);
+            }
+        }
+
+        TRACE("Report %i: %u bytes, %u fields", (int)Program->ReportId,
+            Program->ByteLength, Program->FieldCount);
+        Length  = MAX(Length, Program->ByteLength);
+        Program = Program->Link;
+    }
+    return Device->ReportIdsUsed ? (Length + 1) : Length;
+}
+
+/* ExtractField
+ * Extracts the raw value of a field. Byte-aligned and single-bit fields are read
+ * directly, the rest is read through a little-endian window of the covered bytes. */
+static inline uint32_t
+ExtractField(
+    _In_ const uint8_t *Data,
+    _In_ const UsbHidReportField_t *Field)
+{
+    const uint8_t *Bytes = &Data[Field->BitOffset >> 3];
+    unsigned int   Shift = Field->BitOffset & 7;
+    uint64_t       Window = 0;
+    unsigned int   Count, i;
+
+    if (Field->Flags & HID_FIELD_SINGLE_BIT) {
+        return (Bytes[0] >> Shift) & 1;
+    }
+    else if (Field->Flags & HID_FIELD_BYTE_ALIGNED) {
+        switch (Field->BitLength) {
+            case 8:  return Bytes[0];
+            case 16: return (uint32_t)Bytes[0] | ((uint32_t)Bytes[1] << 8);
+            default:
+                return (uint32_t)Bytes[0] | ((uint32_t)Bytes[1] << 8)
+                    | ((uint32_t)Bytes[2] << 16) | ((uint32_t)Bytes[3] << 24);
+        }
+    }
+
+    Count = (Shift + Field->BitLength + 7) >> 3;
+    for (i = 0; i < Count; i++) {
+        Window |= (uint64_t)Bytes[i] << (i * 8);
+    }
+    return (uint32_t)(Window >> Shift) & Field->Mask;
+}
+
+static inline int32_t
+GetFieldValue(
+    _In_ const uint8_t *Data,
+    _In_ const UsbHidReportField_t *Field)
+{
+    uint32_t Value = ExtractField(Data, Field);
+    if ((Field->Flags & HID_FIELD_SIGNED) && Field->BitLength < 32) {
+        unsigned int Shift = 32 - Field->BitLength;
+        return (int32_t)(Value << Shift) >> Shift;
+    }
+    return (int32_t)Value;
+}
+
+int
+HidParseReport(
+    _In_  HidDevice_t *Device,
+    _In_  size_t DataIndex,
+    _Out_ SystemInput_t *Input)
+{
+    UsbHidReportProgram_t *Program;
+    uint8_t               *Data    = &((uint8_t*)Device->Buffer)[DataIndex];
+    int                    Changes = 0;
+    uint8_t                Changed = 0;
+    size_t                 i;
+
+    memset(Input, 0, sizeof(SystemInput_t));
+
+    // The first byte of the data-report is the id if report-ids are active
+    if (Device->ReportIdsUsed) {
+        Program = GetProgram(Device, Data[0]);
+        Data++;
+    }
+    else {
+        Program = Device->Programs;
+    }
+
+    if (Program == NULL || Program->Previous == NULL) {
+        return 0;
+    }
+
+    // Build the difference to the previous report, the first report is compared
+    // against an all-zero report
+    for (i = 0; i < Program->ByteLength; i++) {
+        Program->Difference[i] = Data[i] ^ Program->Previous[i];
+        Changed |= Program->Difference[i];
+    }
+
+    // Relative fields report changes by being non-zero, so only skip the report
+    // entirely when there is nothing relative in it
+    if (!Changed && !Program->HasRelative) {
+        return 0;
+    }
+
+    Input->Type    = (uint8_t)Program->InputType;
+    Input->Buttons = Program->Buttons;
+    for (i = 0; i < Program->FieldCount; i++) {
+        UsbHidReportField_t *Field = &Program->Fields[i];
+        int32_t              Delta;
+
+        if (Field->Flags & HID_FIELD_RELATIVE) {
+            Delta = GetFieldValue(Data, Field);
+            if (Delta == 0) {
+                continue;
+            }
+        }
+        else {
+            if (!ExtractField(Program->Difference, Field)) {
+                continue;
+            }
+
+            // Buttons report their state, axes report the movement since the last report
+            if (Field->Slot == HID_SLOT_BUTTON) {
+                if (ExtractField(Data, Field)) {
+                    Input->Buttons |= (1U << Field->SlotIndex);
+                }
+                else {
+                    Input->Buttons &= ~(1U << Field->SlotIndex);
+                }
+                Changes++;
+                continue;
+            }
+            Delta = GetFieldValue(Data, Field) - GetFieldValue(Program->Previous, Field);
+        }
+
+        if (Field->Flags & HID_FIELD_SCALED) {
+            Delta = (int32_t)(((int64_t)Delta * Field->Scale) / 65536);
+        }
+
+        switch (Field->Slot) {
+            case HID_SLOT_X: Input->RelativeX += (int16_t)Delta; break;
+            case HID_SLOT_Y: Input->RelativeY += (int16_t)Delta; break;
+            case HID_SLOT_Z: Input->RelativeZ += (int16_t)Delta; break;
+            default: {
+                if (Delta) {
+                    Input->Buttons |= (1U << Field->SlotIndex);
+                }
+                else {
+                    Input->Buttons &= ~(1U << Field->SlotIndex);
+                }
+            } break;
+        }
+        Changes++;
+    }
+
+    memcpy(Program->Previous, Data, Program->ByteLength);
+    if (Changes) {
+        Program->Buttons = Input->Buttons;
+    }
+    return Changes;
+}
+
+void
+HidReportCleanup(
+    _In_ HidDevice_t *Device)
+{
+    UsbHidReportProgram_t *Program = Device->Programs;
+    while (Program != NULL) {
+        UsbHidReportProgram_t *Next = Program->Link;
+        if (Program->Fields != NULL) {
+            free(Program->Fields);
+        }
+        if (Program->Previous != NULL) {
+            free(Program->Previous);
+        }
+        free(Program);
+        Program = Next;
+    }
+    Device->Programs = NULL;
+}
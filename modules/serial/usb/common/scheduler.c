@@ -50,18 +50,26 @@ UsbSchedulerResetInternalData(
     // Start out by zeroing out memory
     if (ResetElements) {
         for (i = 0; i < Scheduler->Settings.PoolCount; i++) {
-            memset((void*)Scheduler->Settings.Pools[i].ElementPool, 0, (Scheduler->Settings.Pools[i].ElementCount * Scheduler->Settings.Pools[i].ElementAlignedSize));
+            UsbSchedulerPool_t* Pool = &Scheduler->Settings.Pools[i];
+            memset((void*)Pool->ElementPool, 0, (Pool->ElementCount * Pool->ElementAlignedSize));
             
             // Allocate and initialze all the reserved elements
-            for (j = 0; j < Scheduler->Settings.Pools[i].ElementCountReserved; j++) {
-                uint8_t *Element              = USB_ELEMENT_INDEX((&Scheduler->Settings.Pools[i]), j);
-                UsbSchedulerObject_t *sObject = USB_ELEMENT_OBJECT((&Scheduler->Settings.Pools[i]), Element);
+            for (j = 0; j < Pool->ElementCountReserved; j++) {
+                uint8_t *Element              = USB_ELEMENT_INDEX(Pool, j);
+                UsbSchedulerObject_t *sObject = USB_ELEMENT_OBJECT(Pool, Element);
                 sObject->Index                = USB_ELEMENT_CREATE_INDEX(i, j);
                 sObject->BreathIndex          = USB_ELEMENT_NO_INDEX;
                 sObject->DepthIndex           = USB_ELEMENT_NO_INDEX;
                 sObject->Flags                = USB_ELEMENT_ALLOCATED;
             }
+
+            // Rebuild the free stack so the lowest indices are handed out first
+            Pool->FreeCount = 0;
+            for (j = (int)Pool->ElementCount - 1; j >= (int)Pool->ElementCountReserved; j--) {
+                Pool->FreeIndices[Pool->FreeCount++] = (uint16_t)j;
+            }
         }
+        Scheduler->TotalBandwidth = 0;
     }
     if (ResetFramelist) {
         reg32_t NoLink = (Scheduler->Settings.Flags & USB_SCHEDULER_LINK_BIT_EOL) ? USB_ELEMENT_LINK_END : 0;
@@ -146,7 +154,7 @@ UsbSchedulerInitialize(
     TRACE("UsbSchedulerInitialize()");
 
     assert(Settings->FrameCount > 0);
-    assert(Settings->SubframeCount > 0);
+    assert(Settings->SubframeCount > 0 && Settings->SubframeCount <= USB_SUBFRAME_MAXCOUNT);
     assert(Settings->PoolCount > 0);
 
     Scheduler = (UsbScheduler_t*)malloc(sizeof(UsbScheduler_t));
@@ -182,11 +190,20 @@ UsbSchedulerInitialize(
     // Initialize all the requested pools. Memory resources must be allocated
     // for them.
     for (i = 0; i < Scheduler->Settings.PoolCount; i++) {
-        Status = AllocateMemoryForPool(&Scheduler->Settings.Pools[i]);
+        UsbSchedulerPool_t* Pool = &Scheduler->Settings.Pools[i];
+        assert(Pool->ElementCount <= (USB_ELEMENT_INDEX_MASK + 1));
+        
+        Status = AllocateMemoryForPool(Pool);
         if (Status != OsSuccess) {
             UsbSchedulerDestroy(Scheduler);
             return Status;
         }
+
+        Pool->FreeIndices = (uint16_t*)malloc(Pool->ElementCount * sizeof(uint16_t));
+        if (!Pool->FreeIndices) {
+            UsbSchedulerDestroy(Scheduler);
+            return OsOutOfMemory;
+        }
     }
 
     // Allocate the last resources
@@ -206,6 +223,10 @@ static void
 FreePoolMemory(
     _In_ UsbSchedulerPool_t* Pool)
 {
+    if (Pool->FreeIndices != NULL) {
+        free(Pool->FreeIndices);
+    }
+    
     if (!Pool->ElementPoolDMA.buffer) {
         return;
     }
@@ -251,46 +272,6 @@ UsbSchedulerDestroy(
     free(Scheduler);
 }
 
-long
-UsbSchedulerCalculateBandwidth(
-    _In_ UsbSpeed_t        Speed, 
-    _In_ int               Direction,
-    _In_ UsbTransferType_t Type,
-    _In_ size_t            Length)
-{
-    long Result = 0;
-
-    // The bandwidth calculations are based entirely
-    // on the speed of the transfer
-    switch (Speed) {
-    case LowSpeed:
-        if (Direction == USB_ENDPOINT_IN) {
-            Result = (67667L * (31L + 10L * BitTime(Length))) / 1000L;
-            return 64060L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + Result;
-        }
-        else {
-            Result = (66700L * (31L + 10L * BitTime(Length))) / 1000L;
-            return 64107L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + Result;
-        }
-    case FullSpeed:
-        if (Type == IsochronousTransfer) {
-            Result = (8354L * (31L + 10L * BitTime(Length))) / 1000L;
-            return ((Direction == USB_ENDPOINT_IN) ? 7268L : 6265L) + BW_HOST_DELAY + Result;
-        }
-        else {
-            Result = (8354L * (31L + 10L * BitTime(Length))) / 1000L;
-            return 9107L + BW_HOST_DELAY + Result;
-        }
-    case SuperSpeed:
-    case HighSpeed:
-        if (Type == IsochronousTransfer)
-            Result = HS_NSECS_ISO(Length);
-        else
-            Result = HS_NSECS(Length);
-    }
-    return Result;
-}
-
 OsStatus_t
 UsbSchedulerGetPoolElement(
     _In_  UsbScheduler_t* Scheduler,
@@ -332,9 +313,10 @@ UsbSchedulerAllocateElement(
     _In_  int             Pool,
     _Out_ uint8_t**       ElementOut)
 {
-    UsbSchedulerObject_t* sObject = NULL;
-    UsbSchedulerPool_t*   sPool   = NULL;
-    size_t                i;
+    UsbSchedulerObject_t* sObject;
+    UsbSchedulerPool_t*   sPool;
+    uint8_t*              Element;
+    uint16_t              Index;
 
     // Get pool
     assert(ElementOut != NULL);
@@ -348,242 +330,23 @@ UsbSchedulerAllocateElement(
     // and isoc, but it doesn't make sense for us as we keep one
     // large pool of TDs, just allocate from that in any case
     spinlock_acquire(&Scheduler->Lock);
-    for (i = sPool->ElementCountReserved; i < sPool->ElementCount; i++) {
-        uint8_t *Element = USB_ELEMENT_INDEX(sPool, i);
-        sObject          = USB_ELEMENT_OBJECT(sPool, Element);
-        if (sObject->Flags & USB_ELEMENT_ALLOCATED) {
-            continue;
-        }
-
-        // Found one, reset
-        memset((void*)Element, 0, sPool->ElementAlignedSize);
-        sObject->Index       = USB_ELEMENT_CREATE_INDEX(Pool, i);
-        sObject->BreathIndex = USB_ELEMENT_NO_INDEX;
-        sObject->DepthIndex  = USB_ELEMENT_NO_INDEX;
-        sObject->Flags       = USB_ELEMENT_ALLOCATED;
-        *ElementOut          = Element;
-        break;
+    if (!sPool->FreeCount) {
+        spinlock_release(&Scheduler->Lock);
+        return OsError;
     }
+    Index = sPool->FreeIndices[--sPool->FreeCount];
     spinlock_release(&Scheduler->Lock);
-    return (i == sPool->ElementCount) ? OsError : OsSuccess;
-}
-
-OsStatus_t
-UsbSchedulerAllocateBandwidthSubframe(
-    _In_  UsbScheduler_t*       Scheduler,
-    _In_  UsbSchedulerObject_t* sObject,
-    _In_  size_t                Frame,
-    _In_  int                   NumberOfTransactions,
-    _In_  int                   Validate,
-    _Out_ reg32_t*              FrameMask)
-{
-    OsStatus_t Result = OsSuccess;
-    size_t     j;
-
-    // Either we create a mask
-    // or we allocate a mask
-    if (*FrameMask == 0) {
-        int Counter = NumberOfTransactions;
-        // Find space in 'sub' schedule
-        for (j = 1; j < Scheduler->Settings.SubframeCount && Counter; j++) {
-            if ((Scheduler->Bandwidth[Frame + j] + sObject->Bandwidth) <= Scheduler->Settings.MaxBandwidthPerFrame) {
-                if (Validate == 0) {
-                    Scheduler->Bandwidth[Frame + j] += sObject->Bandwidth;
-                }
-                *FrameMask |= (1 << j);
-                Counter--;
-            }
-        }
-
-        if (Counter != 0) {
-            Result = OsError;
-        }
-    }
-    else if (Validate != 0) {
-        // Allocate bandwidth in 'sub' schedule
-        for (j = 1; j < Scheduler->Settings.SubframeCount; j++) {
-            if (*FrameMask & (1 << j)) {
-                Scheduler->Bandwidth[Frame + j] += sObject->Bandwidth;
-            }
-        }
-    }
-    return Result;
-}
-
-OsStatus_t
-UsbSchedulerTryAllocateBandwidth(
-    _In_ UsbScheduler_t*       Scheduler,
-    _In_ UsbSchedulerObject_t* sObject,
-    _In_ int                   NumberOfTransactions)
-{
-    OsStatus_t Result     = OsSuccess;
-    reg32_t    StartFrame = (reg32_t)-1;
-    reg32_t    FrameMask  = 0;
-    int        Validated  = 0;
-    size_t     i;
-
-    // Iterate the requested period and make sure there is actually room
-    spinlock_acquire(&Scheduler->Lock);
-    while (NumberOfTransactions) { // Run untill cancel
-        for (i = 0; i < Scheduler->Settings.FrameCount; ) {
-            if ((Scheduler->Bandwidth[i] + sObject->Bandwidth) > Scheduler->Settings.MaxBandwidthPerFrame) {
-                // Try to allocate on uneven frames if period is not 1
-                if (sObject->FrameInterval == 1 || StartFrame != (reg32_t)-1) {
-                    Result = OsError;
-                    break;
-                }
-                else {
-                    i += Scheduler->Settings.SubframeCount;
-                    continue;
-                }
-            }
-
-            // Lock this frame-period
-            if (StartFrame == (reg32_t)-1) {
-                StartFrame = i;
-            }
-
-            // For EHCI we must support bandwidth sizes instead of having a scheduler with multiple
-            // levels, we have it flattened
-            if (NumberOfTransactions > 1 && Scheduler->Settings.SubframeCount > 1) {
-                if (Validated == 0) {
-                    Result = UsbSchedulerAllocateBandwidthSubframe(Scheduler, sObject, i, NumberOfTransactions, 1, &FrameMask);
-                }
-                else {
-                    Result = UsbSchedulerAllocateBandwidthSubframe(Scheduler, sObject, i, NumberOfTransactions, 0, &FrameMask);
-                }
-            }
-
-            // Increase bandwidth and update index by sObject->FrameInterval
-            if (Validated != 0) {
-                Scheduler->Bandwidth[i] += sObject->Bandwidth;
-            }
-            i += (sObject->FrameInterval * Scheduler->Settings.SubframeCount);
-        }
-
-        // Perform another iteration?
-        if (Validated == 0 && Result == OsSuccess) {
-            Validated = 1;
-            continue;
-        }
-        break;
-    }
-    spinlock_release(&Scheduler->Lock);
-    if (Result != OsSuccess) {
-        return Result;
-    }
-
-    // Update members
-    sObject->StartFrame = (uint16_t)(StartFrame & 0xFFFF);
-    sObject->FrameMask  = (uint16_t)(FrameMask & 0xFFFF);
-    return Result;
-}
 
-OsStatus_t
-UsbSchedulerAllocateBandwidth(
-    _In_ UsbScheduler_t*            Scheduler,
-    _In_ UsbHcEndpointDescriptor_t* Endpoint,
-    _In_ size_t                     BytesToTransfer,
-    _In_ UsbTransferType_t          Type,
-    _In_ UsbSpeed_t                 Speed,
-    _In_ uint8_t*                   Element)
-{
-    UsbSchedulerObject_t* sObject              = NULL;
-    UsbSchedulerPool_t*   sPool                = NULL;
-    OsStatus_t            Result               = OsSuccess;
-    int                   NumberOfTransactions = 0;
-    int                   Exponent             = 0;
-
-    // Validate element and lookup pool
-    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
-    assert(Result == OsSuccess);
-    sObject = USB_ELEMENT_OBJECT(sPool, Element);
-
-    // Calculate the required number of transactions based on the MPS
-    NumberOfTransactions = DIVUP(BytesToTransfer, Endpoint->MaxPacketSize);
-
-    // Calculate the number of microseconds the transfer will take
-    sObject->Bandwidth = (uint16_t)NS_TO_US(UsbSchedulerCalculateBandwidth(Speed, Endpoint->Direction, Type, BytesToTransfer));
-    
-    // If highspeed calculate period as 2^(Interval-1)
-    if (Speed == HighSpeed) {
-        sObject->FrameInterval = (1 << LOWORD(Endpoint->Interval));
-    }
-    else {
-        sObject->FrameInterval = LOWORD(Endpoint->Interval);
-    }
-    
-    // Sanitize some bounds for period
-    // to be considered if it should fail instead
-    if (sObject->FrameInterval == 0)                             sObject->FrameInterval = 1;
-    if (sObject->FrameInterval > Scheduler->Settings.FrameCount) sObject->FrameInterval = Scheduler->Settings.FrameCount;
-
-    // Try to fit it in, we try lesser intervals if possible too
-    for (Exponent = 7; Exponent >= 0; --Exponent) {
-        if ((1 << Exponent) <= (int)sObject->FrameInterval) {
-            break;
-        }
-    }
-
-    // Sanitize that the exponent is valid
-    if (Exponent < 0) {
-        ERROR("Invalid usb-endpoint interval %u", Endpoint->Interval);
-        Exponent = 0;
-    }
-
-    // If we don't bandwidth for transfers with 1 interval, then try 2, 4, 8, 16, 32 etc
-    if (Exponent > 0) {
-        while (Result != OsSuccess && --Exponent >= 0) {
-            sObject->FrameInterval = 1 << Exponent;
-            Result                 = UsbSchedulerTryAllocateBandwidth(Scheduler, sObject, NumberOfTransactions);
-        }
-    }
-    else {
-        sObject->FrameInterval = 1 << Exponent;
-        Result                 = UsbSchedulerTryAllocateBandwidth(Scheduler, sObject, NumberOfTransactions);
-    }
-
-    if (Result == OsSuccess) {
-        sObject->Flags |= USB_ELEMENT_BANDWIDTH;
-    }
-    return Result;
-}
-
-OsStatus_t
-UsbSchedulerFreeBandwidth(
-    _In_  UsbScheduler_t* Scheduler,
-    _In_  uint8_t*        Element)
-{
-    UsbSchedulerObject_t* sObject = NULL;
-    UsbSchedulerPool_t*   sPool   = NULL;
-    OsStatus_t            Result  = OsSuccess;
-    size_t                i, j;
-
-    // Validate element and lookup pool
-    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
-    assert(Result == OsSuccess);
-    sObject = USB_ELEMENT_OBJECT(sPool, Element);
-
-    // Iterate the requested period and clean up
-    spinlock_acquire(&Scheduler->Lock);
-    for (i = sObject->StartFrame; i < Scheduler->Settings.FrameCount; i += (sObject->FrameInterval * Scheduler->Settings.SubframeCount)) {
-        // Reduce allocated bandwidth
-        Scheduler->Bandwidth[i] -= MIN(sObject->Bandwidth, Scheduler->Bandwidth[i]);
-
-        // For EHCI we must support bandwidth sizes
-        // instead of having a scheduler with multiple
-        // levels, we have it flattened
-        if (sObject->FrameMask != 0 && Scheduler->Settings.SubframeCount > 1) {
-            // Free bandwidth in 'sub' schedule
-            for (j = 1; j < Scheduler->Settings.SubframeCount; j++) {
-                if (sObject->FrameMask & (1 << j)) {
-                    Scheduler->Bandwidth[i + j] -= sObject->Bandwidth;
-                }
-            }
-        }
-    }
-    spinlock_release(&Scheduler->Lock);
-    return Result;
+    // Found one, reset
+    Element              = USB_ELEMENT_INDEX(sPool, Index);
+    sObject              = USB_ELEMENT_OBJECT(sPool, Element);
+    memset((void*)Element, 0, sPool->ElementAlignedSize);
+    sObject->Index       = USB_ELEMENT_CREATE_INDEX(Pool, Index);
+    sObject->BreathIndex = USB_ELEMENT_NO_INDEX;
+    sObject->DepthIndex  = USB_ELEMENT_NO_INDEX;
+    sObject->Flags       = USB_ELEMENT_ALLOCATED;
+    *ElementOut          = Element;
+    return OsSuccess;
 }
 
 void
@@ -594,17 +357,33 @@ UsbSchedulerFreeElement(
     UsbSchedulerObject_t* sObject = NULL;
     UsbSchedulerPool_t*   sPool   = NULL;
     OsStatus_t            Result  = OsSuccess;
+    size_t                Index;
     
     // Validate element and lookup pool
     Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
     assert(Result == OsSuccess);
     sObject = USB_ELEMENT_OBJECT(sPool, Element);
+    if (!(sObject->Flags & USB_ELEMENT_ALLOCATED)) {
+        return;
+    }
 
     // Should we free bandwidth?
     if (sObject->Flags & USB_ELEMENT_BANDWIDTH) {
         UsbSchedulerFreeBandwidth(Scheduler, Element);
     }
     memset((void*)Element, 0, sPool->ElementAlignedSize);
+
+    // Reserved elements are never handed out by the allocator, so they must not
+    // end up on the free stack either
+    Index = ((uintptr_t)Element - (uintptr_t)sPool->ElementPool) / sPool->ElementAlignedSize;
+    if (Index < sPool->ElementCountReserved) {
+        return;
+    }
+
+    spinlock_acquire(&Scheduler->Lock);
+    assert(sPool->FreeCount < sPool->ElementCount);
+    sPool->FreeIndices[sPool->FreeCount++] = (uint16_t)Index;
+    spinlock_release(&Scheduler->Lock);
 }
 
 uintptr_t
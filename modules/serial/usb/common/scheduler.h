@@ -88,6 +88,7 @@ PACKED_TYPESTRUCT(UsbSchedulerObject, {
 #define USB_CHAIN_BREATH                0
 #define USB_CHAIN_DEPTH                 1
 #define USB_POOL_MAXCOUNT               8
+#define USB_SUBFRAME_MAXCOUNT           8
 
 typedef struct _UsbSchedulerPool {
     size_t    ElementBaseSize;            // Size of an element
@@ -102,6 +103,9 @@ typedef struct _UsbSchedulerPool {
     struct dma_attachment ElementPoolDMA;         // Frame element pool DMA attachment
     struct dma_sg_table   ElementPoolDMATable;
     uint8_t*              ElementPool;
+
+    uint16_t*             FreeIndices;            // Stack of free element indices
+    size_t                FreeCount;              // Number of entries on the free stack
 } UsbSchedulerPool_t;
 
 typedef struct _UsbSchedulerSettings {
@@ -130,7 +134,7 @@ typedef struct _UsbScheduler {
     spinlock_t              Lock;
 
     uintptr_t* VirtualFrameList;       // Virtual frame list
-    size_t*    Bandwidth;              // Bandwidth[FrameCount]
+    size_t*    Bandwidth;              // Bandwidth[FrameCount * SubframeCount]
     size_t     TotalBandwidth;         // Total bandwidth
 } UsbScheduler_t;
 
@@ -242,10 +246,19 @@ UsbSchedulerFreeElement(
     _In_ UsbScheduler_t*            Scheduler,
     _In_ uint8_t*                   Element);
 
+/* UsbSchedulerCalculateBandwidth
+ * Calculates the bus time in nanoseconds a single transaction of the given length takes. */
+__EXTERN long
+UsbSchedulerCalculateBandwidth(
+    _In_ UsbSpeed_t                 Speed, 
+    _In_ int                        Direction,
+    _In_ UsbTransferType_t          Type,
+    _In_ size_t                     Length);
+
 /* UsbSchedulerAllocateBandwidth
- * Allocates bandwidth for a scheduler element. The bandwidth will automatically
- * be fitted into where is best place on schedule. If there is no more room it will
- * return OsError. */
+ * Allocates bandwidth for a scheduler element. The element is placed in the phase and
+ * (micro)frame window that is least loaded, which is stored in StartFrame and FrameMask.
+ * If there is no more room it will return OsError. */
 __EXTERN OsStatus_t
 UsbSchedulerAllocateBandwidth(
     _In_ UsbScheduler_t*            Scheduler,
@@ -255,6 +268,19 @@ UsbSchedulerAllocateBandwidth(
 	_In_ UsbSpeed_t                 Speed,
     _In_ uint8_t*                   Element);
 
+/* UsbSchedulerFreeBandwidth
+ * Releases the bandwidth that was previously allocated for the element. */
+__EXTERN OsStatus_t
+UsbSchedulerFreeBandwidth(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ uint8_t*                   Element);
+
+/* UsbSchedulerGetWorstLoad
+ * Retrieves the load of the most loaded (micro)frame in the schedule. */
+__EXTERN size_t
+UsbSchedulerGetWorstLoad(
+    _In_ UsbScheduler_t*            Scheduler);
+
 /* UsbSchedulerChainElement
  * Chains up a new element to the given element chain. The root element
  * must be specified and the element to append to the chain. Also the
@@ -0,0 +1,250 @@
+/**
+ * MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * USB Controller Scheduler
+ * - Periodic bandwidth planning. The bandwidth table keeps the allocated bus time
+ *   for every (micro)frame, and periodic elements are placed in the phase and
+ *   microframe window that is least loaded.
+ */
+
+//#define __TRACE
+
+#include <assert.h>
+#include <ddk/usb.h>
+#include <ddk/utils.h>
+#include "scheduler.h"
+#include <string.h>
+
+long
+UsbSchedulerCalculateBandwidth(
+    _In_ UsbSpeed_t        Speed,
+    _In_ int               Direction,
+    _In_ UsbTransferType_t Type,
+    _In_ size_t            Length)
+{
+    long Result = 0;
+
+    // The bandwidth calculations are based entirely
+    // on the speed of the transfer
+    switch (Speed) {
+    case LowSpeed:
+        if (Direction == USB_ENDPOINT_IN) {
+            Result = (67667L * (31L + 10L * BitTime(Length))) / 1000L;
+            return 64060L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + Result;
+        }
+        else {
+            Result = (66700L * (31L + 10L * BitTime(Length))) / 1000L;
+            return 64107L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + Result;
+        }
+    case FullSpeed:
+        if (Type == IsochronousTransfer) {
+            Result = (8354L * (31L + 10L * BitTime(Length))) / 1000L;
+            return ((Direction == USB_ENDPOINT_IN) ? 7268L : 6265L) + BW_HOST_DELAY + Result;
+        }
+        else {
+            Result = (8354L * (31L + 10L * BitTime(Length))) / 1000L;
+            return 9107L + BW_HOST_DELAY + Result;
+        }
+    case SuperSpeed:
+    case HighSpeed:
+        if (Type == IsochronousTransfer)
+            Result = HS_NSECS_ISO(Length);
+        else
+            Result = HS_NSECS(Length);
+    }
+    return Result;
+}
+
+/* PlanPeriodicElement
+ * Finds the least loaded placement for a periodic element. For each phase the worst load of
+ * every microframe across the frames the element would be linked into is gathered, and the
+ * window of consecutive microframes with the lowest worst load is selected. Split transactions
+ * need their complete-splits to follow the start-split, which is why the window is contiguous. */
+static OsStatus_t
+PlanPeriodicElement(
+    _In_  UsbScheduler_t*       Scheduler,
+    _In_  UsbSchedulerObject_t* sObject,
+    _In_  size_t                WindowLength,
+    _Out_ size_t*               PhaseOut,
+    _Out_ reg32_t*              MaskOut)
+{
+    size_t Subframes = Scheduler->Settings.SubframeCount;
+    size_t Capacity  = Scheduler->Settings.MaxBandwidthPerFrame / Subframes;
+    size_t BestLoad  = (size_t)-1;
+    size_t Load[USB_SUBFRAME_MAXCOUNT];
+    size_t Phase, Frame, Start, i;
+
+    for (Phase = 0; Phase < sObject->FrameInterval; Phase++) {
+        memset(&Load[0], 0, sizeof(Load));
+        for (Frame = Phase; Frame < Scheduler->Settings.FrameCount; Frame += sObject->FrameInterval) {
+            size_t* Slots = &Scheduler->Bandwidth[Frame * Subframes];
+            for (i = 0; i < Subframes; i++) {
+                Load[i] = MAX(Load[i], Slots[i]);
+            }
+        }
+
+        for (Start = 0; (Start + WindowLength) <= Subframes; Start++) {
+            size_t WorstLoad = 0;
+            for (i = Start; i < (Start + WindowLength); i++) {
+                WorstLoad = MAX(WorstLoad, Load[i]);
+            }
+
+            if ((WorstLoad + sObject->Bandwidth) <= Capacity && WorstLoad < BestLoad) {
+                BestLoad  = WorstLoad;
+                *PhaseOut = Phase;
+                *MaskOut  = ((1U << WindowLength) - 1) << Start;
+
+                // Nothing beats an unused window
+                if (BestLoad == 0) {
+                    return OsSuccess;
+                }
+            }
+        }
+    }
+    return (BestLoad == (size_t)-1) ? OsError : OsSuccess;
+}
+
+static void
+ApplyBandwidth(
+    _In_ UsbScheduler_t*       Scheduler,
+    _In_ UsbSchedulerObject_t* sObject,
+    _In_ int                   Allocate)
+{
+    size_t Subframes = Scheduler->Settings.SubframeCount;
+    size_t Frame, i;
+
+    for (Frame = sObject->StartFrame; Frame < Scheduler->Settings.FrameCount; Frame += sObject->FrameInterval) {
+        size_t* Slots = &Scheduler->Bandwidth[Frame * Subframes];
+        for (i = 0; i < Subframes; i++) {
+            if (!(sObject->FrameMask & (1 << i))) {
+                continue;
+            }
+
+            if (Allocate) {
+                Slots[i]                  += sObject->Bandwidth;
+                Scheduler->TotalBandwidth += sObject->Bandwidth;
+            }
+            else {
+                Slots[i]                  -= MIN(sObject->Bandwidth, Slots[i]);
+                Scheduler->TotalBandwidth -= MIN(sObject->Bandwidth, Scheduler->TotalBandwidth);
+            }
+        }
+    }
+}
+
+OsStatus_t
+UsbSchedulerAllocateBandwidth(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ UsbHcEndpointDescriptor_t* Endpoint,
+    _In_ size_t                     BytesToTransfer,
+    _In_ UsbTransferType_t          Type,
+    _In_ UsbSpeed_t                 Speed,
+    _In_ uint8_t*                   Element)
+{
+    UsbSchedulerObject_t* sObject              = NULL;
+    UsbSchedulerPool_t*   sPool                = NULL;
+    OsStatus_t            Result               = OsSuccess;
+    size_t                NumberOfTransactions = 0;
+    size_t                WindowLength         = 1;
+    size_t                Interval;
+    size_t                Phase;
+    reg32_t               FrameMask;
+
+    // Validate element and lookup pool
+    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
+    assert(Result == OsSuccess);
+    sObject = USB_ELEMENT_OBJECT(sPool, Element);
+
+    // Calculate the required number of transactions based on the MPS
+    NumberOfTransactions = DIVUP(BytesToTransfer, Endpoint->MaxPacketSize);
+    if (Scheduler->Settings.SubframeCount > 1) {
+        WindowLength = MAX(1, MIN(NumberOfTransactions, Scheduler->Settings.SubframeCount));
+    }
+
+    // Calculate the number of microseconds the transfer will take
+    sObject->Bandwidth = (uint16_t)NS_TO_US(UsbSchedulerCalculateBandwidth(Speed, Endpoint->Direction, Type, BytesToTransfer));
+
+    // The highspeed interval is 2^(Interval-1) microframes, otherwise it is given in frames. Periods
+    // shorter than a frame are scheduled every frame.
+    if (Speed == HighSpeed) {
+        Interval = (LOWORD(Endpoint->Interval) > 3) ? (1 << (LOWORD(Endpoint->Interval) - 4)) : 1;
+    }
+    else {
+        Interval = LOWORD(Endpoint->Interval);
+    }
+
+    // The schedule tree only supports power of two periods, so round the period down, the
+    // device must accept being polled more often than it asks for
+    Interval = MAX(1, MIN(Interval, Scheduler->Settings.FrameCount));
+    Interval = (size_t)1 << LastSetBit(Interval);
+    sObject->FrameInterval = (uint16_t)Interval;
+
+    spinlock_acquire(&Scheduler->Lock);
+    Result = PlanPeriodicElement(Scheduler, sObject, WindowLength, &Phase, &FrameMask);
+    if (Result == OsSuccess) {
+        sObject->StartFrame = (uint16_t)(Phase & 0xFFFF);
+        sObject->FrameMask  = (uint16_t)(FrameMask & 0xFFFF);
+        ApplyBandwidth(Scheduler, sObject, 1);
+        sObject->Flags |= USB_ELEMENT_BANDWIDTH;
+    }
+    spinlock_release(&Scheduler->Lock);
+
+    TRACE("UsbSchedulerAllocateBandwidth(Bandwidth %u, Interval %u) => %u, Phase %u, Mask 0x%x",
+        sObject->Bandwidth, sObject->FrameInterval, Result, sObject->StartFrame, sObject->FrameMask);
+    return Result;
+}
+
+OsStatus_t
+UsbSchedulerFreeBandwidth(
+    _In_  UsbScheduler_t* Scheduler,
+    _In_  uint8_t*        Element)
+{
+    UsbSchedulerObject_t* sObject = NULL;
+    UsbSchedulerPool_t*   sPool   = NULL;
+    OsStatus_t            Result  = OsSuccess;
+
+    // Validate element and lookup pool
+    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
+    assert(Result == OsSuccess);
+    sObject = USB_ELEMENT_OBJECT(sPool, Element);
+
+    spinlock_acquire(&Scheduler->Lock);
+    if (sObject->Flags & USB_ELEMENT_BANDWIDTH) {
+        ApplyBandwidth(Scheduler, sObject, 0);
+        sObject->Flags &= ~(USB_ELEMENT_BANDWIDTH);
+    }
+    spinlock_release(&Scheduler->Lock);
+    return Result;
+}
+
+size_t
+UsbSchedulerGetWorstLoad(
+    _In_ UsbScheduler_t* Scheduler)
+{
+    size_t Count     = Scheduler->Settings.FrameCount * Scheduler->Settings.SubframeCount;
+    size_t WorstLoad = 0;
+    size_t i;
+
+    spinlock_acquire(&Scheduler->Lock);
+    for (i = 0; i < Count; i++) {
+        WorstLoad = MAX(WorstLoad, Scheduler->Bandwidth[i]);
+    }
+    spinlock_release(&Scheduler->Lock);
+    return WorstLoad;
+}
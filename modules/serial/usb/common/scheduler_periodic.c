@@ -56,11 +56,15 @@ UsbSchedulerLinkPeriodicElement(
             Scheduler->Settings.FrameList[i] = LODWORD(PhysicalAddress) | USB_ELEMENT_LINKFLAGS(sObject->Flags); //@todo if 64 bit support in xhci
         }
         else {
-            // Ok, so we need to index us by Interval
-            // Lowest interval must come last
-            UsbSchedulerObject_t *ExistingObject = NULL;
-            UsbSchedulerPool_t *ExistingPool     = NULL;
-            uint8_t *ExistingElement             = (uint8_t*)Scheduler->VirtualFrameList[i];
+            // Elements are ordered by their period, longest first. Every element with a shorter
+            // period than ours is in all of our frames, so linking us in front of the first of
+            // those keeps our successor the same in every frame.
+            UsbSchedulerObject_t *PreviousObject  = NULL;
+            UsbSchedulerPool_t *PreviousPool      = NULL;
+            uint8_t *PreviousElement              = NULL;
+            UsbSchedulerObject_t *ExistingObject  = NULL;
+            UsbSchedulerPool_t *ExistingPool      = NULL;
+            uint8_t *ExistingElement              = (uint8_t*)Scheduler->VirtualFrameList[i];
 
             // Get element and validate existance
             Result = UsbSchedulerGetPoolFromElement(Scheduler, ExistingElement, &ExistingPool);
@@ -85,8 +89,13 @@ UsbSchedulerLinkPeriodicElement(
             // @todo as this will break the linkage
 
             // Iterate to correct spot based on interval
-            while (ExistingObject->BreathIndex != USB_ELEMENT_NO_INDEX && ExistingObject != sObject) {
-                if (sObject->FrameInterval > ExistingObject->FrameInterval) {
+            while (ExistingObject != NULL && ExistingObject != sObject
+                   && ExistingObject->FrameInterval >= sObject->FrameInterval) {
+                PreviousObject  = ExistingObject;
+                PreviousPool    = ExistingPool;
+                PreviousElement = ExistingElement;
+                if (ExistingObject->BreathIndex == USB_ELEMENT_NO_INDEX) {
+                    ExistingObject = NULL;
                     break;
                 }
 
@@ -96,27 +105,28 @@ UsbSchedulerLinkPeriodicElement(
                 ExistingObject  = USB_ELEMENT_OBJECT(ExistingPool, ExistingElement);
             }
 
-            // Link us in only if we are not ourselves
-            if (ExistingObject != sObject) {
-                // Two insertion cases. To front or not to front
-                // We must have a larger interval and existingelement must be front
-                if (ExistingElement == (uint8_t*)Scheduler->VirtualFrameList[i] &&
-                    sObject->FrameInterval > ExistingObject->FrameInterval) {
-                    USB_ELEMENT_LINK(sPool, Element, USB_CHAIN_BREATH) = Scheduler->Settings.FrameList[i];
-                    sObject->BreathIndex                               = ExistingObject->Index;
-                    dma_mb();
-                    Scheduler->VirtualFrameList[i]   = (uintptr_t)Element;
-                    Scheduler->Settings.FrameList[i] = LODWORD(PhysicalAddress) | USB_ELEMENT_LINKFLAGS(sObject->Flags); //@todo if 64 bit support in xhci
-                    dma_wmb();
-                }
-                else {
-                    USB_ELEMENT_LINK(sPool, Element, USB_CHAIN_BREATH) = USB_ELEMENT_LINK(ExistingPool, ExistingElement, USB_CHAIN_BREATH);
-                    sObject->BreathIndex                               = ExistingObject->BreathIndex;
-                    dma_mb();
-                    USB_ELEMENT_LINK(ExistingPool, ExistingElement, USB_CHAIN_BREATH) = LODWORD(PhysicalAddress) | USB_ELEMENT_LINKFLAGS(sObject->Flags);
-                    ExistingObject->BreathIndex                                       = sObject->Index;
-                    dma_wmb();
-                }
+            // We are already reachable if an element with a longer period linked us in one
+            // of our earlier frames
+            if (ExistingObject == sObject) {
+                continue;
+            }
+
+            // Two insertion cases. To front or not to front
+            if (PreviousObject == NULL) {
+                USB_ELEMENT_LINK(sPool, Element, USB_CHAIN_BREATH) = Scheduler->Settings.FrameList[i];
+                sObject->BreathIndex                               = ExistingObject->Index;
+                dma_mb();
+                Scheduler->VirtualFrameList[i]   = (uintptr_t)Element;
+                Scheduler->Settings.FrameList[i] = LODWORD(PhysicalAddress) | USB_ELEMENT_LINKFLAGS(sObject->Flags); //@todo if 64 bit support in xhci
+                dma_wmb();
+            }
+            else {
+                USB_ELEMENT_LINK(sPool, Element, USB_CHAIN_BREATH) = USB_ELEMENT_LINK(PreviousPool, PreviousElement, USB_CHAIN_BREATH);
+                sObject->BreathIndex                               = PreviousObject->BreathIndex;
+                dma_mb();
+                USB_ELEMENT_LINK(PreviousPool, PreviousElement, USB_CHAIN_BREATH) = LODWORD(PhysicalAddress) | USB_ELEMENT_LINKFLAGS(sObject->Flags);
+                PreviousObject->BreathIndex                                       = sObject->Index;
+                dma_wmb();
             }
         }
     }
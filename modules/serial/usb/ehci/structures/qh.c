@@ -113,10 +113,12 @@ EhciQhInitialize(
             // FSTN links for low/full speed interrupt transfers. But as the allocator
             // works this never happens as it only allocates in same frame. If this
             // changes we need to update this @todo
-            Qh->FrameStartMask  = (uint8_t)FirstSetBit(Qh->Object.FrameMask);
+            // The allocator hands out a window of consecutive microframes, the first
+            // microframe of the window is used for the start-split
+            Qh->FrameStartMask  = (uint8_t)(Qh->Object.FrameMask & -Qh->Object.FrameMask);
             if (Transfer->Transfer.Speed != HighSpeed) {
                 Qh->FrameCompletionMask = (uint8_t)(Qh->Object.FrameMask & 0xFF);
-                Qh->FrameCompletionMask &= ~(1 << Qh->FrameStartMask);
+                Qh->FrameCompletionMask &= ~(Qh->FrameStartMask);
             }
             else {
                 Qh->FrameCompletionMask = 0;
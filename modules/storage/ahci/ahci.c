@@ -88,10 +88,26 @@ AhciControllerCreate(
     RegisterFastInterruptMemoryResource(&Controller->Device.Interrupt, 
         (uintptr_t)&Controller->InterruptResource, sizeof(AhciInterruptResource_t), 0);
 
-    // Register interrupt
+    // Register interrupt, prefer a message signaled vector of our own over the shared line
     TRACE(" > ahci interrupt line is %u", Controller->Device.Interrupt.Line);
     RegisterInterruptContext(&Controller->Device.Interrupt, Controller);
-    Controller->InterruptId = RegisterInterruptSource(&Controller->Device.Interrupt, INTERRUPT_USERSPACE);
+    Controller->InterruptId = UUID_INVALID;
+    if (Controller->Device.Interrupt.Msi.Vectors > 0) {
+        DeviceInterrupt_t MsiInterrupt;
+        memcpy(&MsiInterrupt, &Controller->Device.Interrupt, sizeof(DeviceInterrupt_t));
+        MsiInterrupt.Line       = INTERRUPT_NONE;
+        Controller->InterruptId = RegisterInterruptSource(&MsiInterrupt, INTERRUPT_USERSPACE | INTERRUPT_MSI);
+        if (Controller->InterruptId != UUID_INVALID &&
+            EnableDeviceMsi(&Controller->Device, 0, &MsiInterrupt) != OsSuccess) {
+            WARNING("Failed to enable msi for the ahci-controller, using the interrupt line");
+            UnregisterInterruptSource(Controller->InterruptId);
+            Controller->InterruptId = UUID_INVALID;
+        }
+    }
+
+    if (Controller->InterruptId == UUID_INVALID) {
+        Controller->InterruptId = RegisterInterruptSource(&Controller->Device.Interrupt, INTERRUPT_USERSPACE);
+    }
 
     // Enable device
     Status = IoctlDevice(Controller->Device.Id, __DEVICEMANAGER_IOCTL_BUS,
@@ -325,6 +325,9 @@ typedef struct _AhciPort {
 
     _Atomic(int)            Slots;
     int                     SlotCount;
+    reg32_t                 IssuedSlots;    // Slots that have been written to PxCI
+    reg32_t                 QueuedSlots;    // Subset of the issued slots that are NCQ commands
+    int                     QueueDepth;     // Max outstanding NCQ commands, 0 if NCQ is not in use
     Collection_t*           Transactions;
 } AhciPort_t;
 
@@ -419,10 +422,19 @@ AhciPortFreeCommandSlot(
     _In_ int         Slot);
 
 /* AhciPortStartCommandSlot
- * Starts a command slot on the given port */
+ * Starts a command slot on the given port. Queued (NCQ) commands have their tag
+ * set in PxSACT before being issued. */
 __EXTERN void
 AhciPortStartCommandSlot(
     _In_ AhciPort_t*        Port, 
+    _In_ int                Slot,
+    _In_ int                Queued);
+
+/* AhciPortGetCommandTable
+ * Retrieves the command table that belongs to the given command slot. */
+__EXTERN void*
+AhciPortGetCommandTable(
+    _In_ AhciPort_t*        Port,
     _In_ int                Slot);
 
 /* AhciPortInterruptHandler
@@ -30,6 +30,7 @@
 #include "manager.h"
 #include "dispatch.h"
 #include <threads.h>
+#include <stdlib.h>
 
 static void
 DumpCurrentState(
@@ -139,9 +140,14 @@ PrepareCommandSlot(
 
     // Get a reference to the command slot and reset the data in the command table
     CommandList   = (AHCICommandList_t*)Port->CommandListDMA.buffer;
-    CommandTable  = (AHCICommandTable_t*)Port->CommandTableDMA.buffer;
+    CommandTable  = (AHCICommandTable_t*)AhciPortGetCommandTable(Port, Transaction->Slot);
     CommandHeader = &CommandList->Headers[Transaction->Slot];
 
+    // Store the current position so an aborted queued command can be re-issued
+    Transaction->Rewind.SgIndex   = Transaction->SgIndex;
+    Transaction->Rewind.SgOffset  = Transaction->SgOffset;
+    Transaction->Rewind.BytesLeft = Transaction->BytesLeft;
+
     // Build the PRDT table
     BuildPRDTTable(Transaction, CommandTable, SectorSize, &PrdtCount);
 
@@ -185,7 +191,7 @@ DispatchCommand(
     }
 
     CommandList   = (AHCICommandList_t*)Port->CommandListDMA.buffer;
-    CommandTable  = (AHCICommandTable_t*)Port->CommandTableDMA.buffer;
+    CommandTable  = (AHCICommandTable_t*)AhciPortGetCommandTable(Port, Transaction->Slot);
     CommandHeader = &CommandList->Headers[Transaction->Slot];
 
     if (AtaCommand != NULL) {
@@ -218,7 +224,7 @@ DispatchCommand(
     CommandHeader->Flags |= (DISPATCH_MULTIPLIER(Flags) << 12);
     
     TRACE("Enabling command on slot %u", Transaction->Slot);
-    AhciPortStartCommandSlot(Port, Transaction->Slot);
+    AhciPortStartCommandSlot(Port, Transaction->Slot, (Flags & DISPATCH_QUEUED) ? 1 : 0);
 
 #ifdef __TRACE
     // Dump state
@@ -262,6 +268,15 @@ ComposeRegisterFIS(
     Fis->Command = LOBYTE(Transaction->Command);
     Fis->Device  = 0x40 | ((LOBYTE(DeviceLUN) & 0x1) << 4);
     Fis->Count   = (uint16_t)SectorCount;
+
+    // FPDMA commands carry the sector count in the features register, and
+    // the tag in bits 7:3 of the count register
+    if (Transaction->Queued) {
+        Fis->FeaturesLow  = LOBYTE(SectorCount);
+        Fis->FeaturesHigh = (uint8_t)((SectorCount >> 8) & 0xFF);
+        Fis->Count        = (uint16_t)((Transaction->Slot & 0x1F) << 3);
+        Fis->Device       = 0x40;
+    }
     
     // Handle LBA to CHS translation if disk uses
     // the CHS scheme
@@ -303,6 +318,7 @@ AhciDispatchRegisterFIS(
     
     // Initialize the command
     BytesQueued = PrepareCommandSlot(Port, Transaction, Transaction->Target.SectorSize);
+    Transaction->SectorsQueued = BytesQueued / Transaction->Target.SectorSize;
     ComposeRegisterFIS(Transaction, &Fis, BytesQueued, 
         Transaction->Target.SectorSize, Transaction->Target.AddressingMode);
     
@@ -316,5 +332,55 @@ AhciDispatchRegisterFIS(
     if (Transaction->Direction == AHCI_XACTION_OUT) {
         Flags |= DISPATCH_WRITE;
     }
+
+    if (Transaction->Queued) {
+        Flags |= DISPATCH_QUEUED;
+    }
     return DispatchCommand(Controller, Port, Transaction, Flags, &Fis, sizeof(FISRegisterH2D_t), NULL, 0);
 }
+
+OsStatus_t
+AhciDispatchReadLogSync(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port,
+    _In_ uint8_t           LogAddress)
+{
+    AhciTransaction_t Transaction = { { 0 } };
+    OsStatus_t        Status;
+    int               Hung = 0;
+
+    // READ LOG EXT encodes the log address in LBA 7:0 and the page in LBA 15:8
+    Transaction.Internal  = 1;
+    Transaction.Type      = TransactionRegisterFISH2D;
+    Transaction.Command   = AtaPIOReadLogExt;
+    Transaction.Direction = AHCI_XACTION_IN;
+    Transaction.Sector    = LogAddress;
+    Transaction.BytesLeft = 512;
+    Transaction.Target.Type           = DeviceATA;
+    Transaction.Target.SectorSize     = 512;
+    Transaction.Target.AddressingMode = AHCI_DEVICE_MODE_LBA48;
+
+    Status = dma_get_sg_table(&Port->InternalBuffer, &Transaction.DmaTable, -1);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    Status = AhciPortAllocateCommandSlot(Port, &Transaction.Slot);
+    if (Status != OsSuccess) {
+        free(Transaction.DmaTable.entries);
+        return Status;
+    }
+
+    Status = AhciDispatchRegisterFIS(Controller, Port, &Transaction);
+    if (Status == OsSuccess) {
+        WaitForConditionWithFault(Hung,
+            (READ_VOLATILE(Port->Registers->CommandIssue) & (1U << Transaction.Slot)) == 0, 10, 10);
+        if (Hung || (READ_VOLATILE(Port->Registers->TaskFileData) & AHCI_PORT_TFD_ERR)) {
+            Status = OsDeviceError;
+        }
+    }
+
+    AhciPortFreeCommandSlot(Port, Transaction.Slot);
+    free(Transaction.DmaTable.entries);
+    return Status;
+}
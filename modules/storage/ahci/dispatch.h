@@ -36,6 +36,7 @@
 #define DISPATCH_PREFETCH               0x20
 #define DISPATCH_CLEARBUSY              0x40
 #define DISPATCH_ATAPI                  0x80
+#define DISPATCH_QUEUED                 0x100 // Command is issued as an NCQ (FPDMA) command
 
 /**
  * AhciDispatchRegisterFIS 
@@ -47,4 +48,16 @@ AhciDispatchRegisterFIS(
     _In_ AhciPort_t*        Port,
     _In_ AhciTransaction_t* Transaction);
 
+/**
+ * AhciDispatchReadLogSync
+ * * Reads a single page of a general purpose log into the ports internal buffer by polling
+ *   a free command slot. Only used during error recovery where the port has been restarted
+ *   and the slots of the discarded commands have been released.
+ */
+__EXTERN OsStatus_t
+AhciDispatchReadLogSync(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port,
+    _In_ uint8_t           LogAddress);
+
 #endif //!__AHCI_DISPATCH_H__
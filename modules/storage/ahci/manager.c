@@ -253,6 +253,17 @@ HandleIdentifyCommand(
         Device->AddressingMode = 0; // CHS
     }
 
+    // Enable native command queuing if both the controller and the device supports it. We
+    // only use the FPDMA commands, so require DMA and LBA48 as well
+    Device->Port->QueueDepth = 0;
+    if ((READ_VOLATILE(Device->Controller->Registers->Capabilities) & AHCI_CAPABILITIES_SNCQ) &&
+        (DeviceInformation->SataCapabilities & (1 << 8)) &&
+        Device->HasDMAEngine && Device->AddressingMode == 2) {
+        Device->Port->QueueDepth = MIN((int)(DeviceInformation->QueueDepth & 0x1F) + 1,
+            Device->Port->SlotCount);
+        TRACE("HandleIdentifyCommand queue depth %i", Device->Port->QueueDepth);
+    }
+
     // Calculate sector size if neccessary
     if (DeviceInformation->SectorSize & (1 << 12)) {
         Device->SectorSize = DeviceInformation->WordsPerLogicalSector * 2;
@@ -82,6 +82,8 @@ typedef struct AhciTransation {
     TransactionType_t     Type;
     AtaCommand_t          Command;
     int                   Slot;
+    int                   Queued;      // Issued as READ/WRITE FPDMA QUEUED
+    int                   DeviceError; // Set by NCQ error recovery for the failing tag
     int                   Direction;
     AHCIFis_t             Response;
     struct dma_attachment DmaAttachment;
@@ -101,6 +103,14 @@ typedef struct AhciTransation {
     int                   SgIndex;
     size_t                SgOffset;
     
+    // State before the last dispatch, so aborted NCQ commands can be re-issued
+    struct {
+        int    SgIndex;
+        size_t SgOffset;
+        size_t BytesLeft;
+    } Rewind;
+    size_t                SectorsQueued;
+    
     struct vali_link_deferred_response DeferredMessage;
 } AhciTransaction_t;
 
@@ -155,4 +165,35 @@ AhciTransactionHandleResponse(
     _In_ AhciPort_t*        Port,
     _In_ AhciTransaction_t* Transaction);
 
+/**
+ * AhciTransactionDispatchQueued
+ * * Issues transactions that were waiting for a free command slot, in the order they were queued.
+ */
+void
+AhciTransactionDispatchQueued(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port);
+
+/**
+ * AhciTransactionReleaseQueued
+ * * Called after the port has been restarted due to a failed NCQ command. The restart discarded
+ *   all outstanding commands, so their command slots are released. The transactions keep their
+ *   tag until AhciTransactionRecoverQueued has matched them against the NCQ error log.
+ */
+void
+AhciTransactionReleaseQueued(
+    _In_ AhciPort_t* Port);
+
+/**
+ * AhciTransactionRecoverQueued
+ * * Called after AhciTransactionReleaseQueued. The transaction on the failed tag is completed
+ *   with an error, all other outstanding commands are re-issued.
+ * @param FailedSlot [In] The tag reported by the NCQ error log, or -1 if unknown.
+ */
+void
+AhciTransactionRecoverQueued(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port,
+    _In_ int               FailedSlot);
+
 #endif //!_AHCI_MANAGER_H_
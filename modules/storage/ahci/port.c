@@ -275,7 +275,7 @@ AhciPortRebase(
 
         PhysicalAddress           += AHCI_COMMAND_TABLE_SIZE;
         SgTable.entries[j].length -= AHCI_COMMAND_TABLE_SIZE;
-        if (!SgTable.entries[j].length) {
+        if (!SgTable.entries[j].length && (j + 1) < SgTable.count) {
             j++;
             PhysicalAddress = SgTable.entries[j].address;
         }
@@ -336,7 +336,7 @@ AhciPortStart(
 
     // Setup the physical data addresses
     dma_get_sg_table(&Port->RecievedFisDMA, &DmaTable, -1);
-    WRITE_VOLATILE(Port->Registers->FISBaseAddress, LOWORD(DmaTable.entries[0].address));
+    WRITE_VOLATILE(Port->Registers->FISBaseAddress, LODWORD(DmaTable.entries[0].address));
     if (Caps & AHCI_CAPABILITIES_S64A) {
         WRITE_VOLATILE(Port->Registers->FISBaseAdressUpper,
             (sizeof(void*) > 4) ? HIDWORD(DmaTable.entries[0].address) : 0);
@@ -359,7 +359,8 @@ AhciPortStart(
 
     // Setup the interesting interrupts we want
     WRITE_VOLATILE(Port->Registers->InterruptEnable, (reg32_t)(AHCI_PORT_IE_CPDE | AHCI_PORT_IE_TFEE
-        | AHCI_PORT_IE_PCE | AHCI_PORT_IE_DSE | AHCI_PORT_IE_PSE | AHCI_PORT_IE_DHRE));
+        | AHCI_PORT_IE_PCE | AHCI_PORT_IE_DSE | AHCI_PORT_IE_PSE | AHCI_PORT_IE_DHRE
+        | AHCI_PORT_IE_SDBE));
 
     // Make sure AHCI_PORT_CR and AHCI_PORT_FR is not set
     WaitForConditionWithFault(Hung, (
@@ -379,12 +380,27 @@ AhciPortStart(
     return AhciPortEnable(Controller, Port);
 }
 
+void*
+AhciPortGetCommandTable(
+    _In_ AhciPort_t* Port,
+    _In_ int         Slot)
+{
+    return (void*)((uint8_t*)Port->CommandTableDMA.buffer + (Slot * AHCI_COMMAND_TABLE_SIZE));
+}
+
 void
 AhciPortStartCommandSlot(
     _In_ AhciPort_t* Port, 
-    _In_ int         Slot)
+    _In_ int         Slot,
+    _In_ int         Queued)
 {
-    WRITE_VOLATILE(Port->Registers->CommandIssue, (1 << Slot));
+    // The tag must be set in PxSACT before the command is issued for FPDMA commands
+    if (Queued) {
+        Port->QueuedSlots |= (1U << Slot);
+        WRITE_VOLATILE(Port->Registers->AtaActive, (1U << Slot));
+    }
+    WRITE_VOLATILE(Port->Registers->CommandIssue, (1U << Slot));
+    Port->IssuedSlots |= (1U << Slot);
 }
 
 OsStatus_t
@@ -392,27 +408,24 @@ AhciPortAllocateCommandSlot(
     _In_  AhciPort_t* Port,
     _Out_ int*        SlotOut)
 {
-    OsStatus_t Status = OsError;
-    int        Slots;
-    int        i;
+    int Slots = atomic_load(&Port->Slots);
+    int i;
     
-    while (Status != OsSuccess) {
-        Slots = atomic_load(&Port->Slots);
-        
-        for (i = 0; i < Port->SlotCount; i++) {
-            // Check availability status on this command slot
-            if (Slots & (1 << i)) {
-                continue;
-            }
-
-            if (atomic_compare_exchange_strong(&Port->Slots, &Slots, Slots | (1 << i))) {
-                Status   = OsSuccess;
-                *SlotOut = i;
-            }
-            break;
+    for (i = 0; i < Port->SlotCount; i++) {
+        // Check availability status on this command slot
+        if (Slots & (1U << i)) {
+            continue;
         }
+
+        if (atomic_compare_exchange_strong(&Port->Slots, &Slots, Slots | (1U << i))) {
+            *SlotOut = i;
+            return OsSuccess;
+        }
+
+        // Slots was updated by the failed exchange, restart the scan
+        i = -1;
     }
-    return Status;
+    return OsBusy;
 }
 
 void
@@ -420,19 +433,117 @@ AhciPortFreeCommandSlot(
     _In_ AhciPort_t* Port,
     _In_ int         Slot)
 {
-    
+    Port->IssuedSlots &= ~(1U << Slot);
+    Port->QueuedSlots &= ~(1U << Slot);
+    atomic_fetch_and(&Port->Slots, ~(1U << Slot));
 }
 
-void
-AhciPortInterruptHandler(
-    _In_ AhciController_t* Controller, 
+static int
+AhciPortRestartEngine(
+    _In_ AhciPort_t* Port)
+{
+    reg32_t Status;
+    int     Hung = 0;
+
+    // Clearing PxCMD.ST resets PxCI and PxSACT, all outstanding commands are lost
+    Status = READ_VOLATILE(Port->Registers->CommandAndStatus);
+    WRITE_VOLATILE(Port->Registers->CommandAndStatus, Status & ~AHCI_PORT_ST);
+    WaitForConditionWithFault(Hung, (READ_VOLATILE(Port->Registers->CommandAndStatus) & AHCI_PORT_CR) == 0, 6, 100);
+    if (Hung) {
+        return Hung;
+    }
+
+    WRITE_VOLATILE(Port->Registers->AtaError, 0xFFFFFFFF);
+    WRITE_VOLATILE(Port->Registers->InterruptStatus, 0xFFFFFFFF);
+
+    Status = READ_VOLATILE(Port->Registers->CommandAndStatus);
+    WRITE_VOLATILE(Port->Registers->CommandAndStatus, Status | AHCI_PORT_ST);
+    WaitForConditionWithFault(Hung, READ_VOLATILE(Port->Registers->CommandAndStatus) & AHCI_PORT_CR, 6, 100);
+    return Hung;
+}
+
+/* AhciPortRecoverQueued
+ * A task file error with NCQ commands outstanding aborts the entire queue on the device.
+ * Restart the command engine, read the NCQ error log to find the failing tag and let
+ * the transaction layer fail that one and re-issue the rest. */
+static void
+AhciPortRecoverQueued(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port)
+{
+    ATANcqErrorLog_t* ErrorLog   = (ATANcqErrorLog_t*)Port->InternalBuffer.buffer;
+    int               FailedSlot = -1;
+    int               Hung;
+
+    WARNING("AHCI::Port %i: NCQ error, active 0x%x, recovering", Port->Id, Port->QueuedSlots);
+    Hung = AhciPortRestartEngine(Port);
+
+    // The port must be idle before the error log is read, so release the slots of
+    // the discarded commands first
+    AhciTransactionReleaseQueued(Port);
+    if (Hung) {
+        ERROR("AHCI::Port %i: command engine failed to restart: 0x%x",
+            Port->Id, Port->Registers->CommandAndStatus);
+    }
+    else if (AhciDispatchReadLogSync(Controller, Port, ATA_LOG_NCQ_COMMAND_ERROR) == OsSuccess) {
+        if (!(ErrorLog->Tag & ATA_NCQ_LOG_NQ)) {
+            FailedSlot = ATA_NCQ_LOG_TAG(ErrorLog);
+            PrintTaskDataErrorString(ErrorLog->Error);
+        }
+    }
+    else {
+        // The failed log read left the port in an error state of its own, it must be
+        // restarted again before the waiting transactions are issued
+        ERROR("AHCI::Port %i: failed to read the NCQ error log", Port->Id);
+        (void)AhciPortRestartEngine(Port);
+    }
+    AhciTransactionRecoverQueued(Controller, Port, FailedSlot);
+}
+
+/* AhciPortCompleteCommands
+ * Completes the transactions of the commands that are done, by using our own slot-status.
+ * Non-queued commands are done when their PxCI bit clears, queued commands when their
+ * PxSACT bit clears. Returns the slots that were completed. */
+static reg32_t
+AhciPortCompleteCommands(
+    _In_ AhciController_t* Controller,
     _In_ AhciPort_t*       Port)
 {
     AhciTransaction_t* Transaction;
-    reg32_t            InterruptStatus;
     reg32_t            DoneCommands;
     DataKey_t          Key;
     int                i;
+
+    DoneCommands = Port->IssuedSlots & ~(READ_VOLATILE(Port->Registers->CommandIssue) | 
+        READ_VOLATILE(Port->Registers->AtaActive));
+    TRACE("DoneCommands(0x%x) <= Issued(0x%x), CommandIssue(0x%x), AtaActive(0x%x)", 
+        DoneCommands, Port->IssuedSlots, Port->Registers->CommandIssue, Port->Registers->AtaActive);
+
+    for (i = 0; i < Port->SlotCount && DoneCommands; i++) {
+        if (DoneCommands & (1U << i)) {
+            Key.Value.Integer = i;
+            Transaction       = (AhciTransaction_t*)CollectionGetNodeByKey(Port->Transactions, Key, 0);                
+            assert(Transaction != NULL);
+
+            // Handle transaction completion, release slot, queue up a new command if any
+            // and then handle the event
+            CollectionRemoveByNode(Port->Transactions, &Transaction->Header);
+            memcpy((void*)&Transaction->Response, Port->RecievedFisDMA.buffer, sizeof(AHCIFis_t));
+            AhciPortFreeCommandSlot(Port, Transaction->Slot);
+            Transaction->Slot = -1;
+
+            AhciTransactionHandleResponse(Controller, Port, Transaction);
+        }
+    }
+    return DoneCommands;
+}
+
+void
+AhciPortInterruptHandler(
+    _In_ AhciController_t* Controller, 
+    _In_ AhciPort_t*       Port)
+{
+    reg32_t InterruptStatus;
     
     // Check interrupt services 
     // Cold port detect, recieved fis etc
@@ -446,7 +557,13 @@ HandleInterrupt:
     // Check for errors status's
     if (InterruptStatus & (AHCI_PORT_IE_TFEE | AHCI_PORT_IE_HBFE 
         | AHCI_PORT_IE_HBDE | AHCI_PORT_IE_IFE | AHCI_PORT_IE_INFE)) {
-        if (InterruptStatus & AHCI_PORT_IE_TFEE) {
+        if ((InterruptStatus & AHCI_PORT_IE_TFEE) && Port->QueuedSlots) {
+            // Queued commands that finished before the error already had their PxSACT bit
+            // cleared, they must be completed before the restart discards the rest
+            (void)AhciPortCompleteCommands(Controller, Port);
+            AhciPortRecoverQueued(Controller, Port);
+        }
+        else if (InterruptStatus & AHCI_PORT_IE_TFEE) {
             PrintTaskDataErrorString(HIBYTE(Port->Registers->TaskFileData));
         }
         else {
@@ -474,30 +591,9 @@ HandleInterrupt:
         }
     }
 
-    // Get completed commands, by using our own slot-status
-    DoneCommands = atomic_load(&Port->Slots) ^ READ_VOLATILE(Port->Registers->AtaActive);
-    TRACE("DoneCommands(0x%x) <= SlotStatus(0x%x) ^ AtaActive(0x%x)", 
-        DoneCommands, atomic_load(&Port->Slots), Port->Registers->AtaActive);
-
     // Check for command completion
-    // by iterating through the command slots
-    if (DoneCommands != 0) {
-        for (i = 0; i < AHCI_MAX_PORTS; i++) {
-            if (DoneCommands & (1 << i)) {
-                Key.Value.Integer = i;
-                Transaction       = (AhciTransaction_t*)CollectionGetNodeByKey(Port->Transactions, Key, 0);                
-                assert(Transaction != NULL);
-
-                // Handle transaction completion, release slot, queue up a new command if any
-                // and then handle the event
-                CollectionRemoveByNode(Port->Transactions, &Transaction->Header);
-                memcpy((void*)&Transaction->Response, Port->RecievedFisDMA.buffer, sizeof(AHCIFis_t));
-                AhciPortFreeCommandSlot(Port, Transaction->Slot);
-                Transaction->Slot = -1;
-
-                AhciTransactionHandleResponse(Controller, Port, Transaction);
-            }
-        }
+    if (AhciPortCompleteCommands(Controller, Port)) {
+        AhciTransactionDispatchQueued(Controller, Port);
     }
 
     // Re-handle?
@@ -39,46 +39,76 @@ static struct {
     int          Direction;
     int          DMA;
     int          AddressingMode;
+    int          Queued;
     AtaCommand_t Command;
     size_t       SectorAlignment;
     size_t       MaxSectors;
 } CommandTable[] = {
-    { __STORAGE_OPERATION_READ, 0, 2, AtaPIOReadExt, 1, 0xFFFF },
-    { __STORAGE_OPERATION_READ, 0, 1, AtaPIORead, 1, 0xFF },
-    { __STORAGE_OPERATION_READ, 0, 0, AtaPIORead, 1, 0xFF },
-    { __STORAGE_OPERATION_READ, 1, 2, AtaDMAReadExt, 1, 0xFFFF },
-    { __STORAGE_OPERATION_READ, 1, 1, AtaDMARead, 1, 0xFF },
-    { __STORAGE_OPERATION_READ, 1, 0, AtaDMARead, 1, 0xFF },
+    { __STORAGE_OPERATION_READ, 1, 2, 1, AtaFPDMAReadQueued, 1, 0xFFFF },
+    { __STORAGE_OPERATION_READ, 0, 2, 0, AtaPIOReadExt, 1, 0xFFFF },
+    { __STORAGE_OPERATION_READ, 0, 1, 0, AtaPIORead, 1, 0xFF },
+    { __STORAGE_OPERATION_READ, 0, 0, 0, AtaPIORead, 1, 0xFF },
+    { __STORAGE_OPERATION_READ, 1, 2, 0, AtaDMAReadExt, 1, 0xFFFF },
+    { __STORAGE_OPERATION_READ, 1, 1, 0, AtaDMARead, 1, 0xFF },
+    { __STORAGE_OPERATION_READ, 1, 0, 0, AtaDMARead, 1, 0xFF },
     
-    { __STORAGE_OPERATION_WRITE, 0, 2, AtaPIOWriteExt, 1, 0xFFFF },
-    { __STORAGE_OPERATION_WRITE, 0, 1, AtaPIOWrite, 1, 0xFF },
-    { __STORAGE_OPERATION_WRITE, 0, 0, AtaPIOWrite, 1, 0xFF },
-    { __STORAGE_OPERATION_WRITE, 1, 2, AtaDMAWriteExt, 1, 0xFFFF },
-    { __STORAGE_OPERATION_WRITE, 1, 1, AtaDMAWrite, 1, 0xFF },
-    { __STORAGE_OPERATION_WRITE, 1, 0, AtaDMAWrite, 1, 0xFF },
-    { -1, -1, -1, 0, 0, 0 }
+    { __STORAGE_OPERATION_WRITE, 1, 2, 1, AtaFPDMAWriteQueued, 1, 0xFFFF },
+    { __STORAGE_OPERATION_WRITE, 0, 2, 0, AtaPIOWriteExt, 1, 0xFFFF },
+    { __STORAGE_OPERATION_WRITE, 0, 1, 0, AtaPIOWrite, 1, 0xFF },
+    { __STORAGE_OPERATION_WRITE, 0, 0, 0, AtaPIOWrite, 1, 0xFF },
+    { __STORAGE_OPERATION_WRITE, 1, 2, 0, AtaDMAWriteExt, 1, 0xFFFF },
+    { __STORAGE_OPERATION_WRITE, 1, 1, 0, AtaDMAWrite, 1, 0xFF },
+    { __STORAGE_OPERATION_WRITE, 1, 0, 0, AtaDMAWrite, 1, 0xFF },
+    { -1, -1, -1, -1, 0, 0, 0 }
 };
 
+static void CompleteTransaction(AhciPort_t*, AhciTransaction_t*, OsStatus_t);
+
+static int
+HasWaitingTransactions(
+    _In_ AhciPort_t* Port)
+{
+    foreach(Node, Port->Transactions) {
+        if (((AhciTransaction_t*)Node)->State == TransactionQueued) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+CanIssueTransaction(
+    _In_ AhciPort_t*        Port,
+    _In_ AhciTransaction_t* Transaction)
+{
+    int Slots = atomic_load(&Port->Slots);
+
+    // Queued and non-queued commands can never be outstanding at the same time, and
+    // only one non-queued command is allowed as they share the received FIS area
+    if (Transaction->Queued) {
+        return (Slots & ~Port->QueuedSlots) == 0 &&
+            __builtin_popcount(Port->QueuedSlots) < Port->QueueDepth;
+    }
+    return Slots == 0;
+}
+
 static OsStatus_t
-QueueTransaction(
+IssueTransaction(
     _In_ AhciController_t*  Controller,
     _In_ AhciPort_t*        Port,
     _In_ AhciTransaction_t* Transaction)
 {
     OsStatus_t Status;
-    
-    // OK so the transaction we just recieved needs to be queued up,
-    // so we must initally see if we can allocate a new slot on the port
+
     Status = AhciPortAllocateCommandSlot(Port, &Transaction->Slot);
-    CollectionAppend(Port->Transactions, &Transaction->Header);
     if (Status != OsSuccess) {
-        Transaction->State = TransactionQueued;
-        return OsSuccess;
+        Transaction->Slot = -1;
+        return Status;
     }
     
-    // If we reach here we've successfully allocated a slot, now we should dispatch 
-    // the transaction
-    Transaction->State = TransactionInProgress;
+    // Transactions in progress are looked up by their slot on completion
+    Transaction->Header.Key.Value.Integer = Transaction->Slot;
+    Transaction->State                    = TransactionInProgress;
     switch (Transaction->Type) {
         case TransactionRegisterFISH2D: {
             Status = AhciDispatchRegisterFIS(Controller, Port, Transaction);
@@ -90,12 +120,130 @@ QueueTransaction(
     }
     
     if (Status != OsSuccess) {
-        CollectionRemoveByNode(Port->Transactions, &Transaction->Header);
         AhciPortFreeCommandSlot(Port, Transaction->Slot);
+        Transaction->Header.Key.Value.Integer = -1;
+        Transaction->Slot                     = -1;
+    }
+    return Status;
+}
+
+static OsStatus_t
+QueueTransaction(
+    _In_ AhciController_t*  Controller,
+    _In_ AhciPort_t*        Port,
+    _In_ AhciTransaction_t* Transaction)
+{
+    OsStatus_t Status = OsBusy;
+    int        Waiting = HasWaitingTransactions(Port);
+    
+    // OK so the transaction we just recieved needs to be queued up, keep ordering by
+    // not letting it bypass any transactions that are already waiting for a slot
+    Transaction->Header.Key.Value.Integer = -1;
+    CollectionAppend(Port->Transactions, &Transaction->Header);
+    if (!Waiting && CanIssueTransaction(Port, Transaction)) {
+        Status = IssueTransaction(Controller, Port, Transaction);
+    }
+
+    if (Status == OsBusy) {
+        Transaction->State = TransactionQueued;
+        return OsSuccess;
+    }
+    
+    if (Status != OsSuccess) {
+        CollectionRemoveByNode(Port->Transactions, &Transaction->Header);
     }
     return Status;
 }
 
+void
+AhciTransactionDispatchQueued(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port)
+{
+    AhciTransaction_t* Transaction;
+    OsStatus_t         Status;
+
+    while (1) {
+        Transaction = NULL;
+        foreach(Node, Port->Transactions) {
+            if (((AhciTransaction_t*)Node)->State == TransactionQueued) {
+                Transaction = (AhciTransaction_t*)Node;
+                break;
+            }
+        }
+
+        // Stop at the first transaction that can not be issued to keep ordering
+        if (!Transaction || !CanIssueTransaction(Port, Transaction)) {
+            break;
+        }
+
+        Status = IssueTransaction(Controller, Port, Transaction);
+        if (Status == OsBusy) {
+            Transaction->State = TransactionQueued;
+            break;
+        }
+        else if (Status != OsSuccess) {
+            CollectionRemoveByNode(Port->Transactions, &Transaction->Header);
+            CompleteTransaction(Port, Transaction, Status);
+        }
+    }
+}
+
+void
+AhciTransactionReleaseQueued(
+    _In_ AhciPort_t* Port)
+{
+    foreach(Node, Port->Transactions) {
+        AhciTransaction_t* Transaction = (AhciTransaction_t*)Node;
+        if (Transaction->State == TransactionInProgress && Transaction->Slot != -1) {
+            AhciPortFreeCommandSlot(Port, Transaction->Slot);
+        }
+    }
+}
+
+void
+AhciTransactionRecoverQueued(
+    _In_ AhciController_t* Controller,
+    _In_ AhciPort_t*       Port,
+    _In_ int               FailedSlot)
+{
+    AhciTransaction_t* Failed;
+
+    // The port restart discarded all outstanding commands and their slots have been
+    // released. Mark the one that failed, and rewind the rest so they are issued again. If we do not know which command
+    // failed, then we fail all of them, instead of risking retrying forever.
+    do {
+        Failed = NULL;
+        foreach(Node, Port->Transactions) {
+            AhciTransaction_t* Transaction = (AhciTransaction_t*)Node;
+            if (Transaction->State != TransactionInProgress) {
+                continue;
+            }
+
+            if (FailedSlot == -1 || Transaction->Slot == FailedSlot) {
+                Failed = Transaction;
+                break;
+            }
+
+            Transaction->SgIndex   = Transaction->Rewind.SgIndex;
+            Transaction->SgOffset  = Transaction->Rewind.SgOffset;
+            Transaction->BytesLeft = Transaction->Rewind.BytesLeft;
+            Transaction->State     = TransactionQueued;
+            Transaction->Slot      = -1;
+            Transaction->Header.Key.Value.Integer = -1;
+        }
+
+        if (Failed) {
+            CollectionRemoveByNode(Port->Transactions, &Failed->Header);
+            Failed->Slot        = -1;
+            Failed->DeviceError = 1;
+            AhciTransactionHandleResponse(Controller, Port, Failed);
+        }
+    } while (Failed);
+
+    AhciTransactionDispatchQueued(Controller, Port);
+}
+
 static OsStatus_t
 AhciTransactionDestroy(
     _In_ AhciTransaction_t* Transaction)
@@ -214,14 +362,17 @@ AhciTransactionStorageCreate(
         sectorCount = device->SectorCount - transaction->Sector;
     }
     
-    // Select the appropriate command
+    // Select the appropriate command, devices that support NCQ on a controller
+    // that supports it will get the FPDMA variants
     i = 0;
     while (CommandTable[i].Direction != -1) {
         if (CommandTable[i].Direction      == direction &&
             CommandTable[i].DMA            == device->HasDMAEngine &&
-            CommandTable[i].AddressingMode == device->AddressingMode) {
+            CommandTable[i].AddressingMode == device->AddressingMode &&
+            CommandTable[i].Queued         == (device->Port->QueueDepth > 0)) {
             // Found the appropriate command
             transaction->Command         = CommandTable[i].Command;
+            transaction->Queued          = CommandTable[i].Queued;
             transaction->SectorAlignment = CommandTable[i].SectorAlignment;
             transaction->BytesLeft       = MIN(sectorCount, CommandTable[i].MaxSectors) * device->SectorSize;
             break;
@@ -287,6 +438,16 @@ VerifyRegisterFISD2H(
 {
     FISRegisterD2H_t* Result = (FISRegisterD2H_t*)&Transaction->Response.RegisterD2H;
 
+    // Queued commands complete through a Set Device Bits FIS, errors are
+    // detected through the NCQ error log during recovery
+    if (Transaction->Queued) {
+        if (Transaction->DeviceError) {
+            return OsDeviceError;
+        }
+        Transaction->SectorsTransferred += Transaction->SectorsQueued;
+        return OsSuccess;
+    }
+
     // Is the error bit set?
     if (Result->Status & ATA_STS_DEV_ERROR) {
         PrintTaskDataErrorString(Result->Error);
@@ -325,14 +486,24 @@ AhciTransactionHandleResponse(
 
     // Is the transaction finished? (Or did it error?)
     if (status != OsSuccess || Transaction->BytesLeft == 0) {
-        if (Transaction->Internal) {
-            AhciManagerHandleControlResponse(Port, Transaction);
-        }
-        else {
-            ctt_storage_transfer_response(&Transaction->DeferredMessage.recv_message,
-                status, Transaction->SectorsTransferred);
-        }
-        return AhciTransactionDestroy(Transaction);
+        CompleteTransaction(Port, Transaction, status);
+        return OsSuccess;
     }
     return QueueTransaction(Controller, Port, Transaction);
 }
+
+static void
+CompleteTransaction(
+    _In_ AhciPort_t*        Port,
+    _In_ AhciTransaction_t* Transaction,
+    _In_ OsStatus_t         Status)
+{
+    if (Transaction->Internal) {
+        AhciManagerHandleControlResponse(Port, Transaction);
+    }
+    else {
+        ctt_storage_transfer_response(&Transaction->DeferredMessage.recv_message,
+            Status, Transaction->SectorsTransferred);
+    }
+    AhciTransactionDestroy(Transaction);
+}
@@ -178,7 +178,7 @@ MsdDevicePrepare(
     TRACE("MsdPrepareDevice()");
 
     // Allocate memory buffer
-    if (dma_pool_allocate(UsbRetrievePool(), sizeof(ScsiSense_t), 
+    if (dma_pool_cache_allocate(Device->BufferCache, sizeof(ScsiSense_t), 
         (void**)&SenseBlock) != OsSuccess) {
         ERROR("Failed to allocate buffer (sense)");
         return OsError;
@@ -189,7 +189,7 @@ MsdDevicePrepare(
         if (MsdScsiCommand(Device, 0, SCSI_TEST_UNIT_READY, 0, 0, 0, 0)
                 != TransferFinished) {
             ERROR("Failed to perform test-unit-ready command");
-            dma_pool_free(UsbRetrievePool(), (void*)SenseBlock);
+            dma_pool_cache_free(Device->BufferCache, (void*)SenseBlock);
             Device->IsReady = 0;
             return OsError;
         }
@@ -200,7 +200,7 @@ MsdDevicePrepare(
         dma_pool_handle(UsbRetrievePool()), dma_pool_offset(UsbRetrievePool(), SenseBlock), 
         sizeof(ScsiSense_t)) != TransferFinished) {
         ERROR("Failed to perform sense command");
-        dma_pool_free(UsbRetrievePool(), (void*)SenseBlock);
+        dma_pool_cache_free(Device->BufferCache, (void*)SenseBlock);
         Device->IsReady = 0;
         return OsError;
     }
@@ -208,7 +208,7 @@ MsdDevicePrepare(
     // Extract sense-codes and key
     ResponseCode = SCSI_SENSE_RESPONSECODE(SenseBlock->ResponseStatus);
     SenseKey = SCSI_SENSE_KEY(SenseBlock->Flags);
-    dma_pool_free(UsbRetrievePool(), (void*)SenseBlock);
+    dma_pool_cache_free(Device->BufferCache, (void*)SenseBlock);
 
     // Must be either 0x70, 0x71, 0x72, 0x73
     if (ResponseCode >= 0x70 && ResponseCode <= 0x73) {
@@ -233,7 +233,7 @@ MsdReadCapabilities(
     uint32_t *CapabilitesPointer = NULL;
 
     // Allocate buffer
-    if (dma_pool_allocate(UsbRetrievePool(), sizeof(ScsiExtendedCaps_t), 
+    if (dma_pool_cache_allocate(Device->BufferCache, sizeof(ScsiExtendedCaps_t), 
         (void**)&CapabilitesPointer) != OsSuccess) {
         ERROR("Failed to allocate buffer (caps)");
         return OsError;
@@ -243,7 +243,7 @@ MsdReadCapabilities(
     if (MsdScsiCommand(Device, 0, SCSI_READ_CAPACITY, 0, 
             dma_pool_handle(UsbRetrievePool()), dma_pool_offset(UsbRetrievePool(), CapabilitesPointer), 
             8) != TransferFinished) {
-        dma_pool_free(UsbRetrievePool(), (void*)CapabilitesPointer);
+        dma_pool_cache_free(Device->BufferCache, (void*)CapabilitesPointer);
         return OsError;
     }
 
@@ -257,7 +257,7 @@ MsdReadCapabilities(
         if (MsdScsiCommand(Device, 0, SCSI_READ_CAPACITY_16, 0, 
                 dma_pool_handle(UsbRetrievePool()), dma_pool_offset(UsbRetrievePool(), CapabilitesPointer),
                 sizeof(ScsiExtendedCaps_t)) != TransferFinished) {
-            dma_pool_free(UsbRetrievePool(), (void*)CapabilitesPointer);
+            dma_pool_cache_free(Device->BufferCache, (void*)CapabilitesPointer);
             return OsError;
         }
 
@@ -265,14 +265,14 @@ MsdReadCapabilities(
         Descriptor->SectorCount = rev64(ExtendedCaps->SectorCount) + 1;
         Descriptor->SectorSize = rev32(ExtendedCaps->SectorSize);
         Device->IsExtended = 1;
-        dma_pool_free(UsbRetrievePool(), (void*)CapabilitesPointer);
+        dma_pool_cache_free(Device->BufferCache, (void*)CapabilitesPointer);
         return OsSuccess;
     }
 
     // Capabilities are returned in reverse byte-order
     Descriptor->SectorCount = (uint64_t)rev32(CapabilitesPointer[0]) + 1;
     Descriptor->SectorSize = rev32(CapabilitesPointer[1]);
-    dma_pool_free(UsbRetrievePool(), (void*)CapabilitesPointer);
+    dma_pool_cache_free(Device->BufferCache, (void*)CapabilitesPointer);
     return OsSuccess;
 }
 
@@ -289,7 +289,7 @@ MsdDeviceStart(
     i = (Device->Protocol != ProtocolCB && Device->Protocol != ProtocolCBI) ? 30 : 3;
 
     // Allocate space for inquiry
-    if (dma_pool_allocate(UsbRetrievePool(), sizeof(ScsiInquiry_t), 
+    if (dma_pool_cache_allocate(Device->BufferCache, sizeof(ScsiInquiry_t), 
         (void**)&InquiryData) != OsSuccess) {
         ERROR("Failed to allocate buffer (inquiry)");
         return OsError;
@@ -300,7 +300,7 @@ MsdDeviceStart(
         dma_pool_handle(UsbRetrievePool()), dma_pool_offset(UsbRetrievePool(), InquiryData), sizeof(ScsiInquiry_t));
     if (Status != TransferFinished) {
         ERROR("Failed to perform the inquiry command on device: %u", Status);
-        dma_pool_free(UsbRetrievePool(), (void*)InquiryData);
+        dma_pool_cache_free(Device->BufferCache, (void*)InquiryData);
         return OsError;
     }
 
@@ -318,10 +318,10 @@ MsdDeviceStart(
     // ready otherwise we can't use it
     if (!Device->IsReady) {
         ERROR("Failed to ready device");
-        dma_pool_free(UsbRetrievePool(), (void*)InquiryData);
+        dma_pool_cache_free(Device->BufferCache, (void*)InquiryData);
         return OsError;
     }
-    dma_pool_free(UsbRetrievePool(), (void*)InquiryData);
+    dma_pool_cache_free(Device->BufferCache, (void*)InquiryData);
     return MsdReadCapabilities(Device);
 }
 
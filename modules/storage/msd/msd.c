@@ -155,12 +155,16 @@ MsdDeviceCreate(
     }
 
     // Allocate reusable buffers
-    if (dma_pool_allocate(UsbRetrievePool(), sizeof(MsdCommandBlock_t), 
+    if (dma_pool_cache_create(UsbRetrievePool(), &Device->BufferCache) != OsSuccess) {
+        ERROR("Failed to allocate buffer cache");
+        goto Error;
+    }
+    if (dma_pool_cache_allocate(Device->BufferCache, sizeof(MsdCommandBlock_t), 
         (void**)&Device->CommandBlock) != OsSuccess) {
         ERROR("Failed to allocate reusable buffer (command-block)");
         goto Error;
     }
-    if (dma_pool_allocate(UsbRetrievePool(), sizeof(MsdCommandStatus_t), 
+    if (dma_pool_cache_allocate(Device->BufferCache, sizeof(MsdCommandStatus_t), 
         (void**)&Device->StatusBlock) != OsSuccess) {
         ERROR("Failed to allocate reusable buffer (status-block)");
         goto Error;
@@ -202,11 +206,12 @@ MsdDeviceDestroy(
 
     // Free reusable buffers
     if (Device->CommandBlock != NULL) {
-        dma_pool_free(UsbRetrievePool(), (void*)Device->CommandBlock);
+        dma_pool_cache_free(Device->BufferCache, (void*)Device->CommandBlock);
     }
     if (Device->StatusBlock != NULL) {
-        dma_pool_free(UsbRetrievePool(), (void*)Device->StatusBlock);
+        dma_pool_cache_free(Device->BufferCache, (void*)Device->StatusBlock);
     }
+    dma_pool_cache_destroy(Device->BufferCache);
 
     // Free data allocated
     free(Device);
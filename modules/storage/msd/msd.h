@@ -140,9 +140,10 @@ typedef struct _MsdDevice {
 	int IsExtended;
     int AlignedAccess;
 
-    // Reusable buffers
-    MsdCommandBlock_t*  CommandBlock;
-    MsdCommandStatus_t* StatusBlock;
+    // Reusable buffers, command buffers are taken from the device cache
+    struct dma_pool_cache* BufferCache;
+    MsdCommandBlock_t*     CommandBlock;
+    MsdCommandStatus_t*    StatusBlock;
     
     // CBI Information
     UsbHcEndpointDescriptor_t* Control;
@@ -90,6 +90,10 @@ typedef enum
 	AtaDMAWriteQueuedExt			= 0x36,
 	AtaDmaWriteQueuedExtFUA			= 0x3E,
 
+	/* Native Command Queuing (FPDMA) */
+	AtaFPDMAReadQueued				= 0x60,
+	AtaFPDMAWriteQueued				= 0x61,
+
 	AtaPIOReadLogExt				= 0x2F,
 	AtaPIOWriteLogExt				= 0x3F,
 	AtaDMAReadLogExt				= 0x47,
@@ -200,8 +204,19 @@ PACKED_TYPESTRUCT(ATAIdentify, {
 	uint32_t SectorCountLBA28;
 
 	/* Obsolete AND i don't care 
-	 * Words 62-79 */
-	uint16_t Obsolete5[18];
+	 * Words 62-74 */
+	uint16_t Obsolete5[13];
+
+	/* 75: Queue Depth
+	 * Bits 0-4: Maximum queue depth - 1 */
+	uint16_t QueueDepth;
+
+	/* 76: Serial ATA Capabilities
+	 * Bit 8: Supports Native Command Queuing */
+	uint16_t SataCapabilities;
+	uint16_t SataCapabilitiesAdditional;
+	uint16_t SataFeaturesSupported;
+	uint16_t SataFeaturesEnabled;
 
 	/* 80: Drive Revision 
 	 * - Major */
@@ -324,4 +339,27 @@ PACKED_TYPESTRUCT(ATAIdentify, {
 
 });
 
+/* NCQ Command Error log (Log Address 10h)
+ * Read with READ LOG EXT after a queued command failed, it
+ * describes which tag caused the device to abort the queue. */
+#define ATA_LOG_NCQ_COMMAND_ERROR	0x10
+#define ATA_NCQ_LOG_TAG(Log)		((Log)->Tag & 0x1F)
+#define ATA_NCQ_LOG_NQ				0x80	/* The error was for a non-queued command */
+
+PACKED_TYPESTRUCT(ATANcqErrorLog, {
+	uint8_t Tag;
+	uint8_t Reserved0;
+	uint8_t Status;
+	uint8_t Error;
+	uint8_t Lba[3];
+	uint8_t Device;
+	uint8_t LbaExtended[3];
+	uint8_t Reserved1;
+	uint8_t Count;
+	uint8_t CountExtended;
+	uint8_t Reserved2[242];
+	uint8_t VendorSpecific[255];
+	uint8_t Checksum;
+});
+
 #endif //!_ATA_H_
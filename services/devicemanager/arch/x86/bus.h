@@ -27,6 +27,7 @@
 #include <os/osdefs.h>
 #include <ds/collection.h>
 #include <ddk/device.h>
+#include <threads.h>
 
 /* Fixed device-id and vendor-id values for 
  * loading non-dynamic devices */
@@ -81,6 +82,14 @@
 #define PCI_COMMAND_FASTBTB             0x200
 #define PCI_COMMAND_INTDISABLE          0x400
 
+/* The capability list is present when the capability bit
+ * is set in the status register, and starts at the pointer in 0x34 */
+#define PCI_CONFIG_SPACE_LENGTH         256
+#define PCI_STATUS_CAPABILITIES         0x10
+#define PCI_REGISTER_CAPABILITIES       0x34
+#define PCI_CAPABILITY_MSI              0x05
+#define PCI_CAPABILITY_MSIX             0x11
+
 /* The PCI base entry on the pci-databus
  * It describes a device on the pci-bus, the resources
  * its command register, status and its system bars */
@@ -117,9 +126,11 @@ PACKED_TYPESTRUCT(PciNativeHeader, {
 
 /* The PCI bus header, this is used
  * by the bus code, and is not related to any hardware structure. 
- * This keeps track of the bus's in the system and their io space */
+ * This keeps track of the bus's in the system and their io space. The lock
+ * protects the select/data register pair of the legacy configuration mechanism */
 typedef struct PciBus {
     DeviceIo_t      IoSpace;
+    mtx_t           Lock;
     int             IsExtended;
     int             Segment;
     int             BusStart;
@@ -133,6 +144,7 @@ typedef struct PciDevice {
     struct PciDevice*   Parent;
     PciBus_t*           BusIo;
     int                 IsBridge;
+    UUId_t              Id;       // Device-manager id, UUID_INVALID until registered
 
     DevInfo_t           Bus;
     DevInfo_t           Slot;
@@ -226,6 +238,33 @@ __EXTERN uint8_t PciReadSecondaryBusNumber(PciBus_t *BusIo,
 __EXTERN uint8_t PciReadHeaderType(PciBus_t *BusIo,
     DevInfo_t Bus, DevInfo_t Device, DevInfo_t Function);
 
+/* PciFindCapability
+ * Locates the capability with the given id in a copy of the configuration space
+ * of a device. Returns the offset of the capability, or 0 if it is not present. */
+__EXTERN uint8_t
+PciFindCapability(
+    _In_ const uint8_t* ConfigSpace,
+    _In_ uint8_t        CapabilityId);
+
+/* PciParseMsiCapability
+ * Fills in the message signaled interrupt capability of a device from a copy of its
+ * configuration space, including the number of vectors the driver may register. */
+__EXTERN OsStatus_t
+PciParseMsiCapability(
+    _In_  const uint8_t*         ConfigSpace,
+    _Out_ DeviceMsiCapability_t* Msi);
+
+/* PciReadMsiCapability
+ * Reads the configuration space of the device at the given location and parses
+ * its message signaled interrupt capability. */
+__EXTERN OsStatus_t
+PciReadMsiCapability(
+    _In_  PciBus_t*              BusIo,
+    _In_  DevInfo_t              Bus,
+    _In_  DevInfo_t              Device,
+    _In_  DevInfo_t              Function,
+    _Out_ DeviceMsiCapability_t* Msi);
+
 /* PciToString
  * Converts the given class, subclass and interface into
  * descriptive string to give the pci-entry a description */
@@ -27,6 +27,7 @@
 #include "bus.h"
 #include <ddk/acpi.h>
 #include <ddk/utils.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <errno.h>
 
@@ -45,6 +46,7 @@ PACKED_TYPESTRUCT(McfgEntry, {
 static Collection_t *__GlbPciDevices    = NULL;
 static PciDevice_t *__GlbRoot           = NULL;
 static int __GlbAcpiAvailable           = 0;
+static int __GlbMsiAvailable            = 1;
 
 /* Prototypes
  * we need access to this function again.. */
@@ -231,6 +233,7 @@ PciCheckFunction(
     Device->Function    = Function;
     Device->Children    = NULL;
     Device->AcpiConform = 0;
+    Device->Id          = UUID_INVALID;
 
     // Trace Information about device 
     // Ignore the spam of device_id 0x7a0 in VMWare
@@ -385,10 +388,12 @@ PciCheckBus(
 }
 
 /* PciCreateDeviceFromPci
- * Creates a new MCoreDevice_t from a pci-device and registers it with the device-manager */
+ * Creates a new MCoreDevice_t from a pci-device and registers it with the device-manager
+ * as a child of the bridge it was found behind */
 OsStatus_t
 PciCreateDeviceFromPci(
-    _In_ PciDevice_t*   PciDevice)
+    _In_ PciDevice_t*   PciDevice,
+    _In_ Flags_t        Flags)
 {
     // Variables
     MCoreDevice_t Device = { 0 };
@@ -409,6 +414,15 @@ PciCreateDeviceFromPci(
     Device.Interrupt.Vectors[0]     = INTERRUPT_NONE;
     Device.Interrupt.AcpiConform    = PciDevice->AcpiConform;
 
+    // Devices that can deliver message signaled interrupts get vectors of their own
+    // instead of sharing the pin based line
+    if (!__GlbMsiAvailable || PciReadMsiCapability(PciDevice->BusIo, PciDevice->Bus,
+            PciDevice->Slot, PciDevice->Function, &Device.Interrupt.Msi) != OsSuccess) {
+        Device.Interrupt.Msi.Type         = INTERRUPT_MSI_CAPABILITY_NONE;
+        Device.Interrupt.Msi.Vectors      = 0;
+        Device.Interrupt.Msi.TableIoSpace = -1;
+    }
+
     // Handle bars attached to device
     PciReadBars(PciDevice->BusIo, &Device, PciDevice->Header->HeaderType);
 
@@ -435,9 +449,9 @@ PciCreateDeviceFromPci(
             }
         }
     }
-    return DmRegisterDevice(UUID_INVALID, &Device, PciToString(PciDevice->Header->Class,
+    return DmRegisterDevice(PciDevice->Parent->Id, &Device, PciToString(PciDevice->Header->Class,
         PciDevice->Header->Subclass, PciDevice->Header->Interface),
-        __DEVICEMANAGER_REGISTER_LOADDRIVER, &Device.Id);
+        Flags, &PciDevice->Id);
 }
 
 /* PciInstallDriverCallback
@@ -453,12 +467,14 @@ PciInstallDriverCallback(
     _CRT_UNUSED(No);
 
     // Bridge or device? 
-    // If a bridge, we keep iterating, device, load driver
+    // If a bridge, register it so the devices behind it have a parent and keep
+    // iterating, device, load driver
     if (PciDev->IsBridge) {
+        PciCreateDeviceFromPci(PciDev, 0);
         CollectionExecuteAll(PciDev->Children, PciInstallDriverCallback, Context);
     }
     else {
-        PciCreateDeviceFromPci(PciDev);
+        PciCreateDeviceFromPci(PciDev, __DEVICEMANAGER_REGISTER_LOADDRIVER);
     }
 }
 
@@ -514,6 +530,67 @@ BusRegisterPS2Controller(void)
     return BusInstallFixed(&Device, "PS/2 Controller");
 }
 
+// Buses of a segment are scanned by a few threads, each thread takes the next bus
+// number until the range is exhausted
+#define PCI_SCAN_WORKERS 4
+
+typedef struct PciBusScan {
+    PciBus_t*    Bus;
+    _Atomic(int) Next;
+    int          End;
+    int          RootFunctions; // Buses are functions of a multi-function root-bridge
+} PciBusScan_t;
+
+static int
+PciScanWorker(void* Context)
+{
+    PciBusScan_t* Scan = (PciBusScan_t*)Context;
+    int           Bus;
+
+    while ((Bus = atomic_fetch_add(&Scan->Next, 1)) <= Scan->End) {
+        if (Scan->RootFunctions && PciReadVendorId(Scan->Bus, 0, 0, Bus) == 0xFFFF) {
+            continue;
+        }
+
+        DmTimelineRecord("bus-begin", (UUId_t)Bus, "pci");
+        PciCheckBus(__GlbRoot, Bus);
+        DmTimelineRecord("bus-end", (UUId_t)Bus, "pci");
+    }
+    return 0;
+}
+
+/* PciScanBuses
+ * Scans a range of buses in parallel, the config space accesses of the scans are
+ * independent of each other. If no thread can be created the caller scans the range. */
+static void
+PciScanBuses(
+    _In_ PciBus_t* Bus,
+    _In_ int       Start,
+    _In_ int       End,
+    _In_ int       RootFunctions)
+{
+    PciBusScan_t Scan;
+    thrd_t       Threads[PCI_SCAN_WORKERS];
+    int          Started = 0;
+
+    Scan.Bus           = Bus;
+    Scan.End           = End;
+    Scan.RootFunctions = RootFunctions;
+    atomic_store(&Scan.Next, Start);
+
+    while (Started < MIN(PCI_SCAN_WORKERS, End - Start + 1)) {
+        if (thrd_create(&Threads[Started], PciScanWorker, &Scan) != thrd_success) {
+            break;
+        }
+        Started++;
+    }
+
+    PciScanWorker(&Scan);
+    while (Started) {
+        thrd_join(Threads[--Started], NULL);
+    }
+}
+
 /* BusEnumerate
  * Enumerates the pci-bus, on newer pcs its possbile for 
  * devices exists on TWO different busses. PCI and PCI Express. */
@@ -524,7 +601,6 @@ BusEnumerate(void* Context)
     ACPI_TABLE_HEADER* Header    = NULL;
     AcpiDescriptor_t   Acpi      = { 0 };
     OsStatus_t         Status;
-    int                Function;
 
     _CRT_UNUSED(Context);
 
@@ -538,6 +614,7 @@ BusEnumerate(void* Context)
     __GlbPciDevices     = CollectionCreate(KeyInteger);
     __GlbRoot->Children = CollectionCreate(KeyInteger);
     __GlbRoot->IsBridge = 1;
+    __GlbRoot->Id       = UUID_INVALID;
 
     // Are we on an acpi-capable system?
     if (AcpiQueryStatus(&Acpi) == OsSuccess) {
@@ -545,6 +622,12 @@ BusEnumerate(void* Context)
             Acpi.Version, Acpi.BootFlags);
         __GlbAcpiAvailable = 1;
 
+        // The firmware can tell us that MSI is broken on this system
+        if (Acpi.BootFlags & ACPI_IA_NO_MSI) {
+            TRACE("MSI is disabled by the firmware");
+            __GlbMsiAvailable = 0;
+        }
+
         // Uh, even better, do we have PCI-e controllers?
         if (AcpiQueryTable(ACPI_SIG_MCFG, &Header) == OsSuccess) {
             TRACE("PCI-Express Controller (mcfg length 0x%x)", Header->Length);
@@ -587,10 +670,9 @@ BusEnumerate(void* Context)
             Bus->BusEnd         = Entry->EndBus;
             Bus->Segment        = Entry->SegmentGroup;
             __GlbRoot->BusIo    = Bus;
+            mtx_init(&Bus->Lock, mtx_plain);
 
-            for (Function = Bus->BusStart; Function <= Bus->BusEnd; Function++) {
-                PciCheckBus(__GlbRoot, Function);
-            }
+            PciScanBuses(Bus, Bus->BusStart, Bus->BusEnd, 0);
             Entry++;
         }
         free(McfgTable);
@@ -605,6 +687,7 @@ BusEnumerate(void* Context)
 
         __GlbRoot->BusIo = Bus;
         Bus->BusEnd      = 7;
+        mtx_init(&Bus->Lock, mtx_plain);
         
         // PCI buses use io
         Status = CreateDevicePortIo(&Bus->IoSpace, PCI_IO_BASE, PCI_IO_LENGTH);
@@ -625,11 +708,7 @@ BusEnumerate(void* Context)
             PciCheckBus(__GlbRoot, 0);
         }
         else {
-            for (Function = 0; Function < 8; Function++) {
-                if (PciReadVendorId(Bus, 0, 0, Function) != 0xFFFF)
-                    break;
-                PciCheckBus(__GlbRoot, Function);
-            }
+            PciScanBuses(Bus, 0, 7, 1);
         }
     }
     CollectionExecuteAll(__GlbRoot->Children, PciInstallDriverCallback, NULL);
@@ -744,15 +823,15 @@ DmIoctlDeviceEx(
     else {
         if (Width == 1) {
             PciWrite8(PciDevice->BusIo, Device->Bus, 
-                Device->Slot, Device->Function, Register, LOBYTE(Value));
+                Device->Slot, Device->Function, Register, LOBYTE(*Value));
         }
         else if (Width == 2) {
             PciWrite16(PciDevice->BusIo, Device->Bus, 
-                Device->Slot, Device->Function, Register, LOWORD(Value));
+                Device->Slot, Device->Function, Register, LOWORD(*Value));
         }
         else if (Width == 4) {
             PciWrite32(PciDevice->BusIo, Device->Bus, 
-                Device->Slot, Device->Function, Register, LODWORD(Value));
+                Device->Slot, Device->Function, Register, LODWORD(*Value));
         }
         else {
             return OsInvalidParameters;
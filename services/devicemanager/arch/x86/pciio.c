@@ -53,8 +53,12 @@ uint32_t PciRead32(PciBus_t *Io,
 		return ReadDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
 	}
 	else {
+		uint32_t Value;
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
-		return ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA, 4);
+		Value = (uint32_t)ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA, 4);
+		mtx_unlock(&Io->Lock);
+		return Value;
 	}
 }
 
@@ -69,8 +73,12 @@ uint16_t PciRead16(PciBus_t *Io,
 		return (uint16_t)ReadDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), 2);
 	}
 	else {
+		uint16_t Value;
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
-		return (uint16_t)ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x02), 2);
+		Value = (uint16_t)ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x02), 2);
+		mtx_unlock(&Io->Lock);
+		return Value;
 	}
 }
 
@@ -84,8 +92,12 @@ uint8_t PciRead8(PciBus_t *Io,
 		return (uint8_t)ReadDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), 1);
 	}
 	else {
+		uint8_t Value;
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
-		return (uint8_t)ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x03), 1);
+		Value = (uint8_t)ReadDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x03), 1);
+		mtx_unlock(&Io->Lock);
+		return Value;
 	}
 }
 
@@ -99,8 +111,10 @@ void PciWrite32(PciBus_t *Io,
 		WriteDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), Value, 4);
 	}
 	else {
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA, Value, 4);
+		mtx_unlock(&Io->Lock);
 	}
 }
 
@@ -114,8 +128,10 @@ void PciWrite16(PciBus_t *Io,
 		WriteDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), Value, 2);
 	}
 	else {
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x02), Value, 2);
+		mtx_unlock(&Io->Lock);
 	}
 }
 
@@ -129,8 +145,10 @@ void PciWrite8(PciBus_t *Io,
 		WriteDeviceIo(&Io->IoSpace, PciCalculateOffset(Io, Bus, Device, Function, Register), Value, 1);
 	}
 	else {
+		mtx_lock(&Io->Lock);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_SELECT, PciCalculateOffset(Io, Bus, Device, Function, Register), 4);
 		WriteDeviceIo(&Io->IoSpace, PCI_REGISTER_DATA + (Register & 0x03), Value, 1);
+		mtx_unlock(&Io->Lock);
 	}
 }
 
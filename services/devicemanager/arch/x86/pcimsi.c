@@ -0,0 +1,184 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS X86 Bus Driver (MSI)
+ * - Discovers the message signaled interrupt capabilities of a device from
+ *   a copy of its configuration space, and decides the vectors a driver gets
+ */
+
+#include "bus.h"
+#include <string.h>
+
+// The capability list can at most hold 48 capabilities in the 192 bytes that
+// follow the header, anything longer is a loop in a broken device
+#define PCI_CAPABILITY_MAX_COUNT    48
+
+// A capability at the end of the list must still fit in the configuration space
+#define PCI_MSI_LENGTH_32BIT        0x0A
+#define PCI_MSI_LENGTH_64BIT        0x0E
+#define PCI_MSIX_LENGTH             0x0C
+
+#define PCI_MSI_CONTROL_64BIT       0x0080
+#define PCI_MSIX_CONTROL_TABLE_SIZE 0x07FF
+#define PCI_MSIX_TABLE_BIR          0x7
+#define PCI_BAR_MEMORY_TYPE_MASK    0x6
+#define PCI_BAR_MEMORY_TYPE_64BIT   0x4
+
+static inline uint16_t
+ReadConfig16(
+    _In_ const uint8_t* ConfigSpace,
+    _In_ size_t         Register)
+{
+    return (uint16_t)(ConfigSpace[Register] | (ConfigSpace[Register + 1] << 8));
+}
+
+static inline uint32_t
+ReadConfig32(
+    _In_ const uint8_t* ConfigSpace,
+    _In_ size_t         Register)
+{
+    return (uint32_t)ReadConfig16(ConfigSpace, Register) |
+        ((uint32_t)ReadConfig16(ConfigSpace, Register + 2) << 16);
+}
+
+uint8_t
+PciFindCapability(
+    _In_ const uint8_t* ConfigSpace,
+    _In_ uint8_t        CapabilityId)
+{
+    uint8_t Offset;
+    int     i;
+
+    // Only the standard and the bridge headers hold the capability pointer here
+    if (!(ReadConfig16(ConfigSpace, 0x06) & PCI_STATUS_CAPABILITIES) ||
+        (ConfigSpace[0x0E] & 0x7F) > 1) {
+        return 0;
+    }
+
+    Offset = ConfigSpace[PCI_REGISTER_CAPABILITIES] & 0xFC;
+    for (i = 0; i < PCI_CAPABILITY_MAX_COUNT && Offset >= 0x40; i++) {
+        if (ConfigSpace[Offset] == CapabilityId) {
+            return Offset;
+        }
+        Offset = ConfigSpace[Offset + 1] & 0xFC;
+    }
+    return 0;
+}
+
+/* PciParseMsix
+ * The vector table must live in a memory bar of the device. 64 bit bars are
+ * stored at the io-space of their upper half, see PciReadBars. */
+static OsStatus_t
+PciParseMsix(
+    _In_ const uint8_t*         ConfigSpace,
+    _In_ uint8_t                Offset,
+    _In_ DeviceMsiCapability_t* Msi)
+{
+    uint16_t Control;
+    uint32_t Table;
+    int      BarIndex;
+    int      BarCount = (ConfigSpace[0x0E] & 0x7F) == 1 ? 2 : 6;
+    uint32_t Bar;
+
+    if (Offset + PCI_MSIX_LENGTH > PCI_CONFIG_SPACE_LENGTH) {
+        return OsError;
+    }
+
+    Control  = ReadConfig16(ConfigSpace, Offset + 0x02);
+    Table    = ReadConfig32(ConfigSpace, Offset + 0x04);
+    BarIndex = (int)(Table & PCI_MSIX_TABLE_BIR);
+    if (BarIndex >= BarCount) {
+        return OsError;
+    }
+
+    Bar = ReadConfig32(ConfigSpace, 0x10 + (BarIndex << 2));
+    if (Bar & 0x1) {
+        return OsError;
+    }
+
+    if ((Bar & PCI_BAR_MEMORY_TYPE_MASK) == PCI_BAR_MEMORY_TYPE_64BIT) {
+        if (BarIndex + 1 >= BarCount) {
+            return OsError;
+        }
+        BarIndex++;
+    }
+
+    Msi->Type         = INTERRUPT_MSI_CAPABILITY_MSIX;
+    Msi->Offset       = Offset;
+    Msi->Vectors      = MIN((int)(Control & PCI_MSIX_CONTROL_TABLE_SIZE) + 1, INTERRUPT_MAX_MSI_VECTORS);
+    Msi->TableIoSpace = BarIndex;
+    Msi->TableOffset  = (size_t)(Table & ~PCI_MSIX_TABLE_BIR);
+    return OsSuccess;
+}
+
+OsStatus_t
+PciParseMsiCapability(
+    _In_  const uint8_t*         ConfigSpace,
+    _Out_ DeviceMsiCapability_t* Msi)
+{
+    uint8_t Offset;
+
+    memset(Msi, 0, sizeof(DeviceMsiCapability_t));
+    Msi->Type         = INTERRUPT_MSI_CAPABILITY_NONE;
+    Msi->TableIoSpace = -1;
+
+    // MSI-X is preferred as every vector is programmed on its own
+    Offset = PciFindCapability(ConfigSpace, PCI_CAPABILITY_MSIX);
+    if (Offset && PciParseMsix(ConfigSpace, Offset, Msi) == OsSuccess) {
+        return OsSuccess;
+    }
+
+    // Multiple MSI messages must use a block of aligned, consecutive vectors, but
+    // vectors are registered one at a time, so MSI devices get a single vector
+    Offset = PciFindCapability(ConfigSpace, PCI_CAPABILITY_MSI);
+    if (Offset) {
+        int Is64Bit = (ReadConfig16(ConfigSpace, Offset + 0x02) & PCI_MSI_CONTROL_64BIT) ? 1 : 0;
+        if (Offset + (Is64Bit ? PCI_MSI_LENGTH_64BIT : PCI_MSI_LENGTH_32BIT) > PCI_CONFIG_SPACE_LENGTH) {
+            return OsDoesNotExist;
+        }
+
+        Msi->Type    = INTERRUPT_MSI_CAPABILITY_MSI;
+        Msi->Offset  = Offset;
+        Msi->Vectors = 1;
+        Msi->Is64Bit = Is64Bit;
+        return OsSuccess;
+    }
+    return OsDoesNotExist;
+}
+
+OsStatus_t
+PciReadMsiCapability(
+    _In_  PciBus_t*              BusIo,
+    _In_  DevInfo_t              Bus,
+    _In_  DevInfo_t              Device,
+    _In_  DevInfo_t              Function,
+    _Out_ DeviceMsiCapability_t* Msi)
+{
+    uint8_t  ConfigSpace[PCI_CONFIG_SPACE_LENGTH];
+    uint32_t Value;
+    size_t   i;
+
+    for (i = 0; i < PCI_CONFIG_SPACE_LENGTH; i += 4) {
+        Value = PciRead32(BusIo, Bus, Device, Function, i);
+        ConfigSpace[i]     = (uint8_t)(Value & 0xFF);
+        ConfigSpace[i + 1] = (uint8_t)((Value >> 8) & 0xFF);
+        ConfigSpace[i + 2] = (uint8_t)((Value >> 16) & 0xFF);
+        ConfigSpace[i + 3] = (uint8_t)((Value >> 24) & 0xFF);
+    }
+    return PciParseMsiCapability(&ConfigSpace[0], Msi);
+}
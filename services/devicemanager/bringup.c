@@ -0,0 +1,112 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - Device Manager
+ * Device Manager (Bring-up)
+ * - The queue of drivers waiting to be installed by the bring-up workers, and the rules
+ *   for which of them may be installed next. The callers provide the locking.
+ */
+
+#include "bringup.h"
+
+void
+DmBringupInitialize(
+    _In_ DmBringupQueue_t* Queue)
+{
+    Queue->Pending = NULL;
+    for (int i = 0; i < DM_BRINGUP_WORKERS; i++) {
+        Queue->Active[i] = UUID_INVALID;
+    }
+}
+
+void
+DmBringupAppend(
+    _In_ DmBringupQueue_t*  Queue,
+    _In_ DmPendingDriver_t* Pending)
+{
+    DmPendingDriver_t** Link = &Queue->Pending;
+
+    Pending->Link = NULL;
+    while (*Link != NULL) {
+        Link = &(*Link)->Link;
+    }
+    *Link = Pending;
+}
+
+int
+DmIsRunnable(
+    _In_ DmBringupQueue_t*  Queue,
+    _In_ DmPendingDriver_t* Pending)
+{
+    DmPendingDriver_t* Iterator = Queue->Pending;
+
+    if (Pending->Parent == UUID_INVALID) {
+        return 1;
+    }
+
+    for (int i = 0; i < DM_BRINGUP_WORKERS; i++) {
+        if (Queue->Active[i] == Pending->Parent) {
+            return 0;
+        }
+    }
+
+    // Parents are registered before their children, so only the drivers queued
+    // before this one can belong to the parent
+    while (Iterator != NULL && Iterator != Pending) {
+        if (Iterator->Device->Id == Pending->Parent) {
+            return 0;
+        }
+        Iterator = Iterator->Link;
+    }
+    return 1;
+}
+
+DmPendingDriver_t*
+DmTakeRunnable(
+    _In_ DmBringupQueue_t* Queue)
+{
+    DmPendingDriver_t* Previous = NULL;
+    DmPendingDriver_t* Iterator = Queue->Pending;
+
+    while (Iterator != NULL) {
+        if (DmIsRunnable(Queue, Iterator)) {
+            if (Previous == NULL) {
+                Queue->Pending = Iterator->Link;
+            }
+            else {
+                Previous->Link = Iterator->Link;
+            }
+            return Iterator;
+        }
+        Previous = Iterator;
+        Iterator = Iterator->Link;
+    }
+    return NULL;
+}
+
+int
+DmIsBringupIdle(
+    _In_ DmBringupQueue_t* Queue)
+{
+    for (int i = 0; i < DM_BRINGUP_WORKERS; i++) {
+        if (Queue->Active[i] != UUID_INVALID) {
+            return 0;
+        }
+    }
+    return Queue->Pending == NULL;
+}
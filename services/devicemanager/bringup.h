@@ -0,0 +1,86 @@
+/* MollenOS
+ *
+ * Copyright 2020, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - Device Manager
+ * Device Manager (Bring-up)
+ * - The queue of drivers waiting to be installed by the bring-up workers, and the rules
+ *   for which of them may be installed next. The callers provide the locking.
+ */
+
+#ifndef __DEVICEMANAGER_BRINGUP__
+#define __DEVICEMANAGER_BRINGUP__
+
+#include <os/osdefs.h>
+#include <ddk/device.h>
+
+// Drivers are installed by a small pool of workers, a device is only installed once the
+// driver of its parent device has been installed
+#define DM_BRINGUP_WORKERS  4
+
+typedef struct DmPendingDriver {
+    struct DmPendingDriver* Link;
+    MCoreDevice_t*          Device;
+    UUId_t                  Parent;
+} DmPendingDriver_t;
+
+typedef struct DmBringupQueue {
+    DmPendingDriver_t* Pending;
+    UUId_t             Active[DM_BRINGUP_WORKERS]; // The device each worker is installing
+} DmBringupQueue_t;
+
+/* DmBringupInitialize
+ * Initializes an empty queue with all workers idle. */
+__EXTERN
+void
+DmBringupInitialize(
+    _In_ DmBringupQueue_t* Queue);
+
+/* DmBringupAppend
+ * Appends a driver to the queue, drivers are installed in the order they are queued
+ * unless they wait for their parent. */
+__EXTERN
+void
+DmBringupAppend(
+    _In_ DmBringupQueue_t*  Queue,
+    _In_ DmPendingDriver_t* Pending);
+
+/* DmIsRunnable
+ * A pending driver is runnable when its parent device is neither installing nor waiting
+ * to be installed. */
+__EXTERN
+int
+DmIsRunnable(
+    _In_ DmBringupQueue_t*  Queue,
+    _In_ DmPendingDriver_t* Pending);
+
+/* DmTakeRunnable
+ * Removes the first runnable driver from the queue, returns NULL if no driver can be
+ * installed right now. */
+__EXTERN
+DmPendingDriver_t*
+DmTakeRunnable(
+    _In_ DmBringupQueue_t* Queue);
+
+/* DmIsBringupIdle
+ * Returns 1 when no drivers are queued and no worker is installing one. */
+__EXTERN
+int
+DmIsBringupIdle(
+    _In_ DmBringupQueue_t* Queue);
+
+#endif //! __DEVICEMANAGER_BRINGUP__
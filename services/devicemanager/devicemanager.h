@@ -70,4 +70,21 @@ DmIoctlDeviceEx(
 	_In_ size_t*        Value,
 	_In_ size_t         Width);
 
+/* DmTimelineRecord
+ * Records a boot stage in the timeline of the device-manager. The stage must be
+ * a string literal, the name is copied and may be NULL */
+__EXTERN
+void
+DmTimelineRecord(
+    _In_ const char* Stage,
+    _In_ UUId_t      DeviceId,
+    _In_ const char* Name);
+
+/* DmTimelineDump
+ * Prints the recorded timeline, one line per stage with the milliseconds
+ * since the first recorded stage */
+__EXTERN
+void
+DmTimelineDump(void);
+
 #endif //! __DEVICEMANAGER_INTERFACE__
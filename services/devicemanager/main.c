@@ -25,6 +25,7 @@
 
 #include <assert.h>
 #include <bus.h>
+#include "bringup.h"
 #include <ctype.h>
 #include "devicemanager.h"
 #include "svc_device_protocol_server.h"
@@ -35,9 +36,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
+#include <time.h>
 
-static Collection_t Devices             = COLLECTION_INIT(KeyId);
-static UUId_t       DeviceIdGenerator   = 0;
+#define DM_TIMELINE_SIZE    256
+#define DM_TIMELINE_NAME    32
+
+typedef struct DmTimelineEntry {
+    clock_t     Timestamp;
+    const char* Stage;
+    UUId_t      DeviceId;
+    char        Name[DM_TIMELINE_NAME];
+} DmTimelineEntry_t;
+
+static Collection_t       Devices           = COLLECTION_INIT(KeyId);
+static _Atomic(UUId_t)    DeviceIdGenerator = ATOMIC_VAR_INIT(UUID_INVALID + 1); // Ids are never UUID_INVALID
+
+static mtx_t              BringupLock;
+static cnd_t              BringupSignal;
+static DmBringupQueue_t   BringupQueue;
+static int                EnumerationDone   = 0;
+
+static mtx_t              TimelineLock;
+static DmTimelineEntry_t  Timeline[DM_TIMELINE_SIZE];
+static int                TimelineCount     = 0;
 
 OsStatus_t OnUnload(void)
 {
@@ -50,6 +71,123 @@ void GetServiceAddress(struct ipmsg_addr* address)
     address->data.path = SERVICE_DEVICE_PATH;
 }
 
+void
+DmTimelineRecord(
+    _In_ const char* Stage,
+    _In_ UUId_t      DeviceId,
+    _In_ const char* Name)
+{
+    DmTimelineEntry_t* Entry;
+
+    mtx_lock(&TimelineLock);
+    if (TimelineCount < DM_TIMELINE_SIZE) {
+        Entry            = &Timeline[TimelineCount++];
+        Entry->Timestamp = clock();
+        Entry->Stage     = Stage;
+        Entry->DeviceId  = DeviceId;
+        Entry->Name[0]   = '\0';
+        if (Name != NULL) {
+            strncpy(&Entry->Name[0], Name, DM_TIMELINE_NAME - 1);
+            Entry->Name[DM_TIMELINE_NAME - 1] = '\0';
+        }
+    }
+    mtx_unlock(&TimelineLock);
+}
+
+void
+DmTimelineDump(void)
+{
+    clock_t Start;
+
+    mtx_lock(&TimelineLock);
+    Start = TimelineCount ? Timeline[0].Timestamp : 0;
+    for (int i = 0; i < TimelineCount; i++) {
+        SystemDebug(SYSTEM_DEBUG_TRACE, "[timeline] %u ms %s %i %s",
+            (unsigned int)(((Timeline[i].Timestamp - Start) * 1000) / CLOCKS_PER_SEC),
+            Timeline[i].Stage, (int)Timeline[i].DeviceId, &Timeline[i].Name[0]);
+    }
+    mtx_unlock(&TimelineLock);
+}
+
+static int
+DmBringupWorker(void* Context)
+{
+    int                Slot = (int)(intptr_t)Context;
+    DmPendingDriver_t* Pending;
+    OsStatus_t         Status;
+
+    mtx_lock(&BringupLock);
+    while (1) {
+        Pending = DmTakeRunnable(&BringupQueue);
+        if (Pending == NULL) {
+            // The boot is done when the buses are enumerated and every driver is installed
+            if (EnumerationDone == 1 && DmIsBringupIdle(&BringupQueue)) {
+                EnumerationDone = 2;
+                mtx_unlock(&BringupLock);
+                DmTimelineRecord("bringup-done", UUID_INVALID, NULL);
+#ifdef __OSCONFIG_BOOT_TIMELINE
+                DmTimelineDump();
+#endif
+                mtx_lock(&BringupLock);
+                continue;
+            }
+            cnd_wait(&BringupSignal, &BringupLock);
+            continue;
+        }
+
+        BringupQueue.Active[Slot] = Pending->Device->Id;
+        mtx_unlock(&BringupLock);
+
+        DmTimelineRecord("driver-begin", Pending->Device->Id, &Pending->Device->Name[0]);
+        Status = InstallDriver(Pending->Device, Pending->Device->Length, NULL, 0);
+        DmTimelineRecord(Status == OsSuccess ? "driver-end" : "driver-failed",
+            Pending->Device->Id, &Pending->Device->Name[0]);
+        free(Pending);
+
+        // Children of the device may be runnable now
+        mtx_lock(&BringupLock);
+        BringupQueue.Active[Slot] = UUID_INVALID;
+        cnd_broadcast(&BringupSignal);
+    }
+    return 0;
+}
+
+static OsStatus_t
+DmQueueDriver(
+    _In_ MCoreDevice_t* Device,
+    _In_ UUId_t         Parent)
+{
+    DmPendingDriver_t* Pending = (DmPendingDriver_t*)malloc(sizeof(DmPendingDriver_t));
+    if (!Pending) {
+        return OsOutOfMemory;
+    }
+
+    Pending->Device = Device;
+    Pending->Parent = Parent;
+
+    mtx_lock(&BringupLock);
+    DmBringupAppend(&BringupQueue, Pending);
+    cnd_signal(&BringupSignal);
+    mtx_unlock(&BringupLock);
+    return OsSuccess;
+}
+
+static int
+DmEnumerate(void* Context)
+{
+    int Result;
+
+    DmTimelineRecord("enumerate-begin", UUID_INVALID, NULL);
+    Result = BusEnumerate(Context);
+    DmTimelineRecord("enumerate-end", UUID_INVALID, NULL);
+
+    mtx_lock(&BringupLock);
+    EnumerationDone = 1;
+    cnd_broadcast(&BringupSignal);
+    mtx_unlock(&BringupLock);
+    return Result;
+}
+
 OsStatus_t
 OnLoad(void)
 {
@@ -57,10 +195,21 @@ OnLoad(void)
     
     // Register supported interfaces
     gracht_server_register_protocol(&svc_device_protocol);
+
+    mtx_init(&TimelineLock, mtx_plain);
+    mtx_init(&BringupLock, mtx_plain);
+    cnd_init(&BringupSignal);
+    DmBringupInitialize(&BringupQueue);
+    for (int i = 0; i < DM_BRINGUP_WORKERS; i++) {
+        if (thrd_create(&thr, DmBringupWorker, (void*)(intptr_t)i) != thrd_success) {
+            return OsError;
+        }
+        thrd_detach(thr);
+    }
     
     // Start the enumeration process in a new thread so we can quickly return
     // and be ready for requests.
-    if (thrd_create(&thr, BusEnumerate, NULL) != thrd_success) {
+    if (thrd_create(&thr, DmEnumerate, NULL) != thrd_success) {
         return OsError;
     }
     return OsSuccess;
@@ -103,18 +252,6 @@ void svc_device_ioctl_ex_callback(struct gracht_recv_message* message, struct sv
     svc_device_ioctl_ex_response(message, Result, args->value);
 }
 
-int
-DmLoadDeviceDriver(void* Context)
-{
-    MCoreDevice_t* Device = Context;
-    OsStatus_t     Status = InstallDriver(Device, Device->Length, NULL, 0);
-    
-    if (Status != OsSuccess) {
-        return OsStatusToErrno(Status);
-    }
-    return 0;
-}
-
 OsStatus_t
 DmRegisterDevice(
     _In_  UUId_t         Parent,
@@ -126,7 +263,6 @@ DmRegisterDevice(
     MCoreDevice_t* CopyDevice;
     DataKey_t      Key = { 0 };
 
-    _CRT_UNUSED(Parent);
     assert(Device != NULL);
     assert(Id != NULL);
     assert(Device->Length >= sizeof(MCoreDevice_t));
@@ -137,25 +273,22 @@ DmRegisterDevice(
     }
     
     memcpy(CopyDevice, Device, Device->Length);
-    CopyDevice->Id = Key.Value.Id = DeviceIdGenerator++;
+    CopyDevice->Id = Key.Value.Id = atomic_fetch_add(&DeviceIdGenerator, 1);
     if (Name != NULL) {
         memcpy(&CopyDevice->Name[0], Name, strlen(Name));
     }
     
     CollectionAppend(&Devices, CollectionCreateNode(Key, CopyDevice));
     TRACE("%u, Registered device %s, struct length %u", 
-        DeviceIdGenerator, &CopyDevice->Name[0], CopyDevice->Length);
+        CopyDevice->Id, &CopyDevice->Name[0], CopyDevice->Length);
+    DmTimelineRecord("register", CopyDevice->Id, &CopyDevice->Name[0]);
     *Id = CopyDevice->Id;
     
-    // Now, we want to try to find a driver for the new device, spawn a new thread
-    // for dealing with this to avoid any waiting for the ipc to open up
+    // Now, we want to try to find a driver for the new device, queue it for the bring-up
+    // workers to avoid any waiting for the ipc to open up
 #ifndef __OSCONFIG_NODRIVERS
     if (Flags & __DEVICEMANAGER_REGISTER_LOADDRIVER) {
-        thrd_t thr;
-        if (thrd_create(&thr, DmLoadDeviceDriver, CopyDevice) != thrd_success) {
-            return OsError;
-        }
-        thrd_detach(thr);
+        return DmQueueDriver(CopyDevice, Parent);
     }
 #endif
     return OsSuccess;
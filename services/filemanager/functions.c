@@ -555,16 +555,9 @@ ReadFile(
         status = Flush(processId, handle);
     }
 
-    status = dma_attach(bufferHandle, &dmaAttachment);
+    status = dma_attach_and_map(bufferHandle, &dmaAttachment);
     if (status != OsSuccess) {
-        ERROR("[vfs_read] [dma_attach] failed: %u", status);
-        return OsInvalidParameters;
-    }
-    
-    status = dma_attachment_map(&dmaAttachment);
-    if (status != OsSuccess) {
-        ERROR("[vfs_read] [dma_attachment_map] failed: %u", status);
-        dma_detach(&dmaAttachment);
+        ERROR("[vfs_read] [dma_attach_and_map] failed: %u", status);
         return OsInvalidParameters;
     }
 
@@ -578,8 +571,7 @@ ReadFile(
     }
     
     // Unregister the dma buffer
-    dma_attachment_unmap(&dmaAttachment);
-    dma_detach(&dmaAttachment);
+    dma_unmap_and_detach(&dmaAttachment);
     return status;
 }
 
@@ -614,16 +606,9 @@ WriteFile(
         status = Flush(processId, handle);
     }
 
-    status = dma_attach(bufferHandle, &dmaAttachment);
-    if (status != OsSuccess) {
-        ERROR("[vfs_write] [dma_attach] failed: %u", status);
-        return OsInvalidParameters;
-    }
-    
-    status = dma_attachment_map(&dmaAttachment);
+    status = dma_attach_and_map(bufferHandle, &dmaAttachment);
     if (status != OsSuccess) {
-        ERROR("[vfs_write] [dma_attachment_map] failed: %u", status);
-        dma_detach(&dmaAttachment);
+        ERROR("[vfs_write] [dma_attach_and_map] failed: %u", status);
         return OsInvalidParameters;
     }
 
@@ -639,8 +624,7 @@ WriteFile(
     }
     
     // Unregister the dma buffer
-    dma_attachment_unmap(&dmaAttachment);
-    dma_detach(&dmaAttachment);
+    dma_unmap_and_detach(&dmaAttachment);
     return status;
 }
 
@@ -35,14 +35,8 @@ ReadStorage(
 	_In_  size_t            sectorCount,
 	_Out_ size_t*           sectorsRead)
 {
-	struct vali_link_message msg  = VALI_MSG_INIT_HANDLE(storage->Driver);
-	OsStatus_t               status;
-	
-	ctt_storage_transfer(GetGrachtClient(), &msg, storage->Device,
-			__STORAGE_OPERATION_READ, LODWORD(sector), HIDWORD(sector), 
-			bufferHandle, 0, sectorCount, &status, sectorsRead);
-	gracht_vali_message_finish(&msg);
-	return status;
+	return BlockQueueTransfer(storage->Queue, __STORAGE_OPERATION_READ, sector,
+			bufferHandle, 0, sectorCount, sectorsRead);
 }
 
 OsStatus_t
@@ -163,6 +163,17 @@ DiskRegisterFileSystem(
     return OsSuccess;
 }
 
+/* DestroyDisk
+ * Removes a disk that failed to initialize from the list of disks before freeing it,
+ * the disk was added to the list when it was registered. */
+static void
+DestroyDisk(FileSystemDisk_t* disk)
+{
+    DataKey_t key = { .Value.Id = disk->Device };
+    CollectionRemoveByKey(VfsGetDisks(), key);
+    free(disk);
+}
+
 static int
 InitializeDisk(void* Context)
 {
@@ -175,7 +186,16 @@ InitializeDisk(void* Context)
     if (status != OsSuccess) {
         // TODO: disk states
         // Disk->State = Crashed
-        free(disk);
+        DestroyDisk(disk);
+        return OsStatusToErrno(status);
+    }
+
+    // All transfers to the disk are sorted and merged through the block queue
+    status = BlockQueueCreate(disk->Driver, disk->Device, disk->Descriptor.SectorSize,
+        BLOCKQUEUE_DEFAULT_DEPTH, BLOCKQUEUE_DEFAULT_MAXSECTORS, &disk->Queue);
+    if (status != OsSuccess) {
+        ERROR("InitializeDisk failed to create block queue for disk %u", disk->Device);
+        DestroyDisk(disk);
         return OsStatusToErrno(status);
     }
     
@@ -204,6 +224,7 @@ void svc_storage_register_callback(struct gracht_recv_message* message, struct s
     disk->Driver = args->driver_id;
     disk->Device = args->device_id;
     disk->Flags  = args->flags;
+    disk->Queue  = NULL;
     // TODO: disk states
     //Disk->State = Initializing
     
@@ -249,6 +270,9 @@ void svc_storage_unregister_callback(struct gracht_recv_message* message, struct
     // Remove the disk from the list of disks
     disk = CollectionGetDataByKey(VfsGetDisks(), key, 0);
     CollectionRemoveByKey(VfsGetDisks(), key);
+    if (disk != NULL) {
+        BlockQueueDestroy(disk->Queue);
+    }
     free(disk);
 }
 
@@ -28,6 +28,7 @@
 #include <ddk/handle.h>
 #include <ddk/utils.h>
 #include "domains/domains.h"
+#include <ds/bplustree.h>
 #include <inet/local.h>
 #include <io_events.h>
 #include "manager.h"
@@ -39,8 +40,10 @@
 #include "svc_socket_protocol_server.h"
 
 // This socket tree contains all the local system sockets that were created by
-// this machine. All remote sockets are maintained by the domains
-static rb_tree_t Sockets;
+// this machine, keyed by their handle. All remote sockets are maintained by the domains.
+// Every socket operation looks its socket up here, so it is a b+ tree for the shallower
+// lookups when there are many sockets.
+static bp_tree_t Sockets;
 static UUId_t    SocketSet;
 static thrd_t    SocketMonitorHandle;
 
@@ -167,7 +170,7 @@ NetworkManagerInitialize(void)
     int        Code;
     TRACE("[net_manager] initialize");
     
-    rb_tree_construct(&Sockets);
+    bp_tree_construct(&Sockets);
     Status = handle_set_create(0, &SocketSet);
     if (Status != OsSuccess) {
         ERROR("[net_manager] failed to create socket handle set");
@@ -219,7 +222,14 @@ NetworkManagerSocketCreate(
         assert(0);
     }
     
-    rb_tree_append(&Sockets, &Socket->Header);
+    Status = bp_tree_append(&Sockets, Socket->Header.key, Socket);
+    if (Status != OsSuccess) {
+        ERROR("[net_manager] [create] failed to register socket: %u", Status);
+        (void)handle_set_ctrl(SocketSet, IO_EVT_DESCRIPTOR_DEL, (UUId_t)(uintptr_t)Socket->Header.key, 0, NULL);
+        (void)SocketShutdownImpl(Socket, SVC_SOCKET_CLOSE_OPTIONS_DESTROY);
+        return Status;
+    }
+    
     *HandleOut           = (UUId_t)(uintptr_t)Socket->Header.key;
     *SendBufferHandleOut = Socket->Send.DmaAttachment.handle;
     *RecvBufferHandleOut = Socket->Receive.DmaAttachment.handle;
@@ -255,7 +265,7 @@ NetworkManagerSocketShutdown(
     if (Options & SVC_SOCKET_CLOSE_OPTIONS_DESTROY) {
         // If removing it failed, then assume that it was already destroyed, and we just
         // encountered a race condition
-        if (!rb_tree_remove(&Sockets, (void*)(uintptr_t)Handle)) {
+        if (bp_tree_remove(&Sockets, (void*)(uintptr_t)Handle, NULL) != OsSuccess) {
             return OsDoesNotExist;
         }
         
@@ -553,5 +563,5 @@ Socket_t*
 NetworkManagerSocketGet(
     _In_ UUId_t Handle)
 {
-    return (Socket_t*)rb_tree_lookup_value(&Sockets, (void*)(uintptr_t)Handle);
+    return (Socket_t*)bp_tree_lookup_value(&Sockets, (void*)(uintptr_t)Handle);
 }
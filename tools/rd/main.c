@@ -76,11 +76,43 @@ PACKED_TYPESTRUCT(MCoreRamDiskModuleHeader, {
     uint32_t    DeviceSubType;
 });
 
+/* MCoreRamDiskModuleHeaderV2
+ * This is the module header used by version 2 ramdisks, it extends the
+ * original header with how the data following the header is stored. */
+PACKED_TYPESTRUCT(MCoreRamDiskModuleHeaderV2, {
+    uint32_t    Flags;
+    uint32_t    LengthOfData; // Excluding this header, uncompressed
+    uint32_t    Crc32OfData;  // Of the uncompressed data
+    
+    uint32_t    VendorId;
+    uint32_t    DeviceId;
+    uint32_t    DeviceType;
+    uint32_t    DeviceSubType;
+
+    uint32_t    Compression;
+    uint32_t    LengthOfStoredData;
+});
+
+#define RAMDISK_VERSION_1           0x01
+#define RAMDISK_VERSION_2           0x02
+#define RAMDISK_COMPRESSION_NONE    0x0
+#define RAMDISK_COMPRESSION_LZ4     0x1
+
+/* RamDiskFile
+ * In-memory description of a file that is going to be written to the ramdisk. */
+typedef struct RamDiskFile {
+    char                          Name[64];
+    uint32_t                      Type;
+    MCoreRamDiskModuleHeaderV2_t  Header;
+    uint8_t*                      Data;
+    uint8_t*                      StoredData;
+} RamDiskFile_t;
+
 // Statics
 uint32_t CrcTable[256] = { 0 };
 MCoreRamDiskHeader_t RdHeaderStatic = {
 	0x3144524D,
-	0x00000001,
+	RAMDISK_VERSION_2,
 	0, 0
 };
 
@@ -88,7 +120,9 @@ MCoreRamDiskHeader_t RdHeaderStatic = {
 static void ShowSyntax(void)
 {
 	printf("  Syntax:\n\n"
-           "    Build    :  rd <arch> <output>\n\n");
+           "    Build    :  rd <arch> <output> [v1]\n\n"
+           "    Version 2 ramdisks are built by default, pass v1 to build the\n"
+           "    legacy uncompressed format.\n\n");
 }
 
 /* Crc32GenerateTable
@@ -136,6 +170,124 @@ Crc32Generate(
     return CrcAccumulator;
 }
 
+/* Lz4 compression
+ * Compresses data into a single raw LZ4 block, this is a greedy compressor that
+ * uses a single hash table of previous positions. The block format requires that
+ * the last 5 bytes are literals, and that the last match starts at least 12 bytes
+ * before the end of the block. */
+#define LZ4_HASH_BITS   16
+#define LZ4_MIN_MATCH   4
+#define LZ4_MAX_OFFSET  65535
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+
+static long Lz4Bound(long Length)
+{
+    return Length + (Length / 255) + 16;
+}
+
+static uint32_t Lz4Read32(const uint8_t* Data)
+{
+    uint32_t Value;
+    memcpy(&Value, Data, sizeof(uint32_t));
+    return Value;
+}
+
+static uint32_t Lz4Hash(uint32_t Value)
+{
+    return (Value * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t* Lz4WriteLength(uint8_t* Output, long Length)
+{
+    while (Length >= 255) {
+        *(Output++) = 255;
+        Length     -= 255;
+    }
+    *(Output++) = (uint8_t)Length;
+    return Output;
+}
+
+static uint8_t* Lz4WriteSequence(uint8_t* Output, const uint8_t* Literals, long LiteralLength,
+    long Offset, long MatchLength)
+{
+    uint8_t* Token = Output++;
+    
+    *Token = (uint8_t)((LiteralLength >= 15 ? 15 : LiteralLength) << 4);
+    if (LiteralLength >= 15) {
+        Output = Lz4WriteLength(Output, LiteralLength - 15);
+    }
+    memcpy(Output, Literals, LiteralLength);
+    Output += LiteralLength;
+
+    // Last sequence has no match part
+    if (MatchLength == 0) {
+        return Output;
+    }
+
+    *(Output++) = (uint8_t)(Offset & 0xFF);
+    *(Output++) = (uint8_t)((Offset >> 8) & 0xFF);
+    MatchLength -= LZ4_MIN_MATCH;
+    *Token      |= (uint8_t)(MatchLength >= 15 ? 15 : MatchLength);
+    if (MatchLength >= 15) {
+        Output = Lz4WriteLength(Output, MatchLength - 15);
+    }
+    return Output;
+}
+
+static long Lz4Compress(const uint8_t* Input, long Length, uint8_t* Output)
+{
+    long* Table = (long*)malloc(sizeof(long) * (1 << LZ4_HASH_BITS));
+    uint8_t* OutputStart = Output;
+    long Position = 0;
+    long Anchor = 0;
+    long i;
+
+    if (Table == NULL) {
+        return -1;
+    }
+    for (i = 0; i < (1 << LZ4_HASH_BITS); i++) {
+        Table[i] = -1;
+    }
+
+    while (Position < Length - LZ4_MATCH_LIMIT) {
+        uint32_t Sequence  = Lz4Read32(&Input[Position]);
+        uint32_t Hash      = Lz4Hash(Sequence);
+        long     Reference = Table[Hash];
+        long     MatchLength;
+        Table[Hash] = Position;
+
+        if (Reference < 0 || (Position - Reference) > LZ4_MAX_OFFSET
+            || Lz4Read32(&Input[Reference]) != Sequence) {
+            Position++;
+            continue;
+        }
+
+        // Extend the match as far as the format allows
+        MatchLength = LZ4_MIN_MATCH;
+        while (Position + MatchLength < Length - LZ4_LAST_LITERALS
+            && Input[Reference + MatchLength] == Input[Position + MatchLength]) {
+            MatchLength++;
+        }
+
+        Output = Lz4WriteSequence(Output, &Input[Anchor], Position - Anchor,
+            Position - Reference, MatchLength);
+        Position += MatchLength;
+        Anchor    = Position;
+    }
+
+    // Rest is written as literals
+    Output = Lz4WriteSequence(Output, &Input[Anchor], Length - Anchor, 0, 0);
+    free(Table);
+    return (long)(Output - OutputStart);
+}
+
+// Sorts ramdisk files by their name
+static int CompareRamDiskFiles(const void* a, const void* b)
+{
+    return strcmp(((const RamDiskFile_t*)a)->Name, ((const RamDiskFile_t*)b)->Name);
+}
+
 // Determines if a file has a corresponding driver descriptor
 static FILE *GetDriver(const char *path)
 {
@@ -321,31 +473,253 @@ char *PerformRLE(char *data, long length, long *new_length)
     return rledata;
 }
 
+// Loads the driver descriptor values into the module header
+static void LoadDriverDescriptor(FILE *drvdata, char **tokens, MCoreRamDiskModuleHeaderV2_t *header)
+{
+    int tokencount;
+    while (1) {
+        int result = GetNextLine(drvdata, tokens, &tokencount);
+        if (tokencount >= 3) {
+            // Skip comments
+            if (strncmp(tokens[0], "#", 1)) {
+                if (!strcmp(tokens[0], "VendorId")) {
+                    header->VendorId = (uint32_t)strtol(tokens[2], NULL, 16);
+                }
+                if (!strcmp(tokens[0], "DeviceId")) {
+                    header->DeviceId = (uint32_t)strtol(tokens[2], NULL, 16);
+                }
+                if (!strcmp(tokens[0], "Class")) {
+                    header->DeviceType = (uint32_t)strtol(tokens[2], NULL, 16);
+                }
+                if (!strcmp(tokens[0], "SubClass")) {
+                    header->DeviceSubType = (uint32_t)strtol(tokens[2], NULL, 16);
+                }
+                if (!strcmp(tokens[0], "Flags")) {
+                    header->Flags = (uint32_t)strtol(tokens[2], NULL, 16);
+                }
+            }
+        }
+
+        // Break on end of file
+        if (result) {
+            break;
+        }
+    }
+}
+
+// Reads all the files from the initrd folder
+static int LoadRamDiskFiles(RamDiskFile_t **filesOut, int *countOut)
+{
+    struct dirent *dp = NULL;
+    RamDiskFile_t *files = NULL;
+    char filename_buffer[512];
+    DIR *dfd = NULL;
+    char **tokens;
+    int count = 0;
+    int capacity = 0;
+
+    if ((dfd = opendir("initrd")) == NULL) {
+        fprintf(stderr, "Can't open initrd folder\n");
+        return 1;
+    }
+
+    // Init token storage
+    tokens = (char**)malloc(sizeof(char*) * 24);
+    for (int i = 0; i < 24; i++)
+        tokens[i] = (char*)malloc(64);
+
+    while ((dp = readdir(dfd)) != NULL) {
+        struct stat stbuf;
+        RamDiskFile_t *file;
+        FILE *drvdata;
+        FILE *entry;
+        long fsize;
+
+        // Build path string
+        sprintf(filename_buffer, "initrd/%s", dp->d_name);
+        if (stat(filename_buffer, &stbuf) == -1) {
+            printf("Unable to stat file: %s\n", filename_buffer);
+            continue;
+        }
+
+        // Skip directories
+        if ((stbuf.st_mode & S_IFMT) == S_IFDIR) {
+            continue;
+        }
+
+        // Skip everything that is not dll's or .bmp's
+        char *dot = strrchr(dp->d_name, '.');
+        if (!dot || (strcmp(dot, ".dll") && strcmp(dot, ".bmp"))) {
+            continue;
+        }
+
+        if (strlen(dp->d_name) >= 64) {
+            printf("skipping %s, name is too long\n", dp->d_name);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            files = (RamDiskFile_t*)realloc(files, sizeof(RamDiskFile_t) * capacity);
+        }
+        file = &files[count++];
+        memset(file, 0, sizeof(RamDiskFile_t));
+        strcpy(file->Name, dp->d_name);
+
+        // Is it a driver? check if file exists with .drvm extension
+        drvdata = GetDriver(filename_buffer);
+        file->Type = drvdata == NULL ? 0x1 : 0x4;
+        if (drvdata != NULL) {
+            LoadDriverDescriptor(drvdata, tokens, &file->Header);
+            fclose(drvdata);
+        }
+
+        // Load file data
+        entry = fopen(filename_buffer, "rb");
+        fseek(entry, 0, SEEK_END);
+        fsize = ftell(entry);
+        file->Data = malloc(fsize);
+        rewind(entry);
+        fread(file->Data, 1, fsize, entry);
+        fclose(entry);
+
+        file->Header.LengthOfData = (uint32_t)fsize;
+        file->Header.Crc32OfData  = Crc32Generate(-1, file->Data, fsize);
+    }
+    closedir(dfd);
+
+    for (int i = 0; i < 24; i++)
+        free(tokens[i]);
+    free(tokens);
+
+    // Sort the files by name to make the image deterministic
+    if (count) {
+        qsort(files, count, sizeof(RamDiskFile_t), CompareRamDiskFiles);
+    }
+    *filesOut = files;
+    *countOut = count;
+    return 0;
+}
+
+// Writes the legacy version 1 format, where the entry table is a fixed page
+static int WriteRamDiskV1(FILE *out, RamDiskFile_t *files, int count)
+{
+    long fentrypos, fdatapos;
+    char *dataptr;
+
+    if (sizeof(MCoreRamDiskHeader_t) + (count * sizeof(MCoreRamDiskEntry_t)) > 0x1000) {
+        printf("too many files (%i) for a version 1 ramdisk\n", count);
+        return 1;
+    }
+
+    RdHeaderStatic.Version = RAMDISK_VERSION_1;
+    fwrite(&RdHeaderStatic, 1, sizeof(MCoreRamDiskHeader_t), out);
+    fentrypos = ftell(out);
+
+    // Fill rest of entry space with 0
+    dataptr = calloc(1, 0x1000 - sizeof(MCoreRamDiskHeader_t));
+    fwrite(dataptr, 1, 0x1000 - sizeof(MCoreRamDiskHeader_t), out);
+    free(dataptr);
+    fdatapos = ftell(out);
+
+    for (int i = 0; i < count; i++) {
+        MCoreRamDiskEntry_t rdentry = { { 0 }, 0 };
+        MCoreRamDiskModuleHeader_t rddataheader;
+
+        memcpy(&rdentry.Name[0], files[i].Name, strlen(files[i].Name));
+        rdentry.Type = files[i].Type;
+        rdentry.DataHeaderOffset = (uint32_t)fdatapos;
+        fseek(out, fentrypos, SEEK_SET);
+        fwrite(&rdentry, sizeof(MCoreRamDiskEntry_t), 1, out);
+        fentrypos = ftell(out);
+
+        // The version 1 header is the prefix of the version 2 header
+        memcpy(&rddataheader, &files[i].Header, sizeof(MCoreRamDiskModuleHeader_t));
+        fseek(out, fdatapos, SEEK_SET);
+        fwrite(&rddataheader, sizeof(MCoreRamDiskModuleHeader_t), 1, out);
+        fwrite(files[i].Data, 1, files[i].Header.LengthOfData, out);
+        fdatapos = ftell(out);
+    }
+    return 0;
+}
+
+// Writes the version 2 format, the entry table is sized to the number of files and
+// every file is compressed if that makes it smaller
+static int WriteRamDiskV2(FILE *out, RamDiskFile_t *files, int count)
+{
+    long fdatapos;
+
+    for (int i = 0; i < count; i++) {
+        long length = files[i].Header.LengthOfData;
+        long compressed;
+
+        files[i].StoredData = (uint8_t*)malloc(Lz4Bound(length));
+        compressed = Lz4Compress(files[i].Data, length, files[i].StoredData);
+        if (compressed > 0 && compressed < length) {
+            files[i].Header.Compression        = RAMDISK_COMPRESSION_LZ4;
+            files[i].Header.LengthOfStoredData = (uint32_t)compressed;
+        }
+        else {
+            free(files[i].StoredData);
+            files[i].StoredData                = files[i].Data;
+            files[i].Header.Compression        = RAMDISK_COMPRESSION_NONE;
+            files[i].Header.LengthOfStoredData = (uint32_t)length;
+        }
+        printf("writing %s to rd (%s, %u -> %u bytes)\n", files[i].Name,
+            files[i].Type == 0x4 ? "driver" : "file", 
+            files[i].Header.LengthOfData, files[i].Header.LengthOfStoredData);
+    }
+
+    RdHeaderStatic.Version = RAMDISK_VERSION_2;
+    fwrite(&RdHeaderStatic, 1, sizeof(MCoreRamDiskHeader_t), out);
+
+    fdatapos = sizeof(MCoreRamDiskHeader_t) + (count * sizeof(MCoreRamDiskEntry_t));
+    for (int i = 0; i < count; i++) {
+        MCoreRamDiskEntry_t rdentry = { { 0 }, 0 };
+        memcpy(&rdentry.Name[0], files[i].Name, strlen(files[i].Name));
+        rdentry.Type = files[i].Type;
+        rdentry.DataHeaderOffset = (uint32_t)fdatapos;
+        fwrite(&rdentry, sizeof(MCoreRamDiskEntry_t), 1, out);
+        fdatapos += sizeof(MCoreRamDiskModuleHeaderV2_t) + files[i].Header.LengthOfStoredData;
+    }
+
+    for (int i = 0; i < count; i++) {
+        fwrite(&files[i].Header, sizeof(MCoreRamDiskModuleHeaderV2_t), 1, out);
+        fwrite(files[i].StoredData, 1, files[i].Header.LengthOfStoredData, out);
+    }
+    return 0;
+}
+
 // main
 int main(int argc, char *argv[])
 {
-	// Variables
-	struct dirent *dp = NULL;
-	char *filename_buffer;
-	char *dataptr = NULL;
+	RamDiskFile_t *files = NULL;
 	FILE *out = NULL;
-	DIR *dfd = NULL;
-	long fentrypos = 0;
-	long fdatapos = 0;
-	char **tokens;
-	int tokencount;
+	int filecount = 0;
+	int version = RAMDISK_VERSION_2;
+	uint64_t totalsize = 0;
+	long imagesize;
+	int result;
 
 	// Print header
 	printf("MollenOS Ramdisk Builder\n"
            "Copyright 2017 Philip Meulengracht (www.mollenos.com)\n\n");
 
 	// Validate the number of arguments
-	// format: rd $(arch) $(out)
-	if (argc != 3) {
+	// format: rd $(arch) $(out) [v1]
+	if (argc != 3 && argc != 4) {
 		ShowSyntax();
 		return 1;
 	}
 
+	if (argc == 4) {
+		if (strcmp(argv[3], "v1")) {
+			ShowSyntax();
+			return 1;
+		}
+		version = RAMDISK_VERSION_1;
+	}
+
 	// Create the output file
 	out = fopen(argv[2], "wb+");
 	if (out == NULL) {
@@ -366,189 +740,36 @@ int main(int argc, char *argv[])
 	    RdHeaderStatic.Architecture = 0x10;
     }
 
-	RdHeaderStatic.FileCount = 0;
-
-    // Open directory
-    printf("Counting available files for rd\n");
-	if ((dfd = opendir("initrd")) == NULL) {
-		fprintf(stderr, "Can't open initrd folder\n");
-		return 1;
-	}
-
-	// Count files of type .dll
-	while ((dp = readdir(dfd)) != NULL) {
-		char *dot = strrchr(dp->d_name, '.');
-		if (dot && !strcmp(dot, ".dll")) {
-			RdHeaderStatic.FileCount++;
-		}
-	}
-
-	// Rewind
-	rewinddir(dfd);
-
-    // Write header
-    printf("Generating ramdisk header\n");
-	fwrite(&RdHeaderStatic, 1, sizeof(MCoreRamDiskHeader_t), out);
-	fflush(out);
+    printf("Loading files for rd\n");
+    if (LoadRamDiskFiles(&files, &filecount)) {
+        fclose(out);
+        return 1;
+    }
+	RdHeaderStatic.FileCount = filecount;
 
-	// Store current position
-	fentrypos = ftell(out);
+    printf("Generating version %i ramdisk\n", version);
+    if (version == RAMDISK_VERSION_1) {
+        result = WriteRamDiskV1(out, files, filecount);
+    }
+    else {
+        result = WriteRamDiskV2(out, files, filecount);
+    }
 
-	// Fill rest of entry space with 0
-	dataptr = malloc(0x1000 - sizeof(MCoreRamDiskHeader_t));
-	memset(dataptr, 0, 0x1000 - sizeof(MCoreRamDiskHeader_t));
-	fwrite(dataptr, 1, 0x1000 - sizeof(MCoreRamDiskHeader_t), out);
-	free(dataptr);
 	fflush(out);
-	fdatapos = ftell(out);
-
-	// Init token storage
-	tokens = (char**)malloc(sizeof(char*) * 24);
-	for (int i = 0; i < 24; i++)
-		tokens[i] = (char*)malloc(64);
-
-    // Iterate entries
-    printf("Generating ramdisk entries\n");
-    filename_buffer = malloc(512);
-	while ((dp = readdir(dfd)) != NULL) {
-		struct stat stbuf;
-
-		// Build path string
-		sprintf(filename_buffer, "initrd/%s", dp->d_name);
-		if (stat(filename_buffer, &stbuf) == -1) {
-			printf("Unable to stat file: %s\n", filename_buffer);
-			continue;
-		}
-
-		// Skip directories
-		if ((stbuf.st_mode & S_IFMT) == S_IFDIR) {
-			continue;
-		}
-		else {
-            // Variables
-            MCoreRamDiskEntry_t rdentry = { { 0 }, 0 };
-            MCoreRamDiskModuleHeader_t rddataheader = { 0 };
-            
-            // Skip everything that is not dll's or .bmp's
-            char *dot = strrchr(dp->d_name, '.');
-			if (!dot || (strcmp(dot, ".dll") && strcmp(dot, ".bmp"))) {
-				continue;
-			}
-
-			// Is it a driver? check if file exists with .drvm extension
-			FILE *drvdata = GetDriver(filename_buffer);
-			FILE *entry = NULL;
-			char *name = NULL;
-			uint32_t type = drvdata == NULL ? 0x1 : 0x4;
-			uint32_t vendorid = 0;
-			uint32_t deviceid = 0;
-			uint32_t dclass = 0;
-			uint32_t dsubclass = 0;
-			uint32_t dflags = 0;
-			long fsize = 0;
-
-			// Debug print
-			if (drvdata != NULL) {
-				printf("writing %s to rd (driver)\n", dp->d_name);
-			}
-			else {
-				printf("writing %s to rd (file)\n", dp->d_name);
-			}
-
-			// Seek to entry pos
-            fseek(out, fentrypos, SEEK_SET);
-            
-            // fill entry
-            memcpy(&rdentry.Name[0], dp->d_name, strlen(dp->d_name));
-            rdentry.Type = type;
-            rdentry.DataHeaderOffset = fdatapos;
-
-			// Write header data
-			fwrite(&rdentry, sizeof(MCoreRamDiskEntry_t), 1, out);
-			fflush(out);
-
-			// Update entry
-			fentrypos = ftell(out);
-
-			// Seek to data
-            fseek(out, fdatapos, SEEK_SET);
-            
-			// Load driver data?
-			if (drvdata != NULL) {
-				while (1) {
-					int result = GetNextLine(drvdata, tokens, &tokencount);
-					if (tokencount >= 3) {
-						// Skip comments
-						if (strncmp(tokens[0], "#", 1)) {
-							if (!strcmp(tokens[0], "VendorId")) {
-								vendorid = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "DeviceId")) {
-								deviceid = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "Class")) {
-								dclass = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "SubClass")) {
-								dsubclass = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "Flags")) {
-								dflags = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-						}
-					}
-
-					// Break on end of file
-					if (result) {
-						break;
-					}
-				}
-				
-				// Cleanup
-				fclose(drvdata);
-            }
-            
-            // Update rest of header
-            rddataheader.VendorId       = vendorid;
-            rddataheader.DeviceId       = deviceid;
-            rddataheader.DeviceType     = dclass;
-            rddataheader.DeviceSubType  = dsubclass;
-            rddataheader.Flags          = dflags;
-
-			// Load file data
-            entry = fopen(filename_buffer, "rb+");
-            fseek(entry, 0, SEEK_END);
-            fsize = ftell(entry);
-            dataptr = malloc(fsize);
-            rewind(entry);
-            fread(dataptr, 1, fsize, entry);
-            fclose(entry);
-
-            // Bmp is the only supported image form, which we automatically run RLE on
-            if (!strcmp(dot, ".bmp")) {
-
-            }
-            
-			// Write data header
-            rddataheader.LengthOfData   = fsize;
-            rddataheader.Crc32OfData    = Crc32Generate(-1, (uint8_t*)dataptr, fsize);
-			fwrite(&rddataheader, sizeof(MCoreRamDiskModuleHeader_t), 1, out);
-
-			// Write file data
-			fwrite(dataptr, 1, fsize, out);
-			fflush(out);
-			free(dataptr);
-
-			// Update data
-			fdatapos = ftell(out);
-		}
-	}
-
-	// Close directory
-	closedir(dfd);
+    imagesize = ftell(out);
+    for (int i = 0; i < filecount; i++) {
+        totalsize += files[i].Header.LengthOfData;
+        if (files[i].StoredData != NULL && files[i].StoredData != files[i].Data) {
+            free(files[i].StoredData);
+        }
+        free(files[i].Data);
+    }
+    free(files);
 
-	// Close and cleanup
-	fflush(out);
-    free(tokens);
-	return fclose(out);
+    printf("Ramdisk contains %i files, %llu bytes of data in a %li byte image\n",
+        filecount, (unsigned long long)totalsize, imagesize);
+	if (fclose(out) || result) {
+        return 1;
+    }
+	return 0;
 }